@@ -0,0 +1,220 @@
+/*
+
+Copyright (c) 2014 Harm Hanemaaijer <fgenfb@yahoo.com>
+
+Permission to use, copy, modify, and/or distribute this software for any
+purpose with or without fee is hereby granted, provided that the above
+copyright notice and this permission notice appear in all copies.
+
+THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+
+*/
+
+// Bounding volume hierarchy for dynamic objects.
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <math.h>
+#include <float.h>
+
+#include "sre.h"
+#include "sre_internal.h"
+#include "sre_bounds.h"
+
+// The leaf bounds are enlarged by this fraction of the object's bounding sphere radius
+// in every direction.
+#define SRE_BVH_LEAF_MARGIN_FACTOR 0.25f
+// Rebuild the tree when the summed surface area of the nodes has grown beyond this factor
+// of the value directly after creation.
+#define SRE_BVH_REBUILD_COST_FACTOR 2.0f
+
+static float SurfaceArea(const sreBoundingVolumeAABB& AABB) {
+    Vector3D extents = AABB.dim_max - AABB.dim_min;
+    return 2.0f * (extents.x * extents.y + extents.y * extents.z + extents.z * extents.x);
+}
+
+// Set the node's AABB and derive the bounding sphere from it.
+
+static void SetNodeBounds(sreObjectBVHNode& node, const sreBoundingVolumeAABB& AABB) {
+    node.bounds.AABB = AABB;
+    node.bounds.sphere.center = (AABB.dim_min + AABB.dim_max) * 0.5f;
+    node.bounds.sphere.radius = Magnitude(AABB.dim_max - AABB.dim_min) * 0.5f;
+}
+
+// Calculate the AABB of an object based on its bounding sphere, which is always kept
+// up-to-date for dynamic objects, enlarged by the given margin.
+
+static void CalculateObjectAABB(const sreObject& so, float margin, sreBoundingVolumeAABB& AABB) {
+    float extent = so.sphere.radius + margin;
+    AABB.dim_min = so.sphere.center - Vector3D(extent, extent, extent);
+    AABB.dim_max = so.sphere.center + Vector3D(extent, extent, extent);
+}
+
+sreObjectBVH::sreObjectBVH() {
+    node = NULL;
+    nu_nodes = 0;
+    leaf_node = NULL;
+    max_object_index = 0;
+    changed_leaf = NULL;
+    nu_changed_leafs = 0;
+}
+
+sreObjectBVH::~sreObjectBVH() {
+    delete [] node;
+    delete [] leaf_node;
+    delete [] changed_leaf;
+}
+
+// Recursively build the subtree for n objects, returning the node index of its root.
+// The object index array is reordered in the process.
+
+static int BuildSubtree(sreObjectBVH& bvh, const sreScene& scene, int *object_index, int n,
+int parent) {
+    int node_index = bvh.nu_nodes;
+    bvh.nu_nodes++;
+    sreObjectBVHNode& node = bvh.node[node_index];
+    node.parent = parent;
+    node.changed = false;
+    if (n == 1) {
+        const sreObject& so = *scene.object[object_index[0]];
+        sreBoundingVolumeAABB AABB;
+        CalculateObjectAABB(so, SRE_BVH_LEAF_MARGIN_FACTOR * so.sphere.radius, AABB);
+        SetNodeBounds(node, AABB);
+        node.child[0] = - 1;
+        node.child[1] = - 1;
+        node.object_index = object_index[0];
+        bvh.leaf_node[object_index[0]] = node_index;
+        return node_index;
+    }
+    // Split at the middle of the largest dimension of the AABB of the object centers.
+    sreBoundingVolumeAABB centers_AABB;
+    centers_AABB.dim_min = Vector3D(FLT_MAX, FLT_MAX, FLT_MAX);
+    centers_AABB.dim_max = Vector3D(- FLT_MAX, - FLT_MAX, - FLT_MAX);
+    for (int i = 0; i < n; i++)
+        UpdateAABB(centers_AABB, scene.object[object_index[i]]->sphere.center);
+    Vector3D extents = centers_AABB.dim_max - centers_AABB.dim_min;
+    int axis = 0;
+    if (extents.y > extents.x)
+        axis = 1;
+    if (extents.z > extents[axis])
+        axis = 2;
+    float split = (centers_AABB.dim_min[axis] + centers_AABB.dim_max[axis]) * 0.5f;
+    int k = 0;
+    for (int i = 0; i < n; i++)
+        if (scene.object[object_index[i]]->sphere.center[axis] < split) {
+            int temp = object_index[k];
+            object_index[k] = object_index[i];
+            object_index[i] = temp;
+            k++;
+        }
+    // When all objects end up on one side (for example when the centers coincide), split
+    // the array in half.
+    if (k == 0 || k == n)
+        k = n / 2;
+    // Note: the node array has been allocated in advance, so the reference stays valid.
+    node.child[0] = BuildSubtree(bvh, scene, object_index, k, node_index);
+    node.child[1] = BuildSubtree(bvh, scene, &object_index[k], n - k, node_index);
+    node.object_index = - 1;
+    sreBoundingVolumeAABB AABB = bvh.node[node.child[0]].bounds.AABB;
+    UpdateAABB(AABB, bvh.node[node.child[1]].bounds.AABB);
+    SetNodeBounds(node, AABB);
+    return node_index;
+}
+
+// Build the BVH for the given list of scene object indices.
+
+void sreObjectBVH::Build(const sreScene& scene, int nu_objects, const int *object_index) {
+    delete [] node;
+    delete [] leaf_node;
+    delete [] changed_leaf;
+    max_object_index = scene.max_objects;
+    leaf_node = new int[max_object_index];
+    for (int i = 0; i < max_object_index; i++)
+        leaf_node[i] = - 1;
+    changed_leaf = new int[nu_objects];
+    nu_changed_leafs = 0;
+    nu_nodes = 0;
+    if (nu_objects == 0) {
+        node = NULL;
+        build_cost = cost = 0;
+        return;
+    }
+    node = new sreObjectBVHNode[nu_objects * 2 - 1];
+    int *temp_object_index = new int[nu_objects];
+    for (int i = 0; i < nu_objects; i++)
+        temp_object_index[i] = object_index[i];
+    BuildSubtree(*this, scene, temp_object_index, nu_objects, - 1);
+    delete [] temp_object_index;
+    build_cost = 0;
+    for (int i = 0; i < nu_nodes; i++)
+        build_cost += SurfaceArea(node[i].bounds.AABB);
+    cost = build_cost;
+}
+
+// Register that the position, orientation or size of an object has changed. Objects that
+// are not part of the BVH are ignored.
+
+void sreObjectBVH::MarkObjectChanged(int object_index) {
+    if (object_index >= max_object_index)
+        return;
+    int i = leaf_node[object_index];
+    if (i < 0 || node[i].changed)
+        return;
+    node[i].changed = true;
+    changed_leaf[nu_changed_leafs] = i;
+    nu_changed_leafs++;
+}
+
+// Refit the tree for the objects that have changed since the last update. Only leafs whose
+// object has moved outside the enlarged leaf bounds, and their ancestors, are updated.
+
+void sreObjectBVH::Update(const sreScene& scene) {
+    if (nu_changed_leafs == 0)
+        return;
+    for (int i = 0; i < nu_changed_leafs; i++) {
+        int node_index = changed_leaf[i];
+        node[node_index].changed = false;
+        const sreObject& so = *scene.object[node[node_index].object_index];
+        sreBoundingVolumeAABB AABB;
+        CalculateObjectAABB(so, 0, AABB);
+        if (IsCompletelyInside(AABB, node[node_index].bounds.AABB))
+            continue;
+        CalculateObjectAABB(so, SRE_BVH_LEAF_MARGIN_FACTOR * so.sphere.radius, AABB);
+        for (;;) {
+            sreObjectBVHNode& n = node[node_index];
+            cost += SurfaceArea(AABB) - SurfaceArea(n.bounds.AABB);
+            SetNodeBounds(n, AABB);
+            node_index = n.parent;
+            if (node_index < 0)
+                break;
+            // Recalculate the parent's AABB from its children; when it is unchanged,
+            // the ancestors do not change either.
+            AABB = node[node[node_index].child[0]].bounds.AABB;
+            UpdateAABB(AABB, node[node[node_index].child[1]].bounds.AABB);
+            const sreBoundingVolumeAABB& old_AABB = node[node_index].bounds.AABB;
+            if (AABB.dim_min == old_AABB.dim_min && AABB.dim_max == old_AABB.dim_max)
+                break;
+        }
+    }
+    nu_changed_leafs = 0;
+    if (cost > SRE_BVH_REBUILD_COST_FACTOR * build_cost) {
+        // The tree has degraded too much; rebuild it with the same set of objects.
+        int nu_objects = (nu_nodes + 1) / 2;
+        int *object_index = new int[nu_objects];
+        int j = 0;
+        for (int i = 0; i < nu_nodes; i++)
+            if (node[i].child[0] < 0) {
+                object_index[j] = node[i].object_index;
+                j++;
+            }
+        sreMessage(SRE_MESSAGE_LOG, "Rebuilding dynamic object BVH (%d objects).", nu_objects);
+        Build(scene, nu_objects, object_index);
+        delete [] object_index;
+    }
+}
@@ -0,0 +1,302 @@
+/*
+
+Copyright (c) 2014 Harm Hanemaaijer <fgenfb@yahoo.com>
+
+Permission to use, copy, modify, and/or distribute this software for any
+purpose with or without fee is hereby granted, provided that the above
+copyright notice and this permission notice appear in all copies.
+
+THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+
+*/
+
+// Clustered forward lighting.
+//
+// Multi-pass rendering draws every lit object once for every light that affects it,
+// while regular single-pass rendering only applies the most prominent light. With
+// clustered lighting, the view frustum is divided into a grid of clusters: screen tiles
+// that are subdivided into depth slices with exponentially increasing thickness. Before
+// the single pass, each visible light is assigned to the clusters overlapped by its
+// bounding sphere, and the light parameters and the per-cluster light lists are uploaded
+// into texture buffers. The clustered single-pass shader determines the cluster of each
+// fragment and applies all lights in its list, so that every object is drawn only once.
+//
+// Directional lights are stored first in the light data and are applied to every
+// fragment. Shadows are not supported.
+//
+// Light data layout (four RGBA32F texels per light):
+//     0: position (direction for directional lights), linear attenuation range
+//     1: color, type (0 = directional, 1 = point source, 2 = spot, 3 = beam)
+//     2: axis direction, spot exponent or beam radius
+//     3: beam axis cut-off distance, beam radial linear attenuation range
+// Light list layout (R32UI): the offset and light count of each cluster, followed by
+// the light indices of all clusters.
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+#ifdef OPENGL_ES2
+#include <GLES2/gl2.h>
+#endif
+#ifdef OPENGL
+#include <GL/glew.h>
+#include <GL/gl.h>
+#endif
+
+#include "sre.h"
+#include "sre_internal.h"
+#include "shader.h"
+
+#define SRE_CLUSTER_LIGHT_DATA_TEXELS 4
+
+#ifndef OPENGL_ES2
+
+static GLuint light_data_buffer, light_data_texture;
+static GLuint light_list_buffer, light_list_texture;
+static float light_data[SRE_MAX_CLUSTERED_LIGHTS * SRE_CLUSTER_LIGHT_DATA_TEXELS * 4];
+// The range of clusters overlapped by each local light (x, y and z begin and end).
+static int light_cluster_range[SRE_MAX_CLUSTERED_LIGHTS][6];
+static unsigned int *light_list = NULL;
+static int max_light_list_size = 0;
+static int nu_directional_lights;
+// Depth slice parameters of the current frame.
+static float depth_slice_scale;
+static float depth_slice_bias;
+
+#endif
+
+void sreInitializeClusteredLighting() {
+#ifdef OPENGL_ES2
+    sreMessage(SRE_MESSAGE_INFO, "Clustered lighting not supported with OpenGL-ES 2.0.");
+#else
+    if (!GLEW_VERSION_3_1 && !GLEW_ARB_texture_buffer_object) {
+        sreMessage(SRE_MESSAGE_INFO, "Clustered lighting not available (no texture buffer objects).");
+        return;
+    }
+    glGenBuffers(1, &light_data_buffer);
+    glGenBuffers(1, &light_list_buffer);
+    glGenTextures(1, &light_data_texture);
+    glGenTextures(1, &light_list_texture);
+    glBindBuffer(GL_TEXTURE_BUFFER, light_data_buffer);
+    glBufferData(GL_TEXTURE_BUFFER, sizeof(light_data), NULL, GL_STREAM_DRAW);
+    glBindTexture(GL_TEXTURE_BUFFER, light_data_texture);
+    glTexBuffer(GL_TEXTURE_BUFFER, GL_RGBA32F, light_data_buffer);
+    glBindBuffer(GL_TEXTURE_BUFFER, light_list_buffer);
+    glBufferData(GL_TEXTURE_BUFFER, SRE_NU_CLUSTERS * 2 * sizeof(unsigned int), NULL,
+        GL_STREAM_DRAW);
+    glBindTexture(GL_TEXTURE_BUFFER, light_list_texture);
+    glTexBuffer(GL_TEXTURE_BUFFER, GL_R32UI, light_list_buffer);
+    glBindTexture(GL_TEXTURE_BUFFER, 0);
+    glBindBuffer(GL_TEXTURE_BUFFER, 0);
+    CHECK_GL_ERROR("Error after clustered lighting initialization.\n");
+    sre_internal_rendering_flags |= SRE_RENDERING_FLAG_CLUSTERED_LIGHTING_SUPPORT;
+    sreMessage(SRE_MESSAGE_INFO, "Clustered lighting supported (disabled by default).");
+#endif
+}
+
+#ifndef OPENGL_ES2
+
+static void StoreLightData(int i, const sreLight& l) {
+    float *data = &light_data[i * SRE_CLUSTER_LIGHT_DATA_TEXELS * 4];
+    memset(data, 0, sizeof(float) * SRE_CLUSTER_LIGHT_DATA_TEXELS * 4);
+    data[0] = l.vector.x;
+    data[1] = l.vector.y;
+    data[2] = l.vector.z;
+    data[4] = l.color.r;
+    data[5] = l.color.g;
+    data[6] = l.color.b;
+    if (l.type & SRE_LIGHT_DIRECTIONAL)
+        return;
+    data[3] = l.attenuation.x;
+    data[8] = l.spotlight.x;
+    data[9] = l.spotlight.y;
+    data[10] = l.spotlight.z;
+    data[11] = l.spotlight.w;
+    if (l.type & SRE_LIGHT_POINT_SOURCE)
+        data[7] = 1.0f;
+    else if (l.type & SRE_LIGHT_SPOT)
+        data[7] = 2.0f;
+    else {
+        data[7] = 3.0f;
+        data[12] = l.attenuation.y;
+        data[13] = l.attenuation.z;
+    }
+}
+
+static inline int DepthSlice(float depth) {
+    int slice = (int)floorf(logf(depth) * depth_slice_scale + depth_slice_bias);
+    if (slice < 0)
+        return 0;
+    if (slice >= SRE_CLUSTER_GRID_Z)
+        return SRE_CLUSTER_GRID_Z - 1;
+    return slice;
+}
+
+static inline int ScreenTile(float ndc, int n) {
+    int tile = (int)floorf((ndc * 0.5f + 0.5f) * n);
+    if (tile < 0)
+        return 0;
+    if (tile >= n)
+        return n - 1;
+    return tile;
+}
+
+// Determine the range of clusters overlapped by the bounding sphere of a local light.
+// Returns false when the light is completely behind the near plane.
+
+static bool CalculateLightClusterRange(const sreLight& l, int *range) {
+    const Point3D& center = l.sphere.center;
+    float radius = l.sphere.radius;
+    float depth = Dot(center - sre_internal_viewpoint, sre_internal_camera_vector);
+    if (depth + radius < sre_internal_near_plane_distance)
+        return false;
+    range[4] = DepthSlice(maxf(depth - radius, sre_internal_near_plane_distance));
+    range[5] = DepthSlice(depth + radius) + 1;
+    range[0] = 0;
+    range[1] = SRE_CLUSTER_GRID_X;
+    range[2] = 0;
+    range[3] = SRE_CLUSTER_GRID_Y;
+    // Project the corners of the bounding box of the sphere to determine the range of
+    // screen tiles. When a corner is in front of the near plane, all tiles are used.
+    float x_min = 1.0f, x_max = - 1.0f, y_min = 1.0f, y_max = - 1.0f;
+    for (int i = 0; i < 8; i++) {
+        Vector4D P = Vector4D(
+            center.x + ((i & 1) ? radius : - radius),
+            center.y + ((i & 2) ? radius : - radius),
+            center.z + ((i & 4) ? radius : - radius), 1.0f);
+        Vector4D P_proj = sre_internal_view_projection_matrix * P;
+        if (P_proj.w < sre_internal_near_plane_distance)
+            return true;
+        float x = P_proj.x / P_proj.w;
+        float y = P_proj.y / P_proj.w;
+        x_min = minf(x_min, x);
+        x_max = maxf(x_max, x);
+        y_min = minf(y_min, y);
+        y_max = maxf(y_max, y);
+    }
+    if (x_min > 1.0f || x_max < - 1.0f || y_min > 1.0f || y_max < - 1.0f)
+        return false;
+    range[0] = ScreenTile(x_min, SRE_CLUSTER_GRID_X);
+    range[1] = ScreenTile(x_max, SRE_CLUSTER_GRID_X) + 1;
+    range[2] = ScreenTile(y_min, SRE_CLUSTER_GRID_Y);
+    range[3] = ScreenTile(y_max, SRE_CLUSTER_GRID_Y) + 1;
+    return true;
+}
+
+static void AllocateLightList(int size) {
+    if (size <= max_light_list_size)
+        return;
+    if (light_list != NULL)
+        delete [] light_list;
+    max_light_list_size = size * 2;
+    light_list = new unsigned int[max_light_list_size];
+}
+
+#endif
+
+// Assign the visible lights of the scene to the clusters of the current view and upload
+// the light data and light lists. Called before the single pass when clustered lighting
+// is enabled, after visible entity determination.
+
+void sreAssignLightsToClusters(sreScene *scene) {
+#ifndef OPENGL_ES2
+    float near_distance = sre_internal_near_plane_distance;
+    float far_distance = sre_internal_far_plane_distance;
+    depth_slice_scale = SRE_CLUSTER_GRID_Z / logf(far_distance / near_distance);
+    depth_slice_bias = - logf(near_distance) * depth_slice_scale;
+
+    // Store the directional lights first, followed by the local lights.
+    int nu_lights = 0;
+    for (int i = 0; i < scene->visible_light_array.Size(); i++) {
+        const sreLight *l = scene->light[scene->visible_light_array.Get(i)];
+        if ((l->type & SRE_LIGHT_DIRECTIONAL) && nu_lights < SRE_MAX_CLUSTERED_LIGHTS) {
+            StoreLightData(nu_lights, *l);
+            nu_lights++;
+        }
+    }
+    nu_directional_lights = nu_lights;
+    int cluster_count[SRE_NU_CLUSTERS];
+    memset(cluster_count, 0, sizeof(cluster_count));
+    int total_count = 0;
+    for (int i = 0; i < scene->visible_light_array.Size(); i++) {
+        const sreLight *l = scene->light[scene->visible_light_array.Get(i)];
+        // Only local lights with a linear attenuation range are supported.
+        if ((l->type & SRE_LIGHT_DIRECTIONAL) || !(l->type & SRE_LIGHT_LINEAR_ATTENUATION_RANGE))
+            continue;
+        if (nu_lights == SRE_MAX_CLUSTERED_LIGHTS)
+            break;
+        int *range = light_cluster_range[nu_lights];
+        if (!CalculateLightClusterRange(*l, range))
+            continue;
+        for (int z = range[4]; z < range[5]; z++)
+            for (int y = range[2]; y < range[3]; y++)
+                for (int x = range[0]; x < range[1]; x++)
+                    cluster_count[(z * SRE_CLUSTER_GRID_Y + y) * SRE_CLUSTER_GRID_X + x]++;
+        total_count += (range[5] - range[4]) * (range[3] - range[2]) * (range[1] - range[0]);
+        StoreLightData(nu_lights, *l);
+        nu_lights++;
+    }
+
+    // Calculate the offset of each cluster's light list, and fill in the lists.
+    AllocateLightList(SRE_NU_CLUSTERS * 2 + total_count);
+    unsigned int offset = SRE_NU_CLUSTERS * 2;
+    for (int i = 0; i < SRE_NU_CLUSTERS; i++) {
+        light_list[i * 2] = offset;
+        light_list[i * 2 + 1] = 0;
+        offset += cluster_count[i];
+    }
+    for (int i = nu_directional_lights; i < nu_lights; i++) {
+        const int *range = light_cluster_range[i];
+        for (int z = range[4]; z < range[5]; z++)
+            for (int y = range[2]; y < range[3]; y++)
+                for (int x = range[0]; x < range[1]; x++) {
+                    int cluster = (z * SRE_CLUSTER_GRID_Y + y) * SRE_CLUSTER_GRID_X + x;
+                    light_list[light_list[cluster * 2] + light_list[cluster * 2 + 1]] = i;
+                    light_list[cluster * 2 + 1]++;
+                }
+    }
+
+    // Upload the data, specifying a new data store so that the driver does not have to
+    // wait for the previous frame.
+    glBindBuffer(GL_TEXTURE_BUFFER, light_data_buffer);
+    glBufferData(GL_TEXTURE_BUFFER, sizeof(light_data), NULL, GL_STREAM_DRAW);
+    if (nu_lights > 0)
+        glBufferSubData(GL_TEXTURE_BUFFER, 0, nu_lights * SRE_CLUSTER_LIGHT_DATA_TEXELS * 4 *
+            sizeof(float), light_data);
+    glBindBuffer(GL_TEXTURE_BUFFER, light_list_buffer);
+    glBufferData(GL_TEXTURE_BUFFER, (SRE_NU_CLUSTERS * 2 + total_count) * sizeof(unsigned int),
+        light_list, GL_STREAM_DRAW);
+    glBindBuffer(GL_TEXTURE_BUFFER, 0);
+    // The texture units are not used for anything else, so the textures only need to be
+    // bound once per frame.
+    glActiveTexture(GL_TEXTURE0 + SRE_CLUSTER_LIGHT_DATA_TEXTURE_UNIT);
+    glBindTexture(GL_TEXTURE_BUFFER, light_data_texture);
+    glActiveTexture(GL_TEXTURE0 + SRE_CLUSTER_LIGHT_LIST_TEXTURE_UNIT);
+    glBindTexture(GL_TEXTURE_BUFFER, light_list_texture);
+    glActiveTexture(GL_TEXTURE0);
+    CHECK_GL_ERROR("Error after uploading cluster light lists.\n");
+#endif
+}
+
+// Set the per-frame parameters of the clustered lighting shader: the scale factors
+// from window coordinates to screen tiles, the depth slice parameters and the number
+// of directional lights.
+
+void GL3InitializeShaderWithClusterParameters(int loc) {
+#ifndef OPENGL_ES2
+    float cluster_parameters[5];
+    cluster_parameters[0] = (float)SRE_CLUSTER_GRID_X / sre_internal_window_width;
+    cluster_parameters[1] = (float)SRE_CLUSTER_GRID_Y / sre_internal_window_height;
+    cluster_parameters[2] = depth_slice_scale;
+    cluster_parameters[3] = depth_slice_bias;
+    cluster_parameters[4] = nu_directional_lights;
+    glUniform1fv(loc, 5, &cluster_parameters[0]);
+#endif
+}
@@ -0,0 +1,300 @@
+/*
+
+Copyright (c) 2014 Harm Hanemaaijer <fgenfb@yahoo.com>
+
+Permission to use, copy, modify, and/or distribute this software for any
+purpose with or without fee is hereby granted, provided that the above
+copyright notice and this permission notice appear in all copies.
+
+THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+
+*/
+
+// Deferred shading.
+//
+// The visible objects are rendered once into a G-buffer, a framebuffer object with four
+// color attachments (diffuse reflection color, specular reflection color and exponent,
+// world space normal, and the base color consisting of ambient light and emission) and
+// a depth texture. The base color and depth are then copied to the regular framebuffer
+// with a full-screen pass, after which every visible light is applied with an additive
+// full-screen pass that reconstructs the world position from the stored depth.
+//
+// Each light pass is restricted to the screen-space scissors region and (when
+// GL_EXT_depth_bounds_test is available) the depth bounds of the light volume, so that
+// only the pixels that can be affected by the light are shaded. Shadow maps are
+// supported; stencil shadow volumes are not applied.
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+#ifdef OPENGL_ES2
+#include <GLES2/gl2.h>
+#endif
+#ifdef OPENGL
+#include <GL/glew.h>
+#include <GL/gl.h>
+#endif
+
+#include "sre.h"
+#include "sre_internal.h"
+#include "sre_bounds.h"
+#include "shader.h"
+
+// When non-zero, deferred shading is supported.
+SRE_GLUINT sre_internal_gbuffer_framebuffer = 0;
+
+#ifndef OPENGL_ES2
+
+static GLuint gbuffer_texture[SRE_NU_GBUFFER_TEXTURES];
+static GLuint full_screen_vertex_buffer;
+
+// Full-screen quad consisting of two triangles.
+static const float full_screen_vertices[12] = {
+    - 1.0f, - 1.0f, 1.0f, - 1.0f, 1.0f, 1.0f,
+    - 1.0f, - 1.0f, 1.0f, 1.0f, - 1.0f, 1.0f
+};
+
+static const GLenum gbuffer_draw_buffers[SRE_GBUFFER_DEPTH] = {
+    GL_COLOR_ATTACHMENT0, GL_COLOR_ATTACHMENT1, GL_COLOR_ATTACHMENT2, GL_COLOR_ATTACHMENT3
+};
+
+// Allocate the G-buffer textures with the current window size.
+
+static void AllocateGBufferTextures() {
+    glBindTexture(GL_TEXTURE_2D, gbuffer_texture[SRE_GBUFFER_DIFFUSE]);
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, sre_internal_window_width,
+        sre_internal_window_height, 0, GL_RGBA, GL_UNSIGNED_BYTE, NULL);
+    // The specular exponent is stored in the alpha component, and the normal and
+    // base color require a signed or extended range.
+    for (int i = SRE_GBUFFER_SPECULAR; i <= SRE_GBUFFER_BASE_COLOR; i++) {
+        glBindTexture(GL_TEXTURE_2D, gbuffer_texture[i]);
+        glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA16F, sre_internal_window_width,
+            sre_internal_window_height, 0, GL_RGBA, GL_HALF_FLOAT, NULL);
+    }
+    glBindTexture(GL_TEXTURE_2D, gbuffer_texture[SRE_GBUFFER_DEPTH]);
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_DEPTH_COMPONENT24, sre_internal_window_width,
+        sre_internal_window_height, 0, GL_DEPTH_COMPONENT, GL_UNSIGNED_INT, NULL);
+    glBindTexture(GL_TEXTURE_2D, 0);
+}
+
+#endif
+
+void sreInitializeDeferredShading() {
+#ifdef OPENGL_ES2
+    sreMessage(SRE_MESSAGE_INFO, "Deferred shading not supported with OpenGL-ES 2.0.");
+#else
+    if (!GLEW_VERSION_3_0) {
+        sreMessage(SRE_MESSAGE_INFO, "Deferred shading not available (requires OpenGL 3.0).");
+        return;
+    }
+    GLint max_draw_buffers;
+    glGetIntegerv(GL_MAX_DRAW_BUFFERS, &max_draw_buffers);
+    if (max_draw_buffers < SRE_GBUFFER_DEPTH) {
+        sreMessage(SRE_MESSAGE_INFO, "Deferred shading not available (too few draw buffers).");
+        return;
+    }
+    glGenTextures(SRE_NU_GBUFFER_TEXTURES, &gbuffer_texture[0]);
+    for (int i = 0; i < SRE_NU_GBUFFER_TEXTURES; i++) {
+        glBindTexture(GL_TEXTURE_2D, gbuffer_texture[i]);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    }
+    AllocateGBufferTextures();
+    GLuint framebuffer;
+    glGenFramebuffers(1, &framebuffer);
+    glBindFramebuffer(GL_FRAMEBUFFER, framebuffer);
+    for (int i = 0; i < SRE_GBUFFER_DEPTH; i++)
+        glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0 + i, GL_TEXTURE_2D,
+            gbuffer_texture[i], 0);
+    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_TEXTURE_2D,
+        gbuffer_texture[SRE_GBUFFER_DEPTH], 0);
+    glDrawBuffers(SRE_GBUFFER_DEPTH, gbuffer_draw_buffers);
+    GLenum status = glCheckFramebufferStatus(GL_FRAMEBUFFER);
+    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+    if (status != GL_FRAMEBUFFER_COMPLETE) {
+        sreMessage(SRE_MESSAGE_INFO, "Deferred shading not available (G-buffer framebuffer "
+            "not complete).");
+        glDeleteFramebuffers(1, &framebuffer);
+        glDeleteTextures(SRE_NU_GBUFFER_TEXTURES, &gbuffer_texture[0]);
+        return;
+    }
+    glGenBuffers(1, &full_screen_vertex_buffer);
+    glBindBuffer(GL_ARRAY_BUFFER, full_screen_vertex_buffer);
+    glBufferData(GL_ARRAY_BUFFER, sizeof(full_screen_vertices), full_screen_vertices,
+        GL_STATIC_DRAW);
+    CHECK_GL_ERROR("Error after deferred shading initialization.\n");
+    sre_internal_gbuffer_framebuffer = framebuffer;
+    sreMessage(SRE_MESSAGE_INFO, "Deferred shading supported (disabled by default).");
+#endif
+}
+
+// Called when the window has been resized.
+
+void sreResizeDeferredShading() {
+#ifndef OPENGL_ES2
+    if (sre_internal_gbuffer_framebuffer == 0)
+        return;
+    AllocateGBufferTextures();
+#endif
+}
+
+#ifndef OPENGL_ES2
+
+static void DrawFullScreenQuad() {
+    glEnableVertexAttribArray(0);
+    glBindBuffer(GL_ARRAY_BUFFER, full_screen_vertex_buffer);
+    glVertexAttribPointer(0, 2, GL_FLOAT, GL_FALSE, 0, (void *)0);
+    glDrawArrays(GL_TRIANGLES, 0, 6);
+}
+
+#endif
+
+// Render the visible objects with deferred shading. Called instead of the regular
+// single-pass rendering when deferred shading is enabled. The target framebuffer has
+// already been cleared.
+
+void sreScene::RenderDeferredShading(sreFrustum *frustum, sreView *view) {
+#ifndef OPENGL_ES2
+    // Geometry pass. No light is active; the G-buffer shader ignores the light parameters.
+    glBindFramebuffer(GL_FRAMEBUFFER, sre_internal_gbuffer_framebuffer);
+    glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+    nu_active_lights = 0;
+    sre_internal_current_light = NULL;
+    GL3InitializeShadersBeforeFrame();
+    RenderVisibleObjectsSinglePass(*frustum);
+    sreIssueOcclusionQueries(this);
+    CHECK_GL_ERROR("Error after deferred shading geometry pass.\n");
+
+    if (sre_internal_HDR_enabled)
+        glBindFramebuffer(GL_FRAMEBUFFER, sre_internal_HDR_multisample_framebuffer);
+    else
+        glBindFramebuffer(GL_FRAMEBUFFER, 0);
+    for (int i = 0; i < SRE_NU_GBUFFER_TEXTURES; i++) {
+        glActiveTexture(GL_TEXTURE0 + SRE_GBUFFER_TEXTURE_UNIT + i);
+        glBindTexture(GL_TEXTURE_2D, gbuffer_texture[i]);
+    }
+    glActiveTexture(GL_TEXTURE0);
+
+    // Composite pass: write the base color and copy the depth values so that the
+    // final pass objects and the depth bounds test use the G-buffer depth.
+    glDisable(GL_CULL_FACE);
+    glDepthFunc(GL_ALWAYS);
+    GL3InitializeDeferredShadingCompositeShader();
+    DrawFullScreenQuad();
+
+    // Light passes. The depth test stays enabled (always passing) because the depth
+    // bounds test operates on the depth buffer of the target framebuffer.
+    glDepthMask(GL_FALSE);
+    glEnable(GL_BLEND);
+    glBlendFunc(GL_ONE, GL_ONE);
+    if (sre_internal_max_active_lights == SRE_MAX_ACTIVE_LIGHTS_UNLIMITED ||
+    visible_light_array.Size() <= sre_internal_max_active_lights)
+        nu_active_lights = visible_light_array.Size();
+    else
+        CalculateVisibleActiveLights(view, sre_internal_max_active_lights);
+#ifndef NO_SHADOW_MAP
+    sreDetermineShadowCastersForActiveLights(this, *frustum);
+    // Render the spot and beam light shadow maps into the shadow map atlas when enabled.
+    sreRenderShadowMapAtlas(this, *frustum);
+#endif
+
+    // Conversion from window coordinates and depth to normalized device coordinates,
+    // followed by the inverse view-projection transformation.
+    Matrix4D window_to_ndc_matrix;
+    window_to_ndc_matrix.Set(
+        2.0f / sre_internal_window_width, 0.0f, 0.0f, - 1.0f,
+        0.0f, 2.0f / sre_internal_window_height, 0.0f, - 1.0f,
+        0.0f, 0.0f, 2.0f, - 1.0f,
+        0.0f, 0.0f, 0.0f, 1.0f);
+    Matrix4D inverse_view_projection_matrix = Inverse(sre_internal_view_projection_matrix) *
+        window_to_ndc_matrix;
+
+    for (int i = 0; i < nu_active_lights; i++) {
+        if (nu_active_lights == visible_light_array.Size())
+            sre_internal_current_light_index = visible_light_array.Get(i);
+        else
+            sre_internal_current_light_index = active_light[i];
+        sre_internal_current_light = light[sre_internal_current_light_index];
+        sreLight *l = sre_internal_current_light;
+        if ((l->type & SRE_LIGHT_DYNAMIC_LIGHT_VOLUME) &&
+        sre_internal_current_frame > frustum->most_recent_frame_changed &&
+        !Intersects(*l, frustum->frustum_world))
+            continue;
+        l->shadow_map_required = false;
+
+#ifndef NO_SHADOW_MAP
+        if (sre_internal_shadows == SRE_SHADOWS_SHADOW_MAPPING) {
+            sreProfilerScope scope(SRE_PROFILE_SHADOW_MAP, sre_internal_current_light_index);
+            // Render the shadow map without scissors and blending. The G-buffer textures
+            // remain bound because the shadow map uses a lower texture unit.
+            glDisable(GL_SCISSOR_TEST);
+            glDisable(GL_BLEND);
+            glDepthMask(GL_TRUE);
+            glDepthFunc(GL_LESS);
+            bool r = GL3RenderShadowMapWithOctree(this, *l, *frustum);
+            glDepthMask(GL_FALSE);
+            glDepthFunc(GL_ALWAYS);
+            glDisable(GL_CULL_FACE);
+            glEnable(GL_BLEND);
+            glBlendFunc(GL_ONE, GL_ONE);
+            if (!r)
+                // There are no shadow casters and no light receivers for this light.
+                continue;
+        }
+#endif
+
+        if (l->type & SRE_LIGHT_DIRECTIONAL) {
+            glDisable(GL_SCISSOR_TEST);
+#ifndef NO_DEPTH_BOUNDS
+            if (GLEW_EXT_depth_bounds_test)
+                glDepthBoundsEXT(0, 1.0f);
+#endif
+        }
+        else {
+            // Restrict the light pass to the region of the screen and the range of depth
+            // values that can be affected by the light.
+            frustum->CalculateLightScissors(l);
+            if (frustum->scissors.RegionIsEmpty() ||
+            frustum->scissors.near >= frustum->scissors.far)
+                continue;
+            glEnable(GL_SCISSOR_TEST);
+            frustum->scissors.SetGL();
+#ifndef NO_DEPTH_BOUNDS
+            if (GLEW_EXT_depth_bounds_test) {
+                glEnable(GL_DEPTH_BOUNDS_TEST_EXT);
+                glDepthBoundsEXT(frustum->scissors.near, frustum->scissors.far);
+            }
+#endif
+        }
+
+        if (l->shadow_map_required)
+            sreBindShadowMapTexture(l);
+        GL3InitializeDeferredShadingLightShader(SRE_DEFERRED_SHADING_SHADER_LIGHT +
+            l->type_index * 2 + (l->shadow_map_required ? 1 : 0),
+            inverse_view_projection_matrix);
+        DrawFullScreenQuad();
+    }
+    CHECK_GL_ERROR("Error after deferred shading light passes.\n");
+
+    // Restore the settings for the final pass.
+    glDisable(GL_SCISSOR_TEST);
+#ifndef NO_DEPTH_BOUNDS
+    if (GLEW_EXT_depth_bounds_test)
+        glDepthBoundsEXT(0, 1.0f);
+#endif
+    glDisable(GL_BLEND);
+    glDepthFunc(GL_LEQUAL);
+    glDepthMask(GL_TRUE);
+    glEnable(GL_CULL_FACE);
+    RenderFinalPassObjectsSinglePass(*frustum);
+#endif
+}
@@ -1181,16 +1181,20 @@ skip_spacecraft :
     scene->SetEmissionColor(Color(1.0, 1.0, 1.0));
     scene->SetFlags(SRE_OBJECT_USE_EMISSION_MAP | SRE_OBJECT_USE_TEXTURE |
         SRE_OBJECT_USE_SPECULARITY_MAP | SRE_OBJECT_CAST_SHADOWS |
-        physics_flag);
+        SRE_OBJECT_OCCLUDER | physics_flag);
 #else
 #ifdef SPHERE
     scene->SetFlags(SRE_OBJECT_USE_TEXTURE | SRE_OBJECT_EARTH_SHADER |
-        SRE_OBJECT_USE_SPECULARITY_MAP | SRE_OBJECT_CAST_SHADOWS | physics_flag);
+        SRE_OBJECT_USE_SPECULARITY_MAP | SRE_OBJECT_CAST_SHADOWS | SRE_OBJECT_OCCLUDER |
+        physics_flag);
 #else
     scene->SetFlags(SRE_OBJECT_USE_TEXTURE | /* SRE_OBJECT_NO_PHYSICS | */
-        SRE_OBJECT_USE_SPECULARITY_MAP | SRE_OBJECT_CAST_SHADOWS | physics_flag);
+        SRE_OBJECT_USE_SPECULARITY_MAP | SRE_OBJECT_CAST_SHADOWS | SRE_OBJECT_OCCLUDER |
+        physics_flag);
 #endif
 #endif
+    // The terrain meshes are marked as occluders for software occlusion culling
+    // (--software-occlusion-culling), so that mountains hide the terrain behind them.
     earth_heightmap = new sreTexture(earth_heightmap_filename, TEXTURE_TYPE_WILL_MERGE_LATER);
     sreModel *mesh_model[SUB_MESHES_Y][SUB_MESHES_X];
     for (int y = 0; y < SUB_MESHES_Y; y++)
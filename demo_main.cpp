@@ -23,6 +23,9 @@ OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
 #include <stdio.h>
 #include <string.h>
 #include <math.h>
+#include <unistd.h>
+#include <sys/types.h>
+#include <sys/wait.h>
 
 #include "sre.h"
 #include "sreBackend.h"
@@ -72,6 +75,32 @@ void DemoApplication::StepBeforePhysics(double demo_time) {
         Demo4StepBeforePhysics(scene, demo_time);  
 }
 
+// Run every demo in turn in a separate process with the same options (the demo name
+// "all" at index i of argv is replaced), for example to benchmark all demos with
+// --benchmark-frames. Returns the number of demos that failed.
+
+static int RunAllDemos(int argc, char **argv, int i) {
+    int nu_failed = 0;
+    for (int j = 0; j < NU_DEMOS; j++) {
+        argv[i] = (char *)demo_table[j].name;
+        printf("Running %s.\n", demo_table[j].name);
+        fflush(stdout);
+        pid_t pid = fork();
+        if (pid == 0) {
+            execvp(argv[0], argv);
+            printf("Could not execute %s.\n", argv[0]);
+            _exit(127);
+        }
+        int status;
+        if (pid < 0 || waitpid(pid, &status, 0) < 0 || !WIFEXITED(status) ||
+        WEXITSTATUS(status) != 0) {
+            printf("Demo %s failed.\n", demo_table[j].name);
+            nu_failed++;
+        }
+    }
+    return nu_failed;
+}
+
 int main(int argc, char **argv) {
     if (argc == 1) {
         sreSelectBackend(SRE_BACKEND_DEFAULT);
@@ -87,9 +116,36 @@ int main(int argc, char **argv) {
             "Option --multi-pass enables multi-pass rendering (for multiple lights).\n"
             "Option --single-pass disables multi-pass rendering.\n"
             "Option --benchmark makes the application quit automatically after 20s of\n"
-            "rendering, displaying the number of frames per second.\n"
+            "rendering, displaying the number of frames per second and the average CPU\n"
+            "time per frame spent issuing rendering commands.\n"
+            "Option --no-vertex-array-objects disables caching of vertex attribute state in\n"
+            "vertex array objects (for benchmark comparison).\n"
+            "Option --occlusion-culling enables occlusion culling with occlusion queries.\n"
+            "Option --software-occlusion-culling enables occlusion culling against occluder\n"
+            "objects rasterized on the CPU.\n"
+            "Option --clustered-lighting enables single-pass rendering with all visible lights\n"
+            "applied using clustered lighting (no shadows).\n"
+            "Option --deferred-shading enables deferred shading with a G-buffer and one\n"
+            "screen-space pass per visible light.\n"
+            "Option --shadow-map-cascades <n> splits directional light shadow maps into n\n"
+            "cascades (2 to 4).\n"
+            "Option --shadow-map-cache keeps the shadow maps of local lights between frames\n"
+            "until the light or its shadow casters change. Option\n"
+            "--shadow-map-cache-static-layer also caches the static shadow casters separately.\n"
+            "Option --shadow-map-atlas <size> renders spot and beam light shadow maps into\n"
+            "tiles of a shadow map atlas of the given size, sized per light.\n"
+            "Option --layered-cube-shadow-maps renders point light shadow cube maps in a single\n"
+            "pass using a geometry shader.\n"
             "Option --preprocess performs T-junction elimination on all static scenery at start-up.\n"
             "Option --demand-load-shaders enables demand-loading of shaders (experimental).\n"
+            "Option --shader-cache <dir/> caches compiled shader programs in the given directory.\n"
+            "Option --async-shaders compiles demand-loaded shaders without blocking rendering.\n"
+            "Option --profile-trace <file> writes per-pass CPU and GPU times as a Chrome trace.\n"
+            "Option --benchmark-frames <n> renders a fixed number of frames at a fixed demo time\n"
+            "step with the camera circling once, and reports frame time percentiles, draw calls,\n"
+            "triangles and per-pass times. Option --benchmark-output <file> appends the results\n"
+            "as a line of JSON to the file. The demo name all runs every demo in turn.\n"
+            "Option --headless renders offscreen without a window (HEADLESS back-end).\n"
             "Option --large-shadow-maps enabled the use of very large shadow maps.\n";
         const char *text2;
         if (strcmp(sre_internal_backend->name, "GLFW") == 0)
@@ -158,6 +214,11 @@ int main(int argc, char **argv) {
         exit(0);
     }
  
+    // Run all demos in separate processes when the demo name is "all".
+    for (int i = argc - 1; i > 0; i--)
+        if (strcmp(argv[i], "all") == 0)
+            exit(RunAllDemos(argc, argv, i) == 0 ? 0 : 1);
+
     sreApplication *app = new DemoApplication;
     sreInitializeApplication(app, &argc, &argv);
 
@@ -195,6 +256,7 @@ int main(int argc, char **argv) {
     // function when necessary to set set flags (presence of physics, type of gravity
     // etc). 
 
+    app->name = demo_table[demo_index].name;
     demo_table[demo_index].CreateScene(app->scene, app->view);
     // By convention object 0 is the default user-controlled object (usually a ball/sphere).
     app->control_object = 0;
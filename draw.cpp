@@ -22,6 +22,7 @@ OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
 #include <math.h>
 #ifdef __GNUC__
 #include <fenv.h>
+#include <stdint.h>
 #endif
 #ifdef OPENGL_ES2
 #include <GLES2/gl2.h>
@@ -64,6 +65,10 @@ static void SetFrustum(sreScene *scene, sreFrustum *frustum, sreView *view) {
 
 void sreScene::Render(sreView *view) {
     sre_internal_scene = this;
+    sreProfilerBeginFrame();
+
+    // Switch to the next segment of the streaming buffer for dynamic geometry.
+    sreStreamingBufferNextFrame();
 
     if (sre_internal_invalidate_geometry_scissors_cache) {
         InvalidateGeometryScissorsCache();
@@ -130,27 +135,50 @@ void sreScene::Render(sreView *view) {
     }
 
     // Perform the visible object determination.
-    DetermineVisibleEntities(*frustum);
+    {
+        sreProfilerScope scope(SRE_PROFILE_VISIBILITY);
+        DetermineVisibleEntities(*frustum);
+    }
 
-    if (!sre_internal_multi_pass_rendering) {
+    if (!sre_internal_multi_pass_rendering &&
+    (sre_internal_rendering_flags & SRE_RENDERING_FLAG_DEFERRED_SHADING)) {
+        // Deferred shading replaces the single pass.
+        sreProfilerScope scope(SRE_PROFILE_DEFERRED_SHADING);
+        RenderDeferredShading(frustum, view);
+    }
+    else if (!sre_internal_multi_pass_rendering) {
         // Single pass rendering (with a final pass for possibly transparent emission only
         //objects).
-        // The single pass shaders are limited to one light. Calculate the most prominent
-        // light based on the list of determined visible lights.
-        CalculateVisibleActiveLights(view, 1);
-        // Set the current light.
-        if (nu_active_lights > 0) {
-            sre_internal_current_light_index = active_light[0];
-            sre_internal_current_light = light[active_light[0]];
-        }
-        else
+        if (sre_internal_rendering_flags & SRE_RENDERING_FLAG_CLUSTERED_LIGHTING) {
+            // With clustered lighting, all visible lights are applied in the single pass.
+            // Assign them to the clusters of the view frustum and upload the light lists.
+            sreAssignLightsToClusters(this);
+            nu_active_lights = 0;
             sre_internal_current_light = NULL;
+        }
+        else {
+            // The single pass shaders are limited to one light. Calculate the most prominent
+            // light based on the list of determined visible lights.
+            CalculateVisibleActiveLights(view, 1);
+            // Set the current light.
+            if (nu_active_lights > 0) {
+                sre_internal_current_light_index = active_light[0];
+                sre_internal_current_light = light[active_light[0]];
+            }
+            else
+                sre_internal_current_light = NULL;
+        }
         // Initialization of shaders was delayed because the single active light
         // parameters are only known after visible entity determination.
         GL3InitializeShadersBeforeFrame();
 
         // Render objects.
-        RenderVisibleObjectsSinglePass(*frustum);
+        {
+            sreProfilerScope scope(SRE_PROFILE_SINGLE_PASS);
+            RenderVisibleObjectsSinglePass(*frustum);
+            sreIssueOcclusionQueries(this);
+        }
+        sreProfilerScope scope(SRE_PROFILE_FINAL_PASS);
         RenderFinalPassObjectsSinglePass(*frustum);
     }
     else if (sre_internal_shadows == SRE_SHADOWS_NONE) {
@@ -159,7 +187,11 @@ void sreScene::Render(sreView *view) {
         sre_internal_current_light_index = - 1;
         GL3InitializeShadersBeforeLight();
         // Render the ambient pass which also initializes the depth buffer.
-        RenderVisibleObjectsAmbientPass(*frustum);
+        {
+            sreProfilerScope scope(SRE_PROFILE_AMBIENT_PASS);
+            RenderVisibleObjectsAmbientPass(*frustum);
+            sreIssueOcclusionQueries(this);
+        }
         // Perform the lighting passes.
         // Enable additive blending.
         glEnable(GL_BLEND);
@@ -189,6 +221,7 @@ void sreScene::Render(sreView *view) {
         glDepthMask(GL_TRUE);
         // Note: some objects in the final pass might need blending, but this
         // be enabled/disabled on a per-object basis.
+        sreProfilerScope scope(SRE_PROFILE_FINAL_PASS);
         RenderFinalPassObjectsMultiPass(*frustum);
     }
     else if (sre_internal_shadows == SRE_SHADOWS_SHADOW_VOLUMES) {
@@ -214,7 +247,11 @@ void sreScene::Render(sreView *view) {
         glDepthRangef(0, 0.99999f);
 #endif
         // Render the ambient pass which also initializes the depth buffer.
-        RenderVisibleObjectsAmbientPass(*frustum);
+        {
+            sreProfilerScope scope(SRE_PROFILE_AMBIENT_PASS);
+            RenderVisibleObjectsAmbientPass(*frustum);
+            sreIssueOcclusionQueries(this);
+        }
         // Perform the lighting passes.
         // Enable additive blending.
         glEnable(GL_BLEND);
@@ -245,6 +282,7 @@ void sreScene::Render(sreView *view) {
         glDepthRangef(0, 0.99999f);
 #endif
         glDepthMask(GL_TRUE);
+        sreProfilerScope scope(SRE_PROFILE_FINAL_PASS);
         RenderFinalPassObjectsMultiPass(*frustum);
     }
     else if (sre_internal_shadows == SRE_SHADOWS_SHADOW_MAPPING) {
@@ -254,7 +292,11 @@ void sreScene::Render(sreView *view) {
         CHECK_GL_ERROR("Error before ambient pass (shadow mapping).\n");
         GL3InitializeShadersBeforeLight();
         // Render the ambient pass which also initializes the depth buffer.
-        RenderVisibleObjectsAmbientPass(*frustum);
+        {
+            sreProfilerScope scope(SRE_PROFILE_AMBIENT_PASS);
+            RenderVisibleObjectsAmbientPass(*frustum);
+            sreIssueOcclusionQueries(this);
+        }
         CHECK_GL_ERROR("Error after ambient pass (shadow mapping).\n");
         // Perform the lighting passes.
         // Enable additive blending.
@@ -281,6 +323,7 @@ void sreScene::Render(sreView *view) {
 #endif
         glDepthMask(GL_TRUE);
         CHECK_GL_ERROR("Error before final pass (shadow mapping).\n");
+        sreProfilerScope scope(SRE_PROFILE_FINAL_PASS);
         RenderFinalPassObjectsMultiPass(*frustum);
     }
     CHECK_GL_ERROR("Error after rendering.\n");
@@ -288,6 +331,7 @@ void sreScene::Render(sreView *view) {
     // Post-processing for HDR rendering.
 #ifndef NO_HDR
     if (sre_internal_HDR_enabled) {
+        sreProfilerScope scope(SRE_PROFILE_HDR);
         // Resolve the multi-sampled float framebuffer into a regular float framebuffer.
         glBindFramebuffer(GL_READ_FRAMEBUFFER, sre_internal_HDR_multisample_framebuffer);
         glBindFramebuffer(GL_DRAW_FRAMEBUFFER, sre_internal_HDR_framebuffer);
@@ -373,6 +417,7 @@ void sreScene::Render(sreView *view) {
     glEnable(GL_BLEND);
     glBlendFunc(GL_ONE, GL_ONE);
     sreDrawTextOverlayFunc();
+    sreProfilerEndFrame();
  
     // Display.
     sre_internal_swap_buffers_func();
@@ -383,6 +428,10 @@ void sreScene::Render(sreView *view) {
     // Any aspect ratio change will have been applied to loaded shaders.
     sre_internal_aspect_changed = false;
 
+    // Keep the lighting pass batching statistics of the frame.
+    sre_internal_lighting_pass_stats_last_frame = sre_internal_lighting_pass_stats;
+    memset(&sre_internal_lighting_pass_stats, 0, sizeof(sreLightingPassBatchingInfo));
+
     sre_internal_current_frame++;
 }
 
@@ -487,37 +536,62 @@ static float AccurateProjectedSize(const sreFrustum& f, const Point3D& P, float
 
 static int octree_culled_count_frustum = 0;
 static int octree_culled_count_projected = 0;
+static int octree_culled_count_occlusion = 0;
 static int octree_objects_inside = 0;
 
-// Determine whether the object is visible (intersects the view frustum), and if so
-// add it to a few possible arrays:
-//
-// - The object is added to visible_object[] if it should be drawn in a lighting pass.
-//   In this case, the most_recent_frame_visible field in the object is set to
-//   the current frame. This information is latee is used when drawing objects for
-//   local lights from the list of static light-receiving objects for the light, to
-//   quickly determine whether the object is visible (it may be used in other places
-//   such as shadows).
-// - The object is added to final_pass_object[] if it should be drawn in the final
-//   pass.
+// Whether a non-root octree node or BVH node is hidden behind the occluders in the
+// software depth buffer.
 
-void sreScene::DetermineObjectIsVisible(sreObject& so, const sreFrustum& frustum,
-BoundsCheckResult bounds_check_result) {
+static inline bool NodeIsSoftwareOccluded(const sreBoundingVolumeAABB& AABB) {
+    return (sre_internal_rendering_flags & SRE_RENDERING_FLAG_SOFTWARE_OCCLUSION_CULLING) &&
+        sreIsOccludedBySoftwareDepthBuffer(AABB);
+}
+
+// Append a value to a dynamically allocated int array, doubling the array size
+// when it is full.
+
+static inline void AddToVisibleEntityArray(int *&array, int& nu_entries, int& max_entries,
+int value) {
+    if (nu_entries == max_entries) {
+        int *new_array = new int[max_entries * 2];
+        memcpy(new_array, array, sizeof(int) * max_entries);
+        delete [] array;
+        array = new_array;
+        max_entries *= 2;
+    }
+    array[nu_entries] = value;
+    nu_entries++;
+}
+
+enum {
+    OBJECT_NOT_VISIBLE = 0,
+    OBJECT_VISIBLE_LIGHTING_PASSES,
+    OBJECT_VISIBLE_FINAL_PASS
+};
+
+// Determine whether the object is visible (intersects the view frustum and is not too
+// small), and in which passes it should be drawn. Only fields of the object itself are
+// updated, so that this function can be called from multiple threads for different
+// objects. objects_inside is incremented when the object was known to be inside the
+// frustum.
+
+static int DetermineObjectVisibility(sreObject& so, const sreFrustum& frustum,
+BoundsCheckResult bounds_check_result, int& objects_inside) {
     // Bounds checks on view frustum.
     if (bounds_check_result != SRE_COMPLETELY_INSIDE) {
 #if SRE_NU_FRUSTUM_PLANES == 6
         // Infinite distance object should not be clipped by the far plane.
         if (so.flags & SRE_OBJECT_INFINITE_DISTANCE) {
             if (!Intersects(so, frustum.frustum_without_far_plane_world))
-                return;
+                return OBJECT_NOT_VISIBLE;
         }
         else
 #endif
         if (!Intersects(so, frustum.frustum_world))
-            return;
+            return OBJECT_NOT_VISIBLE;
     }
     else
-        octree_objects_inside++;
+        objects_inside++;
 
     // Check the projected object size, and store it. Objects below the threshold
     // size will not be rendered. The projected size is stored in the object
@@ -526,81 +600,127 @@ BoundsCheckResult bounds_check_result) {
     // so that their projected size is still material.
     so.projected_size = ProjectedSize(so.sphere.center, so.sphere.radius);
     if (so.projected_size < SRE_OBJECT_SIZE_CUTOFF)
-        return;
+        return OBJECT_NOT_VISIBLE;
+
+    // Skip objects that are hidden behind the occluders in the software depth buffer.
+    // The occluders themselves are not checked.
+    if ((sre_internal_rendering_flags & SRE_RENDERING_FLAG_SOFTWARE_OCCLUSION_CULLING) &&
+    !(so.flags & (SRE_OBJECT_INFINITE_DISTANCE | SRE_OBJECT_OCCLUDER)) &&
+    sreIsOccludedBySoftwareDepthBuffer(so))
+        return OBJECT_NOT_VISIBLE;
 
     // If the object should be drawn in lighting passes, mark the object as visible.
     if (!(so.flags & (SRE_OBJECT_EMISSION_ONLY | SRE_OBJECT_LIGHT_HALO | SRE_OBJECT_PARTICLE_SYSTEM))) {
+        // Large objects are skipped when they were found to be occluded.
+        if ((sre_internal_rendering_flags & SRE_RENDERING_FLAG_OCCLUSION_CULLING) &&
+        !(so.flags & SRE_OBJECT_INFINITE_DISTANCE) &&
+        so.model->lod_model[0]->nu_triangles >= SRE_OCCLUSION_QUERY_MIN_TRIANGLES &&
+        sreCheckOccluded(so.occlusion))
+            return OBJECT_NOT_VISIBLE;
         so.most_recent_frame_visible = sre_internal_current_frame;
-        if (nu_visible_objects == max_visible_objects) {
-            // Dynamically increase the visible objects array size when needed.
-            int *new_visible_object = new int[max_visible_objects * 2];
-            memcpy(new_visible_object, visible_object, sizeof(int) * max_visible_objects);
-            delete [] visible_object;
-            visible_object = new_visible_object;
-            max_visible_objects *= 2;
-        }
-        visible_object[nu_visible_objects] = so.id;
-        nu_visible_objects++;
-        return;
+        return OBJECT_VISIBLE_LIGHTING_PASSES;
     }
-
-    // If the object should be drawn in the final pass, queue the object for later sorting and rendering.
     // Note: It is not necessary to set so.most_recent_frame_visible for final pass objects.
-    if (nu_final_pass_objects == max_final_pass_objects) {
-        // Dynamically increase the final pass objects array size when needed.
-        int *new_final_pass_object = new int[max_final_pass_objects * 2];
-        memcpy(new_final_pass_object, final_pass_object, sizeof(int) *
-            max_final_pass_objects);
-        delete [] final_pass_object;
-        final_pass_object = new_final_pass_object;
-        max_final_pass_objects *= 2;
-    }
-    final_pass_object[nu_final_pass_objects] = so.id;
-    nu_final_pass_objects++;
-    return;
+    return OBJECT_VISIBLE_FINAL_PASS;
+}
+
+// Determine whether a light volume intersects the view frustum and is not too small.
+// Like DetermineObjectVisibility, only the light itself is updated.
+
+static bool DetermineLightIsVisible(sreLight& l, const sreFrustum& frustum) {
+    if (l.type & SRE_LIGHT_DIRECTIONAL)
+        return true;
+    if (l.type & SRE_LIGHT_WORST_CASE_BOUNDS_SPHERE) {
+        // If there are worst-case bounds, use them, because when the frustum doesn't
+        // change for a while in subsequent frames, the variable light volume might
+        // come into view.
+        if (!Intersects(l.worst_case_sphere, frustum.frustum_world))
+            // If outside, skip the light.
+            return false;
+    }
+    else if (!Intersects(l, frustum.frustum_world))
+        // If outside, skip the light.
+        return false;
+    // Check whether the project size of the light volume is too small.
+    l.projected_size = AccurateProjectedSize(frustum, l.vector.GetPoint3D(),
+        l.sphere.radius);
+    if (l.projected_size < SRE_LIGHT_VOLUME_SIZE_CUTOFF)
+        return false;
+    return true;
+}
+
+// Determine whether the object is visible (intersects the view frustum), and if so
+// add it to a few possible arrays:
+//
+// - The object is added to visible_object[] if it should be drawn in a lighting pass.
+//   In this case, the most_recent_frame_visible field in the object is set to
+//   the current frame. This information is latee is used when drawing objects for
+//   local lights from the list of static light-receiving objects for the light, to
+//   quickly determine whether the object is visible (it may be used in other places
+//   such as shadows).
+// - The object is added to final_pass_object[] if it should be drawn in the final
+//   pass.
+
+void sreScene::DetermineObjectIsVisible(sreObject& so, const sreFrustum& frustum,
+BoundsCheckResult bounds_check_result) {
+    int visibility = DetermineObjectVisibility(so, frustum, bounds_check_result,
+        octree_objects_inside);
+    if (visibility == OBJECT_VISIBLE_LIGHTING_PASSES)
+        AddToVisibleEntityArray(visible_object, nu_visible_objects, max_visible_objects, so.id);
+    else if (visibility == OBJECT_VISIBLE_FINAL_PASS)
+        // Queue the object for later sorting and rendering in the final pass.
+        AddToVisibleEntityArray(final_pass_object, nu_final_pass_objects, max_final_pass_objects,
+            so.id);
 }
 
 
+// Entities in an octree node are processed in batches of up to this number, so that
+// the result of the batched bounding sphere test fits in a 32-bit mask.
+#define SRE_ENTITY_BATCH_SIZE 32
+
+// When the octree has a packed copy of the entity bounding spheres, test a batch of
+// n entities starting at array_index against the view frustum using SIMD instructions,
+// and return a mask of the entities that are completely outside. Because the bounding
+// sphere encloses the object, these can be skipped without further tests. Returns
+// zero when the node is completely inside the frustum or there are no packed spheres.
+
+static inline unsigned int QueryEntityBatchOutsideFrustum(const sreFastOctree& fast_oct,
+const sreFrustum& frustum, BoundsCheckResult bounds_check_result, int array_index, int n) {
+    if (fast_oct.entity_sphere_x == NULL || bounds_check_result == SRE_COMPLETELY_INSIDE)
+        return 0;
+    return QuerySpheresOutsideConvexHull(&fast_oct.entity_sphere_x[array_index],
+        &fast_oct.entity_sphere_y[array_index], &fast_oct.entity_sphere_z[array_index],
+        &fast_oct.entity_sphere_radius[array_index], n, frustum.frustum_world);
+}
+
 // Determine visibility of an array of entities defined in a single node of a "fast" or
 // "fast strict" octree. nu_entities entities starting at fast_oct array index array_index
 // are processed.
 
 void sreScene::DetermineFastOctreeNodeVisibleEntities(const sreFastOctree& fast_oct,
 const sreFrustum& frustum, BoundsCheckResult bounds_check_result, int array_index, int nu_entities) {
-    for (int i = 0; i < nu_entities; i++) {
-        sreSceneEntityType type;
-        int index;
-        fast_oct.GetEntity(array_index + i, type, index);
-        if (type == SRE_ENTITY_OBJECT) {
-            sreObject *so = object[index];
-            if (!(so->flags & SRE_OBJECT_HIDDEN))
-                DetermineObjectIsVisible(*so, frustum, bounds_check_result);
-        }
-        else if (type == SRE_ENTITY_LIGHT) {
-            sreLight *l = light[index];
-//            printf("Checking visibility of light %d\n", l->id);
-            if (!(l->type & SRE_LIGHT_DIRECTIONAL)) {
-                if (l->type & SRE_LIGHT_WORST_CASE_BOUNDS_SPHERE) {
-                    // If there are worst-case bounds, use them, because when the frustum doesn't
-                    // change for a while in subsequent frames, the variable light volume might
-                    // come into view.
-                    if (!Intersects(l->worst_case_sphere, frustum.frustum_world))
-                        // If outside, skip the light.
-                        continue;
-                }
-                else if (!Intersects(*l, frustum.frustum_world))
-                    // If outside, skip the light.
-                    continue;
+    for (int i = 0; i < nu_entities; i += SRE_ENTITY_BATCH_SIZE) {
+        int n = nu_entities - i;
+        if (n > SRE_ENTITY_BATCH_SIZE)
+            n = SRE_ENTITY_BATCH_SIZE;
+        unsigned int outside_mask = QueryEntityBatchOutsideFrustum(fast_oct, frustum,
+            bounds_check_result, array_index + i, n);
+        for (int j = 0; j < n; j++) {
+            if (outside_mask & (1u << j))
+                continue;
+            sreSceneEntityType type;
+            int index;
+            fast_oct.GetEntity(array_index + i + j, type, index);
+            if (type == SRE_ENTITY_OBJECT) {
+                sreObject *so = object[index];
+                if (!(so->flags & SRE_OBJECT_HIDDEN))
+                    DetermineObjectIsVisible(*so, frustum, bounds_check_result);
             }
-            // Check whether the project size of the light volume is too small.
-            if (!(l->type & SRE_LIGHT_DIRECTIONAL)) {
-                l->projected_size = AccurateProjectedSize(frustum, l->vector.GetPoint3D(),
-                    l->sphere.radius);
-                if (l->projected_size < SRE_LIGHT_VOLUME_SIZE_CUTOFF)
-                    continue;
+            else if (type == SRE_ENTITY_LIGHT) {
+                sreLight *l = light[index];
+                if (DetermineLightIsVisible(*l, frustum))
+                    visible_light_array.Add(l->id);
             }
-//            printf("Light %d is visible, type = %d.\n", l->id, l->type);
-            visible_light_array.Add(l->id);
         }
     }
 }
@@ -656,6 +776,18 @@ const sreFrustum& frustum, BoundsCheckResult bounds_check_result) {
         }
 #endif
     }
+    // Discard the node when it was found to be occluded. This also applies to nodes that
+    // are completely inside the frustum.
+    if (array_index != 0 && &fast_oct == sre_internal_occlusion_octree &&
+    (sre_internal_rendering_flags & SRE_RENDERING_FLAG_OCCLUSION_CULLING) &&
+    sreCheckOccluded(sre_internal_octree_node_occlusion_state[node_index])) {
+        octree_culled_count_occlusion++;
+        return;
+    }
+    if (array_index != 0 && NodeIsSoftwareOccluded(fast_oct.node_bounds[node_index].AABB)) {
+        octree_culled_count_occlusion++;
+        return;
+    }
     int nu_octants = fast_oct.GetNumberOfOctants(array_index + 1);
     int nu_entities = fast_oct.array[array_index + 2];
 //    printf("Number of entities in node: %d.\n", nu_entities);
@@ -878,6 +1010,10 @@ BoundsCheckResult bounds_check_result) {
         }
 #endif
     }
+    if (array_index != 0 && NodeIsSoftwareOccluded(node_bounds.AABB)) {
+        octree_culled_count_occlusion++;
+        return;
+    }
     // The optimized fast strict octree has no node index.
     int nu_entities = fast_oct.array[array_index + 1];
     // Determine visibility for the entities stored in this node.
@@ -900,24 +1036,349 @@ int array_index, const sreFrustum& frustum, BoundsCheckResult bounds_check_resul
         array_index + 2, nu_entities);
 }
 
+// Multi-threaded visible entity determination.
+//
+// When enabled, the subtrees of the non-empty octants of the static octree's root node
+// are traversed in parallel, one job per octant. Each job writes to its own set of
+// visible entity buffers; afterwards the buffers are appended to the scene's visible
+// entity arrays in octant order, so that the result is identical to that of the
+// single-threaded depth-first traversal. The entities in the root node itself are
+// processed by the rendering thread before the jobs are started.
+//
+// Since every entity is stored in exactly one octree node, each object or light is
+// only updated by a single job.
+
+#define SRE_MAX_VISIBLE_ENTITIES_JOBS 8
+
+class VisibleEntitiesJobBuffer {
+public :
+    int nu_visible_objects;
+    int max_visible_objects;
+    int *visible_object;
+    int nu_final_pass_objects;
+    int max_final_pass_objects;
+    int *final_pass_object;
+    int nu_visible_lights;
+    int max_visible_lights;
+    int *visible_light;
+    int octree_culled_count_frustum;
+    int octree_culled_count_projected;
+    int octree_culled_count_occlusion;
+    int octree_objects_inside;
+
+    VisibleEntitiesJobBuffer() {
+        max_visible_objects = SRE_DEFAULT_MAX_VISIBLE_OBJECTS;
+        visible_object = new int[max_visible_objects];
+        max_final_pass_objects = SRE_DEFAULT_MAX_FINAL_PASS_OBJECTS;
+        final_pass_object = new int[max_final_pass_objects];
+        max_visible_lights = SRE_DEFAULT_MAX_VISIBLE_LIGHTS;
+        visible_light = new int[max_visible_lights];
+    }
+    void Reset() {
+        nu_visible_objects = 0;
+        nu_final_pass_objects = 0;
+        nu_visible_lights = 0;
+        octree_culled_count_frustum = 0;
+        octree_culled_count_projected = 0;
+        octree_culled_count_occlusion = 0;
+        octree_objects_inside = 0;
+    }
+};
+
+class VisibleEntitiesJobData {
+public :
+    sreScene *scene;
+    const sreFastOctree *fast_oct;
+    const sreFrustum *frustum;
+    bool strict_optimized;
+    // Array index and node bounds (only used for the strict optimized octree) of the
+    // octant subtree processed by each job.
+    int array_index[SRE_MAX_VISIBLE_ENTITIES_JOBS];
+    sreOctreeNodeBounds node_bounds[SRE_MAX_VISIBLE_ENTITIES_JOBS];
+};
+
+static VisibleEntitiesJobBuffer *visible_entities_job_buffer = NULL;
+
+static void DetermineNodeVisibleEntitiesJob(sreScene *scene, VisibleEntitiesJobBuffer *buffer,
+const sreFastOctree& fast_oct, const sreFrustum& frustum, BoundsCheckResult bounds_check_result,
+int array_index, int nu_entities) {
+    for (int i = 0; i < nu_entities; i += SRE_ENTITY_BATCH_SIZE) {
+        int n = nu_entities - i;
+        if (n > SRE_ENTITY_BATCH_SIZE)
+            n = SRE_ENTITY_BATCH_SIZE;
+        unsigned int outside_mask = QueryEntityBatchOutsideFrustum(fast_oct, frustum,
+            bounds_check_result, array_index + i, n);
+        for (int j = 0; j < n; j++) {
+            if (outside_mask & (1u << j))
+                continue;
+            sreSceneEntityType type;
+            int index;
+            fast_oct.GetEntity(array_index + i + j, type, index);
+            if (type == SRE_ENTITY_OBJECT) {
+                sreObject *so = scene->object[index];
+                if (so->flags & SRE_OBJECT_HIDDEN)
+                    continue;
+                int visibility = DetermineObjectVisibility(*so, frustum, bounds_check_result,
+                    buffer->octree_objects_inside);
+                if (visibility == OBJECT_VISIBLE_LIGHTING_PASSES)
+                    AddToVisibleEntityArray(buffer->visible_object, buffer->nu_visible_objects,
+                        buffer->max_visible_objects, so->id);
+                else if (visibility == OBJECT_VISIBLE_FINAL_PASS)
+                    AddToVisibleEntityArray(buffer->final_pass_object,
+                        buffer->nu_final_pass_objects, buffer->max_final_pass_objects, so->id);
+            }
+            else if (type == SRE_ENTITY_LIGHT) {
+                sreLight *l = scene->light[index];
+                if (DetermineLightIsVisible(*l, frustum))
+                    AddToVisibleEntityArray(buffer->visible_light, buffer->nu_visible_lights,
+                        buffer->max_visible_lights, l->id);
+            }
+        }
+    }
+}
+
+// Job equivalent of sreScene::DetermineVisibleEntitiesInFastOctree() for non-root nodes.
+
+static void DetermineVisibleEntitiesInFastOctreeJob(sreScene *scene, VisibleEntitiesJobBuffer *buffer,
+const sreFastOctree& fast_oct, int array_index, const sreFrustum& frustum,
+BoundsCheckResult bounds_check_result) {
+    int node_index = fast_oct.array[array_index];
+    if (bounds_check_result != SRE_COMPLETELY_INSIDE) {
+        bounds_check_result = QueryIntersection(fast_oct.node_bounds[node_index], frustum.frustum_world);
+        if (bounds_check_result == SRE_COMPLETELY_OUTSIDE) {
+            buffer->octree_culled_count_frustum++;
+            return;
+        }
+#if SRE_NU_FRUSTUM_PLANES == 5
+        if (!Intersects(sre_internal_viewpoint, fast_oct.node_bounds[node_index].AABB)) {
+            float size = AccurateProjectedSize(frustum, fast_oct.node_bounds[node_index].sphere.center,
+                fast_oct.node_bounds[node_index].sphere.radius);
+            if (size < SRE_OCTREE_SIZE_CUTOFF) {
+                buffer->octree_culled_count_projected++;
+                return;
+            }
+        }
+#endif
+    }
+    if (&fast_oct == sre_internal_occlusion_octree &&
+    (sre_internal_rendering_flags & SRE_RENDERING_FLAG_OCCLUSION_CULLING) &&
+    sreCheckOccluded(sre_internal_octree_node_occlusion_state[node_index])) {
+        buffer->octree_culled_count_occlusion++;
+        return;
+    }
+    if (NodeIsSoftwareOccluded(fast_oct.node_bounds[node_index].AABB)) {
+        buffer->octree_culled_count_occlusion++;
+        return;
+    }
+    int nu_octants = fast_oct.GetNumberOfOctants(array_index + 1);
+    int nu_entities = fast_oct.array[array_index + 2];
+    array_index += 3;
+    DetermineNodeVisibleEntitiesJob(scene, buffer, fast_oct, frustum, bounds_check_result,
+        array_index, nu_entities);
+    array_index += nu_entities;
+    for (int i = 0; i < nu_octants; i++)
+        DetermineVisibleEntitiesInFastOctreeJob(scene, buffer, fast_oct, fast_oct.array[array_index + i],
+            frustum, bounds_check_result);
+}
+
+static void CalculateStrictOptimizedOctreeSubnodeBounds(const sreOctreeNodeBounds& node_bounds,
+int octant, sreOctreeNodeBounds& subnode_bounds) {
+    float dim = node_bounds.AABB.dim_max.x - node_bounds.AABB.dim_min.x;
+    Vector3D subnode_half_dim = Vector3D(0.25f, 0.25f, 0.25f) * dim;
+    subnode_bounds.sphere.center = node_bounds.AABB.dim_min + subnode_center_vector[octant] * dim;
+    subnode_bounds.AABB.dim_min = subnode_bounds.sphere.center - subnode_half_dim;
+    subnode_bounds.AABB.dim_max = subnode_bounds.sphere.center + subnode_half_dim;
+    subnode_bounds.sphere.radius = node_bounds.sphere.radius * 0.5f;
+}
+
+// Job equivalent of sreScene::DetermineVisibleEntitiesInFastStrictOptimizedOctree() for
+// non-root nodes.
+
+static void DetermineVisibleEntitiesInFastStrictOptimizedOctreeJob(sreScene *scene,
+VisibleEntitiesJobBuffer *buffer, const sreFastOctree& fast_oct, const sreOctreeNodeBounds& node_bounds,
+int array_index, const sreFrustum& frustum, BoundsCheckResult bounds_check_result) {
+    if (bounds_check_result != SRE_COMPLETELY_INSIDE) {
+        bounds_check_result = QueryIntersection(node_bounds, frustum.frustum_world);
+        if (bounds_check_result == SRE_COMPLETELY_OUTSIDE) {
+            buffer->octree_culled_count_frustum++;
+            return;
+        }
+#if SRE_NU_FRUSTUM_PLANES == 5
+        if (!Intersects(sre_internal_viewpoint, node_bounds.AABB)) {
+            float size = AccurateProjectedSize(frustum, node_bounds.sphere.center,
+                node_bounds.sphere.radius);
+            if (size < SRE_OCTREE_SIZE_CUTOFF) {
+                buffer->octree_culled_count_projected++;
+                return;
+            }
+        }
+#endif
+    }
+    if (NodeIsSoftwareOccluded(node_bounds.AABB)) {
+        buffer->octree_culled_count_occlusion++;
+        return;
+    }
+    unsigned int octant_data = (unsigned int)fast_oct.array[array_index];
+    int nu_octants = octant_data & 0xFF;
+    octant_data >>= 8;
+    int nu_entities = fast_oct.array[array_index + 1];
+    DetermineNodeVisibleEntitiesJob(scene, buffer, fast_oct, frustum, bounds_check_result,
+        array_index + 2, nu_entities);
+    array_index += nu_entities + 2;
+    for (int i = 0; i < nu_octants; i++) {
+        sreOctreeNodeBounds subnode_bounds;
+        CalculateStrictOptimizedOctreeSubnodeBounds(node_bounds, octant_data & 7, subnode_bounds);
+        octant_data >>= 3;
+        DetermineVisibleEntitiesInFastStrictOptimizedOctreeJob(scene, buffer, fast_oct, subnode_bounds,
+            fast_oct.array[array_index + i], frustum, bounds_check_result);
+    }
+}
+
+static void DetermineVisibleEntitiesJob(void *data, int job_index, int thread_index) {
+    VisibleEntitiesJobData *job_data = (VisibleEntitiesJobData *)data;
+    VisibleEntitiesJobBuffer *buffer = &visible_entities_job_buffer[job_index];
+    buffer->Reset();
+    if (job_data->strict_optimized)
+        DetermineVisibleEntitiesInFastStrictOptimizedOctreeJob(job_data->scene, buffer,
+            *job_data->fast_oct, job_data->node_bounds[job_index], job_data->array_index[job_index],
+            *job_data->frustum, SRE_BOUNDS_UNDEFINED);
+    else
+        DetermineVisibleEntitiesInFastOctreeJob(job_data->scene, buffer, *job_data->fast_oct,
+            job_data->array_index[job_index], *job_data->frustum, SRE_BOUNDS_UNDEFINED);
+}
+
+// Traverse a static octree using worker threads. Returns false when the octree is not
+// worth splitting into jobs, in which case nothing has been done.
+
+static bool DetermineVisibleEntitiesInStaticOctreeMultiThreaded(sreScene *scene,
+const sreFastOctree& fast_oct, const sreFrustum& frustum, bool strict_optimized) {
+    VisibleEntitiesJobData job_data;
+    int nu_octants;
+    int array_index;
+    if (strict_optimized) {
+        nu_octants = fast_oct.array[0] & 0xFF;
+        array_index = fast_oct.array[1] + 2;
+    }
+    else {
+        nu_octants = fast_oct.GetNumberOfOctants(1);
+        array_index = fast_oct.array[2] + 3;
+    }
+    if (nu_octants < 2 || sreGetThreadPoolSize() < 2)
+        return false;
+    if (visible_entities_job_buffer == NULL)
+        visible_entities_job_buffer = new VisibleEntitiesJobBuffer[SRE_MAX_VISIBLE_ENTITIES_JOBS];
+
+    // Process the entities in the root node first, so that the resulting order is the
+    // same as with single-threaded traversal.
+    if (strict_optimized)
+        scene->DetermineVisibleEntitiesInFastStrictOptimizedOctreeRootNode(fast_oct, 0, frustum,
+            SRE_BOUNDS_UNDEFINED);
+    else
+        scene->DetermineVisibleEntitiesInFastOctreeRootNode(fast_oct, 0, frustum,
+            SRE_BOUNDS_UNDEFINED);
+
+    job_data.scene = scene;
+    job_data.fast_oct = &fast_oct;
+    job_data.frustum = &frustum;
+    job_data.strict_optimized = strict_optimized;
+    unsigned int octant_data = (unsigned int)fast_oct.array[0] >> 8;
+    for (int i = 0; i < nu_octants; i++) {
+        job_data.array_index[i] = fast_oct.array[array_index + i];
+        if (strict_optimized) {
+            CalculateStrictOptimizedOctreeSubnodeBounds(fast_oct.node_bounds[0], octant_data & 7,
+                job_data.node_bounds[i]);
+            octant_data >>= 3;
+        }
+    }
+    sreRunThreadPoolJobs(DetermineVisibleEntitiesJob, &job_data, nu_octants);
+
+    // Merge the job buffers in octant order.
+    for (int i = 0; i < nu_octants; i++) {
+        VisibleEntitiesJobBuffer *buffer = &visible_entities_job_buffer[i];
+        for (int j = 0; j < buffer->nu_visible_objects; j++)
+            AddToVisibleEntityArray(scene->visible_object, scene->nu_visible_objects,
+                scene->max_visible_objects, buffer->visible_object[j]);
+        for (int j = 0; j < buffer->nu_final_pass_objects; j++)
+            AddToVisibleEntityArray(scene->final_pass_object, scene->nu_final_pass_objects,
+                scene->max_final_pass_objects, buffer->final_pass_object[j]);
+        for (int j = 0; j < buffer->nu_visible_lights; j++)
+            scene->visible_light_array.Add(buffer->visible_light[j]);
+        octree_culled_count_frustum += buffer->octree_culled_count_frustum;
+        octree_culled_count_projected += buffer->octree_culled_count_projected;
+        octree_culled_count_occlusion += buffer->octree_culled_count_occlusion;
+        octree_objects_inside += buffer->octree_objects_inside;
+    }
+    return true;
+}
+
+// Determine the visible objects in the dynamic object BVH. Nodes are checked against the
+// view frustum until they are completely inside or completely outside.
+
+void sreScene::DetermineVisibleEntitiesInObjectBVH(const sreObjectBVH& bvh, int node_index,
+const sreFrustum& frustum, BoundsCheckResult bounds_check_result) {
+    const sreObjectBVHNode& node = bvh.node[node_index];
+    if (bounds_check_result != SRE_COMPLETELY_INSIDE) {
+        bounds_check_result = QueryIntersection(node.bounds, frustum.frustum_world);
+        if (bounds_check_result == SRE_COMPLETELY_OUTSIDE) {
+            octree_culled_count_frustum++;
+            return;
+        }
+    }
+    if (node.child[0] >= 0 && NodeIsSoftwareOccluded(node.bounds.AABB)) {
+        octree_culled_count_occlusion++;
+        return;
+    }
+    if (node.child[0] < 0) {
+        sreObject *so = object[node.object_index];
+        if (!(so->flags & SRE_OBJECT_HIDDEN))
+            DetermineObjectIsVisible(*so, frustum, bounds_check_result);
+        return;
+    }
+    DetermineVisibleEntitiesInObjectBVH(bvh, node.child[0], frustum, bounds_check_result);
+    DetermineVisibleEntitiesInObjectBVH(bvh, node.child[1], frustum, bounds_check_result);
+}
+
 // Keep track of the number of static visible objects and lights so that
 // they can be reused for visible entity determination in the next frame
 // if the view frustum doesn't change.
 static int nu_static_visible_objects;
 static int nu_static_final_pass_objects;
 static int nu_static_visible_lights;
+// The occlusion culling flags with which the static visible entities were determined.
+static int static_visibility_culling_flags = 0;
 
 void sreScene::DetermineVisibleEntities(const sreFrustum& frustum) {
     octree_culled_count_frustum = 0;
     octree_culled_count_projected = 0;
+    octree_culled_count_occlusion = 0;
     octree_objects_inside = 0;
 
+    // Retrieve the available results of the occlusion queries of previous frames.
+    if (sre_internal_rendering_flags & SRE_RENDERING_FLAG_OCCLUSION_CULLING)
+        sreUpdateOcclusionQueryResults(this);
+    // Update the software depth buffer with the occluders.
+    if (sre_internal_rendering_flags & SRE_RENDERING_FLAG_SOFTWARE_OCCLUSION_CULLING)
+        sreRasterizeOccluders(this, frustum);
+
+    // Refit the dynamic object BVH for objects that have moved since the previous frame.
+    if (dynamic_object_bvh != NULL)
+        dynamic_object_bvh->Update(*this);
+
     // An optimization is possible when the view frustum has not changed
     // (frustum.most_recent_frame_changed < current_frame). The visible/final pass object
     // and visible light arrays from the previous frame will still be present and can be
     // reused. Only the static objects and lights can be reused; the visibility of dynamic
     // object and lights has to redetermined using the dynamic entities octrees.
-    if (frustum.most_recent_frame_changed < sre_internal_current_frame) {
+    // With occlusion culling, the visibility of static entities can change while the
+    // frustum is unchanged, so the optimization cannot be used. Software occlusion
+    // culling only uses static occluders, so it does not prevent the optimization, but
+    // the static entities have to be redetermined when a culling mode is toggled.
+    int culling_flags = sre_internal_rendering_flags & (SRE_RENDERING_FLAG_OCCLUSION_CULLING |
+        SRE_RENDERING_FLAG_SOFTWARE_OCCLUSION_CULLING);
+    bool culling_flags_changed = (culling_flags != static_visibility_culling_flags);
+    static_visibility_culling_flags = culling_flags;
+    if (frustum.most_recent_frame_changed < sre_internal_current_frame && !culling_flags_changed &&
+    !(sre_internal_rendering_flags & SRE_RENDERING_FLAG_OCCLUSION_CULLING)) {
         // Re-use visible objects up to nu_static_visible_objects and nu_static_final_pass_objects,
         // visible lights up to nu_static_visible_lights;
         nu_visible_objects = nu_static_visible_objects;
@@ -938,6 +1399,9 @@ void sreScene::DetermineVisibleEntities(const sreFrustum& frustum) {
             DetermineVisibleEntitiesInFastOctreeRootNode(fast_octree_dynamic_infinite_distance,
                 0, frustum, SRE_COMPLETELY_INSIDE);
         }
+        if (dynamic_object_bvh != NULL && dynamic_object_bvh->nu_nodes > 0)
+            DetermineVisibleEntitiesInObjectBVH(*dynamic_object_bvh, 0, frustum,
+                SRE_BOUNDS_UNDEFINED);
         return;
     }
 
@@ -951,8 +1415,10 @@ void sreScene::DetermineVisibleEntities(const sreFrustum& frustum) {
         // When an optimized strict octree or quadtree is used, calculate node bounding information
         // on the fly instead of looking it up in memory.
         // Traverse the static entities octrees.
-        DetermineVisibleEntitiesInFastStrictOptimizedOctree(fast_octree_static,
-            fast_octree_static.node_bounds[0], 0, frustum, SRE_BOUNDS_UNDEFINED);
+        if (!(sre_internal_rendering_flags & SRE_RENDERING_FLAG_MULTI_THREADED_VISIBILITY) ||
+        !DetermineVisibleEntitiesInStaticOctreeMultiThreaded(this, fast_octree_static, frustum, true))
+            DetermineVisibleEntitiesInFastStrictOptimizedOctree(fast_octree_static,
+                fast_octree_static.node_bounds[0], 0, frustum, SRE_BOUNDS_UNDEFINED);
         DetermineVisibleEntitiesInFastStrictOptimizedOctreeRootNode(
             fast_octree_static_infinite_distance, 0, frustum, SRE_BOUNDS_UNDEFINED);
         nu_static_visible_objects = nu_visible_objects;
@@ -966,7 +1432,9 @@ void sreScene::DetermineVisibleEntities(const sreFrustum& frustum) {
     }
     else {
         // Traverse the static entities octrees.
-        DetermineVisibleEntitiesInFastOctree(fast_octree_static, 0, frustum, SRE_BOUNDS_UNDEFINED);
+        if (!(sre_internal_rendering_flags & SRE_RENDERING_FLAG_MULTI_THREADED_VISIBILITY) ||
+        !DetermineVisibleEntitiesInStaticOctreeMultiThreaded(this, fast_octree_static, frustum, false))
+            DetermineVisibleEntitiesInFastOctree(fast_octree_static, 0, frustum, SRE_BOUNDS_UNDEFINED);
         DetermineVisibleEntitiesInFastOctree(fast_octree_static_infinite_distance,
             0, frustum, SRE_BOUNDS_UNDEFINED);
         nu_static_visible_objects = nu_visible_objects;
@@ -978,10 +1446,13 @@ void sreScene::DetermineVisibleEntities(const sreFrustum& frustum) {
         DetermineVisibleEntitiesInFastOctreeRootNode(
             fast_octree_dynamic_infinite_distance, 0, frustum, SRE_COMPLETELY_INSIDE);
     }
+    // Dynamic objects in the BVH are culled hierarchically.
+    if (dynamic_object_bvh != NULL && dynamic_object_bvh->nu_nodes > 0)
+        DetermineVisibleEntitiesInObjectBVH(*dynamic_object_bvh, 0, frustum, SRE_BOUNDS_UNDEFINED);
 //    printf("Number of visible objects: %d, lights: %d\n", nu_visible_objects,
 //          visible_light_array.Size());
-//    printf("octrees culled: frustum: %d projected size: %d\n", octree_culled_count_frustum,
-//        octree_culled_count_projected);
+//    printf("octrees culled: frustum: %d projected size: %d occlusion: %d\n",
+//        octree_culled_count_frustum, octree_culled_count_projected, octree_culled_count_occlusion);
 //    printf("objects inside octrees completely inside frustum: %d\n", octree_objects_inside);
 //    printf("%d light volumes intersect frustum\n", visible_light_array.Size());
 }
@@ -1204,6 +1675,198 @@ void sreScene::RenderFinalPassObjectsSinglePass(const sreFrustum& frustum) const
 
 // Multi-pass rendering.
 
+// Render queue used for the lighting passes and, when instancing is enabled, for the
+// ambient pass.
+//
+// When lighting pass batching is enabled, objects are not drawn immediately but added to a
+// queue with a 64-bit sort key made up of the object's shader, textures and LOD model. The
+// queue is sorted and drawn when the scissors or depth bounds are about to change and at the
+// end of the light's lighting pass, so that all objects in the queue are drawn with the same
+// scissors state. Because lighting passes are additive, the drawing order does not affect
+// the result. While drawing the sorted queue, shader and texture changes that do not change
+// the current state are skipped.
+//
+// When instancing is enabled, runs of objects in the sorted queue that share the LOD model,
+// shader and material are drawn with one instanced draw call.
+
+class sreLightingPassQueueEntry {
+public :
+    uint64_t key;
+    sreObject *so;
+    sreLODModel *m;
+};
+
+static sreLightingPassQueueEntry *lighting_pass_queue = NULL;
+static int lighting_pass_queue_size = 0;
+static int max_lighting_pass_queue_size = 0;
+static bool lighting_pass_queue_enabled = false;
+static bool lighting_pass_shadow_map_required;
+// Object list for instanced drawing.
+static sreObject **instanced_objects = NULL;
+static int max_instanced_objects = 0;
+
+static uint64_t LightingPassSortKey(const sreObject& so, const sreLODModel *m,
+bool shadow_map_required) {
+    int light_type = sre_internal_current_light->shader_light_type;
+    int shader;
+    if (shadow_map_required)
+        shader = so.current_shader_shadow_map[light_type];
+    else
+        shader = so.current_shader[light_type];
+    // Bits 56-63: shader (- 1 when not yet selected). Bits 40-55: texture. Bits 28-39:
+    // normal map. Bits 20-27: specularity map. Bits 0-19: LOD model. Only the lower bits of
+    // the ids are used, which only affects the quality of the ordering.
+    uint64_t key = (uint64_t)((shader + 1) & 0xFF) << 56;
+    if (so.texture != NULL)
+        key |= (uint64_t)(so.texture->opengl_id & 0xFFFF) << 40;
+    if (so.normal_map != NULL)
+        key |= (uint64_t)(so.normal_map->opengl_id & 0xFFF) << 28;
+    if (so.specularity_map != NULL)
+        key |= (uint64_t)(so.specularity_map->opengl_id & 0xFF) << 20;
+    key |= m->id & 0xFFFFF;
+    return key;
+}
+
+// The ambient pass always uses the same shader, and only the texture and emission map
+// are relevant.
+
+static uint64_t AmbientPassSortKey(const sreObject& so, const sreLODModel *m) {
+    int shader = so.current_shader[SRE_SHADER_LIGHT_TYPE_AMBIENT];
+    uint64_t key = (uint64_t)((shader + 1) & 0xFF) << 56;
+    if (so.texture != NULL)
+        key |= (uint64_t)(so.texture->opengl_id & 0xFFFF) << 40;
+    if (so.emission_map != NULL)
+        key |= (uint64_t)(so.emission_map->opengl_id & 0xFFFF) << 20;
+    key |= m->id & 0xFFFFF;
+    return key;
+}
+
+static int LightingPassQueueCompare(const void *e1, const void *e2) {
+    const sreLightingPassQueueEntry *entry1 = (const sreLightingPassQueueEntry *)e1;
+    const sreLightingPassQueueEntry *entry2 = (const sreLightingPassQueueEntry *)e2;
+    if (entry1->key < entry2->key)
+        return - 1;
+    if (entry1->key > entry2->key)
+        return 1;
+    // Impose an order by id so that the drawing order is deterministic.
+    return entry1->so->id - entry2->so->id;
+}
+
+static void AddToLightingPassQueue(sreObject& so, sreLODModel *m, uint64_t key) {
+    if (lighting_pass_queue_size == max_lighting_pass_queue_size) {
+        int new_max_size = maxi(max_lighting_pass_queue_size * 2, 256);
+        sreLightingPassQueueEntry *new_queue = new sreLightingPassQueueEntry[new_max_size];
+        for (int i = 0; i < lighting_pass_queue_size; i++)
+            new_queue[i] = lighting_pass_queue[i];
+        delete [] lighting_pass_queue;
+        lighting_pass_queue = new_queue;
+        max_lighting_pass_queue_size = new_max_size;
+    }
+    lighting_pass_queue[lighting_pass_queue_size].key = key;
+    lighting_pass_queue[lighting_pass_queue_size].so = &so;
+    lighting_pass_queue[lighting_pass_queue_size].m = m;
+    lighting_pass_queue_size++;
+}
+
+// Objects can be drawn in the same instanced batch when they have the same sort key
+// (shader, textures and LOD model) and the same material. Only the model transformation
+// and the diffuse reflection color may differ.
+
+static bool ObjectsCanBeInstanced(const sreLightingPassQueueEntry& e1,
+const sreLightingPassQueueEntry& e2) {
+    const sreObject& so1 = *e1.so;
+    const sreObject& so2 = *e2.so;
+    return e1.key == e2.key && e1.m == e2.m && so1.flags == so2.flags &&
+        so1.texture == so2.texture && so1.normal_map == so2.normal_map &&
+        so1.specularity_map == so2.specularity_map && so1.emission_map == so2.emission_map &&
+        so1.UV_transformation_matrix == so2.UV_transformation_matrix &&
+        so1.specular_reflection_color == so2.specular_reflection_color &&
+        so1.specular_exponent == so2.specular_exponent &&
+        so1.emission_color == so2.emission_color &&
+        so1.diffuse_fraction == so2.diffuse_fraction &&
+        so1.roughness_values.x == so2.roughness_values.x &&
+        so1.roughness_values.y == so2.roughness_values.y &&
+        so1.roughness_weights.x == so2.roughness_weights.x &&
+        so1.roughness_weights.y == so2.roughness_weights.y &&
+        so1.anisotropic == so2.anisotropic;
+}
+
+// Draw the (sorted) queue, using instanced draw calls where possible.
+
+static void DrawQueue(bool ambient_pass, bool shadow_map_required) {
+    bool instancing = (sre_internal_rendering_flags & SRE_RENDERING_FLAG_INSTANCING) &&
+        !sre_internal_reselect_shaders;
+    int i = 0;
+    while (i < lighting_pass_queue_size) {
+        int n = 1;
+        // The shader must already have been selected for the object (bits 56-63 of the
+        // key are non-zero).
+        if (instancing && (lighting_pass_queue[i].key >> 56) != 0)
+            while (i + n < lighting_pass_queue_size &&
+            ObjectsCanBeInstanced(lighting_pass_queue[i], lighting_pass_queue[i + n]))
+                n++;
+        if (n > 1) {
+            if (n > max_instanced_objects) {
+                delete [] instanced_objects;
+                max_instanced_objects = maxi(n, 256);
+                instanced_objects = new sreObject *[max_instanced_objects];
+            }
+            for (int j = 0; j < n; j++)
+                instanced_objects[j] = lighting_pass_queue[i + j].so;
+            if (sreDrawObjectsInstanced(instanced_objects, n, ambient_pass,
+            shadow_map_required)) {
+                i += n;
+                continue;
+            }
+        }
+        // Draw the objects individually.
+        for (int j = i; j < i + n; j++)
+            if (ambient_pass)
+                sreDrawObjectAmbientPass(lighting_pass_queue[j].so);
+            else
+                sreDrawObjectMultiPassLightingPass(lighting_pass_queue[j].so,
+                    shadow_map_required);
+        i += n;
+    }
+}
+
+static void BeginLightingPassQueue(const sreLight& light) {
+    lighting_pass_queue_enabled =
+        (sre_internal_rendering_flags & SRE_RENDERING_FLAG_LIGHTING_PASS_BATCHING) != 0;
+    lighting_pass_shadow_map_required = light.shadow_map_required;
+    lighting_pass_queue_size = 0;
+}
+
+static void FlushLightingPassQueue() {
+    if (lighting_pass_queue_size == 0)
+        return;
+    if (lighting_pass_queue_size > 1)
+        qsort(lighting_pass_queue, lighting_pass_queue_size, sizeof(sreLightingPassQueueEntry),
+            LightingPassQueueCompare);
+    sreBeginLightingPassStateFiltering();
+    DrawQueue(false, lighting_pass_shadow_map_required);
+    sreEndLightingPassStateFiltering();
+    sre_internal_lighting_pass_stats.batches++;
+    lighting_pass_queue_size = 0;
+}
+
+static void EndLightingPassQueue() {
+    FlushLightingPassQueue();
+    lighting_pass_queue_enabled = false;
+}
+
+// Draw an object in the lighting pass, or add it to the queue when batching is enabled.
+
+static void DrawLightingPassObject(sreObject& so, bool shadow_map_required) {
+    sre_internal_lighting_pass_stats.objects_drawn++;
+    if (!lighting_pass_queue_enabled) {
+        sreDrawObjectMultiPassLightingPass(&so, shadow_map_required);
+        return;
+    }
+    sreLODModel *m = sreCalculateLODModel(so);
+    AddToLightingPassQueue(so, m, LightingPassSortKey(so, m, shadow_map_required));
+}
+
 // Ambient pass of multi-pass rendering.
 
 static void RenderVisibleObjectAmbientPass(sreObject& so) {
@@ -1215,8 +1878,27 @@ static void RenderVisibleObjectAmbientPass(sreObject& so) {
 
 void sreScene::RenderVisibleObjectsAmbientPass(const sreFrustum& frustum) const {
     object_count = 0;
-    for (int i = 0; i < nu_visible_objects; i++)
-        RenderVisibleObjectAmbientPass(*object[visible_object[i]]);
+    if (!(sre_internal_rendering_flags & SRE_RENDERING_FLAG_INSTANCING) ||
+    sre_internal_reselect_shaders) {
+        for (int i = 0; i < nu_visible_objects; i++)
+            RenderVisibleObjectAmbientPass(*object[visible_object[i]]);
+        return;
+    }
+    // With instancing, sort the objects using the render queue so that objects with
+    // the same model and material are adjacent. The ambient pass also lays down the
+    // depth buffer, but the drawing order does not affect the result.
+    lighting_pass_queue_size = 0;
+    for (int i = 0; i < nu_visible_objects; i++) {
+        sreObject *so = object[visible_object[i]];
+        sreLODModel *m = sreCalculateLODModel(*so);
+        AddToLightingPassQueue(*so, m, AmbientPassSortKey(*so, m));
+    }
+    object_count = nu_visible_objects;
+    if (lighting_pass_queue_size > 1)
+        qsort(lighting_pass_queue, lighting_pass_queue_size, sizeof(sreLightingPassQueueEntry),
+            LightingPassQueueCompare);
+    DrawQueue(true, false);
+    lighting_pass_queue_size = 0;
 }
 
 // Lighting pass of multi-pass rendering.
@@ -1228,7 +1910,7 @@ static void RenderVisibleObjectLightingPassCompletelyInside(sreObject& so) {
     object_count++;
 
      // Draw the object.
-    sreDrawObjectMultiPassLightingPass(&so, sre_internal_current_light->shadow_map_required);
+    DrawLightingPassObject(so, sre_internal_current_light->shadow_map_required);
 }
 
 static int light_volume_intersection_test_count;
@@ -1249,7 +1931,7 @@ const sreLight& light, const sreFrustum &frustum) {
     object_count++;
 
     // Draw the object.
-    sreDrawObjectMultiPassLightingPass(&so, light.shadow_map_required);
+    DrawLightingPassObject(so, light.shadow_map_required);
 }
 
 enum {
@@ -1345,6 +2027,8 @@ const sreLight& light, const sreFrustum &frustum, const sreScissors& object_scis
     // if normal light scissors are required but custom scissors smaller than
     // the light scissors region are still active, update the scissors region.
     if (viewport_adjusted || custom_scissors_set) {
+        // Draw the queued objects with the current scissors first.
+        FlushLightingPassQueue();
         SetGLScissors(scissors);
 
 #ifdef DEBUG_SCISSORS
@@ -1377,6 +2061,7 @@ const sreLight& light, const sreFrustum &frustum, const sreScissors& object_scis
     // are smaller are still set, update the depth bounds.
 #ifndef NO_DEPTH_BOUNDS
     if (GLEW_EXT_depth_bounds_test && (depth_bounds_adjusted || custom_depth_bounds_set)) {
+        FlushLightingPassQueue();
         glDepthBoundsEXT(scissors.near, scissors.far);
         custom_depth_bounds_set = depth_bounds_adjusted;
 #ifdef DEBUG_OPENGL
@@ -1395,7 +2080,7 @@ const sreLight& light, const sreFrustum &frustum, const sreScissors& object_scis
     object_count++;
 
     // Draw the object.
-    sreDrawObjectMultiPassLightingPass(&so, light.shadow_map_required);
+    DrawLightingPassObject(so, light.shadow_map_required);
 }
 
 // Render a lighting pass visible object, using geometry scissors if possible,
@@ -1558,6 +2243,7 @@ static int intersection_tests_all_lights;
 void sreScene::RenderVisibleObjectsLightingPass(const sreFrustum& frustum, const sreLight& light) const {
     object_count = 0;
     light_volume_intersection_test_count = 0;
+    BeginLightingPassQueue(light);
     if (light.type & SRE_LIGHT_DIRECTIONAL) {
         // For directional lights, every object is completely inside the light volume.
         // Scissors will have been disabled by the calling function.
@@ -1747,6 +2433,7 @@ void sreScene::RenderVisibleObjectsLightingPass(const sreFrustum& frustum, const
                 // a previous object. Since the objects are all completely inside the
                 // light volume, we can disable scissors completely (it doesn't help
                 // to use the light-specific scissors).
+                FlushLightingPassQueue();
                 DisableScissors();
                 for (int i = light.nu_light_volume_objects_partially_inside;
                 i < light.nu_light_volume_objects; i++) {
@@ -1790,6 +2477,7 @@ void sreScene::RenderVisibleObjectsLightingPass(const sreFrustum& frustum, const
             if (light.nu_light_volume_objects_partially_inside < light.nu_light_volume_objects) {
                 // Since the objects are all completely inside the light volume, we can disable
                 // scissors completely (it doesn't help to use the light-specific scissors).
+                FlushLightingPassQueue();
                 DisableScissors();
                 for (int i = light.nu_light_volume_objects_partially_inside; i < light.nu_light_volume_objects; i++) {
                     sreObject *so = object[light.light_volume_object[i]];
@@ -1881,6 +2569,7 @@ void sreScene::RenderVisibleObjectsLightingPass(const sreFrustum& frustum, const
             object_count_completely_inside, light_volume_intersection_test_count);
 #endif
     }
+    EndLightingPassQueue();
     object_count_all_lights += object_count;
     intersection_tests_all_lights += light_volume_intersection_test_count;
 }
@@ -1957,6 +2646,13 @@ void sreScene::RenderLightingPasses(sreFrustum *frustum, sreView *view) {
         CalculateVisibleActiveLights(view, sre_internal_max_active_lights);
     }
 
+#ifndef NO_SHADOW_MAP
+    // Determine the shadow casters of the active lights with worker threads when enabled.
+    sreDetermineShadowCastersForActiveLights(this, *frustum);
+    // Render the spot and beam light shadow maps into the shadow map atlas when enabled.
+    sreRenderShadowMapAtlas(this, *frustum);
+#endif
+
     for (int i = 0; i < nu_active_lights; i++) {
         // Set the light to be rendered.
         if (nu_active_lights == visible_light_array.Size())
@@ -1986,6 +2682,7 @@ void sreScene::RenderLightingPasses(sreFrustum *frustum, sreView *view) {
 
 #ifndef NO_SHADOW_MAP
         if (sre_internal_shadows == SRE_SHADOWS_SHADOW_MAPPING) {
+            sreProfilerScope scope(SRE_PROFILE_SHADOW_MAP, sre_internal_current_light_index);
             // Shadow mapping. Render shadow maps without scissors.
             DisableScissors();
             // Disable blending.
@@ -2066,7 +2763,10 @@ skip_scissors :
         // reset to (0, 1.0f).
         glDepthRangef(0, 0.99998f);
 #endif
-        sreRenderShadowVolumes(this, sre_internal_current_light, *frustum);
+        {
+            sreProfilerScope scope(SRE_PROFILE_SHADOW_VOLUMES, sre_internal_current_light_index);
+            sreRenderShadowVolumes(this, sre_internal_current_light, *frustum);
+        }
         glDepthRangef(0, 0.99998f);
 
         if ((sre_internal_scissors & SRE_SCISSORS_LIGHT_MASK) && !(sre_internal_current_light->type &
@@ -2089,8 +2789,11 @@ do_lighting_pass :
         glBlendFunc(GL_ONE, GL_ONE);
 
         // Render the objects affected by this light.
-        GL3InitializeShadersBeforeLight();
-        RenderVisibleObjectsLightingPass(*frustum, *sre_internal_current_light);
+        {
+            sreProfilerScope scope(SRE_PROFILE_LIGHTING_PASS, sre_internal_current_light_index);
+            GL3InitializeShadersBeforeLight();
+            RenderVisibleObjectsLightingPass(*frustum, *sre_internal_current_light);
+        }
     }
     DisableScissors();
 
@@ -2196,8 +2899,11 @@ void sreScene::RenderLightingPassesNoShadow(sreFrustum *frustum, sreView *view)
 skip_scissors :
 
         CHECK_GL_ERROR("Error before lighting pass RenderVisibleObjects\n");
-        GL3InitializeShadersBeforeLight();
-        RenderVisibleObjectsLightingPass(*frustum, *sre_internal_current_light);
+        {
+            sreProfilerScope scope(SRE_PROFILE_LIGHTING_PASS, sre_internal_current_light_index);
+            GL3InitializeShadersBeforeLight();
+            RenderVisibleObjectsLightingPass(*frustum, *sre_internal_current_light);
+        }
         CHECK_GL_ERROR("Error after lighting pass RenderVisibleObjects\n");
     }
 
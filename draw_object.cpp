@@ -25,6 +25,7 @@ OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
 #include <math.h>
 #include <malloc.h>
 #include <float.h>
+#include <stdint.h>
 #ifdef OPENGL_ES2
 #include <GLES2/gl2.h>
 #endif
@@ -188,33 +189,18 @@ void sreDrawObjectLightHalo(sreObject *so) {
     glEnable(GL_BLEND);
     glBlendFunc(GL_ONE, GL_ONE_MINUS_SRC_ALPHA);
    // The normal buffer is used for the centers of the halo billboards.
-    glEnableVertexAttribArray(2);
-    glBindBuffer(GL_ARRAY_BUFFER, m->GL_attribute_buffer[SRE_ATTRIBUTE_NORMAL]);
-    glVertexAttribPointer(
-        2,
-        3,
-        GL_FLOAT,
-        GL_FALSE,
-        0,
-        (void *)0
-        );
-    glEnableVertexAttribArray(0);
-    glBindBuffer(GL_ARRAY_BUFFER, m->GL_attribute_buffer[SRE_ATTRIBUTE_POSITION]);
-    glVertexAttribPointer(
-        0,
-        4,
-        GL_FLOAT,
-        GL_FALSE,
-        0,
-        (void *)0
-    );
+    GL3EnableBillboardAttribute(m, SRE_ATTRIBUTE_NORMAL);
+    GL3EnableBillboardAttribute(m, SRE_ATTRIBUTE_POSITION);
     if (so->flags & SRE_OBJECT_PARTICLE_SYSTEM) {
         glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, m->GL_element_buffer);
         glDrawElements(GL_TRIANGLES, m->nu_triangles * 3, GL_UNSIGNED_SHORT, (void *)(0));
+        sreProfilerCountDraw(m->nu_triangles);
     }
-    else
+    else {
         // Draw a triangle fan consisting of two triangles from the still bound vertex position buffer.
         glDrawArrays(GL_TRIANGLE_FAN, 0, 4);
+        sreProfilerCountDraw(2);
+    }
     glDisableVertexAttribArray(0);
     glDisableVertexAttribArray(2);
     glDepthMask(GL_TRUE);
@@ -234,23 +220,17 @@ void sreDrawObjectBillboard(sreObject *so) {
         glEnable(GL_BLEND);
         glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
     }
-    glEnableVertexAttribArray(0);
-    glBindBuffer(GL_ARRAY_BUFFER, m->GL_attribute_buffer[SRE_ATTRIBUTE_POSITION]);
-    glVertexAttribPointer(
-        0,
-        4,
-        GL_FLOAT,
-        GL_FALSE,
-        0,
-        (void *)0
-    );
+    GL3EnableBillboardAttribute(m, SRE_ATTRIBUTE_POSITION);
     if (so->flags & SRE_OBJECT_PARTICLE_SYSTEM) {
         glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, m->GL_element_buffer);
         glDrawElements(GL_TRIANGLES, m->nu_triangles * 3, GL_UNSIGNED_SHORT, (void *)(0));
+        sreProfilerCountDraw(m->nu_triangles);
     }
-    else
+    else {
         // Draw a triangle fan consisting of two triangles from the still bound vertex position buffer.
         glDrawArrays(GL_TRIANGLE_FAN, 0, 4);
+        sreProfilerCountDraw(2);
+    }
     glDisableVertexAttribArray(0);
     if (so->render_flags & SRE_OBJECT_INFINITE_DISTANCE) {
         glDepthMask(GL_TRUE);
@@ -303,15 +283,63 @@ const sreAttributeInfo& model_attribute_info) {
     }
 }
 
+#ifndef OPENGL_ES2
+
+// Set up the per-instance attributes for an instanced draw call from the instance data
+// at the given offset in the streaming buffer. The matrices are specified as row or
+// column vectors.
+
+static void SetupInstanceAttributes(unsigned int offset) {
+    glBindBuffer(GL_ARRAY_BUFFER, sre_internal_streaming_buffer);
+    for (int i = 0; i < SRE_NU_INSTANCE_ATTRIBUTES; i++) {
+        int attribute = SRE_INSTANCE_ATTRIBUTE_MODEL_MATRIX + i;
+        int size, data_offset;
+        if (attribute < SRE_INSTANCE_ATTRIBUTE_ROTATION_MATRIX) {
+            size = 4;
+            data_offset = i * 4;
+        }
+        else {
+            size = 3;
+            data_offset = 12 + (attribute - SRE_INSTANCE_ATTRIBUTE_ROTATION_MATRIX) * 3;
+        }
+        glEnableVertexAttribArray(attribute);
+        glVertexAttribPointer(attribute, size, GL_FLOAT, GL_FALSE, sizeof(sreInstanceData),
+            (void *)(uintptr_t)(offset + data_offset * sizeof(float)));
+        glVertexAttribDivisor(attribute, 1);
+    }
+}
+
+static void ResetInstanceAttributes() {
+    for (int i = 0; i < SRE_NU_INSTANCE_ATTRIBUTES; i++) {
+        glVertexAttribDivisor(SRE_INSTANCE_ATTRIBUTE_MODEL_MATRIX + i, 0);
+        glDisableVertexAttribArray(SRE_INSTANCE_ATTRIBUTE_MODEL_MATRIX + i);
+    }
+}
+
+#endif
+
 // This function issue the actual draw commands. The attribute information in info must be
-// initialized.
+// initialized. When nu_instances is greater than one, instanced draw calls are used with
+// the per-instance attributes stored at instance_data_offset in the streaming buffer.
 
 static void sreFinishDrawingObject(sreObject *so, sreLODModel *m,
-sreObjectAttributeInfo *info) {
-    if (info->attribute_masks & 0xFF)
-        m->SetupAttributesNonInterleaved(info);
-    if (info->attribute_masks & 0xFFFFFF00)
-        m->SetupAttributesInterleaved(info);
+sreObjectAttributeInfo *info, int nu_instances = 1, unsigned int instance_data_offset = 0) {
+    // When a vertex array object for the attribute configuration has already been set up
+    // for the model, binding it is all that is needed.
+    int vertex_array_object = m->BindVertexArrayObject(info);
+    if (vertex_array_object != SRE_VERTEX_ARRAY_OBJECT_BOUND) {
+        if (info->attribute_masks & 0xFF)
+            m->SetupAttributesNonInterleaved(info);
+        if (info->attribute_masks & 0xFFFFFF00)
+            m->SetupAttributesInterleaved(info);
+        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, m->GL_element_buffer);
+    }
+#ifndef OPENGL_ES2
+    // The per-instance attributes are not recorded in the vertex array object; they are
+    // disabled again before it is unbound.
+    if (nu_instances > 1)
+        SetupInstanceAttributes(instance_data_offset);
+#endif
 
 #ifdef DEBUG_RENDER_LOG
     if (sre_internal_debug_message_level >= SRE_MESSAGE_VERBOSE_LOG) {
@@ -322,7 +350,6 @@ sreObjectAttributeInfo *info) {
     }
 #endif
 
-    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, m->GL_element_buffer);
     // Multiple meshes are supported, which can have different textures.
     // Multiple meshes are currently only generated by assimp-imported objects.
     for (int i = 0; i < m->nu_meshes; i++) {
@@ -338,12 +365,36 @@ sreObjectAttributeInfo *info) {
             // has been bound yet. Bind the textures for the mesh.
             sreInitializeShaderWithMesh(so, &m->mesh[i]);
         }
+#ifndef OPENGL_ES2
+        if (nu_instances > 1) {
+            if (m->GL_indexsize == 2)
+                glDrawElementsInstanced(GL_TRIANGLES, nu_vertices, GL_UNSIGNED_SHORT,
+                    (void *)(vertex_offset * 2), nu_instances);
+            else
+                glDrawElementsInstanced(GL_TRIANGLES, nu_vertices, GL_UNSIGNED_INT,
+                    (void *)(vertex_offset * 4), nu_instances);
+            sreProfilerCountDraw(nu_vertices / 3 * nu_instances);
+            continue;
+        }
+#endif
         if (m->GL_indexsize == 2)
             glDrawElements(GL_TRIANGLES, nu_vertices, GL_UNSIGNED_SHORT, (void *)(vertex_offset * 2));
         else
             glDrawElements(GL_TRIANGLES, nu_vertices, GL_UNSIGNED_INT, (void *)(vertex_offset * 4));
+        sreProfilerCountDraw(nu_vertices / 3);
     } // end for each each mesh
 
+#ifndef OPENGL_ES2
+    if (nu_instances > 1)
+        ResetInstanceAttributes();
+#endif
+    if (vertex_array_object != SRE_VERTEX_ARRAY_OBJECT_NONE) {
+        // The enabled attributes remain part of the vertex array object.
+        sreUnbindVertexArrayObject();
+        sreResetGLFlags(so);
+        return;
+    }
+
     // Disable non-interleaved attribute buffers.
     unsigned int mask = info->attribute_masks & 0xFF;
     if (mask != 0) {
@@ -660,4 +711,61 @@ void sreDrawObjectMultiPassLightingPass(sreObject *so, bool shadow_map_required)
     sreFinishDrawingObject(so, m, info);
 }
 
-
+// Hardware instancing for the ambient and lighting passes of multi-pass rendering.
+//
+// Draw a batch of objects that share the LOD model, selected shader and material of the first
+// object with one instanced draw call per mesh. The model matrix, rotation matrix and diffuse
+// reflection color of each object are written to the streaming buffer as per-instance
+// attributes. Returns false when the batch could not be drawn instanced (the shader has no
+// instanced variant or the streaming buffer is full), in which case the caller should draw
+// the objects individually.
+
+bool sreDrawObjectsInstanced(sreObject **so, int nu_objects, bool ambient_pass,
+bool shadow_map_required) {
+#ifdef OPENGL_ES2
+    return false;
+#else
+    sreObject *first = so[0];
+    int shader;
+    sreObjectAttributeInfo *info;
+    if (ambient_pass) {
+        shader = first->current_shader[SRE_SHADER_LIGHT_TYPE_AMBIENT];
+        info = &first->attribute_info_ambient_pass;
+    }
+    else if (shadow_map_required) {
+        shader = first->current_shader_shadow_map[sre_internal_current_light->shader_light_type];
+        info = &first->attribute_info_shadow_map;
+    }
+    else {
+        shader = first->current_shader[sre_internal_current_light->shader_light_type];
+        info = &first->attribute_info;
+    }
+    // The shader and attribute information of the first object must have been set up by
+    // drawing it individually before.
+    if (shader < 0 || !sreMultiPassInstancedShaderAvailable(shader))
+        return false;
+
+    unsigned int offset;
+    sreInstanceData *data = (sreInstanceData *)sreMapStreamingBuffer(
+        nu_objects * sizeof(sreInstanceData), offset);
+    if (data == NULL)
+        return false;
+    for (int i = 0; i < nu_objects; i++) {
+        memcpy(data[i].model_matrix, &so[i]->model_matrix, sizeof(float) * 12);
+        memcpy(data[i].rotation_matrix, &so[i]->rotation_matrix, sizeof(float) * 9);
+        memcpy(data[i].diffuse_reflection_color, &so[i]->diffuse_reflection_color,
+            sizeof(float) * 3);
+    }
+    sreUnmapStreamingBuffer();
+
+    sreInitializeObjectShaderMultiPassInstanced(*first, shader);
+    sreSetGLFlags(first);
+    sreLODModel *m = sreCalculateLODModel(*first);
+
+    sreFinishDrawingObject(first, m, info, nu_objects, offset);
+
+    sre_internal_lighting_pass_stats.instanced_draws++;
+    sre_internal_lighting_pass_stats.instanced_objects += nu_objects;
+    return true;
+#endif
+}
@@ -164,17 +164,31 @@ void sreLODModelFluid::UpdateVertexBuffers() {
     // Update vertex buffers.
     // Since the vertex buffer has four-dimensions vertices, we have to convert from the
     // fluid state's three-dimensional vertices.
-    float *fvertices = new float[nu_vertices * 4];
+    // The fluid model's buffers are used at offset zero by every rendering path (including
+    // shadow maps), so they are not sub-allocated from the streaming buffer. Instead, with
+    // OpenGL the buffer is mapped with invalidation, which allows the driver to provide
+    // fresh storage without waiting for the GPU, and the vertices are converted directly
+    // into it.
     Vector3D *vert = fluid->buffer[fluid->renderBuffer];
+    glBindBuffer(GL_ARRAY_BUFFER, GL_attribute_buffer[SRE_ATTRIBUTE_POSITION]);
+#ifdef OPENGL_ES2
+    float *fvertices = new float[nu_vertices * 4];
+#else
+    float *fvertices = (float *)glMapBufferRange(GL_ARRAY_BUFFER, 0,
+        nu_vertices * sizeof(float) * 4, GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_BUFFER_BIT);
+#endif
     for (int i = 0; i < nu_vertices; i++) {
         fvertices[i * 4] = vert[i].x;
         fvertices[i * 4 + 1] = vert[i].y;
         fvertices[i * 4 + 2] = vert[i].z;
         fvertices[i * 4 + 3] = 1.0f;
     }
-    glBindBuffer(GL_ARRAY_BUFFER, GL_attribute_buffer[SRE_ATTRIBUTE_POSITION]);
+#ifdef OPENGL_ES2
     glBufferData(GL_ARRAY_BUFFER, nu_vertices * sizeof(float) * 4, &fvertices[0], GL_DYNAMIC_DRAW);
     delete [] fvertices;
+#else
+    glUnmapBuffer(GL_ARRAY_BUFFER);
+#endif
     // Update normals.
     // Although the normals are not normalized, the lighting pass fragment shader will generally
     // perform normalization.
@@ -194,7 +208,12 @@ void sreLODModelFluid::UpdateVertexBuffers() {
     }
 #endif
     glBindBuffer(GL_ARRAY_BUFFER, GL_attribute_buffer[SRE_ATTRIBUTE_NORMAL]);
+#ifdef OPENGL_ES2
     glBufferData(GL_ARRAY_BUFFER, nu_vertices * sizeof(float) * 3, vertex_normal, GL_DYNAMIC_DRAW);
+#else
+    // The buffer keeps its size, so only the contents have to be replaced.
+    glBufferSubData(GL_ARRAY_BUFFER, 0, nu_vertices * sizeof(float) * 3, vertex_normal);
+#endif
 }
 
 void sreEvaluateModelFluid(sreModel *m) {
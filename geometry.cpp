@@ -111,6 +111,7 @@ sreLODModel::sreLODModel() {
     nu_meshes = 1;
     referenced = false;
     flags = 0;
+    nu_vertex_array_objects = 0;
     // Note: when a new sreLODModel is created, normally
     // the sreBaseModel constructor and this constructor
     // are called in succession.
@@ -118,6 +119,7 @@ sreLODModel::sreLODModel() {
 
 sreLODModelShadowVolume::sreLODModelShadowVolume() {
     nu_edges = 0;
+    triangle_plane_x = NULL;
     flags = SRE_LOD_MODEL_IS_SHADOW_VOLUME_MODEL;
     // Note: when a new sreLODModelShadowVolume is created,
     // normally the sreBaseModel, sreLODModel and this constructor
@@ -143,6 +145,8 @@ sreLODModel *sreLODModel::CreateCopy() const {
         *(sreLODModelShadowVolume *)m = *(sreLODModelShadowVolume *)this;
     else
         *m = *this;
+    // Vertex array objects are not shared with the copy.
+    m->nu_vertex_array_objects = 0;
     return m;
 }
 
@@ -1183,12 +1187,41 @@ void sreLODModelShadowVolume::CalculateEdges() {
     // The deconstructor should automatically free vertex positions and triangles.
     delete clone;
     sreMessage(SRE_MESSAGE_LOG, "CalculateEdges (geometry only): found %d edges.", nu_edges);
+    CalculateTrianglePlanes();
+}
+
+// Calculate the plane equation of every triangle, so that whether a triangle faces a
+// light (with position or direction L in model space) is determined by the sign of
+// Dot(plane, L).
+
+void sreLODModelShadowVolume::CalculateTrianglePlanes() {
+    delete [] triangle_plane_x;
+    int size = (nu_triangles + 31) & ~31;
+    triangle_plane_x = new float[size * 4];
+    triangle_plane_y = &triangle_plane_x[size];
+    triangle_plane_z = &triangle_plane_x[size * 2];
+    triangle_plane_w = &triangle_plane_x[size * 3];
+    for (int i = 0; i < nu_triangles; i++) {
+        const Vector3D& normal = triangle[i].normal;
+        triangle_plane_x[i] = normal.x;
+        triangle_plane_y[i] = normal.y;
+        triangle_plane_z[i] = normal.z;
+        triangle_plane_w[i] = - Dot(normal, vertex[triangle[i].vertex_index[0]]);
+    }
+    for (int i = nu_triangles; i < size; i++) {
+        triangle_plane_x[i] = 0;
+        triangle_plane_y[i] = 0;
+        triangle_plane_z[i] = 0;
+        triangle_plane_w[i] = 0;
+    }
 }
 
 void sreLODModelShadowVolume::DestroyEdges() {
     if (nu_edges > 0)
         delete [] edge;
     nu_edges = 0;
+    delete [] triangle_plane_x;
+    triangle_plane_x = NULL;
     flags &= ~SRE_LOD_MODEL_HAS_EDGE_INFORMATION;
 }
 
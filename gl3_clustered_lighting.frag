@@ -0,0 +1,178 @@
+/*
+
+Copyright (c) 2015 Harm Hanemaaijer <fgenfb@yahoo.com>
+
+Permission to use, copy, modify, and/or distribute this software for any
+purpose with or without fee is hereby granted, provided that the above
+copyright notice and this permission notice appear in all copies.
+
+THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+
+*/
+
+// Per-pixel Phong shader for clustered lighting, used with the vertex shader of the
+// complete single-pass lighting shaders (gl3_lighting_pass.vert). It supports
+// multi-color, texture, normal, specularity and emission maps. Instead of a single
+// light, it applies all directional lights and all lights in the light list of the
+// fragment's cluster, which are read from texture buffers. Shadows are not supported.
+//
+// Requires texture buffer objects, so it is not compatible with OpenGL ES 2.0.
+
+uniform bool use_texture_map_in;
+uniform bool use_normal_map_in;
+uniform bool use_specular_map_in;
+uniform bool use_emission_map_in;
+#ifndef UNIFORM_BUFFERS
+uniform vec3 viewpoint_in;
+uniform vec3 ambient_color_in;
+#endif
+uniform vec3 specular_reflection_color_in;
+uniform float specular_exponent_in;
+uniform vec3 emission_color_in;
+uniform sampler2D texture_map_in;
+uniform sampler2D normal_map_in;
+uniform sampler2D specular_map_in;
+uniform sampler2D emission_map_in;
+// Four texels per light, see clustered_lighting.cpp.
+uniform samplerBuffer cluster_light_data_in;
+// Offset and count of the light list of each cluster, followed by the light lists.
+uniform usamplerBuffer cluster_light_list_in;
+uniform float cluster_parameters_in[NU_CLUSTER_PARAMETERS];
+varying vec3 diffuse_reflection_color_var;
+varying vec3 normal_var;
+varying vec3 position_world_var;
+varying mat3 tbn_matrix_var;
+varying vec2 texcoord_var;
+
+// The specular color contribution should not depend on the color of the
+// light, but only its intrinsic intensity.
+const vec3 Crgb = vec3(
+	0.212655, // Red factor
+	0.715158, // Green factor
+	0.072187  // Blue factor
+	);
+
+// Calculate the diffuse and specular contribution of a light. The normal and the
+// inverse view direction V are normalized world space vectors.
+
+vec3 CalculateLight(int light_index, vec3 normal, vec3 V, vec3 diffuse_base_color,
+vec3 specular_map_color) {
+	vec4 position_range = texelFetch(cluster_light_data_in, light_index * 4);
+	vec4 color_type = texelFetch(cluster_light_data_in, light_index * 4 + 1);
+	vec3 L;
+	float light_att = 1.0;
+	if (color_type.w == 0.0)
+		// Directional light.
+		L = position_range.xyz;
+	else {
+		// Local light with a linear attenuation range.
+		vec3 light_vector = position_range.xyz - position_world_var;
+		float dist = length(light_vector);
+		L = light_vector / dist;
+		light_att = clamp((position_range.w - dist) / position_range.w, 0.0, 1.0);
+		if (color_type.w > 1.5) {
+			vec4 axis = texelFetch(cluster_light_data_in, light_index * 4 + 2);
+			if (color_type.w < 2.5)
+				// Spot light.
+				light_att *= pow(max(- dot(axis.xyz, L), 0.0), axis.w);
+			else {
+				// Beam light.
+				vec4 beam = texelFetch(cluster_light_data_in, light_index * 4 + 3);
+				float d_light_direction = dot(position_world_var - position_range.xyz,
+					axis.xyz);
+				if (d_light_direction < 0.0 || d_light_direction >= beam.x)
+					light_att = 0.0;
+				else {
+					// Apply the radial linear attenuation range and cut-off distance.
+					float d_light_direction_axis = sqrt(max(dist * dist -
+						d_light_direction * d_light_direction, 0.0));
+					light_att *= clamp((beam.y - d_light_direction_axis) / beam.y,
+						0.0, 1.0);
+					if (d_light_direction_axis >= axis.w)
+						light_att = 0.0;
+				}
+				L = - axis.xyz;
+			}
+		}
+	}
+	float NdotL = dot(normal, L);
+	if (light_att == 0.0 || NdotL <= 0.0)
+		return vec3(0.0, 0.0, 0.0);
+	vec3 c = light_att * color_type.rgb * diffuse_base_color * NdotL;
+	vec3 R = - reflect(L, normal);
+	float RdotV = max(dot(R, V), 0.0);
+	vec3 specular_component = specular_reflection_color_in * pow(RdotV, specular_exponent_in);
+	float light_intensity = dot(color_type.rgb, Crgb);
+	c += light_att * light_intensity * specular_map_color * specular_component;
+	return c;
+}
+
+void main() {
+	vec3 diffuse_base_color = diffuse_reflection_color_var;
+	vec4 tex_color = vec4(0, 0, 0, 1.0);
+	if (use_texture_map_in) {
+		tex_color = texture2D(texture_map_in, texcoord_var);
+		diffuse_base_color *= tex_color.rgb;
+	}
+	vec3 c = ambient_color_in * diffuse_base_color;
+	if (use_emission_map_in)
+		c += emission_color_in * texture2D(emission_map_in, texcoord_var).rgb;
+	else
+		c += emission_color_in;
+
+	vec3 V = normalize(viewpoint_in - position_world_var);
+	vec3 normal;
+	if (use_normal_map_in) {
+		vec3 n = texture2D(normal_map_in, texcoord_var).rgb;
+		if (n.z != 0.0)
+			// Move range from [0,1] to  [-1, 1].
+			n.xy = n.xy * 2.0 - vec2(1.0, 1.0);
+		n.z = sqrt(max(1.0 - n.x * n.x - n.y * n.y, 0.0));
+		// The TBN matrix converts from world space to tangent space, and is orthonormal,
+		// so its transpose converts the normal map normal to world space.
+		normal = normalize(transpose(tbn_matrix_var) * n);
+	}
+	else
+		normal = normalize(normal_var);
+	// Invert normal for back faces for correct lighting of faces that
+	// can be looked at from both sides.
+	normal *= float(gl_FrontFacing) * 2.0 - 1.0;
+
+	vec3 specular_map_color;
+	if (use_specular_map_in)
+		specular_map_color = texture2D(specular_map_in, texcoord_var).rgb;
+	else
+		specular_map_color = vec3(1.0, 1.0, 1.0);
+
+	// Directional lights are stored first and apply to every cluster.
+	int nu_directional_lights = int(cluster_parameters_in[CLUSTER_NU_DIRECTIONAL_LIGHTS]);
+	for (int i = 0; i < nu_directional_lights; i++)
+		c += CalculateLight(i, normal, V, diffuse_base_color, specular_map_color);
+
+	// Determine the cluster from the window coordinates and the eye space depth
+	// (which is equal to the clip space w coordinate).
+	ivec3 cluster;
+	cluster.x = min(int(gl_FragCoord.x * cluster_parameters_in[CLUSTER_TILE_SCALE_X]),
+		CLUSTER_GRID_X - 1);
+	cluster.y = min(int(gl_FragCoord.y * cluster_parameters_in[CLUSTER_TILE_SCALE_Y]),
+		CLUSTER_GRID_Y - 1);
+	float depth = 1.0 / gl_FragCoord.w;
+	cluster.z = clamp(int(floor(log(depth) * cluster_parameters_in[CLUSTER_DEPTH_SLICE_SCALE] +
+		cluster_parameters_in[CLUSTER_DEPTH_SLICE_BIAS])), 0, CLUSTER_GRID_Z - 1);
+	int cluster_index = (cluster.z * CLUSTER_GRID_Y + cluster.y) * CLUSTER_GRID_X + cluster.x;
+	int offset = int(texelFetch(cluster_light_list_in, cluster_index * 2).r);
+	int count = int(texelFetch(cluster_light_list_in, cluster_index * 2 + 1).r);
+	for (int i = 0; i < count; i++) {
+		int light_index = int(texelFetch(cluster_light_list_in, offset + i).r);
+		c += CalculateLight(light_index, normal, V, diffuse_base_color, specular_map_color);
+	}
+
+	// Allow for transparent textures.
+	gl_FragColor = vec4(c, tex_color.a);
+}
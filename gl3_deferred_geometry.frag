@@ -0,0 +1,87 @@
+/*
+
+Copyright (c) 2015 Harm Hanemaaijer <fgenfb@yahoo.com>
+
+Permission to use, copy, modify, and/or distribute this software for any
+purpose with or without fee is hereby granted, provided that the above
+copyright notice and this permission notice appear in all copies.
+
+THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+
+*/
+
+// G-buffer geometry pass shader for deferred shading, used with the vertex shader of the
+// complete single-pass lighting shaders (gl3_lighting_pass.vert). It supports multi-color,
+// texture, normal, specularity and emission maps. Instead of applying lights, the
+// surface attributes are written to the G-buffer (see deferred_shading.cpp):
+//     0: diffuse reflection color
+//     1: specular reflection color (multiplied by the specularity map), specular exponent
+//     2: world space normal
+//     3: base color (ambient light and emission)
+// Transparent texture pixels are discarded since the G-buffer cannot be blended.
+
+uniform bool use_texture_map_in;
+uniform bool use_normal_map_in;
+uniform bool use_specular_map_in;
+uniform bool use_emission_map_in;
+#ifndef UNIFORM_BUFFERS
+uniform vec3 ambient_color_in;
+#endif
+uniform vec3 specular_reflection_color_in;
+uniform float specular_exponent_in;
+uniform vec3 emission_color_in;
+uniform sampler2D texture_map_in;
+uniform sampler2D normal_map_in;
+uniform sampler2D specular_map_in;
+uniform sampler2D emission_map_in;
+varying vec3 diffuse_reflection_color_var;
+varying vec3 normal_var;
+varying mat3 tbn_matrix_var;
+varying vec2 texcoord_var;
+
+void main() {
+	vec3 diffuse_base_color = diffuse_reflection_color_var;
+	if (use_texture_map_in) {
+		vec4 tex_color = texture2D(texture_map_in, texcoord_var);
+		if (tex_color.a < 0.5)
+			discard;
+		diffuse_base_color *= tex_color.rgb;
+	}
+	vec3 c = ambient_color_in * diffuse_base_color;
+	if (use_emission_map_in)
+		c += emission_color_in * texture2D(emission_map_in, texcoord_var).rgb;
+	else
+		c += emission_color_in;
+
+	vec3 normal;
+	if (use_normal_map_in) {
+		vec3 n = texture2D(normal_map_in, texcoord_var).rgb;
+		if (n.z != 0.0)
+			// Move range from [0,1] to  [-1, 1].
+			n.xy = n.xy * 2.0 - vec2(1.0, 1.0);
+		n.z = sqrt(max(1.0 - n.x * n.x - n.y * n.y, 0.0));
+		// The TBN matrix converts from world space to tangent space, and is orthonormal,
+		// so its transpose converts the normal map normal to world space.
+		normal = normalize(transpose(tbn_matrix_var) * n);
+	}
+	else
+		normal = normalize(normal_var);
+	// Invert normal for back faces for correct lighting of faces that
+	// can be looked at from both sides.
+	normal *= float(gl_FrontFacing) * 2.0 - 1.0;
+
+	vec3 specular_color = specular_reflection_color_in;
+	if (use_specular_map_in)
+		specular_color *= texture2D(specular_map_in, texcoord_var).rgb;
+
+	gl_FragData[0] = vec4(diffuse_base_color, 1.0);
+	gl_FragData[1] = vec4(specular_color, specular_exponent_in);
+	gl_FragData[2] = vec4(normal, 0.0);
+	gl_FragData[3] = vec4(c, 1.0);
+}
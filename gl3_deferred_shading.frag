@@ -0,0 +1,252 @@
+/*
+
+Copyright (c) 2015 Harm Hanemaaijer <fgenfb@yahoo.com>
+
+Permission to use, copy, modify, and/or distribute this software for any
+purpose with or without fee is hereby granted, provided that the above
+copyright notice and this permission notice appear in all copies.
+
+THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+
+*/
+
+// Full-screen fragment shader for the deferred shading passes (see deferred_shading.cpp).
+//
+// When COMPOSITE is defined, the base color (ambient light and emission) and the depth
+// stored in the G-buffer are copied to the target framebuffer. Otherwise, the light
+// specified by one of DIRECTIONAL_LIGHT, POINT_SOURCE_LIGHT, SPOT_LIGHT or BEAM_LIGHT is
+// applied to the surface stored in the G-buffer, optionally with a shadow map
+// (SHADOW_MAP for directional and beam lights, SPOT_LIGHT_SHADOW_MAP or SHADOW_CUBE_MAP).
+// The output is blended additively.
+
+uniform sampler2D gbuffer_in[NU_GBUFFER_TEXTURES];
+
+#ifdef COMPOSITE
+
+void main() {
+	ivec2 coords = ivec2(gl_FragCoord.xy);
+	gl_FragColor = vec4(texelFetch(gbuffer_in[GBUFFER_BASE_COLOR], coords, 0).rgb, 1.0);
+	gl_FragDepth = texelFetch(gbuffer_in[GBUFFER_DEPTH], coords, 0).r;
+}
+
+#else
+
+uniform float light_parameters_in[NU_LIGHT_PARAMETERS_MAX];
+uniform vec3 viewpoint_in;
+// Converts window coordinates and depth to world space.
+uniform mat4 inverse_view_projection_matrix;
+#ifdef SHADOW_MAP
+uniform mat4x3 shadow_map_transformation_matrix;
+#endif
+#ifdef SPOT_LIGHT_SHADOW_MAP
+uniform mat4 shadow_map_transformation_matrix;
+#endif
+#if defined(SHADOW_MAP) || defined(SPOT_LIGHT_SHADOW_MAP)
+#ifdef USE_SHADOW_SAMPLER
+uniform sampler2DShadow shadow_map_in;
+#else
+uniform sampler2D shadow_map_in;
+#endif
+#endif
+#ifdef SHADOW_CUBE_MAP
+#ifdef USE_SHADOW_SAMPLER
+uniform samplerCubeShadow cube_shadow_map_in;
+#else
+uniform samplerCube cube_shadow_map_in;
+#endif
+#endif
+#ifdef SHADOW_MAP_CASCADES
+uniform float shadow_map_parameters_in[NU_SHADOW_MAP_PARAMETERS_CASCADES];
+#elif defined(SHADOW_MAP) || defined(SPOT_LIGHT_SHADOW_MAP) || defined(SHADOW_CUBE_MAP)
+uniform float shadow_map_parameters_in[NU_SHADOW_MAP_PARAMETERS_MAX];
+#endif
+
+// The specular color contribution should not depend on the color of the
+// light, but only its intrinsic intensity.
+const vec3 Crgb = vec3(
+	0.212655, // Red factor
+	0.715158, // Green factor
+	0.072187  // Blue factor
+	);
+
+#if defined(SHADOW_MAP) || defined(SPOT_LIGHT_SHADOW_MAP)
+
+// Returns the light factor for the shadow map coordinates (range [0, 1]).
+
+float SampleShadowMap(vec3 coords, float bias) {
+	if (any(lessThan(coords, vec3(0.0, 0.0, 0.0))) ||
+	any(greaterThan(coords, vec3(1.0, 1.0, 1.0))))
+		return 1.0;
+#ifdef SHADOW_MAP_ATLAS
+	// Convert to coordinates within the shadow map atlas tile (see gl3_lighting_pass.frag).
+	float scale = shadow_map_parameters_in[SHADOW_MAP_ATLAS_TILE_SCALE];
+	if (scale < 1.0) {
+		vec2 offset = vec2(shadow_map_parameters_in[SHADOW_MAP_ATLAS_TILE_OFFSET_X],
+			shadow_map_parameters_in[SHADOW_MAP_ATLAS_TILE_OFFSET_Y]);
+		float margin = 2.0 / shadow_map_parameters_in[SHADOW_MAP_SIZE];
+		coords.xy = offset + clamp(coords.xy, vec2(margin, margin),
+			vec2(1.0 - margin, 1.0 - margin)) * scale;
+	}
+#endif
+#ifdef USE_SHADOW_SAMPLER
+	return texture(shadow_map_in, vec3(coords.xy, coords.z + bias));
+#else
+	return float(texture2D(shadow_map_in, coords.xy).r >= coords.z + bias);
+#endif
+}
+
+#endif
+
+#ifdef SHADOW_MAP_CASCADES
+
+// Convert the coordinates within the first cascade to the tile of the first cascade
+// that contains them (see gl3_lighting_pass.frag). The bias is scaled to the cascade.
+
+vec3 SelectShadowMapCascade(vec3 coords, inout float bias) {
+	int nu_cascades = int(shadow_map_parameters_in[SHADOW_MAP_NU_CASCADES]);
+	for (int cascade = 0; cascade < nu_cascades; cascade++) {
+		int i = SHADOW_MAP_CASCADE_TRANSFORM + cascade * 6;
+		vec3 scale = vec3(shadow_map_parameters_in[i], shadow_map_parameters_in[i + 1],
+			shadow_map_parameters_in[i + 2]);
+		vec3 offset = vec3(shadow_map_parameters_in[i + 3], shadow_map_parameters_in[i + 4],
+			shadow_map_parameters_in[i + 5]);
+		vec3 local_coords = coords * scale + offset;
+		if (any(lessThan(local_coords, vec3(0.0, 0.0, 0.0))) ||
+		any(greaterThan(local_coords, vec3(1.0, 1.0, 1.0))))
+			continue;
+		bias *= scale.z / scale.x;
+		if (nu_cascades == 1)
+			return local_coords;
+		vec2 tile_offset = vec2(float(cascade - (cascade / 2) * 2), float(cascade / 2)) * 0.5;
+		float margin = 2.0 / shadow_map_parameters_in[SHADOW_MAP_SIZE];
+		local_coords.xy = tile_offset + clamp(local_coords.xy * 0.5, vec2(margin, margin),
+			vec2(0.5 - margin, 0.5 - margin));
+		return local_coords;
+	}
+	// Outside all cascades; SampleShadowMap() treats this as unshadowed.
+	return vec3(- 1.0, - 1.0, - 1.0);
+}
+
+#endif
+
+void main() {
+	ivec2 coords = ivec2(gl_FragCoord.xy);
+	float depth = texelFetch(gbuffer_in[GBUFFER_DEPTH], coords, 0).r;
+	// Skip the background.
+	if (depth == 1.0)
+		discard;
+	vec4 P = inverse_view_projection_matrix * vec4(gl_FragCoord.xy, depth, 1.0);
+	vec3 position_world = P.xyz / P.w;
+	vec3 normal = texelFetch(gbuffer_in[GBUFFER_NORMAL], coords, 0).xyz;
+
+	vec3 light_position = vec3(
+		light_parameters_in[LIGHT_POSITION_X],
+		light_parameters_in[LIGHT_POSITION_Y],
+		light_parameters_in[LIGHT_POSITION_Z]
+		);
+	vec3 light_color = vec3(
+		light_parameters_in[LIGHT_COLOR_R],
+		light_parameters_in[LIGHT_COLOR_G],
+		light_parameters_in[LIGHT_COLOR_B]
+		);
+	vec3 L;
+	float light_att = 1.0;
+#ifdef DIRECTIONAL_LIGHT
+	L = light_position;
+#else
+	vec3 light_vector = light_position - position_world;
+	float dist = length(light_vector);
+	L = light_vector / dist;
+	float range = light_parameters_in[LIGHT_LINEAR_ATTENUATION_RANGE];
+	light_att = clamp((range - dist) / range, 0.0, 1.0);
+#if defined(SPOT_LIGHT) || defined(BEAM_LIGHT)
+	vec3 axis = vec3(
+		light_parameters_in[LIGHT_AXIS_DIRECTION_X],
+		light_parameters_in[LIGHT_AXIS_DIRECTION_Y],
+		light_parameters_in[LIGHT_AXIS_DIRECTION_Z]
+		);
+#endif
+#ifdef SPOT_LIGHT
+	light_att *= pow(max(- dot(axis, L), 0.0), light_parameters_in[SPOT_LIGHT_EXPONENT]);
+#endif
+#ifdef BEAM_LIGHT
+	float d_light_direction = dot(position_world - light_position, axis);
+	if (d_light_direction < 0.0 ||
+	d_light_direction >= light_parameters_in[BEAM_LIGHT_AXIS_CUT_OFF_DISTANCE])
+		discard;
+	// Apply the radial linear attenuation range and cut-off distance.
+	float d_light_direction_axis = sqrt(max(dist * dist -
+		d_light_direction * d_light_direction, 0.0));
+	if (d_light_direction_axis >= light_parameters_in[BEAM_LIGHT_RADIUS])
+		discard;
+	float radial_range = light_parameters_in[BEAM_LIGHT_RADIAL_LINEAR_ATTENUATION_RANGE];
+	light_att *= clamp((radial_range - d_light_direction_axis) / radial_range, 0.0, 1.0);
+	L = - axis;
+#endif
+#endif
+	float NdotL = dot(normal, L);
+	if (light_att == 0.0 || NdotL <= 0.0)
+		discard;
+
+#if defined(SHADOW_MAP) || defined(SPOT_LIGHT_SHADOW_MAP)
+	// Slope-dependent bias, limited to a slope of approximately 100.0.
+	float slope = tan(acos(clamp(NdotL, 0.01, 1.0)));
+	float bias = 0.00005 * slope * shadow_map_parameters_in[SHADOW_MAP_SIZE] / 2048.0;
+#ifndef USE_SHADOW_SAMPLER
+	bias += shadow_map_parameters_in[SHADOW_MAP_DEPTH_PRECISION];
+#endif
+#ifdef SHADOW_MAP_CASCADES
+	vec3 shadow_map_coords = shadow_map_transformation_matrix * vec4(position_world, 1.0);
+	shadow_map_coords = SelectShadowMapCascade(shadow_map_coords, bias);
+	light_att *= SampleShadowMap(shadow_map_coords, bias);
+#elif defined(SHADOW_MAP)
+	light_att *= SampleShadowMap(shadow_map_transformation_matrix * vec4(position_world, 1.0),
+		bias);
+#else
+	vec4 P_trans = shadow_map_transformation_matrix * vec4(position_world, 1.0);
+	light_att *= SampleShadowMap(P_trans.xyz / P_trans.w, bias);
+#endif
+#endif
+#ifdef SHADOW_CUBE_MAP
+	vec3 space_vector_from_light = position_world - light_position;
+	const float cube_bias = 0.0005;
+#ifdef CUBE_MAP_STORES_DISTANCE
+	// Compare the scaled radial distance from the light.
+	float depth_compare = length(space_vector_from_light) *
+		shadow_map_parameters_in[SHADOW_MAP_SEGMENT_DISTANCE_SCALING] + cube_bias;
+#else
+	// Derive the depth value of the cube map face from the world coordinates.
+	vec3 abs_vec = abs(space_vector_from_light);
+	float local_z_comp = max(abs_vec.x, max(abs_vec.y, abs_vec.z));
+	float norm_z_comp = shadow_map_parameters_in[SHADOW_MAP_F_N_COEFFICIENT_1] -
+		shadow_map_parameters_in[SHADOW_MAP_F_N_COEFFICIENT_2] / local_z_comp;
+	float depth_compare = (norm_z_comp + 1.0) * 0.5 +
+		0.00005 * shadow_map_parameters_in[SHADOW_MAP_SIZE] / 2048.0;
+#endif
+#ifdef USE_SHADOW_SAMPLER
+	light_att *= texture(cube_shadow_map_in, vec4(space_vector_from_light, depth_compare));
+#else
+	light_att *= float(texture(cube_shadow_map_in, space_vector_from_light).r >= depth_compare);
+#endif
+#endif
+	if (light_att == 0.0)
+		discard;
+
+	vec3 diffuse_base_color = texelFetch(gbuffer_in[GBUFFER_DIFFUSE], coords, 0).rgb;
+	vec4 specular = texelFetch(gbuffer_in[GBUFFER_SPECULAR], coords, 0);
+	vec3 c = light_att * light_color * diffuse_base_color * NdotL;
+	vec3 V = normalize(viewpoint_in - position_world);
+	vec3 R = - reflect(L, normal);
+	float RdotV = max(dot(R, V), 0.0);
+	float light_intensity = dot(light_color, Crgb);
+	c += light_att * light_intensity * specular.rgb * pow(RdotV, specular.a);
+	gl_FragColor = vec4(c, 1.0);
+}
+
+#endif
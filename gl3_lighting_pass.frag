@@ -33,23 +33,33 @@ precision mediump float;
 #define MEDIUMP
 #define LOWP
 #endif
+// With an object uniform buffer, the object parameters are members of the uniform block
+// defined in the prologue.
+#ifndef OBJECT_UNIFORM_BUFFER
 #ifdef TEXTURE_MAP_OPTION
 uniform bool use_texture_map_in;
 #endif
 #ifdef NORMAL_MAP_OPTION
 uniform bool use_normal_map_in;
 #endif
+#endif
+// With uniform buffers, the viewpoint, ambient color, light parameters and shadow map
+// parameters are members of the uniform blocks defined in the prologue.
+#ifndef UNIFORM_BUFFERS
 #ifdef VIEWPOINT_IN
 uniform vec3 viewpoint_in;
 #endif
 #ifdef AMBIENT_COLOR_IN
 uniform vec3 ambient_color_in;
 #endif
+#endif
 #if defined(POINT_SOURCE_LIGHT) || defined(SPOT_LIGHT) || defined(BEAM_LIGHT) || defined(GENERAL_LOCAL_LIGHT)
 #define LOCAL_LIGHT
 #endif
 #ifdef LIGHT_PARAMETERS
+#ifndef UNIFORM_BUFFERS
 uniform float light_parameters_in[NU_LIGHT_PARAMETERS_MAX];
+#endif
 //uniform vec4 light_position_in;
 #ifndef DIRECTIONAL_LIGHT
 //uniform vec4 light_att_in;
@@ -59,6 +69,7 @@ uniform float light_parameters_in[NU_LIGHT_PARAMETERS_MAX];
 //uniform vec4 spotlight_in;
 #endif
 // Object light parameters.
+#ifndef OBJECT_UNIFORM_BUFFER
 uniform vec3 specular_reflection_color_in;
 #ifdef MICROFACET
 uniform float diffuse_fraction_in;
@@ -68,7 +79,9 @@ uniform bool anisotropic_in;
 #else
 uniform float specular_exponent_in;
 #endif
+#endif
 #endif // defined(LIGHT_PARAMETERS)
+#ifndef OBJECT_UNIFORM_BUFFER
 #ifdef EMISSION_COLOR_IN
 uniform vec3 emission_color_in;
 #endif
@@ -78,6 +91,7 @@ uniform bool use_specular_map_in;
 #ifdef EMISSION_MAP_OPTION
 uniform bool use_emission_map_in;
 #endif
+#endif
 #ifdef TEXTURE_MAP_SAMPLER
 uniform sampler2D texture_map_in;
 #endif
@@ -104,8 +118,10 @@ uniform samplerCubeShadow cube_shadow_map_in;
 uniform samplerCube cube_shadow_map_in;
 #endif
 #endif
-#if !defined(MULTI_COLOR_OPTION) && !defined(MULTI_COLOR_FIXED)
+#if !defined(MULTI_COLOR_OPTION) && !defined(MULTI_COLOR_FIXED) && !defined(INSTANCING)
+#ifndef OBJECT_UNIFORM_BUFFER
 uniform vec3 diffuse_reflection_color_in;
+#endif
 #else
 varying MEDIUMP vec3 diffuse_reflection_color_var;
 #endif
@@ -133,7 +149,10 @@ varying vec4 shadow_map_coord_var;
 #if defined(SHADOW_MAP) || defined(SPOT_LIGHT_SHADOW_MAP)
 varying float slope_var;
 #endif
-#if defined(SHADOW_MAP) || defined(SPOT_LIGHT_SHADOW_MAP) || defined(SHADOW_CUBE_MAP)
+#ifdef UNIFORM_BUFFERS
+#elif defined(SHADOW_MAP_CASCADES)
+uniform float shadow_map_parameters_in[NU_SHADOW_MAP_PARAMETERS_CASCADES];
+#elif defined(SHADOW_MAP) || defined(SPOT_LIGHT_SHADOW_MAP) || defined(SHADOW_CUBE_MAP)
 uniform float shadow_map_parameters_in[NU_SHADOW_MAP_PARAMETERS_MAX];
 #endif
 #ifdef NORMAL_MAP_TANGENT_SPACE_VECTORS
@@ -254,9 +273,74 @@ float SampleShadowSimple(sampler2D shadow_map, vec3 coords, float bias) {
 
 #endif
 
+#ifdef SHADOW_MAP_CASCADES
+
+// Factor applied to the shadow map bias for the selected cascade, compensating for the
+// different world space width and depth of each cascade.
+float shadow_map_cascade_bias_factor;
+
+// Directional light cascaded shadow map. The cascades are stored in tiles of a single
+// shadow map, and shadow_map_coord_var holds the coordinates within the first cascade.
+// Select the first (highest resolution) cascade that contains the fragment and return
+// the coordinates within its tile. Sets out_of_bounds when no cascade contains it.
+
+vec3 CalculateCascadeShadowMapCoordinates(out bool out_of_bounds) {
+	int nu_cascades = int(shadow_map_parameters_in[SHADOW_MAP_NU_CASCADES]);
+	out_of_bounds = true;
+	vec3 coords;
+	int cascade;
+	for (cascade = 0; cascade < nu_cascades; cascade++) {
+		int i = SHADOW_MAP_CASCADE_TRANSFORM + cascade * 6;
+		vec3 scale = vec3(shadow_map_parameters_in[i], shadow_map_parameters_in[i + 1],
+			shadow_map_parameters_in[i + 2]);
+		vec3 offset = vec3(shadow_map_parameters_in[i + 3], shadow_map_parameters_in[i + 4],
+			shadow_map_parameters_in[i + 5]);
+		coords = shadow_map_coord_var * scale + offset;
+		if (all(greaterThanEqual(coords, vec3(0.0, 0.0, 0.0))) &&
+		all(lessThanEqual(coords, vec3(1.0, 1.0, 1.0)))) {
+			out_of_bounds = false;
+			shadow_map_cascade_bias_factor = scale.z / scale.x;
+			break;
+		}
+	}
+	if (nu_cascades == 1 || out_of_bounds)
+		return coords;
+	// Multiple cascades are arranged in a 2x2 grid of tiles. Keep the coordinates away
+	// from the tile edges so that filtering does not sample neighbouring tiles.
+	vec2 tile_offset = vec2(float(cascade - (cascade / 2) * 2), float(cascade / 2)) * 0.5;
+	float margin = 2.0 / shadow_map_parameters_in[SHADOW_MAP_SIZE];
+	coords.xy = tile_offset + clamp(coords.xy * 0.5, vec2(margin, margin),
+		vec2(0.5 - margin, 0.5 - margin));
+	return coords;
+}
+
+#endif
+
+#ifdef SHADOW_MAP_ATLAS
+
+// Spot and beam light shadow maps may be stored in a tile of the shadow map atlas.
+// Convert shadow map coordinates in the range [0, 1] to coordinates within the tile,
+// keeping them away from the tile edges so that filtering does not sample neighbouring
+// tiles.
+
+vec3 CalculateAtlasShadowMapCoordinates(vec3 coords) {
+	// A scale of 1.0 means the light does not use the atlas.
+	float scale = shadow_map_parameters_in[SHADOW_MAP_ATLAS_TILE_SCALE];
+	if (scale < 1.0) {
+		vec2 offset = vec2(shadow_map_parameters_in[SHADOW_MAP_ATLAS_TILE_OFFSET_X],
+			shadow_map_parameters_in[SHADOW_MAP_ATLAS_TILE_OFFSET_Y]);
+		float margin = 2.0 / shadow_map_parameters_in[SHADOW_MAP_SIZE];
+		coords.xy = offset + clamp(coords.xy, vec2(margin, margin),
+			vec2(1.0 - margin, 1.0 - margin)) * scale;
+	}
+	return coords;
+}
+
+#endif
+
 #if defined(SHADOW_MAP) && !defined(USE_SHADOW_SAMPLER)
 
-float CalculateShadow() {
+float CalculateShadow(vec3 shadow_map_coords) {
 	// Scale the Poisson factor according to the resolution of the shadow map.
         // Note: 1.0 / shadow_map_parameters_in[SHADOW_MAP_SIZE] could be added as a uniform.
 	float poisson_factor = 1.3 / shadow_map_parameters_in[SHADOW_MAP_SIZE];
@@ -280,15 +364,25 @@ float CalculateShadow() {
 	// Example bias calculation for directional light, slope = 1.0:
 	// ..
 
+#ifdef SHADOW_MAP_CASCADES
+	bias *= shadow_map_cascade_bias_factor;
+#endif
+
 	// Add one unit of shadow map depth precision (0.00024 for 16-bit depth buffer).
 	bias += shadow_map_parameters_in[SHADOW_MAP_DEPTH_PRECISION];
 
+#ifdef SHADOW_MAP_ATLAS
+	// The Poisson disk offsets are applied to atlas coordinates.
+	poisson_factor *= shadow_map_parameters_in[SHADOW_MAP_ATLAS_TILE_SCALE];
+	shadow_map_coords = CalculateAtlasShadowMapCoordinates(shadow_map_coords);
+#endif
+
 	// Produce slightly soft shadows with the Poisson disk.
 #ifndef GL_ES
-	return SampleShadowPoisson(shadow_map_in, shadow_map_coord_var, bias,
+	return SampleShadowPoisson(shadow_map_in, shadow_map_coords, bias,
 		poisson_factor);
 #else
-	return SampleShadowSimple(shadow_map_in, shadow_map_coord_var, bias);
+	return SampleShadowSimple(shadow_map_in, shadow_map_coords, bias);
 #endif
 }
 
@@ -299,6 +393,10 @@ float CalculateShadow() {
 float CalculateShadow(vec3 shadow_map_coords, float bias) {
 	// Scale the Poisson factor according to the resolution of the shadow map.
 	float poisson_factor = 1.3 / shadow_map_parameters_in[SHADOW_MAP_SIZE];
+#ifdef SHADOW_MAP_ATLAS
+	poisson_factor *= shadow_map_parameters_in[SHADOW_MAP_ATLAS_TILE_SCALE];
+	shadow_map_coords = CalculateAtlasShadowMapCoordinates(shadow_map_coords);
+#endif
 
 	// Produce slightly soft shadows with the Poisson disk.
 #ifndef GL_ES
@@ -446,7 +544,7 @@ void main() {
 
         LOWP vec3 diffuse_reflection_color;
 	LOWP vec3 diffuse_base_color;
-#if defined(MULTI_COLOR_OPTION) || defined(MULTI_COLOR_FIXED)
+#if defined(MULTI_COLOR_OPTION) || defined(MULTI_COLOR_FIXED) || defined(INSTANCING)
 	diffuse_reflection_color = diffuse_reflection_color_var;
 #else
 	diffuse_reflection_color = diffuse_reflection_color_in;
@@ -759,21 +857,39 @@ void main() {
 	float shadow_light_factor;
 #ifdef SHADOW_MAP
 	// Directional or beam light, orthogonal transformation shadow map.
+#ifdef SHADOW_MAP_CASCADES
+	bool out_of_shadow_bounds;
+	vec3 shadow_map_coords = CalculateCascadeShadowMapCoordinates(out_of_shadow_bounds);
+#else
+	vec3 shadow_map_coords = shadow_map_coord_var;
+#endif
 #ifdef USE_SHADOW_SAMPLER
-	vec3 coords = shadow_map_coord_var;
+	vec3 coords = shadow_map_coords;
         float bias = 0.00005 * slope_var * shadow_map_parameters_in[SHADOW_MAP_SIZE] / 2048.0;
+#ifdef SHADOW_MAP_CASCADES
+	bias *= shadow_map_cascade_bias_factor;
+#endif
 	// Since only back faces with respect to the light have been written to the shadow map,
 	// the bias value has to be added to the depth comparison value, so that the depth comparison
 	// will fail (shadow) for fragments very close but away from the back face surface.
         coords.z += bias;
+#ifdef SHADOW_MAP_ATLAS
+	coords = CalculateAtlasShadowMapCoordinates(coords);
+#endif
 	shadow_light_factor = texture(shadow_map_in, coords);
+#ifdef SHADOW_MAP_CASCADES
+	if (out_of_shadow_bounds)
+		shadow_light_factor = 1.0;
+#endif
 #else
-	bool out_of_shadow_bounds = any(lessThan(shadow_map_coord_var.xyz, vec3(0.0, 0.0, 0.0))) ||
-            any(greaterThan(shadow_map_coord_var.xyz, vec3(1.0, 1.0, 1.0)));
+#ifndef SHADOW_MAP_CASCADES
+	bool out_of_shadow_bounds = any(lessThan(shadow_map_coords, vec3(0.0, 0.0, 0.0))) ||
+            any(greaterThan(shadow_map_coords, vec3(1.0, 1.0, 1.0)));
+#endif
         // The following variable holds the amount of shadow received by the fragment ([0, 1.0]).
         shadow_light_factor = 1.0;
 	if (!out_of_shadow_bounds)
-		shadow_light_factor = CalculateShadow();
+		shadow_light_factor = CalculateShadow(shadow_map_coords);
 #endif
 #endif
 
@@ -786,7 +902,12 @@ void main() {
 	// before the textureProj function, which divides by coords.w. The first two operations
 	// cancel out each other.
         coords.z += bias;
+#ifdef SHADOW_MAP_ATLAS
+	shadow_light_factor = texture(shadow_map_in,
+		CalculateAtlasShadowMapCoordinates(coords.xyz / coords.w));
+#else
 	shadow_light_factor = TEXTURE_PROJ_FUNC(shadow_map_in, coords);
+#endif
         light_att *= shadow_light_factor;
 #else
 	// Spotlight shadow map. Only one shadow map is used.
@@ -32,6 +32,24 @@ OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
 // "mediump", so that uniforms or varying variables must be limited in precision.
 #define MEDIUMP mediump
 #endif
+#ifdef INSTANCING
+// With instancing, the model transformation and the diffuse reflection color are
+// per-instance attributes. The model matrix is specified as three row vectors and the
+// rotation matrix as three column vectors.
+uniform mat4 view_projection_matrix;
+attribute vec4 instance_model_matrix_row0_in;
+attribute vec4 instance_model_matrix_row1_in;
+attribute vec4 instance_model_matrix_row2_in;
+attribute vec3 instance_rotation_matrix_column0_in;
+attribute vec3 instance_rotation_matrix_column1_in;
+attribute vec3 instance_rotation_matrix_column2_in;
+attribute vec3 instance_diffuse_reflection_color_in;
+#ifdef NORMAL_VAR
+mat3 model_rotation_matrix;
+#endif
+#elif !defined(OBJECT_UNIFORM_BUFFER)
+// With an object uniform buffer, the object matrices and parameters are members of the
+// uniform block defined in the prologue.
 uniform mat4 MVP;
 #ifdef POSITION_WORLD_VAR
 #ifdef GL_ES
@@ -43,12 +61,14 @@ uniform mat4x3 model_matrix;
 #ifdef NORMAL_VAR
 uniform mat3 model_rotation_matrix;
 #endif
-#ifdef MULTI_COLOR_OPTION
-uniform bool use_multi_color_in;
 #endif
 #ifdef TEXTURE_MAP_OPTION
 uniform bool use_texture_in;
 #endif
+#ifndef OBJECT_UNIFORM_BUFFER
+#ifdef MULTI_COLOR_OPTION
+uniform bool use_multi_color_in;
+#endif
 #ifdef NORMAL_MAP_OPTION
 uniform bool use_normal_map_in;
 #endif
@@ -58,10 +78,13 @@ uniform bool use_specular_map_in;
 #ifdef EMISSION_MAP_OPTION
 uniform bool use_emission_map_in;
 #endif
-#ifdef VIEWPOINT_IN
+#endif
+// With uniform buffers, the viewpoint and light parameters are members of the uniform
+// blocks defined in the prologue.
+#if defined(VIEWPOINT_IN) && !defined(UNIFORM_BUFFERS)
 uniform vec3 viewpoint_in;
 #endif
-#ifdef MULTI_COLOR_OPTION
+#if defined(MULTI_COLOR_OPTION) && !defined(INSTANCING) && !defined(OBJECT_UNIFORM_BUFFER)
 uniform vec3 diffuse_reflection_color_in;
 #endif
 #if defined(SHADOW_MAP)
@@ -74,7 +97,8 @@ uniform mat4x3 shadow_map_transformation_matrix;
 #ifdef SPOT_LIGHT_SHADOW_MAP
 uniform mat4 shadow_map_transformation_matrix;
 #endif
-#if defined(SHADOW_MAP) || defined(SPOT_LIGHT_SHADOW_MAP) || defined(NORMAL_MAP_TANGENT_SPACE_VECTORS)
+#ifdef UNIFORM_BUFFERS
+#elif defined(SHADOW_MAP) || defined(SPOT_LIGHT_SHADOW_MAP) || defined(NORMAL_MAP_TANGENT_SPACE_VECTORS)
 #ifdef GL_ES
 uniform mediump float light_parameters_in[NU_LIGHT_PARAMETERS_MAX];
 #else
@@ -85,7 +109,7 @@ attribute vec4 position_in;
 #ifdef TEXCOORD_IN
 attribute vec2 texcoord_in;
 #endif
-#ifdef UV_TRANSFORM
+#if defined(UV_TRANSFORM) && !defined(OBJECT_UNIFORM_BUFFER)
 // 3D transformation matrix to apply to the texcoords.
 uniform mat3 uv_transform_in;
 #endif
@@ -103,6 +127,8 @@ attribute float color_in;
 attribute vec3 color_in;
 #endif
 varying MEDIUMP vec3 diffuse_reflection_color_var;
+#elif defined(INSTANCING)
+varying MEDIUMP vec3 diffuse_reflection_color_var;
 #endif
 #ifdef NORMAL_VAR
 varying vec3 normal_var;
@@ -152,10 +178,28 @@ vec3 DecompressColor(float cc) {
 #endif
 
 void main() {
+#ifdef INSTANCING
+	// The vertex position is specified in model space. Convert to world space.
+	vec3 position_world = vec3(
+		dot(instance_model_matrix_row0_in, position_in),
+		dot(instance_model_matrix_row1_in, position_in),
+		dot(instance_model_matrix_row2_in, position_in));
+#ifdef POSITION_WORLD_VAR
+	position_world_var = position_world;
+#endif
+#ifdef NORMAL_VAR
+	model_rotation_matrix = mat3(instance_rotation_matrix_column0_in,
+		instance_rotation_matrix_column1_in, instance_rotation_matrix_column2_in);
+#endif
+#if !defined(MULTI_COLOR_OPTION) && !defined(MULTI_COLOR_FIXED)
+	diffuse_reflection_color_var = instance_diffuse_reflection_color_in;
+#endif
+#else
 #ifdef POSITION_WORLD_VAR
 	// The vertex position is specified in model space. Convert to world space.
 	position_world_var = (model_matrix * position_in).xyz;
 #endif
+#endif
 #ifdef NORMAL_VAR
 	// Normal given is in model space.
         // Convert normal from model space to world space.
@@ -165,7 +209,11 @@ void main() {
 
 #ifdef MULTI_COLOR_OPTION
         if (!use_multi_color_in)
+#ifdef INSTANCING
+		diffuse_reflection_color_var = instance_diffuse_reflection_color_in;
+#else
 		diffuse_reflection_color_var = diffuse_reflection_color_in;
+#endif
 	else
 #endif
 #if defined(MULTI_COLOR_OPTION) || defined(MULTI_COLOR_FIXED)
@@ -287,6 +335,10 @@ void main() {
 	// ([0.0, 1.0], [0.0, 1.0], [0.0, 1.0]) for the shadow map region.
 #endif
 
+#ifdef INSTANCING
+	gl_Position = view_projection_matrix * vec4(position_world, 1.0);
+#else
 	gl_Position = MVP * position_in;
+#endif
 }
 
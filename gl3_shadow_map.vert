@@ -20,6 +20,13 @@ OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
 //
 // It has been written to be compatible with both OpenGL 2.0+ and OpenGL ES 2.0.
 
+#ifdef CUBE_MAP_LAYERED
+// The geometry shader (gl3_shadow_map.geom) applies the cube face transformations
+// and passes on the varyings under their regular names.
+#define texcoord_var texcoord_geom_in
+#define position_world_var position_world_geom_in
+#endif
+
 #if defined(CUBE_MAP) || defined(SPOTLIGHT) || defined(GL_ES)
 uniform mat4 MVP;
 #else
@@ -34,12 +41,14 @@ varying vec2 texcoord_var;
 // 3D transformation matrix to apply to the texcoords.
 uniform mat3 uv_transform_in;
 #endif
-#if defined(CUBE_MAP) && defined(CUBE_MAP_STORES_DISTANCE)
+#if defined(CUBE_MAP) && (defined(CUBE_MAP_STORES_DISTANCE) || defined(CUBE_MAP_LAYERED))
 #ifdef GL_ES
 uniform mat4 model_matrix;
 #else
 uniform mat4x3 model_matrix;
 #endif
+#endif
+#if defined(CUBE_MAP) && defined(CUBE_MAP_STORES_DISTANCE)
 varying vec3 position_world_var;
 #endif
 #if defined(ADD_BIAS) && !defined(CUBE_MAP) && !defined(SPOTLIGHT)
@@ -112,7 +121,13 @@ void main() {
 	bias_var = bias;	
 #endif
 
-#if defined(CUBE_MAP) && defined(CUBE_MAP_STORES_DISTANCE)
+#ifdef CUBE_MAP_LAYERED
+	// Output the world space position; the geometry shader transforms it for each face.
+	gl_Position = vec4((model_matrix * position_in).xyz, 1.0);
+#ifdef CUBE_MAP_STORES_DISTANCE
+	position_world_var = gl_Position.xyz;
+#endif
+#elif defined(CUBE_MAP) && defined(CUBE_MAP_STORES_DISTANCE)
 	position_world_var = (model_matrix * position_in).xyz;
 	gl_Position = MVP * position_in;
 #else
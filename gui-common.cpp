@@ -141,6 +141,8 @@ static void SetSceneInfo(sreScene *scene, sreEngineSettingsInfo *settings_info)
                 ((settings_info->rendering_flags & SRE_RENDERING_FLAG_SHADOW_VOLUME_VISIBILITY_TEST) != 0) + 2 *
                 ((settings_info->rendering_flags & SRE_RENDERING_FLAG_SHADOW_VOLUME_DARKCAP_VISIBILITY_TEST) != 0)]
             );
+        sprintf(scene_info_text_line[21], "Shadow cache memory: %d KB of %d KB, pinned entries: %d",
+            info->cache_total_size / 1024, info->cache_budget / 1024, info->cache_entries_pinned);
 
         delete info;
     }
@@ -149,8 +151,8 @@ static void SetSceneInfo(sreScene *scene, sreEngineSettingsInfo *settings_info)
         sprintf(scene_info_text_line[18], "");
         sprintf(scene_info_text_line[19], "");
         sprintf(scene_info_text_line[20], "");
+        sprintf(scene_info_text_line[21], "");
     }
-    sprintf(scene_info_text_line[21], "");
 }
 
 static void SetEngineSettingsInfo(sreEngineSettingsInfo *info) {
@@ -183,9 +185,42 @@ static void SetEngineSettingsInfo(sreEngineSettingsInfo *info) {
     if (info->HDR_enabled)
         sprintf(strend(scene_info_text_line[10]), ", Tone-mapping shader: %s (F4)",
             sreGetToneMappingShaderName(info->HDR_tone_mapping_shader));
-    sprintf(scene_info_text_line[11], "");
-    sprintf(scene_info_text_line[12], "");
-    sprintf(scene_info_text_line[13], "");
+    if (info->multi_pass_rendering) {
+        sreLightingPassBatchingInfo *batching_info = sreGetLightingPassBatchingInfo();
+        sprintf(scene_info_text_line[11], "Lighting batching: %s, objects %d, batches %d, "
+            "shaders %d (saved %d), textures %d (saved %d)",
+            disabled_enabled_str[
+                (info->rendering_flags & SRE_RENDERING_FLAG_LIGHTING_PASS_BATCHING) != 0],
+            batching_info->objects_drawn, batching_info->batches,
+            batching_info->shader_changes, batching_info->shader_changes_saved,
+            batching_info->texture_changes, batching_info->texture_changes_saved);
+        sprintf(scene_info_text_line[12], "Instancing: %s, instanced draws %d, instanced objects %d",
+            disabled_enabled_str[(info->rendering_flags & SRE_RENDERING_FLAG_INSTANCING) != 0],
+            batching_info->instanced_draws, batching_info->instanced_objects);
+        delete batching_info;
+    }
+    else {
+        sprintf(scene_info_text_line[11], "");
+        sprintf(scene_info_text_line[12], "");
+    }
+    sreFrameProfileInfo *profile_info = sreGetFrameProfileInfo();
+    if (profile_info != NULL) {
+        double shadow_time[2], lighting_time[2];
+        for (int i = 0; i < 2; i++) {
+            double *t = i == 0 ? profile_info->cpu_time : profile_info->gpu_time;
+            shadow_time[i] = t[SRE_PROFILE_SHADOW_MAP] + t[SRE_PROFILE_SHADOW_VOLUMES];
+            lighting_time[i] = t[SRE_PROFILE_AMBIENT_PASS] + t[SRE_PROFILE_SINGLE_PASS] +
+                t[SRE_PROFILE_DEFERRED_SHADING] + t[SRE_PROFILE_LIGHTING_PASS];
+        }
+        sprintf(scene_info_text_line[13], "Profile (CPU/GPU ms): frame %.2lf/%.2lf, "
+            "shadows %.2lf/%.2lf, lighting %.2lf/%.2lf",
+            profile_info->cpu_time[SRE_PROFILE_FRAME] * 0.001,
+            profile_info->gpu_time[SRE_PROFILE_FRAME] * 0.001, shadow_time[0] * 0.001,
+            shadow_time[1] * 0.001, lighting_time[0] * 0.001, lighting_time[1] * 0.001);
+        delete profile_info;
+    }
+    else
+        sprintf(scene_info_text_line[13], "");
 }
 
 static sreEngineSettingsInfo *settings_info;
@@ -0,0 +1,269 @@
+/*
+
+Copyright (c) 2014 Harm Hanemaaijer <fgenfb@yahoo.com>
+
+Permission to use, copy, modify, and/or distribute this software for any
+purpose with or without fee is hereby granted, provided that the above
+copyright notice and this permission notice appear in all copies.
+
+THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+
+*/
+
+// Headless back-end rendering into an offscreen EGL pbuffer surface, without a window
+// system (for example for benchmarking with Mesa llvmpipe on a server). The surfaceless
+// Mesa platform is used when available, otherwise the default EGL display. With OpenGL
+// (not ES 2.0), a desktop OpenGL 3.0 context is created through EGL.
+//
+// Since swapping the buffers of a pbuffer surface has no effect, GLSwapBuffers()
+// waits until rendering of the frame has finished, so that frame times include the
+// GPU time and commands do not queue up without limit.
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+#include <sys/time.h>
+#include <EGL/egl.h>
+#include <EGL/eglext.h>
+#ifdef OPENGL_ES2
+#include <GLES2/gl2.h>
+#endif
+#ifdef OPENGL
+#include <GL/glew.h>
+#include <GL/gl.h>
+#endif
+
+#include "sre.h"
+#include "sreBackend.h"
+#include "gui-common.h"
+
+#ifndef EGL_PLATFORM_SURFACELESS_MESA
+#define EGL_PLATFORM_SURFACELESS_MESA 0x31DD
+#endif
+
+class sreBackendHeadless : public sreBackend {
+public :
+    virtual void Initialize(int *argc, char ***argv, int window_width, int window_height,
+        int& actual_width, int& actual_height, unsigned int backend_flags);
+    virtual void Finalize();
+    virtual void GLSwapBuffers();
+    virtual void GLSync();
+    virtual double GetCurrentTime();
+    virtual void ProcessGUIEvents();
+    virtual void ToggleFullScreenMode(int& width, int& height, bool pan_with_mouse);
+    virtual void HideCursor();
+    virtual void RestoreCursor();
+    virtual void WarpCursor(int x, int y);
+};
+
+sreBackend *sreCreateBackendHeadless() {
+    sreBackend *b = new sreBackendHeadless;
+    b->name = "Headless EGL";
+    return b;
+}
+
+static EGLDisplay display;
+static EGLSurface surface;
+static EGLContext context;
+
+static const EGLint attribute_list_base[] = {
+    EGL_SURFACE_TYPE, EGL_PBUFFER_BIT,
+#ifdef OPENGL_ES2
+    EGL_RENDERABLE_TYPE, EGL_OPENGL_ES2_BIT,
+#else
+    EGL_RENDERABLE_TYPE, EGL_OPENGL_BIT,
+#endif
+    EGL_RED_SIZE, 8,
+    EGL_GREEN_SIZE, 8,
+    EGL_BLUE_SIZE, 8,
+    EGL_ALPHA_SIZE, 8,
+    EGL_NONE
+};
+
+static const EGLint attribute_list_stencil_buffer[] = {
+    EGL_DEPTH_SIZE, 24,
+    EGL_STENCIL_SIZE, 8,
+    EGL_NONE
+};
+
+static const EGLint attribute_list_no_stencil_buffer[] = {
+    EGL_DEPTH_SIZE, 24,
+    EGL_STENCIL_SIZE, 0,
+    EGL_NONE
+};
+
+static const EGLint attribute_list_multi_sample[] =  {
+    EGL_SAMPLE_BUFFERS, 1,
+    EGL_SAMPLES, 4,
+    EGL_NONE
+};
+
+#define MAX_ATTRIBUTES_SIZE ((sizeof(attribute_list_base) + \
+    sizeof(attribute_list_stencil_buffer) + \
+    sizeof(attribute_list_multi_sample)) / sizeof(EGLint))
+
+static void AddAttributes(EGLint *attributes, const EGLint *extra_attributes) {
+    int i = 0;
+    while (attributes[i] != EGL_NONE)
+        i++;
+    int j = 0;
+    while (extra_attributes[j] != EGL_NONE) {
+        attributes[i] = extra_attributes[j];
+        i++;
+        j++;
+    }
+    attributes[i] = EGL_NONE;
+}
+
+static EGLDisplay GetHeadlessDisplay() {
+    // Client extensions can be queried without a display (EGL 1.5 or
+    // EGL_EXT_client_extensions); NULL is returned otherwise.
+    const char *client_extensions = eglQueryString(EGL_NO_DISPLAY, EGL_EXTENSIONS);
+    if (client_extensions != NULL &&
+    strstr(client_extensions, "EGL_MESA_platform_surfaceless") != NULL) {
+        PFNEGLGETPLATFORMDISPLAYEXTPROC eglGetPlatformDisplayEXT_func =
+            (PFNEGLGETPLATFORMDISPLAYEXTPROC)eglGetProcAddress("eglGetPlatformDisplayEXT");
+        if (eglGetPlatformDisplayEXT_func != NULL) {
+            EGLDisplay d = eglGetPlatformDisplayEXT_func(EGL_PLATFORM_SURFACELESS_MESA,
+                EGL_DEFAULT_DISPLAY, NULL);
+            if (d != EGL_NO_DISPLAY) {
+                sreMessage(SRE_MESSAGE_INFO, "Using surfaceless EGL platform.");
+                return d;
+            }
+        }
+    }
+    return eglGetDisplay(EGL_DEFAULT_DISPLAY);
+}
+
+void sreBackendHeadless::Initialize(int *argc, char ***argv, int requested_width,
+int requested_height, int& actual_width, int& actual_height, unsigned int backend_flags) {
+    display = GetHeadlessDisplay();
+    if (display == EGL_NO_DISPLAY)
+        sreFatalError("Headless back-end: no EGL display available.");
+    EGLint egl_major, egl_minor;
+    if (!eglInitialize(display, &egl_major, &egl_minor))
+        sreFatalError("Headless back-end: eglInitialize failed.");
+    sreMessage(SRE_MESSAGE_INFO, "EGL version %d.%d (%s).", egl_major, egl_minor,
+        eglQueryString(display, EGL_VENDOR));
+
+    EGLint attribute_list[MAX_ATTRIBUTES_SIZE];
+    attribute_list[0] = EGL_NONE;
+    AddAttributes(attribute_list, attribute_list_base);
+    if (backend_flags & SRE_BACKEND_INIT_FLAG_STENCIL_BUFFER)
+        AddAttributes(attribute_list, attribute_list_stencil_buffer);
+    else
+        AddAttributes(attribute_list, attribute_list_no_stencil_buffer);
+    if (backend_flags & SRE_BACKEND_INIT_FLAG_MULTI_SAMPLE)
+        AddAttributes(attribute_list, attribute_list_multi_sample);
+    EGLConfig config;
+    EGLint num_config;
+    if (!eglChooseConfig(display, attribute_list, &config, 1, &num_config) ||
+    num_config == 0) {
+        // Multi-sampling is often not supported for pbuffers; retry without it.
+        attribute_list[0] = EGL_NONE;
+        AddAttributes(attribute_list, attribute_list_base);
+        if (backend_flags & SRE_BACKEND_INIT_FLAG_STENCIL_BUFFER)
+            AddAttributes(attribute_list, attribute_list_stencil_buffer);
+        else
+            AddAttributes(attribute_list, attribute_list_no_stencil_buffer);
+        if (!eglChooseConfig(display, attribute_list, &config, 1, &num_config) ||
+        num_config == 0)
+            sreFatalError("Headless back-end: EGL returned no suitable framebuffer "
+                "configurations.");
+        sreMessage(SRE_MESSAGE_INFO, "Multi-sampling not available with EGL pbuffer.");
+    }
+
+#ifdef OPENGL_ES2
+    eglBindAPI(EGL_OPENGL_ES_API);
+    static const EGLint context_attributes[] = {
+        EGL_CONTEXT_CLIENT_VERSION, 2,
+        EGL_NONE
+    };
+#else
+    eglBindAPI(EGL_OPENGL_API);
+    // Same context version as the GL_X11 back-end (requires EGL 1.5 or
+    // EGL_KHR_create_context).
+    static const EGLint context_attributes[] = {
+        EGL_CONTEXT_MAJOR_VERSION_KHR, 3,
+        EGL_CONTEXT_MINOR_VERSION_KHR, 0,
+        EGL_NONE
+    };
+#endif
+    context = eglCreateContext(display, config, EGL_NO_CONTEXT, context_attributes);
+    if (context == EGL_NO_CONTEXT)
+        sreFatalError("Headless back-end: eglCreateContext failed.");
+
+    const EGLint pbuffer_attributes[] = {
+        EGL_WIDTH, requested_width,
+        EGL_HEIGHT, requested_height,
+        EGL_NONE
+    };
+    surface = eglCreatePbufferSurface(display, config, pbuffer_attributes);
+    if (surface == EGL_NO_SURFACE)
+        sreFatalError("Headless back-end: eglCreatePbufferSurface failed.");
+    if (!eglMakeCurrent(display, surface, surface, context))
+        sreFatalError("Headless back-end: eglMakeCurrent failed.");
+    eglQuerySurface(display, surface, EGL_WIDTH, &actual_width);
+    eglQuerySurface(display, surface, EGL_HEIGHT, &actual_height);
+
+#ifdef OPENGL
+    GLenum err = glewInit();
+    // Without an X display, GLEW versions that also initialize GLX report an error
+    // after the OpenGL functions have been loaded successfully.
+#ifdef GLEW_ERROR_NO_GLX_DISPLAY
+    if (err == GLEW_ERROR_NO_GLX_DISPLAY)
+        err = GLEW_OK;
+#endif
+    if (GLEW_OK != err)
+        sreFatalError("Error: %s", glewGetErrorString(err));
+    sreMessage(SRE_MESSAGE_INFO, "Status: Using GLEW %s.", glewGetString(GLEW_VERSION));
+#endif
+    sreMessage(SRE_MESSAGE_INFO, "Opened offscreen %dx%d EGL pbuffer surface, renderer %s.",
+        actual_width, actual_height, (const char *)glGetString(GL_RENDERER));
+}
+
+void sreBackendHeadless::Finalize() {
+    eglMakeCurrent(display, EGL_NO_SURFACE, EGL_NO_SURFACE, EGL_NO_CONTEXT);
+    eglDestroySurface(display, surface);
+    eglDestroyContext(display, context);
+    eglTerminate(display);
+}
+
+void sreBackendHeadless::GLSwapBuffers() {
+    eglSwapBuffers(display, surface);
+    glFinish();
+}
+
+void sreBackendHeadless::GLSync() {
+    glFinish();
+}
+
+double sreBackendHeadless::GetCurrentTime() {
+    struct timeval tv;
+    gettimeofday(&tv, NULL);
+    return (double)tv.tv_sec + (double)tv.tv_usec / 1000000.0;
+}
+
+// There is no user input.
+
+void sreBackendHeadless::ProcessGUIEvents() {
+}
+
+void sreBackendHeadless::ToggleFullScreenMode(int& width, int& height, bool pan_with_mouse) {
+}
+
+void sreBackendHeadless::HideCursor() {
+}
+
+void sreBackendHeadless::RestoreCursor() {
+}
+
+void sreBackendHeadless::WarpCursor(int x, int y) {
+}
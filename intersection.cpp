@@ -32,6 +32,9 @@ OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
 #ifdef USE_SIMD
 #include <dstVectorMathSIMD.h>
 #endif
+#ifdef __AVX2__
+#include <immintrin.h>
+#endif
 
 // Intersection tests against a hull (a collection of vertex positions).
 
@@ -73,6 +76,82 @@ bool Intersects(const sreBoundingVolumeSphere& sphere, const sreBoundingVolumeCo
     return true;
 }
 
+// Batched version of the sphere test above for n (at most 32) spheres stored in
+// structure-of-arrays format. Bit i of the returned mask is set when sphere i is
+// completely outside the convex hull. Uses AVX2 (eight spheres per iteration) when
+// compiled with AVX2 support and four spheres per iteration with the SIMD (SSE)
+// functions; any remaining spheres are tested one at a time.
+
+unsigned int QuerySpheresOutsideConvexHull(const float *center_x, const float *center_y,
+const float *center_z, const float *radius, int n, const sreBoundingVolumeConvexHull& ch) {
+    unsigned int outside_mask = 0;
+    int i = 0;
+#ifdef __AVX2__
+    for (; i + 8 <= n; i += 8) {
+        __m256 m_x = _mm256_loadu_ps(&center_x[i]);
+        __m256 m_y = _mm256_loadu_ps(&center_y[i]);
+        __m256 m_z = _mm256_loadu_ps(&center_z[i]);
+        __m256 m_neg_radius = _mm256_sub_ps(_mm256_setzero_ps(), _mm256_loadu_ps(&radius[i]));
+        __m256 m_outside = _mm256_setzero_ps();
+        for (int j = 0; j < ch.nu_planes; j++) {
+            // Calculate Dot(plane, center) for eight spheres.
+#ifdef __FMA__
+            __m256 m_dot = _mm256_fmadd_ps(m_x, _mm256_set1_ps(ch.plane[j].x),
+                _mm256_set1_ps(ch.plane[j].w));
+            m_dot = _mm256_fmadd_ps(m_y, _mm256_set1_ps(ch.plane[j].y), m_dot);
+            m_dot = _mm256_fmadd_ps(m_z, _mm256_set1_ps(ch.plane[j].z), m_dot);
+#else
+            __m256 m_dot = _mm256_add_ps(
+                _mm256_add_ps(
+                    _mm256_mul_ps(m_x, _mm256_set1_ps(ch.plane[j].x)),
+                    _mm256_mul_ps(m_y, _mm256_set1_ps(ch.plane[j].y))),
+                _mm256_add_ps(
+                    _mm256_mul_ps(m_z, _mm256_set1_ps(ch.plane[j].z)),
+                    _mm256_set1_ps(ch.plane[j].w)));
+#endif
+            m_outside = _mm256_or_ps(m_outside, _mm256_cmp_ps(m_dot, m_neg_radius, _CMP_LE_OQ));
+        }
+        outside_mask |= (unsigned int)_mm256_movemask_ps(m_outside) << i;
+    }
+#endif
+#ifdef USE_SIMD
+    for (; i + 4 <= n; i += 4) {
+        __simd128_float m_x = simd128_set_float(center_x[i], center_x[i + 1],
+            center_x[i + 2], center_x[i + 3]);
+        __simd128_float m_y = simd128_set_float(center_y[i], center_y[i + 1],
+            center_y[i + 2], center_y[i + 3]);
+        __simd128_float m_z = simd128_set_float(center_z[i], center_z[i + 1],
+            center_z[i + 2], center_z[i + 3]);
+        __simd128_float m_neg_radius = simd128_sub_float(simd128_set_same_float(0.0f),
+            simd128_set_float(radius[i], radius[i + 1], radius[i + 2], radius[i + 3]));
+        int mask = 0;
+        for (int j = 0; j < ch.nu_planes; j++) {
+            __simd128_float m_dot = simd128_add_float(
+                simd128_add_float(
+                    simd128_mul_float(m_x, simd128_set_same_float(ch.plane[j].x)),
+                    simd128_mul_float(m_y, simd128_set_same_float(ch.plane[j].y))),
+                simd128_add_float(
+                    simd128_mul_float(m_z, simd128_set_same_float(ch.plane[j].z)),
+                    simd128_set_same_float(ch.plane[j].w)));
+            __simd128_int m_comp = simd128_cmple_float(m_dot, m_neg_radius);
+            mask |= simd128_convert_masks_int32_int1(m_comp);
+            // Stop when all four spheres are known to be outside.
+            if (mask == 0xF)
+                break;
+        }
+        outside_mask |= (unsigned int)mask << i;
+    }
+#endif
+    for (; i < n; i++)
+        for (int j = 0; j < ch.nu_planes; j++)
+            if (ch.plane[j].x * center_x[i] + ch.plane[j].y * center_y[i] +
+            ch.plane[j].z * center_z[i] + ch.plane[j].w <= - radius[i]) {
+                outside_mask |= 1u << i;
+                break;
+            }
+    return outside_mask;
+}
+
 // Test with more information for a sphere and a convex hull. This test may return
 // SRE_PARTIALLY_INSIDE in some cases when the sphere is actually completely outside.
 
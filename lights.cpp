@@ -1162,277 +1162,516 @@ int *intersecting_object) const {
             nu_intersecting_objects, intersecting_object);
 }
 
+// Determine the static objects with an index of at least first_object that intersect a light
+// volume, without using the static octree. Used for objects that have been added since
+// the static light object lists were last calculated, and for all objects when the lists
+// are recalculated after objects have been deleted.
+
+static void DetermineNewStaticLightVolumeIntersectingObjects(const sreScene *scene,
+int first_object, const sreLight& light, int &nu_intersecting_objects, int *intersecting_object) {
+    for (int i = first_object; i < scene->nu_objects; i++) {
+        const sreObject *so = scene->object[i];
+        if (!so->exists)
+            continue;
+        // Only static objects that are stored in the static octree are considered.
+        if (so->flags & (SRE_OBJECT_DYNAMIC_POSITION | SRE_OBJECT_INFINITE_DISTANCE))
+            continue;
+        if ((so->flags & (SRE_OBJECT_EMISSION_ONLY | SRE_OBJECT_CAST_SHADOWS))
+        == SRE_OBJECT_EMISSION_ONLY)
+            // Skip emission-only objects that do not cast shadows.
+            continue;
+        if (light.type & SRE_LIGHT_WORST_CASE_BOUNDS_SPHERE) {
+            if (!Intersects(*so, light.worst_case_sphere))
+                continue;
+        }
+        else if (!Intersects(*so, light))
+            continue;
+        intersecting_object[nu_intersecting_objects] = i;
+        nu_intersecting_objects++;
+    }
+}
+
+// Scratch storage used by a thread when calculating static light object lists.
+
+class sreStaticLightObjectListsScratch {
+public:
+    int *intersecting_object;
+    int *shadow_caster_object;
+    int *partially_inside_object;
+    int *completely_inside_object;
+
+    void Allocate(int n) {
+        intersecting_object = new int[n];
+        shadow_caster_object = new int[n];
+        partially_inside_object = new int[n];
+        completely_inside_object = new int[n];
+    }
+    void Free() {
+        delete [] intersecting_object;
+        delete [] shadow_caster_object;
+        delete [] partially_inside_object;
+        delete [] completely_inside_object;
+    }
+};
+
+// Static shadow volumes calculated for a light. Because the shadow volume array of an
+// object is shared between lights, they are added to the objects afterwards by the
+// calling thread, in light order.
+
+class sreStaticLightShadowVolumes {
+public:
+    int nu_shadow_volumes;
+    sreShadowVolume **shadow_volume;
+    int *object_index;
+
+    sreStaticLightShadowVolumes() {
+        nu_shadow_volumes = 0;
+        shadow_volume = NULL;
+        object_index = NULL;
+    }
+};
+
+class sreStaticLightObjectListsJobData {
+public:
+    sreScene *scene;
+    // Lights with an index lower than first_new_light already have static object lists;
+    // for these lights only objects with an index of at least first_new_object are
+    // considered, and the objects found are added to the existing lists.
+    int first_new_light;
+    int first_new_object;
+    // The light processed by each job.
+    int *light_index;
+    // Scratch storage for each thread.
+    sreStaticLightObjectListsScratch *scratch;
+    // Shadow volumes calculated by each job.
+    sreStaticLightShadowVolumes *shadow_volumes;
+};
+
+// Return a newly allocated copy of the n1 integers in array1 followed by the n2 integers
+// in array2. array1 is freed.
+
+static int *ConcatenateObjectLists(int *array1, int n1, const int *array2, int n2) {
+    int *new_array = new int[n1 + n2];
+    if (n1 > 0) {
+        memcpy(new_array, array1, n1 * sizeof(int));
+        delete [] array1;
+    }
+    if (n2 > 0)
+        memcpy(&new_array[n1], array2, n2 * sizeof(int));
+    return new_array;
+}
+
 // Calculate static object lists for the light. For local lights, both shadow casters and
 // objects within the light volume are determined (with seperation of objects that are
 // completely as opposed to partially inside the light volume). For directional lights,
 // a list of objects within the light volume wouldn't make much sense, but we can precalculate
 // the light volume half cylinder with every object.
 //
-// Note that this function uses, as temporary storage, the sreScene visible_object and shadow_caster_object
-// arrays which must be allocated.
-
-void sreScene::CalculateStaticLightObjectLists() {
-    sreMessage(SRE_MESSAGE_INFO,
-        "Calculating static shadow bounding volumes and static object lists for lights.");
-    // Keep track of the number of static lights for which an object
-    // is partially inside the light volume (this will be used to allocate
-    // geometry scissors cache slots).
-    int *object_partially_inside_light_volume_count = new int[nu_objects];
-    memset(object_partially_inside_light_volume_count, 0, sizeof(int) * nu_objects);
-    int *intersecting_object = new int[nu_objects];
-    BoundsCheckResult *intersection_test_result = new BoundsCheckResult[nu_objects];
-    for (int i = 0; i < nu_lights; i++) {
-        int nu_intersecting_objects = 0;
-        // Determine objects that intersect the volume. This uses bounding volume checks;
-        // more accurate tests may be tried later.
-        // We are only interested in local lights (for dynamic position lights,
-        // the object lists will be initialized to a size of zero).
-        if ((!(light[i]->type & SRE_LIGHT_DYNAMIC_SHADOW_VOLUME) ||
-        (light[i]->type & SRE_LIGHT_WORST_CASE_BOUNDS_SPHERE)) ||
-        (!(light[i]->type & (SRE_LIGHT_DYNAMIC_LIGHT_VOLUME | SRE_LIGHT_DIRECTIONAL)) ||
-        (light[i]->type & SRE_LIGHT_WORST_CASE_BOUNDS_SPHERE)))
-            DetermineStaticLightVolumeIntersectingObjects(fast_octree_static, 0, *light[i],
+// When new_light is false, the light already has static object lists and only the objects
+// with an index of at least first_new_object are added to them. No global state is
+// modified, so that this function can be run by worker threads for different lights at
+// the same time.
+
+static void CalculateStaticLightObjectListsForLight(sreScene *scene, int i, bool new_light,
+int first_new_object, sreStaticLightObjectListsScratch& scratch,
+sreStaticLightShadowVolumes& shadow_volumes) {
+    sreLight *l = scene->light[i];
+    if (new_light) {
+        l->nu_shadow_caster_objects = 0;
+        l->nu_light_volume_objects = 0;
+        l->nu_light_volume_objects_partially_inside = 0;
+    }
+    shadow_volumes.nu_shadow_volumes = 0;
+    int nu_intersecting_objects = 0;
+    int *intersecting_object = scratch.intersecting_object;
+    // Determine objects that intersect the volume. This uses bounding volume checks;
+    // more accurate tests may be tried later.
+    // We are only interested in local lights (for dynamic position lights,
+    // the object lists will be initialized to a size of zero).
+    if ((!(l->type & SRE_LIGHT_DYNAMIC_SHADOW_VOLUME) ||
+    (l->type & SRE_LIGHT_WORST_CASE_BOUNDS_SPHERE)) ||
+    (!(l->type & (SRE_LIGHT_DYNAMIC_LIGHT_VOLUME | SRE_LIGHT_DIRECTIONAL)) ||
+    (l->type & SRE_LIGHT_WORST_CASE_BOUNDS_SPHERE))) {
+        if (new_light) {
+            scene->DetermineStaticLightVolumeIntersectingObjects(scene->fast_octree_static, 0,
+                *l, nu_intersecting_objects, intersecting_object);
+            if (first_new_object > 0 && first_new_object < scene->nu_objects) {
+                // The static octree may have been reused and not contain the new objects;
+                // test these objects directly.
+                int n = 0;
+                for (int k = 0; k < nu_intersecting_objects; k++)
+                    if (intersecting_object[k] < first_new_object) {
+                        intersecting_object[n] = intersecting_object[k];
+                        n++;
+                    }
+                nu_intersecting_objects = n;
+            }
+        }
+        if (!new_light || first_new_object > 0)
+            DetermineNewStaticLightVolumeIntersectingObjects(scene, first_new_object, *l,
                 nu_intersecting_objects, intersecting_object);
-//        printf("%d light volume intersecting objects.\n", nu_intersecting_objects); //DEBUG
-        // Create a list of potential shadow casters within the light volume (non-directional lights).
-        // Calculate static shadow volumes for static objects when the light has a non-changing shadow
-        // volumes for a static object, including directional lights. For a directional light and
-        // large scene, the resource requirements are not extreme (directional light shadow volume
-        // half-cylinders are quickly calculated and do not require much memory). Lots of local
-        // lights that affect significant numbers of objects are potentially more expensive.
-        // We also generate a static objects list and shadow caster list for local lights that are
-        // variable but have a worst-case bounding sphere.
-        if (!(light[i]->type & SRE_LIGHT_DYNAMIC_SHADOW_VOLUME) ||
-        (light[i]->type & SRE_LIGHT_WORST_CASE_BOUNDS_SPHERE)) {
-            shadow_caster_array.Truncate(0);
-            for (int k = 0; k < nu_intersecting_objects; k++) {
-                int j = intersecting_object[k];
-                sreObject *so = object[j];
-                // Dynamic objects shouldn't be encountered, but check anyway.
-                if (so->flags & SRE_OBJECT_DYNAMIC_POSITION)
-                    continue;
-                // Only need to include shadow casters.
-                if (!(so->flags & SRE_OBJECT_CAST_SHADOWS))
-                    continue;
-                // If the object is attached to the current light, don't cast shadows for this object.
-                if (so->attached_light == i)
-                    continue;
-                // For all lights except directional lights, add the object to the list
-                // of shadow casters.
-                if (!(light[i]->type & SRE_LIGHT_DIRECTIONAL)) {
-                    // Add the object to the list of shadow casters for the light.
-                    // For lights with SRE_LIGHT_WORST_CASE_BOUNDS_SPHERE set, these are only
-                    // potential shadow casters.
-                    shadow_caster_array.Add(j);
-                }
-                // When the light's shadow volumes are static for a static object,
-                // calculate the shadow volume and add it to the object's list of shadow volumes.
-                // SRE_LIGHT_DYNAMIC_SHADOW_VOLUME is expected to have been set appropriately
-                // when the light was added to the scene, depending on light type, and on whether
-                // the position, direction, range etc was marked as dynamic or not.
-                if (light[i]->type & SRE_LIGHT_DYNAMIC_SHADOW_VOLUME)
-                    continue;
-                if (light[i]->type & (SRE_LIGHT_POINT_SOURCE | SRE_LIGHT_SPOT)) {
+    }
+    // Create a list of potential shadow casters within the light volume (non-directional lights).
+    // Calculate static shadow volumes for static objects when the light has a non-changing shadow
+    // volumes for a static object, including directional lights. For a directional light and
+    // large scene, the resource requirements are not extreme (directional light shadow volume
+    // half-cylinders are quickly calculated and do not require much memory). Lots of local
+    // lights that affect significant numbers of objects are potentially more expensive.
+    // We also generate a static objects list and shadow caster list for local lights that are
+    // variable but have a worst-case bounding sphere.
+    if (!(l->type & SRE_LIGHT_DYNAMIC_SHADOW_VOLUME) ||
+    (l->type & SRE_LIGHT_WORST_CASE_BOUNDS_SPHERE)) {
+        int nu_shadow_casters = 0;
+        if (nu_intersecting_objects > 0 && !(l->type & SRE_LIGHT_DYNAMIC_SHADOW_VOLUME)) {
+            shadow_volumes.shadow_volume = new sreShadowVolume *[nu_intersecting_objects];
+            shadow_volumes.object_index = new int[nu_intersecting_objects];
+        }
+        for (int k = 0; k < nu_intersecting_objects; k++) {
+            int j = intersecting_object[k];
+            sreObject *so = scene->object[j];
+            // Dynamic objects shouldn't be encountered, but check anyway.
+            if (so->flags & SRE_OBJECT_DYNAMIC_POSITION)
+                continue;
+            // Only need to include shadow casters.
+            if (!(so->flags & SRE_OBJECT_CAST_SHADOWS))
+                continue;
+            // If the object is attached to the current light, don't cast shadows for this object.
+            if (so->attached_light == i)
+                continue;
+            // For all lights except directional lights, add the object to the list
+            // of shadow casters.
+            if (!(l->type & SRE_LIGHT_DIRECTIONAL)) {
+                // Add the object to the list of shadow casters for the light.
+                // For lights with SRE_LIGHT_WORST_CASE_BOUNDS_SPHERE set, these are only
+                // potential shadow casters.
+                scratch.shadow_caster_object[nu_shadow_casters] = j;
+                nu_shadow_casters++;
+            }
+            // When the light's shadow volumes are static for a static object,
+            // calculate the shadow volume and add it to the object's list of shadow volumes.
+            // SRE_LIGHT_DYNAMIC_SHADOW_VOLUME is expected to have been set appropriately
+            // when the light was added to the scene, depending on light type, and on whether
+            // the position, direction, range etc was marked as dynamic or not.
+            if (l->type & SRE_LIGHT_DYNAMIC_SHADOW_VOLUME)
+                continue;
+            sreShadowVolume *sv = NULL;
+            if (l->type & (SRE_LIGHT_POINT_SOURCE | SRE_LIGHT_SPOT)) {
 #if 0
-                    // Point and spot light create pyramid-shaped shadow volumes.
-                    Point3D Q[12];
-                    int n_convex_hull;
-                    // Calculate the shadow volume pyramid for the object.
-                    sreBoundingVolumeType t = so->CalculateShadowVolumePyramid(*light[i],
-                        Q, n_convex_hull);
-                    sreShadowVolume *sv = new sreShadowVolume;
-                    if (t == SRE_BOUNDING_VOLUME_EMPTY)
-                        sv->SetEmpty();
-                    else
-                    if (t == SRE_BOUNDING_VOLUME_EVERYWHERE)
-                        sv->SetEverywhere();
-                    else
-                        sv->SetPyramid(Q, n_convex_hull);
+                // Point and spot light create pyramid-shaped shadow volumes.
+                Point3D Q[12];
+                int n_convex_hull;
+                // Calculate the shadow volume pyramid for the object.
+                sreBoundingVolumeType t = so->CalculateShadowVolumePyramid(*l,
+                    Q, n_convex_hull);
+                sv = new sreShadowVolume;
+                if (t == SRE_BOUNDING_VOLUME_EMPTY)
+                    sv->SetEmpty();
+                else
+                if (t == SRE_BOUNDING_VOLUME_EVERYWHERE)
+                    sv->SetEverywhere();
+                else
+                    sv->SetPyramid(Q, n_convex_hull);
 #else
-                    // Point and spot light create pyramid cone-shaped shadow volumes.
-                    Point3D Q[12];
-                    int n_convex_hull;
-                    Vector3D axis;
-                    float radius;
-                    float cos_half_angular_size;
-                    // Calculate the shadow volume pyramid cone for the object.
-                    sreBoundingVolumeType t = so->CalculatePointSourceOrSpotShadowVolume(*light[i],
-                        Q, n_convex_hull, axis, radius, cos_half_angular_size);
-                    sreShadowVolume *sv = new sreShadowVolume;
-                    if (t == SRE_BOUNDING_VOLUME_EMPTY)
-                        sv->SetEmpty();
-                    else if (t == SRE_BOUNDING_VOLUME_EVERYWHERE)
-                        sv->SetEverywhere();
-                    else if (t == SRE_BOUNDING_VOLUME_PYRAMID_CONE)
-                        sv->SetPyramidCone(Q, n_convex_hull, axis, radius, cos_half_angular_size);
-                    else {
-//                        sreMessage(SRE_MESSAGE_LOG,
-//                            "Object %d has spherical sector shadow volume for light %d",
-//                              so->id, light[i]->id);
-                        sv->SetSphericalSector(light[i]->vector.GetPoint3D(), axis, radius,
-                            cos_half_angular_size);
-                    }
+                // Point and spot light create pyramid cone-shaped shadow volumes.
+                Point3D Q[12];
+                int n_convex_hull;
+                Vector3D axis;
+                float radius;
+                float cos_half_angular_size;
+                // Calculate the shadow volume pyramid cone for the object.
+                sreBoundingVolumeType t = so->CalculatePointSourceOrSpotShadowVolume(*l,
+                    Q, n_convex_hull, axis, radius, cos_half_angular_size);
+                sv = new sreShadowVolume;
+                if (t == SRE_BOUNDING_VOLUME_EMPTY)
+                    sv->SetEmpty();
+                else if (t == SRE_BOUNDING_VOLUME_EVERYWHERE)
+                    sv->SetEverywhere();
+                else if (t == SRE_BOUNDING_VOLUME_PYRAMID_CONE)
+                    sv->SetPyramidCone(Q, n_convex_hull, axis, radius, cos_half_angular_size);
+                else
+                    sv->SetSphericalSector(l->vector.GetPoint3D(), axis, radius,
+                        cos_half_angular_size);
 #endif
-                    sv->light = i;
-                    so->AddShadowVolume(sv);
-                }
-                else if (light[i]->type & SRE_LIGHT_DIRECTIONAL) {
-                    // Directional lights create half cylinder (cylinder with no top)
-                    // -shaped shadow volumes (based on the object's bounding sphere).
-                    float cylinder_radius;
-                    Vector3D cylinder_axis;
-                    Point3D E;
-                    so->CalculateShadowVolumeHalfCylinderForDirectionalLight(
-                        *light[i], E, cylinder_radius, cylinder_axis);
-                    sreShadowVolume *sv = new sreShadowVolume;
-                    sv->SetHalfCylinder(E, cylinder_radius, cylinder_axis);
-                    sv->light = i;
-                    so->AddShadowVolume(sv);
-                }
-                else if (light[i]->type & SRE_LIGHT_BEAM) {
-                    // Beam lights. The shadow volume will be a regular cylinder
-                    // (based on the object's bounding sphere).
-                    Point3D center;
-                    float length;
-                    Vector3D cylinder_axis;
-                    float cylinder_radius;
-                    so->CalculateShadowVolumeCylinderForBeamLight(
-                        *light[i], center, length, cylinder_axis, cylinder_radius);
-                    sreShadowVolume *sv = new sreShadowVolume;
-                    sv->SetCylinder(center, length, cylinder_axis, cylinder_radius);
-                    sv->light = i;
-                    so->AddShadowVolume(sv);
-                }
             }
-            light[i]->nu_shadow_caster_objects = shadow_caster_array.Size();
-            if (!(light[i]->type & SRE_LIGHT_DIRECTIONAL)) {
-                // Copy the shadow caster list into the light's structure.
-                if (shadow_caster_array.Size() > 0) {
-                    light[i]->shadow_caster_object = new int[shadow_caster_array.Size()];
-                    memcpy(light[i]->shadow_caster_object, shadow_caster_array.DataPointer(),
-                        shadow_caster_array.Size() * sizeof(int));
-                }
-                sreMessage(SRE_MESSAGE_LOG, "Light %d: %d shadow casters within light volume.",
-                    i, shadow_caster_array.Size());
-                // Set the flag indicating there is a list containing all static shadow casters
-                // for the light.
-                light[i]->type |= SRE_LIGHT_STATIC_SHADOW_CASTER_LIST;
-           }
+            else if (l->type & SRE_LIGHT_DIRECTIONAL) {
+                // Directional lights create half cylinder (cylinder with no top)
+                // -shaped shadow volumes (based on the object's bounding sphere).
+                float cylinder_radius;
+                Vector3D cylinder_axis;
+                Point3D E;
+                so->CalculateShadowVolumeHalfCylinderForDirectionalLight(
+                    *l, E, cylinder_radius, cylinder_axis);
+                sv = new sreShadowVolume;
+                sv->SetHalfCylinder(E, cylinder_radius, cylinder_axis);
+            }
+            else if (l->type & SRE_LIGHT_BEAM) {
+                // Beam lights. The shadow volume will be a regular cylinder
+                // (based on the object's bounding sphere).
+                Point3D center;
+                float length;
+                Vector3D cylinder_axis;
+                float cylinder_radius;
+                so->CalculateShadowVolumeCylinderForBeamLight(
+                    *l, center, length, cylinder_axis, cylinder_radius);
+                sv = new sreShadowVolume;
+                sv->SetCylinder(center, length, cylinder_axis, cylinder_radius);
+            }
+            if (sv == NULL)
+                continue;
+            sv->light = i;
+            shadow_volumes.shadow_volume[shadow_volumes.nu_shadow_volumes] = sv;
+            shadow_volumes.object_index[shadow_volumes.nu_shadow_volumes] = j;
+            shadow_volumes.nu_shadow_volumes++;
         }
-        else
-            light[i]->nu_shadow_caster_objects = 0;
-        // Calculate static object list for the light. Only applied to static lights
-        // (not directional) that have a fixed light volume. However, for stationary lights
-        // or lights that can only move in a fixed range that have an established worst case
-        // light volume bounding sphere (SRE_LIGHT_WORST_CASE_BOUNDS_SPHERE), such as
-        // spot light that can only change direction, or a point light that can
-        // change attenuation (range) up to a known limit), and a limited position movement
-        // range, we can also calculate a list.
-        if (!(light[i]->type & (SRE_LIGHT_DYNAMIC_LIGHT_VOLUME | SRE_LIGHT_DIRECTIONAL)) ||
-        (light[i]->type & SRE_LIGHT_WORST_CASE_BOUNDS_SPHERE)) {
-            nu_visible_objects = 0;
-            // First the objects that are partially inside the light volume.
-            // Note: More accurate intersection tests, can be used, since this
-            // function is not very time-sensitive. Every vertex of the object can
-            // be checked (after bounding volume tests suggest intersection).
-            for (int k = 0; k < nu_intersecting_objects; k++) {
-                int j = intersecting_object[k];
-                sreObject *so = object[j];
-                if (so->flags & SRE_OBJECT_DYNAMIC_POSITION)
-                    continue;
-                // Emission-only objects are not affected by the light.
-                if (so->flags & SRE_OBJECT_EMISSION_ONLY)
-                    continue;
-                // Use the full intersection test that tests every vertex. Unless the scene is
-                // very large with a large number of lights, this should be acceptable for an
-                // preprocessing function. The extra accuracy should result in some rendering
-                // performance gains.
+        if (!(l->type & SRE_LIGHT_DIRECTIONAL)) {
+            // Add the shadow casters to the light's list.
+            if (nu_shadow_casters > 0) {
+                l->shadow_caster_object = ConcatenateObjectLists(l->shadow_caster_object,
+                    l->nu_shadow_caster_objects, scratch.shadow_caster_object, nu_shadow_casters);
+                l->nu_shadow_caster_objects += nu_shadow_casters;
+            }
+            // Set the flag indicating there is a list containing all static shadow casters
+            // for the light.
+            l->type |= SRE_LIGHT_STATIC_SHADOW_CASTER_LIST;
+        }
+    }
+    else
+        l->nu_shadow_caster_objects = 0;
+    // Calculate static object list for the light. Only applied to static lights
+    // (not directional) that have a fixed light volume. However, for stationary lights
+    // or lights that can only move in a fixed range that have an established worst case
+    // light volume bounding sphere (SRE_LIGHT_WORST_CASE_BOUNDS_SPHERE), such as
+    // spot light that can only change direction, or a point light that can
+    // change attenuation (range) up to a known limit), and a limited position movement
+    // range, we can also calculate a list.
+    if (!(l->type & (SRE_LIGHT_DYNAMIC_LIGHT_VOLUME | SRE_LIGHT_DIRECTIONAL)) ||
+    (l->type & SRE_LIGHT_WORST_CASE_BOUNDS_SPHERE)) {
+        int nu_partially_inside = 0;
+        int nu_completely_inside = 0;
+        // Note: More accurate intersection tests, can be used, since this
+        // function is not very time-sensitive. Every vertex of the object can
+        // be checked (after bounding volume tests suggest intersection).
+        for (int k = 0; k < nu_intersecting_objects; k++) {
+            int j = intersecting_object[k];
+            sreObject *so = scene->object[j];
+            if (so->flags & SRE_OBJECT_DYNAMIC_POSITION)
+                continue;
+            // Emission-only objects are not affected by the light.
+            if (so->flags & SRE_OBJECT_EMISSION_ONLY)
+                continue;
+            // Use the full intersection test that tests every vertex. Unless the scene is
+            // very large with a large number of lights, this should be acceptable for an
+            // preprocessing function. The extra accuracy should result in some rendering
+            // performance gains.
 #ifdef STATIC_OBJECT_DETERMINATION_LOG
-                printf("Object LOD levels: %d, vertices in level 0: %d\n",
-                     so->model->nu_lod_levels, so->model->lod_model[0]->nu_vertices);
+            printf("Object LOD levels: %d, vertices in level 0: %d\n",
+                 so->model->nu_lod_levels, so->model->lod_model[0]->nu_vertices);
 #endif
-                BoundsCheckResult r;
-                if (light[i]->type & SRE_LIGHT_WORST_CASE_BOUNDS_SPHERE) {
-                    // Use the light's worst-case light volume.
-                    r = QueryIntersectionFull(*so, *light[i], true);
-                    // If we only have worst case bounds, treat all objects that intersect with
-                    // them as partially inside.
-                    if (r == SRE_COMPLETELY_INSIDE)
-                        r = SRE_PARTIALLY_INSIDE;
-                }
-                else
-                    r = QueryIntersectionFull(*so, *light[i]);
-                // Store the intersection test result for later use below (note: indexed
-                // with index into intersecting object array, not global object index/id).
-                intersection_test_result[k] = r;
-                if (sre_internal_debug_message_level >= 2)
-                    if (r == SRE_PARTIALLY_INSIDE &&
-                    QueryIntersection(*so, *light[i]) == SRE_COMPLETELY_INSIDE)
-                        sreMessage(SRE_MESSAGE_LOG,
-                            "Object bounding volumes completely inside light volume, "
-                            "but at least one LOD model vertex is actually outside the light volume.");
-                // Only store objects partially inside the light volume for now.
-                if (r != SRE_PARTIALLY_INSIDE)
-                    continue;
-                visible_object[nu_visible_objects] = j;
-                nu_visible_objects++;
-                // Count the number of lights for which an object is partially inside the light
-                // volume.
-                object_partially_inside_light_volume_count[j]++;
+            BoundsCheckResult r;
+            if (l->type & SRE_LIGHT_WORST_CASE_BOUNDS_SPHERE) {
+                // Use the light's worst-case light volume.
+                r = QueryIntersectionFull(*so, *l, true);
+                // If we only have worst case bounds, treat all objects that intersect with
+                // them as partially inside.
+                if (r == SRE_COMPLETELY_INSIDE)
+                    r = SRE_PARTIALLY_INSIDE;
             }
-            light[i]->nu_light_volume_objects_partially_inside = nu_visible_objects;
-            // Secondly the objects that are completely inside the light volume.
-            for (int k = 0; k < nu_intersecting_objects; k++) {
-                int j = intersecting_object[k];
-                sreObject *so = object[j];
-                if (so->flags & SRE_OBJECT_DYNAMIC_POSITION)
-                    continue;
-                if (so->flags & SRE_OBJECT_EMISSION_ONLY)
-                    continue;
-                if (light[i]->type & SRE_LIGHT_WORST_CASE_BOUNDS_SPHERE)
-                    // If we only have worst case bounds, no object is completely inside (all
-                    // objects were already stored as partially inside).
-                    continue;
-                // Since precisely the same objects were considered in the earlier (partially inside)
-                // loop, the intersection test result should be valid.
-                BoundsCheckResult r = intersection_test_result[k];
-                // Only store objects completely inside the light volume.
-                if (sre_internal_debug_message_level >= 2)
-                    if (r == SRE_COMPLETELY_INSIDE &&
-                    QueryIntersection(*so, *light[i]) == SRE_PARTIALLY_INSIDE)
-                        sreMessage(SRE_MESSAGE_LOG,
-                            "Object bounding volumes partially inside light volume, "
-                            "but every LOD model vertex is actually inside the light volume.");
-                if (r != SRE_COMPLETELY_INSIDE)
-                    continue;
-                visible_object[nu_visible_objects] = j;
-                nu_visible_objects++;
+            else
+                r = QueryIntersectionFull(*so, *l);
+            if (sre_internal_debug_message_level >= 2) {
+                if (r == SRE_PARTIALLY_INSIDE &&
+                QueryIntersection(*so, *l) == SRE_COMPLETELY_INSIDE)
+                    sreMessage(SRE_MESSAGE_LOG,
+                        "Object bounding volumes completely inside light volume, "
+                        "but at least one LOD model vertex is actually outside the light volume.");
+                else if (r == SRE_COMPLETELY_INSIDE &&
+                QueryIntersection(*so, *l) == SRE_PARTIALLY_INSIDE)
+                    sreMessage(SRE_MESSAGE_LOG,
+                        "Object bounding volumes partially inside light volume, "
+                        "but every LOD model vertex is actually inside the light volume.");
+            }
+            // Objects partially inside the light volume come first in the light volume
+            // object list, followed by the objects completely inside.
+            if (r == SRE_PARTIALLY_INSIDE) {
+                scratch.partially_inside_object[nu_partially_inside] = j;
+                nu_partially_inside++;
+            }
+            else if (r == SRE_COMPLETELY_INSIDE) {
+                scratch.completely_inside_object[nu_completely_inside] = j;
+                nu_completely_inside++;
             }
-            light[i]->type |= SRE_LIGHT_STATIC_OBJECTS_LIST;
-            light[i]->nu_light_volume_objects = nu_visible_objects;
-            if (nu_visible_objects > 0) {
-                light[i]->light_volume_object = new int[nu_visible_objects];
-                memcpy(light[i]->light_volume_object, visible_object, nu_visible_objects * sizeof(int));
+        }
+        if (nu_partially_inside + nu_completely_inside > 0) {
+            // Merge with the existing list while keeping the partially inside objects first.
+            int n = l->nu_light_volume_objects;
+            int n_partial = l->nu_light_volume_objects_partially_inside;
+            int *new_object = new int[n + nu_partially_inside + nu_completely_inside];
+            int count = 0;
+            if (n_partial > 0)
+                memcpy(&new_object[count], l->light_volume_object, n_partial * sizeof(int));
+            count += n_partial;
+            if (nu_partially_inside > 0)
+                memcpy(&new_object[count], scratch.partially_inside_object,
+                    nu_partially_inside * sizeof(int));
+            count += nu_partially_inside;
+            if (n - n_partial > 0)
+                memcpy(&new_object[count], &l->light_volume_object[n_partial],
+                    (n - n_partial) * sizeof(int));
+            count += n - n_partial;
+            if (nu_completely_inside > 0)
+                memcpy(&new_object[count], scratch.completely_inside_object,
+                    nu_completely_inside * sizeof(int));
+            if (n > 0)
+                delete [] l->light_volume_object;
+            l->light_volume_object = new_object;
+            l->nu_light_volume_objects = n + nu_partially_inside + nu_completely_inside;
+            l->nu_light_volume_objects_partially_inside = n_partial + nu_partially_inside;
+        }
+        l->type |= SRE_LIGHT_STATIC_OBJECTS_LIST;
+    }
+    else
+        l->nu_light_volume_objects = 0;
+}
+
+static void CalculateStaticLightObjectListsJob(void *data, int job_index, int thread_index) {
+    sreStaticLightObjectListsJobData *job_data = (sreStaticLightObjectListsJobData *)data;
+    int i = job_data->light_index[job_index];
+    CalculateStaticLightObjectListsForLight(job_data->scene, i, i >= job_data->first_new_light,
+        job_data->first_new_object, job_data->scratch[thread_index],
+        job_data->shadow_volumes[job_index]);
+}
+
+// Count, for each object, the number of static lights for which the object is partially
+// inside the light volume (this is used to allocate geometry scissors cache slots).
+
+static void CountObjectPartiallyInsideLightVolumes(const sreScene *scene, int nu_lights,
+int *count) {
+    memset(count, 0, sizeof(int) * scene->nu_objects);
+    for (int i = 0; i < nu_lights; i++) {
+        const sreLight *l = scene->light[i];
+        if (!(l->type & SRE_LIGHT_STATIC_OBJECTS_LIST))
+            continue;
+        for (int k = 0; k < l->nu_light_volume_objects_partially_inside; k++)
+            count[l->light_volume_object[k]]++;
+    }
+}
+
+// Calculate the static object lists of the lights. The per-light work is distributed over
+// the worker threads. The lists persist, so that when lights or static objects have been
+// added since the previous call (for example when PrepareForRendering() is called again
+// with SRE_PREPARE_REUSE_OCTREES after adding a light), only the new lights are calculated
+// in full, and the lists of existing lights are only extended with the new objects.
+// When objects have been deleted since the previous call, the lists of all lights are
+// recalculated, because DeleteObject() does not remove the objects from the lists and
+// AddObject() may have reused their ids.
+
+void sreScene::CalculateStaticLightObjectLists() {
+    int first_new_light = static_light_object_lists_nu_lights;
+    int first_new_object = static_light_object_lists_nu_objects;
+    if (first_new_light == nu_lights && first_new_object == nu_objects &&
+    !static_light_object_lists_objects_deleted)
+        return;
+    if (first_new_light == 0)
+        sreMessage(SRE_MESSAGE_INFO,
+            "Calculating static shadow bounding volumes and static object lists for lights.");
+    else if (static_light_object_lists_objects_deleted)
+        sreMessage(SRE_MESSAGE_INFO,
+            "Recalculating static object lists for lights (objects have been deleted).");
+    else
+        sreMessage(SRE_MESSAGE_INFO,
+            "Updating static object lists for lights (%d new lights, %d new objects).",
+            nu_lights - first_new_light, nu_objects - first_new_object);
+    // Keep track of the number of static lights for which an object
+    // is partially inside the light volume (this will be used to allocate
+    // geometry scissors cache slots).
+    int *previous_partially_inside_count = new int[nu_objects];
+    CountObjectPartiallyInsideLightVolumes(this, first_new_light, previous_partially_inside_count);
+
+    if (static_light_object_lists_objects_deleted) {
+        // Empty the lists of every light and the static shadow volumes of every object,
+        // and treat all lights as existing lights for which every object is new. This
+        // tests each object directly, skipping deleted objects, instead of using the
+        // static octree, which may have been reused and still contain them.
+        for (int i = 0; i < nu_lights; i++) {
+            if (i < first_new_light) {
+                if (light[i]->nu_light_volume_objects > 0)
+                    delete [] light[i]->light_volume_object;
+                if (light[i]->nu_shadow_caster_objects > 0)
+                    delete [] light[i]->shadow_caster_object;
             }
+            light[i]->nu_shadow_caster_objects = 0;
+            light[i]->nu_light_volume_objects = 0;
+            light[i]->nu_light_volume_objects_partially_inside = 0;
+        }
+        for (int i = 0; i < nu_objects; i++)
+            object[i]->FreeShadowVolumes();
+        first_new_light = nu_lights;
+        first_new_object = 0;
+        static_light_object_lists_objects_deleted = false;
+    }
+
+    // When there are no new objects, only the new lights have to be processed.
+    int first_light = first_new_object == nu_objects ? first_new_light : 0;
+    int nu_jobs = nu_lights - first_light;
+    sreStaticLightObjectListsJobData job_data;
+    job_data.scene = this;
+    job_data.first_new_light = first_new_light;
+    job_data.first_new_object = first_new_object;
+    job_data.light_index = new int[nu_jobs];
+    for (int i = 0; i < nu_jobs; i++)
+        job_data.light_index[i] = first_light + i;
+    int nu_threads = sreGetThreadPoolSize();
+    job_data.scratch = new sreStaticLightObjectListsScratch[nu_threads];
+    for (int i = 0; i < nu_threads; i++)
+        job_data.scratch[i].Allocate(nu_objects);
+    job_data.shadow_volumes = new sreStaticLightShadowVolumes[nu_jobs];
+    sreRunThreadPoolJobs(CalculateStaticLightObjectListsJob, &job_data, nu_jobs);
+    for (int i = 0; i < nu_threads; i++)
+        job_data.scratch[i].Free();
+    delete [] job_data.scratch;
+
+    // Add the static shadow volumes to the objects in light order.
+    for (int job = 0; job < nu_jobs; job++) {
+        sreStaticLightShadowVolumes *shadow_volumes = &job_data.shadow_volumes[job];
+        for (int k = 0; k < shadow_volumes->nu_shadow_volumes; k++)
+            object[shadow_volumes->object_index[k]]->AddShadowVolume(
+                shadow_volumes->shadow_volume[k]);
+        delete [] shadow_volumes->shadow_volume;
+        delete [] shadow_volumes->object_index;
+        int i = job_data.light_index[job];
+        if (light[i]->type & SRE_LIGHT_STATIC_SHADOW_CASTER_LIST)
+            sreMessage(SRE_MESSAGE_LOG, "Light %d: %d shadow casters within light volume.",
+                i, light[i]->nu_shadow_caster_objects);
+        if (light[i]->type & SRE_LIGHT_STATIC_OBJECTS_LIST)
             sreMessage(SRE_MESSAGE_LOG,
                 "Light %d: %d objects within light volume, %d partially inside.", i,
-                nu_visible_objects, light[i]->nu_light_volume_objects_partially_inside);
-        }
-        else {
+                light[i]->nu_light_volume_objects, light[i]->nu_light_volume_objects_partially_inside);
+        else
             sreMessage(SRE_MESSAGE_LOG, "Light %d: Objects within light volume not calculated "
                 "(directional or dynamic light).", i);
-            light[i]->nu_light_volume_objects = 0;
-	}
     }
-    delete [] intersecting_object;
-    delete [] intersection_test_result;
+    delete [] job_data.shadow_volumes;
+    delete [] job_data.light_index;
+
     // Create a geometry scissors cache for each static object that is partially inside
     // the light volume of one or more static lights. For other objects, the geometry
-    // scissors cache will never be used.
-    for (int i = 0; i < nu_objects; i++)
+    // scissors cache will never be used. Objects for which the count has changed get a
+    // new cache.
+    int *object_partially_inside_light_volume_count = new int[nu_objects];
+    CountObjectPartiallyInsideLightVolumes(this, nu_lights,
+        object_partially_inside_light_volume_count);
+    for (int i = 0; i < nu_objects; i++) {
+        if (object_partially_inside_light_volume_count[i] == previous_partially_inside_count[i])
+            continue;
+        if (previous_partially_inside_count[i] > 0)
+            delete [] object[i]->geometry_scissors_cache;
         if (object_partially_inside_light_volume_count[i] > 0)
             object[i]->geometry_scissors_cache =
                 new sreScissorsCacheEntry[object_partially_inside_light_volume_count[i]];
+        object[i]->geometry_scissors_cache_timestamp = - 1;
+    }
     delete [] object_partially_inside_light_volume_count;
+    delete [] previous_partially_inside_count;
+    static_light_object_lists_nu_lights = nu_lights;
+    static_light_object_lists_nu_objects = nu_objects;
 }
-
@@ -0,0 +1,350 @@
+/*
+
+Copyright (c) 2014 Harm Hanemaaijer <fgenfb@yahoo.com>
+
+Permission to use, copy, modify, and/or distribute this software for any
+purpose with or without fee is hereby granted, provided that the above
+copyright notice and this permission notice appear in all copies.
+
+THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+
+*/
+
+// Occlusion culling with hardware occlusion queries.
+//
+// After the depth buffer has been initialized (by the ambient pass in multi-pass
+// rendering, or the single pass), the bounding boxes of static octree nodes and large
+// objects that are inside the view frustum are drawn with color and depth writes
+// disabled, each inside an occlusion query. The results are retrieved at the start of
+// a later frame, only when they are available, so that the CPU never waits for the GPU.
+// During visible entity determination, an octree node that was found to be occluded is
+// skipped together with all its subnodes, and an occluded object is not drawn in the
+// ambient pass nor in any of the lighting passes. Since entities in an octree node lie
+// within the node's bounds, lights in an occluded node cannot affect visible pixels
+// either.
+//
+// Entities that are occluded are queried again every frame so that they reappear
+// quickly. Visible entities are queried only every SRE_OCCLUSION_QUERY_INTERVAL frames
+// (staggered by index) to limit the number of queries.
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <stdint.h>
+#ifdef OPENGL_ES2
+#include <GLES2/gl2.h>
+#endif
+#ifdef OPENGL
+#include <GL/glew.h>
+#include <GL/gl.h>
+#endif
+
+#include "sre.h"
+#include "sre_internal.h"
+#include "shader.h"
+
+#define SRE_OCCLUSION_QUERY_INTERVAL 4
+#define SRE_MAX_OCCLUSION_QUERIES_PER_FRAME 1024
+// Number of vertices of a bounding box drawn as triangles.
+#define SRE_OCCLUSION_BOX_VERTICES 36
+
+const sreFastOctree *sre_internal_occlusion_octree = NULL;
+sreOcclusionQueryState *sre_internal_octree_node_occlusion_state = NULL;
+
+#ifndef OPENGL_ES2
+
+static GLenum query_target;
+// Fallback vertex buffer for the bounding boxes when the streaming buffer is not in use.
+static GLuint box_vertex_buffer = 0;
+// The scene and the node bounds of the static octree for which the node states were
+// allocated.
+static sreScene *occlusion_scene = NULL;
+static const sreOctreeNodeBounds *occlusion_node_bounds = NULL;
+static int occlusion_nu_nodes = 0;
+static int nu_node_states = 0;
+// Entities with an issued query of which the result has not yet been retrieved. Objects
+// are encoded as the object id, octree nodes as the node index with bit 31 set.
+static unsigned int *pending_query = NULL;
+static int nu_pending_queries = 0;
+static int max_pending_queries = 0;
+// The entities queried in the current frame and their bounding boxes.
+static unsigned int queried_entity[SRE_MAX_OCCLUSION_QUERIES_PER_FRAME];
+static sreBoundingVolumeAABB queried_AABB[SRE_MAX_OCCLUSION_QUERIES_PER_FRAME];
+
+// Triangles of a box with corners indexed by bit 0 (x), bit 1 (y) and bit 2 (z), with
+// counter-clockwise winding when seen from outside.
+static const unsigned char box_triangle_corner[SRE_OCCLUSION_BOX_VERTICES] = {
+    0, 2, 3, 0, 3, 1,  // z = min
+    4, 5, 7, 4, 7, 6,  // z = max
+    0, 1, 5, 0, 5, 4,  // y = min
+    2, 6, 7, 2, 7, 3,  // y = max
+    0, 4, 6, 0, 6, 2,  // x = min
+    1, 3, 7, 1, 7, 5   // x = max
+};
+
+#endif
+
+void sreInitializeOcclusionQueries() {
+#ifdef OPENGL_ES2
+    sreMessage(SRE_MESSAGE_INFO, "Occlusion queries not supported with OpenGL-ES 2.0.");
+#else
+    if (!GLEW_VERSION_1_5 && !GLEW_ARB_occlusion_query) {
+        sreMessage(SRE_MESSAGE_INFO, "Occlusion queries not available.");
+        return;
+    }
+    // Only whether any samples passed is of interest, which may be faster.
+    if (GLEW_VERSION_3_3 || GLEW_ARB_occlusion_query2)
+        query_target = GL_ANY_SAMPLES_PASSED;
+    else
+        query_target = GL_SAMPLES_PASSED;
+    glGenBuffers(1, &box_vertex_buffer);
+    sre_internal_rendering_flags |= SRE_RENDERING_FLAG_OCCLUSION_QUERY_SUPPORT;
+    sreMessage(SRE_MESSAGE_INFO, "Occlusion queries supported (occlusion culling disabled "
+        "by default).");
+#endif
+}
+
+void sreDestroyOcclusionQuery(sreOcclusionQueryState& state) {
+#ifndef OPENGL_ES2
+    if (state.query != 0)
+        glDeleteQueries(1, &state.query);
+    state.query = 0;
+    state.query_pending = false;
+#endif
+}
+
+#ifndef OPENGL_ES2
+
+static void AddPendingQuery(unsigned int entity) {
+    if (nu_pending_queries == max_pending_queries) {
+        max_pending_queries = max_pending_queries == 0 ? 256 : max_pending_queries * 2;
+        unsigned int *new_pending_query = new unsigned int[max_pending_queries];
+        if (nu_pending_queries > 0) {
+            memcpy(new_pending_query, pending_query, sizeof(unsigned int) * nu_pending_queries);
+            delete [] pending_query;
+        }
+        pending_query = new_pending_query;
+    }
+    pending_query[nu_pending_queries] = entity;
+    nu_pending_queries++;
+}
+
+static sreOcclusionQueryState *LookupState(sreScene *scene, unsigned int entity) {
+    if (entity & 0x80000000)
+        return &sre_internal_octree_node_occlusion_state[entity & 0x7FFFFFFF];
+    sreObject *so = scene->object[entity];
+    if (so == NULL || !so->exists)
+        return NULL;
+    return &so->occlusion;
+}
+
+// Allocate the node states when the static octree has been (re)created, or the scene
+// has changed. Any pending queries for the previous octree or scene are discarded.
+
+static void UpdateNodeStates(sreScene *scene) {
+    if (scene == occlusion_scene && scene->fast_octree_static.node_bounds ==
+    occlusion_node_bounds && scene->fast_octree_static.nu_nodes == occlusion_nu_nodes)
+        return;
+    if (scene == occlusion_scene) {
+        // Keep the pending object queries.
+        int n = 0;
+        for (int i = 0; i < nu_pending_queries; i++)
+            if (!(pending_query[i] & 0x80000000)) {
+                pending_query[n] = pending_query[i];
+                n++;
+            }
+        nu_pending_queries = n;
+    }
+    else
+        nu_pending_queries = 0;
+    for (int i = 0; i < nu_node_states; i++)
+        sreDestroyOcclusionQuery(sre_internal_octree_node_occlusion_state[i]);
+    delete [] sre_internal_octree_node_occlusion_state;
+    sre_internal_octree_node_occlusion_state = NULL;
+    sre_internal_occlusion_octree = NULL;
+    nu_node_states = 0;
+    occlusion_scene = scene;
+    occlusion_node_bounds = scene->fast_octree_static.node_bounds;
+    occlusion_nu_nodes = scene->fast_octree_static.nu_nodes;
+    // Node indices are only available for regular fast octrees.
+    if (occlusion_node_bounds == NULL || sre_internal_octree_type ==
+    SRE_OCTREE_STRICT_OPTIMIZED || sre_internal_octree_type == SRE_QUADTREE_XY_STRICT_OPTIMIZED)
+        return;
+    nu_node_states = scene->fast_octree_static.nu_nodes;
+    sre_internal_octree_node_occlusion_state = new sreOcclusionQueryState[nu_node_states];
+    sre_internal_occlusion_octree = &scene->fast_octree_static;
+}
+
+#endif
+
+// Retrieve the results of pending queries that have become available. Called at the
+// start of visible entity determination.
+
+void sreUpdateOcclusionQueryResults(sreScene *scene) {
+#ifndef OPENGL_ES2
+    UpdateNodeStates(scene);
+    int n = 0;
+    for (int i = 0; i < nu_pending_queries; i++) {
+        sreOcclusionQueryState *state = LookupState(scene, pending_query[i]);
+        if (state == NULL || !state->query_pending)
+            continue;
+        GLuint available;
+        glGetQueryObjectuiv(state->query, GL_QUERY_RESULT_AVAILABLE, &available);
+        if (!available) {
+            // Keep the previous result and check again in the next frame.
+            pending_query[n] = pending_query[i];
+            n++;
+            continue;
+        }
+        GLuint samples_passed;
+        glGetQueryObjectuiv(state->query, GL_QUERY_RESULT, &samples_passed);
+        state->occluded = (samples_passed == 0);
+        state->query_pending = false;
+    }
+    nu_pending_queries = n;
+#endif
+}
+
+#ifndef OPENGL_ES2
+
+// Select a candidate of the current frame for a new query. Returns false when no query
+// should be issued.
+
+static bool SelectForQuery(sreOcclusionQueryState& state, int index,
+const sreBoundingVolumeAABB& AABB) {
+    if (state.most_recent_frame_candidate != sre_internal_current_frame || state.query_pending)
+        return false;
+    if (!state.occluded && (index + sre_internal_current_frame) %
+    SRE_OCCLUSION_QUERY_INTERVAL != 0)
+        return false;
+    // When the viewpoint is inside or very close to the box, the box may be clipped by the
+    // near plane; the entity must be considered visible.
+    float margin = sre_internal_near_plane_distance * 2.0f;
+    if (sre_internal_viewpoint.x >= AABB.dim_min.x - margin &&
+    sre_internal_viewpoint.x <= AABB.dim_max.x + margin &&
+    sre_internal_viewpoint.y >= AABB.dim_min.y - margin &&
+    sre_internal_viewpoint.y <= AABB.dim_max.y + margin &&
+    sre_internal_viewpoint.z >= AABB.dim_min.z - margin &&
+    sre_internal_viewpoint.z <= AABB.dim_max.z + margin) {
+        state.occluded = false;
+        return false;
+    }
+    return true;
+}
+
+static void GetObjectAABB(const sreObject& so, sreBoundingVolumeAABB& AABB) {
+    if (so.flags & SRE_OBJECT_DYNAMIC_POSITION) {
+        // The static AABB is not updated for moving objects.
+        Vector3D extent = Vector3D(so.sphere.radius, so.sphere.radius, so.sphere.radius);
+        AABB.dim_min = so.sphere.center - extent;
+        AABB.dim_max = so.sphere.center + extent;
+    }
+    else
+        AABB = so.AABB;
+}
+
+#endif
+
+// Issue occlusion queries for the candidate octree nodes and objects of the current
+// frame. Must be called when the depth buffer has been initialized with the geometry
+// that was determined to be visible.
+
+void sreIssueOcclusionQueries(sreScene *scene) {
+#ifndef OPENGL_ES2
+    if (!(sre_internal_rendering_flags & SRE_RENDERING_FLAG_OCCLUSION_CULLING) ||
+    misc_shader[SRE_MISC_SHADER_SHADOW_VOLUME].status != SRE_SHADER_STATUS_LOADED)
+        return;
+    int nu_queries = 0;
+    for (int i = 0; i < nu_node_states && nu_queries < SRE_MAX_OCCLUSION_QUERIES_PER_FRAME; i++) {
+        const sreBoundingVolumeAABB& AABB = sre_internal_occlusion_octree->node_bounds[i].AABB;
+        if (!SelectForQuery(sre_internal_octree_node_occlusion_state[i], i, AABB))
+            continue;
+        queried_entity[nu_queries] = i | 0x80000000;
+        queried_AABB[nu_queries] = AABB;
+        nu_queries++;
+    }
+    for (int i = 0; i < scene->nu_objects && nu_queries < SRE_MAX_OCCLUSION_QUERIES_PER_FRAME;
+    i++) {
+        sreObject *so = scene->object[i];
+        if (so == NULL || !so->exists)
+            continue;
+        sreBoundingVolumeAABB AABB;
+        GetObjectAABB(*so, AABB);
+        if (!SelectForQuery(so->occlusion, i, AABB))
+            continue;
+        queried_entity[nu_queries] = i;
+        queried_AABB[nu_queries] = AABB;
+        nu_queries++;
+    }
+    if (nu_queries == 0)
+        return;
+
+    // Write the box vertices.
+    int size = nu_queries * SRE_OCCLUSION_BOX_VERTICES * sizeof(float) * 3;
+    unsigned int offset = 0;
+    bool streamed = true;
+    float *vertices = (float *)sreMapStreamingBuffer(size, offset);
+    if (vertices == NULL) {
+        streamed = false;
+        vertices = new float[nu_queries * SRE_OCCLUSION_BOX_VERTICES * 3];
+    }
+    float *v = vertices;
+    for (int i = 0; i < nu_queries; i++) {
+        const sreBoundingVolumeAABB& AABB = queried_AABB[i];
+        for (int j = 0; j < SRE_OCCLUSION_BOX_VERTICES; j++) {
+            int corner = box_triangle_corner[j];
+            v[0] = (corner & 1) ? AABB.dim_max.x : AABB.dim_min.x;
+            v[1] = (corner & 2) ? AABB.dim_max.y : AABB.dim_min.y;
+            v[2] = (corner & 4) ? AABB.dim_max.z : AABB.dim_min.z;
+            v += 3;
+        }
+    }
+    if (streamed) {
+        sreUnmapStreamingBuffer();
+        glBindBuffer(GL_ARRAY_BUFFER, sre_internal_streaming_buffer);
+    }
+    else {
+        glBindBuffer(GL_ARRAY_BUFFER, box_vertex_buffer);
+        glBufferData(GL_ARRAY_BUFFER, size, vertices, GL_STREAM_DRAW);
+        delete [] vertices;
+    }
+
+    // The shadow volume shader is used to draw the boxes with the view-projection matrix
+    // as MVP; since the w component of the vertices is 1, the light position has no effect.
+    glUseProgram(misc_shader[SRE_MISC_SHADER_SHADOW_VOLUME].program);
+    glUniformMatrix4fv(misc_shader[SRE_MISC_SHADER_SHADOW_VOLUME].
+        uniform_location[UNIFORM_MISC_MVP], 1, GL_FALSE,
+        (const float *)&sre_internal_view_projection_matrix);
+    Vector4D light_position = Vector4D(0, 0, 0, 1.0f);
+    glUniform4fv(misc_shader[SRE_MISC_SHADER_SHADOW_VOLUME].
+        uniform_location[UNIFORM_MISC_LIGHT_MODEL_SPACE], 1, (const float *)&light_position);
+    glEnableVertexAttribArray(0);
+    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 0, (void *)(uintptr_t)offset);
+    glColorMask(GL_FALSE, GL_FALSE, GL_FALSE, GL_FALSE);
+    glDepthMask(GL_FALSE);
+    // Back faces are drawn as well so that the result is correct when the camera is
+    // close to the box.
+    glDisable(GL_CULL_FACE);
+    for (int i = 0; i < nu_queries; i++) {
+        sreOcclusionQueryState *state = LookupState(scene, queried_entity[i]);
+        if (state->query == 0)
+            glGenQueries(1, &state->query);
+        glBeginQuery(query_target, state->query);
+        glDrawArrays(GL_TRIANGLES, i * SRE_OCCLUSION_BOX_VERTICES, SRE_OCCLUSION_BOX_VERTICES);
+        glEndQuery(query_target);
+        state->query_pending = true;
+        AddPendingQuery(queried_entity[i]);
+    }
+    glEnable(GL_CULL_FACE);
+    glDepthMask(GL_TRUE);
+    glColorMask(GL_TRUE, GL_TRUE, GL_TRUE, GL_TRUE);
+    glDisableVertexAttribArray(0);
+    CHECK_GL_ERROR("Error after issuing occlusion queries.\n");
+#endif
+}
@@ -57,13 +57,13 @@ public :
     void AddEntitiesBalancedAtRootLevel(int nu_input_entities, sreSceneEntity *input_entity_array);
     void AddEntityIntoBalancedOctree(const sreSceneEntity& entity);
     void AddEntityIntoBalancedOctreeAtRootLevel(const sreSceneEntity& entity);
-    void ConvertToFastOctree(sreFastOctree& fast_oct);
+    void ConvertToFastOctree(sreFastOctree& fast_oct, bool create_entity_spheres = false);
 private :
     void AddEntityRecursive(sreSceneEntity *entity, int depth);
     void ConvertToArrays(int& counted_nodes, int& counted_leafs, int& counted_entities);
     void ConvertToFastOctreeRecursive(sreFastOctree& fast_oct) const;
     void ConvertToFastOctree(sreFastOctree& fast_oct, int counted_nodes, int counted_leafs,
-        int counted_entities) const;
+        int counted_entities, bool create_entity_spheres = false) const;
 };
 
 
@@ -996,6 +996,23 @@ void Octree::ConvertToFastOctreeRecursive(sreFastOctree& fast_oct) const {
             fast_oct.array[array_index] = entity_array[i].so->id;
         else if (entity_array[i].type == SRE_ENTITY_LIGHT)
             fast_oct.array[array_index] = entity_array[i].light->id | 0x80000000;
+        if (fast_oct.entity_sphere_x != NULL) {
+            // Mirror the bounding sphere of objects in the packed arrays. Lights get an
+            // infinite radius so that they are never culled by the SIMD sphere test.
+            if (entity_array[i].type == SRE_ENTITY_OBJECT) {
+                const sreBoundingVolumeSphere& sphere = entity_array[i].so->sphere;
+                fast_oct.entity_sphere_x[array_index] = sphere.center.x;
+                fast_oct.entity_sphere_y[array_index] = sphere.center.y;
+                fast_oct.entity_sphere_z[array_index] = sphere.center.z;
+                fast_oct.entity_sphere_radius[array_index] = sphere.radius;
+            }
+            else {
+                fast_oct.entity_sphere_x[array_index] = 0;
+                fast_oct.entity_sphere_y[array_index] = 0;
+                fast_oct.entity_sphere_z[array_index] = 0;
+                fast_oct.entity_sphere_radius[array_index] = FLT_MAX;
+            }
+        }
         array_index++;
     }
     // Return when there are no non-empty subnodes.
@@ -1027,9 +1044,12 @@ void Octree::ConvertToFastOctreeRecursive(sreFastOctree& fast_oct) const {
 }
 
 // Convert octree to fast octree with the given number of nodes, leafs and entities.
+// When create_entity_spheres is true, a packed structure-of-arrays copy of the bounding
+// spheres of the entities is also created; this is only useful for octrees with entities
+// that do not move.
 
 void Octree::ConvertToFastOctree(sreFastOctree& fast_oct, int counted_nodes, int counted_leafs,
-int counted_entities) const {
+int counted_entities, bool create_entity_spheres) const {
     int size;
     if (sre_internal_octree_type == SRE_OCTREE_STRICT_OPTIMIZED || sre_internal_octree_type ==
     SRE_QUADTREE_XY_STRICT_OPTIMIZED)
@@ -1040,7 +1060,22 @@ int counted_entities) const {
         "Creating fast octree (%d nodes, %d leafs, %d entities), array size = %d.",
         counted_nodes, counted_leafs, counted_entities, size);
     fast_oct.node_bounds = new sreOctreeNodeBounds[counted_nodes];
+    fast_oct.nu_nodes = counted_nodes;
     fast_oct.array = new unsigned int[size];
+    if (create_entity_spheres) {
+        // Use a single allocation for the four arrays. Array positions that do not
+        // correspond to entities are left undefined.
+        fast_oct.entity_sphere_x = new float[size * 4];
+        fast_oct.entity_sphere_y = &fast_oct.entity_sphere_x[size];
+        fast_oct.entity_sphere_z = &fast_oct.entity_sphere_x[size * 2];
+        fast_oct.entity_sphere_radius = &fast_oct.entity_sphere_x[size * 3];
+    }
+    else {
+        fast_oct.entity_sphere_x = NULL;
+        fast_oct.entity_sphere_y = NULL;
+        fast_oct.entity_sphere_z = NULL;
+        fast_oct.entity_sphere_radius = NULL;
+    }
     array_index = 0;
     node_index = 0;
     ConvertToFastOctreeRecursive(fast_oct);
@@ -1050,13 +1085,14 @@ int counted_entities) const {
 // Convert octree to fast octree, first counting the required number of nodes, leafs
 // and entities.
 
-void Octree::ConvertToFastOctree(sreFastOctree& fast_oct) {
+void Octree::ConvertToFastOctree(sreFastOctree& fast_oct, bool create_entity_spheres) {
     int counted_nodes, counted_leafs, counted_entities;
     counted_nodes = 0;
     counted_leafs = 0;
     counted_entities = 0;
     CountNodes(counted_nodes, counted_leafs, counted_entities);
-    ConvertToFastOctree(fast_oct, counted_nodes, counted_leafs, counted_entities);
+    ConvertToFastOctree(fast_oct, counted_nodes, counted_leafs, counted_entities,
+        create_entity_spheres);
     // Free the original octree.
     MakeEmpty();
 }
@@ -1064,6 +1100,8 @@ void Octree::ConvertToFastOctree(sreFastOctree& fast_oct) {
 void sreFastOctree::Destroy() {
     delete [] node_bounds;
     delete [] array;
+    // The other sphere arrays share the same allocation.
+    delete [] entity_sphere_x;
 }
 
 // Create the scene octrees (in sreFastOctree format).
@@ -1220,10 +1258,36 @@ create_octrees :
     Octree octree_dynamic;
     octree_dynamic.nu_entities = 0;
 
-    // Add dynamic objects to an entity array.
+    // When there are enough dynamic objects, store the ones that are not at infinite
+    // distance in a bounding volume hierarchy that is refitted when objects move, so
+    // that they do not all have to be checked individually.
+    int nu_BVH_objects = 0;
+    for (int i = 0 ; i < nu_objects; i++)
+        if ((object[i]->flags & (SRE_OBJECT_DYNAMIC_POSITION | SRE_OBJECT_INFINITE_DISTANCE))
+        == SRE_OBJECT_DYNAMIC_POSITION)
+            nu_BVH_objects++;
+    delete dynamic_object_bvh;
+    dynamic_object_bvh = NULL;
+    if (nu_BVH_objects >= SRE_MIN_DYNAMIC_OBJECT_BVH_OBJECTS) {
+        int *BVH_object = new int[nu_BVH_objects];
+        int j = 0;
+        for (int i = 0 ; i < nu_objects; i++)
+            if ((object[i]->flags & (SRE_OBJECT_DYNAMIC_POSITION | SRE_OBJECT_INFINITE_DISTANCE))
+            == SRE_OBJECT_DYNAMIC_POSITION) {
+                BVH_object[j] = i;
+                j++;
+            }
+        dynamic_object_bvh = new sreObjectBVH;
+        dynamic_object_bvh->Build(*this, nu_BVH_objects, BVH_object);
+        delete [] BVH_object;
+        sreMessage(SRE_MESSAGE_INFO, "Created dynamic object BVH (%d objects).", nu_BVH_objects);
+    }
+
+    // Add dynamic objects that are not stored in the BVH to an entity array.
     size = 0;
     for (int i = 0 ; i < nu_objects; i++)
-        if (object[i]->flags & SRE_OBJECT_DYNAMIC_POSITION) {
+        if ((object[i]->flags & SRE_OBJECT_DYNAMIC_POSITION) && (dynamic_object_bvh == NULL ||
+        (object[i]->flags & SRE_OBJECT_INFINITE_DISTANCE))) {
             entity_array[size].type = SRE_ENTITY_OBJECT;
             entity_array[size].so = object[i];
             size++;
@@ -1297,8 +1361,9 @@ create_octrees :
     delete [] entity_array;
 
     // Convert the static octree, dynamic octree and both infinite distance octrees to
-    // the "fast" octrees for the scene.
-    octree_static.ConvertToFastOctree(fast_octree_static);
+    // the "fast" octrees for the scene. For the static octree, a packed copy of the
+    // object bounding spheres is created for SIMD-accelerated visibility tests.
+    octree_static.ConvertToFastOctree(fast_octree_static, true);
     octree_dynamic.ConvertToFastOctree(fast_octree_dynamic);
     octree_static_infinite_distance.ConvertToFastOctree(fast_octree_static_infinite_distance);
     octree_dynamic_infinite_distance.ConvertToFastOctree(fast_octree_dynamic_infinite_distance);
@@ -0,0 +1,361 @@
+/*
+
+Copyright (c) 2014 Harm Hanemaaijer <fgenfb@yahoo.com>
+
+Permission to use, copy, modify, and/or distribute this software for any
+purpose with or without fee is hereby granted, provided that the above
+copyright notice and this permission notice appear in all copies.
+
+THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+
+*/
+
+// Per-pass frame profiler.
+//
+// When profiling is enabled, the stages of sreScene::Render() (visibility determination,
+// the ambient or single pass, the shadow map or shadow volume pass and lighting pass of
+// each light, the final pass and HDR post-processing) are recorded as nested events
+// with their CPU time. When timer queries are available (OpenGL 3.3 or
+// ARB_timer_query), a GPU timestamp is also written at the start and end of each event.
+// The timestamp results are retrieved up to SRE_PROFILE_FRAME_LATENCY frames later, only
+// when they are available, so that the CPU does not have to wait for the GPU. GPU times
+// are converted to the CPU time base using the GPU timestamp at the start of the frame.
+//
+// The events of the most recent completed frame can be retrieved with
+// sreGetFrameProfileInfo(). Between sreBeginProfileTrace() and sreEndProfileTrace(), the
+// events of all completed frames are also collected and written as a Chrome trace
+// (JSON) file that can be loaded in chrome://tracing or similar tools, with the CPU and
+// GPU timelines as separate threads.
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <stdint.h>
+#include <sys/time.h>
+#ifdef OPENGL_ES2
+#include <GLES2/gl2.h>
+#endif
+#ifdef OPENGL
+#include <GL/glew.h>
+#include <GL/gl.h>
+#endif
+
+#include "sre.h"
+#include "sre_internal.h"
+
+// Number of frames for which GPU timer query results can be outstanding.
+#define SRE_PROFILE_FRAME_LATENCY 4
+#define SRE_PROFILE_MAX_EVENTS_PER_FRAME 256
+// Maximum number of events (CPU and GPU) collected in a trace.
+#define SRE_PROFILE_MAX_TRACE_EVENTS (1 << 20)
+
+static const char *profile_stage_name[SRE_NU_PROFILE_STAGES] = {
+    "Frame",
+    "Visibility",
+    "Ambient pass",
+    "Single pass",
+    "Deferred shading",
+    "Shadow map",
+    "Shadow volumes",
+    "Lighting pass",
+    "Final pass",
+    "HDR"
+};
+
+class sreProfileFrame {
+public :
+    int frame;
+    int nu_events;
+    sreProfileEvent event[SRE_PROFILE_MAX_EVENTS_PER_FRAME];
+    // Start time of the frame on the CPU in microseconds.
+    double cpu_start_time;
+    int draw_calls;
+    int triangles;
+#ifndef OPENGL_ES2
+    // GPU timestamp queries at the start and end of each event.
+    GLuint query[SRE_PROFILE_MAX_EVENTS_PER_FRAME * 2];
+    // GPU timestamp in nanoseconds at the start of the frame.
+    GLint64 gpu_start_time;
+#endif
+    // Whether the GPU timer query results have not yet been retrieved.
+    bool pending;
+};
+
+class sreProfileTraceEvent {
+public :
+    sreProfileEvent event;
+    int frame;
+    // Start time of the frame relative to the start of the trace in microseconds.
+    double frame_start_time;
+};
+
+int sre_internal_profile_draw_calls = 0;
+int sre_internal_profile_triangles = 0;
+
+static bool gpu_timer_queries = false;
+static sreProfileFrame *profile_frame = NULL;
+// The frame currently being recorded, or NULL when no frame is being recorded.
+static sreProfileFrame *current_profile_frame = NULL;
+static int current_depth;
+// The events of the most recent frame of which the results are complete.
+static int last_frame = - 1;
+static int last_nu_events = 0;
+static sreProfileEvent last_event[SRE_PROFILE_MAX_EVENTS_PER_FRAME];
+static int last_draw_calls;
+static int last_triangles;
+static bool tracing = false;
+static double trace_start_time;
+static sreProfileTraceEvent *trace_event = NULL;
+static int nu_trace_events = 0;
+static int max_trace_events = 0;
+
+static double GetCurrentTime() {
+    struct timeval tv;
+    gettimeofday(&tv, NULL);
+    return (double)tv.tv_sec * 1000000.0 + (double)tv.tv_usec;
+}
+
+void sreInitializeProfiler() {
+    profile_frame = new sreProfileFrame[SRE_PROFILE_FRAME_LATENCY];
+    for (int i = 0; i < SRE_PROFILE_FRAME_LATENCY; i++) {
+        profile_frame[i].nu_events = 0;
+        profile_frame[i].pending = false;
+    }
+#ifndef OPENGL_ES2
+    if (GLEW_VERSION_3_3 || GLEW_ARB_timer_query) {
+        for (int i = 0; i < SRE_PROFILE_FRAME_LATENCY; i++)
+            glGenQueries(SRE_PROFILE_MAX_EVENTS_PER_FRAME * 2, &profile_frame[i].query[0]);
+        gpu_timer_queries = true;
+        return;
+    }
+#endif
+    sreMessage(SRE_MESSAGE_INFO, "GPU timer queries not available (profiler limited to "
+        "CPU times).");
+}
+
+static void AddTraceEvent(const sreProfileFrame *f, int i) {
+    if (nu_trace_events == max_trace_events) {
+        if (max_trace_events == SRE_PROFILE_MAX_TRACE_EVENTS) {
+            sreMessage(SRE_MESSAGE_WARNING, "Profile trace event limit reached.");
+            tracing = false;
+            return;
+        }
+        max_trace_events = max_trace_events == 0 ? 4096 : max_trace_events * 2;
+        sreProfileTraceEvent *new_trace_event = new sreProfileTraceEvent[max_trace_events];
+        if (nu_trace_events > 0) {
+            memcpy(new_trace_event, trace_event, sizeof(sreProfileTraceEvent) * nu_trace_events);
+            delete [] trace_event;
+        }
+        trace_event = new_trace_event;
+    }
+    trace_event[nu_trace_events].event = f->event[i];
+    trace_event[nu_trace_events].frame = f->frame;
+    trace_event[nu_trace_events].frame_start_time = f->cpu_start_time - trace_start_time;
+    nu_trace_events++;
+}
+
+// Called when the results of a frame are complete.
+
+static void FinishProfileFrame(sreProfileFrame *f) {
+    f->pending = false;
+    last_frame = f->frame;
+    last_nu_events = f->nu_events;
+    memcpy(last_event, f->event, sizeof(sreProfileEvent) * f->nu_events);
+    last_draw_calls = f->draw_calls;
+    last_triangles = f->triangles;
+    if (tracing && f->cpu_start_time >= trace_start_time)
+        for (int i = 0; i < f->nu_events && tracing; i++)
+            AddTraceEvent(f, i);
+}
+
+// Retrieve the GPU timer query results of a frame. When wait is false, the function
+// returns false if the results are not yet available.
+
+static bool RetrieveProfileFrameResults(sreProfileFrame *f, bool wait) {
+#ifndef OPENGL_ES2
+    if (!wait) {
+        // The end of the frame event is the last timestamp written in the frame.
+        GLuint available;
+        glGetQueryObjectuiv(f->query[1], GL_QUERY_RESULT_AVAILABLE, &available);
+        if (!available)
+            return false;
+    }
+    for (int i = 0; i < f->nu_events; i++) {
+        GLuint64 start, end;
+        glGetQueryObjectui64v(f->query[i * 2], GL_QUERY_RESULT, &start);
+        glGetQueryObjectui64v(f->query[i * 2 + 1], GL_QUERY_RESULT, &end);
+        f->event[i].gpu_start = (double)((GLint64)start - f->gpu_start_time) * 0.001;
+        f->event[i].gpu_duration = (double)(end - start) * 0.001;
+    }
+#endif
+    FinishProfileFrame(f);
+    return true;
+}
+
+void sreProfilerBeginFrame() {
+    if (profile_frame == NULL)
+        return;
+    // Collect the results of earlier frames that have become available, oldest first.
+    // The slot of the oldest frame is reused for the current frame, so if the GPU is
+    // that far behind, wait for its results.
+    for (int i = 0; i < SRE_PROFILE_FRAME_LATENCY; i++) {
+        sreProfileFrame *f = &profile_frame[(sre_internal_current_frame + i) %
+            SRE_PROFILE_FRAME_LATENCY];
+        if (f->pending && !RetrieveProfileFrameResults(f, i == 0))
+            break;
+    }
+    sreProfileFrame *f = &profile_frame[sre_internal_current_frame % SRE_PROFILE_FRAME_LATENCY];
+    if (!sre_internal_profiling)
+        return;
+    f->frame = sre_internal_current_frame;
+    f->nu_events = 0;
+#ifndef OPENGL_ES2
+    if (gpu_timer_queries)
+        glGetInteger64v(GL_TIMESTAMP, &f->gpu_start_time);
+#endif
+    f->cpu_start_time = GetCurrentTime();
+    current_profile_frame = f;
+    current_depth = 0;
+    sre_internal_profile_draw_calls = 0;
+    sre_internal_profile_triangles = 0;
+    sreProfilerBeginEvent(SRE_PROFILE_FRAME, - 1);
+}
+
+void sreProfilerEndFrame() {
+    sreProfileFrame *f = current_profile_frame;
+    if (f == NULL)
+        return;
+    sreProfilerEndEvent(0);
+    current_profile_frame = NULL;
+    f->draw_calls = sre_internal_profile_draw_calls;
+    f->triangles = sre_internal_profile_triangles;
+    if (gpu_timer_queries)
+        f->pending = true;
+    else
+        FinishProfileFrame(f);
+}
+
+int sreProfilerBeginEvent(int stage, int light_index) {
+    sreProfileFrame *f = current_profile_frame;
+    if (f == NULL || f->nu_events == SRE_PROFILE_MAX_EVENTS_PER_FRAME)
+        return - 1;
+    int i = f->nu_events;
+    f->nu_events++;
+    sreProfileEvent *e = &f->event[i];
+    e->stage = stage;
+    e->light_index = light_index;
+    e->depth = current_depth;
+    current_depth++;
+    e->cpu_start = GetCurrentTime() - f->cpu_start_time;
+    e->gpu_start = - 1.0;
+    e->gpu_duration = - 1.0;
+#ifndef OPENGL_ES2
+    if (gpu_timer_queries)
+        glQueryCounter(f->query[i * 2], GL_TIMESTAMP);
+#endif
+    return i;
+}
+
+void sreProfilerEndEvent(int i) {
+    sreProfileFrame *f = current_profile_frame;
+    if (f == NULL || i < 0)
+        return;
+    current_depth--;
+    f->event[i].cpu_duration = GetCurrentTime() - f->cpu_start_time - f->event[i].cpu_start;
+#ifndef OPENGL_ES2
+    if (gpu_timer_queries)
+        glQueryCounter(f->query[i * 2 + 1], GL_TIMESTAMP);
+#endif
+}
+
+void sreSetProfiling(bool enabled) {
+    sre_internal_profiling = enabled;
+}
+
+sreFrameProfileInfo *sreGetFrameProfileInfo() {
+    if (last_frame < 0)
+        return NULL;
+    sreFrameProfileInfo *info = new sreFrameProfileInfo;
+    info->frame = last_frame;
+    info->gpu_timing = gpu_timer_queries;
+    info->nu_events = last_nu_events;
+    info->event = new sreProfileEvent[last_nu_events];
+    memcpy(info->event, last_event, sizeof(sreProfileEvent) * last_nu_events);
+    info->draw_calls = last_draw_calls;
+    info->triangles = last_triangles;
+    for (int i = 0; i < SRE_NU_PROFILE_STAGES; i++) {
+        info->cpu_time[i] = 0;
+        info->gpu_time[i] = 0;
+    }
+    for (int i = 0; i < last_nu_events; i++) {
+        info->cpu_time[last_event[i].stage] += last_event[i].cpu_duration;
+        if (gpu_timer_queries)
+            info->gpu_time[last_event[i].stage] += last_event[i].gpu_duration;
+    }
+    return info;
+}
+
+const char *sreGetProfileStageName(int stage) {
+    if (stage < 0 || stage >= SRE_NU_PROFILE_STAGES)
+        return "Unknown";
+    return profile_stage_name[stage];
+}
+
+// Free the recorded trace events.
+
+static void FreeTraceEvents() {
+    delete [] trace_event;
+    trace_event = NULL;
+    nu_trace_events = 0;
+    max_trace_events = 0;
+}
+
+void sreBeginProfileTrace() {
+    nu_trace_events = 0;
+    trace_start_time = GetCurrentTime();
+    tracing = true;
+}
+
+static void WriteTraceEvent(FILE *fp, const sreProfileTraceEvent *t, int tid, double start,
+double duration) {
+    fprintf(fp, ",\n{\"name\":\"%s\",\"cat\":\"%s\",\"ph\":\"X\",\"ts\":%.3lf,\"dur\":%.3lf,"
+        "\"pid\":1,\"tid\":%d,\"args\":{\"frame\":%d",
+        profile_stage_name[t->event.stage], tid == 1 ? "cpu" : "gpu",
+        t->frame_start_time + start, duration, tid, t->frame);
+    if (t->event.light_index >= 0)
+        fprintf(fp, ",\"light\":%d", t->event.light_index);
+    fprintf(fp, "}}");
+}
+
+bool sreEndProfileTrace(const char *filename) {
+    tracing = false;
+    FILE *fp = fopen(filename, "wb");
+    if (fp == NULL) {
+        sreMessage(SRE_MESSAGE_WARNING, "Could not open profile trace file %s.", filename);
+        FreeTraceEvents();
+        return false;
+    }
+    fprintf(fp, "{\"traceEvents\":[\n"
+        "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":1,\"args\":{\"name\":\"CPU\"}}");
+    if (gpu_timer_queries)
+        fprintf(fp, ",\n{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":2,"
+            "\"args\":{\"name\":\"GPU\"}}");
+    for (int i = 0; i < nu_trace_events; i++) {
+        const sreProfileTraceEvent *t = &trace_event[i];
+        WriteTraceEvent(fp, t, 1, t->event.cpu_start, t->event.cpu_duration);
+        if (gpu_timer_queries)
+            WriteTraceEvent(fp, t, 2, t->event.gpu_start, t->event.gpu_duration);
+    }
+    fprintf(fp, "\n],\n\"displayTimeUnit\":\"ms\"}\n");
+    fclose(fp);
+    sreMessage(SRE_MESSAGE_INFO, "Profile trace with %d events written to %s.", nu_trace_events,
+        filename);
+    FreeTraceEvents();
+    return true;
+}
@@ -63,9 +63,13 @@ sreScene::sreScene(int _max_objects, int _max_models, int _max_scene_lights) {
     current_physics_lod_level = 0;
     current_UV_transformation_matrix = sre_internal_standard_UV_transformation_matrix;
     deleted_ids = new sreObjectList;
+    static_light_object_lists_nu_lights = 0;
+    static_light_object_lists_nu_objects = 0;
+    static_light_object_lists_objects_deleted = false;
     // No rendering object arrays allocated yet.
     max_visible_objects = 0;
     max_final_pass_objects = 0; 
+    dynamic_object_bvh = NULL;
 }
 
 void sreScene::ClearOctrees() {
@@ -75,6 +79,8 @@ void sreScene::ClearOctrees() {
     fast_octree_dynamic.Destroy();
     fast_octree_static_infinite_distance.Destroy();
     fast_octree_dynamic_infinite_distance.Destroy();
+    delete dynamic_object_bvh;
+    dynamic_object_bvh = NULL;
 }
 
 // Make an already existing scene empty. Models are not affected.
@@ -88,6 +94,9 @@ void sreScene::ClearObjectsAndLights() {
         delete light[i];
     nu_lights = 0;
     deleted_ids->MakeEmpty();
+    static_light_object_lists_nu_lights = 0;
+    static_light_object_lists_nu_objects = 0;
+    static_light_object_lists_objects_deleted = false;
 }
 
 sreScene::~sreScene() {
@@ -103,6 +112,10 @@ sreScene::~sreScene() {
     if (max_final_pass_objects > 0)
         delete [] final_pass_object;
     visible_light_array.MakeEmpty();
+    delete dynamic_object_bvh;
+#ifndef NO_SHADOW_MAP
+    sreFreeShadowCasterSets();
+#endif
 }
 
 void sreScene::PrepareForRendering(unsigned int flags) {
@@ -117,16 +130,14 @@ void sreScene::PrepareForRendering(unsigned int flags) {
             RemoveUnreferencedModels();
     }
 
-    // Temporarily allocate visual object and shadow caster object arrays
-    // with full capacity for shadow volume calculation.
-    nu_visible_objects = 0;
-    visible_object = new int[max_objects];
-    shadow_caster_array.Truncate(0);
-    shadow_caster_array.SetCapacity(max_objects);
-    // Use visible_object and shadow_caster_object arrays as scratch memory.
+    // Calculate or update the static object lists of the lights.
     CalculateStaticLightObjectLists();
-    delete [] visible_object;
-    shadow_caster_array.MakeEmpty();
+
+    // Free the rendering arrays when the scene has been prepared before.
+    if (max_visible_objects > 0)
+        delete [] visible_object;
+    if (max_final_pass_objects > 0)
+        delete [] final_pass_object;
 
     // Set reasonable limits for number of visible objects/lights during
     // rendering. If the world is large, this can be much lower than the
@@ -151,6 +162,24 @@ void sreScene::PrepareForRendering(unsigned int flags) {
         UploadModels();
 }
 
+// Shader selection depends on the light type, so the shaders of each object are warmed up
+// for one light of every shader light type present in the scene.
+
+void sreScene::WarmUpShaders() const {
+    sreLight *light_of_type[SRE_SHADER_LIGHT_TYPE_AMBIENT];
+    for (int i = 0; i < SRE_SHADER_LIGHT_TYPE_AMBIENT; i++)
+        light_of_type[i] = NULL;
+    for (int i = 0; i < nu_lights; i++)
+        if (light_of_type[light[i]->shader_light_type] == NULL)
+            light_of_type[light[i]->shader_light_type] = light[i];
+    for (int i = 0; i < nu_objects; i++) {
+        sreWarmUpObjectShaders(*object[i], NULL);
+        for (int j = 0; j < SRE_SHADER_LIGHT_TYPE_AMBIENT; j++)
+            if (light_of_type[j] != NULL)
+                sreWarmUpObjectShaders(*object[i], light_of_type[j]);
+    }
+}
+
 // Scene builder helper functions.
 
 void sreScene::SetColor(Color color) {
@@ -453,6 +482,7 @@ float rot_x, float rot_y, float rot_z, float scaling) {
     so->bv_special.ellipsoid = NULL;
     so->most_recent_frame_visible = - 1;
     so->geometry_scissors_cache_timestamp = - 1;
+    so->object_uniform_buffer_generation = - 1;
 
     if ((so->flags & (SRE_OBJECT_DYNAMIC_POSITION | SRE_OBJECT_NO_PHYSICS)) ==
     (SRE_OBJECT_DYNAMIC_POSITION))
@@ -517,6 +547,12 @@ void sreScene::DeleteObject(int soi) {
     deleted_ids->AddElement(so->id);
     so->exists = false;
     so->flags |= SRE_OBJECT_HIDDEN;
+    // The object is not removed from the static object lists of the lights; instead,
+    // the lists are recalculated by the next CalculateStaticLightObjectLists(), since
+    // the id may be reused by AddObject() in the meantime.
+    so->FreeShadowVolumes();
+    if (soi < static_light_object_lists_nu_objects)
+        static_light_object_lists_objects_deleted = true;
 }
 
 // Scene object dynamic change helper functions.
@@ -545,6 +581,14 @@ static void UpdateChangeTracking(sreObject& so, int mask) {
    }
 }
 
+// When the object is stored in the dynamic object BVH, register that its bounds have changed.
+// The BVH is updated before visible entity determination.
+
+static inline void UpdateDynamicObjectBVH(sreObjectBVH *bvh, int soi) {
+    if (bvh != NULL)
+        bvh->MarkObjectChanged(soi);
+}
+
 void sreScene::ChangePosition(int soi, Point3D pos) const {
     if (pos == object[soi]->position)
         // Position didn't actually change.
@@ -552,6 +596,7 @@ void sreScene::ChangePosition(int soi, Point3D pos) const {
     object[soi]->position= pos;
     InstantiateObject(soi);
     UpdateChangeTracking(*object[soi], SRE_OBJECT_POSITION_CHANGE);
+    UpdateDynamicObjectBVH(dynamic_object_bvh, soi);
 }
 
 void sreScene::ChangePosition(int soi, float x, float y, float z) const {
@@ -570,6 +615,7 @@ void sreScene::ChangeRotation(int soi, float rotx, float roty, float rotz) const
     object[soi]->rotation.Set(rotx, roty, rotz);
     InstantiateObject(soi);
     UpdateChangeTracking(*object[soi], SRE_OBJECT_TRANSFORMATION_CHANGE);
+    UpdateDynamicObjectBVH(dynamic_object_bvh, soi);
 }
 
 void sreScene::ChangeRotationMatrix(int soi, const Matrix3D& rot) const {
@@ -579,6 +625,7 @@ void sreScene::ChangeRotationMatrix(int soi, const Matrix3D& rot) const {
     object[soi]->rotation_matrix = rot;
     InstantiateObjectRotationMatrixAlreadySet(soi);
     UpdateChangeTracking(*object[soi], SRE_OBJECT_TRANSFORMATION_CHANGE);
+    UpdateDynamicObjectBVH(dynamic_object_bvh, soi);
 }
 
 void sreScene::ChangePositionAndRotation(int soi, float x, float y, float z,
@@ -593,6 +640,7 @@ float rotx, float roty, float rotz) const {
     object[soi]->rotation.Set(rotx, roty, rotz);
     InstantiateObject(soi);
     UpdateChangeTracking(*object[soi], flags);
+    UpdateDynamicObjectBVH(dynamic_object_bvh, soi);
 }
 
 void sreScene::ChangePositionAndRotationMatrix(int soi, float x, float y, float z,
@@ -609,6 +657,7 @@ const Matrix3D& m_rot) const {
     object[soi]->rotation_matrix = m_rot;
     InstantiateObjectRotationMatrixAlreadySet(soi);
     UpdateChangeTracking(*object[soi], flags);
+    UpdateDynamicObjectBVH(dynamic_object_bvh, soi);
 }
 
 void sreScene::ChangeBillboardSize(int object_index, float bb_width, float bb_height) const {
@@ -622,6 +671,7 @@ void sreScene::ChangeBillboardSize(int object_index, float bb_width, float bb_he
         // if preprocessing is enabled.
         object[object_index]->sphere.center = object[object_index]->position;
     object[object_index]->sphere.radius = Magnitude(X + Y);
+    UpdateDynamicObjectBVH(dynamic_object_bvh, object_index);
 }
 
 void sreScene::ChangeHaloSize(int object_index, float size) const {
@@ -779,6 +829,11 @@ sreObject::~sreObject() {
     // or more static shadow volumes that were calculated in
     // sreScene::CalculateStaticLightObjectLists(). These are dynamically
     // allocated structured that can be freed.
+    FreeShadowVolumes();
+    sreDestroyOcclusionQuery(occlusion);
+}
+
+void sreObject::FreeShadowVolumes() {
     for (int i = 0; i < nu_shadow_volumes; i++)
         // This should trigger the destructor of sreShadowVolume,
         // freeing additional allocated structures.
@@ -786,6 +841,7 @@ sreObject::~sreObject() {
     if (nu_shadow_volumes > 0)
         // Free the array of shadow volume pointers.
         delete [] shadow_volume;
+    nu_shadow_volumes = 0;
 }
 
 void sreObject::AddShadowVolume(sreShadowVolume *sv) {
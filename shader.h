@@ -44,7 +44,7 @@ extern unsigned int sre_internal_attribute_list_table[1 << SRE_NU_VERTEX_ATTRIBU
 
 // Shader definitions.
 
-#define NU_SINGLE_PASS_SHADERS 10
+#define NU_SINGLE_PASS_SHADERS 12
 #ifdef NO_SHADOW_MAP
 #define NU_MULTI_PASS_SHADERS 13
 #else
@@ -54,7 +54,9 @@ extern unsigned int sre_internal_attribute_list_table[1 << SRE_NU_VERTEX_ATTRIBU
 #define MAX_UNIFORMS 32
 
 enum { SRE_SHADER_STATUS_UNINITIALIZED, SRE_SHADER_STATUS_INITIALIZED,
-    SRE_SHADER_STATUS_LOADED };
+    SRE_SHADER_STATUS_LOADING, SRE_SHADER_STATUS_LOADED };
+
+class sreShaderLoadState;
 
 class sreShader {
 public :
@@ -67,14 +69,24 @@ public :
     int attribute_mask;
     const char *vfilename;
     const char *ffilename;
+    // Optional geometry shader (NULL when not used).
+    const char *gfilename;
     const char *prologue;
+    // Compilation state while the status is SRE_SHADER_STATUS_LOADING.
+    sreShaderLoadState *load_state;
 
     sreShader();
     // When demand loading is disabled, Initialize() will load the shader.
     void Initialize(const char *_name, int _type, int _uniform_mask, int _attribute_mask,
-        const char * _vsource, const char *_fsource, const char *_prologue);
+        const char * _vsource, const char *_fsource, const char *_prologue,
+        const char *_gsource = NULL);
     void Initialize(const char *vertex_shader, const char *fragment_shader, const char *prologue);
     void Load();
+    // Asynchronous loading in two steps.
+    void BeginLoad();
+    bool FinishLoad(bool wait);
+    void CompleteLoad();
+    bool LoadNonBlocking();
     void Validate() {
         if (status == SRE_SHADER_STATUS_LOADED)
             return;
@@ -101,10 +113,14 @@ extern bool sre_shader_load_on_demand;
 // #define UNIFORM_CURRENT_LIGHT 6
 // Reuse unused uniform index.
 // #define UNIFORM_SHADOW_MAP_DIMENSIONS 6
+// Only used by the clustered lighting shader.
+#define UNIFORM_CLUSTER_LIGHT_DATA_SAMPLER 6
 #define UNIFORM_AMBIENT_COLOR 7
 #define UNIFORM_VIEWPOINT 8
 #define UNIFORM_LIGHT_PARAMETERS 9
 #define UNIFORM_SHADOW_MAP_PARAMETERS 10
+// Only used by the clustered lighting shader.
+#define UNIFORM_CLUSTER_LIGHT_LIST_SAMPLER 11
 #if 0
 #define UNIFORM_LIGHT_POSITION 9
 #define UNIFORM_LIGHT_ATT 10
@@ -128,12 +144,31 @@ extern bool sre_shader_load_on_demand;
 #define UNIFORM_SHADOW_MAP_SAMPLER 27
 #define UNIFORM_CUBE_SHADOW_MAP_SAMPLER 28
 #define UNIFORM_UV_TRANSFORM 29
+// Only used by the instanced variants of the multi-pass shaders.
+#define UNIFORM_VIEW_PROJECTION_MATRIX 30
+// Only used by the clustered lighting shader.
+#define UNIFORM_CLUSTER_PARAMETERS 31
 #if 1
 #define UNIFORM_LIGHT_PARAMETERS_MASK ((1 << UNIFORM_LIGHT_PARAMETERS) | \
     (1 << UNIFORM_SPECULAR_REFLECTION_COLOR) | (1 << UNIFORM_SPECULAR_EXPONENT))
 #else
 #define UNIFORM_LIGHT_PARAMETERS_MASK ((1 << 9) | (1 << 10) | (1 << 11) | (1 << 12) | (1 << 13))
 #endif
+// Uniforms that are stored in uniform buffers shared by the lighting shaders when uniform
+// buffer objects are used.
+#define UNIFORM_MASK_UNIFORM_BUFFERS ((1 << UNIFORM_AMBIENT_COLOR) | (1 << UNIFORM_VIEWPOINT) | \
+    (1 << UNIFORM_LIGHT_PARAMETERS) | (1 << UNIFORM_SHADOW_MAP_PARAMETERS))
+// Uniforms that are stored in the object uniform buffer by the non-instanced multi-pass
+// lighting shaders when uniform buffer objects are used.
+#define UNIFORM_MASK_OBJECT_UNIFORM_BUFFER ((1 << UNIFORM_MVP) | (1 << UNIFORM_MODEL_MATRIX) | \
+    (1 << UNIFORM_MODEL_ROTATION_MATRIX) | (1 << UNIFORM_DIFFUSE_REFLECTION_COLOR) | \
+    (1 << UNIFORM_USE_MULTI_COLOR) | (1 << UNIFORM_USE_TEXTURE_MAP) | \
+    (1 << UNIFORM_SPECULAR_REFLECTION_COLOR) | (1 << UNIFORM_SPECULAR_EXPONENT) | \
+    (1 << UNIFORM_USE_NORMAL_MAP) | (1 << UNIFORM_USE_SPECULARITY_MAP) | \
+    (1 << UNIFORM_EMISSION_COLOR) | (1 << UNIFORM_USE_EMISSION_MAP) | \
+    (1 << UNIFORM_DIFFUSE_FRACTION) | (1 << UNIFORM_ROUGHNESS) | \
+    (1 << UNIFORM_ROUGHNESS_WEIGHTS) | (1 << UNIFORM_ANISOTROPIC) | \
+    ((unsigned int)1 << UNIFORM_UV_TRANSFORM))
 // The mask defines a set of commonly used uniforms, but does not include all uniforms.
 #define UNIFORM_MASK_COMMON ((1 << UNIFORM_MVP) | (1 << UNIFORM_MODEL_MATRIX ) | \
     (1 << UNIFORM_MODEL_ROTATION_MATRIX) | (1 << UNIFORM_DIFFUSE_REFLECTION_COLOR) | \
@@ -151,7 +186,23 @@ extern bool sre_shader_load_on_demand;
 // the uniform locations. Combining the uniform mask has no great advantage, except for initialization
 // (which can still take advantage of).
 
-#define MAX_MISC_UNIFORMS 22
+#define MAX_MISC_UNIFORMS 32
+
+// Per-instance vertex attributes used by the instanced variants of the multi-pass shaders.
+// The locations follow the regular vertex attributes. The model matrix is specified as
+// three row vectors and the rotation matrix as three column vectors.
+
+#define SRE_INSTANCE_ATTRIBUTE_MODEL_MATRIX 5
+#define SRE_INSTANCE_ATTRIBUTE_ROTATION_MATRIX 8
+#define SRE_INSTANCE_ATTRIBUTE_DIFFUSE_REFLECTION_COLOR 11
+#define SRE_NU_INSTANCE_ATTRIBUTES 7
+
+class sreInstanceData {
+public :
+    float model_matrix[12];
+    float rotation_matrix[9];
+    float diffuse_reflection_color[3];
+};
 
 #define UNIFORM_MISC_MVP 0
 #define UNIFORM_MISC_LIGHT_MODEL_SPACE 1
@@ -175,6 +226,18 @@ extern bool sre_shader_load_on_demand;
 #define UNIFORM_MISC_STRING 19
 #define UNIFORM_MISC_USE_EMISSION_MAP 20
 #define UNIFORM_MISC_SHADOW_MAP_DIMENSIONS 21
+// Only used by the deferred shading shaders.
+#define UNIFORM_MISC_LIGHT_PARAMETERS 22
+#define UNIFORM_MISC_VIEWPOINT 23
+#define UNIFORM_MISC_INVERSE_VIEW_PROJECTION_MATRIX 24
+#define UNIFORM_MISC_GBUFFER_SAMPLERS 25
+#define UNIFORM_MISC_SHADOW_MAP_TRANSFORMATION_MATRIX 26
+#define UNIFORM_MISC_SHADOW_MAP_PARAMETERS 27
+#define UNIFORM_MISC_SHADOW_MAP_SAMPLER 28
+#define UNIFORM_MISC_CUBE_SHADOW_MAP_SAMPLER 29
+// Only used by the layered shadow cube-map shaders.
+#define UNIFORM_MISC_CUBE_FACE_MATRICES 30
+#define UNIFORM_MISC_CUBE_SEGMENT_MASK 31
 
 // The misc shader-specific uniforms are packed in the order they appear in the generic misc
 // uniforms list above. The indices do not correspond, the real uniform indices for each shader
@@ -209,8 +272,11 @@ enum { UNIFORM_HDR_LUMINANCE_HISTORY_TEXTURE_SAMPLER = 0, UNIFORM_HDR_LUMINANCE_
 // Only define misc shaders that can actually be used.
 #ifdef NO_SHADOW_MAP
 #define SRE_NU_MISC_SHADERS_SHADOW_MAP 0
-#else
+#elif defined(OPENGL_ES2)
 #define SRE_NU_MISC_SHADERS_SHADOW_MAP 8
+#else
+// Includes the layered (geometry shader) shadow cube-map shaders.
+#define SRE_NU_MISC_SHADERS_SHADOW_MAP 10
 #endif
 #ifdef NO_HDR
 #define SRE_NU_MISC_SHADERS_HDR 0
@@ -244,6 +310,10 @@ enum {
     SRE_MISC_SHADER_SPOTLIGHT_SHADOW_MAP_TRANSPARENT,
     SRE_MISC_SHADER_CUBE_SHADOW_MAP,
     SRE_MISC_SHADER_CUBE_SHADOW_MAP_TRANSPARENT,
+#ifndef OPENGL_ES2
+    SRE_MISC_SHADER_CUBE_SHADOW_MAP_LAYERED,
+    SRE_MISC_SHADER_CUBE_SHADOW_MAP_LAYERED_TRANSPARENT,
+#endif
 #endif
     SRE_MISC_SHADER_HALO,
     SRE_MISC_SHADER_BILLBOARD,
@@ -258,10 +328,26 @@ enum {
 // shader_loading.cpp
 
 extern sreShader multi_pass_shader[NU_MULTI_PASS_SHADERS];
+// Instanced variants of the multi-pass shaders. Entries for shaders that do not support
+// instancing remain uninitialized.
+extern sreShader multi_pass_shader_instanced[NU_MULTI_PASS_SHADERS];
 extern sreShader single_pass_shader[NU_SINGLE_PASS_SHADERS];
 extern sreShader misc_shader[SRE_NU_MISC_SHADERS];
 extern sreShader HDR_tone_map_shader[SRE_NUMBER_OF_TONE_MAPPING_SHADERS];
-
+// Deferred shading shaders. The light shaders are indexed by
+// SRE_DEFERRED_SHADING_SHADER_LIGHT + light type index * 2 + shadow map flag.
+enum {
+    SRE_DEFERRED_SHADING_SHADER_COMPOSITE = 0,
+    SRE_DEFERRED_SHADING_SHADER_LIGHT
+};
+#define SRE_NU_DEFERRED_SHADING_SHADERS 9
+extern sreShader deferred_shading_shader[SRE_NU_DEFERRED_SHADING_SHADERS];
+
+// Program binary cache (sreSetShaderCachePath()).
+void sreInitializeShaderCache();
+// Log the number of shader programs loaded so far and the time spent.
+void sreReportShaderLoadingStats();
+void sreInitializeAsyncShaderLoading();
 void sreInitializeShaders(int shader_mask);
 void sreValidateShadowVolumeShaders();
 void sreValidateShadowMapShaders();
@@ -297,4 +383,6 @@ bool sreInitializeObjectShaderMultiPassLightingPass(sreObject& so);
 void sreInitializeObjectShaderLightHalo(const sreObject& so);
 void sreInitializeObjectShaderBillboard(const sreObject& so);
 bool sreInitializeObjectShaderMultiPassShadowMapLightingPass(sreObject& so);
+bool sreInitializeObjectShaderMultiPassInstanced(const sreObject& so, int shader);
+bool sreMultiPassInstancedShaderAvailable(int shader);
 
@@ -24,8 +24,12 @@ OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
 #include <math.h>
 #include <malloc.h>
 #include <float.h>
+#include <stdint.h>
+#include <sys/time.h>
 #ifdef OPENGL_ES2
 #include <GLES2/gl2.h>
+#include <GLES2/gl2ext.h>
+#include <EGL/egl.h>
 #endif
 #ifdef OPENGL
 #include <GL/glew.h>
@@ -41,14 +45,23 @@ OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
 // Generic vertex attribute names.
 const char *attribute_str[5] = { "position_in", "texcoord_in", "normal_in", "tangent_in", "color_in" };
 
+// Per-instance attribute names of the instanced multi-pass shaders, starting at
+// SRE_INSTANCE_ATTRIBUTE_MODEL_MATRIX.
+static const char *instance_attribute_str[SRE_NU_INSTANCE_ATTRIBUTES] = {
+    "instance_model_matrix_row0_in", "instance_model_matrix_row1_in",
+    "instance_model_matrix_row2_in", "instance_rotation_matrix_column0_in",
+    "instance_rotation_matrix_column1_in", "instance_rotation_matrix_column2_in",
+    "instance_diffuse_reflection_color_in"
+};
+
 // Multi-pass lighting shader definition.
 
 const char *uniform_str[MAX_UNIFORMS] = {
     "MVP", "model_matrix", "model_rotation_matrix", "diffuse_reflection_color_in",
-    "use_multi_color_in", "use_texture_map_in", "", "ambient_color_in",
+    "use_multi_color_in", "use_texture_map_in", "cluster_light_data_in", "ambient_color_in",
     "viewpoint_in",
 #if 1
-    "light_parameters_in", "shadow_map_parameters_in", "",
+    "light_parameters_in", "shadow_map_parameters_in", "cluster_light_list_in",
 #else
     "light_position_in",
     "light_att_in", "light_color_in",
@@ -60,7 +73,7 @@ const char *uniform_str[MAX_UNIFORMS] = {
     "use_emission_map_in", "emission_map_in", "diffuse_fraction_in", "roughness_in",
     "roughness_weights_in",
     "anisotropic_in", "shadow_map_transformation_matrix", "shadow_map_in", "cube_shadow_map_in",
-    "uv_transform_in", "", ""
+    "uv_transform_in", "view_projection_matrix", "cluster_parameters_in"
     };
 
 class ShaderInfo {
@@ -799,6 +812,18 @@ static ShaderInfo single_pass_shader_info[NU_SINGLE_PASS_SHADERS] = {
     (1 << ATTRIBUTE_POSITION) | (1 << ATTRIBUTE_TEXCOORDS) | (1 << ATTRIBUTE_NORMAL) |
     (1 << ATTRIBUTE_TANGENT) |
     (1 << ATTRIBUTE_COLOR) },
+    { "Complete single pass clustered lighting shader",
+    (UNIFORM_MASK_COMMON & ~(1 << UNIFORM_LIGHT_PARAMETERS)) |
+    (1 << UNIFORM_CLUSTER_LIGHT_DATA_SAMPLER) | (1 << UNIFORM_CLUSTER_LIGHT_LIST_SAMPLER) |
+    ((unsigned int)1 << UNIFORM_CLUSTER_PARAMETERS),
+    (1 << ATTRIBUTE_POSITION) | (1 << ATTRIBUTE_TEXCOORDS) | (1 << ATTRIBUTE_NORMAL) |
+    (1 << ATTRIBUTE_TANGENT) |
+    (1 << ATTRIBUTE_COLOR) },
+    { "Deferred shading G-buffer geometry shader",
+    UNIFORM_MASK_COMMON & ~((1 << UNIFORM_LIGHT_PARAMETERS) | (1 << UNIFORM_VIEWPOINT)),
+    (1 << ATTRIBUTE_POSITION) | (1 << ATTRIBUTE_TEXCOORDS) | (1 << ATTRIBUTE_NORMAL) |
+    (1 << ATTRIBUTE_TANGENT) |
+    (1 << ATTRIBUTE_COLOR) },
 };
 
 const char *single_pass_shader_prologue[NU_SINGLE_PASS_SHADERS] = {
@@ -997,6 +1022,43 @@ const char *single_pass_shader_prologue[NU_SINGLE_PASS_SHADERS] = {
     "#define TEXTURE_MAP_ALPHA\n"
     "#define BEAM_LIGHT\n"
     "#define LINEAR_ATTENUATION_RANGE\n",
+    // SHADER10
+    // Complete single pass shader applying all lights of the fragment's cluster
+    // (clustered lighting). Uses gl3_clustered_lighting.frag.
+    "#define SINGLE_PASS\n"
+    "#define TEXCOORD_IN\n"
+    "#define UV_TRANSFORM\n"
+    "#define NORMAL_IN\n"
+    "#define TANGENT_IN\n"
+    "#define COLOR_IN\n"
+    "#define POSITION_WORLD_VAR\n"
+    "#define NORMAL_VAR\n"
+    "#define TBN_MATRIX_VAR\n"
+    "#define TEXCOORD_VAR\n"
+    "#define MULTI_COLOR_OPTION\n"
+    "#define TEXTURE_MAP_OPTION\n"
+    "#define NORMAL_MAP_OPTION\n"
+    "#define SPECULARITY_MAP_OPTION\n"
+    "#define VIEWPOINT_IN\n"
+    "#define EMISSION_MAP_OPTION\n",
+    // SHADER11
+    // Deferred shading geometry shader writing the surface attributes to the G-buffer.
+    // Uses gl3_deferred_geometry.frag.
+    "#define SINGLE_PASS\n"
+    "#define TEXCOORD_IN\n"
+    "#define UV_TRANSFORM\n"
+    "#define NORMAL_IN\n"
+    "#define TANGENT_IN\n"
+    "#define COLOR_IN\n"
+    "#define POSITION_WORLD_VAR\n"
+    "#define NORMAL_VAR\n"
+    "#define TBN_MATRIX_VAR\n"
+    "#define TEXCOORD_VAR\n"
+    "#define MULTI_COLOR_OPTION\n"
+    "#define TEXTURE_MAP_OPTION\n"
+    "#define NORMAL_MAP_OPTION\n"
+    "#define SPECULARITY_MAP_OPTION\n"
+    "#define EMISSION_MAP_OPTION\n",
 };
 
 static char *newstrcat(const char *s1, const char *s2) {
@@ -1202,6 +1264,8 @@ static char* filetobuf(const char *file) {
 
 sreShader::sreShader() {
     status = SRE_SHADER_STATUS_UNINITIALIZED;
+    gfilename = NULL;
+    load_state = NULL;
 }
 
 #define SHADER_DIRECTORY_DEFAULT_PATH 0
@@ -1217,7 +1281,7 @@ static int shader_directory_table[] = {
 };
 
 void sreShader::Initialize(const char *_name, int _type, int _uniform_mask, int _attribute_mask,
-const char * _vfilename, const char *_ffilename, const char *_prologue) {
+const char * _vfilename, const char *_ffilename, const char *_prologue, const char *_gfilename) {
     if (status != SRE_SHADER_STATUS_UNINITIALIZED) {
         sreFatalError("Error (sreShader::Initialize()) -- shader not uninitialized.\n");
         exit(1);
@@ -1228,6 +1292,7 @@ const char * _vfilename, const char *_ffilename, const char *_prologue) {
     attribute_mask = _attribute_mask;
     vfilename = _vfilename;
     ffilename = _ffilename;
+    gfilename = _gfilename;
     prologue = _prologue;
     status = SRE_SHADER_STATUS_INITIALIZED;
     // Demand loading only enabled for lighting shaders for now.
@@ -1245,6 +1310,7 @@ const char *pr_str) {
     }
     vfilename = vertex_shader_filename;
     ffilename = fragment_shader_filename;
+    gfilename = NULL;
     prologue = pr_str;
     status = SRE_SHADER_STATUS_INITIALIZED;
     // Demand loading only enabled for lighting shaders for now.
@@ -1254,20 +1320,281 @@ const char *pr_str) {
         Load();
 }
 
-void sreShader::Load() {
-    if (status == SRE_SHADER_STATUS_UNINITIALIZED) {
-        sreFatalError(
-            "Error -- sreShader::Initialize() should be called before LoadShader().\n");
+#ifdef OPENGL
+
+// Find the source of a single shader file (used for geometry shaders), using the same
+// search order as for vertex and fragment shaders. *builtin is set when the returned
+// source belongs to the built-in shader table and must not be freed.
+
+static char *FindShaderSource(const char *filename, bool *builtin) {
+    for (int sdir = 0; shader_directory_table[sdir] != SHADER_DIRECTORY_END_MARKER; sdir++) {
+#ifdef SHADERS_BUILTIN
+        if (shader_directory_table[sdir] == SHADER_DIRECTORY_BUILTIN) {
+            for (int i = 0; i < sre_nu_builtin_shader_sources; i++)
+                if (strcmp(sre_builtin_shader_table[i].shader_filename, filename) == 0) {
+                    *builtin = true;
+                    return (char *)sre_builtin_shader_table[i].shader_source;
+                }
+        }
+#endif
+        if (shader_directory_table[sdir] == SHADER_DIRECTORY_DEFAULT_PATH) {
+            char *path = new char[strlen(sre_internal_shader_path) + strlen(filename) + 1];
+            strcpy(path, sre_internal_shader_path);
+            strcat(path, filename);
+            char *source = filetobuf(path);
+            delete [] path;
+            if (source != NULL) {
+                *builtin = false;
+                return source;
+            }
+        }
     }
+    sreFatalError("Error - shader file not found (%s).\n", filename);
+    return NULL;
+}
 
-    GLuint v = glCreateShader(GL_VERTEX_SHADER);
-    if (v == 0) {
-        sreFatalError("Error allocating vertex shader %s\n", name);
+#endif
+
+// On-disk cache of linked shader program binaries. A program is stored in a file named
+// after a 64-bit hash of its complete shader sources (including the prologue), its
+// attribute bindings and the OpenGL vendor, renderer and version strings, so that a
+// driver update invalidates the cache. When the cache misses or the driver rejects a
+// cached binary, the program is compiled from source and the cache file is (re)written.
+
+#ifdef OPENGL_ES2
+// With OpenGL-ES 2.0, the functions of the GL_OES_get_program_binary extension are
+// obtained at run-time.
+static PFNGLGETPROGRAMBINARYOESPROC glGetProgramBinaryOES_function = NULL;
+static PFNGLPROGRAMBINARYOESPROC glProgramBinaryOES_function = NULL;
+#define glGetProgramBinary glGetProgramBinaryOES_function
+#define glProgramBinary glProgramBinaryOES_function
+#define GL_PROGRAM_BINARY_LENGTH GL_PROGRAM_BINARY_LENGTH_OES
+#define GL_NUM_PROGRAM_BINARY_FORMATS GL_NUM_PROGRAM_BINARY_FORMATS_OES
+#endif
+
+#ifndef GL_COMPLETION_STATUS_KHR
+#define GL_COMPLETION_STATUS_KHR 0x91B1
+#endif
+
+#define SHADER_CACHE_FILE_MAGIC 0x42455253  // "SREB"
+
+class sreShaderCacheFileHeader {
+public :
+    uint32_t magic;
+    uint32_t binary_format;
+    uint32_t binary_length;
+    uint32_t reserved;
+    uint64_t hash;
+};
+
+// Compilation state of a shader for which loading has been started but not finished.
+
+class sreShaderLoadState {
+public :
+    GLuint v, f, g;
+    // The complete shader sources, for error reporting.
+    char *vertex_source;
+    char *fragment_source;
+    char *geometry_source;
+    uint64_t hash;
+    // The frame in which loading was started.
+    int frame;
+};
+
+// Whether the completion status of a program can be queried without blocking.
+static bool parallel_shader_compile = false;
+static bool shader_cache_enabled = false;
+static uint64_t shader_cache_driver_hash;
+// Statistics reported by sreReportShaderLoadingStats().
+static int shader_programs_loaded = 0;
+static int shader_cache_hits = 0;
+static double shader_loading_time = 0;
+
+static double GetShaderLoadingTime() {
+    struct timeval tv;
+    gettimeofday(&tv, NULL);
+    return (double)tv.tv_sec + (double)tv.tv_usec / 1000000;
+}
+
+// 64-bit FNV-1a hash. The terminating zero is included so that different splits of the
+// same concatenated text hash differently.
+
+static uint64_t HashString(uint64_t h, const char *s) {
+    for (;; s++) {
+        h ^= (unsigned char)*s;
+        h *= 1099511628211ULL;
+        if (*s == '\0')
+            break;
     }
-    GLuint f = glCreateShader(GL_FRAGMENT_SHADER);	
-    if (f == 0) {
-        sreFatalError("Error allocating fragment shader %s\n", name);
+    return h;
+}
+
+void sreInitializeShaderCache() {
+    if (sre_internal_shader_cache_path == NULL)
+        return;
+#ifdef OPENGL_ES2
+    const char *extensions_str = (const char *)glGetString(GL_EXTENSIONS);
+    if (strstr(extensions_str, "GL_OES_get_program_binary") != NULL) {
+        glGetProgramBinaryOES_function = (PFNGLGETPROGRAMBINARYOESPROC)
+            eglGetProcAddress("glGetProgramBinaryOES");
+        glProgramBinaryOES_function = (PFNGLPROGRAMBINARYOESPROC)
+            eglGetProcAddress("glProgramBinaryOES");
+    }
+    if (glGetProgramBinaryOES_function == NULL || glProgramBinaryOES_function == NULL) {
+        sreMessage(SRE_MESSAGE_INFO,
+            "Shader program binary cache not available (requires GL_OES_get_program_binary).");
+        return;
+    }
+#else
+    if (!GLEW_VERSION_4_1 && !GLEW_ARB_get_program_binary) {
+        sreMessage(SRE_MESSAGE_INFO,
+            "Shader program binary cache not available (requires GL_ARB_get_program_binary).");
+        return;
+    }
+#endif
+    // Some drivers advertise the extension without supporting any binary format.
+    GLint nu_formats = 0;
+    glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &nu_formats);
+    if (nu_formats == 0) {
+        sreMessage(SRE_MESSAGE_INFO,
+            "Shader program binary cache not available (no program binary formats).");
+        return;
+    }
+    uint64_t h = 14695981039346656037ULL;
+    h = HashString(h, (const char *)glGetString(GL_VENDOR));
+    h = HashString(h, (const char *)glGetString(GL_RENDERER));
+    h = HashString(h, (const char *)glGetString(GL_VERSION));
+    shader_cache_driver_hash = h;
+    shader_cache_enabled = true;
+    sreMessage(SRE_MESSAGE_INFO, "Shader program binary cache enabled (%s).",
+        sre_internal_shader_cache_path);
+}
+
+#ifdef OPENGL_ES2
+typedef void (GL_APIENTRYP PFNGLMAXSHADERCOMPILERTHREADSKHRPROC_SRE)(GLuint count);
+#endif
+
+// Check for GL_KHR_parallel_shader_compile (or the equivalent ARB extension), which
+// allows the completion status of programs being compiled to be polled, and let the
+// driver use as many compiler threads as it wants.
+
+void sreInitializeAsyncShaderLoading() {
+#ifdef OPENGL_ES2
+    const char *extensions_str = (const char *)glGetString(GL_EXTENSIONS);
+    if (strstr(extensions_str, "GL_KHR_parallel_shader_compile") != NULL) {
+        PFNGLMAXSHADERCOMPILERTHREADSKHRPROC_SRE glMaxShaderCompilerThreadsKHR_function =
+            (PFNGLMAXSHADERCOMPILERTHREADSKHRPROC_SRE)
+            eglGetProcAddress("glMaxShaderCompilerThreadsKHR");
+        if (glMaxShaderCompilerThreadsKHR_function != NULL) {
+            glMaxShaderCompilerThreadsKHR_function(0xFFFFFFFF);
+            parallel_shader_compile = true;
+        }
+    }
+#else
+    if (GLEW_KHR_parallel_shader_compile) {
+        glMaxShaderCompilerThreadsKHR(0xFFFFFFFF);
+        parallel_shader_compile = true;
     }
+    else if (GLEW_ARB_parallel_shader_compile) {
+        glMaxShaderCompilerThreadsARB(0xFFFFFFFF);
+        parallel_shader_compile = true;
+    }
+#endif
+    if (!sre_internal_async_shader_loading)
+        return;
+    if (parallel_shader_compile)
+        sreMessage(SRE_MESSAGE_INFO,
+            "Asynchronous shader loading enabled (parallel shader compilation).");
+    else
+        sreMessage(SRE_MESSAGE_INFO,
+            "Asynchronous shader loading enabled (parallel shader compilation not available, "
+            "programs are checked in the next frame).");
+}
+
+static char *ShaderCacheFilename(uint64_t hash) {
+    char *filename = new char[strlen(sre_internal_shader_cache_path) + 32];
+    sprintf(filename, "%s%016llx.bin", sre_internal_shader_cache_path,
+        (unsigned long long)hash);
+    return filename;
+}
+
+// Try to load a program binary from the cache into program. Returns true when the
+// binary was accepted by the driver.
+
+static bool LoadProgramBinaryFromCache(GLuint program, uint64_t hash) {
+    char *filename = ShaderCacheFilename(hash);
+    FILE *fp = fopen(filename, "rb");
+    delete [] filename;
+    if (fp == NULL)
+        return false;
+    sreShaderCacheFileHeader header;
+    bool success = false;
+    if (fread(&header, sizeof(header), 1, fp) == 1 && header.magic == SHADER_CACHE_FILE_MAGIC
+    && header.hash == hash && header.binary_length > 0) {
+        char *binary = new char[header.binary_length];
+        if (fread(binary, header.binary_length, 1, fp) == 1) {
+            glProgramBinary(program, header.binary_format, binary, header.binary_length);
+            GLint params;
+            glGetProgramiv(program, GL_LINK_STATUS, &params);
+            success = (params == GL_TRUE);
+        }
+        delete [] binary;
+    }
+    fclose(fp);
+    // Clear the error flag if the driver rejected the binary format.
+    if (!success)
+        glGetError();
+    return success;
+}
+
+static void SaveProgramBinaryToCache(GLuint program, uint64_t hash) {
+    GLint length = 0;
+    glGetProgramiv(program, GL_PROGRAM_BINARY_LENGTH, &length);
+    if (length <= 0)
+        return;
+    sreShaderCacheFileHeader header;
+    header.magic = SHADER_CACHE_FILE_MAGIC;
+    header.reserved = 0;
+    header.hash = hash;
+    char *binary = new char[length];
+    GLsizei actual_length = 0;
+    GLenum binary_format;
+    glGetProgramBinary(program, length, &actual_length, &binary_format, binary);
+    header.binary_format = binary_format;
+    header.binary_length = actual_length;
+    char *filename = ShaderCacheFilename(hash);
+    FILE *fp = fopen(filename, "wb");
+    if (fp == NULL)
+        sreMessage(SRE_MESSAGE_WARNING, "Could not write shader cache file %s.", filename);
+    else {
+        if (actual_length == 0 || fwrite(&header, sizeof(header), 1, fp) != 1 ||
+        fwrite(binary, actual_length, 1, fp) != 1)
+            sreMessage(SRE_MESSAGE_WARNING, "Error writing shader cache file %s.", filename);
+        fclose(fp);
+    }
+    delete [] filename;
+    delete [] binary;
+}
+
+void sreReportShaderLoadingStats() {
+    if (shader_programs_loaded == 0)
+        return;
+    sreMessage(SRE_MESSAGE_INFO,
+        "%d shader programs loaded in %.3lf s (%d from program binary cache).",
+        shader_programs_loaded, shader_loading_time, shader_cache_hits);
+}
+
+// Start loading the shader. The shader sources are submitted for compilation and the
+// program is linked, but the link status is not queried, so that the driver may compile
+// in the background; FinishLoad() completes the process. When the program binary cache
+// provides the program, the shader is loaded immediately.
+
+void sreShader::BeginLoad() {
+    if (status == SRE_SHADER_STATUS_UNINITIALIZED) {
+        sreFatalError(
+            "Error -- sreShader::Initialize() should be called before LoadShader().\n");
+    }
+    double start_time = GetShaderLoadingTime();
 
     bool builtin = false;
     char *vertexsource = NULL;
@@ -1339,6 +1666,22 @@ void sreShader::Load() {
     prologue_with_version = strdup(prologue);
 #endif
 
+    // Optional geometry shader, which shares the prologue.
+    char *geometry_source_str[1];
+    geometry_source_str[0] = NULL;
+#ifdef OPENGL
+    if (gfilename != NULL) {
+        bool geometry_builtin;
+        char *geometrysource = FindShaderSource(gfilename, &geometry_builtin);
+        geometry_source_str[0] = new char[strlen(prologue_with_version)
+            + strlen(geometrysource) + 1];
+        strcpy(geometry_source_str[0], prologue_with_version);
+        strcat(geometry_source_str[0], geometrysource);
+        if (!geometry_builtin)
+            delete [] geometrysource;
+    }
+#endif
+
     char *vertex_source_str[1];
     vertex_source_str[0] = new char[strlen(prologue_with_version)
         + strlen(vertexsource) + 1];
@@ -1359,43 +1702,142 @@ void sreShader::Load() {
     free(prologue_with_version);
 #endif
 
-    glShaderSource(v, 1, (const char **)&vertex_source_str[0], NULL);
-    glShaderSource(f, 1, (const char **)&fragment_source_str[0], NULL);
-    glCompileShader(v);
-    glCompileShader(f);
-
     program = glCreateProgram();
-    if (f == 0) {
+    if (program == 0) {
         sreFatalError("Error creating shader program.\n");
     }
 
-//    glUseProgram(0);
+    // The cache key covers everything that determines the linked program.
+    uint64_t hash = 0;
+    if (shader_cache_enabled) {
+        char binding_str[32];
+        sprintf(binding_str, "%d %d", attribute_mask,
+            (type & SRE_SHADER_MASK_LIGHTING_MULTI_PASS) != 0);
+        hash = HashString(shader_cache_driver_hash, binding_str);
+        hash = HashString(hash, vertex_source_str[0]);
+        hash = HashString(hash, fragment_source_str[0]);
+#ifdef OPENGL
+        if (gfilename != NULL)
+            hash = HashString(hash, geometry_source_str[0]);
+#endif
+        if (LoadProgramBinaryFromCache(program, hash)) {
+            shader_cache_hits++;
+            delete [] vertex_source_str[0];
+            delete [] fragment_source_str[0];
+            delete [] geometry_source_str[0];
+            shader_loading_time += GetShaderLoadingTime() - start_time;
+            CompleteLoad();
+            return;
+        }
+    }
+
+    load_state = new sreShaderLoadState;
+    load_state->vertex_source = vertex_source_str[0];
+    load_state->fragment_source = fragment_source_str[0];
+    load_state->geometry_source = geometry_source_str[0];
+    load_state->hash = hash;
+    load_state->frame = sre_internal_current_frame;
+
+    GLuint v = glCreateShader(GL_VERTEX_SHADER);
+    if (v == 0) {
+        sreFatalError("Error allocating vertex shader %s\n", name);
+    }
+    GLuint f = glCreateShader(GL_FRAGMENT_SHADER);	
+    if (f == 0) {
+        sreFatalError("Error allocating fragment shader %s\n", name);
+    }
+    load_state->v = v;
+    load_state->f = f;
+    load_state->g = 0;
+#ifdef OPENGL
+    if (gfilename != NULL) {
+        GLuint g = glCreateShader(GL_GEOMETRY_SHADER);
+        if (g == 0) {
+            sreFatalError("Error allocating geometry shader %s\n", name);
+        }
+        glShaderSource(g, 1, (const char **)&geometry_source_str[0], NULL);
+        glCompileShader(g);
+        load_state->g = g;
+    }
+#endif
+
+    glShaderSource(v, 1, (const char **)&vertex_source_str[0], NULL);
+    glShaderSource(f, 1, (const char **)&fragment_source_str[0], NULL);
+    glCompileShader(v);
+    glCompileShader(f);
 
     glAttachShader(program, v);
     glAttachShader(program ,f);
+#ifdef OPENGL
+    if (gfilename != NULL)
+        glAttachShader(program, load_state->g);
+    if (shader_cache_enabled)
+        glProgramParameteri(program, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
+#endif
 
     BindAttributes();
 
     glLinkProgram(program);
+    status = SRE_SHADER_STATUS_LOADING;
+    shader_loading_time += GetShaderLoadingTime() - start_time;
+}
+
+// Finish loading a shader for which BeginLoad() has been called. When wait is false and
+// the driver is still compiling the program, false is returned without blocking. Without
+// GL_KHR_parallel_shader_compile the completion status cannot be queried, and the
+// program is assumed to be ready one frame after it was submitted.
+
+bool sreShader::FinishLoad(bool wait) {
+    if (!wait) {
+        if (parallel_shader_compile) {
+            GLint completed;
+            glGetProgramiv(program, GL_COMPLETION_STATUS_KHR, &completed);
+            if (!completed)
+                return false;
+        }
+        else if (load_state->frame == sre_internal_current_frame)
+            return false;
+    }
+    double start_time = GetShaderLoadingTime();
     GLint params;
     glGetProgramiv(program, GL_LINK_STATUS, &params);
     if (params == GL_FALSE) {
         sreMessage(SRE_MESSAGE_ERROR,
             "Shader program link unsuccesful (%s, %s).\n",  vfilename, ffilename);
-	sreMessage(SRE_MESSAGE_ERROR, "Vertex shader code:\n%s", vertex_source_str[0]);
-	sreMessage(SRE_MESSAGE_ERROR, "Fragment shader code:\n%s", fragment_source_str[0]);
+        sreMessage(SRE_MESSAGE_ERROR, "Vertex shader code:\n%s", load_state->vertex_source);
+        sreMessage(SRE_MESSAGE_ERROR, "Fragment shader code:\n%s", load_state->fragment_source);
         sreMessage(SRE_MESSAGE_ERROR, "Vertex shader log:");
-        printShaderInfoLog(v);
+        printShaderInfoLog(load_state->v);
         sreMessage(SRE_MESSAGE_ERROR, "Fragment shader log:\n");
-        printShaderInfoLog(f);
+        printShaderInfoLog(load_state->f);
+#ifdef OPENGL
+        if (gfilename != NULL) {
+            sreMessage(SRE_MESSAGE_ERROR, "Geometry shader code:\n%s",
+                load_state->geometry_source);
+            sreMessage(SRE_MESSAGE_ERROR, "Geometry shader log:\n");
+            printShaderInfoLog(load_state->g);
+        }
+#endif
         sreMessage(SRE_MESSAGE_ERROR, "Shader program log:\n");
         printProgramInfoLog(program);
         sreFatalError("Loading of shader failed:\n%s", name);
     }
+    if (shader_cache_enabled)
+        SaveProgramBinaryToCache(program, load_state->hash);
+
+    delete [] load_state->vertex_source;
+    delete [] load_state->fragment_source;
+    delete [] load_state->geometry_source;
+    delete load_state;
+    load_state = NULL;
+    shader_loading_time += GetShaderLoadingTime() - start_time;
+
+    CompleteLoad();
+    return true;
+}
 
-    delete [] vertex_source_str[0];
-    delete [] fragment_source_str[0];
-
+void sreShader::CompleteLoad() {
+    double start_time = GetShaderLoadingTime();
     // Also bind uniform locations.
     if (type & (SRE_SHADER_MASK_LIGHTING_SINGLE_PASS | SRE_SHADER_MASK_LIGHTING_MULTI_PASS))
         InitializeUniformLocationsLightingShader();
@@ -1405,6 +1847,34 @@ void sreShader::Load() {
     status = SRE_SHADER_STATUS_LOADED;
 
     SetDefaultUniformValues();
+
+    shader_programs_loaded++;
+    shader_loading_time += GetShaderLoadingTime() - start_time;
+}
+
+// Load the shader, waiting for compilation to finish.
+
+void sreShader::Load() {
+    if (status != SRE_SHADER_STATUS_LOADING)
+        BeginLoad();
+    if (status == SRE_SHADER_STATUS_LOADING)
+        FinishLoad(true);
+}
+
+// Load the shader without blocking when asynchronous shader loading is enabled. Returns
+// true when the shader has been loaded (during this call), false when it is still being
+// compiled. Without asynchronous loading, the shader is loaded immediately.
+
+bool sreShader::LoadNonBlocking() {
+    if (!sre_internal_async_shader_loading) {
+        Load();
+        return true;
+    }
+    if (status == SRE_SHADER_STATUS_INITIALIZED)
+        BeginLoad();
+    if (status == SRE_SHADER_STATUS_LOADING)
+        return FinishLoad(false);
+    return true;
 }
 
 void sreShader::BindAttributes() {
@@ -1418,6 +1888,12 @@ void sreShader::BindAttributes() {
             exit(1);
         }
     }
+    // Bind the per-instance attributes of multi-pass lighting shaders. The attributes are
+    // only present in the instanced variants; binding an unused name has no effect.
+    if (type & SRE_SHADER_MASK_LIGHTING_MULTI_PASS)
+        for (int i = 0; i < SRE_NU_INSTANCE_ATTRIBUTES; i++)
+            glBindAttribLocation(program, SRE_INSTANCE_ATTRIBUTE_MODEL_MATRIX + i,
+                instance_attribute_str[i]);
     if (glGetError() != GL_NO_ERROR) {
         sreFatalError("OpenGL error occurred after BindAttribs.\n");
         exit(1);
@@ -1425,6 +1901,26 @@ void sreShader::BindAttributes() {
 }
 
 void sreShader::InitializeUniformLocationsLightingShader() {
+#ifndef OPENGL_ES2
+    if (sre_internal_uniform_buffers) {
+        // The frame and light parameters are members of uniform blocks, which are bound
+        // to fixed binding points. Blocks that are not used by the shader are inactive.
+        uniform_mask &= ~UNIFORM_MASK_UNIFORM_BUFFERS;
+        GLuint index = glGetUniformBlockIndex(program, "frame_data");
+        if (index != GL_INVALID_INDEX)
+            glUniformBlockBinding(program, index, SRE_FRAME_UNIFORM_BUFFER_BINDING);
+        index = glGetUniformBlockIndex(program, "light_data");
+        if (index != GL_INVALID_INDEX)
+            glUniformBlockBinding(program, index, SRE_LIGHT_UNIFORM_BUFFER_BINDING);
+        // The std140 object block is always active when it is declared (non-instanced
+        // multi-pass shaders); the object parameters are then no longer plain uniforms.
+        index = glGetUniformBlockIndex(program, "object_data");
+        if (index != GL_INVALID_INDEX) {
+            uniform_mask &= ~UNIFORM_MASK_OBJECT_UNIFORM_BUFFER;
+            glUniformBlockBinding(program, index, SRE_OBJECT_UNIFORM_BUFFER_BINDING);
+        }
+    }
+#endif
     for (int j = 0; j < MAX_UNIFORMS; j++)
         if (uniform_mask & (1 << j)) {
             uniform_location[j] = glGetUniformLocation(program, uniform_str[j]);
@@ -1433,6 +1929,10 @@ void sreShader::InitializeUniformLocationsLightingShader() {
                 exit(1);
             }
         }
+        else
+            // Setting a uniform at location - 1 is silently ignored, which allows the
+            // instanced shader variants to share the uniform setup code.
+            uniform_location[j] = - 1;
 }
 
 // Initialization of uniforms that only need to be initialized once.
@@ -1467,7 +1967,10 @@ static const char *uniform_misc_str[MAX_MISC_UNIFORMS] = {
     "model_matrix", "segment_distance_scaling_in", "average_lum_in", "slot_in",
     "key_value_in", "array_in", "rectangle_in", "uv_transform_in", "mult_color_in",
     "add_color_in", "screen_size_in_chars_in", "string_in", "use_emission_map_in",
-    "shadow_map_dimensions_in"
+    "shadow_map_dimensions_in", "light_parameters_in", "viewpoint_in",
+    "inverse_view_projection_matrix", "gbuffer_in", "shadow_map_transformation_matrix",
+    "shadow_map_parameters_in", "shadow_map_in", "cube_shadow_map_in",
+    "cube_face_matrix_in", "cube_segment_mask_in"
 };
 
 class MiscShaderInfo {
@@ -1479,6 +1982,8 @@ public :
     const char *vsource;
     const char *fsource;
     const char *prologue;
+    // Optional geometry shader; omitted (NULL) for most shaders.
+    const char *gsource;
 };
 
 static const MiscShaderInfo misc_shader_info[] = {
@@ -1678,6 +2183,43 @@ static const MiscShaderInfo misc_shader_info[] = {
     "#define CUBE_MAP_STORES_DISTANCE\n"
 #endif
     },
+#ifndef OPENGL_ES2
+    // Layered shadow cube-map shaders. The vertex shader outputs world space positions and
+    // the geometry shader routes each triangle to the cube map faces selected by the
+    // segment mask, so that every object only has to be submitted once.
+    {
+    "Shadow cube-map shader (layered)",
+    SRE_SHADER_MASK_CUBE_SHADOW_MAP,
+    (1 << UNIFORM_MISC_MODEL_MATRIX) | (1 << UNIFORM_MISC_CUBE_FACE_MATRICES) |
+    (1 << UNIFORM_MISC_CUBE_SEGMENT_MASK)
+#ifdef CUBE_MAP_STORES_DISTANCE
+    | (1 << UNIFORM_MISC_LIGHT_POSITION) | (1 << UNIFORM_MISC_SEGMENT_DISTANCE_SCALING)
+#endif
+    , (1 << ATTRIBUTE_POSITION),
+     "gl3_shadow_map.vert", "gl3_shadow_map.frag", "#define CUBE_MAP\n#define CUBE_MAP_LAYERED\n"
+#ifdef CUBE_MAP_STORES_DISTANCE
+    "#define CUBE_MAP_STORES_DISTANCE\n"
+#endif
+    , "gl3_shadow_map.geom"
+    },
+    {
+    "Shadow cube-map shader for transparent textures (layered)",
+    SRE_SHADER_MASK_CUBE_SHADOW_MAP,
+    (1 << UNIFORM_MISC_MODEL_MATRIX) | (1 << UNIFORM_MISC_CUBE_FACE_MATRICES) |
+    (1 << UNIFORM_MISC_CUBE_SEGMENT_MASK) | (1 << UNIFORM_MISC_TEXTURE_SAMPLER) |
+    (1 << UNIFORM_MISC_UV_TRANSFORM)
+#ifdef CUBE_MAP_STORES_DISTANCE
+    | (1 << UNIFORM_MISC_LIGHT_POSITION) | (1 << UNIFORM_MISC_SEGMENT_DISTANCE_SCALING)
+#endif
+    , (1 << ATTRIBUTE_POSITION) | (1 << ATTRIBUTE_TEXCOORDS),
+     "gl3_shadow_map.vert", "gl3_shadow_map.frag",
+     "#define CUBE_MAP\n#define CUBE_MAP_LAYERED\n#define TEXTURE_ALPHA\n#define UV_TRANSFORM\n"
+#ifdef CUBE_MAP_STORES_DISTANCE
+    "#define CUBE_MAP_STORES_DISTANCE\n"
+#endif
+    , "gl3_shadow_map.geom"
+    },
+#endif
 #endif
     {
     "Halo shader (single and particle system)",
@@ -1756,21 +2298,37 @@ void sreShader::InitializeUniformLocationsMiscShader() {
 // Actual shader initialization.
 
 sreShader multi_pass_shader[NU_MULTI_PASS_SHADERS];
+sreShader multi_pass_shader_instanced[NU_MULTI_PASS_SHADERS];
 sreShader single_pass_shader[NU_SINGLE_PASS_SHADERS];
 sreShader misc_shader[SRE_NU_MISC_SHADERS];
 sreShader HDR_tone_map_shader[SRE_NUMBER_OF_TONE_MAPPING_SHADERS];
+sreShader deferred_shading_shader[SRE_NU_DEFERRED_SHADING_SHADERS];
+
+static void sreInitializeMiscShader(int i) {
+    misc_shader[i].Initialize(
+        misc_shader_info[i].name,
+        misc_shader_info[i].type,
+        misc_shader_info[i].uniform_mask,
+        misc_shader_info[i].attribute_mask,
+        misc_shader_info[i].vsource,
+        misc_shader_info[i].fsource,
+        misc_shader_info[i].prologue,
+        misc_shader_info[i].gsource);
+}
 
 static void sreInitializeMiscShaders(int mask) {
-    for (int i = 0; i < SRE_NU_MISC_SHADERS; i++)
-        if (misc_shader_info[i].type & mask)
-            misc_shader[i].Initialize(
-                misc_shader_info[i].name,
-                misc_shader_info[i].type,
-                misc_shader_info[i].uniform_mask,
-                misc_shader_info[i].attribute_mask,
-                misc_shader_info[i].vsource,
-                misc_shader_info[i].fsource,
-                misc_shader_info[i].prologue);
+    for (int i = 0; i < SRE_NU_MISC_SHADERS; i++) {
+        if (!(misc_shader_info[i].type & mask))
+            continue;
+#ifndef OPENGL_ES2
+        // The layered cube shadow map shaders are only initialized (and loaded) when
+        // layered cube shadow maps are enabled (see sreValidateCubeShadowMapShaders()).
+        if (i >= SRE_MISC_SHADER_CUBE_SHADOW_MAP_LAYERED &&
+        i <= SRE_MISC_SHADER_CUBE_SHADOW_MAP_LAYERED_TRANSPARENT)
+            continue;
+#endif
+        sreInitializeMiscShader(i);
+    }
 }
 
 static void sreInitializeTextShader() {
@@ -1879,14 +2437,37 @@ static const char *shadow_map_parameter_definitions =
     "#define NU_SHADOW_MAP_PARAMETERS_DIRECTIONAL_BEAM_LIGHT 4\n"
     "#define NU_SHADOW_MAP_PARAMETERS_SPOT_LIGHT 2\n"
     "#define NU_SHADOW_MAP_PARAMETERS_POINT_LIGHT 4\n"
-    "#define NU_SHADOW_MAP_PARAMETERS_MAX 4\n"
+    "#define NU_SHADOW_MAP_PARAMETERS_MAX 7\n"
+    "#define NU_SHADOW_MAP_PARAMETERS_CASCADES 29\n"
+    "#define NU_SHADOW_MAP_PARAMETERS_ATLAS 7\n"
     "#define SHADOW_MAP_SIZE 0\n"
     "#define SHADOW_MAP_DEPTH_PRECISION 1\n"
     "#define SHADOW_MAP_DIMENSIONS_X 2\n"
     "#define SHADOW_MAP_DIMENSIONS_Z 3\n"
     "#define SHADOW_MAP_F_N_COEFFICIENT_1 2\n"
     "#define SHADOW_MAP_F_N_COEFFICIENT_2 3\n"
-    "#define SHADOW_MAP_SEGMENT_DISTANCE_SCALING 2\n";
+    "#define SHADOW_MAP_SEGMENT_DISTANCE_SCALING 2\n"
+    "#define SHADOW_MAP_NU_CASCADES 4\n"
+    "#define SHADOW_MAP_CASCADE_TRANSFORM 5\n"
+    "#define SHADOW_MAP_ATLAS_TILE_SCALE 4\n"
+    "#define SHADOW_MAP_ATLAS_TILE_OFFSET_X 5\n"
+    "#define SHADOW_MAP_ATLAS_TILE_OFFSET_Y 6\n";
+
+static void AddClusterParameterDefinitions(char *&prologue) {
+    char cluster_parameter_definitions[256];
+    sprintf(cluster_parameter_definitions,
+        "#define CLUSTER_GRID_X %d\n"
+        "#define CLUSTER_GRID_Y %d\n"
+        "#define CLUSTER_GRID_Z %d\n"
+        "#define NU_CLUSTER_PARAMETERS 5\n"
+        "#define CLUSTER_TILE_SCALE_X 0\n"
+        "#define CLUSTER_TILE_SCALE_Y 1\n"
+        "#define CLUSTER_DEPTH_SLICE_SCALE 2\n"
+        "#define CLUSTER_DEPTH_SLICE_BIAS 3\n"
+        "#define CLUSTER_NU_DIRECTIONAL_LIGHTS 4\n",
+        SRE_CLUSTER_GRID_X, SRE_CLUSTER_GRID_Y, SRE_CLUSTER_GRID_Z);
+    AddPrologueDefinition(cluster_parameter_definitions, prologue);
+}
 
 static void AddLightParameterDefinitions(char *&prologue) {
     AddPrologueDefinition(light_parameter_definitions, prologue);
@@ -1896,6 +2477,66 @@ static void AddShadowMapParameterDefinitions(char *&prologue) {
     AddPrologueDefinition(shadow_map_parameter_definitions, prologue);
 }
 
+#ifndef OPENGL_ES2
+
+// Uniform blocks shared by all lighting shaders when uniform buffer objects are used. The
+// std140 layout must match the buffer contents written in shader_uniform.cpp. The light
+// and shadow map parameter definitions must precede these definitions in the prologue.
+
+static const char *uniform_buffer_definitions =
+    "#define UNIFORM_BUFFERS\n"
+    "layout(std140) uniform frame_data {\n"
+    "    vec3 viewpoint_in;\n"
+    "    vec3 ambient_color_in;\n"
+    "};\n"
+    "layout(std140) uniform light_data {\n"
+    "    float light_parameters_in[NU_LIGHT_PARAMETERS_MAX];\n"
+    "    float shadow_map_parameters_in[NU_SHADOW_MAP_PARAMETERS_CASCADES];\n"
+    "};\n";
+
+// Uniform block with the parameters of the object being drawn, used by the non-instanced
+// multi-pass lighting shaders. The std140 layout must match sreObjectUniformData in
+// shader_uniform.cpp. The model matrix is stored in row-major order like
+// sreObject::model_matrix.
+
+static const char *object_uniform_buffer_definitions =
+    "#define OBJECT_UNIFORM_BUFFER\n"
+    "layout(std140) uniform object_data {\n"
+    "    mat4 MVP;\n"
+    "    layout(row_major) mat4x3 model_matrix;\n"
+    "    mat3 model_rotation_matrix;\n"
+    "    mat3 uv_transform_in;\n"
+    "    vec3 diffuse_reflection_color_in;\n"
+    "    float specular_exponent_in;\n"
+    "    vec3 specular_reflection_color_in;\n"
+    "    float diffuse_fraction_in;\n"
+    "    vec3 emission_color_in;\n"
+    "    bool use_multi_color_in;\n"
+    "    vec2 roughness_in;\n"
+    "    vec2 roughness_weights_in;\n"
+    "    bool use_texture_map_in;\n"
+    "    bool use_normal_map_in;\n"
+    "    bool use_specular_map_in;\n"
+    "    bool use_emission_map_in;\n"
+    "    bool anisotropic_in;\n"
+    "};\n";
+
+#endif
+
+static void AddUniformBufferDefinitions(char *&prologue) {
+#ifndef OPENGL_ES2
+    if (sre_internal_uniform_buffers)
+        AddPrologueDefinition(uniform_buffer_definitions, prologue);
+#endif
+}
+
+static void AddObjectUniformBufferDefinitions(char *&prologue) {
+#ifndef OPENGL_ES2
+    if (sre_internal_uniform_buffers)
+        AddPrologueDefinition(object_uniform_buffer_definitions, prologue);
+#endif
+}
+
 static void sreInitializeMultiPassLightingShaders() {
     // New style shader loading for lighting shaders.
     for (int i = 0; i < NU_MULTI_PASS_SHADERS; i++) {
@@ -1921,20 +2562,66 @@ static void sreInitializeMultiPassLightingShaders() {
         AddDirectionalLightSpillOverDefinition(prologue);
         AddLightParameterDefinitions(prologue);
         AddShadowMapParameterDefinitions(prologue);
+        AddUniformBufferDefinitions(prologue);
+#ifndef OPENGL_ES2
+        // Directional light shadow maps may be split into cascades.
+        if (strstr(multi_pass_shader_prologue[i], "#define SHADOW_MAP\n") != NULL &&
+        strstr(multi_pass_shader_prologue[i], "#define DIRECTIONAL_LIGHT\n") != NULL)
+            AddPrologueDefinition("#define SHADOW_MAP_CASCADES\n", prologue);
+        // Spot and beam light shadow maps may be stored in the shadow map atlas.
+        if (strstr(multi_pass_shader_prologue[i], "#define SPOT_LIGHT_SHADOW_MAP\n") != NULL ||
+        (strstr(multi_pass_shader_prologue[i], "#define SHADOW_MAP\n") != NULL &&
+        strstr(multi_pass_shader_prologue[i], "#define BEAM_LIGHT\n") != NULL))
+            AddPrologueDefinition("#define SHADOW_MAP_ATLAS\n", prologue);
+#endif
 //	sreMessage(SRE_MESSAGE_INFO, "%s", prologue);
+        // The non-instanced variant takes the object parameters from the object uniform
+        // buffer.
+        char *object_prologue = new char[strlen(prologue) + 1];
+        strcpy(object_prologue, prologue);
+        AddObjectUniformBufferDefinitions(object_prologue);
         multi_pass_shader[i].Initialize(
             multi_pass_shader_info[i].name,
             SRE_SHADER_MASK_LIGHTING_MULTI_PASS,
             multi_pass_shader_info[i].uniform_mask,
             multi_pass_shader_info[i].attribute_mask,
             "gl3_lighting_pass.vert", "gl3_lighting_pass.frag",
-            prologue);
+            object_prologue);
+        delete [] object_prologue;
+        // Instanced variant. The per-object matrices and diffuse reflection color are
+        // replaced by per-instance attributes. Shaders that use a model space shadow
+        // map transformation (directional and beam light shadow maps) are excluded.
+        if ((sre_internal_rendering_flags & SRE_RENDERING_FLAG_INSTANCING_SUPPORT) &&
+        strstr(multi_pass_shader_prologue[i], "#define SHADOW_MAP\n") == NULL) {
+            AddPrologueDefinition("#define INSTANCING\n", prologue);
+            char name[128];
+            sprintf(name, "%s (instanced)", multi_pass_shader_info[i].name);
+            multi_pass_shader_instanced[i].Initialize(
+                strdup(name),
+                SRE_SHADER_MASK_LIGHTING_MULTI_PASS,
+                (multi_pass_shader_info[i].uniform_mask & ~((1 << UNIFORM_MVP) |
+                    (1 << UNIFORM_MODEL_MATRIX) | (1 << UNIFORM_MODEL_ROTATION_MATRIX) |
+                    (1 << UNIFORM_DIFFUSE_REFLECTION_COLOR))) |
+                    ((unsigned int)1 << UNIFORM_VIEW_PROJECTION_MATRIX),
+                multi_pass_shader_info[i].attribute_mask,
+                "gl3_lighting_pass.vert", "gl3_lighting_pass.frag",
+                prologue);
+        }
         delete [] prologue;
     }
 }
 
 static void sreInitializeSinglePassLightingShaders() {
     for (int i = 0; i < NU_SINGLE_PASS_SHADERS; i++) {
+        // The clustered lighting shader requires texture buffer objects.
+        bool clustered = (i == 10);
+        if (clustered &&
+        !(sre_internal_rendering_flags & SRE_RENDERING_FLAG_CLUSTERED_LIGHTING_SUPPORT))
+            continue;
+        // The G-buffer geometry shader requires the deferred shading framebuffer.
+        bool deferred = (i == 11);
+        if (deferred && sre_internal_gbuffer_framebuffer == 0)
+            continue;
         char *prologue = new char[strlen(single_pass_shader_prologue[i]) + 1];
         strcpy(prologue, single_pass_shader_prologue[i]);
 #ifdef COMPRESS_COLOR_ATTRIBUTE
@@ -1947,17 +2634,119 @@ static void sreInitializeSinglePassLightingShaders() {
 #endif
         AddDirectionalLightSpillOverDefinition(prologue);
         AddLightParameterDefinitions(prologue);
+        if (sre_internal_uniform_buffers) {
+            // The light uniform block includes the shadow map parameters.
+            AddShadowMapParameterDefinitions(prologue);
+            AddUniformBufferDefinitions(prologue);
+        }
+        if (clustered)
+            AddClusterParameterDefinitions(prologue);
         single_pass_shader[i].Initialize(
             single_pass_shader_info[i].name,
             SRE_SHADER_MASK_LIGHTING_SINGLE_PASS,
             single_pass_shader_info[i].uniform_mask,
             single_pass_shader_info[i].attribute_mask,
-            "gl3_lighting_pass.vert", "gl3_lighting_pass.frag",
+            "gl3_lighting_pass.vert",
+            clustered ? "gl3_clustered_lighting.frag" :
+            (deferred ? "gl3_deferred_geometry.frag" : "gl3_lighting_pass.frag"),
             prologue);
         delete [] prologue;
     }
 }
 
+static const char *deferred_light_type_definition[4] = {
+    "#define DIRECTIONAL_LIGHT\n", "#define POINT_SOURCE_LIGHT\n", "#define SPOT_LIGHT\n",
+    "#define BEAM_LIGHT\n"
+};
+
+static const char *deferred_shadow_map_definition[4] = {
+    "#define SHADOW_MAP\n", "#define SHADOW_CUBE_MAP\n", "#define SPOT_LIGHT_SHADOW_MAP\n",
+    "#define SHADOW_MAP\n"
+};
+
+static void sreInitializeDeferredShadingShaders() {
+    if (sre_internal_gbuffer_framebuffer == 0)
+        return;
+    char gbuffer_definitions[256];
+    sprintf(gbuffer_definitions,
+        "#define NU_GBUFFER_TEXTURES %d\n"
+        "#define GBUFFER_DIFFUSE %d\n"
+        "#define GBUFFER_SPECULAR %d\n"
+        "#define GBUFFER_NORMAL %d\n"
+        "#define GBUFFER_BASE_COLOR %d\n"
+        "#define GBUFFER_DEPTH %d\n",
+        SRE_NU_GBUFFER_TEXTURES, SRE_GBUFFER_DIFFUSE, SRE_GBUFFER_SPECULAR,
+        SRE_GBUFFER_NORMAL, SRE_GBUFFER_BASE_COLOR, SRE_GBUFFER_DEPTH);
+    char *prologue = new char[strlen(gbuffer_definitions) + 1];
+    strcpy(prologue, gbuffer_definitions);
+    AddPrologueDefinition("#define COMPOSITE\n", prologue);
+    deferred_shading_shader[SRE_DEFERRED_SHADING_SHADER_COMPOSITE].Initialize(
+        "Deferred shading composite shader",
+        SRE_SHADER_MASK_DEFERRED_SHADING,
+        (1 << UNIFORM_MISC_GBUFFER_SAMPLERS),
+        (1 << ATTRIBUTE_POSITION),
+        "gl3_deferred_shading.vert", "gl3_deferred_shading.frag", prologue);
+    delete [] prologue;
+    for (int i = 0; i < SRE_NU_DEFERRED_SHADING_SHADERS - SRE_DEFERRED_SHADING_SHADER_LIGHT; i++) {
+        int type = i >> 1;
+        bool shadow_map = i & 1;
+        int uniform_mask = (1 << UNIFORM_MISC_LIGHT_PARAMETERS) | (1 << UNIFORM_MISC_VIEWPOINT) |
+            (1 << UNIFORM_MISC_INVERSE_VIEW_PROJECTION_MATRIX) |
+            (1 << UNIFORM_MISC_GBUFFER_SAMPLERS);
+        if (shadow_map) {
+#ifdef NO_SHADOW_MAP
+            continue;
+#else
+            // Only load shadow map variants when the shadow map technique is supported.
+            if (type == SRE_LIGHT_TYPE_POINT_SOURCE) {
+                if (!(sre_internal_rendering_flags & SRE_RENDERING_FLAG_CUBE_SHADOW_MAP_SUPPORT))
+                    continue;
+                uniform_mask |= (1 << UNIFORM_MISC_SHADOW_MAP_PARAMETERS) |
+                    (1 << UNIFORM_MISC_CUBE_SHADOW_MAP_SAMPLER);
+            }
+            else {
+                if (!(sre_internal_rendering_flags & SRE_RENDERING_FLAG_SHADOW_MAP_SUPPORT))
+                    continue;
+                uniform_mask |= (1 << UNIFORM_MISC_SHADOW_MAP_PARAMETERS) |
+                    (1 << UNIFORM_MISC_SHADOW_MAP_SAMPLER) |
+                    (1 << UNIFORM_MISC_SHADOW_MAP_TRANSFORMATION_MATRIX);
+            }
+#endif
+        }
+        prologue = new char[strlen(gbuffer_definitions) + 1];
+        strcpy(prologue, gbuffer_definitions);
+        AddDirectionalLightSpillOverDefinition(prologue);
+        AddLightParameterDefinitions(prologue);
+        AddPrologueDefinition(deferred_light_type_definition[type], prologue);
+        if (shadow_map) {
+            AddShadowMapParameterDefinitions(prologue);
+            AddPrologueDefinition(deferred_shadow_map_definition[type], prologue);
+#ifndef OPENGL_ES2
+            if (type == SRE_LIGHT_TYPE_DIRECTIONAL)
+                AddPrologueDefinition("#define SHADOW_MAP_CASCADES\n", prologue);
+            else if (type == SRE_LIGHT_TYPE_SPOT || type == SRE_LIGHT_TYPE_BEAM)
+                AddPrologueDefinition("#define SHADOW_MAP_ATLAS\n", prologue);
+#endif
+#ifdef USE_SHADOW_SAMPLER
+            AddPrologueDefinition("#define USE_SHADOW_SAMPLER\n", prologue);
+#endif
+#ifdef CUBE_MAP_STORES_DISTANCE
+            AddPrologueDefinition("#define CUBE_MAP_STORES_DISTANCE\n", prologue);
+#endif
+        }
+        char name[80];
+        sprintf(name, "Deferred shading light shader (light type %d%s)", type,
+            shadow_map ? ", shadow map" : "");
+        deferred_shading_shader[SRE_DEFERRED_SHADING_SHADER_LIGHT + i].Initialize(
+            strdup(name),
+            SRE_SHADER_MASK_DEFERRED_SHADING,
+            uniform_mask,
+            (1 << ATTRIBUTE_POSITION),
+            "gl3_deferred_shading.vert", "gl3_deferred_shading.frag", prologue);
+        delete [] prologue;
+    }
+}
+
 // This function is called by sreInitialize(). Depending on the demand-loading
 // setting, most shaders may not actually be loaded yet.
 
@@ -1980,6 +2769,8 @@ void sreInitializeShaders(int shader_mask) {
         sreInitializeSinglePassLightingShaders();
     if (shader_mask & SRE_SHADER_MASK_LIGHTING_MULTI_PASS)
         sreInitializeMultiPassLightingShaders();
+    if (shader_mask & SRE_SHADER_MASK_DEFERRED_SHADING)
+        sreInitializeDeferredShadingShaders();
 }
 
 // Functions to validate shaders (make sure they are loaded) when shadow
@@ -2006,6 +2797,15 @@ void sreValidateSpotlightShadowMapShaders() {
 void sreValidateCubeShadowMapShaders() {
     misc_shader[SRE_MISC_SHADER_CUBE_SHADOW_MAP].Validate();
     misc_shader[SRE_MISC_SHADER_CUBE_SHADOW_MAP_TRANSPARENT].Validate();
+#ifndef OPENGL_ES2
+    if (sre_internal_layered_cube_shadow_maps)
+        for (int i = SRE_MISC_SHADER_CUBE_SHADOW_MAP_LAYERED;
+        i <= SRE_MISC_SHADER_CUBE_SHADOW_MAP_LAYERED_TRANSPARENT; i++) {
+            if (misc_shader[i].status == SRE_SHADER_STATUS_UNINITIALIZED)
+                sreInitializeMiscShader(i);
+            misc_shader[i].Validate();
+        }
+#endif
 }
 
 #endif
@@ -61,13 +61,20 @@ void sreUpdateShadowMapNearPlaneDistance(float n) {
 // texture units when required.
 
 // Common shader uniforms.
+//
+// The object parameter functions return without a GL call when the uniform location is
+// - 1, which is the case for the parameters that are stored in the object uniform buffer.
 
 static void GL3InitializeShaderWithMVP(int loc, const sreObject& so) {
+    if (loc < 0)
+        return;
     Matrix4D MVP = sre_internal_view_projection_matrix * so.model_matrix;
     glUniformMatrix4fv(loc, 1, GL_FALSE, (const float *)&MVP);
 }
 
 static void GL3InitializeShaderWithModelMatrix(int loc, const sreObject& so) {
+    if (loc < 0)
+        return;
 #ifdef OPENGL_ES2
     // Convert Matrix4x3RM to Matrix4D.
     Matrix4D m = so.model_matrix;
@@ -80,6 +87,8 @@ static void GL3InitializeShaderWithModelMatrix(int loc, const sreObject& so) {
 }
 
 static void GL3InitializeShaderWithModelRotationMatrix(int loc, const sreObject& so) {
+    if (loc < 0)
+        return;
     glUniformMatrix3fv(loc, 1, GL_FALSE, (const float *)&so.rotation_matrix);
 }
 
@@ -88,6 +97,8 @@ static void GL3InitializeShaderWithViewProjectionMatrix(int loc) {
 }
 
 static void GL3InitializeShaderWithMultiColor(int loc, const sreObject& so) {
+    if (loc < 0)
+        return;
     GLboolean multi_color;
     if (so.render_flags & SRE_OBJECT_MULTI_COLOR)
         multi_color = GL_TRUE;
@@ -97,6 +108,8 @@ static void GL3InitializeShaderWithMultiColor(int loc, const sreObject& so) {
 }
 
 static void GL3InitializeShaderWithUseTexture(int loc, const sreObject& so) {
+    if (loc < 0)
+        return;
     GLboolean use_texture;
     if (so.render_flags & SRE_OBJECT_USE_TEXTURE)
         use_texture = GL_TRUE;
@@ -114,6 +127,8 @@ static void GL3InitializeShaderWithLightPosition4ModelSpace(int loc, float *ligh
 }
 
 static void GL3InitializeShaderWithEmissionColor(int loc, const sreObject& so) {
+    if (loc < 0)
+        return;
     glUniform3fv(loc, 1, (GLfloat *)&so.emission_color);
 }
 
@@ -180,30 +195,44 @@ static void GL3InitializeShadowMapShaderWithShadowMapDimensions(int loc, const V
 // Object-specific lighting-related uniforms.
 
 static void GL3InitializeShaderWithDiffuseReflectionColor(int loc, const sreObject& so) {
+    if (loc < 0)
+        return;
     glUniform3fv(loc, 1, (GLfloat *)&so.diffuse_reflection_color);
 }
 
 static void GL3InitializeShaderWithSpecularReflectionColor(int loc, const sreObject& so) {
+    if (loc < 0)
+        return;
     glUniform3fv(loc, 1, (GLfloat *)&so.specular_reflection_color);
 }
 
 static void GL3InitializeShaderWithSpecularExponent(int loc, const sreObject& so) {
+    if (loc < 0)
+        return;
     glUniform1f(loc, so.specular_exponent);
 }
 
 static void GL3InitializeShaderWithDiffuseFraction(int loc, const sreObject& so) {
+    if (loc < 0)
+        return;
     glUniform1f(loc, so.diffuse_fraction);
 }
 
 static void GL3InitializeShaderWithRoughness(int loc, const sreObject& so) {
+    if (loc < 0)
+        return;
     glUniform2fv(loc, 1, (GLfloat *)&so.roughness_values);
 }
 
 static void GL3InitializeShaderWithRoughnessWeights(int loc, const sreObject& so) {
+    if (loc < 0)
+        return;
     glUniform2fv(loc, 1, (GLfloat *)&so.roughness_weights);
 }
 
 static void GL3InitializeShaderWithAnisotropic(int loc, const sreObject& so) {
+    if (loc < 0)
+        return;
     GLboolean value;
     if (so.anisotropic)
         value = GL_TRUE;
@@ -224,8 +253,10 @@ static const char nu_light_parameters_table[4] = {
     NU_LIGHT_PARAMETERS_BEAM
 };
 
-static void InitializeShaderLightParameters(int loc) {
-    float light_parameters[NU_LIGHT_PARAMETERS_MAX];
+// Calculate the light parameters of the current light. Returns the number of parameters
+// used by the light type.
+
+static int CalculateShaderLightParameters(float *light_parameters) {
     light_parameters[LIGHT_POSITION_X] = sre_internal_current_light->vector.x;
     light_parameters[LIGHT_POSITION_Y] = sre_internal_current_light->vector.y;
     light_parameters[LIGHT_POSITION_Z] = sre_internal_current_light->vector.z;
@@ -264,6 +295,12 @@ static void InitializeShaderLightParameters(int loc) {
         light_parameters[LIGHT_LINEAR_ATTENUATION_RANGE] = 1000000.0f;
         light_parameters[BEAM_LIGHT_RADIAL_LINEAR_ATTENUATION_RANGE] = 1000000.0f;
     }
+    return nu_light_parameters;
+}
+
+static void InitializeShaderLightParameters(int loc) {
+    float light_parameters[NU_LIGHT_PARAMETERS_MAX];
+    int nu_light_parameters = CalculateShaderLightParameters(light_parameters);
     glUniform1fv(loc, nu_light_parameters, &light_parameters[0]);
 }
 
@@ -276,8 +313,10 @@ static const char nu_shadow_map_parameters_table[4] = {
     NU_SHADOW_MAP_PARAMETERS_DIRECTIONAL_BEAM_LIGHT,
 };
 
-static void sreInitializeShaderShadowMapParameters(int loc) {
-    float shadow_map_parameters[NU_SHADOW_MAP_PARAMETERS_MAX];
+// Calculate the shadow map parameters of the current light. Returns the number of
+// parameters used by the light type.
+
+static int CalculateShaderShadowMapParameters(float *shadow_map_parameters) {
     int type = sre_internal_current_light->type_index;
     int nu_shadow_map_parameters = nu_shadow_map_parameters_table[type];
     if (type == SRE_LIGHT_TYPE_POINT_SOURCE) {
@@ -305,9 +344,253 @@ static void sreInitializeShaderShadowMapParameters(int loc) {
             shadow_map_parameters[SHADOW_MAP_DIMENSIONS_X] = sre_internal_current_shadow_map_dimensions.x;
             shadow_map_parameters[SHADOW_MAP_DIMENSIONS_Z] = sre_internal_current_shadow_map_dimensions.z;
         }
+#ifndef OPENGL_ES2
+        // Directional light shaders also take the cascade parameters.
+        if (type == SRE_LIGHT_TYPE_DIRECTIONAL) {
+            memcpy(&shadow_map_parameters[SHADOW_MAP_NU_CASCADES],
+                sre_internal_shadow_map_cascade_parameters,
+                sizeof(sre_internal_shadow_map_cascade_parameters));
+            nu_shadow_map_parameters = NU_SHADOW_MAP_PARAMETERS_CASCADES;
+        }
+        // Spot and beam light shaders also take the shadow map atlas tile.
+        else {
+            if (sre_internal_current_shadow_map_atlas_tile_size > 0) {
+                shadow_map_parameters[SHADOW_MAP_SIZE] =
+                    sre_internal_current_shadow_map_atlas_tile_size;
+                // The atlas uses 32-bit float depth values.
+                shadow_map_parameters[SHADOW_MAP_DEPTH_PRECISION] = 1.0f / powf(2.0f, 23.0f);
+            }
+            memcpy(&shadow_map_parameters[SHADOW_MAP_ATLAS_TILE_SCALE],
+                sre_internal_shadow_map_atlas_tile_parameters,
+                sizeof(sre_internal_shadow_map_atlas_tile_parameters));
+            nu_shadow_map_parameters = NU_SHADOW_MAP_PARAMETERS_ATLAS;
+        }
+#endif
     }
+    return nu_shadow_map_parameters;
+}
+
+static void sreInitializeShaderShadowMapParameters(int loc) {
+    float shadow_map_parameters[NU_SHADOW_MAP_PARAMETERS_CASCADES];
+    int nu_shadow_map_parameters = CalculateShaderShadowMapParameters(shadow_map_parameters);
     glUniform1fv(loc, nu_shadow_map_parameters, &shadow_map_parameters[0]);
-} 
+}
+
+#ifndef OPENGL_ES2
+
+// Uniform buffers shared by all lighting shaders. The frame and light parameters are
+// written once per frame and once per light instead of being set for every shader. The
+// layout follows the std140 rules, in which every element of a scalar array occupies
+// a vec4 slot; it must match the uniform block definitions in shader_loading.cpp.
+//
+// The per-object parameters (the model matrices and material) of the non-instanced
+// multi-pass shaders are stored in a third buffer that holds one record per object. A
+// record is written the first time the object is drawn in a frame and the lighting passes
+// only bind its range. The shadow map transformation matrix depends on the light and is
+// still set as a uniform; instanced draws take the model transformation and diffuse
+// reflection color from instance attributes.
+
+class sreFrameUniformData {
+public :
+    float viewpoint[4];
+    float ambient_color[4];
+};
+
+class sreLightUniformData {
+public :
+    float light_parameters[NU_LIGHT_PARAMETERS_MAX][4];
+    float shadow_map_parameters[NU_SHADOW_MAP_PARAMETERS_CASCADES][4];
+};
+
+// The matrix columns are padded to a vec4; the model matrix is stored in row-major order
+// (three rows of four elements) like sreObject::model_matrix.
+
+class sreObjectUniformData {
+public :
+    float MVP[16];
+    float model_matrix[12];
+    float model_rotation_matrix[3][4];
+    float uv_transform[3][4];
+    float diffuse_reflection_color[3];
+    float specular_exponent;
+    float specular_reflection_color[3];
+    float diffuse_fraction;
+    float emission_color[3];
+    int use_multi_color;
+    float roughness[2];
+    float roughness_weights[2];
+    int use_texture_map;
+    int use_normal_map;
+    int use_specular_map;
+    int use_emission_map;
+    int anisotropic;
+    int padding[3];
+};
+
+#define OBJECT_UNIFORM_BUFFER_INITIAL_SLOTS 1024
+
+static GLuint frame_uniform_buffer;
+static GLuint light_uniform_buffer;
+static GLuint object_uniform_buffer;
+// The offset of a bound range must be a multiple of GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT.
+static int object_uniform_buffer_stride;
+static int object_uniform_buffer_max_slots;
+static int object_uniform_buffer_nu_slots;
+static int object_uniform_buffer_frame = - 1;
+// Incremented whenever the buffer storage is respecified, which invalidates the slots
+// assigned to objects.
+static int object_uniform_buffer_generation = 0;
+
+void sreInitializeUniformBuffers() {
+    if (!GLEW_VERSION_3_1 && !GLEW_ARB_uniform_buffer_object) {
+        sreMessage(SRE_MESSAGE_INFO, "Uniform buffer objects not available.");
+        return;
+    }
+    glGenBuffers(1, &frame_uniform_buffer);
+    glGenBuffers(1, &light_uniform_buffer);
+    glBindBuffer(GL_UNIFORM_BUFFER, frame_uniform_buffer);
+    glBufferData(GL_UNIFORM_BUFFER, sizeof(sreFrameUniformData), NULL, GL_STREAM_DRAW);
+    glBindBuffer(GL_UNIFORM_BUFFER, light_uniform_buffer);
+    glBufferData(GL_UNIFORM_BUFFER, sizeof(sreLightUniformData), NULL, GL_STREAM_DRAW);
+    GLint alignment;
+    glGetIntegerv(GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT, &alignment);
+    object_uniform_buffer_stride = (sizeof(sreObjectUniformData) + alignment - 1) /
+        alignment * alignment;
+    object_uniform_buffer_max_slots = OBJECT_UNIFORM_BUFFER_INITIAL_SLOTS;
+    glGenBuffers(1, &object_uniform_buffer);
+    glBindBuffer(GL_UNIFORM_BUFFER, object_uniform_buffer);
+    glBufferData(GL_UNIFORM_BUFFER, object_uniform_buffer_max_slots *
+        object_uniform_buffer_stride, NULL, GL_STREAM_DRAW);
+    glBindBuffer(GL_UNIFORM_BUFFER, 0);
+    // The buffers stay bound to their binding points.
+    glBindBufferBase(GL_UNIFORM_BUFFER, SRE_FRAME_UNIFORM_BUFFER_BINDING, frame_uniform_buffer);
+    glBindBufferBase(GL_UNIFORM_BUFFER, SRE_LIGHT_UNIFORM_BUFFER_BINDING, light_uniform_buffer);
+    CHECK_GL_ERROR("Error after uniform buffer initialization.\n");
+    sre_internal_uniform_buffers = true;
+    sreMessage(SRE_MESSAGE_INFO, "Using uniform buffer objects for lighting shader parameters.");
+}
+
+static void UpdateFrameUniformBuffer() {
+    sreFrameUniformData data;
+    data.viewpoint[0] = sre_internal_viewpoint.x;
+    data.viewpoint[1] = sre_internal_viewpoint.y;
+    data.viewpoint[2] = sre_internal_viewpoint.z;
+    data.viewpoint[3] = 0;
+    data.ambient_color[0] = sre_internal_scene->ambient_color.r;
+    data.ambient_color[1] = sre_internal_scene->ambient_color.g;
+    data.ambient_color[2] = sre_internal_scene->ambient_color.b;
+    data.ambient_color[3] = 0;
+    // Respecifying the buffer's data store avoids waiting for draws that use the old
+    // contents.
+    glBindBuffer(GL_UNIFORM_BUFFER, frame_uniform_buffer);
+    glBufferData(GL_UNIFORM_BUFFER, sizeof(data), &data, GL_STREAM_DRAW);
+    glBindBuffer(GL_UNIFORM_BUFFER, 0);
+}
+
+static void UpdateLightUniformBuffer() {
+    sreLightUniformData data;
+    memset(&data, 0, sizeof(data));
+    float light_parameters[NU_LIGHT_PARAMETERS_MAX];
+    int n = CalculateShaderLightParameters(light_parameters);
+    for (int i = 0; i < n; i++)
+        data.light_parameters[i][0] = light_parameters[i];
+#ifndef NO_SHADOW_MAP
+    if (sre_internal_shadows == SRE_SHADOWS_SHADOW_MAPPING) {
+        float shadow_map_parameters[NU_SHADOW_MAP_PARAMETERS_CASCADES];
+        n = CalculateShaderShadowMapParameters(shadow_map_parameters);
+        for (int i = 0; i < n; i++)
+            data.shadow_map_parameters[i][0] = shadow_map_parameters[i];
+    }
+#endif
+    glBindBuffer(GL_UNIFORM_BUFFER, light_uniform_buffer);
+    glBufferData(GL_UNIFORM_BUFFER, sizeof(data), &data, GL_STREAM_DRAW);
+    glBindBuffer(GL_UNIFORM_BUFFER, 0);
+}
+
+// Respecify the object buffer's data store. Draws that have already been issued keep
+// using the old storage.
+
+static void ResetObjectUniformBuffer() {
+    glBufferData(GL_UNIFORM_BUFFER, object_uniform_buffer_max_slots *
+        object_uniform_buffer_stride, NULL, GL_STREAM_DRAW);
+    object_uniform_buffer_nu_slots = 0;
+    object_uniform_buffer_generation++;
+}
+
+static void WriteObjectUniformData(const sreObject& so, int offset) {
+    sreObjectUniformData data;
+    Matrix4D MVP = sre_internal_view_projection_matrix * so.model_matrix;
+    memcpy(data.MVP, &MVP, sizeof(data.MVP));
+    memcpy(data.model_matrix, &so.model_matrix, sizeof(data.model_matrix));
+    const float *rotation_matrix = (const float *)&so.rotation_matrix;
+    const float *uv_transform = (const float *)so.UV_transformation_matrix;
+    for (int i = 0; i < 3; i++) {
+        for (int j = 0; j < 3; j++) {
+            data.model_rotation_matrix[i][j] = rotation_matrix[i * 3 + j];
+            // The UV transformation matrix is only used by shaders that have the
+            // UV transform flag.
+            if (uv_transform != NULL)
+                data.uv_transform[i][j] = uv_transform[i * 3 + j];
+            else
+                data.uv_transform[i][j] = (i == j);
+        }
+        data.model_rotation_matrix[i][3] = 0;
+        data.uv_transform[i][3] = 0;
+    }
+    memcpy(data.diffuse_reflection_color, &so.diffuse_reflection_color,
+        sizeof(data.diffuse_reflection_color));
+    data.specular_exponent = so.specular_exponent;
+    memcpy(data.specular_reflection_color, &so.specular_reflection_color,
+        sizeof(data.specular_reflection_color));
+    data.diffuse_fraction = so.diffuse_fraction;
+    memcpy(data.emission_color, &so.emission_color, sizeof(data.emission_color));
+    data.use_multi_color = (so.render_flags & SRE_OBJECT_MULTI_COLOR) != 0;
+    memcpy(data.roughness, &so.roughness_values, sizeof(data.roughness));
+    memcpy(data.roughness_weights, &so.roughness_weights, sizeof(data.roughness_weights));
+    data.use_texture_map = (so.render_flags & SRE_OBJECT_USE_TEXTURE) != 0;
+    data.use_normal_map = (so.render_flags & SRE_OBJECT_USE_NORMAL_MAP) != 0;
+    data.use_specular_map = (so.render_flags & SRE_OBJECT_USE_SPECULARITY_MAP) != 0;
+    data.use_emission_map = (so.render_flags & SRE_OBJECT_USE_EMISSION_MAP) != 0;
+    data.anisotropic = so.anisotropic;
+    glBufferSubData(GL_UNIFORM_BUFFER, offset, sizeof(data), &data);
+}
+
+// Bind the object's record in the object uniform buffer for the non-instanced multi-pass
+// shaders, writing it when the object has not yet been drawn in the current frame.
+
+static void BindObjectUniformBuffer(sreObject& so) {
+    if (so.object_uniform_buffer_generation != object_uniform_buffer_generation ||
+    object_uniform_buffer_frame != sre_internal_current_frame) {
+        glBindBuffer(GL_UNIFORM_BUFFER, object_uniform_buffer);
+        if (object_uniform_buffer_frame != sre_internal_current_frame) {
+            // Orphan the records of the previous frame.
+            object_uniform_buffer_frame = sre_internal_current_frame;
+            ResetObjectUniformBuffer();
+        }
+        else if (object_uniform_buffer_nu_slots == object_uniform_buffer_max_slots) {
+            // The buffer is full; the objects drawn so far in this frame will be written
+            // again when they are next drawn.
+            object_uniform_buffer_max_slots *= 2;
+            ResetObjectUniformBuffer();
+        }
+        so.object_uniform_buffer_slot = object_uniform_buffer_nu_slots;
+        so.object_uniform_buffer_generation = object_uniform_buffer_generation;
+        object_uniform_buffer_nu_slots++;
+        WriteObjectUniformData(so, so.object_uniform_buffer_slot *
+            object_uniform_buffer_stride);
+        glBindBuffer(GL_UNIFORM_BUFFER, 0);
+    }
+    glBindBufferRange(GL_UNIFORM_BUFFER, SRE_OBJECT_UNIFORM_BUFFER_BINDING,
+        object_uniform_buffer, so.object_uniform_buffer_slot * object_uniform_buffer_stride,
+        sizeof(sreObjectUniformData));
+}
+
+#else
+
+void sreInitializeUniformBuffers() {
+}
+
+#endif
 
 #else
 
@@ -438,17 +721,71 @@ static void GL3InitializeSinglePassShaderWithLightColor(int loc) {
 
 #endif
 
+// Redundant state filtering for lighting-pass objects. When the lighting pass render queue
+// is flushed, objects are drawn sorted by shader and textures, and program and texture
+// changes that would not change the current state are skipped. Filtering is only enabled
+// during the flush, because other code binds programs and textures directly.
+
+static bool state_filtering_enabled = false;
+// The currently used program and the textures bound to texture units 0 to 3; 0 means
+// unknown.
+static GLuint filtered_program;
+static GLuint filtered_texture[4];
+
+void sreBeginLightingPassStateFiltering() {
+    state_filtering_enabled = true;
+    filtered_program = 0;
+    for (int i = 0; i < 4; i++)
+        filtered_texture[i] = 0;
+}
+
+void sreEndLightingPassStateFiltering() {
+    state_filtering_enabled = false;
+}
+
+// The multi-pass shader table used by sreInitializeMultiPassShader(). It is temporarily
+// switched to the instanced shader variants for instanced drawing.
+
+static sreShader *multi_pass_shader_table = multi_pass_shader;
+
+static void UseMultiPassProgram(int shader) {
+    GLuint program = multi_pass_shader_table[shader].program;
+    if (state_filtering_enabled) {
+        if (program == filtered_program) {
+            sre_internal_lighting_pass_stats.shader_changes_saved++;
+            return;
+        }
+        filtered_program = program;
+        sre_internal_lighting_pass_stats.shader_changes++;
+    }
+    glUseProgram(program);
+}
+
+static void BindTexture(int unit, GLuint id) {
+    if (state_filtering_enabled) {
+        if (id == filtered_texture[unit]) {
+            sre_internal_lighting_pass_stats.texture_changes_saved++;
+            return;
+        }
+        filtered_texture[unit] = id;
+        sre_internal_lighting_pass_stats.texture_changes++;
+    }
+    glActiveTexture(GL_TEXTURE0 + unit);
+    glBindTexture(GL_TEXTURE_2D, id);
+}
+
 // Texture related uniforms, and texture binding.
 
 static void GL3InitializeShaderWithObjectTexture(const sreObject& so) {
-    glActiveTexture(GL_TEXTURE0);
     if (so.texture != NULL)
-        glBindTexture(GL_TEXTURE_2D, so.texture->opengl_id);
+        BindTexture(0, so.texture->opengl_id);
     // When texture == NULL, the object has different textures for
     // each mesh. Binding will be delayed until the draw function.
 }
 
 static void GL3InitializeShaderWithUseNormalMap(int loc, const sreObject& so) {
+    if (loc < 0)
+        return;
     GLboolean use_normal_map;
     if (so.render_flags & SRE_OBJECT_USE_NORMAL_MAP)
         use_normal_map = GL_TRUE;
@@ -458,9 +795,8 @@ static void GL3InitializeShaderWithUseNormalMap(int loc, const sreObject& so) {
 }
 
 static void GL3InitializeShaderWithObjectNormalMap(const sreObject& so) {
-    glActiveTexture(GL_TEXTURE1);
     if (so.normal_map != NULL)
-        glBindTexture(GL_TEXTURE_2D, so.normal_map->opengl_id);
+        BindTexture(1, so.normal_map->opengl_id);
     // When normal_map == NULL, the object has different normal maps for
     // each mesh. Binding will be delayed until the draw function.
 }
@@ -474,18 +810,18 @@ static void GL3InitializeShaderWithTexture3DType(int loc, const sreObject& so) {
 }
 
 static void GL3InitializeShaderWithModelSubTexture(int id) {
-    glActiveTexture(GL_TEXTURE0);
-    glBindTexture(GL_TEXTURE_2D, id);
+    BindTexture(0, id);
 //    printf("ModelSubTexture (subsequent mesh): Texture id = %d\n", id);
 }
 
 static void GL3InitializeShaderWithModelSubNormalMap(int id) {
-    glActiveTexture(GL_TEXTURE1);
-    glBindTexture(GL_TEXTURE_2D, id);
+    BindTexture(1, id);
 //    printf("ModelSubNormalMap (subsequent mesh): Normal map id = %d\n", id);
 }
 
 static void GL3InitializeShaderWithUseSpecularMap(int loc, const sreObject& so) {
+    if (loc < 0)
+        return;
     GLboolean use_specular_map;
     if (so.render_flags & SRE_OBJECT_USE_SPECULARITY_MAP)
         use_specular_map = GL_TRUE;
@@ -495,19 +831,19 @@ static void GL3InitializeShaderWithUseSpecularMap(int loc, const sreObject& so)
 }
 
 static void GL3InitializeShaderWithObjectSpecularMap(const sreObject& so) {
-    glActiveTexture(GL_TEXTURE2);
     if (so.specularity_map != NULL)
-        glBindTexture(GL_TEXTURE_2D, so.specularity_map->opengl_id);
+        BindTexture(2, so.specularity_map->opengl_id);
     // When specularity_map == NULL, the object has different specularity maps for
     // each mesh. Binding will be delayed until the draw function.
 }
 
 static void GL3InitializeShaderWithModelSubSpecularMap(int id) {
-    glActiveTexture(GL_TEXTURE2);
-    glBindTexture(GL_TEXTURE_2D, id);
+    BindTexture(2, id);
 }
 
 static void GL3InitializeShaderWithUseEmissionMap(int loc, const sreObject& so) {
+    if (loc < 0)
+        return;
     GLboolean use_emission_map;
     if (so.render_flags & SRE_OBJECT_USE_EMISSION_MAP)
         use_emission_map = GL_TRUE;
@@ -517,16 +853,14 @@ static void GL3InitializeShaderWithUseEmissionMap(int loc, const sreObject& so)
 }
 
 static void GL3InitializeShaderWithObjectEmissionMap(const sreObject& so) {
-    glActiveTexture(GL_TEXTURE3);
     if (so.emission_map != NULL)
-        glBindTexture(GL_TEXTURE_2D, so.emission_map->opengl_id);
+        BindTexture(3, so.emission_map->opengl_id);
     // When emission_map == NULL, the object has different emission maps for
     // each mesh. Binding will be delayed until the draw function.
 }
 
 static void GL3InitializeShaderWithModelSubEmissionMap(int id) {
-    glActiveTexture(GL_TEXTURE3);
-    glBindTexture(GL_TEXTURE_2D, id);
+    BindTexture(3, id);
 }
 
 // The misc shader for billboards uses the texture sampler 0 instead of 3 for the emission map.
@@ -536,6 +870,8 @@ static void GL3InitializeShaderWithObjectEmissionMapBillboardShader(const sreObj
 }
 
 static void GL3InitializeShaderWithUVTransform(int loc, const sreObject& so) {
+    if (loc < 0)
+        return;
     glUniformMatrix3fv(loc, 1, GL_FALSE, (GLfloat *)so.UV_transformation_matrix);
 }
 
@@ -578,8 +914,7 @@ static void GL3InitializeShaderWithSpotlightShadowMapTransformationMatrix(int lo
 
 static void GL3InitializeShaderWithShadowMapTexture() {
     glActiveTexture(GL_TEXTURE4);
-    glBindTexture(GL_TEXTURE_2D,
-        sre_internal_depth_texture[sre_internal_current_shadow_map_index]);
+    glBindTexture(GL_TEXTURE_2D, sre_internal_current_shadow_map_texture);
 }
 
 static void GL3InitializeShaderWithCubeShadowMapTexture() {
@@ -644,6 +979,12 @@ void sreInitializeLightingShaderUniformWithDefaultValue(int uniform_id, int loc)
     case UNIFORM_CUBE_SHADOW_MAP_SAMPLER :
         glUniform1i(loc, 4);
         break;
+    case UNIFORM_CLUSTER_LIGHT_DATA_SAMPLER :
+        glUniform1i(loc, SRE_CLUSTER_LIGHT_DATA_TEXTURE_UNIT);
+        break;
+    case UNIFORM_CLUSTER_LIGHT_LIST_SAMPLER :
+        glUniform1i(loc, SRE_CLUSTER_LIGHT_LIST_TEXTURE_UNIT);
+        break;
     }
 }
 
@@ -655,6 +996,18 @@ void sreInitializeMiscShaderUniformWithDefaultValue(int uniform_id, int loc) {
     case UNIFORM_MISC_AVERAGE_LUM_SAMPLER :
         glUniform1i(loc, 1);
         break;
+    case UNIFORM_MISC_GBUFFER_SAMPLERS : {
+        // The G-buffer textures are bound to consecutive texture units.
+        GLint units[SRE_NU_GBUFFER_TEXTURES];
+        for (int i = 0; i < SRE_NU_GBUFFER_TEXTURES; i++)
+            units[i] = SRE_GBUFFER_TEXTURE_UNIT + i;
+        glUniform1iv(loc, SRE_NU_GBUFFER_TEXTURES, units);
+        break;
+        }
+    case UNIFORM_MISC_SHADOW_MAP_SAMPLER :
+    case UNIFORM_MISC_CUBE_SHADOW_MAP_SAMPLER :
+        glUniform1i(loc, 4);
+        break;
     // Note: The shadow map shader's shadow map textures are attached to the
     // framebuffer, so there's no need to initialize a sampler uniform. When
     // a transparent object texture is used with the shadow map shader, it will
@@ -687,7 +1040,8 @@ enum MultiPassShaderSelection {
 enum SinglePassShaderSelection {
     SINGLE_PASS_SHADER0 = 0, SINGLE_PASS_SHADER1, SINGLE_PASS_SHADER2,
     SINGLE_PASS_SHADER3, SINGLE_PASS_SHADER4, SINGLE_PASS_SHADER5, SINGLE_PASS_SHADER6,
-    SINGLE_PASS_SHADER7, SINGLE_PASS_SHADER8, SINGLE_PASS_SHADER9
+    SINGLE_PASS_SHADER7, SINGLE_PASS_SHADER8, SINGLE_PASS_SHADER9, SINGLE_PASS_SHADER10,
+    SINGLE_PASS_SHADER11
 };
 
 
@@ -696,6 +1050,16 @@ enum SinglePassShaderSelection {
 // It would be better to initialize the shaders on a completely on-demand basis.
 
 void GL3InitializeShadersBeforeFrame() {
+#ifndef OPENGL_ES2
+    // With uniform buffers, the frame parameters (and for single-pass rendering the
+    // light parameters) are shared by all shaders; the corresponding bits have been
+    // cleared from the uniform masks, so the loops below skip them.
+    if (sre_internal_uniform_buffers) {
+        UpdateFrameUniformBuffer();
+        if (!sre_internal_multi_pass_rendering && sre_internal_current_light != NULL)
+            UpdateLightUniformBuffer();
+    }
+#endif
     // Note: When multi-pass rendering is enabled, the only single-pass shader that may
     // be used is SINGLE_PASS_SHADER3 (for final pass objects), but it does not require
     // any uniform initialization before the frame (no viewpoint or ambient color needed).
@@ -722,13 +1086,17 @@ void GL3InitializeShadersBeforeFrame() {
                 GL3InitializeShaderWithEmissionMap(
                     single_pass_shader[i].uniform_location[UNIFORM_EMISSION_MAP_SAMPLER]);
 #endif
+            if (single_pass_shader[i].uniform_mask & ((unsigned int)1 << UNIFORM_CLUSTER_PARAMETERS))
+                GL3InitializeShaderWithClusterParameters(
+                    single_pass_shader[i].uniform_location[UNIFORM_CLUSTER_PARAMETERS]);
             // If multi-pass rendering is enabled, the active_lights data structures are not filled in so
             // we must avoid the single-pass shader initialization of light parameters.
             if (sre_internal_multi_pass_rendering)
                 continue;
             if (sre_internal_current_light == NULL)
-                // It is possible that there are no lights.
-                return;
+                // It is possible that there are no lights (or clustered lighting is
+                // enabled).
+                continue;
             // Initialize the parameters for the single light.
 #if 1
             if (single_pass_shader[i].uniform_mask & (1 << UNIFORM_LIGHT_PARAMETERS))
@@ -780,6 +1148,19 @@ void GL3InitializeShadersBeforeFrame() {
 #endif
 #endif
         }
+        // The instanced shader variants additionally need the view-projection matrix.
+        for (int i = 0; i < NU_MULTI_PASS_SHADERS; i++) {
+            sreShader *shader = &multi_pass_shader_instanced[i];
+            if (shader->status != SRE_SHADER_STATUS_LOADED)
+                continue;
+            glUseProgram(shader->program);
+            GL3InitializeShaderWithViewProjectionMatrix(
+                shader->uniform_location[UNIFORM_VIEW_PROJECTION_MATRIX]);
+            if (shader->uniform_mask & (1 << UNIFORM_VIEWPOINT))
+                GL3InitializeShaderWithViewpoint(shader->uniform_location[UNIFORM_VIEWPOINT]);
+            if (shader->uniform_mask & (1 << UNIFORM_AMBIENT_COLOR))
+                GL3InitializeShaderWithAmbientColor(shader->uniform_location[UNIFORM_AMBIENT_COLOR]);
+        }
     }
 
     if (misc_shader[SRE_MISC_SHADER_HALO].status == SRE_SHADER_STATUS_LOADED) {
@@ -977,6 +1358,14 @@ void GL3InitializeShadersBeforeLight() {
     // This function is only called when multi-pass rendering is enabled, before each lighting pass.
     if (sre_internal_current_light_index == - 1)
         return;
+#ifndef OPENGL_ES2
+    // All light parameters are stored in the light uniform buffer, so there is nothing to
+    // initialize for each shader.
+    if (sre_internal_uniform_buffers) {
+        UpdateLightUniformBuffer();
+        return;
+    }
+#endif
     // With the new optimization where non-shadow map shaders may be used when shadow mapping is
     // enabled, more shaders have to be initialized before each light.
     MultiPassShaderList *list;
@@ -1036,37 +1425,39 @@ void GL3InitializeShadersBeforeLight() {
                         list = &shader_list_point_source_linear_attenuation_range_standard;
         else
             list = &shader_list_point_source;
-    for (int i = 0; i < list->nu_shaders; i++) {
-        int j = list->shader[i];
+    // The instanced shader variants are initialized as well.
+    for (int i = 0; i < list->nu_shaders * 2; i++) {
+        int j = list->shader[i >> 1];
+        sreShader *table = (i & 1) ? multi_pass_shader_instanced : multi_pass_shader;
         // Only initialize shaders that are loaded.
-        if (multi_pass_shader[j].status != SRE_SHADER_STATUS_LOADED)
+        if (table[j].status != SRE_SHADER_STATUS_LOADED)
             continue;
-        glUseProgram(multi_pass_shader[j].program);
+        glUseProgram(table[j].program);
 #if 1
-        if (multi_pass_shader[j].uniform_mask & (1 << UNIFORM_LIGHT_PARAMETERS))
+        if (table[j].uniform_mask & (1 << UNIFORM_LIGHT_PARAMETERS))
             InitializeShaderLightParameters(
-                multi_pass_shader[j].uniform_location[UNIFORM_LIGHT_PARAMETERS]);
+                table[j].uniform_location[UNIFORM_LIGHT_PARAMETERS]);
 #else
-        if (multi_pass_shader[j].uniform_mask & (1 << UNIFORM_LIGHT_POSITION))
+        if (table[j].uniform_mask & (1 << UNIFORM_LIGHT_POSITION))
             GL3InitializeMultiPassShaderWithLightPosition(
-                multi_pass_shader[j].uniform_location[UNIFORM_LIGHT_POSITION]);
-        if (multi_pass_shader[j].uniform_mask & (1 << UNIFORM_LIGHT_ATT))
+                table[j].uniform_location[UNIFORM_LIGHT_POSITION]);
+        if (table[j].uniform_mask & (1 << UNIFORM_LIGHT_ATT))
             GL3InitializeMultiPassShaderWithLightAttenuation(
-                multi_pass_shader[j].uniform_location[UNIFORM_LIGHT_ATT]);
-        if (multi_pass_shader[j].uniform_mask & (1 << UNIFORM_LIGHT_COLOR))
+                table[j].uniform_location[UNIFORM_LIGHT_ATT]);
+        if (table[j].uniform_mask & (1 << UNIFORM_LIGHT_COLOR))
             GL3InitializeMultiPassShaderWithLightColor(
-                multi_pass_shader[j].uniform_location[UNIFORM_LIGHT_COLOR]);
-        if (multi_pass_shader[j].uniform_mask & (1 << UNIFORM_SPOTLIGHT))
+                table[j].uniform_location[UNIFORM_LIGHT_COLOR]);
+        if (table[j].uniform_mask & (1 << UNIFORM_SPOTLIGHT))
             GL3InitializeMultiPassShaderWithSpotlight(
-                multi_pass_shader[j].uniform_location[UNIFORM_SPOTLIGHT]);
+                table[j].uniform_location[UNIFORM_SPOTLIGHT]);
 #endif
 #ifndef NO_SHADOW_MAP
-        if (multi_pass_shader[j].uniform_mask & (1 << UNIFORM_SHADOW_MAP_PARAMETERS))
+        if (table[j].uniform_mask & (1 << UNIFORM_SHADOW_MAP_PARAMETERS))
             sreInitializeShaderShadowMapParameters(
-                multi_pass_shader[j].uniform_location[UNIFORM_SHADOW_MAP_PARAMETERS]);
-//        if (multi_pass_shader[j].uniform_mask & (1 << UNIFORM_SEGMENT_DISTANCE_SCALING))
+                table[j].uniform_location[UNIFORM_SHADOW_MAP_PARAMETERS]);
+//        if (table[j].uniform_mask & (1 << UNIFORM_SEGMENT_DISTANCE_SCALING))
 //            GL3InitializeShaderWithSegmentDistanceScaling(
-//                multi_pass_shader[j].uniform_location[UNIFORM_SEGMENT_DISTANCE_SCALING]);
+//                table[j].uniform_location[UNIFORM_SEGMENT_DISTANCE_SCALING]);
 #endif
     }
 }
@@ -1186,9 +1577,35 @@ void GL3InitializeCubeShadowMapShadersBeforeLight() {
            misc_shader[SRE_MISC_SHADER_CUBE_SHADOW_MAP_TRANSPARENT].
                uniform_location[UNIFORM_MISC_LIGHT_POSITION]);
     }
+#ifndef OPENGL_ES2
+    for (int i = SRE_MISC_SHADER_CUBE_SHADOW_MAP_LAYERED;
+    i <= SRE_MISC_SHADER_CUBE_SHADOW_MAP_LAYERED_TRANSPARENT; i++)
+        if (misc_shader[i].status == SRE_SHADER_STATUS_LOADED) {
+            glUseProgram(misc_shader[i].program);
+            GL3InitializeShadowMapShaderWithLightPosition(
+                misc_shader[i].uniform_location[UNIFORM_MISC_LIGHT_POSITION]);
+        }
 #endif
+#endif
+}
+
+#ifndef OPENGL_ES2
+
+// Set the view-projection matrices of the six cube map faces for the layered shadow
+// cube-map shaders.
+
+void GL3InitializeLayeredCubeShadowMapShadersWithFaceMatrices(const Matrix4D *face_matrix) {
+    for (int i = SRE_MISC_SHADER_CUBE_SHADOW_MAP_LAYERED;
+    i <= SRE_MISC_SHADER_CUBE_SHADOW_MAP_LAYERED_TRANSPARENT; i++)
+        if (misc_shader[i].status == SRE_SHADER_STATUS_LOADED) {
+            glUseProgram(misc_shader[i].program);
+            glUniformMatrix4fv(misc_shader[i].uniform_location[UNIFORM_MISC_CUBE_FACE_MATRICES],
+                6, GL_FALSE, (GLfloat *)face_matrix);
+        }
 }
 
+#endif
+
 void GL3InitializeCubeShadowMapShadersWithSegmentDistanceScaling() {
     if (misc_shader[SRE_MISC_SHADER_CUBE_SHADOW_MAP].status == SRE_SHADER_STATUS_LOADED) {
         glUseProgram(misc_shader[SRE_MISC_SHADER_CUBE_SHADOW_MAP].program);
@@ -1202,6 +1619,15 @@ void GL3InitializeCubeShadowMapShadersWithSegmentDistanceScaling() {
             uniform_location[UNIFORM_MISC_SEGMENT_DISTANCE_SCALING],
             sre_internal_shadow_segment_distance_scaling);
     }
+#ifndef OPENGL_ES2
+    for (int i = SRE_MISC_SHADER_CUBE_SHADOW_MAP_LAYERED;
+    i <= SRE_MISC_SHADER_CUBE_SHADOW_MAP_LAYERED_TRANSPARENT; i++)
+        if (misc_shader[i].status == SRE_SHADER_STATUS_LOADED) {
+            glUseProgram(misc_shader[i].program);
+            glUniform1f(misc_shader[i].uniform_location[UNIFORM_MISC_SEGMENT_DISTANCE_SCALING],
+                sre_internal_shadow_segment_distance_scaling);
+        }
+#endif
 }
 
 #endif
@@ -1376,602 +1802,640 @@ static MultiPassShaderSelection sreSelectMultiPassShadowMapShader(const sreObjec
 
 #endif
 
+// Generic multi-pass shader for the current light that supports all object options
+// (similar to the selection when optimized shaders are disabled). It is used while the
+// selected shader is still being compiled with asynchronous shader loading; shadow map
+// shaders fall back to an unshadowed shader.
+
+static MultiPassShaderSelection sreSelectMultiPassFallbackShader(MultiPassShaderSelection shader) {
+    // The ambient pass shader has no alternative.
+    if (shader == SHADER1)
+        return SHADER1;
+    if (sre_internal_reflection_model == SRE_REFLECTION_MODEL_MICROFACET)
+        if (sre_internal_current_light->type & SRE_LIGHT_DIRECTIONAL)
+            return SHADER10;
+        else
+            return SHADER11;
+    if (sre_internal_current_light->type & SRE_LIGHT_LINEAR_ATTENUATION_RANGE)
+        return SHADER7;
+    if (sre_internal_current_light->type & SRE_LIGHT_DIRECTIONAL)
+        return SHADER4;
+    return SHADER6;
+}
+
+// Make sure the before-frame and before-light initialization is done for a newly loaded
+// shader. This could be optimized by only initializing the newly loaded shader.
+
+static void InitializeNewlyLoadedShaders() {
+    GL3InitializeShadersBeforeFrame();
+    if (sre_internal_multi_pass_rendering)
+        GL3InitializeShadersBeforeLight();
+    // These functions use other programs.
+    filtered_program = 0;
+}
+
 static void sreInitializeMultiPassShader(const sreObject& so, MultiPassShaderSelection shader) {
         // Handle demand-loading of lighting-pass shaders.
-        if (multi_pass_shader[shader].status != SRE_SHADER_STATUS_LOADED) {
-            multi_pass_shader[shader].Load();
-            // Must make sure the before-frame and before-light initialization is done.
-            // This could be optimized by only initializing the newly loaded shader.
-            GL3InitializeShadersBeforeFrame();
-            if (sre_internal_multi_pass_rendering)
-                GL3InitializeShadersBeforeLight();
+        if (multi_pass_shader_table[shader].status != SRE_SHADER_STATUS_LOADED) {
+            bool loaded = multi_pass_shader_table[shader].LoadNonBlocking();
+            if (!loaded) {
+                // Still being compiled; use the generic shader, loading it synchronously
+                // if necessary.
+                shader = sreSelectMultiPassFallbackShader(shader);
+                if (multi_pass_shader_table[shader].status != SRE_SHADER_STATUS_LOADED) {
+                    multi_pass_shader_table[shader].Load();
+                    loaded = true;
+                }
+            }
+            if (loaded)
+                InitializeNewlyLoadedShaders();
         }
         int flags = so.render_flags;
         switch (shader) {
         case SHADER0 :
             // Multi-pass lighting shader for directional lights with objects with texture
             // (non-transparent) and normal map.
-            glUseProgram(multi_pass_shader[SHADER0].program);
-            GL3InitializeShaderWithMVP(multi_pass_shader[SHADER0].uniform_location[UNIFORM_MVP], so);
-            GL3InitializeShaderWithModelMatrix(multi_pass_shader[SHADER0].uniform_location[UNIFORM_MODEL_MATRIX], so);
+            UseMultiPassProgram(SHADER0);
+            GL3InitializeShaderWithMVP(multi_pass_shader_table[SHADER0].uniform_location[UNIFORM_MVP], so);
+            GL3InitializeShaderWithModelMatrix(multi_pass_shader_table[SHADER0].uniform_location[UNIFORM_MODEL_MATRIX], so);
             GL3InitializeShaderWithModelRotationMatrix(
-                multi_pass_shader[SHADER0].uniform_location[UNIFORM_MODEL_ROTATION_MATRIX], so);
+                multi_pass_shader_table[SHADER0].uniform_location[UNIFORM_MODEL_ROTATION_MATRIX], so);
             GL3InitializeShaderWithDiffuseReflectionColor(
-                multi_pass_shader[SHADER0].uniform_location[UNIFORM_DIFFUSE_REFLECTION_COLOR], so);
+                multi_pass_shader_table[SHADER0].uniform_location[UNIFORM_DIFFUSE_REFLECTION_COLOR], so);
             GL3InitializeShaderWithSpecularReflectionColor(
-                multi_pass_shader[SHADER0].uniform_location[UNIFORM_SPECULAR_REFLECTION_COLOR], so);
+                multi_pass_shader_table[SHADER0].uniform_location[UNIFORM_SPECULAR_REFLECTION_COLOR], so);
             GL3InitializeShaderWithSpecularExponent(
-                multi_pass_shader[SHADER0].uniform_location[UNIFORM_SPECULAR_EXPONENT], so);
+                multi_pass_shader_table[SHADER0].uniform_location[UNIFORM_SPECULAR_EXPONENT], so);
             GL3InitializeShaderWithObjectTexture(so);
             GL3InitializeShaderWithObjectNormalMap(so);
             GL3InitializeShaderWithUVTransform( 
-                   multi_pass_shader[SHADER0].uniform_location[UNIFORM_UV_TRANSFORM], so);
+                   multi_pass_shader_table[SHADER0].uniform_location[UNIFORM_UV_TRANSFORM], so);
             break;
         case SHADER1 : // Ambient-pass shader plus emission color and map.
-            glUseProgram(multi_pass_shader[SHADER1].program);
-            GL3InitializeShaderWithMVP(multi_pass_shader[SHADER1].uniform_location[UNIFORM_MVP], so);
+            UseMultiPassProgram(SHADER1);
+            GL3InitializeShaderWithMVP(multi_pass_shader_table[SHADER1].uniform_location[UNIFORM_MVP], so);
             GL3InitializeShaderWithDiffuseReflectionColor(
-                multi_pass_shader[SHADER1].uniform_location[UNIFORM_DIFFUSE_REFLECTION_COLOR], so);
-            GL3InitializeShaderWithMultiColor(multi_pass_shader[SHADER1].uniform_location[UNIFORM_USE_MULTI_COLOR], so);
-            GL3InitializeShaderWithUseTexture(multi_pass_shader[SHADER1].uniform_location[UNIFORM_USE_TEXTURE_MAP], so);
+                multi_pass_shader_table[SHADER1].uniform_location[UNIFORM_DIFFUSE_REFLECTION_COLOR], so);
+            GL3InitializeShaderWithMultiColor(multi_pass_shader_table[SHADER1].uniform_location[UNIFORM_USE_MULTI_COLOR], so);
+            GL3InitializeShaderWithUseTexture(multi_pass_shader_table[SHADER1].uniform_location[UNIFORM_USE_TEXTURE_MAP], so);
             if (flags & SRE_OBJECT_USE_TEXTURE)
                 GL3InitializeShaderWithObjectTexture(so);
-            GL3InitializeShaderWithEmissionColor(multi_pass_shader[SHADER1].uniform_location[UNIFORM_EMISSION_COLOR], so);
-            GL3InitializeShaderWithUseEmissionMap(multi_pass_shader[SHADER1].uniform_location[UNIFORM_USE_EMISSION_MAP], so);
+            GL3InitializeShaderWithEmissionColor(multi_pass_shader_table[SHADER1].uniform_location[UNIFORM_EMISSION_COLOR], so);
+            GL3InitializeShaderWithUseEmissionMap(multi_pass_shader_table[SHADER1].uniform_location[UNIFORM_USE_EMISSION_MAP], so);
             if (flags & SRE_OBJECT_USE_EMISSION_MAP)
                 GL3InitializeShaderWithObjectEmissionMap(so);
             if (flags & (SRE_OBJECT_USE_TEXTURE | SRE_OBJECT_USE_EMISSION_MAP))
                GL3InitializeShaderWithUVTransform(
-                   multi_pass_shader[SHADER1].uniform_location[UNIFORM_UV_TRANSFORM], so);
+                   multi_pass_shader_table[SHADER1].uniform_location[UNIFORM_UV_TRANSFORM], so);
             break;
         case SHADER2 : // Lighting pass shader for beam lights.
-            glUseProgram(multi_pass_shader[SHADER2].program);
-            GL3InitializeShaderWithMVP(multi_pass_shader[SHADER2].uniform_location[UNIFORM_MVP], so);
-            GL3InitializeShaderWithModelMatrix(multi_pass_shader[SHADER2].uniform_location[UNIFORM_MODEL_MATRIX], so);
+            UseMultiPassProgram(SHADER2);
+            GL3InitializeShaderWithMVP(multi_pass_shader_table[SHADER2].uniform_location[UNIFORM_MVP], so);
+            GL3InitializeShaderWithModelMatrix(multi_pass_shader_table[SHADER2].uniform_location[UNIFORM_MODEL_MATRIX], so);
             GL3InitializeShaderWithModelRotationMatrix(
-                multi_pass_shader[SHADER2].uniform_location[UNIFORM_MODEL_ROTATION_MATRIX], so);
+                multi_pass_shader_table[SHADER2].uniform_location[UNIFORM_MODEL_ROTATION_MATRIX], so);
             GL3InitializeShaderWithDiffuseReflectionColor(
-                multi_pass_shader[SHADER2].uniform_location[UNIFORM_DIFFUSE_REFLECTION_COLOR], so);
-            GL3InitializeShaderWithMultiColor(multi_pass_shader[SHADER2].uniform_location[UNIFORM_USE_MULTI_COLOR], so);
-            GL3InitializeShaderWithUseTexture(multi_pass_shader[SHADER2].uniform_location[UNIFORM_USE_TEXTURE_MAP], so);
+                multi_pass_shader_table[SHADER2].uniform_location[UNIFORM_DIFFUSE_REFLECTION_COLOR], so);
+            GL3InitializeShaderWithMultiColor(multi_pass_shader_table[SHADER2].uniform_location[UNIFORM_USE_MULTI_COLOR], so);
+            GL3InitializeShaderWithUseTexture(multi_pass_shader_table[SHADER2].uniform_location[UNIFORM_USE_TEXTURE_MAP], so);
             GL3InitializeShaderWithSpecularReflectionColor(
-                multi_pass_shader[SHADER2].uniform_location[UNIFORM_SPECULAR_REFLECTION_COLOR], so);
+                multi_pass_shader_table[SHADER2].uniform_location[UNIFORM_SPECULAR_REFLECTION_COLOR], so);
             GL3InitializeShaderWithSpecularExponent(
-                multi_pass_shader[SHADER2].uniform_location[UNIFORM_SPECULAR_EXPONENT], so);
+                multi_pass_shader_table[SHADER2].uniform_location[UNIFORM_SPECULAR_EXPONENT], so);
             if (flags & SRE_OBJECT_USE_TEXTURE)
                 GL3InitializeShaderWithObjectTexture(so);
-            GL3InitializeShaderWithUseNormalMap(multi_pass_shader[SHADER2].uniform_location[UNIFORM_USE_NORMAL_MAP], so);
+            GL3InitializeShaderWithUseNormalMap(multi_pass_shader_table[SHADER2].uniform_location[UNIFORM_USE_NORMAL_MAP], so);
             if (flags & SRE_OBJECT_USE_NORMAL_MAP)
                 GL3InitializeShaderWithObjectNormalMap(so);
-            GL3InitializeShaderWithUseSpecularMap(multi_pass_shader[SHADER2].uniform_location[UNIFORM_USE_SPECULARITY_MAP], so);
+            GL3InitializeShaderWithUseSpecularMap(multi_pass_shader_table[SHADER2].uniform_location[UNIFORM_USE_SPECULARITY_MAP], so);
             if (flags & SRE_OBJECT_USE_SPECULARITY_MAP)
                 GL3InitializeShaderWithObjectSpecularMap(so);
             if (flags & (SRE_OBJECT_USE_TEXTURE | SRE_OBJECT_USE_NORMAL_MAP |
             SRE_OBJECT_USE_SPECULARITY_MAP))
                GL3InitializeShaderWithUVTransform(
-                   multi_pass_shader[SHADER2].uniform_location[UNIFORM_UV_TRANSFORM], so);
+                   multi_pass_shader_table[SHADER2].uniform_location[UNIFORM_UV_TRANSFORM], so);
            break;
         case SHADER3 : // Plain texture-mapped object lighting pass shader for point source lights.
-            glUseProgram(multi_pass_shader[SHADER3].program);
-            GL3InitializeShaderWithMVP(multi_pass_shader[SHADER3].uniform_location[UNIFORM_MVP], so);
-            GL3InitializeShaderWithModelMatrix(multi_pass_shader[SHADER3].uniform_location[UNIFORM_MODEL_MATRIX], so);
+            UseMultiPassProgram(SHADER3);
+            GL3InitializeShaderWithMVP(multi_pass_shader_table[SHADER3].uniform_location[UNIFORM_MVP], so);
+            GL3InitializeShaderWithModelMatrix(multi_pass_shader_table[SHADER3].uniform_location[UNIFORM_MODEL_MATRIX], so);
             GL3InitializeShaderWithModelRotationMatrix(
-                multi_pass_shader[SHADER3].uniform_location[UNIFORM_MODEL_ROTATION_MATRIX], so);
+                multi_pass_shader_table[SHADER3].uniform_location[UNIFORM_MODEL_ROTATION_MATRIX], so);
             GL3InitializeShaderWithDiffuseReflectionColor(
-                multi_pass_shader[SHADER3].uniform_location[UNIFORM_DIFFUSE_REFLECTION_COLOR], so);
+                multi_pass_shader_table[SHADER3].uniform_location[UNIFORM_DIFFUSE_REFLECTION_COLOR], so);
             GL3InitializeShaderWithSpecularReflectionColor(
-                multi_pass_shader[SHADER3].uniform_location[UNIFORM_SPECULAR_REFLECTION_COLOR], so);
+                multi_pass_shader_table[SHADER3].uniform_location[UNIFORM_SPECULAR_REFLECTION_COLOR], so);
             GL3InitializeShaderWithSpecularExponent(
-                multi_pass_shader[SHADER3].uniform_location[UNIFORM_SPECULAR_EXPONENT], so);
+                multi_pass_shader_table[SHADER3].uniform_location[UNIFORM_SPECULAR_EXPONENT], so);
             GL3InitializeShaderWithObjectTexture(so);
             GL3InitializeShaderWithUVTransform(
-                multi_pass_shader[SHADER3].uniform_location[UNIFORM_UV_TRANSFORM], so);
+                multi_pass_shader_table[SHADER3].uniform_location[UNIFORM_UV_TRANSFORM], so);
             break;
         case SHADER4 : // Complete lighting pass shader for directional lights.
-            glUseProgram(multi_pass_shader[SHADER4].program);
-            GL3InitializeShaderWithMVP(multi_pass_shader[SHADER4].uniform_location[UNIFORM_MVP], so);
-            GL3InitializeShaderWithModelMatrix(multi_pass_shader[SHADER4].uniform_location[UNIFORM_MODEL_MATRIX], so);
+            UseMultiPassProgram(SHADER4);
+            GL3InitializeShaderWithMVP(multi_pass_shader_table[SHADER4].uniform_location[UNIFORM_MVP], so);
+            GL3InitializeShaderWithModelMatrix(multi_pass_shader_table[SHADER4].uniform_location[UNIFORM_MODEL_MATRIX], so);
             GL3InitializeShaderWithModelRotationMatrix(
-                multi_pass_shader[SHADER4].uniform_location[UNIFORM_MODEL_ROTATION_MATRIX], so);
+                multi_pass_shader_table[SHADER4].uniform_location[UNIFORM_MODEL_ROTATION_MATRIX], so);
             GL3InitializeShaderWithDiffuseReflectionColor(
-                multi_pass_shader[SHADER4].uniform_location[UNIFORM_DIFFUSE_REFLECTION_COLOR], so);
-            GL3InitializeShaderWithMultiColor(multi_pass_shader[SHADER4].uniform_location[UNIFORM_USE_MULTI_COLOR], so);
-            GL3InitializeShaderWithUseTexture(multi_pass_shader[SHADER4].uniform_location[UNIFORM_USE_TEXTURE_MAP], so);
+                multi_pass_shader_table[SHADER4].uniform_location[UNIFORM_DIFFUSE_REFLECTION_COLOR], so);
+            GL3InitializeShaderWithMultiColor(multi_pass_shader_table[SHADER4].uniform_location[UNIFORM_USE_MULTI_COLOR], so);
+            GL3InitializeShaderWithUseTexture(multi_pass_shader_table[SHADER4].uniform_location[UNIFORM_USE_TEXTURE_MAP], so);
             GL3InitializeShaderWithSpecularReflectionColor(
-                multi_pass_shader[SHADER4].uniform_location[UNIFORM_SPECULAR_REFLECTION_COLOR], so);
+                multi_pass_shader_table[SHADER4].uniform_location[UNIFORM_SPECULAR_REFLECTION_COLOR], so);
             GL3InitializeShaderWithSpecularExponent(
-                multi_pass_shader[SHADER4].uniform_location[UNIFORM_SPECULAR_EXPONENT], so);
+                multi_pass_shader_table[SHADER4].uniform_location[UNIFORM_SPECULAR_EXPONENT], so);
             if (flags & SRE_OBJECT_USE_TEXTURE)
                 GL3InitializeShaderWithObjectTexture(so);
-            GL3InitializeShaderWithUseNormalMap(multi_pass_shader[SHADER4].uniform_location[UNIFORM_USE_NORMAL_MAP], so);
+            GL3InitializeShaderWithUseNormalMap(multi_pass_shader_table[SHADER4].uniform_location[UNIFORM_USE_NORMAL_MAP], so);
             if (flags & SRE_OBJECT_USE_NORMAL_MAP)
                 GL3InitializeShaderWithObjectNormalMap(so);
-            GL3InitializeShaderWithUseSpecularMap(multi_pass_shader[SHADER4].uniform_location[UNIFORM_USE_SPECULARITY_MAP], so);
+            GL3InitializeShaderWithUseSpecularMap(multi_pass_shader_table[SHADER4].uniform_location[UNIFORM_USE_SPECULARITY_MAP], so);
             if (flags & SRE_OBJECT_USE_SPECULARITY_MAP)
                 GL3InitializeShaderWithObjectSpecularMap(so);
             if (flags & (SRE_OBJECT_USE_TEXTURE | SRE_OBJECT_USE_NORMAL_MAP |
             SRE_OBJECT_USE_SPECULARITY_MAP))
                GL3InitializeShaderWithUVTransform(
-                   multi_pass_shader[SHADER4].uniform_location[UNIFORM_UV_TRANSFORM], so);
+                   multi_pass_shader_table[SHADER4].uniform_location[UNIFORM_UV_TRANSFORM], so);
             break;
         case SHADER5: // Plain texture mapped object lighting pass shader for directional lights.
-            glUseProgram(multi_pass_shader[SHADER5].program);
-            GL3InitializeShaderWithMVP(multi_pass_shader[SHADER5].uniform_location[UNIFORM_MVP], so);
-            GL3InitializeShaderWithModelMatrix(multi_pass_shader[SHADER5].uniform_location[UNIFORM_MODEL_MATRIX], so);
+            UseMultiPassProgram(SHADER5);
+            GL3InitializeShaderWithMVP(multi_pass_shader_table[SHADER5].uniform_location[UNIFORM_MVP], so);
+            GL3InitializeShaderWithModelMatrix(multi_pass_shader_table[SHADER5].uniform_location[UNIFORM_MODEL_MATRIX], so);
             GL3InitializeShaderWithModelRotationMatrix(
-                multi_pass_shader[SHADER5].uniform_location[UNIFORM_MODEL_ROTATION_MATRIX], so);
+                multi_pass_shader_table[SHADER5].uniform_location[UNIFORM_MODEL_ROTATION_MATRIX], so);
             GL3InitializeShaderWithDiffuseReflectionColor(
-                multi_pass_shader[SHADER5].uniform_location[UNIFORM_DIFFUSE_REFLECTION_COLOR], so);
+                multi_pass_shader_table[SHADER5].uniform_location[UNIFORM_DIFFUSE_REFLECTION_COLOR], so);
             GL3InitializeShaderWithSpecularReflectionColor(
-                multi_pass_shader[SHADER5].uniform_location[UNIFORM_SPECULAR_REFLECTION_COLOR], so);
+                multi_pass_shader_table[SHADER5].uniform_location[UNIFORM_SPECULAR_REFLECTION_COLOR], so);
             GL3InitializeShaderWithSpecularExponent(
-                multi_pass_shader[SHADER5].uniform_location[UNIFORM_SPECULAR_EXPONENT], so);
+                multi_pass_shader_table[SHADER5].uniform_location[UNIFORM_SPECULAR_EXPONENT], so);
             GL3InitializeShaderWithObjectTexture(so);
             GL3InitializeShaderWithUVTransform(
-                multi_pass_shader[SHADER5].uniform_location[UNIFORM_UV_TRANSFORM], so);
+                multi_pass_shader_table[SHADER5].uniform_location[UNIFORM_UV_TRANSFORM], so);
             break;
         case SHADER6 :	// Complete lighting pass shader for point source lights.
-            glUseProgram(multi_pass_shader[SHADER6].program);
-            GL3InitializeShaderWithMVP(multi_pass_shader[SHADER6].uniform_location[UNIFORM_MVP], so);
-            GL3InitializeShaderWithModelMatrix(multi_pass_shader[SHADER6].uniform_location[UNIFORM_MODEL_MATRIX], so);
+            UseMultiPassProgram(SHADER6);
+            GL3InitializeShaderWithMVP(multi_pass_shader_table[SHADER6].uniform_location[UNIFORM_MVP], so);
+            GL3InitializeShaderWithModelMatrix(multi_pass_shader_table[SHADER6].uniform_location[UNIFORM_MODEL_MATRIX], so);
             GL3InitializeShaderWithModelRotationMatrix(
-                multi_pass_shader[SHADER6].uniform_location[UNIFORM_MODEL_ROTATION_MATRIX], so);
+                multi_pass_shader_table[SHADER6].uniform_location[UNIFORM_MODEL_ROTATION_MATRIX], so);
             GL3InitializeShaderWithDiffuseReflectionColor(
-                multi_pass_shader[SHADER6].uniform_location[UNIFORM_DIFFUSE_REFLECTION_COLOR], so);
-            GL3InitializeShaderWithMultiColor(multi_pass_shader[SHADER6].uniform_location[UNIFORM_USE_MULTI_COLOR], so);
-            GL3InitializeShaderWithUseTexture(multi_pass_shader[SHADER6].uniform_location[UNIFORM_USE_TEXTURE_MAP], so);
+                multi_pass_shader_table[SHADER6].uniform_location[UNIFORM_DIFFUSE_REFLECTION_COLOR], so);
+            GL3InitializeShaderWithMultiColor(multi_pass_shader_table[SHADER6].uniform_location[UNIFORM_USE_MULTI_COLOR], so);
+            GL3InitializeShaderWithUseTexture(multi_pass_shader_table[SHADER6].uniform_location[UNIFORM_USE_TEXTURE_MAP], so);
             GL3InitializeShaderWithSpecularReflectionColor(
-                multi_pass_shader[SHADER6].uniform_location[UNIFORM_SPECULAR_REFLECTION_COLOR], so);
+                multi_pass_shader_table[SHADER6].uniform_location[UNIFORM_SPECULAR_REFLECTION_COLOR], so);
             GL3InitializeShaderWithSpecularExponent(
-                multi_pass_shader[SHADER6].uniform_location[UNIFORM_SPECULAR_EXPONENT], so);
+                multi_pass_shader_table[SHADER6].uniform_location[UNIFORM_SPECULAR_EXPONENT], so);
             if (flags & SRE_OBJECT_USE_TEXTURE)
                 GL3InitializeShaderWithObjectTexture(so);
-            GL3InitializeShaderWithUseNormalMap(multi_pass_shader[SHADER6].uniform_location[UNIFORM_USE_NORMAL_MAP], so);
+            GL3InitializeShaderWithUseNormalMap(multi_pass_shader_table[SHADER6].uniform_location[UNIFORM_USE_NORMAL_MAP], so);
             if (flags & SRE_OBJECT_USE_NORMAL_MAP)
                 GL3InitializeShaderWithObjectNormalMap(so);
-            GL3InitializeShaderWithUseSpecularMap(multi_pass_shader[SHADER6].uniform_location[UNIFORM_USE_SPECULARITY_MAP], so);
+            GL3InitializeShaderWithUseSpecularMap(multi_pass_shader_table[SHADER6].uniform_location[UNIFORM_USE_SPECULARITY_MAP], so);
             if (flags & SRE_OBJECT_USE_SPECULARITY_MAP)
                 GL3InitializeShaderWithObjectSpecularMap(so);
             if (flags & (SRE_OBJECT_USE_TEXTURE | SRE_OBJECT_USE_NORMAL_MAP |
             SRE_OBJECT_USE_SPECULARITY_MAP))
                GL3InitializeShaderWithUVTransform(
-                   multi_pass_shader[SHADER6].uniform_location[UNIFORM_UV_TRANSFORM], so);
+                   multi_pass_shader_table[SHADER6].uniform_location[UNIFORM_UV_TRANSFORM], so);
             break;
         case SHADER7 : // Complete lighting pass shader for point source lights 
                        // with a linear attenuation range.
-            glUseProgram(multi_pass_shader[SHADER7].program);
-            GL3InitializeShaderWithMVP(multi_pass_shader[SHADER7].uniform_location[UNIFORM_MVP], so);
-            GL3InitializeShaderWithModelMatrix(multi_pass_shader[SHADER7].uniform_location[UNIFORM_MODEL_MATRIX], so);
+            UseMultiPassProgram(SHADER7);
+            GL3InitializeShaderWithMVP(multi_pass_shader_table[SHADER7].uniform_location[UNIFORM_MVP], so);
+            GL3InitializeShaderWithModelMatrix(multi_pass_shader_table[SHADER7].uniform_location[UNIFORM_MODEL_MATRIX], so);
             GL3InitializeShaderWithModelRotationMatrix(
-                multi_pass_shader[SHADER7].uniform_location[UNIFORM_MODEL_ROTATION_MATRIX], so);
+                multi_pass_shader_table[SHADER7].uniform_location[UNIFORM_MODEL_ROTATION_MATRIX], so);
             GL3InitializeShaderWithDiffuseReflectionColor(
-                multi_pass_shader[SHADER7].uniform_location[UNIFORM_DIFFUSE_REFLECTION_COLOR], so);
-            GL3InitializeShaderWithMultiColor(multi_pass_shader[SHADER7].uniform_location[UNIFORM_USE_MULTI_COLOR], so);
-            GL3InitializeShaderWithUseTexture(multi_pass_shader[SHADER7].uniform_location[UNIFORM_USE_TEXTURE_MAP], so);
+                multi_pass_shader_table[SHADER7].uniform_location[UNIFORM_DIFFUSE_REFLECTION_COLOR], so);
+            GL3InitializeShaderWithMultiColor(multi_pass_shader_table[SHADER7].uniform_location[UNIFORM_USE_MULTI_COLOR], so);
+            GL3InitializeShaderWithUseTexture(multi_pass_shader_table[SHADER7].uniform_location[UNIFORM_USE_TEXTURE_MAP], so);
             GL3InitializeShaderWithSpecularReflectionColor(
-                multi_pass_shader[SHADER7].uniform_location[UNIFORM_SPECULAR_REFLECTION_COLOR], so);
+                multi_pass_shader_table[SHADER7].uniform_location[UNIFORM_SPECULAR_REFLECTION_COLOR], so);
             GL3InitializeShaderWithSpecularExponent(
-                multi_pass_shader[SHADER7].uniform_location[UNIFORM_SPECULAR_EXPONENT], so);
+                multi_pass_shader_table[SHADER7].uniform_location[UNIFORM_SPECULAR_EXPONENT], so);
             if (flags & SRE_OBJECT_USE_TEXTURE)
                 GL3InitializeShaderWithObjectTexture(so);
-            GL3InitializeShaderWithUseNormalMap(multi_pass_shader[SHADER7].uniform_location[UNIFORM_USE_NORMAL_MAP], so);
+            GL3InitializeShaderWithUseNormalMap(multi_pass_shader_table[SHADER7].uniform_location[UNIFORM_USE_NORMAL_MAP], so);
             if (flags & SRE_OBJECT_USE_NORMAL_MAP)
                 GL3InitializeShaderWithObjectNormalMap(so);
-            GL3InitializeShaderWithUseSpecularMap(multi_pass_shader[SHADER7].uniform_location[UNIFORM_USE_SPECULARITY_MAP], so);
+            GL3InitializeShaderWithUseSpecularMap(multi_pass_shader_table[SHADER7].uniform_location[UNIFORM_USE_SPECULARITY_MAP], so);
             if (flags & SRE_OBJECT_USE_SPECULARITY_MAP)
                 GL3InitializeShaderWithObjectSpecularMap(so);
             if (flags & (SRE_OBJECT_USE_TEXTURE | SRE_OBJECT_USE_NORMAL_MAP |
             SRE_OBJECT_USE_SPECULARITY_MAP))
                GL3InitializeShaderWithUVTransform(
-                   multi_pass_shader[SHADER7].uniform_location[UNIFORM_UV_TRANSFORM], so);
+                   multi_pass_shader_table[SHADER7].uniform_location[UNIFORM_UV_TRANSFORM], so);
             break;
         case SHADER8 : // Complete lighting pass shader for spot lights.
-            glUseProgram(multi_pass_shader[SHADER8].program);
-            GL3InitializeShaderWithMVP(multi_pass_shader[SHADER8].uniform_location[UNIFORM_MVP], so);
-            GL3InitializeShaderWithModelMatrix(multi_pass_shader[SHADER8].uniform_location[UNIFORM_MODEL_MATRIX], so);
+            UseMultiPassProgram(SHADER8);
+            GL3InitializeShaderWithMVP(multi_pass_shader_table[SHADER8].uniform_location[UNIFORM_MVP], so);
+            GL3InitializeShaderWithModelMatrix(multi_pass_shader_table[SHADER8].uniform_location[UNIFORM_MODEL_MATRIX], so);
             GL3InitializeShaderWithModelRotationMatrix(
-                multi_pass_shader[SHADER8].uniform_location[UNIFORM_MODEL_ROTATION_MATRIX], so);
+                multi_pass_shader_table[SHADER8].uniform_location[UNIFORM_MODEL_ROTATION_MATRIX], so);
             GL3InitializeShaderWithDiffuseReflectionColor(
-                multi_pass_shader[SHADER8].uniform_location[UNIFORM_DIFFUSE_REFLECTION_COLOR], so);
-            GL3InitializeShaderWithMultiColor(multi_pass_shader[SHADER8].uniform_location[UNIFORM_USE_MULTI_COLOR], so);
-            GL3InitializeShaderWithUseTexture(multi_pass_shader[SHADER8].uniform_location[UNIFORM_USE_TEXTURE_MAP], so);
+                multi_pass_shader_table[SHADER8].uniform_location[UNIFORM_DIFFUSE_REFLECTION_COLOR], so);
+            GL3InitializeShaderWithMultiColor(multi_pass_shader_table[SHADER8].uniform_location[UNIFORM_USE_MULTI_COLOR], so);
+            GL3InitializeShaderWithUseTexture(multi_pass_shader_table[SHADER8].uniform_location[UNIFORM_USE_TEXTURE_MAP], so);
             GL3InitializeShaderWithSpecularReflectionColor(
-                multi_pass_shader[SHADER8].uniform_location[UNIFORM_SPECULAR_REFLECTION_COLOR], so);
+                multi_pass_shader_table[SHADER8].uniform_location[UNIFORM_SPECULAR_REFLECTION_COLOR], so);
             GL3InitializeShaderWithSpecularExponent(
-                multi_pass_shader[SHADER8].uniform_location[UNIFORM_SPECULAR_EXPONENT], so);
+                multi_pass_shader_table[SHADER8].uniform_location[UNIFORM_SPECULAR_EXPONENT], so);
             if (flags & SRE_OBJECT_USE_TEXTURE)
                 GL3InitializeShaderWithObjectTexture(so);
-            GL3InitializeShaderWithUseNormalMap(multi_pass_shader[SHADER8].uniform_location[UNIFORM_USE_NORMAL_MAP], so);
+            GL3InitializeShaderWithUseNormalMap(multi_pass_shader_table[SHADER8].uniform_location[UNIFORM_USE_NORMAL_MAP], so);
             if (flags & SRE_OBJECT_USE_NORMAL_MAP)
                 GL3InitializeShaderWithObjectNormalMap(so);
-            GL3InitializeShaderWithUseSpecularMap(multi_pass_shader[SHADER8].uniform_location[UNIFORM_USE_SPECULARITY_MAP], so);
+            GL3InitializeShaderWithUseSpecularMap(multi_pass_shader_table[SHADER8].uniform_location[UNIFORM_USE_SPECULARITY_MAP], so);
             if (flags & SRE_OBJECT_USE_SPECULARITY_MAP)
                 GL3InitializeShaderWithObjectSpecularMap(so);
             if (flags & (SRE_OBJECT_USE_TEXTURE | SRE_OBJECT_USE_NORMAL_MAP |
             SRE_OBJECT_USE_SPECULARITY_MAP))
                GL3InitializeShaderWithUVTransform(
-                   multi_pass_shader[SHADER8].uniform_location[UNIFORM_UV_TRANSFORM], so);
+                   multi_pass_shader_table[SHADER8].uniform_location[UNIFORM_UV_TRANSFORM], so);
             break;
         case SHADER9 : // Plain Phong-shading lighting pass shader for point source lights/
                        // spot lights/beam lights with a linear attenuation range.
-            glUseProgram(multi_pass_shader[SHADER9].program);
-            GL3InitializeShaderWithMVP(multi_pass_shader[SHADER9].uniform_location[UNIFORM_MVP], so);
-            GL3InitializeShaderWithModelMatrix(multi_pass_shader[SHADER9].uniform_location[UNIFORM_MODEL_MATRIX], so);
+            UseMultiPassProgram(SHADER9);
+            GL3InitializeShaderWithMVP(multi_pass_shader_table[SHADER9].uniform_location[UNIFORM_MVP], so);
+            GL3InitializeShaderWithModelMatrix(multi_pass_shader_table[SHADER9].uniform_location[UNIFORM_MODEL_MATRIX], so);
             GL3InitializeShaderWithModelRotationMatrix(
-                multi_pass_shader[SHADER9].uniform_location[UNIFORM_MODEL_ROTATION_MATRIX], so);
+                multi_pass_shader_table[SHADER9].uniform_location[UNIFORM_MODEL_ROTATION_MATRIX], so);
             GL3InitializeShaderWithDiffuseReflectionColor(
-                multi_pass_shader[SHADER9].uniform_location[UNIFORM_DIFFUSE_REFLECTION_COLOR], so);
+                multi_pass_shader_table[SHADER9].uniform_location[UNIFORM_DIFFUSE_REFLECTION_COLOR], so);
             GL3InitializeShaderWithSpecularReflectionColor(
-                multi_pass_shader[SHADER9].uniform_location[UNIFORM_SPECULAR_REFLECTION_COLOR], so);
+                multi_pass_shader_table[SHADER9].uniform_location[UNIFORM_SPECULAR_REFLECTION_COLOR], so);
             GL3InitializeShaderWithSpecularExponent(
-                multi_pass_shader[SHADER9].uniform_location[UNIFORM_SPECULAR_EXPONENT], so);
+                multi_pass_shader_table[SHADER9].uniform_location[UNIFORM_SPECULAR_EXPONENT], so);
             break;
         case SHADER10 :	// Complete lighting pass shader with microfacet reflection model.
-            glUseProgram(multi_pass_shader[SHADER10].program);
-            GL3InitializeShaderWithMVP(multi_pass_shader[SHADER10].uniform_location[UNIFORM_MVP], so);
-            GL3InitializeShaderWithModelMatrix(multi_pass_shader[SHADER10].uniform_location[UNIFORM_MODEL_MATRIX], so);
+            UseMultiPassProgram(SHADER10);
+            GL3InitializeShaderWithMVP(multi_pass_shader_table[SHADER10].uniform_location[UNIFORM_MVP], so);
+            GL3InitializeShaderWithModelMatrix(multi_pass_shader_table[SHADER10].uniform_location[UNIFORM_MODEL_MATRIX], so);
             GL3InitializeShaderWithModelRotationMatrix(
-                multi_pass_shader[SHADER10].uniform_location[UNIFORM_MODEL_ROTATION_MATRIX], so);
+                multi_pass_shader_table[SHADER10].uniform_location[UNIFORM_MODEL_ROTATION_MATRIX], so);
             GL3InitializeShaderWithDiffuseReflectionColor(
-                multi_pass_shader[SHADER10].uniform_location[UNIFORM_DIFFUSE_REFLECTION_COLOR], so);
-            GL3InitializeShaderWithMultiColor(multi_pass_shader[SHADER10].uniform_location[UNIFORM_USE_MULTI_COLOR], so);
-            GL3InitializeShaderWithUseTexture(multi_pass_shader[SHADER10].uniform_location[UNIFORM_USE_TEXTURE_MAP], so);
+                multi_pass_shader_table[SHADER10].uniform_location[UNIFORM_DIFFUSE_REFLECTION_COLOR], so);
+            GL3InitializeShaderWithMultiColor(multi_pass_shader_table[SHADER10].uniform_location[UNIFORM_USE_MULTI_COLOR], so);
+            GL3InitializeShaderWithUseTexture(multi_pass_shader_table[SHADER10].uniform_location[UNIFORM_USE_TEXTURE_MAP], so);
             GL3InitializeShaderWithSpecularReflectionColor(
-                multi_pass_shader[SHADER10].uniform_location[UNIFORM_SPECULAR_REFLECTION_COLOR], so);
+                multi_pass_shader_table[SHADER10].uniform_location[UNIFORM_SPECULAR_REFLECTION_COLOR], so);
             if (flags & SRE_OBJECT_USE_TEXTURE)
                 GL3InitializeShaderWithObjectTexture(so);
-            GL3InitializeShaderWithUseNormalMap(multi_pass_shader[SHADER10].uniform_location[UNIFORM_USE_NORMAL_MAP], so);
+            GL3InitializeShaderWithUseNormalMap(multi_pass_shader_table[SHADER10].uniform_location[UNIFORM_USE_NORMAL_MAP], so);
             if (flags & SRE_OBJECT_USE_NORMAL_MAP)
                 GL3InitializeShaderWithObjectNormalMap(so);
             GL3InitializeShaderWithUseSpecularMap(
-                multi_pass_shader[SHADER10].uniform_location[UNIFORM_USE_SPECULARITY_MAP], so);
+                multi_pass_shader_table[SHADER10].uniform_location[UNIFORM_USE_SPECULARITY_MAP], so);
             if (flags & SRE_OBJECT_USE_SPECULARITY_MAP)
                 GL3InitializeShaderWithObjectSpecularMap(so);
             if (flags & (SRE_OBJECT_USE_TEXTURE | SRE_OBJECT_USE_NORMAL_MAP |
             SRE_OBJECT_USE_SPECULARITY_MAP))
                GL3InitializeShaderWithUVTransform(
-                   multi_pass_shader[SHADER10].uniform_location[UNIFORM_UV_TRANSFORM], so);
+                   multi_pass_shader_table[SHADER10].uniform_location[UNIFORM_UV_TRANSFORM], so);
             GL3InitializeShaderWithDiffuseFraction(
-                multi_pass_shader[SHADER10].uniform_location[UNIFORM_DIFFUSE_FRACTION], so);
+                multi_pass_shader_table[SHADER10].uniform_location[UNIFORM_DIFFUSE_FRACTION], so);
             GL3InitializeShaderWithRoughness(
-                multi_pass_shader[SHADER10].uniform_location[UNIFORM_ROUGHNESS], so);
+                multi_pass_shader_table[SHADER10].uniform_location[UNIFORM_ROUGHNESS], so);
             GL3InitializeShaderWithRoughnessWeights(
-                multi_pass_shader[SHADER10].uniform_location[UNIFORM_ROUGHNESS_WEIGHTS], so);
+                multi_pass_shader_table[SHADER10].uniform_location[UNIFORM_ROUGHNESS_WEIGHTS], so);
             GL3InitializeShaderWithAnisotropic(
-                multi_pass_shader[SHADER10].uniform_location[UNIFORM_ANISOTROPIC], so);
+                multi_pass_shader_table[SHADER10].uniform_location[UNIFORM_ANISOTROPIC], so);
             break;
         case SHADER11 :	// Complete lighting pass shader with microfacet reflection model for
                         // point lights/spot lights/beam lights with a linear attenuation range.
-            glUseProgram(multi_pass_shader[SHADER11].program);
-            GL3InitializeShaderWithMVP(multi_pass_shader[SHADER11].uniform_location[UNIFORM_MVP], so);
-            GL3InitializeShaderWithModelMatrix(multi_pass_shader[SHADER11].uniform_location[UNIFORM_MODEL_MATRIX], so);
+            UseMultiPassProgram(SHADER11);
+            GL3InitializeShaderWithMVP(multi_pass_shader_table[SHADER11].uniform_location[UNIFORM_MVP], so);
+            GL3InitializeShaderWithModelMatrix(multi_pass_shader_table[SHADER11].uniform_location[UNIFORM_MODEL_MATRIX], so);
             GL3InitializeShaderWithModelRotationMatrix(
-                multi_pass_shader[SHADER11].uniform_location[UNIFORM_MODEL_ROTATION_MATRIX], so);
+                multi_pass_shader_table[SHADER11].uniform_location[UNIFORM_MODEL_ROTATION_MATRIX], so);
             GL3InitializeShaderWithDiffuseReflectionColor(
-                multi_pass_shader[SHADER11].uniform_location[UNIFORM_DIFFUSE_REFLECTION_COLOR], so);
-            GL3InitializeShaderWithMultiColor(multi_pass_shader[SHADER11].uniform_location[UNIFORM_USE_MULTI_COLOR], so);
-            GL3InitializeShaderWithUseTexture(multi_pass_shader[SHADER11].uniform_location[UNIFORM_USE_TEXTURE_MAP], so);
+                multi_pass_shader_table[SHADER11].uniform_location[UNIFORM_DIFFUSE_REFLECTION_COLOR], so);
+            GL3InitializeShaderWithMultiColor(multi_pass_shader_table[SHADER11].uniform_location[UNIFORM_USE_MULTI_COLOR], so);
+            GL3InitializeShaderWithUseTexture(multi_pass_shader_table[SHADER11].uniform_location[UNIFORM_USE_TEXTURE_MAP], so);
             GL3InitializeShaderWithSpecularReflectionColor(
-                multi_pass_shader[SHADER11].uniform_location[UNIFORM_SPECULAR_REFLECTION_COLOR], so);
+                multi_pass_shader_table[SHADER11].uniform_location[UNIFORM_SPECULAR_REFLECTION_COLOR], so);
             if (flags & SRE_OBJECT_USE_TEXTURE)
                 GL3InitializeShaderWithObjectTexture(so);
-            GL3InitializeShaderWithUseNormalMap(multi_pass_shader[SHADER11].uniform_location[UNIFORM_USE_NORMAL_MAP], so);
+            GL3InitializeShaderWithUseNormalMap(multi_pass_shader_table[SHADER11].uniform_location[UNIFORM_USE_NORMAL_MAP], so);
             if (flags & SRE_OBJECT_USE_NORMAL_MAP)
                 GL3InitializeShaderWithObjectNormalMap(so);
             GL3InitializeShaderWithUseSpecularMap(
-                multi_pass_shader[SHADER11].uniform_location[UNIFORM_USE_SPECULARITY_MAP], so);
+                multi_pass_shader_table[SHADER11].uniform_location[UNIFORM_USE_SPECULARITY_MAP], so);
             if (flags & SRE_OBJECT_USE_SPECULARITY_MAP)
                 GL3InitializeShaderWithObjectSpecularMap(so);
             if (flags & (SRE_OBJECT_USE_TEXTURE | SRE_OBJECT_USE_NORMAL_MAP |
             SRE_OBJECT_USE_SPECULARITY_MAP))
                GL3InitializeShaderWithUVTransform(
-                   multi_pass_shader[SHADER11].uniform_location[UNIFORM_UV_TRANSFORM], so);
+                   multi_pass_shader_table[SHADER11].uniform_location[UNIFORM_UV_TRANSFORM], so);
             GL3InitializeShaderWithDiffuseFraction(
-                multi_pass_shader[SHADER11].uniform_location[UNIFORM_DIFFUSE_FRACTION], so);
+                multi_pass_shader_table[SHADER11].uniform_location[UNIFORM_DIFFUSE_FRACTION], so);
             GL3InitializeShaderWithRoughness(
-                multi_pass_shader[SHADER11].uniform_location[UNIFORM_ROUGHNESS], so);
+                multi_pass_shader_table[SHADER11].uniform_location[UNIFORM_ROUGHNESS], so);
             GL3InitializeShaderWithRoughnessWeights(
-                multi_pass_shader[SHADER11].uniform_location[UNIFORM_ROUGHNESS_WEIGHTS], so);
+                multi_pass_shader_table[SHADER11].uniform_location[UNIFORM_ROUGHNESS_WEIGHTS], so);
             GL3InitializeShaderWithAnisotropic(
-                multi_pass_shader[SHADER11].uniform_location[UNIFORM_ANISOTROPIC], so);
+                multi_pass_shader_table[SHADER11].uniform_location[UNIFORM_ANISOTROPIC], so);
             break;
 #ifndef NO_SHADOW_MAP
         case SHADER12 : // Shadow map, directional light.
-            glUseProgram(multi_pass_shader[SHADER12].program);
-            GL3InitializeShaderWithMVP(multi_pass_shader[SHADER12].uniform_location[UNIFORM_MVP], so);
-            GL3InitializeShaderWithModelMatrix(multi_pass_shader[SHADER12].uniform_location[UNIFORM_MODEL_MATRIX], so);
+            UseMultiPassProgram(SHADER12);
+            GL3InitializeShaderWithMVP(multi_pass_shader_table[SHADER12].uniform_location[UNIFORM_MVP], so);
+            GL3InitializeShaderWithModelMatrix(multi_pass_shader_table[SHADER12].uniform_location[UNIFORM_MODEL_MATRIX], so);
             GL3InitializeShaderWithModelRotationMatrix(
-                multi_pass_shader[SHADER12].uniform_location[UNIFORM_MODEL_ROTATION_MATRIX], so);
+                multi_pass_shader_table[SHADER12].uniform_location[UNIFORM_MODEL_ROTATION_MATRIX], so);
             GL3InitializeShaderWithDiffuseReflectionColor(
-                multi_pass_shader[SHADER12].uniform_location[UNIFORM_DIFFUSE_REFLECTION_COLOR], so);
-            GL3InitializeShaderWithMultiColor(multi_pass_shader[SHADER12].uniform_location[UNIFORM_USE_MULTI_COLOR], so);
-            GL3InitializeShaderWithUseTexture(multi_pass_shader[SHADER12].uniform_location[UNIFORM_USE_TEXTURE_MAP], so);
+                multi_pass_shader_table[SHADER12].uniform_location[UNIFORM_DIFFUSE_REFLECTION_COLOR], so);
+            GL3InitializeShaderWithMultiColor(multi_pass_shader_table[SHADER12].uniform_location[UNIFORM_USE_MULTI_COLOR], so);
+            GL3InitializeShaderWithUseTexture(multi_pass_shader_table[SHADER12].uniform_location[UNIFORM_USE_TEXTURE_MAP], so);
             GL3InitializeShaderWithSpecularReflectionColor(
-                multi_pass_shader[SHADER12].uniform_location[UNIFORM_SPECULAR_REFLECTION_COLOR], so);
+                multi_pass_shader_table[SHADER12].uniform_location[UNIFORM_SPECULAR_REFLECTION_COLOR], so);
             GL3InitializeShaderWithSpecularExponent(
-                multi_pass_shader[SHADER12].uniform_location[UNIFORM_SPECULAR_EXPONENT], so);
+                multi_pass_shader_table[SHADER12].uniform_location[UNIFORM_SPECULAR_EXPONENT], so);
             if (flags & SRE_OBJECT_USE_TEXTURE)
                 GL3InitializeShaderWithObjectTexture(so);
-            GL3InitializeShaderWithUseNormalMap(multi_pass_shader[SHADER12].uniform_location[UNIFORM_USE_NORMAL_MAP], so);
+            GL3InitializeShaderWithUseNormalMap(multi_pass_shader_table[SHADER12].uniform_location[UNIFORM_USE_NORMAL_MAP], so);
             if (flags & SRE_OBJECT_USE_NORMAL_MAP)
                 GL3InitializeShaderWithObjectNormalMap(so);
-            GL3InitializeShaderWithUseSpecularMap(multi_pass_shader[SHADER12].uniform_location[UNIFORM_USE_SPECULARITY_MAP], so);
+            GL3InitializeShaderWithUseSpecularMap(multi_pass_shader_table[SHADER12].uniform_location[UNIFORM_USE_SPECULARITY_MAP], so);
             if (flags & SRE_OBJECT_USE_SPECULARITY_MAP)
                 GL3InitializeShaderWithObjectSpecularMap(so);
             if (flags & (SRE_OBJECT_USE_TEXTURE | SRE_OBJECT_USE_NORMAL_MAP |
             SRE_OBJECT_USE_SPECULARITY_MAP))
                GL3InitializeShaderWithUVTransform(
-                   multi_pass_shader[SHADER12].uniform_location[UNIFORM_UV_TRANSFORM], so);
+                   multi_pass_shader_table[SHADER12].uniform_location[UNIFORM_UV_TRANSFORM], so);
             GL3InitializeShaderWithShadowMapTransformationMatrix(
-                multi_pass_shader[SHADER12].uniform_location[UNIFORM_SHADOW_MAP_TRANSFORMATION_MATRIX], so);
+                multi_pass_shader_table[SHADER12].uniform_location[UNIFORM_SHADOW_MAP_TRANSFORMATION_MATRIX], so);
             break;
         case SHADER13 : // Shadow cube-map, point source light with linear attenuation range.
-            glUseProgram(multi_pass_shader[SHADER13].program);
-            GL3InitializeShaderWithMVP(multi_pass_shader[SHADER13].uniform_location[UNIFORM_MVP], so);
-            GL3InitializeShaderWithModelMatrix(multi_pass_shader[SHADER13].uniform_location[UNIFORM_MODEL_MATRIX], so);
+            UseMultiPassProgram(SHADER13);
+            GL3InitializeShaderWithMVP(multi_pass_shader_table[SHADER13].uniform_location[UNIFORM_MVP], so);
+            GL3InitializeShaderWithModelMatrix(multi_pass_shader_table[SHADER13].uniform_location[UNIFORM_MODEL_MATRIX], so);
             GL3InitializeShaderWithModelRotationMatrix(
-                multi_pass_shader[SHADER13].uniform_location[UNIFORM_MODEL_ROTATION_MATRIX], so);
+                multi_pass_shader_table[SHADER13].uniform_location[UNIFORM_MODEL_ROTATION_MATRIX], so);
             GL3InitializeShaderWithDiffuseReflectionColor(
-                multi_pass_shader[SHADER13].uniform_location[UNIFORM_DIFFUSE_REFLECTION_COLOR], so);
-            GL3InitializeShaderWithMultiColor(multi_pass_shader[SHADER13].uniform_location[UNIFORM_USE_MULTI_COLOR], so);
-            GL3InitializeShaderWithUseTexture(multi_pass_shader[SHADER13].uniform_location[UNIFORM_USE_TEXTURE_MAP], so);
+                multi_pass_shader_table[SHADER13].uniform_location[UNIFORM_DIFFUSE_REFLECTION_COLOR], so);
+            GL3InitializeShaderWithMultiColor(multi_pass_shader_table[SHADER13].uniform_location[UNIFORM_USE_MULTI_COLOR], so);
+            GL3InitializeShaderWithUseTexture(multi_pass_shader_table[SHADER13].uniform_location[UNIFORM_USE_TEXTURE_MAP], so);
             GL3InitializeShaderWithSpecularReflectionColor(
-                multi_pass_shader[SHADER13].uniform_location[UNIFORM_SPECULAR_REFLECTION_COLOR], so);
+                multi_pass_shader_table[SHADER13].uniform_location[UNIFORM_SPECULAR_REFLECTION_COLOR], so);
             GL3InitializeShaderWithSpecularExponent(
-                multi_pass_shader[SHADER13].uniform_location[UNIFORM_SPECULAR_EXPONENT], so);
+                multi_pass_shader_table[SHADER13].uniform_location[UNIFORM_SPECULAR_EXPONENT], so);
             if (flags & SRE_OBJECT_USE_TEXTURE)
                 GL3InitializeShaderWithObjectTexture(so);
-            GL3InitializeShaderWithUseNormalMap(multi_pass_shader[SHADER13].uniform_location[UNIFORM_USE_NORMAL_MAP], so);
+            GL3InitializeShaderWithUseNormalMap(multi_pass_shader_table[SHADER13].uniform_location[UNIFORM_USE_NORMAL_MAP], so);
             if (flags & SRE_OBJECT_USE_NORMAL_MAP)
                 GL3InitializeShaderWithObjectNormalMap(so);
             GL3InitializeShaderWithUseSpecularMap(
-                multi_pass_shader[SHADER13].uniform_location[UNIFORM_USE_SPECULARITY_MAP], so);
+                multi_pass_shader_table[SHADER13].uniform_location[UNIFORM_USE_SPECULARITY_MAP], so);
             if (flags & SRE_OBJECT_USE_SPECULARITY_MAP)
                 GL3InitializeShaderWithObjectSpecularMap(so);
             if (flags & (SRE_OBJECT_USE_TEXTURE | SRE_OBJECT_USE_NORMAL_MAP |
             SRE_OBJECT_USE_SPECULARITY_MAP))
                GL3InitializeShaderWithUVTransform(
-                   multi_pass_shader[SHADER13].uniform_location[UNIFORM_UV_TRANSFORM], so);
+                   multi_pass_shader_table[SHADER13].uniform_location[UNIFORM_UV_TRANSFORM], so);
             break;
         case SHADER14 : // Complete microfacet shadow map lighting pass shader for directional lights.
-            glUseProgram(multi_pass_shader[SHADER14].program);
-            GL3InitializeShaderWithMVP(multi_pass_shader[SHADER14].uniform_location[UNIFORM_MVP], so);
-            GL3InitializeShaderWithModelMatrix(multi_pass_shader[SHADER14].uniform_location[UNIFORM_MODEL_MATRIX], so);
+            UseMultiPassProgram(SHADER14);
+            GL3InitializeShaderWithMVP(multi_pass_shader_table[SHADER14].uniform_location[UNIFORM_MVP], so);
+            GL3InitializeShaderWithModelMatrix(multi_pass_shader_table[SHADER14].uniform_location[UNIFORM_MODEL_MATRIX], so);
             GL3InitializeShaderWithModelRotationMatrix(
-                multi_pass_shader[SHADER14].uniform_location[UNIFORM_MODEL_ROTATION_MATRIX], so);
+                multi_pass_shader_table[SHADER14].uniform_location[UNIFORM_MODEL_ROTATION_MATRIX], so);
             GL3InitializeShaderWithDiffuseReflectionColor(
-                multi_pass_shader[SHADER14].uniform_location[UNIFORM_DIFFUSE_REFLECTION_COLOR], so);
-            GL3InitializeShaderWithMultiColor(multi_pass_shader[SHADER14].uniform_location[UNIFORM_USE_MULTI_COLOR], so);
-            GL3InitializeShaderWithUseTexture(multi_pass_shader[SHADER14].uniform_location[UNIFORM_USE_TEXTURE_MAP], so);
+                multi_pass_shader_table[SHADER14].uniform_location[UNIFORM_DIFFUSE_REFLECTION_COLOR], so);
+            GL3InitializeShaderWithMultiColor(multi_pass_shader_table[SHADER14].uniform_location[UNIFORM_USE_MULTI_COLOR], so);
+            GL3InitializeShaderWithUseTexture(multi_pass_shader_table[SHADER14].uniform_location[UNIFORM_USE_TEXTURE_MAP], so);
             GL3InitializeShaderWithSpecularReflectionColor(
-                multi_pass_shader[SHADER14].uniform_location[UNIFORM_SPECULAR_REFLECTION_COLOR], so);
+                multi_pass_shader_table[SHADER14].uniform_location[UNIFORM_SPECULAR_REFLECTION_COLOR], so);
             if (flags & SRE_OBJECT_USE_TEXTURE)
                 GL3InitializeShaderWithObjectTexture(so);
-            GL3InitializeShaderWithUseNormalMap(multi_pass_shader[SHADER14].uniform_location[UNIFORM_USE_NORMAL_MAP], so);
+            GL3InitializeShaderWithUseNormalMap(multi_pass_shader_table[SHADER14].uniform_location[UNIFORM_USE_NORMAL_MAP], so);
             if (flags & SRE_OBJECT_USE_NORMAL_MAP)
                 GL3InitializeShaderWithObjectNormalMap(so);
-            GL3InitializeShaderWithUseSpecularMap(multi_pass_shader[SHADER14].uniform_location[UNIFORM_USE_SPECULARITY_MAP], so);
+            GL3InitializeShaderWithUseSpecularMap(multi_pass_shader_table[SHADER14].uniform_location[UNIFORM_USE_SPECULARITY_MAP], so);
             if (flags & SRE_OBJECT_USE_SPECULARITY_MAP)
                 GL3InitializeShaderWithObjectSpecularMap(so);
             if (flags & (SRE_OBJECT_USE_TEXTURE | SRE_OBJECT_USE_NORMAL_MAP |
             SRE_OBJECT_USE_SPECULARITY_MAP))
                GL3InitializeShaderWithUVTransform(
-                   multi_pass_shader[SHADER14].uniform_location[UNIFORM_UV_TRANSFORM], so);
+                   multi_pass_shader_table[SHADER14].uniform_location[UNIFORM_UV_TRANSFORM], so);
             GL3InitializeShaderWithDiffuseFraction(
-                multi_pass_shader[SHADER14].uniform_location[UNIFORM_DIFFUSE_FRACTION], so);
+                multi_pass_shader_table[SHADER14].uniform_location[UNIFORM_DIFFUSE_FRACTION], so);
             GL3InitializeShaderWithRoughness(
-                multi_pass_shader[SHADER14].uniform_location[UNIFORM_ROUGHNESS], so);
+                multi_pass_shader_table[SHADER14].uniform_location[UNIFORM_ROUGHNESS], so);
             GL3InitializeShaderWithRoughnessWeights(
-                multi_pass_shader[SHADER14].uniform_location[UNIFORM_ROUGHNESS_WEIGHTS], so);
+                multi_pass_shader_table[SHADER14].uniform_location[UNIFORM_ROUGHNESS_WEIGHTS], so);
             GL3InitializeShaderWithAnisotropic(
-                multi_pass_shader[SHADER14].uniform_location[UNIFORM_ANISOTROPIC], so);
+                multi_pass_shader_table[SHADER14].uniform_location[UNIFORM_ANISOTROPIC], so);
             GL3InitializeShaderWithShadowMapTransformationMatrix(
-                multi_pass_shader[SHADER14].uniform_location[UNIFORM_SHADOW_MAP_TRANSFORMATION_MATRIX], so);
+                multi_pass_shader_table[SHADER14].uniform_location[UNIFORM_SHADOW_MAP_TRANSFORMATION_MATRIX], so);
             break;
         case SHADER15 : // Complete microfacet shadow map lighting pass shader for point source lights
                         // with a linear attenuation range.
-            glUseProgram(multi_pass_shader[SHADER15].program);
-            GL3InitializeShaderWithMVP(multi_pass_shader[SHADER15].uniform_location[UNIFORM_MVP], so);
-            GL3InitializeShaderWithModelMatrix(multi_pass_shader[SHADER15].uniform_location[UNIFORM_MODEL_MATRIX], so);
+            UseMultiPassProgram(SHADER15);
+            GL3InitializeShaderWithMVP(multi_pass_shader_table[SHADER15].uniform_location[UNIFORM_MVP], so);
+            GL3InitializeShaderWithModelMatrix(multi_pass_shader_table[SHADER15].uniform_location[UNIFORM_MODEL_MATRIX], so);
             GL3InitializeShaderWithModelRotationMatrix(
-                multi_pass_shader[SHADER15].uniform_location[UNIFORM_MODEL_ROTATION_MATRIX], so);
+                multi_pass_shader_table[SHADER15].uniform_location[UNIFORM_MODEL_ROTATION_MATRIX], so);
             GL3InitializeShaderWithDiffuseReflectionColor(
-                multi_pass_shader[SHADER15].uniform_location[UNIFORM_DIFFUSE_REFLECTION_COLOR], so);
-            GL3InitializeShaderWithMultiColor(multi_pass_shader[SHADER15].uniform_location[UNIFORM_USE_MULTI_COLOR], so);
-            GL3InitializeShaderWithUseTexture(multi_pass_shader[SHADER15].uniform_location[UNIFORM_USE_TEXTURE_MAP], so);
+                multi_pass_shader_table[SHADER15].uniform_location[UNIFORM_DIFFUSE_REFLECTION_COLOR], so);
+            GL3InitializeShaderWithMultiColor(multi_pass_shader_table[SHADER15].uniform_location[UNIFORM_USE_MULTI_COLOR], so);
+            GL3InitializeShaderWithUseTexture(multi_pass_shader_table[SHADER15].uniform_location[UNIFORM_USE_TEXTURE_MAP], so);
             GL3InitializeShaderWithSpecularReflectionColor(
-                multi_pass_shader[SHADER15].uniform_location[UNIFORM_SPECULAR_REFLECTION_COLOR], so);
+                multi_pass_shader_table[SHADER15].uniform_location[UNIFORM_SPECULAR_REFLECTION_COLOR], so);
             if (flags & SRE_OBJECT_USE_TEXTURE)
                 GL3InitializeShaderWithObjectTexture(so);
-            GL3InitializeShaderWithUseNormalMap(multi_pass_shader[SHADER15].uniform_location[UNIFORM_USE_NORMAL_MAP], so);
+            GL3InitializeShaderWithUseNormalMap(multi_pass_shader_table[SHADER15].uniform_location[UNIFORM_USE_NORMAL_MAP], so);
             if (flags & SRE_OBJECT_USE_NORMAL_MAP)
                 GL3InitializeShaderWithObjectNormalMap(so);
-            GL3InitializeShaderWithUseSpecularMap(multi_pass_shader[SHADER15].uniform_location[UNIFORM_USE_SPECULARITY_MAP], so);
+            GL3InitializeShaderWithUseSpecularMap(multi_pass_shader_table[SHADER15].uniform_location[UNIFORM_USE_SPECULARITY_MAP], so);
             if (flags & SRE_OBJECT_USE_SPECULARITY_MAP)
                 GL3InitializeShaderWithObjectSpecularMap(so);
             if (flags & (SRE_OBJECT_USE_TEXTURE | SRE_OBJECT_USE_NORMAL_MAP |
             SRE_OBJECT_USE_SPECULARITY_MAP))
                GL3InitializeShaderWithUVTransform(
-                   multi_pass_shader[SHADER15].uniform_location[UNIFORM_UV_TRANSFORM], so);
+                   multi_pass_shader_table[SHADER15].uniform_location[UNIFORM_UV_TRANSFORM], so);
             GL3InitializeShaderWithDiffuseFraction(
-                multi_pass_shader[SHADER15].uniform_location[UNIFORM_DIFFUSE_FRACTION], so);
+                multi_pass_shader_table[SHADER15].uniform_location[UNIFORM_DIFFUSE_FRACTION], so);
             GL3InitializeShaderWithRoughness(
-                multi_pass_shader[SHADER15].uniform_location[UNIFORM_ROUGHNESS], so);
+                multi_pass_shader_table[SHADER15].uniform_location[UNIFORM_ROUGHNESS], so);
             GL3InitializeShaderWithRoughnessWeights(
-                multi_pass_shader[SHADER15].uniform_location[UNIFORM_ROUGHNESS_WEIGHTS], so);
+                multi_pass_shader_table[SHADER15].uniform_location[UNIFORM_ROUGHNESS_WEIGHTS], so);
             GL3InitializeShaderWithAnisotropic(
-                multi_pass_shader[SHADER15].uniform_location[UNIFORM_ANISOTROPIC], so);
+                multi_pass_shader_table[SHADER15].uniform_location[UNIFORM_ANISOTROPIC], so);
             break;
         case SHADER16 : // Shadow map, spot light.
-            glUseProgram(multi_pass_shader[SHADER16].program);
-            GL3InitializeShaderWithMVP(multi_pass_shader[SHADER16].uniform_location[UNIFORM_MVP], so);
-            GL3InitializeShaderWithModelMatrix(multi_pass_shader[SHADER16].uniform_location[UNIFORM_MODEL_MATRIX], so);
+            UseMultiPassProgram(SHADER16);
+            GL3InitializeShaderWithMVP(multi_pass_shader_table[SHADER16].uniform_location[UNIFORM_MVP], so);
+            GL3InitializeShaderWithModelMatrix(multi_pass_shader_table[SHADER16].uniform_location[UNIFORM_MODEL_MATRIX], so);
             GL3InitializeShaderWithModelRotationMatrix(
-                multi_pass_shader[SHADER16].uniform_location[UNIFORM_MODEL_ROTATION_MATRIX], so);
+                multi_pass_shader_table[SHADER16].uniform_location[UNIFORM_MODEL_ROTATION_MATRIX], so);
             GL3InitializeShaderWithDiffuseReflectionColor(
-                multi_pass_shader[SHADER16].uniform_location[UNIFORM_DIFFUSE_REFLECTION_COLOR], so);
-            GL3InitializeShaderWithMultiColor(multi_pass_shader[SHADER16].uniform_location[UNIFORM_USE_MULTI_COLOR], so);
-            GL3InitializeShaderWithUseTexture(multi_pass_shader[SHADER16].uniform_location[UNIFORM_USE_TEXTURE_MAP], so);
+                multi_pass_shader_table[SHADER16].uniform_location[UNIFORM_DIFFUSE_REFLECTION_COLOR], so);
+            GL3InitializeShaderWithMultiColor(multi_pass_shader_table[SHADER16].uniform_location[UNIFORM_USE_MULTI_COLOR], so);
+            GL3InitializeShaderWithUseTexture(multi_pass_shader_table[SHADER16].uniform_location[UNIFORM_USE_TEXTURE_MAP], so);
             GL3InitializeShaderWithSpecularReflectionColor(
-                multi_pass_shader[SHADER16].uniform_location[UNIFORM_SPECULAR_REFLECTION_COLOR], so);
+                multi_pass_shader_table[SHADER16].uniform_location[UNIFORM_SPECULAR_REFLECTION_COLOR], so);
             GL3InitializeShaderWithSpecularExponent(
-                multi_pass_shader[SHADER16].uniform_location[UNIFORM_SPECULAR_EXPONENT], so);
+                multi_pass_shader_table[SHADER16].uniform_location[UNIFORM_SPECULAR_EXPONENT], so);
             if (flags & SRE_OBJECT_USE_TEXTURE)
                 GL3InitializeShaderWithObjectTexture(so);
-            GL3InitializeShaderWithUseNormalMap(multi_pass_shader[SHADER16].uniform_location[UNIFORM_USE_NORMAL_MAP], so);
+            GL3InitializeShaderWithUseNormalMap(multi_pass_shader_table[SHADER16].uniform_location[UNIFORM_USE_NORMAL_MAP], so);
             if (flags & SRE_OBJECT_USE_NORMAL_MAP)
                 GL3InitializeShaderWithObjectNormalMap(so);
-            GL3InitializeShaderWithUseSpecularMap(multi_pass_shader[SHADER16].uniform_location[UNIFORM_USE_SPECULARITY_MAP], so);
+            GL3InitializeShaderWithUseSpecularMap(multi_pass_shader_table[SHADER16].uniform_location[UNIFORM_USE_SPECULARITY_MAP], so);
             if (flags & SRE_OBJECT_USE_SPECULARITY_MAP)
                 GL3InitializeShaderWithObjectSpecularMap(so);
             if (flags & (SRE_OBJECT_USE_TEXTURE | SRE_OBJECT_USE_NORMAL_MAP |
             SRE_OBJECT_USE_SPECULARITY_MAP))
                GL3InitializeShaderWithUVTransform(
-                   multi_pass_shader[SHADER16].uniform_location[UNIFORM_UV_TRANSFORM], so);
+                   multi_pass_shader_table[SHADER16].uniform_location[UNIFORM_UV_TRANSFORM], so);
             GL3InitializeShaderWithSpotlightShadowMapTransformationMatrix(
-                multi_pass_shader[SHADER16].uniform_location[UNIFORM_SHADOW_MAP_TRANSFORMATION_MATRIX], so);
+                multi_pass_shader_table[SHADER16].uniform_location[UNIFORM_SHADOW_MAP_TRANSFORMATION_MATRIX], so);
             break;
         case SHADER17 : // Shadow map, spot light, micro-facet.
-            glUseProgram(multi_pass_shader[SHADER17].program);
-            GL3InitializeShaderWithMVP(multi_pass_shader[SHADER17].uniform_location[UNIFORM_MVP], so);
-            GL3InitializeShaderWithModelMatrix(multi_pass_shader[SHADER17].uniform_location[UNIFORM_MODEL_MATRIX], so);
+            UseMultiPassProgram(SHADER17);
+            GL3InitializeShaderWithMVP(multi_pass_shader_table[SHADER17].uniform_location[UNIFORM_MVP], so);
+            GL3InitializeShaderWithModelMatrix(multi_pass_shader_table[SHADER17].uniform_location[UNIFORM_MODEL_MATRIX], so);
             GL3InitializeShaderWithModelRotationMatrix(
-                multi_pass_shader[SHADER17].uniform_location[UNIFORM_MODEL_ROTATION_MATRIX], so);
+                multi_pass_shader_table[SHADER17].uniform_location[UNIFORM_MODEL_ROTATION_MATRIX], so);
             GL3InitializeShaderWithDiffuseReflectionColor(
-                multi_pass_shader[SHADER17].uniform_location[UNIFORM_DIFFUSE_REFLECTION_COLOR], so);
-            GL3InitializeShaderWithMultiColor(multi_pass_shader[SHADER17].uniform_location[UNIFORM_USE_MULTI_COLOR], so);
-            GL3InitializeShaderWithUseTexture(multi_pass_shader[SHADER17].uniform_location[UNIFORM_USE_TEXTURE_MAP], so);
+                multi_pass_shader_table[SHADER17].uniform_location[UNIFORM_DIFFUSE_REFLECTION_COLOR], so);
+            GL3InitializeShaderWithMultiColor(multi_pass_shader_table[SHADER17].uniform_location[UNIFORM_USE_MULTI_COLOR], so);
+            GL3InitializeShaderWithUseTexture(multi_pass_shader_table[SHADER17].uniform_location[UNIFORM_USE_TEXTURE_MAP], so);
             GL3InitializeShaderWithSpecularReflectionColor(
-                multi_pass_shader[SHADER17].uniform_location[UNIFORM_SPECULAR_REFLECTION_COLOR], so);
+                multi_pass_shader_table[SHADER17].uniform_location[UNIFORM_SPECULAR_REFLECTION_COLOR], so);
             if (flags & SRE_OBJECT_USE_TEXTURE)
                 GL3InitializeShaderWithObjectTexture(so);
-            GL3InitializeShaderWithUseNormalMap(multi_pass_shader[SHADER17].uniform_location[UNIFORM_USE_NORMAL_MAP], so);
+            GL3InitializeShaderWithUseNormalMap(multi_pass_shader_table[SHADER17].uniform_location[UNIFORM_USE_NORMAL_MAP], so);
             if (flags & SRE_OBJECT_USE_NORMAL_MAP)
                 GL3InitializeShaderWithObjectNormalMap(so);
             GL3InitializeShaderWithUseSpecularMap(
-                multi_pass_shader[SHADER17].uniform_location[UNIFORM_USE_SPECULARITY_MAP], so);
+                multi_pass_shader_table[SHADER17].uniform_location[UNIFORM_USE_SPECULARITY_MAP], so);
             if (flags & SRE_OBJECT_USE_SPECULARITY_MAP)
                 GL3InitializeShaderWithObjectSpecularMap(so);
             if (flags & (SRE_OBJECT_USE_TEXTURE | SRE_OBJECT_USE_NORMAL_MAP |
             SRE_OBJECT_USE_SPECULARITY_MAP))
                GL3InitializeShaderWithUVTransform(
-                   multi_pass_shader[SHADER17].uniform_location[UNIFORM_UV_TRANSFORM], so);
+                   multi_pass_shader_table[SHADER17].uniform_location[UNIFORM_UV_TRANSFORM], so);
             GL3InitializeShaderWithDiffuseFraction(
-                multi_pass_shader[SHADER17].uniform_location[UNIFORM_DIFFUSE_FRACTION], so);
+                multi_pass_shader_table[SHADER17].uniform_location[UNIFORM_DIFFUSE_FRACTION], so);
             GL3InitializeShaderWithRoughness(
-                multi_pass_shader[SHADER17].uniform_location[UNIFORM_ROUGHNESS], so);
+                multi_pass_shader_table[SHADER17].uniform_location[UNIFORM_ROUGHNESS], so);
             GL3InitializeShaderWithRoughnessWeights(
-                multi_pass_shader[SHADER17].uniform_location[UNIFORM_ROUGHNESS_WEIGHTS], so);
+                multi_pass_shader_table[SHADER17].uniform_location[UNIFORM_ROUGHNESS_WEIGHTS], so);
             GL3InitializeShaderWithAnisotropic(
-                multi_pass_shader[SHADER17].uniform_location[UNIFORM_ANISOTROPIC], so);
+                multi_pass_shader_table[SHADER17].uniform_location[UNIFORM_ANISOTROPIC], so);
             GL3InitializeShaderWithSpotlightShadowMapTransformationMatrix(
-                multi_pass_shader[SHADER17].uniform_location[UNIFORM_SHADOW_MAP_TRANSFORMATION_MATRIX], so);
+                multi_pass_shader_table[SHADER17].uniform_location[UNIFORM_SHADOW_MAP_TRANSFORMATION_MATRIX], so);
             break;
         case SHADER18 : // Shadow map, beam light.
-            glUseProgram(multi_pass_shader[SHADER18].program);
-            GL3InitializeShaderWithMVP(multi_pass_shader[SHADER18].uniform_location[UNIFORM_MVP], so);
-            GL3InitializeShaderWithModelMatrix(multi_pass_shader[SHADER18].uniform_location[UNIFORM_MODEL_MATRIX], so);
+            UseMultiPassProgram(SHADER18);
+            GL3InitializeShaderWithMVP(multi_pass_shader_table[SHADER18].uniform_location[UNIFORM_MVP], so);
+            GL3InitializeShaderWithModelMatrix(multi_pass_shader_table[SHADER18].uniform_location[UNIFORM_MODEL_MATRIX], so);
             GL3InitializeShaderWithModelRotationMatrix(
-                multi_pass_shader[SHADER18].uniform_location[UNIFORM_MODEL_ROTATION_MATRIX], so);
+                multi_pass_shader_table[SHADER18].uniform_location[UNIFORM_MODEL_ROTATION_MATRIX], so);
             GL3InitializeShaderWithDiffuseReflectionColor(
-                multi_pass_shader[SHADER18].uniform_location[UNIFORM_DIFFUSE_REFLECTION_COLOR], so);
-            GL3InitializeShaderWithMultiColor(multi_pass_shader[SHADER18].uniform_location[UNIFORM_USE_MULTI_COLOR], so);
-            GL3InitializeShaderWithUseTexture(multi_pass_shader[SHADER18].uniform_location[UNIFORM_USE_TEXTURE_MAP], so);
+                multi_pass_shader_table[SHADER18].uniform_location[UNIFORM_DIFFUSE_REFLECTION_COLOR], so);
+            GL3InitializeShaderWithMultiColor(multi_pass_shader_table[SHADER18].uniform_location[UNIFORM_USE_MULTI_COLOR], so);
+            GL3InitializeShaderWithUseTexture(multi_pass_shader_table[SHADER18].uniform_location[UNIFORM_USE_TEXTURE_MAP], so);
             GL3InitializeShaderWithSpecularReflectionColor(
-                multi_pass_shader[SHADER18].uniform_location[UNIFORM_SPECULAR_REFLECTION_COLOR], so);
+                multi_pass_shader_table[SHADER18].uniform_location[UNIFORM_SPECULAR_REFLECTION_COLOR], so);
             GL3InitializeShaderWithSpecularExponent(
-                multi_pass_shader[SHADER18].uniform_location[UNIFORM_SPECULAR_EXPONENT], so);
+                multi_pass_shader_table[SHADER18].uniform_location[UNIFORM_SPECULAR_EXPONENT], so);
             if (flags & SRE_OBJECT_USE_TEXTURE)
                 GL3InitializeShaderWithObjectTexture(so);
-            GL3InitializeShaderWithUseNormalMap(multi_pass_shader[SHADER18].uniform_location[UNIFORM_USE_NORMAL_MAP], so);
+            GL3InitializeShaderWithUseNormalMap(multi_pass_shader_table[SHADER18].uniform_location[UNIFORM_USE_NORMAL_MAP], so);
             if (flags & SRE_OBJECT_USE_NORMAL_MAP)
                 GL3InitializeShaderWithObjectNormalMap(so);
-            GL3InitializeShaderWithUseSpecularMap(multi_pass_shader[SHADER18].uniform_location[UNIFORM_USE_SPECULARITY_MAP], so);
+            GL3InitializeShaderWithUseSpecularMap(multi_pass_shader_table[SHADER18].uniform_location[UNIFORM_USE_SPECULARITY_MAP], so);
             if (flags & SRE_OBJECT_USE_SPECULARITY_MAP)
                 GL3InitializeShaderWithObjectSpecularMap(so);
             if (flags & (SRE_OBJECT_USE_TEXTURE | SRE_OBJECT_USE_NORMAL_MAP |
             SRE_OBJECT_USE_SPECULARITY_MAP))
                GL3InitializeShaderWithUVTransform(
-                   multi_pass_shader[SHADER18].uniform_location[UNIFORM_UV_TRANSFORM], so);
+                   multi_pass_shader_table[SHADER18].uniform_location[UNIFORM_UV_TRANSFORM], so);
             GL3InitializeShaderWithShadowMapTransformationMatrix(
-                multi_pass_shader[SHADER18].uniform_location[UNIFORM_SHADOW_MAP_TRANSFORMATION_MATRIX], so);
+                multi_pass_shader_table[SHADER18].uniform_location[UNIFORM_SHADOW_MAP_TRANSFORMATION_MATRIX], so);
             break;
         case SHADER19 : // Shadow map, beam light, micro-facet.
-            glUseProgram(multi_pass_shader[SHADER19].program);
-            GL3InitializeShaderWithMVP(multi_pass_shader[SHADER19].uniform_location[UNIFORM_MVP], so);
-            GL3InitializeShaderWithModelMatrix(multi_pass_shader[SHADER19].uniform_location[UNIFORM_MODEL_MATRIX], so);
+            UseMultiPassProgram(SHADER19);
+            GL3InitializeShaderWithMVP(multi_pass_shader_table[SHADER19].uniform_location[UNIFORM_MVP], so);
+            GL3InitializeShaderWithModelMatrix(multi_pass_shader_table[SHADER19].uniform_location[UNIFORM_MODEL_MATRIX], so);
             GL3InitializeShaderWithModelRotationMatrix(
-                multi_pass_shader[SHADER19].uniform_location[UNIFORM_MODEL_ROTATION_MATRIX], so);
+                multi_pass_shader_table[SHADER19].uniform_location[UNIFORM_MODEL_ROTATION_MATRIX], so);
             GL3InitializeShaderWithDiffuseReflectionColor(
-                multi_pass_shader[SHADER19].uniform_location[UNIFORM_DIFFUSE_REFLECTION_COLOR], so);
-            GL3InitializeShaderWithMultiColor(multi_pass_shader[SHADER19].uniform_location[UNIFORM_USE_MULTI_COLOR], so);
-            GL3InitializeShaderWithUseTexture(multi_pass_shader[SHADER19].uniform_location[UNIFORM_USE_TEXTURE_MAP], so);
+                multi_pass_shader_table[SHADER19].uniform_location[UNIFORM_DIFFUSE_REFLECTION_COLOR], so);
+            GL3InitializeShaderWithMultiColor(multi_pass_shader_table[SHADER19].uniform_location[UNIFORM_USE_MULTI_COLOR], so);
+            GL3InitializeShaderWithUseTexture(multi_pass_shader_table[SHADER19].uniform_location[UNIFORM_USE_TEXTURE_MAP], so);
             GL3InitializeShaderWithSpecularReflectionColor(
-                multi_pass_shader[SHADER19].uniform_location[UNIFORM_SPECULAR_REFLECTION_COLOR], so);
+                multi_pass_shader_table[SHADER19].uniform_location[UNIFORM_SPECULAR_REFLECTION_COLOR], so);
             if (flags & SRE_OBJECT_USE_TEXTURE)
                 GL3InitializeShaderWithObjectTexture(so);
-            GL3InitializeShaderWithUseNormalMap(multi_pass_shader[SHADER19].uniform_location[UNIFORM_USE_NORMAL_MAP], so);
+            GL3InitializeShaderWithUseNormalMap(multi_pass_shader_table[SHADER19].uniform_location[UNIFORM_USE_NORMAL_MAP], so);
             if (flags & SRE_OBJECT_USE_NORMAL_MAP)
                 GL3InitializeShaderWithObjectNormalMap(so);
             GL3InitializeShaderWithUseSpecularMap(
-                multi_pass_shader[SHADER19].uniform_location[UNIFORM_USE_SPECULARITY_MAP], so);
+                multi_pass_shader_table[SHADER19].uniform_location[UNIFORM_USE_SPECULARITY_MAP], so);
             if (flags & SRE_OBJECT_USE_SPECULARITY_MAP)
                 GL3InitializeShaderWithObjectSpecularMap(so);
             if (flags & (SRE_OBJECT_USE_TEXTURE | SRE_OBJECT_USE_NORMAL_MAP |
             SRE_OBJECT_USE_SPECULARITY_MAP))
                GL3InitializeShaderWithUVTransform(
-                   multi_pass_shader[SHADER19].uniform_location[UNIFORM_UV_TRANSFORM], so);
+                   multi_pass_shader_table[SHADER19].uniform_location[UNIFORM_UV_TRANSFORM], so);
             GL3InitializeShaderWithDiffuseFraction(
-                multi_pass_shader[SHADER19].uniform_location[UNIFORM_DIFFUSE_FRACTION], so);
+                multi_pass_shader_table[SHADER19].uniform_location[UNIFORM_DIFFUSE_FRACTION], so);
             GL3InitializeShaderWithRoughness(
-                multi_pass_shader[SHADER19].uniform_location[UNIFORM_ROUGHNESS], so);
+                multi_pass_shader_table[SHADER19].uniform_location[UNIFORM_ROUGHNESS], so);
             GL3InitializeShaderWithRoughnessWeights(
-                multi_pass_shader[SHADER19].uniform_location[UNIFORM_ROUGHNESS_WEIGHTS], so);
+                multi_pass_shader_table[SHADER19].uniform_location[UNIFORM_ROUGHNESS_WEIGHTS], so);
             GL3InitializeShaderWithAnisotropic(
-                multi_pass_shader[SHADER19].uniform_location[UNIFORM_ANISOTROPIC], so);
+                multi_pass_shader_table[SHADER19].uniform_location[UNIFORM_ANISOTROPIC], so);
             GL3InitializeShaderWithShadowMapTransformationMatrix(
-                multi_pass_shader[SHADER19].uniform_location[UNIFORM_SHADOW_MAP_TRANSFORMATION_MATRIX], so);
+                multi_pass_shader_table[SHADER19].uniform_location[UNIFORM_SHADOW_MAP_TRANSFORMATION_MATRIX], so);
             break;
         case SHADER20 : // Earth shadow map, directional light.
-            glUseProgram(multi_pass_shader[SHADER20].program);
-            GL3InitializeShaderWithMVP(multi_pass_shader[SHADER20].uniform_location[UNIFORM_MVP], so);
-            GL3InitializeShaderWithModelMatrix(multi_pass_shader[SHADER20].uniform_location[UNIFORM_MODEL_MATRIX], so);
+            UseMultiPassProgram(SHADER20);
+            GL3InitializeShaderWithMVP(multi_pass_shader_table[SHADER20].uniform_location[UNIFORM_MVP], so);
+            GL3InitializeShaderWithModelMatrix(multi_pass_shader_table[SHADER20].uniform_location[UNIFORM_MODEL_MATRIX], so);
             GL3InitializeShaderWithModelRotationMatrix(
-                multi_pass_shader[SHADER20].uniform_location[UNIFORM_MODEL_ROTATION_MATRIX], so);
+                multi_pass_shader_table[SHADER20].uniform_location[UNIFORM_MODEL_ROTATION_MATRIX], so);
             GL3InitializeShaderWithDiffuseReflectionColor(
-                multi_pass_shader[SHADER20].uniform_location[UNIFORM_DIFFUSE_REFLECTION_COLOR], so);
+                multi_pass_shader_table[SHADER20].uniform_location[UNIFORM_DIFFUSE_REFLECTION_COLOR], so);
             GL3InitializeShaderWithSpecularReflectionColor(
-                multi_pass_shader[SHADER20].uniform_location[UNIFORM_SPECULAR_REFLECTION_COLOR], so);
+                multi_pass_shader_table[SHADER20].uniform_location[UNIFORM_SPECULAR_REFLECTION_COLOR], so);
             GL3InitializeShaderWithSpecularExponent(
-                multi_pass_shader[SHADER20].uniform_location[UNIFORM_SPECULAR_EXPONENT], so);
+                multi_pass_shader_table[SHADER20].uniform_location[UNIFORM_SPECULAR_EXPONENT], so);
             GL3InitializeShaderWithObjectTexture(so);
             GL3InitializeShaderWithObjectSpecularMap(so);
             GL3InitializeShaderWithObjectEmissionMap(so);
             GL3InitializeShaderWithUVTransform(
-                multi_pass_shader[SHADER20].uniform_location[UNIFORM_UV_TRANSFORM], so);
+                multi_pass_shader_table[SHADER20].uniform_location[UNIFORM_UV_TRANSFORM], so);
             GL3InitializeShaderWithShadowMapTransformationMatrix(
-                multi_pass_shader[SHADER20].uniform_location[UNIFORM_SHADOW_MAP_TRANSFORMATION_MATRIX], so);
+                multi_pass_shader_table[SHADER20].uniform_location[UNIFORM_SHADOW_MAP_TRANSFORMATION_MATRIX], so);
             break;
 #endif
         case SHADER21 : // Earth shader, directional light.
             // SHADER21 is equal to 21 when shadow mapping is enabled,
             // 12 otherwise.
-            glUseProgram(multi_pass_shader[SHADER21].program);
-            GL3InitializeShaderWithMVP(multi_pass_shader[SHADER21].uniform_location[UNIFORM_MVP], so);
-            GL3InitializeShaderWithModelMatrix(multi_pass_shader[SHADER21].uniform_location[UNIFORM_MODEL_MATRIX], so);
+            UseMultiPassProgram(SHADER21);
+            GL3InitializeShaderWithMVP(multi_pass_shader_table[SHADER21].uniform_location[UNIFORM_MVP], so);
+            GL3InitializeShaderWithModelMatrix(multi_pass_shader_table[SHADER21].uniform_location[UNIFORM_MODEL_MATRIX], so);
             GL3InitializeShaderWithModelRotationMatrix(
-                multi_pass_shader[SHADER21].uniform_location[UNIFORM_MODEL_ROTATION_MATRIX], so);
+                multi_pass_shader_table[SHADER21].uniform_location[UNIFORM_MODEL_ROTATION_MATRIX], so);
             GL3InitializeShaderWithDiffuseReflectionColor(
-                multi_pass_shader[SHADER21].uniform_location[UNIFORM_DIFFUSE_REFLECTION_COLOR], so);
+                multi_pass_shader_table[SHADER21].uniform_location[UNIFORM_DIFFUSE_REFLECTION_COLOR], so);
             GL3InitializeShaderWithSpecularReflectionColor(
-                multi_pass_shader[SHADER21].uniform_location[UNIFORM_SPECULAR_REFLECTION_COLOR], so);
+                multi_pass_shader_table[SHADER21].uniform_location[UNIFORM_SPECULAR_REFLECTION_COLOR], so);
             GL3InitializeShaderWithSpecularExponent(
-                multi_pass_shader[SHADER21].uniform_location[UNIFORM_SPECULAR_EXPONENT], so);
+                multi_pass_shader_table[SHADER21].uniform_location[UNIFORM_SPECULAR_EXPONENT], so);
             GL3InitializeShaderWithObjectTexture(so);
             GL3InitializeShaderWithObjectSpecularMap(so);
             GL3InitializeShaderWithObjectEmissionMap(so);
             GL3InitializeShaderWithUVTransform(
-                multi_pass_shader[SHADER21].uniform_location[UNIFORM_UV_TRANSFORM], so);
+                multi_pass_shader_table[SHADER21].uniform_location[UNIFORM_UV_TRANSFORM], so);
             break;
         }
 }
@@ -1991,6 +2455,14 @@ static SinglePassShaderSelection sreSelectSinglePassShader(const sreObject& so)
             shader = SINGLE_PASS_SHADER3;
     else
 #endif
+    if (sre_internal_rendering_flags & SRE_RENDERING_FLAG_DEFERRED_SHADING)
+        // The G-buffer geometry shader supports all options; lights are applied later.
+        shader = SINGLE_PASS_SHADER11;
+    else
+    if (sre_internal_rendering_flags & SRE_RENDERING_FLAG_CLUSTERED_LIGHTING)
+        // The clustered lighting shader applies all lights and supports all options.
+        shader = SINGLE_PASS_SHADER10;
+    else
     if (flags & SRE_OBJECT_TRANSPARENT_TEXTURE)
         if (sre_internal_current_light->type & SRE_LIGHT_LINEAR_ATTENUATION_RANGE)
             // The specific point source, spot and beam light shaders also support
@@ -2038,13 +2510,39 @@ static SinglePassShaderSelection sreSelectSinglePassShader(const sreObject& so)
     return shader;
 }
 
+// Generic single-pass shader used while the selected shader is still being compiled
+// with asynchronous shader loading. Only the optimized directional light and emission-only
+// shaders have a more general alternative.
+
+static SinglePassShaderSelection sreSelectSinglePassFallbackShader(SinglePassShaderSelection shader) {
+    switch (shader) {
+    case SINGLE_PASS_SHADER0 :
+    case SINGLE_PASS_SHADER2 :
+    case SINGLE_PASS_SHADER4 :
+    case SINGLE_PASS_SHADER5 :
+        return SINGLE_PASS_SHADER1;
+    case SINGLE_PASS_SHADER7 :
+        return SINGLE_PASS_SHADER3;
+    default :
+        return shader;
+    }
+}
+
 static void sreInitializeSinglePassShader(const sreObject& so, SinglePassShaderSelection shader) {
     if (single_pass_shader[shader].status != SRE_SHADER_STATUS_LOADED) {
         // Demand-loaded shader.
-        single_pass_shader[shader].Load();
+        bool loaded = single_pass_shader[shader].LoadNonBlocking();
+        if (!loaded) {
+            shader = sreSelectSinglePassFallbackShader(shader);
+            if (single_pass_shader[shader].status != SRE_SHADER_STATUS_LOADED) {
+                single_pass_shader[shader].Load();
+                loaded = true;
+            }
+        }
         // Must make sure the before-frame initialization is done.
         // This could be optimized by only initializing the newly loaded shader.
-        GL3InitializeShadersBeforeFrame();
+        if (loaded)
+            GL3InitializeShadersBeforeFrame();
     }
     int flags = so.render_flags;
     switch (shader) {
@@ -2272,6 +2770,68 @@ static void sreInitializeSinglePassShader(const sreObject& so, SinglePassShaderS
             GL3InitializeShaderWithUVTransform(
                 single_pass_shader[SHADER9].uniform_location[UNIFORM_UV_TRANSFORM], so);
         break;  
+    case SINGLE_PASS_SHADER10 :	// Complete single pass shader for clustered lighting.
+        glUseProgram(single_pass_shader[SHADER10].program);
+        GL3InitializeShaderWithMVP(single_pass_shader[SHADER10].uniform_location[UNIFORM_MVP], so);
+        GL3InitializeShaderWithModelMatrix(single_pass_shader[SHADER10].uniform_location[UNIFORM_MODEL_MATRIX], so);
+        GL3InitializeShaderWithModelRotationMatrix(
+            single_pass_shader[SHADER10].uniform_location[UNIFORM_MODEL_ROTATION_MATRIX], so);
+        GL3InitializeShaderWithDiffuseReflectionColor(
+            single_pass_shader[SHADER10].uniform_location[UNIFORM_DIFFUSE_REFLECTION_COLOR], so);
+        GL3InitializeShaderWithMultiColor(single_pass_shader[SHADER10].uniform_location[UNIFORM_USE_MULTI_COLOR], so);
+        GL3InitializeShaderWithUseTexture(single_pass_shader[SHADER10].uniform_location[UNIFORM_USE_TEXTURE_MAP], so);
+        GL3InitializeShaderWithSpecularReflectionColor(
+            single_pass_shader[SHADER10].uniform_location[UNIFORM_SPECULAR_REFLECTION_COLOR], so);
+        GL3InitializeShaderWithSpecularExponent(
+            single_pass_shader[SHADER10].uniform_location[UNIFORM_SPECULAR_EXPONENT], so);
+        if (flags & SRE_OBJECT_USE_TEXTURE)
+            GL3InitializeShaderWithObjectTexture(so);
+        GL3InitializeShaderWithUseNormalMap(single_pass_shader[SHADER10].uniform_location[UNIFORM_USE_NORMAL_MAP], so);
+        if (flags & SRE_OBJECT_USE_NORMAL_MAP)
+            GL3InitializeShaderWithObjectNormalMap(so);
+        GL3InitializeShaderWithUseSpecularMap(single_pass_shader[SHADER10].uniform_location[UNIFORM_USE_SPECULARITY_MAP], so);
+        if (flags & SRE_OBJECT_USE_SPECULARITY_MAP)
+            GL3InitializeShaderWithObjectSpecularMap(so);
+        GL3InitializeShaderWithEmissionColor(single_pass_shader[SHADER10].uniform_location[UNIFORM_EMISSION_COLOR], so);
+        GL3InitializeShaderWithUseEmissionMap(single_pass_shader[SHADER10].uniform_location[UNIFORM_USE_EMISSION_MAP], so);
+        if (flags & SRE_OBJECT_USE_EMISSION_MAP)
+            GL3InitializeShaderWithObjectEmissionMap(so);
+        if (flags & (SRE_OBJECT_USE_TEXTURE | SRE_OBJECT_USE_NORMAL_MAP |
+        SRE_OBJECT_USE_SPECULARITY_MAP | SRE_OBJECT_USE_EMISSION_MAP))
+            GL3InitializeShaderWithUVTransform(
+                single_pass_shader[SHADER10].uniform_location[UNIFORM_UV_TRANSFORM], so);
+        break;
+    case SINGLE_PASS_SHADER11 :	// Deferred shading G-buffer geometry shader.
+        glUseProgram(single_pass_shader[SHADER11].program);
+        GL3InitializeShaderWithMVP(single_pass_shader[SHADER11].uniform_location[UNIFORM_MVP], so);
+        GL3InitializeShaderWithModelMatrix(single_pass_shader[SHADER11].uniform_location[UNIFORM_MODEL_MATRIX], so);
+        GL3InitializeShaderWithModelRotationMatrix(
+            single_pass_shader[SHADER11].uniform_location[UNIFORM_MODEL_ROTATION_MATRIX], so);
+        GL3InitializeShaderWithDiffuseReflectionColor(
+            single_pass_shader[SHADER11].uniform_location[UNIFORM_DIFFUSE_REFLECTION_COLOR], so);
+        GL3InitializeShaderWithMultiColor(single_pass_shader[SHADER11].uniform_location[UNIFORM_USE_MULTI_COLOR], so);
+        GL3InitializeShaderWithUseTexture(single_pass_shader[SHADER11].uniform_location[UNIFORM_USE_TEXTURE_MAP], so);
+        GL3InitializeShaderWithSpecularReflectionColor(
+            single_pass_shader[SHADER11].uniform_location[UNIFORM_SPECULAR_REFLECTION_COLOR], so);
+        GL3InitializeShaderWithSpecularExponent(
+            single_pass_shader[SHADER11].uniform_location[UNIFORM_SPECULAR_EXPONENT], so);
+        if (flags & SRE_OBJECT_USE_TEXTURE)
+            GL3InitializeShaderWithObjectTexture(so);
+        GL3InitializeShaderWithUseNormalMap(single_pass_shader[SHADER11].uniform_location[UNIFORM_USE_NORMAL_MAP], so);
+        if (flags & SRE_OBJECT_USE_NORMAL_MAP)
+            GL3InitializeShaderWithObjectNormalMap(so);
+        GL3InitializeShaderWithUseSpecularMap(single_pass_shader[SHADER11].uniform_location[UNIFORM_USE_SPECULARITY_MAP], so);
+        if (flags & SRE_OBJECT_USE_SPECULARITY_MAP)
+            GL3InitializeShaderWithObjectSpecularMap(so);
+        GL3InitializeShaderWithEmissionColor(single_pass_shader[SHADER11].uniform_location[UNIFORM_EMISSION_COLOR], so);
+        GL3InitializeShaderWithUseEmissionMap(single_pass_shader[SHADER11].uniform_location[UNIFORM_USE_EMISSION_MAP], so);
+        if (flags & SRE_OBJECT_USE_EMISSION_MAP)
+            GL3InitializeShaderWithObjectEmissionMap(so);
+        if (flags & (SRE_OBJECT_USE_TEXTURE | SRE_OBJECT_USE_NORMAL_MAP |
+        SRE_OBJECT_USE_SPECULARITY_MAP | SRE_OBJECT_USE_EMISSION_MAP))
+            GL3InitializeShaderWithUVTransform(
+                single_pass_shader[SHADER11].uniform_location[UNIFORM_UV_TRANSFORM], so);
+        break;
     }
 }
 
@@ -2351,6 +2911,10 @@ bool sreInitializeObjectShaderAmbientPass(sreObject& so) {
         // Use the multi-pass ambient shader.
         so.current_shader[SRE_SHADER_LIGHT_TYPE_AMBIENT] = (int)SHADER1;
     }
+#ifndef OPENGL_ES2
+    if (sre_internal_uniform_buffers)
+        BindObjectUniformBuffer(so);
+#endif
     sreInitializeMultiPassShader(so, SHADER1);
     return select_new_shader;
 }
@@ -2367,6 +2931,10 @@ bool sreInitializeObjectShaderMultiPassLightingPass(sreObject& so) {
     }
     else
         s = (MultiPassShaderSelection)so.current_shader[light_type];
+#ifndef OPENGL_ES2
+    if (sre_internal_uniform_buffers)
+        BindObjectUniformBuffer(so);
+#endif
     sreInitializeMultiPassShader(so, s);
     return select_new_shader;
 }
@@ -2389,12 +2957,100 @@ bool sreInitializeObjectShaderMultiPassShadowMapLightingPass(sreObject& so) {
     }
     else
         s = (MultiPassShaderSelection)so.current_shader_shadow_map[light_type];
+#ifndef OPENGL_ES2
+    if (sre_internal_uniform_buffers)
+        BindObjectUniformBuffer(so);
+#endif
     sreInitializeMultiPassShader(so, s);
     return select_new_shader;
 }
 
 #endif
 
+// Initialize the instanced variant of a multi-pass shader that has already been selected
+// for the object, for drawing a batch of instances that share the object's model and
+// material. Returns false when the shader has no instanced variant.
+
+bool sreInitializeObjectShaderMultiPassInstanced(const sreObject& so, int shader) {
+    if (!sreMultiPassInstancedShaderAvailable(shader))
+        return false;
+    multi_pass_shader_table = multi_pass_shader_instanced;
+    sreInitializeMultiPassShader(so, (MultiPassShaderSelection)shader);
+    multi_pass_shader_table = multi_pass_shader;
+    return true;
+}
+
+// Return whether the instanced variant of a multi-pass shader can be used. With
+// asynchronous shader loading, a variant that is still being compiled is not available
+// (the objects are drawn individually instead).
+
+bool sreMultiPassInstancedShaderAvailable(int shader) {
+    sreShader *s = &multi_pass_shader_instanced[shader];
+    if (s->status == SRE_SHADER_STATUS_UNINITIALIZED)
+        return false;
+    if (s->status == SRE_SHADER_STATUS_LOADED || !sre_internal_async_shader_loading)
+        return true;
+    if (!s->LoadNonBlocking())
+        return false;
+    InitializeNewlyLoadedShaders();
+    return true;
+}
+
+static void WarmUpShader(sreShader *s) {
+    if (s->status != SRE_SHADER_STATUS_INITIALIZED)
+        return;
+    if (sre_internal_async_shader_loading)
+        s->BeginLoad();
+    else
+        s->Load();
+}
+
+static void WarmUpMultiPassShader(MultiPassShaderSelection shader) {
+    WarmUpShader(&multi_pass_shader[shader]);
+    // The instanced variant is uninitialized when instancing is not supported.
+    WarmUpShader(&multi_pass_shader_instanced[shader]);
+}
+
+// Start loading the shaders that will be used to draw an object lit by the given light
+// (NULL for the light-independent shaders) with the current rendering settings.
+
+void sreWarmUpObjectShaders(sreObject& so, sreLight *light) {
+    if (so.flags & (SRE_OBJECT_LIGHT_HALO | SRE_OBJECT_PARTICLE_SYSTEM))
+        return;
+    sreLight *saved_light = sre_internal_current_light;
+    SetRenderFlags(so);
+    if (so.render_flags & SRE_OBJECT_EMISSION_ONLY) {
+        if (light == NULL) {
+            if ((so.render_flags & (SRE_OBJECT_EMISSION_ADD_DIFFUSE_REFLECTION_COLOR |
+            SRE_OBJECT_USE_EMISSION_MAP | SRE_OBJECT_USE_TEXTURE)) ==
+            SRE_OBJECT_EMISSION_ADD_DIFFUSE_REFLECTION_COLOR)
+                WarmUpShader(&single_pass_shader[SINGLE_PASS_SHADER7]);
+            else
+                WarmUpShader(&single_pass_shader[SINGLE_PASS_SHADER3]);
+        }
+    }
+    else if (sre_internal_multi_pass_rendering) {
+        if (light == NULL)
+            WarmUpMultiPassShader(SHADER1);
+        else {
+            sre_internal_current_light = light;
+            WarmUpMultiPassShader(sreSelectMultiPassShader(so));
+#ifndef NO_SHADOW_MAP
+            if (sre_internal_shadows == SRE_SHADOWS_SHADOW_MAPPING)
+                WarmUpMultiPassShader(sreSelectMultiPassShadowMapShader(so));
+#endif
+        }
+    }
+    else if ((light != NULL) != ((sre_internal_rendering_flags &
+    (SRE_RENDERING_FLAG_DEFERRED_SHADING | SRE_RENDERING_FLAG_CLUSTERED_LIGHTING)) != 0)) {
+        // Single-pass rendering uses one shader per light type, or a single shader for
+        // all lights with clustered lighting or deferred shading.
+        sre_internal_current_light = light;
+        WarmUpShader(&single_pass_shader[sreSelectSinglePassShader(so)]);
+    }
+    sre_internal_current_light = saved_light;
+}
+
 // Initialize a sub-mesh of an object.
 
 void sreInitializeShaderWithMesh(sreObject *so, sreModelMesh *mesh) {
@@ -2758,6 +3414,33 @@ void GL3InitializeCubeShadowMapShader(const sreObject& so) {
     }
 }
 
+#ifndef OPENGL_ES2
+
+// Layered variant; segment_mask selects the cube map faces (bits 0 to 5) that the
+// geometry shader routes the object's triangles to.
+
+void GL3InitializeLayeredCubeShadowMapShader(const sreObject& so, int segment_mask) {
+    int i;
+    if (so.render_flags & SRE_OBJECT_TRANSPARENT_TEXTURE)
+        i = SRE_MISC_SHADER_CUBE_SHADOW_MAP_LAYERED_TRANSPARENT;
+    else
+        i = SRE_MISC_SHADER_CUBE_SHADOW_MAP_LAYERED;
+    glUseProgram(misc_shader[i].program);
+    GL3InitializeShaderWithModelMatrix(misc_shader[i].uniform_location[UNIFORM_MISC_MODEL_MATRIX], so);
+    glUniform1i(misc_shader[i].uniform_location[UNIFORM_MISC_CUBE_SEGMENT_MASK], segment_mask);
+    if (so.render_flags & SRE_OBJECT_TRANSPARENT_TEXTURE) {
+        GL3InitializeShaderWithUVTransform(misc_shader[i].uniform_location[UNIFORM_MISC_UV_TRANSFORM], so);
+        // When the texture is NULL, it is assumed that the object uses a mesh with different
+        // textures for each sub-mesh, which will be bound later.
+        if (so.texture != NULL) {
+            glActiveTexture(GL_TEXTURE0);
+            glBindTexture(GL_TEXTURE_2D, so.texture->opengl_id);
+        }
+    }
+}
+
+#endif
+
 #endif
 
 #ifndef NO_HDR
@@ -2809,3 +3492,43 @@ void GL3InitializeHDRToneMapShader() {
 
 #endif
 
+#ifndef OPENGL_ES2
+
+// Deferred shading shaders. The G-buffer textures have already been bound.
+
+void GL3InitializeDeferredShadingCompositeShader() {
+    deferred_shading_shader[SRE_DEFERRED_SHADING_SHADER_COMPOSITE].Validate();
+    glUseProgram(deferred_shading_shader[SRE_DEFERRED_SHADING_SHADER_COMPOSITE].program);
+}
+
+// Set up the light shader for the current light. The inverse view-projection matrix also
+// includes the inverse viewport transformation, so that it converts window coordinates
+// and depth values to world space.
+
+void GL3InitializeDeferredShadingLightShader(int shader_index,
+const Matrix4D& inverse_view_projection_matrix) {
+    sreShader *shader = &deferred_shading_shader[shader_index];
+    // Demand-load the shader if required.
+    shader->Validate();
+    glUseProgram(shader->program);
+    InitializeShaderLightParameters(shader->uniform_location[UNIFORM_MISC_LIGHT_PARAMETERS]);
+    GL3InitializeShaderWithViewpoint(shader->uniform_location[UNIFORM_MISC_VIEWPOINT]);
+    glUniformMatrix4fv(shader->uniform_location[UNIFORM_MISC_INVERSE_VIEW_PROJECTION_MATRIX],
+        1, GL_FALSE, (float *)&inverse_view_projection_matrix);
+#ifndef NO_SHADOW_MAP
+    if (shader->uniform_mask & (1 << UNIFORM_MISC_SHADOW_MAP_PARAMETERS))
+        sreInitializeShaderShadowMapParameters(
+            shader->uniform_location[UNIFORM_MISC_SHADOW_MAP_PARAMETERS]);
+    // The shadow map matrices are applied to world space positions.
+    if (shader->uniform_mask & (1 << UNIFORM_MISC_SHADOW_MAP_TRANSFORMATION_MATRIX)) {
+        if (sre_internal_current_light->type & SRE_LIGHT_SPOT)
+            glUniformMatrix4fv(shader->uniform_location[UNIFORM_MISC_SHADOW_MAP_TRANSFORMATION_MATRIX],
+                1, GL_FALSE, (float *)&projection_shadow_map_lighting_pass_matrix);
+        else
+            glUniformMatrix4x3fv(shader->uniform_location[UNIFORM_MISC_SHADOW_MAP_TRANSFORMATION_MATRIX],
+                1, GL_TRUE, (float *)&shadow_map_lighting_pass_matrix);
+    }
+#endif
+}
+
+#endif
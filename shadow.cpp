@@ -23,6 +23,7 @@ OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
 #include <string.h>
 #include <math.h>
 #include <limits.h>
+#include <stdint.h>
 #ifdef __GNUC__
 #include <fenv.h>
 #endif
@@ -37,32 +38,34 @@ OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
 #ifdef USE_SIMD
 #include <dstSIMD.h>
 #endif
+// On x86 with GCC-compatible compilers, AVX2 and AVX-512 versions of the light-facing
+// triangle determination are compiled regardless of the target instruction set and
+// selected at run-time.
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__)) && !defined(NO_SIMD)
+#define SRE_RUNTIME_SIMD_DISPATCH
+#include <immintrin.h>
+#endif
 
 #include "sre.h"
 #include "sre_internal.h"
 #include "sre_bounds.h"
 
-// Cache for objects (point source lights and spotlights).
-// The total number of entries is four times this number (four per object).
+// Default number of cache lines of the cache for objects (point source lights and
+// spotlights). The total number of entries is four times this number (four per line).
+// The size can be changed with sreSetShadowVolumeCacheSize().
 #define SRE_SHADOW_VOLUME_OBJECT_CACHE_SIZE 1024
-// Cache for models (directional lights and beam lights).
-// The total number of entries is four times this number (four per model).
+// Default number of cache lines of the cache for models (directional lights and beam lights).
+// The total number of entries is four times this number (four per line).
 #define SRE_SHADOW_VOLUME_MODEL_CACHE_SIZE 256
 
 enum {
-    SRE_FACE_FLAG_LIGHT_FACING = 1,
-    SRE_FACE_FLAG_PERPENDICULAR_TO_LIGHT = 2
+    SRE_FACE_FLAG_LIGHT_FACING = 1
 };
 
 // VBO edges implementation
 
 // Class to hold shadow volume building information.
 
-// Number of bits to use for face flags storage. A value of eight uses a byte
-// for each triangle and simplifies the code at expense of greater memory requirements.
-#define SRE_FACE_FLAG_BITS 8
-#define SRE_FACE_FLAG_MASK ((1 << SRE_FACE_FLAG_BITS) - 1)
-
 class EdgeArray {
 public :
     sreLODModelShadowVolume *m;
@@ -75,13 +78,20 @@ public :
     unsigned int *edge_index;
     int nu_edges;
     int max_edges;
-    // The face type (light facing or not) of every face (triangle in the model).
-    // Four flags fields are packed into each byte.
-    unsigned char *face_type;
-    int max_face_types;
+    // Packed bit mask with a set bit for every face (triangle in the model) that is
+    // facing the light. Sized for the model's triangle count rounded up to a multiple of 32.
+    unsigned int *face_mask;
+    int max_face_mask_words;
+    // The element indices of the shadow volume constructed from the silhouette, stored as
+    // shorts or ints depending on array_buffer_flags.
+    void *vertex;
+    int nu_vertices;
+    int max_vertices;
+    int array_buffer_flags;
 
     EdgeArray();
     void CheckEdgeCapacity(int nu_edges_required);
+    void CheckVertexCapacity(int nu_vertices_required);
     inline void AppendEdge(unsigned int model_edge_index) {
         edge_index[nu_edges] = model_edge_index;
         nu_edges++;    
@@ -116,51 +126,13 @@ public :
         v1 = (m->edge[index].vertex_index[0] & mask1) +
             (m->edge[index].vertex_index[1] & mask0);
     }
-    void CheckFaceTypeCapacity(int nu_faces_required);
-    // Pack four face types into each byte.
-    inline void SetFaceType(int i, unsigned int flags) {
-#if SRE_FACE_FLAG_BITS == 8
-        face_type[i] = flags;
-#else
-        int j = i / (8 / SRE_FACE_FLAG_BITS);
-        unsigned char value = face_type[j];
-        int shift = (i & ((8 / SRE_FACE_FLAG_BITS) - 1)) * SRE_FACE_FLAG_BITS;
-        unsigned char mask = SRE_FACE_FLAG_MASK << shift;
-        face_type[j] = (value & (~mask)) | (flags << shift);
-#endif
-    }
+    void CheckFaceMaskCapacity(int nu_faces_required);
+    // Return SRE_FACE_FLAG_LIGHT_FACING when the triangle faces the light, 0 otherwise.
     inline unsigned int GetFaceType(int i) {
-        int j = i / (8 / SRE_FACE_FLAG_BITS);
-        int shift = (i & ((8 / SRE_FACE_FLAG_BITS) - 1)) * SRE_FACE_FLAG_BITS;
-        return (face_type[j] >> shift) & SRE_FACE_FLAG_MASK;
-    }
-    // Set afce types for four triangles.
-    inline void SetFourFaceTypes(int i, unsigned int byte_flags) {
-#if SRE_FACE_FLAG_BITS == 8
-        *(unsigned int *)(&face_type[i]) = byte_flags;
-#else
-        unsigned int packed_flags =
-            (byte_flags & 0x1) | ((byte_flags & 0x100) >> (8 - SRE_FACE_FLAG_BITS)) |
-            ((byte_flags & 0x10000) >> (16 - SRE_FACE_FLAG_BITS * 2)) |
-            ((byte_flags & 0x1000000) >> (24 - SRE_FACE_FLAG_BITS * 3));
-        int j = i / (8 / SRE_FACE_FLAG_BITS);
-#if SRE_FACE_FLAG_BITS == 4
-        *(unsigned short *)(&face_type[j]) = byte_flags;
-#elif SRE_FACE_FLAG_BITS == 2
-        face_type[j] = packed_flags;
-#else
-        unsigned char shift = (i & 4);
-        face_type[j] = (face_type[j] & (0xF << (4 - shift))) | (packed_flags << shift);
-#endif
-#endif
-    }
-    // Return four face types packed into a byte.
-    inline unsigned int GetFourFaceTypes(int i) {
-        return GetFaceType(i) | (GetFaceType(i + 1) << 8) | (GetFaceType(i + 2) << 16) |
-            (GetFaceType(i + 3) << 24);
+        return (face_mask[i >> 5] >> (i & 31)) & 1;
     }
     inline bool IsLightFacing(int triangle_index) {
-        return (GetFaceType(triangle_index) & SRE_FACE_FLAG_LIGHT_FACING) != 0;
+        return GetFaceType(triangle_index) != 0;
     }
 };
 
@@ -168,10 +140,12 @@ public :
 EdgeArray::EdgeArray() {
     edge_index = new unsigned int[SRE_DEFAULT_MAX_SILHOUETTE_EDGES]; 
     max_edges = SRE_DEFAULT_MAX_SILHOUETTE_EDGES;
-    // Face types do not need to be stored after silhouette determination; only maintain
-    // one global buffer.
-    face_type = NULL;
-    max_face_types = 0;
+    // The face mask is allocated when the first silhouette is calculated.
+    face_mask = NULL;
+    max_face_mask_words = 0;
+    vertex = new int[SRE_DEFAULT_MAX_SHADOW_VOLUME_VERTICES];
+    max_vertices = SRE_DEFAULT_MAX_SHADOW_VOLUME_VERTICES;
+    nu_vertices = 0;
 }
 
 void EdgeArray::CheckEdgeCapacity(int nu_edges_required) {
@@ -185,20 +159,31 @@ void EdgeArray::CheckEdgeCapacity(int nu_edges_required) {
     }
 }
 
-void EdgeArray::CheckFaceTypeCapacity(int nu_faces_required) {
-    if (nu_faces_required > max_face_types) {
-        if (face_type != NULL)
-            delete [] face_type;
+void EdgeArray::CheckVertexCapacity(int nu_vertices_required) {
+    if (nu_vertices_required > max_vertices) {
+        delete [] (int *)vertex;
         // Add a little extra capacity to avoid constant reallocation in the unlikely
         // theoretical case of a small number of triangles being added to the largest
         // model continuously.
-        int new_size = (nu_faces_required + 1024 + (8 / SRE_FACE_FLAG_BITS - 1)) /
-            (8 / SRE_FACE_FLAG_BITS);
-        face_type = new unsigned char[new_size];
-        max_face_types = new_size;
+        vertex = new int[nu_vertices_required + 1024];
+        max_vertices = nu_vertices_required + 1024;
     }
 }
 
+void EdgeArray::CheckFaceMaskCapacity(int nu_faces_required) {
+    int nu_words_required = (nu_faces_required + 31) >> 5;
+    if (nu_words_required > max_face_mask_words) {
+        delete [] face_mask;
+        // Add a little extra capacity to avoid constant reallocation in the unlikely
+        // theoretical case of a small number of triangles being added to the largest
+        // model continuously.
+        face_mask = new unsigned int[nu_words_required + 32];
+        max_face_mask_words = nu_words_required + 32;
+    }
+}
+
+// Silhouette and shadow volume buffer used when shadow volumes are calculated directly
+// in the rendering thread.
 static EdgeArray *silhouette_edges = NULL;
 
 // Shadow volume flags. These flags are not intrinsically tied to the model (information
@@ -215,245 +200,186 @@ enum {
   TYPE_COMPLEX_NON_CLOSED = 0x40,
 };
 
-static void CalculateSilhouetteEdges(const Vector4D& lightpos, EdgeArray *ea, int type) {
-    sreLODModelShadowVolume *m = ea->m;
-
-    // Dynamically reallocate the face type buffer when required.
-    ea->CheckFaceTypeCapacity(m->nu_triangles);
+// Determine which triangles are facing the light, using the model's precalculated triangle
+// plane equations. lightpos is in model space. A bit is written into face_mask for every
+// triangle; the padding triangles at the end of the last 32-bit word are also classified.
 
-    // Dynamically enlarge the edge array when required.
-    ea->CheckEdgeCapacity(m->nu_edges);
+typedef void (*sreClassifyFacesFunc)(const sreLODModelShadowVolume *m,
+    const Vector4D& lightpos, unsigned int *face_mask);
 
-    ea->nu_edges = 0;
-
-    // Determine which triangles are facing the light. Note that lightpos is in model space.
-    // In the VBO edges implementation, it is acceptable to do this in the model's
-    // original data structure instead of the VBO data.
-
-    // Special handling for non-closed models. When the open side is always hidden from the light
-    // and depth-pass rendering is used, no special handling is required.
-    if ((m->flags & SRE_LOD_MODEL_NOT_CLOSED) &&
-    ((type & TYPE_DEPTH_FAIL) || !(type & TYPE_OPEN_SIDE_HIDDEN_FROM_LIGHT)))
-        goto model_not_closed;
-
-// Configuration for SIMD light facing triangle calculation.
-// TRIANGLES_AT_A_TIME must be 4.
-#define TRIANGLES_AT_A_TIME 4
-// Whether to use full optimized SIMD, as opposed to using SIMD just for dot products.
-#define USE_INLINE_SIMD_FOR_LIGHT_VECTOR_CALCULATION
-// Whether to use simd_load instructions to load entire vectors into SIMD registers,
-// and then transposing vectors to obtain the appropriate set-up for calculation, as
-// opposed to using simd_set to set vector components.
-// Not using load instruction seems to be slightly faster in this case.
-// #define USE_LOAD_INSTRUCTION
-
-    {
-    int i = 0;
+static void ClassifyFaces(const sreLODModelShadowVolume *m, const Vector4D& lightpos,
+unsigned int *face_mask) {
+    int nu_words = (m->nu_triangles + 31) >> 5;
 #ifdef USE_SIMD
-    // Process TRIANGLES_AT_AT_TIME triangles at a time using SIMD.
+    // Process four triangles at a time using SIMD.
     const __simd128_float m_zeros = simd128_set_zero_float();
-#ifdef USE_INLINE_SIMD_FOR_LIGHT_VECTOR_CALCULATION
     const __simd128_float m_lightpos_x = simd128_set_same_float(lightpos.x);
     const __simd128_float m_lightpos_y = simd128_set_same_float(lightpos.y);
     const __simd128_float m_lightpos_z = simd128_set_same_float(lightpos.z);
     const __simd128_float m_lightpos_w = simd128_set_same_float(lightpos.w);
-#endif
-    for (; i + TRIANGLES_AT_A_TIME - 1 < m->nu_triangles; i += TRIANGLES_AT_A_TIME) {
-        for (int j = 0; j < TRIANGLES_AT_A_TIME / 4; j++) {
-            int k = i + j * 4;
-            // Calculate dot products of the light vector lv and triangle normal tn.
-#ifdef USE_INLINE_SIMD_FOR_LIGHT_VECTOR_CALCULATION
-#ifdef USE_LOAD_INSTRUCTION
-            __simd128_float m_vertex0_0 = simd128_load(
-                &m->vertex[m->triangle[k + 0].vertex_index[0]]);
-            __simd128_float m_vertex0_1 = simd128_load(
-                &m->vertex[m->triangle[k + 1].vertex_index[0]]);
-            __simd128_float m_vertex0_2 = simd128_load(
-                &m->vertex[m->triangle[k + 2].vertex_index[0]]);
-            __simd128_float m_vertex0_3 = simd128_load(
-                &m->vertex[m->triangle[k + 3].vertex_index[0]]);
-            __simd128_float m_vertex0_x, m_vertex0_y, m_vertex0_z;
-            simd128_transpose4to3_float(m_vertex0_0, m_vertex0_1, m_vertex0_2,
-                m_vertex0_3, m_vertex0_x, m_vertex0_y, m_vertex0_z);
-#else
-            Vector3D vertex0[4], tn[4];
-            for (int l = 0; l < 4; l++) { 
-                 vertex0[l] = m->vertex[m->triangle[k + l].vertex_index[0]];
-                 tn[l] = m->triangle[k + l].normal;
-            }
-            __simd128_float m_vertex0_x = simd128_set_float(vertex0[0].x, vertex0[1].x,
-                 vertex0[2].x, vertex0[3].x);
-            __simd128_float m_vertex0_y = simd128_set_float(vertex0[0].y, vertex0[1].y,
-                 vertex0[2].y, vertex0[3].y);
-            __simd128_float m_vertex0_z = simd128_set_float(vertex0[0].z, vertex0[1].z,
-                 vertex0[2].z, vertex0[3].z);
-#endif
-            __simd128_float m_lv_x = simd128_sub_float(m_lightpos_x,
-                 simd128_mul_float(m_lightpos_w, m_vertex0_x));
-            __simd128_float m_lv_y = simd128_sub_float(m_lightpos_y,
-                 simd128_mul_float(m_lightpos_w, m_vertex0_y));
-            __simd128_float m_lv_z = simd128_sub_float(m_lightpos_z,
-                 simd128_mul_float(m_lightpos_w, m_vertex0_z));
-#ifdef USE_LOAD_INSTRUCTION
-            __simd128_float m_tn0 = simd128_load(&m->triangle[k + 0].normal);
-            __simd128_float m_tn1 = simd128_load(&m->triangle[k + 1].normal);
-            __simd128_float m_tn2 = simd128_load(&m->triangle[k + 2].normal);
-            __simd128_float m_tn3 = simd128_load(&m->triangle[k + 3].normal);
-            __simd128_float m_tn_x, m_tn_y, m_tn_z;
-            simd128_transpose4to3_float(m_tn0, m_tn1, m_tn2,
-                m_tn3, m_tn_x, m_tn_y, m_tn_z);
-#else
-            __simd128_float m_tn_x = simd128_set_float(tn[0].x, tn[1].x, tn[2].x, tn[3].x);
-            __simd128_float m_tn_y = simd128_set_float(tn[0].y, tn[1].y, tn[2].y, tn[3].y);
-            __simd128_float m_tn_z = simd128_set_float(tn[0].z, tn[1].z, tn[2].z, tn[3].z);
-#endif
-            __simd128_float m_dot_x = simd128_mul_float(m_lv_x, m_tn_x);
-            __simd128_float m_dot_y = simd128_mul_float(m_lv_y, m_tn_y);
-            __simd128_float m_dot_z = simd128_mul_float(m_lv_z, m_tn_z);
-            // mul0 should contain only the x components of the dot products, etc.
-            __simd128_float m_result = simd128_add_float(
-                simd128_add_float(m_dot_x, m_dot_y), m_dot_z);
-#else
-            Vector3D lv[4], tn[4];
-            for (int l = 0; l < 4; l++) {
-                lv[l] = lightpos.GetPoint3D() - lightpos.w *
-                    m->vertex[m->triangle[k + l].vertex_index[0]];
-                tn[l] = m->triangle[k + l].normal;
-            }
-            __simd128_float m_result;
-            SIMDCalculateFourDotProductsNoStore(&lv[0], &tn[0], m_result);
-#endif
-            // Produce 32-bit masks (0xFFFFFFFF or 0x00000000) for each comparison result.
-            __simd128_int m_comp = simd128_cmpge_float(m_result, m_zeros);
-            unsigned int face_flags = simd128_convert_masks_int32_int1(m_comp);
-            unsigned int byte_flags = (face_flags & 0x1) + ((face_flags & 0x2) << 7)
-                + ((face_flags & 0x4) << 14) + ((face_flags & 0x8) << 21);
-            // Set four flags at a time.
-            ea->SetFourFaceTypes(k, byte_flags);
-//            printf("face_type[0, 1, 2, 3] = 0x%08X\n", ea->GetFourFaceTypes(k));
+    for (int i = 0; i < nu_words; i++) {
+        unsigned int mask = 0;
+        for (int j = 0; j < 32; j += 4) {
+            int k = i * 32 + j;
+            __simd128_float m_plane_x = simd128_set_float(m->triangle_plane_x[k],
+                m->triangle_plane_x[k + 1], m->triangle_plane_x[k + 2], m->triangle_plane_x[k + 3]);
+            __simd128_float m_plane_y = simd128_set_float(m->triangle_plane_y[k],
+                m->triangle_plane_y[k + 1], m->triangle_plane_y[k + 2], m->triangle_plane_y[k + 3]);
+            __simd128_float m_plane_z = simd128_set_float(m->triangle_plane_z[k],
+                m->triangle_plane_z[k + 1], m->triangle_plane_z[k + 2], m->triangle_plane_z[k + 3]);
+            __simd128_float m_plane_w = simd128_set_float(m->triangle_plane_w[k],
+                m->triangle_plane_w[k + 1], m->triangle_plane_w[k + 2], m->triangle_plane_w[k + 3]);
+            __simd128_float m_dot = simd128_add_float(
+                simd128_add_float(
+                    simd128_mul_float(m_lightpos_x, m_plane_x),
+                    simd128_mul_float(m_lightpos_y, m_plane_y)),
+                simd128_add_float(
+                    simd128_mul_float(m_lightpos_z, m_plane_z),
+                    simd128_mul_float(m_lightpos_w, m_plane_w)));
+            __simd128_int m_comp = simd128_cmpge_float(m_dot, m_zeros);
+            mask |= simd128_convert_masks_int32_int1(m_comp) << j;
         }
+        face_mask[i] = mask;
     }
-#endif	// defined(USE_SIMD)
-    for (;i < m->nu_triangles; i++) {
-        Vector3D light_vector = lightpos.GetPoint3D() -
-            lightpos.w * m->vertex[m->triangle[i].vertex_index[0]];
-        if (Dot(light_vector, m->triangle[i].normal) < 0.0f)
-            ea->SetFaceType(i, 0);
-        else
-            ea->SetFaceType(i, SRE_FACE_FLAG_LIGHT_FACING);
+#else
+    for (int i = 0; i < nu_words; i++) {
+        unsigned int mask = 0;
+        for (int j = 0; j < 32; j++) {
+            int k = i * 32 + j;
+            float dot = lightpos.x * m->triangle_plane_x[k] + lightpos.y * m->triangle_plane_y[k] +
+                lightpos.z * m->triangle_plane_z[k] + lightpos.w * m->triangle_plane_w[k];
+            mask |= (unsigned int)(dot >= 0.0f) << j;
+        }
+        face_mask[i] = mask;
     }
-    // Check the orientation of the faces with the respect to the light to determine the
-    // silhouette edges.
-    i = 0;
-    // Processing of multiple edges a time is supported when the face flags are stored
-    // as a single byte.
-#if SRE_FACE_FLAG_BITS == 8
-#define EDGES_AT_A_TIME 8
-    for (; i + EDGES_AT_A_TIME - 1 < m->nu_edges; i += EDGES_AT_A_TIME) {
-        // Process 4, 8 or 16 edges a time.
-        unsigned int face_type_bits_tri0 =
-            (unsigned int)ea->face_type[m->edge[i + 0].triangle_index[0]] +
-            ((unsigned int)ea->face_type[m->edge[i + 1].triangle_index[0]] << 1) +
-            ((unsigned int)ea->face_type[m->edge[i + 2].triangle_index[0]] << 2) +
-            ((unsigned int)ea->face_type[m->edge[i + 3].triangle_index[0]] << 3);
-        unsigned int face_type_bits_tri1 =
-            (unsigned int)ea->face_type[m->edge[i + 0].triangle_index[1]] +
-            ((unsigned int)ea->face_type[m->edge[i + 1].triangle_index[1]] << 1) +
-            ((unsigned int)ea->face_type[m->edge[i + 2].triangle_index[1]] << 2) +
-            ((unsigned int)ea->face_type[m->edge[i + 3].triangle_index[1]] << 3);
-#if EDGES_AT_A_TIME >= 8
-        face_type_bits_tri0 +=
-            ((unsigned int)ea->face_type[m->edge[i + 4].triangle_index[0]] << 4) +
-            ((unsigned int)ea->face_type[m->edge[i + 5].triangle_index[0]] << 5) +
-            ((unsigned int)ea->face_type[m->edge[i + 6].triangle_index[0]] << 6) +
-            ((unsigned int)ea->face_type[m->edge[i + 7].triangle_index[0]] << 7);
-        face_type_bits_tri1 +=
-            ((unsigned int)ea->face_type[m->edge[i + 4].triangle_index[1]] << 4) +
-            ((unsigned int)ea->face_type[m->edge[i + 5].triangle_index[1]] << 5) +
-            ((unsigned int)ea->face_type[m->edge[i + 6].triangle_index[1]] << 6) +
-            ((unsigned int)ea->face_type[m->edge[i + 7].triangle_index[1]] << 7);
 #endif
-#if EDGES_AT_A_TIME == 16
-        face_type_bits_tri0 +=
-            ((unsigned int)ea->face_type[m->edge[i + 8].triangle_index[0]] << 8) +
-            ((unsigned int)ea->face_type[m->edge[i + 9].triangle_index[0]] << 9) +
-            ((unsigned int)ea->face_type[m->edge[i + 10].triangle_index[0]] << 10) +
-            ((unsigned int)ea->face_type[m->edge[i + 11].triangle_index[0]] << 11);
-        face_type_bits_tri0 +=
-            ((unsigned int)ea->face_type[m->edge[i + 12].triangle_index[0]] << 12) +
-            ((unsigned int)ea->face_type[m->edge[i + 13].triangle_index[0]] << 13) +
-            ((unsigned int)ea->face_type[m->edge[i + 14].triangle_index[0]] << 14) +
-            ((unsigned int)ea->face_type[m->edge[i + 15].triangle_index[0]] << 15);
-        face_type_bits_tri1 +=
-            ((unsigned int)ea->face_type[m->edge[i + 8].triangle_index[1]] << 8) +
-            ((unsigned int)ea->face_type[m->edge[i + 9].triangle_index[1]] << 9) +
-            ((unsigned int)ea->face_type[m->edge[i + 10].triangle_index[1]] << 10) +
-            ((unsigned int)ea->face_type[m->edge[i + 11].triangle_index[1]] << 11);
-        face_type_bits_tri1 +=
-            ((unsigned int)ea->face_type[m->edge[i + 12].triangle_index[1]] << 12) +
-            ((unsigned int)ea->face_type[m->edge[i + 13].triangle_index[1]] << 13) +
-            ((unsigned int)ea->face_type[m->edge[i + 14].triangle_index[1]] << 14) +
-            ((unsigned int)ea->face_type[m->edge[i + 15].triangle_index[1]] << 15);
-#endif
-        unsigned int cond_int = face_type_bits_tri0 ^ face_type_bits_tri1;
-        // Process multiple checks at a time, so that a set of four/sixteen edges can be
-        // immediately dismissed when none of them are part of the silhouette.
-        for (int j = 0; j < EDGES_AT_A_TIME; j++) {
-            if (cond_int == 0)
-                break;
-            // Set the "reverse edge" bit when triangle 0 faces the light.
-            unsigned int reversed_bit = face_type_bits_tri0 << 31;
-            if (cond_int & 0x1) {
-                ea->AppendEdge((i + j) | reversed_bit);
-            }
-            face_type_bits_tri0 >>= 1;
-            cond_int >>= 1;
+}
+
+#ifdef SRE_RUNTIME_SIMD_DISPATCH
+
+// AVX2 version processing eight triangles at a time.
+
+__attribute__((target("avx2,fma")))
+static void ClassifyFacesAVX2(const sreLODModelShadowVolume *m, const Vector4D& lightpos,
+unsigned int *face_mask) {
+    int nu_words = (m->nu_triangles + 31) >> 5;
+    const __m256 m_zeros = _mm256_setzero_ps();
+    const __m256 m_lightpos_x = _mm256_set1_ps(lightpos.x);
+    const __m256 m_lightpos_y = _mm256_set1_ps(lightpos.y);
+    const __m256 m_lightpos_z = _mm256_set1_ps(lightpos.z);
+    const __m256 m_lightpos_w = _mm256_set1_ps(lightpos.w);
+    for (int i = 0; i < nu_words; i++) {
+        unsigned int mask = 0;
+        for (int j = 0; j < 32; j += 8) {
+            int k = i * 32 + j;
+            __m256 m_dot = _mm256_mul_ps(m_lightpos_w, _mm256_loadu_ps(&m->triangle_plane_w[k]));
+            m_dot = _mm256_fmadd_ps(m_lightpos_z, _mm256_loadu_ps(&m->triangle_plane_z[k]), m_dot);
+            m_dot = _mm256_fmadd_ps(m_lightpos_y, _mm256_loadu_ps(&m->triangle_plane_y[k]), m_dot);
+            m_dot = _mm256_fmadd_ps(m_lightpos_x, _mm256_loadu_ps(&m->triangle_plane_x[k]), m_dot);
+            mask |= (unsigned int)_mm256_movemask_ps(_mm256_cmp_ps(m_dot, m_zeros, _CMP_GE_OQ)) << j;
         }
+        face_mask[i] = mask;
     }
-#endif // SRE_FACE_FLAG_BITS == 8 (processed multiple edges at a time).
-    // Process the remaining edges.
-    for (; i < m->nu_edges; i++) {
-        ModelEdge *e = &m->edge[i];
-        // Check the orientation of the faces with the respect to the light to determine the
-        // silhouette edge.
-        unsigned char face_type0 = ea->GetFaceType(e->triangle_index[0]);
-        unsigned char face_type1 = ea->GetFaceType(e->triangle_index[1]);
-        if (face_type0 != face_type1) {
-            // When the face on on side of the edge faces the light, and the one on the other
-            // side does not, the edge is part of the silhouette.
-            // Convention for an edge in the model's edge array is that v0 to v1 is
-            // counterclockwise in face 0 and clockwise in face 1.
-            // Set the "reverse edge" bit when triangle 0 faces the light to ensure that the
-            // edge is in clockwise order with respect to the silhouette, ready to be output
-            // in sequential order as part of a shadow volume side triangle.
-            unsigned int reversed_bit = (unsigned int)face_type0 << 31;
-            ea->AppendEdge(i | reversed_bit);
+}
+
+// AVX-512 version processing sixteen triangles at a time.
+
+__attribute__((target("avx512f")))
+static void ClassifyFacesAVX512(const sreLODModelShadowVolume *m, const Vector4D& lightpos,
+unsigned int *face_mask) {
+    int nu_words = (m->nu_triangles + 31) >> 5;
+    const __m512 m_zeros = _mm512_setzero_ps();
+    const __m512 m_lightpos_x = _mm512_set1_ps(lightpos.x);
+    const __m512 m_lightpos_y = _mm512_set1_ps(lightpos.y);
+    const __m512 m_lightpos_z = _mm512_set1_ps(lightpos.z);
+    const __m512 m_lightpos_w = _mm512_set1_ps(lightpos.w);
+    for (int i = 0; i < nu_words; i++) {
+        unsigned int mask = 0;
+        for (int j = 0; j < 32; j += 16) {
+            int k = i * 32 + j;
+            __m512 m_dot = _mm512_mul_ps(m_lightpos_w, _mm512_loadu_ps(&m->triangle_plane_w[k]));
+            m_dot = _mm512_fmadd_ps(m_lightpos_z, _mm512_loadu_ps(&m->triangle_plane_z[k]), m_dot);
+            m_dot = _mm512_fmadd_ps(m_lightpos_y, _mm512_loadu_ps(&m->triangle_plane_y[k]), m_dot);
+            m_dot = _mm512_fmadd_ps(m_lightpos_x, _mm512_loadu_ps(&m->triangle_plane_x[k]), m_dot);
+            mask |= (unsigned int)_mm512_cmp_ps_mask(m_dot, m_zeros, _CMP_GE_OQ) << j;
         }
+        face_mask[i] = mask;
     }
-    return;
-    }
+}
 
-model_not_closed :
-    for (int i = 0; i < m->nu_triangles; i++) {
-        Vector3D light_vector = lightpos.GetPoint3D() - lightpos.w *
-            m->vertex[m->triangle[i].vertex_index[0]];
-        float dot = Dot(light_vector, m->triangle[i].normal);
-        int face_flags;
-        if (dot < 0.0f)
-            face_flags = 0;
-        else
-            face_flags = SRE_FACE_FLAG_LIGHT_FACING;
-#if 0
-#if SRE_FACE_FLAG_BITS > 1
-        if (dot > - 0.01f && dot < 0.01f)
-            face_flags |= SRE_FACE_FLAG_PERPENDICULAR_TO_LIGHT;
 #endif
+
+static sreClassifyFacesFunc classify_faces_func = NULL;
+
+// Select the light-facing triangle determination function for the processor. Must be
+// called before any silhouettes are calculated.
+
+static void SelectClassifyFacesFunction() {
+    classify_faces_func = ClassifyFaces;
+#ifdef SRE_RUNTIME_SIMD_DISPATCH
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx512f")) {
+        classify_faces_func = ClassifyFacesAVX512;
+        sreMessage(SRE_MESSAGE_INFO, "Using AVX-512 for shadow volume silhouette determination.");
+    }
+    else if (__builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma")) {
+        classify_faces_func = ClassifyFacesAVX2;
+        sreMessage(SRE_MESSAGE_INFO, "Using AVX2 for shadow volume silhouette determination.");
+    }
 #endif
-        ea->SetFaceType(i, face_flags);
+}
+
+static void CalculateSilhouetteEdges(const Vector4D& lightpos, EdgeArray *ea, int type) {
+    sreLODModelShadowVolume *m = ea->m;
+
+    // Dynamically reallocate the face mask when required.
+    ea->CheckFaceMaskCapacity(m->nu_triangles);
+
+    // Dynamically enlarge the edge array when required.
+    ea->CheckEdgeCapacity(m->nu_edges);
+
+    ea->nu_edges = 0;
+
+    // Determine which triangles are facing the light. Note that lightpos is in model space.
+    classify_faces_func(m, lightpos, ea->face_mask);
+
+    // Special handling for non-closed models. Edges on the open side have no second
+    // triangle (triangle_index[1] == -1), which the branch-free loop below cannot handle.
+    if (m->flags & SRE_LOD_MODEL_NOT_CLOSED)
+        goto model_not_closed;
+
+    // Check the orientation of the faces with the respect to the light to determine the
+    // silhouette edges. When the face on one side of the edge faces the light, and the one
+    // on the other side does not, the edge is part of the silhouette.
+    // Convention for an edge in the model's edge array is that v0 to v1 is counterclockwise
+    // in face 0 and clockwise in face 1. The "reverse edge" bit is set when triangle 0 faces
+    // the light to ensure that the edge is in clockwise order with respect to the silhouette,
+    // ready to be output in sequential order as part of a shadow volume side triangle.
+    //
+    // The loop is branch-free: every edge is written to the array, but the edge count is
+    // only advanced for silhouette edges. This is safe because the count never exceeds
+    // the index of the current edge.
+    {
+    const ModelEdge *edge = m->edge;
+    const unsigned int *face_mask = ea->face_mask;
+    unsigned int *edge_index = ea->edge_index;
+    int n = 0;
+    for (int i = 0; i < m->nu_edges; i++) {
+        unsigned int t0 = edge[i].triangle_index[0];
+        unsigned int t1 = edge[i].triangle_index[1];
+        unsigned int face_type0 = (face_mask[t0 >> 5] >> (t0 & 31)) & 1;
+        unsigned int face_type1 = (face_mask[t1 >> 5] >> (t1 & 31)) & 1;
+        edge_index[n] = i | (face_type0 << 31);
+        n += face_type0 ^ face_type1;
     }
+    ea->nu_edges = n;
+    return;
+    }
+
+model_not_closed :
     for (int i = 0; i < m->nu_edges; i++) {
         ModelEdge *e = &m->edge[i];
-        unsigned char face_type0 = ea->GetFaceType(e->triangle_index[0]);
+        unsigned int face_type0 = ea->GetFaceType(e->triangle_index[0]);
         if (e->triangle_index[1] == -1) {
             // The other side of the edge is open.
             if (type & TYPE_OPEN_SIDE_HIDDEN_FROM_LIGHT) {
@@ -480,7 +406,7 @@ model_not_closed :
         if (m->flags & SRE_LOD_MODEL_SINGLE_PLANE)
             // Don't output interior edges within the plane.
             continue;
-        unsigned char face_type1 = ea->GetFaceType(e->triangle_index[1]);
+        unsigned int face_type1 = ea->GetFaceType(e->triangle_index[1]);
         if (type & TYPE_OPEN_SIDE_HIDDEN_FROM_LIGHT) {
             if ((face_type0 & SRE_FACE_FLAG_LIGHT_FACING)
             != (face_type1 & SRE_FACE_FLAG_LIGHT_FACING)) {
@@ -512,22 +438,18 @@ model_not_closed :
 #define SHORT_ELEMENT_BUFFER
 
 #define EmitVertexShort(v) \
-    ((unsigned short *)shadow_volume_vertex)[nu_shadow_volume_vertices] = v; \
-    nu_shadow_volume_vertices++;
+    ((unsigned short *)ea->vertex)[ea->nu_vertices] = v; \
+    ea->nu_vertices++;
 
 #define EmitVertexInt(v) \
-    ((unsigned int *)shadow_volume_vertex)[nu_shadow_volume_vertices] = v; \
-    nu_shadow_volume_vertices++;
+    ((unsigned int *)ea->vertex)[ea->nu_vertices] = v; \
+    ea->nu_vertices++;
 
 #define NU_ELEMENT_BUFFERS 1
 static GLuint *element_buffer_id = NULL;
 static int current_element_buffer;
 static GLuint last_vertexbuffer_id;
 
-static void *shadow_volume_vertex = NULL;
-static int max_shadow_volume_vertices;
-static int nu_shadow_volume_vertices;
-
 // Array buffer flags for shadow volumes.
 
 enum {
@@ -710,7 +632,7 @@ int array_buffer_flags) {
         int e = edge_starting_at_vertex[v0];
         if (e < 0) {
             // Error. Cannot construct triangle fan.
-            nu_shadow_volume_vertices = 0;
+            ea->nu_vertices = 0;
             return false;
         }
         ea->GetSecondVertex(e, v1);
@@ -730,7 +652,7 @@ add_sides_triangle_fan_int :
         int e = edge_starting_at_vertex[v0];
         if (e < 0) {
             // Error.
-            nu_shadow_volume_vertices = 0;
+            ea->nu_vertices = 0;
             return false;
         }
         ea->GetSecondVertex(e, v1);
@@ -930,6 +852,8 @@ int array_buffer_flags, int nu_vertices) {
         }
         else
             glDrawElements(GL_TRIANGLE_STRIP, nu_vertices, GL_UNSIGNED_SHORT, (void *)0);
+        // The restart indices are counted as vertices.
+        sreProfilerCountDraw(nu_vertices - 2);
         return;
     }
 #endif
@@ -943,6 +867,7 @@ int array_buffer_flags, int nu_vertices) {
         glDrawElements(mode, nu_vertices, GL_UNSIGNED_SHORT, (void *)0);
     else
         glDrawElements(mode, nu_vertices, GL_UNSIGNED_INT, (void *)0);
+    sreProfilerCountDraw(mode == GL_TRIANGLES ? nu_vertices / 3 : nu_vertices - 2);
 
 #ifdef OPENGL_ES2
     if (!(type & TYPE_DEPTH_PASS))
@@ -952,10 +877,11 @@ int array_buffer_flags, int nu_vertices) {
 
 // Draw shadow volume after it has been calculated.
 
-static void DrawShadowVolumeGL(sreLODModelShadowVolume *m, int array_buffer_flags,
-int cache_used) {
-    if (nu_shadow_volume_vertices == 0)
+static void DrawShadowVolumeGL(EdgeArray *ea, int cache_used) {
+    if (ea->nu_vertices == 0)
         return;
+    sreLODModelShadowVolume *m = ea->m;
+    int array_buffer_flags = ea->array_buffer_flags;
     // Enable the vertex buffer of the model.
     if (m->GL_attribute_buffer[SRE_ATTRIBUTE_POSITION] != last_vertexbuffer_id) {
         glEnableVertexAttribArray(0);
@@ -972,22 +898,26 @@ int cache_used) {
         last_vertexbuffer_id = m->GL_attribute_buffer[SRE_ATTRIBUTE_POSITION];
     }
 
-    // Enable the elements (index) buffer.
-    current_element_buffer = (current_element_buffer + 1) % NU_ELEMENT_BUFFERS;
-    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, element_buffer_id[current_element_buffer]);
-
-    // Upload the element data.
-    int buffer_usage;
-    if (cache_used != 0)
-        buffer_usage = GL_STATIC_DRAW;
-    else
-        buffer_usage = GL_DYNAMIC_DRAW;
-    if (m->GL_indexsize == 2)
-        glBufferData(GL_ELEMENT_ARRAY_BUFFER, nu_shadow_volume_vertices * sizeof(short int),
-            shadow_volume_vertex, buffer_usage);
-    else
-        glBufferData(GL_ELEMENT_ARRAY_BUFFER, nu_shadow_volume_vertices * sizeof(int),
-            shadow_volume_vertex, buffer_usage);
+    // Upload the element data. When the shadow volume is not going to be cached, try to
+    // use the streaming buffer; otherwise, use the current element buffer, which may be
+    // handed over to a shadow volume cache afterwards.
+    int size = ea->nu_vertices * m->GL_indexsize;
+    unsigned int offset = SRE_STREAMING_BUFFER_FAILED;
+    if (cache_used == 0)
+        offset = sreUploadToStreamingBuffer(ea->vertex, size);
+    if (offset != SRE_STREAMING_BUFFER_FAILED)
+        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, sre_internal_streaming_buffer);
+    else {
+        current_element_buffer = (current_element_buffer + 1) % NU_ELEMENT_BUFFERS;
+        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, element_buffer_id[current_element_buffer]);
+        int buffer_usage;
+        if (cache_used != 0)
+            buffer_usage = GL_STATIC_DRAW;
+        else
+            buffer_usage = GL_DYNAMIC_DRAW;
+        glBufferData(GL_ELEMENT_ARRAY_BUFFER, size, ea->vertex, buffer_usage);
+        offset = 0;
+    }
 
     // Draw the element array.
 #ifndef NO_PRIMITIVE_RESTART
@@ -997,12 +927,14 @@ int cache_used) {
         // using 32-bit indices.
         if (m->GL_indexsize == 4) {
             glPrimitiveRestartIndexNV(0xFFFFFFFF);
-            glDrawElements(GL_TRIANGLE_STRIP, nu_shadow_volume_vertices, GL_UNSIGNED_INT, (void *)0);
+            glDrawElements(GL_TRIANGLE_STRIP, ea->nu_vertices, GL_UNSIGNED_INT, (void *)(uintptr_t)offset);
             // Restore the expected state.
             glPrimitiveRestartIndexNV(0xFFFF);
         }
         else
-            glDrawElements(GL_TRIANGLE_STRIP, nu_shadow_volume_vertices, GL_UNSIGNED_SHORT, (void *)0);
+            glDrawElements(GL_TRIANGLE_STRIP, ea->nu_vertices, GL_UNSIGNED_SHORT, (void *)(uintptr_t)offset);
+        // The restart indices are counted as vertices.
+        sreProfilerCountDraw(ea->nu_vertices - 2);
         return;
     }
 #endif
@@ -1013,295 +945,311 @@ int cache_used) {
     else
         mode = GL_TRIANGLES;
     if (m->GL_indexsize == 2)
-        glDrawElements(mode, nu_shadow_volume_vertices, GL_UNSIGNED_SHORT, (void *)0);
+        glDrawElements(mode, ea->nu_vertices, GL_UNSIGNED_SHORT, (void *)(uintptr_t)offset);
     else
-        glDrawElements(mode, nu_shadow_volume_vertices, GL_UNSIGNED_INT, (void *)0);
+        glDrawElements(mode, ea->nu_vertices, GL_UNSIGNED_INT, (void *)(uintptr_t)offset);
+    sreProfilerCountDraw(mode == GL_TRIANGLES ? ea->nu_vertices / 3 : ea->nu_vertices - 2);
 }
 
-// Object shadow volumes cache for point lights/spot lights. Direct-mapped with
-// scene object id with the light id mixed in with a multiplication factor.
+// Shadow volume caches. There is an object cache for point lights/spot lights, keyed by
+// scene object id with the light index mixed in with a multiplication factor, and a model
+// cache for directional lights/beam lights, keyed by LOD model id.
+//
+// Both caches are set-associative with SRE_SHADOW_VOLUME_CACHE_WAYS entries per cache line;
+// the number of cache lines is configurable. In addition, the GPU memory used by the element
+// buffers of both caches combined is limited to sre_internal_shadow_volume_cache_budget
+// bytes; when the budget is exceeded, the least recently used entries are evicted. Entries
+// created or last used by objects with the SRE_OBJECT_PIN_SHADOW_VOLUME_CACHE flag set are
+// pinned and never evicted.
 
-class ShadowVolumeObjectCacheEntry {
+#define SRE_SHADOW_VOLUME_CACHE_WAYS 4
+
+class ShadowVolumeCacheEntry {
 public :
-    int so_id; // -1 if empty.
-    sreLODModelShadowVolume *model;
+    sreLODModelShadowVolume *model; // NULL if empty.
+    int so_id; // Scene object id for the object cache, - 1 for the model cache.
     Vector4D lightpos;
     GLuint opengl_id;
     int nu_vertices;
+    int size; // Size of the element buffer in bytes.
     char type;
     char array_buffer_flags;
+    bool pinned;
     int timestamp;
+    // Links in the LRU list (most recently used first). Pinned entries are not in the list.
+    int lru_prev;
+    int lru_next;
 };
 
-// There are SRE_SHADOW_VOLUME_OBJECT_CACHE_SIZE cache lines of four cache entries each.
-// Scene object i is mapped to entries at ((i + light_index * 77) %
-// SRE_SHADOW_VOLUME_OBJECT_CACHE_SIZE) * 4.
-
-class ShadowVolumeObjectCache {
+class ShadowVolumeCache {
 public :
-    ShadowVolumeObjectCacheEntry entry[SRE_SHADOW_VOLUME_OBJECT_CACHE_SIZE * 4];
+    const char *name;
+    ShadowVolumeCacheEntry *entry;
+    int nu_lines; // Power of two.
+    int lru_head;
+    int lru_tail;
+    int nu_entries_used;
+    int nu_entries_pinned;
     int total_vertex_count;
-
-    ShadowVolumeObjectCache();
-    ShadowVolumeObjectCacheEntry *Lookup(int so_id, sreLODModelShadowVolume *model,
+    int total_size;
+    int hits;
+    int hits_depthfail;
+    int misses;
+
+    ShadowVolumeCache(const char *_name, int _nu_lines);
+    void SetSize(int _nu_lines);
+    // Return the index of the first entry of the cache line for the given key.
+    inline int Line(int key) const {
+        return (key & (nu_lines - 1)) * SRE_SHADOW_VOLUME_CACHE_WAYS;
+    }
+    ShadowVolumeCacheEntry *Lookup(int line, int so_id, sreLODModelShadowVolume *model,
         const Vector4D& lightpos_model, int type);
-    bool Add(int so_id, sreLODModelShadowVolume *model, const Vector4D& lightpos_model,
-        GLuint opengl_id, int nu_vertices, int type, int array_buffer_flags);
+    bool Add(int line, int so_id, sreLODModelShadowVolume *model, const Vector4D& lightpos_model,
+        GLuint opengl_id, int nu_vertices, int type, int array_buffer_flags, bool pinned);
+    void Touch(ShadowVolumeCacheEntry *e, bool pinned);
+    void Remove(int i);
+    void LinkLRU(int i);
+    void UnlinkLRU(int i);
     void PrintStats();
     void Clear();
 };
 
-static ShadowVolumeObjectCache object_cache;
+static ShadowVolumeCache object_cache("object", SRE_SHADOW_VOLUME_OBJECT_CACHE_SIZE);
+static ShadowVolumeCache model_cache("model", SRE_SHADOW_VOLUME_MODEL_CACHE_SIZE);
 
-ShadowVolumeObjectCache::ShadowVolumeObjectCache() {
-   for (int i = 0; i < SRE_SHADOW_VOLUME_OBJECT_CACHE_SIZE * 4; i++)
-       entry[i].so_id = - 1;
-   total_vertex_count = 0;
+ShadowVolumeCache::ShadowVolumeCache(const char *_name, int _nu_lines) {
+    name = _name;
+    entry = NULL;
+    SetSize(_nu_lines);
+    hits = 0;
+    hits_depthfail = 0;
+    misses = 0;
 }
 
-static inline int CacheIndex(int so_id) {
-    return ((so_id + sre_internal_current_light_index * 77) &
-        (SRE_SHADOW_VOLUME_OBJECT_CACHE_SIZE - 1)) * 4;
+// Reallocate the cache with the given number of cache lines (rounded up to a power of two).
+// The cache must be empty.
+
+void ShadowVolumeCache::SetSize(int _nu_lines) {
+    nu_lines = 1;
+    while (nu_lines < _nu_lines)
+        nu_lines *= 2;
+    delete [] entry;
+    entry = new ShadowVolumeCacheEntry[nu_lines * SRE_SHADOW_VOLUME_CACHE_WAYS];
+    for (int i = 0; i < nu_lines * SRE_SHADOW_VOLUME_CACHE_WAYS; i++)
+        entry[i].model = NULL;
+    lru_head = - 1;
+    lru_tail = - 1;
+    nu_entries_used = 0;
+    nu_entries_pinned = 0;
+    total_vertex_count = 0;
+    total_size = 0;
 }
 
-ShadowVolumeObjectCacheEntry *ShadowVolumeObjectCache::Lookup(int so_id,
-sreLODModelShadowVolume *model, const Vector4D& lightpos, int type) {
-    int start_i = CacheIndex(so_id);
-    for (int i = start_i; i < start_i + 4; i++)
-        if (entry[i].so_id == so_id) {
-            if (entry[i].model == model && entry[i].lightpos == lightpos && entry[i].type == type)
-                return &entry[i];
-        }
-    return NULL;
-}
-
-bool ShadowVolumeObjectCache::Add(int so_id, sreLODModelShadowVolume *model,
-const Vector4D& lightpos, GLuint opengl_id, int nu_vertices, int type, int array_buffer_flags) {
-    // Check whether there is an empty space at the cache position.
-    int min_timestamp = INT_MAX;
-    int j;
-    int start_i = CacheIndex(so_id);
-    for (int i = start_i; i < start_i + 4; i++) {
-        if (entry[i].so_id == -1) {
-            // There is an empty space, add the entry
-            j = i;
-            goto set_entry;
-        }
-        if (entry[i].timestamp < min_timestamp) {
-            min_timestamp = entry[i].timestamp;
-            j = i;
-        }
-    }
-    // Replace the least recently used entry.
-    glDeleteBuffers(1, &entry[j].opengl_id);
-    total_vertex_count -= entry[j].nu_vertices;
-set_entry :
-    entry[j].so_id = so_id;
-    entry[j].model = model;
-    entry[j].lightpos = lightpos;
-    entry[j].opengl_id = opengl_id;
-    entry[j].nu_vertices = nu_vertices;
-    entry[j].type = type;
-    entry[j].array_buffer_flags = array_buffer_flags;
-    entry[j].timestamp = sre_internal_current_frame;
-    total_vertex_count += nu_vertices;
-    return true;
-}
-
-static int object_cache_hits = 0;
-static int object_cache_hits_depthfail = 0;
-static int object_cache_misses = 0;
-
-void ShadowVolumeObjectCache::PrintStats() {
-    int count = 0;
-    int depth_fail = 0;
-    for (int i = 0; i < SRE_SHADOW_VOLUME_OBJECT_CACHE_SIZE * 4; i++) {
-        if (entry[i].so_id != -1) {
-            count++;
-            if (entry[i].type & TYPE_DEPTH_FAIL)
-                depth_fail++;
-        }
-    }
-    sreMessage(SRE_MESSAGE_INFO,
-        "Shadow volume cache stats (frame = %d): Use = %3.2f%%, Hit-rate = %3.2f%%",
-        sre_internal_current_frame, (float)count * 100 / (SRE_SHADOW_VOLUME_OBJECT_CACHE_SIZE * 4),
-        (float)object_cache_hits * 100 / (object_cache_misses + object_cache_hits));
-    sreMessage(SRE_MESSAGE_INFO,
-        "Depth fail (of entries) = %3.2f%%, of hits = %3.2f%%", (float)depth_fail * 100 / count,
-        (float)object_cache_hits_depthfail * 100 / object_cache_hits);
+void ShadowVolumeCache::LinkLRU(int i) {
+    entry[i].lru_prev = - 1;
+    entry[i].lru_next = lru_head;
+    if (lru_head >= 0)
+        entry[lru_head].lru_prev = i;
+    else
+        lru_tail = i;
+    lru_head = i;
 }
 
-void ShadowVolumeObjectCache::Clear() {
-   for (int i = 0; i < SRE_SHADOW_VOLUME_OBJECT_CACHE_SIZE * 4; i++)
-        if (entry[i].so_id != -1) {
-           glDeleteBuffers(1, &entry[i].opengl_id);
-           entry[i].so_id = - 1;
-        }
-   total_vertex_count = 0;
+void ShadowVolumeCache::UnlinkLRU(int i) {
+    if (entry[i].lru_prev >= 0)
+        entry[entry[i].lru_prev].lru_next = entry[i].lru_next;
+    else
+        lru_head = entry[i].lru_next;
+    if (entry[i].lru_next >= 0)
+        entry[entry[i].lru_next].lru_prev = entry[i].lru_prev;
+    else
+        lru_tail = entry[i].lru_prev;
 }
 
-// Check whether the scene object shadow volume is in the cache, if so draw it.
-
-bool ShadowVolumeObjectCacheHit(sreObject *so, sreLODModelShadowVolume *model,
-const Vector4D& lightpos_model, int type) {
-    ShadowVolumeObjectCacheEntry *entry = object_cache.Lookup(so->id, model, lightpos_model, type);
-    if (entry == NULL) {
-        object_cache_misses++;
-        return false;
-    }
-    object_cache_hits++;
-    if (entry->type & TYPE_DEPTH_FAIL)
-        object_cache_hits_depthfail++;
-
-    entry->timestamp = sre_internal_current_frame; // Update LRU stat.
+// Mark an entry as used in the current frame, and update its pinned status.
 
-    // We found a match, draw from the cache.
-
-    // Early exit is there are no vertices.
-    if (entry->nu_vertices == 0)
-        return true;
-
-    GL3InitializeShadowVolumeShader(*so, lightpos_model);
-    FinishDrawingShadowVolume(entry->type, model, entry->opengl_id, entry->array_buffer_flags,
-        entry->nu_vertices);
-
-    return true;
+void ShadowVolumeCache::Touch(ShadowVolumeCacheEntry *e, bool pinned) {
+    int i = e - entry;
+    e->timestamp = sre_internal_current_frame;
+    if (!e->pinned)
+        UnlinkLRU(i);
+    else
+        nu_entries_pinned--;
+    e->pinned = pinned;
+    if (!pinned)
+        LinkLRU(i);
+    else
+        nu_entries_pinned++;
 }
 
-// Model shadow volume cache for directional lights/beam lights. Direct-mapped with
-// model object id. Because there are only possible entries per object, in the rare
-// case of multiple directional (or beam) lights affecting the model, the cache
-// might become ineffective.
-
-class ShadowVolumeModelCacheEntry {
-public :
-    sreLODModelShadowVolume *model; // NULL if empty.
-    Vector4D lightpos;
-    GLuint opengl_id;
-    int nu_vertices;
-    char type;
-    char array_buffer_flags;
-    int timestamp;
-};
-
-// There are SRE_SHADOW_VOLUME_MODEL_CACHE_SIZE cache lines of four cache entries each.
-// Model object i is mapped to entries (i % (SRE_SHADOW_VOLUME_MODEL_CACHE_SIZE -1)) * 4
-// to (i % (SRE_SHADOW_VOLUME_MODEL_CACHE_SIZE - 1)) * 4 + 3.
-
-class ShadowVolumeModelCache {
-public :
-    ShadowVolumeModelCacheEntry entry[SRE_SHADOW_VOLUME_MODEL_CACHE_SIZE * 4];
-    int total_vertex_count;
-
-    ShadowVolumeModelCache();
-    ShadowVolumeModelCacheEntry *Lookup(sreLODModelShadowVolume *model,
-        const Vector4D& lightpos_model, int type);
-    bool Add(sreLODModelShadowVolume *model, const Vector4D& lightpos_model,
-        GLuint opengl_id, int nu_vertices, int type, int array_buffer_flags);
-    void PrintStats();
-    void Clear();
-};
-
-static ShadowVolumeModelCache model_cache;
-
-ShadowVolumeModelCache::ShadowVolumeModelCache() {
-   for (int i = 0; i < SRE_SHADOW_VOLUME_MODEL_CACHE_SIZE * 4; i++)
-       entry[i].model = NULL;
-   total_vertex_count = 0;
+void ShadowVolumeCache::Remove(int i) {
+    glDeleteBuffers(1, &entry[i].opengl_id);
+    if (!entry[i].pinned)
+        UnlinkLRU(i);
+    else
+        nu_entries_pinned--;
+    nu_entries_used--;
+    total_vertex_count -= entry[i].nu_vertices;
+    total_size -= entry[i].size;
+    entry[i].model = NULL;
 }
 
-ShadowVolumeModelCacheEntry *ShadowVolumeModelCache::Lookup(sreLODModelShadowVolume *model,
-const Vector4D& lightpos, int type) {
-    int map_id = model->id & (SRE_SHADOW_VOLUME_MODEL_CACHE_SIZE - 1);
-    for (int i = map_id * 4; i < map_id * 4 + 4; i++)
-        if (entry[i].model == model) {
+ShadowVolumeCacheEntry *ShadowVolumeCache::Lookup(int line, int so_id,
+sreLODModelShadowVolume *model, const Vector4D& lightpos, int type) {
+    for (int i = line; i < line + SRE_SHADOW_VOLUME_CACHE_WAYS; i++)
+        if (entry[i].model == model && entry[i].so_id == so_id) {
             if (entry[i].lightpos == lightpos && entry[i].type == type)
                 return &entry[i];
         }
     return NULL;
 }
 
-bool ShadowVolumeModelCache::Add(sreLODModelShadowVolume *model, const Vector4D& lightpos,
-GLuint opengl_id, int nu_vertices, int type, int array_buffer_flags) {
-    // Check whether there is already an entry with this object id.
+// Evict least recently used entries from both caches until an element buffer of the given
+// size fits within the budget. Returns false when that is not possible because the remaining
+// entries are pinned.
+
+static bool MakeShadowVolumeCacheSpace(int size) {
+    while (object_cache.total_size + model_cache.total_size + size >
+    sre_internal_shadow_volume_cache_budget) {
+        ShadowVolumeCache *cache;
+        if (object_cache.lru_tail < 0) {
+            if (model_cache.lru_tail < 0)
+                return false;
+            cache = &model_cache;
+        }
+        else if (model_cache.lru_tail < 0 ||
+        object_cache.entry[object_cache.lru_tail].timestamp <=
+        model_cache.entry[model_cache.lru_tail].timestamp)
+            cache = &object_cache;
+        else
+            cache = &model_cache;
+        cache->Remove(cache->lru_tail);
+    }
+    return true;
+}
+
+// Add a shadow volume to the cache. Returns false when it could not be added, in which
+// case the GL buffer is not taken over by the cache.
+
+bool ShadowVolumeCache::Add(int line, int so_id, sreLODModelShadowVolume *model,
+const Vector4D& lightpos, GLuint opengl_id, int nu_vertices, int type, int array_buffer_flags,
+bool pinned) {
+    int size = nu_vertices * model->GL_indexsize;
+    if (size > sre_internal_shadow_volume_cache_budget)
+        return false;
+    // Use an empty entry in the cache line if there is one, otherwise replace the least
+    // recently used entry that is not pinned.
     int min_timestamp = INT_MAX;
-    int j;
-    int map_id = model->id & (SRE_SHADOW_VOLUME_MODEL_CACHE_SIZE - 1);
-    for (int i = map_id * 4; i < map_id * 4 + 4; i++) {
+    int j = - 1;
+    for (int i = line; i < line + SRE_SHADOW_VOLUME_CACHE_WAYS; i++) {
         if (entry[i].model == NULL) {
-            // There is an empty space, add the entry
             j = i;
-            goto set_entry;
+            break;
         }
-        if (entry[i].timestamp < min_timestamp) {
+        if (!entry[i].pinned && entry[i].timestamp < min_timestamp) {
             min_timestamp = entry[i].timestamp;
             j = i;
         }
     }
-    // Replace the least recently used entry.
-    glDeleteBuffers(1, &entry[j].opengl_id);
-    total_vertex_count -= entry[j].nu_vertices;
-set_entry :
+    if (j < 0)
+        // All entries in the cache line are pinned.
+        return false;
+    if (entry[j].model != NULL)
+        Remove(j);
+    if (!MakeShadowVolumeCacheSpace(size))
+        return false;
     entry[j].model = model;
+    entry[j].so_id = so_id;
     entry[j].lightpos = lightpos;
     entry[j].opengl_id = opengl_id;
     entry[j].nu_vertices = nu_vertices;
+    entry[j].size = size;
     entry[j].type = type;
     entry[j].array_buffer_flags = array_buffer_flags;
     entry[j].timestamp = sre_internal_current_frame;
-    total_vertex_count += entry[j].nu_vertices;
+    entry[j].pinned = pinned;
+    if (!pinned)
+        LinkLRU(j);
+    else
+        nu_entries_pinned++;
+    nu_entries_used++;
+    total_vertex_count += nu_vertices;
+    total_size += size;
     return true;
 }
 
-static int model_cache_hits = 0;
-static int model_cache_hits_depthfail = 0;
-static int model_cache_misses = 0;
-
-void ShadowVolumeModelCache::PrintStats() {
-    int count = 0;
+void ShadowVolumeCache::PrintStats() {
     int depth_fail = 0;
-    for (int i = 0; i < SRE_SHADOW_VOLUME_MODEL_CACHE_SIZE * 4; i++) {
-        if (entry[i].model != NULL) {
-            count++;
-            if (entry[i].type & TYPE_DEPTH_FAIL)
-                depth_fail++;
-        }
-    }
+    for (int i = 0; i < nu_lines * SRE_SHADOW_VOLUME_CACHE_WAYS; i++)
+        if (entry[i].model != NULL && (entry[i].type & TYPE_DEPTH_FAIL))
+            depth_fail++;
     sreMessage(SRE_MESSAGE_INFO,
-        "Shadow volume model_cache stats (frame = %d): Use = %3.2f%%, Hit-rate = %3.2f%%",
-        sre_internal_current_frame, (float)count * 100 / (SRE_SHADOW_VOLUME_MODEL_CACHE_SIZE  * 4),
-        (float)model_cache_hits * 100 / (model_cache_misses + model_cache_hits));
+        "Shadow volume %s cache stats (frame = %d): Use = %3.2f%%, Hit-rate = %3.2f%%, "
+        "%d KB, %d pinned", name, sre_internal_current_frame,
+        (float)nu_entries_used * 100 / (nu_lines * SRE_SHADOW_VOLUME_CACHE_WAYS),
+        (float)hits * 100 / (misses + hits), total_size / 1024, nu_entries_pinned);
     sreMessage(SRE_MESSAGE_INFO,
-        "Depth fail (of entries) = %3.2f%%, of hits = %3.2f%%", (float)depth_fail * 100 / count,
-        (float)model_cache_hits_depthfail * 100 / model_cache_hits);
-    model_cache_hits = 0;
-    model_cache_misses = 0;
-    model_cache_hits_depthfail = 0;
+        "Depth fail (of entries) = %3.2f%%, of hits = %3.2f%%",
+        (float)depth_fail * 100 / nu_entries_used, (float)hits_depthfail * 100 / hits);
+}
+
+void ShadowVolumeCache::Clear() {
+    for (int i = 0; i < nu_lines * SRE_SHADOW_VOLUME_CACHE_WAYS; i++)
+        if (entry[i].model != NULL)
+            glDeleteBuffers(1, &entry[i].opengl_id);
+    SetSize(nu_lines);
 }
 
-void ShadowVolumeModelCache::Clear() {
-   for (int i = 0; i < SRE_SHADOW_VOLUME_MODEL_CACHE_SIZE * 4; i++)
-        if (entry[i].model != NULL) {
-           glDeleteBuffers(1, &entry[i].opengl_id);
-           entry[i].model = NULL;
+// Per-light and per-object cache statistics for the current frame (both caches combined),
+// indexed by light index and scene object id.
+
+static sreShadowCacheStats *light_cache_stats = NULL;
+static int max_light_cache_stats = 0;
+static sreShadowCacheStats *object_cache_stats = NULL;
+static int max_object_cache_stats = 0;
+
+static sreShadowCacheStats *GetCacheStats(sreShadowCacheStats *&stats, int& max_stats, int i) {
+    if (i >= max_stats) {
+        int new_max_stats = maxi(i + 1, max_stats * 2);
+        sreShadowCacheStats *new_stats = new sreShadowCacheStats[new_max_stats];
+        for (int j = 0; j < max_stats; j++)
+            new_stats[j] = stats[j];
+        for (int j = max_stats; j < new_max_stats; j++) {
+            new_stats[j].hits = 0;
+            new_stats[j].misses = 0;
         }
-   total_vertex_count = 0;
+        delete [] stats;
+        stats = new_stats;
+        max_stats = new_max_stats;
+    }
+    return &stats[i];
+}
+
+static void CountShadowVolumeCacheMiss(ShadowVolumeCache& cache, int so_id) {
+    cache.misses++;
+    GetCacheStats(light_cache_stats, max_light_cache_stats,
+        sre_internal_current_light_index)->misses++;
+    GetCacheStats(object_cache_stats, max_object_cache_stats, so_id)->misses++;
 }
 
-// Check whether the model object shadow volume is in the cache, if so draw it.
+// Check whether the shadow volume is in the cache, if so draw it.
 
-bool ShadowVolumeModelCacheHit(sreObject *so, sreLODModelShadowVolume *model,
-const Vector4D& lightpos_model, int type) {
-    ShadowVolumeModelCacheEntry *entry = model_cache.Lookup(model, lightpos_model, type);
+static bool ShadowVolumeCacheHit(ShadowVolumeCache& cache, int line, int so_id, sreObject *so,
+sreLODModelShadowVolume *model, const Vector4D& lightpos_model, int type) {
+    ShadowVolumeCacheEntry *entry = cache.Lookup(line, so_id, model, lightpos_model, type);
     if (entry == NULL) {
-        model_cache_misses++;
+        CountShadowVolumeCacheMiss(cache, so->id);
         return false;
     }
-    model_cache_hits++;
+    cache.hits++;
     if (entry->type & TYPE_DEPTH_FAIL)
-        model_cache_hits_depthfail++;
+        cache.hits_depthfail++;
+    GetCacheStats(light_cache_stats, max_light_cache_stats,
+        sre_internal_current_light_index)->hits++;
+    GetCacheStats(object_cache_stats, max_object_cache_stats, so->id)->hits++;
 
-    entry->timestamp = sre_internal_current_frame; // Update LRU stat.
+    // Update LRU stat.
+    cache.Touch(entry, (so->flags & SRE_OBJECT_PIN_SHADOW_VOLUME_CACHE) != 0);
 
     // We found a match, draw from the cache.
 
@@ -1315,222 +1263,216 @@ const Vector4D& lightpos_model, int type) {
     return true;
 }
 
-// Create a shadow volume GPU object after the silhouette has just been calculated, and
-// render it. The GPU object is preserved in the cache if appropriate.
-
-static void RenderCalculatedShadowVolume(sreObject *so, sreLight *light,
-const Vector4D& lightpos_model, sreLODModelShadowVolume *m, int type, int cache_used) {
-        // Generate a new buffer if required.
-        if (element_buffer_id[current_element_buffer] == 0xFFFFFFFF)
-            glGenBuffers(1, &element_buffer_id[current_element_buffer]);
-
-        // The number of edges in the silhouette limits the worst-case total amount of vertices
-        // in the shadow volume.
-        //
-        // With depth-pass rendering (sides only), the maximum number of vertices is equal
-        // to the number of silhouette edges * 6 for point and spot lights (two triangles
-        // required for each edge), while for directional and beam lights it is
-        // equal to the number of silhouette edges * 3 (one triangle required for each edge).
-        //
-        // With depth-fail rendering, front cap, sides and dark cap may need to be included.
-        // For point or spot lights, the maximum number of vertices in the shadow volume is
-        // the number of silhouette edges * 6 (sides) + the number of model triangles * 3
-        // (the light cap and dark cap combined total not more than the total number of
-        // triangles in the object).
-        //
-        // For directional lights and beam lights, the maximum number of vertices is also
-        // number of silhouette edges * 3 (sides) + the number of model triangles * 3
-        // (only a light cap is required, but it can potentially have as many triangles
-        // as the whole object if the triangle detail of the object is concentrated on
-        // the light-facing side).
-        int max_vertices;
-        if (type & TYPE_DEPTH_PASS) {
-            if (light->type & (SRE_LIGHT_SPOT | SRE_LIGHT_POINT_SOURCE))
-                max_vertices = silhouette_edges->nu_edges * 6;
-            else
-                max_vertices = silhouette_edges->nu_edges * 3;
-        }
-        else {
-            if (!(type & TYPE_SKIP_SIDES)) {
-                if (light->type & (SRE_LIGHT_SPOT | SRE_LIGHT_POINT_SOURCE))
-                    max_vertices = silhouette_edges->nu_edges * 6;
-                else
-                    max_vertices = silhouette_edges->nu_edges * 3;
-            }
-            // Add the vertices for the front and/or dark cap. If any of these
-            // is present, the maximum amount of combined vertices is never
-            // greater than the total number of triangles in the model * 3.
-            if ((type & (TYPE_SKIP_DARKCAP | TYPE_SKIP_LIGHTCAP)) !=
-            (TYPE_SKIP_DARKCAP | TYPE_SKIP_LIGHTCAP))
-                max_vertices += m->nu_triangles * 3;
-        }
-        // Dynamically enlarge the shadow volume vertex buffer when needed.
-        if (max_vertices > max_shadow_volume_vertices) {
-            delete [] (int *)shadow_volume_vertex;
-            // Add a little extra capacity to avoid constant reallocation in the unlikely
-            // theoretical case of a small number of triangles being added to the largest
-            // model continuously.
-            shadow_volume_vertex = new int[max_vertices + 1024];
-            max_shadow_volume_vertices = max_vertices + 1024;
-        }
+static inline int ObjectCacheLine(int so_id) {
+    return object_cache.Line(so_id + sre_internal_current_light_index * 77);
+}
+
+static inline int ModelCacheLine(sreLODModelShadowVolume *model) {
+    return model_cache.Line(model->id);
+}
+
+// Construct the shadow volume element indices after the silhouette has just been calculated.
+// No GL calls are made, so that this can be run in a worker thread.
 
-        int array_buffer_flags;
-        if (m->GL_indexsize == 2)
-            array_buffer_flags = SRE_SHADOW_VOLUME_ARRAY_BUFFER_FLAG_SHORT_INDEX;
+static void BuildShadowVolume(EdgeArray *ea, const sreLight& light, int type, int cache_used) {
+    sreLODModelShadowVolume *m = ea->m;
+    // The number of edges in the silhouette limits the worst-case total amount of vertices
+    // in the shadow volume.
+    //
+    // With depth-pass rendering (sides only), the maximum number of vertices is equal
+    // to the number of silhouette edges * 6 for point and spot lights (two triangles
+    // required for each edge), while for directional and beam lights it is
+    // equal to the number of silhouette edges * 3 (one triangle required for each edge).
+    //
+    // With depth-fail rendering, front cap, sides and dark cap may need to be included.
+    // For point or spot lights, the maximum number of vertices in the shadow volume is
+    // the number of silhouette edges * 6 (sides) + the number of model triangles * 3
+    // (the light cap and dark cap combined total not more than the total number of
+    // triangles in the object).
+    //
+    // For directional lights and beam lights, the maximum number of vertices is also
+    // number of silhouette edges * 3 (sides) + the number of model triangles * 3
+    // (only a light cap is required, but it can potentially have as many triangles
+    // as the whole object if the triangle detail of the object is concentrated on
+    // the light-facing side).
+    int max_vertices = 0;
+    if (!(type & TYPE_SKIP_SIDES) || (type & TYPE_DEPTH_PASS)) {
+        if (light.type & (SRE_LIGHT_SPOT | SRE_LIGHT_POINT_SOURCE))
+            max_vertices = ea->nu_edges * 6;
         else
-            array_buffer_flags = 0;
-        GL3InitializeShadowVolumeShader(*so, lightpos_model);
-        nu_shadow_volume_vertices = 0;
-        if (type & TYPE_DEPTH_PASS) {
-            // Depth-pass rendering.
-            glStencilOpSeparate(GL_FRONT, GL_KEEP, GL_KEEP, GL_INCR_WRAP);
-            glStencilOpSeparate(GL_BACK, GL_KEEP, GL_KEEP, GL_DECR_WRAP);
-            if ((sre_internal_rendering_flags & SRE_RENDERING_FLAG_USE_TRIANGLE_FANS_FOR_SHADOW_VOLUMES)
-            && cache_used != 0 && (light->type & (SRE_LIGHT_DIRECTIONAL | SRE_LIGHT_BEAM))
-            && !(m->flags & (SRE_LOD_MODEL_NOT_CLOSED | SRE_LOD_MODEL_CONTAINS_HOLES))) {
-                // For closed models without holes with a directional light or beam light, we
-                // can create a triangle fan representing the shadow volume.
-                // Because constructing a triangle fan is more processor/memory intensive than
-                // a regular shadow volume, only try when the shadow volume will be cached
-                // subsequently.
-                bool r = AddSidesTriangleFan(silhouette_edges, *light, array_buffer_flags);
-                if (r) {
-                    array_buffer_flags |= SRE_SHADOW_VOLUME_ARRAY_BUFFER_FLAG_TRIANGLE_FAN;
+            max_vertices = ea->nu_edges * 3;
+    }
+    // Add the vertices for the front and/or dark cap. If any of these
+    // is present, the maximum amount of combined vertices is never
+    // greater than the total number of triangles in the model * 3.
+    if ((type & TYPE_DEPTH_FAIL) && (type & (TYPE_SKIP_DARKCAP | TYPE_SKIP_LIGHTCAP)) !=
+    (TYPE_SKIP_DARKCAP | TYPE_SKIP_LIGHTCAP))
+        max_vertices += m->nu_triangles * 3;
+    // Dynamically enlarge the shadow volume vertex buffer when needed.
+    ea->CheckVertexCapacity(max_vertices);
+
+    int array_buffer_flags;
+    if (m->GL_indexsize == 2)
+        array_buffer_flags = SRE_SHADOW_VOLUME_ARRAY_BUFFER_FLAG_SHORT_INDEX;
+    else
+        array_buffer_flags = 0;
+    ea->nu_vertices = 0;
+    if ((type & TYPE_DEPTH_PASS) || (type & (TYPE_SKIP_SIDES | TYPE_SKIP_DARKCAP |
+    TYPE_SKIP_LIGHTCAP)) == (TYPE_SKIP_DARKCAP | TYPE_SKIP_LIGHTCAP)) {
+        // Depth-pass rendering, or depth-fail rendering with just the sides required.
+        if ((sre_internal_rendering_flags & SRE_RENDERING_FLAG_USE_TRIANGLE_FANS_FOR_SHADOW_VOLUMES)
+        && cache_used != 0 && (light.type & (SRE_LIGHT_DIRECTIONAL | SRE_LIGHT_BEAM))
+        && !(m->flags & (SRE_LOD_MODEL_NOT_CLOSED | SRE_LOD_MODEL_CONTAINS_HOLES))) {
+            // For closed models without holes with a directional light or beam light, we
+            // can create a triangle fan representing the shadow volume.
+            // Because constructing a triangle fan is more processor/memory intensive than
+            // a regular shadow volume, only try when the shadow volume will be cached
+            // subsequently.
+            bool r = AddSidesTriangleFan(ea, light, array_buffer_flags);
+            if (r) {
+                array_buffer_flags |= SRE_SHADOW_VOLUME_ARRAY_BUFFER_FLAG_TRIANGLE_FAN;
 #if 0
-                    printf("Triangle fan shadow volume constructed (%d vertices).\n", nu_shadow_volume_vertices);
+                printf("Triangle fan shadow volume constructed (%d vertices).\n", ea->nu_vertices);
 #endif
-                }
-                else {
-                    // Triangle fan construction not succesful; use a regular shadow volume
-                    // consisting of triangles.
+            }
+            else {
+                // Triangle fan construction not succesful; use a regular shadow volume
+                // consisting of triangles.
 #ifdef DEBUG_RENDER_LOG
-                    if (sre_internal_debug_message_level >= 1)
-                        printf("Triangle fan shadow volume construction failed for model %d.\n", m->id);
+                if (sre_internal_debug_message_level >= 1)
+                    printf("Triangle fan shadow volume construction failed for model %d.\n", m->id);
 #endif
-                    AddSides(silhouette_edges, *light, array_buffer_flags);
-                }
+                AddSides(ea, light, array_buffer_flags);
             }
-            else
+        }
+        else
 #ifndef NO_PRIMITIVE_RESTART
-            if ((sre_internal_rendering_flags & SRE_RENDERING_FLAG_USE_TRIANGLE_STRIPS_FOR_SHADOW_VOLUMES)
-            && (light->type & (SRE_LIGHT_POINT_SOURCE | SRE_LIGHT_SPOT))) {
-                // When we just need the sides for a point or spot light, we can use triangle strips with
-                // primitive restart for all of the shadow volume, resulting in a small saving of GPU space.
-                array_buffer_flags |= SRE_SHADOW_VOLUME_ARRAY_BUFFER_FLAG_TRIANGLE_STRIP;
-                AddSidesTriangleStrip(silhouette_edges, *light, array_buffer_flags);
-            }
-            else
-#endif
-                AddSides(silhouette_edges, *light, array_buffer_flags);
-            if (nu_shadow_volume_vertices > 0) {
-                DrawShadowVolumeGL(m, array_buffer_flags, cache_used);
-            }
+        if ((sre_internal_rendering_flags & SRE_RENDERING_FLAG_USE_TRIANGLE_STRIPS_FOR_SHADOW_VOLUMES)
+        && (light.type & (SRE_LIGHT_POINT_SOURCE | SRE_LIGHT_SPOT))) {
+            // When we just need the sides for a point or spot light, we can use triangle strips with
+            // primitive restart for all of the shadow volume, resulting in a small saving of GPU space.
+            array_buffer_flags |= SRE_SHADOW_VOLUME_ARRAY_BUFFER_FLAG_TRIANGLE_STRIP;
+            AddSidesTriangleStrip(ea, light, array_buffer_flags);
         }
-        else {
-            // Depth-fail rendering.
-            glStencilOpSeparate(GL_BACK, GL_KEEP, GL_INCR_WRAP, GL_KEEP);
-            glStencilOpSeparate(GL_FRONT, GL_KEEP, GL_DECR_WRAP, GL_KEEP);
-#ifdef OPENGL_ES2
-            glDepthRangef(0, 1.0f);
-#endif
-            if ((type & (TYPE_SKIP_SIDES | TYPE_SKIP_DARKCAP | TYPE_SKIP_LIGHTCAP)) ==
-            (TYPE_SKIP_DARKCAP | TYPE_SKIP_LIGHTCAP)) {
-                // Just sides required.
-                if ((sre_internal_rendering_flags &
-                SRE_RENDERING_FLAG_USE_TRIANGLE_FANS_FOR_SHADOW_VOLUMES)
-                && cache_used != 0 && (light->type & (SRE_LIGHT_DIRECTIONAL | SRE_LIGHT_BEAM))
-                && !(m->flags & (SRE_LOD_MODEL_NOT_CLOSED | SRE_LOD_MODEL_CONTAINS_HOLES))) {
-                    // For closed models with a directional light or beam light, we can create a
-                    // triangle fan representing the shadow volume (sides only).
-                    bool r = AddSidesTriangleFan(silhouette_edges, *light, array_buffer_flags);
-                    if (r)
-                        array_buffer_flags |= SRE_SHADOW_VOLUME_ARRAY_BUFFER_FLAG_TRIANGLE_FAN;
-                    else {
-                        // Triangle fan construction not succesful; use a regular shadow volume
-                        // consisting of triangles.
-#ifdef DEBUG_RENDER_LOG
-                        if (sre_internal_debug_message_level >= 1)
-                            printf("Triangle fan shadow volume construction failed for model %d.\n", m->id);
+        else
 #endif
-                        AddSides(silhouette_edges, *light, array_buffer_flags);
-                    }
-                }
-                else
-#ifndef NO_PRIMITIVE_RESTART
-                if ((sre_internal_rendering_flags &
-                SRE_RENDERING_FLAG_USE_TRIANGLE_STRIPS_FOR_SHADOW_VOLUMES)
-                && (light->type & (SRE_LIGHT_SPOT | SRE_LIGHT_POINT_SOURCE))) {
-                    // When we just need the sides for a point or spot light, we can use triangle strips with
-                    // primitive restart for all of the shadow volume.
-                    array_buffer_flags |= SRE_SHADOW_VOLUME_ARRAY_BUFFER_FLAG_TRIANGLE_STRIP;
-                    AddSidesTriangleStrip(silhouette_edges, *light, array_buffer_flags);
-                }
-                else
+            AddSides(ea, light, array_buffer_flags);
+    }
+    else {
+        // Depth-fail rendering; at least a lightcap or darkcap is needed.
+        if (!(type & TYPE_SKIP_SIDES))
+            AddSides(ea, light, array_buffer_flags);
+        if (!(type & TYPE_SKIP_DARKCAP))
+            AddDarkCap(ea, array_buffer_flags, type);
+        if (!(type & TYPE_SKIP_LIGHTCAP))
+            AddLightCap(ea, array_buffer_flags, type);
+    }
+    ea->array_buffer_flags = array_buffer_flags;
+}
+
+// Upload and render a shadow volume that has just been constructed. The GPU object is
+// preserved in the cache if appropriate.
+
+static void DrawConstructedShadowVolume(EdgeArray *ea, sreObject *so, sreLight *light,
+const Vector4D& lightpos_model, int type, int cache_used) {
+    // Generate a new buffer if required.
+    if (element_buffer_id[current_element_buffer] == 0xFFFFFFFF)
+        glGenBuffers(1, &element_buffer_id[current_element_buffer]);
+
+    GL3InitializeShadowVolumeShader(*so, lightpos_model);
+    if (type & TYPE_DEPTH_PASS) {
+        // Depth-pass rendering.
+        glStencilOpSeparate(GL_FRONT, GL_KEEP, GL_KEEP, GL_INCR_WRAP);
+        glStencilOpSeparate(GL_BACK, GL_KEEP, GL_KEEP, GL_DECR_WRAP);
+        DrawShadowVolumeGL(ea, cache_used);
+    }
+    else {
+        // Depth-fail rendering.
+        glStencilOpSeparate(GL_BACK, GL_KEEP, GL_INCR_WRAP, GL_KEEP);
+        glStencilOpSeparate(GL_FRONT, GL_KEEP, GL_DECR_WRAP, GL_KEEP);
+#ifdef OPENGL_ES2
+        glDepthRangef(0, 1.0f);
 #endif
-                    AddSides(silhouette_edges, *light, array_buffer_flags);
-                DrawShadowVolumeGL(m, array_buffer_flags, cache_used);
-            }
-            else {
-                 // At least a lightcap or darkcap is needed.
-                if (!(type & TYPE_SKIP_SIDES)) {
-                    AddSides(silhouette_edges, *light, array_buffer_flags);
- 		}
-                if (!(type & TYPE_SKIP_DARKCAP)) {
-                    AddDarkCap(silhouette_edges, array_buffer_flags, type);
-		}
-                if (!(type & TYPE_SKIP_LIGHTCAP)) {
-                    AddLightCap(silhouette_edges, array_buffer_flags, type);
-                    DrawShadowVolumeGL(m, array_buffer_flags, cache_used);
-		}
-            }
+        DrawShadowVolumeGL(ea, cache_used);
 #ifdef OPENGL_ES2
-            glDepthRangef(0, 0.99998f);
+        glDepthRangef(0, 0.99998f);
 #endif
-        }
+    }
 
-        // Add to the cache when applicable.
-        // Note: In the unlikely case that the number of shadow volumes vertices is zero,
-        // (which probably shouldn't happen), still add to the cache to minimize overhead.
-        if (cache_used == 1) {
-            if (object_cache.Add(so->id, m, lightpos_model,
-            element_buffer_id[current_element_buffer],
-            nu_shadow_volume_vertices, type, array_buffer_flags))
-                // If added to the object cache, mark the current buffer as invalid.
-                element_buffer_id[current_element_buffer] = 0xFFFFFFFF;
-        }
-        else if (cache_used == 2) {
-            if (model_cache.Add(m, lightpos_model, element_buffer_id[current_element_buffer],
-            nu_shadow_volume_vertices, type, array_buffer_flags))
-                // If added to the model cache, mark the current buffer as invalid.
-                element_buffer_id[current_element_buffer] = 0xFFFFFFFF;
-        }
+    // Add to the cache when applicable.
+    // Note: In the unlikely case that the number of shadow volumes vertices is zero,
+    // (which probably shouldn't happen), still add to the cache to minimize overhead.
+    bool pinned = (so->flags & SRE_OBJECT_PIN_SHADOW_VOLUME_CACHE) != 0;
+    if (cache_used == 1) {
+        if (object_cache.Add(ObjectCacheLine(so->id), so->id, ea->m, lightpos_model,
+        element_buffer_id[current_element_buffer],
+        ea->nu_vertices, type, ea->array_buffer_flags, pinned))
+            // If added to the object cache, mark the current buffer as invalid.
+            element_buffer_id[current_element_buffer] = 0xFFFFFFFF;
+    }
+    else if (cache_used == 2) {
+        if (model_cache.Add(ModelCacheLine(ea->m), - 1, ea->m, lightpos_model,
+        element_buffer_id[current_element_buffer],
+        ea->nu_vertices, type, ea->array_buffer_flags, pinned))
+            // If added to the model cache, mark the current buffer as invalid.
+            element_buffer_id[current_element_buffer] = 0xFFFFFFFF;
+    }
 }
 
+// When multi-threaded shadow volumes are enabled, the silhouettes of the shadow casters
+// of a light that miss the shadow volume cache are queued, and calculated (together with
+// the shadow volume element indices) in parallel using the thread pool, after which the
+// shadow volumes are uploaded and drawn in the rendering thread in queue order. Each queue
+// entry has its own silhouette buffer. The queue is flushed when it is full, which limits
+// the amount of memory used for the buffers.
+
+#define SRE_MAX_QUEUED_SHADOW_VOLUMES 64
+
 class sreShadowVolumeQueueEntry {
 public :
-	sreObject *so;
-	sreLight *light;
-	Vector4D lightpos_model;
-	sreLODModelShadowVolume *m;
-	int type;
-	int cache_used;
-	sreScissors scissors;
-
-	sreShadowVolumeQueueEntry(sreObject *_so, sreLight *_light, const Vector4D& _lightpos_model,
-	sreLODModelShadowVolume *_m, int _type, int _cache_used, const sreScissors* _scissors) {
-		so = _so;
-		light = _light;
-		lightpos_model = _lightpos_model;
-		m = _m;
-		type = _type;
-		cache_used = _cache_used;
-		scissors = *_scissors;
-	}
+    sreObject *so;
+    sreLight *light;
+    Vector4D lightpos_model;
+    int type;
+    int cache_used;
+    // Whether geometry scissors are used for the shadow volume, and the scissors to apply
+    // before drawing it.
+    bool geometry_scissors;
+    sreScissors scissors;
+    EdgeArray *ea;
 };
 
-// Queue for calculated shadow volumes for which rendering has been deferred.
+// Queue for shadow volumes for which silhouette calculation and rendering has been deferred.
 typedef dstDynamicArray <sreShadowVolumeQueueEntry, uint32_t> sreShadowVolumeQueue;
-sreShadowVolumeQueue shadow_volume_queue;
+static sreShadowVolumeQueue shadow_volume_queue;
+static bool shadow_volume_queue_enabled = false;
+static EdgeArray *queued_silhouette_edges[SRE_MAX_QUEUED_SHADOW_VOLUMES];
+
+static void QueueShadowVolume(sreObject *so, sreLight *light, const Vector4D& lightpos_model,
+sreLODModelShadowVolume *m, int type, int cache_used, const sreScissors *scissors) {
+    int i = shadow_volume_queue.Size();
+    if (queued_silhouette_edges[i] == NULL)
+        queued_silhouette_edges[i] = new EdgeArray;
+    sreShadowVolumeQueueEntry entry;
+    entry.so = so;
+    entry.light = light;
+    entry.lightpos_model = lightpos_model;
+    entry.type = type;
+    entry.cache_used = cache_used;
+    entry.geometry_scissors = (scissors != NULL);
+    if (scissors != NULL)
+        entry.scissors = *scissors;
+    entry.ea = queued_silhouette_edges[i];
+    entry.ea->m = m;
+    entry.ea->full_model = so->model;
+    shadow_volume_queue.Add(entry);
+}
+
+static void CalculateQueuedShadowVolumeJob(void *data, int job_index, int thread_index) {
+    sreShadowVolumeQueueEntry *entry = &((sreShadowVolumeQueueEntry *)data)[job_index];
+    CalculateSilhouetteEdges(entry->lightpos_model, entry->ea, entry->type);
+    BuildShadowVolume(entry->ea, *entry->light, entry->type, entry->cache_used);
+}
 
 // Draw an object's shadow volume for the given light. The object has already been
 // determined to be a shadow caster in terms of being in the light volume and in
@@ -1647,7 +1589,7 @@ static void DrawShadowVolume(sreObject *so, sreLight *light, sreFrustum &frustum
         // If the light is changing every frame in such a way that shadow volumes will be affected,
         // skip the cache.
         if (light->ShadowVolumeIsChangingEveryFrame(sre_internal_current_frame)) {
-            object_cache_misses++;
+            CountShadowVolumeCacheMiss(object_cache, so->id);
             goto skip_cache;
         }
 
@@ -1655,7 +1597,7 @@ static void DrawShadowVolume(sreObject *so, sreLight *light, sreFrustum &frustum
             // Any continuous change of position, rotation or scaling of the object
             // will affect the shadow volume for point/spot lights.
             if (so->IsChangingEveryFrame(sre_internal_current_frame)) {
-                object_cache_misses++;
+                CountShadowVolumeCacheMiss(object_cache, so->id);
                 goto skip_cache;
             }
             cache_used = 1;
@@ -1665,7 +1607,7 @@ static void DrawShadowVolume(sreObject *so, sreLight *light, sreFrustum &frustum
             // affect the shadow volume (just position change doesn't change the
             // shadow volume).
             if (so->IsChangingTransformationEveryFrame(sre_internal_current_frame)) {
-                model_cache_misses++;
+                CountShadowVolumeCacheMiss(model_cache, so->id);
                 goto skip_cache;
            }
            // Set the cache to the model cache, except when the SRE_OBJECT_USE_OBJECT_SHADOW_CACHE
@@ -1680,12 +1622,14 @@ static void DrawShadowVolume(sreObject *so, sreLight *light, sreFrustum &frustum
             // Use the object shadow volume cache (primarily for point source and spot
             // lights, but may be used for other lights if SRE_OBJECT_USE_OBJECT_SHADOW_CACHE
             // flag was set).
-            if (ShadowVolumeObjectCacheHit(so, m, lightpos_model, type))
+            if (ShadowVolumeCacheHit(object_cache, ObjectCacheLine(so->id), so->id, so, m,
+            lightpos_model, type))
                 return;
         }
         else {
             // Directional light or beam light, use the model cache.
-            if (ShadowVolumeModelCacheHit(so, m, lightpos_model, type))
+            if (ShadowVolumeCacheHit(model_cache, ModelCacheLine(m), - 1, so, m,
+            lightpos_model, type))
                 return;
         }
 
@@ -1694,23 +1638,18 @@ skip_cache :
         // it to the GPU.
         sre_internal_silhouette_count++;
 
+        if (shadow_volume_queue_enabled) {
+            // Defer the silhouette calculation to the thread pool.
+            QueueShadowVolume(so, light, lightpos_model, m, type, cache_used, scissors);
+            return;
+        }
+
         // Calculate silhouette edges.
         silhouette_edges->m = m;
         silhouette_edges->full_model = so->model;
-
-#ifndef THREADED_SILHOUETTE_CALCULATION
-
         CalculateSilhouetteEdges(lightpos_model, silhouette_edges, type);
-	RenderCalculatedShadowVolume(so, light, lightpos_model, m, type, cache_used);
-
-#else
-
-//	silhouette_task_group.Add
-
-	sreShadowVolumeQueueEntry entry(so, lightpos_model, m, type, cache_used, scissors);
-	shadow_volume_queue.Add(entry);
-
-#endif
+        BuildShadowVolume(silhouette_edges, *light, type, cache_used);
+        DrawConstructedShadowVolume(silhouette_edges, so, light, lightpos_model, type, cache_used);
 }
 
 static void SetGLScissors(const sreScissors& scissors) {
@@ -1732,48 +1671,26 @@ static void SetGLScissors(const sreScissors& scissors) {
     glScissor(left, bottom, right - left, top - bottom);
 }
 
-#ifdef THREADED_SILHOUETTE_CALCULATION
+static int octree_count, octree_count2, octree_count3;
+static bool custom_scissors_set;
+static bool custom_depth_bounds_set;
 
-static void RenderQueuedShadowVolumesGeometryScissors() {
-	int n = shadow_volume_queue.Size();
-	sreShadowVolumeQueueEntry *data = shadow_volume_queue.DataPointer();
-	for (int i = 0; i < n; i++) {
-            // Update scissors and depth bounds.
-            SetGLScissors(data[i].scissors);
+// Apply the geometry scissors for a shadow volume, only updating the GL state when required.
+
+static void ApplyShadowVolumeScissors(const sreScissors& scissors, bool viewport_adjusted,
+bool depth_bounds_adjusted) {
+    if (viewport_adjusted || custom_scissors_set) {
+        SetGLScissors(scissors);
+        custom_scissors_set = viewport_adjusted;
+    }
 #ifndef NO_DEPTH_BOUNDS
-            if (GLEW_EXT_depth_bounds_test)
-                glDepthBoundsEXT(scissors->near, scissors->far);
+    if (GLEW_EXT_depth_bounds_test && (depth_bounds_adjusted || custom_depth_bounds_set)) {
+        glDepthBoundsEXT(scissors.near, scissors.far);
+        custom_depth_bounds_set = depth_bounds_adjusted;
+    }
 #endif
-            RenderCalculatedShadowVolume(
-		data[i].so,
-		data[i].light,
-		data[i].lightpos_model,
-		data[i].m,
-		data[i].type,
-		data[i].cache_used);
-	}
 }
 
-static void RenderQueuedShadowVolumes() {
-	int n = shadow_volume_queue.Size();
-	sreShadowVolumeQueueEntry *data = shadow_volume_queue.DataPointer();
-	for (int i = 0; i < n; i++) {
-            RenderCalculatedShadowVolume(
-		data[i].so,
-		data[i].light,
-		data[i].lightpos_model,
-		data[i].m,
-		data[i].type,
-		data[i].cache_used);
-	}
-}
-
-#endif
-
-static int octree_count, octree_count2, octree_count3;
-static bool custom_scissors_set;
-static bool custom_depth_bounds_set;
-
 // Render a shadow volume for a shadow-casting object with per-object geometry
 // scissors enabled. A specific scissors region for the object's shadow volume is
 // calculated and applied if it is smaller than the pre-existing light scissors region.
@@ -1834,16 +1751,7 @@ static void RenderShadowVolumeGeometryScissors(sreObject *so, sreLight *light, s
             }
 
             // Update scissors and depth bounds when required.
-            if (viewport_adjusted || custom_scissors_set) {
-                SetGLScissors(*scissors);
-                custom_scissors_set = viewport_adjusted;
-            }
-#ifndef NO_DEPTH_BOUNDS
-            if (GLEW_EXT_depth_bounds_test && (depth_bounds_adjusted || custom_depth_bounds_set)) {
-                glDepthBoundsEXT(scissors->near, scissors->far);
-                custom_depth_bounds_set = depth_bounds_adjusted;
-            }
-#endif
+            ApplyShadowVolumeScissors(*scissors, viewport_adjusted, depth_bounds_adjusted);
             DrawShadowVolume(so, light, frustum, sv, scissors);
 }
 
@@ -1851,6 +1759,30 @@ static void RenderShadowVolume(sreObject *so, sreLight *light, sreFrustum& frust
     DrawShadowVolume(so, light, frustum, NULL, NULL);
 }
 
+// Calculate the silhouettes of the queued shadow volumes in parallel, and draw the shadow
+// volumes in queue order.
+
+static void FlushShadowVolumeQueue(sreFrustum& frustum) {
+    int n = shadow_volume_queue.Size();
+    if (n == 0)
+        return;
+    sreShadowVolumeQueueEntry *entry = shadow_volume_queue.DataPointer();
+    sreRunThreadPoolJobs(CalculateQueuedShadowVolumeJob, entry, n);
+    for (int i = 0; i < n; i++) {
+        if (entry[i].geometry_scissors) {
+            bool viewport_adjusted = !entry[i].scissors.ScissorsRegionIsEqual(frustum.scissors);
+            bool depth_bounds_adjusted = false;
+#ifndef NO_DEPTH_BOUNDS
+            depth_bounds_adjusted = !entry[i].scissors.DepthBoundsAreEqual(frustum.scissors);
+#endif
+            ApplyShadowVolumeScissors(entry[i].scissors, viewport_adjusted, depth_bounds_adjusted);
+        }
+        DrawConstructedShadowVolume(entry[i].ea, entry[i].so, entry[i].light,
+            entry[i].lightpos_model, entry[i].type, entry[i].cache_used);
+    }
+    shadow_volume_queue.Truncate(0);
+}
+
 // Flags indicating whether an octree is completely inside the light volume
 // or shadow caster volume.
 enum {
@@ -2026,6 +1958,75 @@ sreScene *scene, sreLight *light, sreFrustum &frustum, int intersection_flags) {
     }
 }
 
+// Determine shadow casters from the dynamic object BVH. Like the octree version, nodes
+// are checked against the shadow caster volume and the light volume until they are
+// completely inside both.
+
+static void DetermineShadowCastersFromObjectBVH(const sreObjectBVH& bvh, int node_index,
+sreScene *scene, sreLight *light, sreFrustum &frustum, int intersection_flags) {
+    octree_count++;
+    const sreObjectBVHNode& node = bvh.node[node_index];
+    if (!(intersection_flags & OCTREE_IS_INSIDE_SHADOW_CASTER_VOLUME)) {
+        BoundsCheckResult r = QueryIntersection(node.bounds, frustum.shadow_caster_volume);
+        if (r == SRE_COMPLETELY_OUTSIDE) {
+            octree_count2++;
+            return;
+        }
+        if (r == SRE_COMPLETELY_INSIDE)
+            intersection_flags |= OCTREE_IS_INSIDE_SHADOW_CASTER_VOLUME;
+    }
+    if (!(intersection_flags & OCTREE_IS_INSIDE_LIGHT_VOLUME)) {
+        BoundsCheckResult r = QueryIntersection(node.bounds, *light);
+        if (r == SRE_COMPLETELY_OUTSIDE) {
+            octree_count2++;
+            return;
+        }
+        if (r == SRE_COMPLETELY_INSIDE)
+            intersection_flags |= OCTREE_IS_INSIDE_LIGHT_VOLUME;
+    }
+    if (node.child[0] >= 0) {
+        DetermineShadowCastersFromObjectBVH(bvh, node.child[0], scene, light, frustum,
+            intersection_flags);
+        DetermineShadowCastersFromObjectBVH(bvh, node.child[1], scene, light, frustum,
+            intersection_flags);
+        return;
+    }
+    sreObject *so = scene->object[node.object_index];
+    if (!so->exists)
+        return;
+    // Exclude objects that do not cast shadows.
+    if (!(so->flags & SRE_OBJECT_CAST_SHADOWS) ||
+    !(so->model->model_flags & SRE_MODEL_SHADOW_VOLUMES_CONFIGURED))
+        return;
+    // If the object is attached to the current light, don't cast shadows for this object.
+    if (so->attached_light == sre_internal_current_light_index)
+        return;
+    octree_count3++;
+    if (!(intersection_flags & OCTREE_IS_INSIDE_LIGHT_VOLUME))
+        if (!Intersects(*so, *light))
+            return;
+    if (!(intersection_flags & OCTREE_IS_INSIDE_SHADOW_CASTER_VOLUME))
+        if (!Intersects(*so, frustum.shadow_caster_volume))
+            return;
+    scene->shadow_caster_array.Add(node.object_index);
+}
+
+// Add the shadow casters from the dynamic entities (the dynamic object octree, and the
+// dynamic object BVH when present).
+
+static void DetermineDynamicShadowCasters(sreScene *scene, sreLight *light, sreFrustum &frustum) {
+    DetermineShadowCastersFromFastOctreeRootNode(scene->fast_octree_dynamic,
+        scene, light, frustum, 0);
+    if (scene->dynamic_object_bvh != NULL && scene->dynamic_object_bvh->nu_nodes > 0) {
+        // For directional lights, everything is inside the light volume.
+        int flags = 0;
+        if (light->type & SRE_LIGHT_DIRECTIONAL)
+            flags = OCTREE_IS_INSIDE_LIGHT_VOLUME;
+        DetermineShadowCastersFromObjectBVH(*scene->dynamic_object_bvh, 0, scene, light,
+            frustum, flags);
+    }
+}
+
 // Determine shadow casters for a whole octree, usually the static object octree.
 // We perform a light volume intersection test and shadow caster volume intersection test
 // for every potential shadow casting object. Any shadow casters found are stored; the
@@ -2153,27 +2154,30 @@ sreLight *light, sreFrustum &frustum) {
         use_geometry_scissors = true;
     else
         use_geometry_scissors = false;
-#ifdef THREADED_SILHOUETTE_CALCULATION
+    // Cache hits are still drawn immediately when the queue is used; since the stencil
+    // updates of different shadow volumes are commutative, the drawing order does not matter.
+    shadow_volume_queue_enabled =
+        (sre_internal_rendering_flags & SRE_RENDERING_FLAG_MULTI_THREADED_SHADOW_VOLUMES) &&
+        scene->shadow_caster_array.Size() >= 2 && sreGetThreadPoolSize() > 1;
     shadow_volume_queue.Truncate(0);
-#endif
     if (use_geometry_scissors) {
        for (int i = 0; i < scene->shadow_caster_array.Size(); i++) {
             sreObject *so = scene->object[scene->shadow_caster_array.Get(i)];
             RenderShadowVolumeGeometryScissors(so, light, frustum);
+            if (shadow_volume_queue.Size() == SRE_MAX_QUEUED_SHADOW_VOLUMES)
+                FlushShadowVolumeQueue(frustum);
        }
-#ifdef THREADED_SILHOUETTE_CALCULATION
-       RenderQueuedShadowVolumesGeometryScissors();
-#endif
     }
     else {
        for (int i = 0; i < scene->shadow_caster_array.Size(); i++) {
             sreObject *so = scene->object[scene->shadow_caster_array.Get(i)];
             RenderShadowVolume(so, light, frustum);
+            if (shadow_volume_queue.Size() == SRE_MAX_QUEUED_SHADOW_VOLUMES)
+                FlushShadowVolumeQueue(frustum);
        }
-#ifdef THREADED_SILHOUETTE_CALCULATION
-       RenderQueuedShadowVolumes();
-#endif
     }
+    FlushShadowVolumeQueue(frustum);
+    shadow_volume_queue_enabled = false;
 }
 
 // Render all shadow volumes for a light.
@@ -2196,9 +2200,8 @@ void sreRenderShadowVolumes(sreScene *scene, sreLight *light, sreFrustum &frustu
         // list might include objects outside the light volume so we have to check that too.
         DetermineShadowCastersFromLightStaticCasterArray(scene->fast_octree_dynamic,
             scene, light, frustum);
-        // Add the dynamic object shadow casters from the dynamic objects octree.
-        DetermineShadowCastersFromFastOctreeRootNode(scene->fast_octree_dynamic,
-            scene, light, frustum, 0);
+        // Add the dynamic object shadow casters.
+        DetermineDynamicShadowCasters(scene, light, frustum);
     }
     else {
         // When there is no static objects list for the light, we have to walk both
@@ -2206,9 +2209,8 @@ void sreRenderShadowVolumes(sreScene *scene, sreLight *light, sreFrustum &frustu
         // Add the static object shadow casters from the static objects octree.
         DetermineShadowCastersFromFastOctree(scene->fast_octree_static, 0,
             scene, light, frustum, 0);
-        // Add the dynamic object shadow casters from the dynamic objects octree.
-        DetermineShadowCastersFromFastOctreeRootNode(scene->fast_octree_dynamic,
-            scene, light, frustum, 0);
+        // Add the dynamic object shadow casters.
+        DetermineDynamicShadowCasters(scene, light, frustum);
     }
 
     // Predetermining shadow casting objects has the advantage that we can exit
@@ -2231,10 +2233,7 @@ void sreRenderShadowVolumes(sreScene *scene, sreLight *light, sreFrustum &frustu
     // Create global silhouette edges data structure.
     if (silhouette_edges == NULL) {
         silhouette_edges = new EdgeArray;
-    }
-    if (shadow_volume_vertex == NULL) {
-        shadow_volume_vertex = new int[SRE_DEFAULT_MAX_SHADOW_VOLUME_VERTICES];
-        max_shadow_volume_vertices = SRE_DEFAULT_MAX_SHADOW_VOLUME_VERTICES;
+        SelectClassifyFacesFunction();
     }
     octree_count = octree_count2 = octree_count3 = 0;
 
@@ -2358,7 +2357,6 @@ void sreRenderShadowVolumes(sreScene *scene, sreLight *light, sreFrustum &frustu
 //        octree_count2, octree_count);
 //    printf("Light %d: %d scene objects iterated.\n", sre_internal_current_light_index, octree_count3);
 //    printf("%d shadow volumes drawn, %d silhouettes calculated.\n", sre_internal_shadow_volume_count, sre_internal_silhouette_count);
-//    delete [] shadow_volume_vertex;
 //    delete silhouette_edges;
     glDisableVertexAttribArray(0);
 #if 0
@@ -2380,48 +2378,71 @@ void sreResetShadowCacheStats() {
     // Reset stats before frame.
     sre_internal_shadow_volume_count = 0;
     sre_internal_silhouette_count = 0;
-    model_cache_hits = 0;
-    model_cache_misses = 0;
-    model_cache_hits_depthfail = 0;
-    object_cache_hits = 0;
-    object_cache_misses = 0;
-    object_cache_hits_depthfail = 0;
+    model_cache.hits = 0;
+    model_cache.misses = 0;
+    model_cache.hits_depthfail = 0;
+    object_cache.hits = 0;
+    object_cache.misses = 0;
+    object_cache.hits_depthfail = 0;
+    for (int i = 0; i < max_light_cache_stats; i++) {
+        light_cache_stats[i].hits = 0;
+        light_cache_stats[i].misses = 0;
+    }
+    for (int i = 0; i < max_object_cache_stats; i++) {
+        object_cache_stats[i].hits = 0;
+        object_cache_stats[i].misses = 0;
+    }
+}
+
+static int CountDepthFailEntries(const ShadowVolumeCache& cache) {
+    int count = 0;
+    for (int i = 0; i < cache.nu_lines * SRE_SHADOW_VOLUME_CACHE_WAYS; i++)
+        if (cache.entry[i].model != NULL && (cache.entry[i].type & TYPE_DEPTH_FAIL))
+            count++;
+    return count;
 }
 
 void sreSetShadowCacheStatsInfo(sreShadowRenderingInfo *info) {
-    int object_count = 0;
-    int object_depth_fail = 0;
-    for (int i = 0; i < SRE_SHADOW_VOLUME_OBJECT_CACHE_SIZE * 4; i++) {
-        if (object_cache.entry[i].so_id != -1)
-            object_count++;
-        if (object_cache.entry[i].type & TYPE_DEPTH_FAIL)
-            object_depth_fail++;
-    }
-    int model_count = 0;
-    int model_depth_fail = 0;
-    for (int i = 0; i < SRE_SHADOW_VOLUME_MODEL_CACHE_SIZE * 4; i++) {
-        if (model_cache.entry[i].model != NULL)
-            model_count++;
-        if (model_cache.entry[i].type & TYPE_DEPTH_FAIL)
-            model_depth_fail++;
-    }
-    info->object_cache_total_entries = SRE_SHADOW_VOLUME_OBJECT_CACHE_SIZE * 4;
-    info->object_cache_entries_used = object_count;
+    info->object_cache_total_entries = object_cache.nu_lines * SRE_SHADOW_VOLUME_CACHE_WAYS;
+    info->object_cache_entries_used = object_cache.nu_entries_used;
     info->object_cache_total_vertex_count = object_cache.total_vertex_count;
-    info->object_cache_hits = object_cache_hits;
-    info->object_cache_misses = object_cache_misses;
-    info->object_cache_entries_depthfail = object_depth_fail;
-    info->object_cache_hits_depthfail = object_cache_hits_depthfail;
-    info->model_cache_total_entries = SRE_SHADOW_VOLUME_MODEL_CACHE_SIZE * 4;
-    info->model_cache_entries_used = model_count;
+    info->object_cache_hits = object_cache.hits;
+    info->object_cache_misses = object_cache.misses;
+    info->object_cache_entries_depthfail = CountDepthFailEntries(object_cache);
+    info->object_cache_hits_depthfail = object_cache.hits_depthfail;
+    info->model_cache_total_entries = model_cache.nu_lines * SRE_SHADOW_VOLUME_CACHE_WAYS;
+    info->model_cache_entries_used = model_cache.nu_entries_used;
     info->model_cache_total_vertex_count = model_cache.total_vertex_count;
-    info->model_cache_hits = model_cache_hits;
-    info->model_cache_misses = model_cache_misses;
-    info->model_cache_entries_depthfail = model_depth_fail;
-    info->model_cache_hits_depthfail = model_cache_hits_depthfail;
+    info->model_cache_hits = model_cache.hits;
+    info->model_cache_misses = model_cache.misses;
+    info->model_cache_entries_depthfail = CountDepthFailEntries(model_cache);
+    info->model_cache_hits_depthfail = model_cache.hits_depthfail;
+    info->cache_total_size = object_cache.total_size + model_cache.total_size;
+    info->cache_budget = sre_internal_shadow_volume_cache_budget;
+    info->cache_entries_pinned = object_cache.nu_entries_pinned + model_cache.nu_entries_pinned;
+    delete [] info->light_stats;
+    delete [] info->object_stats;
+    info->nu_light_stats = max_light_cache_stats;
+    info->light_stats = new sreShadowCacheStats[max_light_cache_stats];
+    for (int i = 0; i < max_light_cache_stats; i++)
+        info->light_stats[i] = light_cache_stats[i];
+    info->nu_object_stats = max_object_cache_stats;
+    info->object_stats = new sreShadowCacheStats[max_object_cache_stats];
+    for (int i = 0; i < max_object_cache_stats; i++)
+        info->object_stats[i] = object_cache_stats[i];
 }
 
 void sreClearShadowCache() {
     object_cache.Clear();
     model_cache.Clear();
 }
+
+// Change the number of entries of the object and model caches. The caches are cleared.
+
+void sreResizeShadowCache(int object_cache_entries, int model_cache_entries) {
+    sreClearShadowCache();
+    object_cache.SetSize((object_cache_entries + SRE_SHADOW_VOLUME_CACHE_WAYS - 1) /
+        SRE_SHADOW_VOLUME_CACHE_WAYS);
+    model_cache.SetSize((model_cache_entries + SRE_SHADOW_VOLUME_CACHE_WAYS - 1) /
+        SRE_SHADOW_VOLUME_CACHE_WAYS);
+}
@@ -0,0 +1,201 @@
+/*
+
+Copyright (c) 2014 Harm Hanemaaijer <fgenfb@yahoo.com>
+
+Permission to use, copy, modify, and/or distribute this software for any
+purpose with or without fee is hereby granted, provided that the above
+copyright notice and this permission notice appear in all copies.
+
+THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+
+*/
+
+// Shadow map atlas.
+//
+// When enabled, spot and beam light shadow maps are rendered into square tiles of a
+// single large depth texture instead of into the shared per-size-level shadow map
+// textures, which are then not created. The tile size is chosen per light from its
+// projected size, with a finer range of sizes than the shadow map size levels, so that
+// small lights use little memory and all of them share one texture and framebuffer.
+//
+// At the start of the lighting passes of a frame, the atlas is bound and cleared once and
+// the shadow maps of all active spot and beam lights are packed into it (see
+// sreRenderShadowMapAtlas() in shadowmap.cpp). Tiles are allocated from a quadtree over
+// the atlas, each node being either free, split into four children or in use. When the
+// atlas is full, later lights render their shadow map just before their lighting pass,
+// at which point the tiles of the lights that have already been drawn can be reused.
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+#ifdef OPENGL_ES2
+#include <GLES2/gl2.h>
+#endif
+#ifdef OPENGL
+#include <GL/glew.h>
+#include <GL/gl.h>
+#endif
+
+#include "sre.h"
+#include "sre_internal.h"
+
+#if !defined(NO_SHADOW_MAP) && !defined(OPENGL_ES2)
+
+enum { ATLAS_NODE_FREE = 0, ATLAS_NODE_SPLIT, ATLAS_NODE_USED };
+
+// Number of nodes of a complete quadtree with depth SRE_SHADOW_MAP_ATLAS_MAX_DEPTH.
+#define NU_ATLAS_NODES (((1 << (2 * (SRE_SHADOW_MAP_ATLAS_MAX_DEPTH + 1))) - 1) / 3)
+
+static char node_state[NU_ATLAS_NODES];
+static int atlas_size = 0;
+// The number of pixels in allocated tiles.
+static int used_area = 0;
+static GLuint atlas_framebuffer = 0;
+
+static void CreateAtlas(int size) {
+    glGenTextures(1, &sre_internal_shadow_map_atlas_texture);
+    glBindTexture(GL_TEXTURE_2D, sre_internal_shadow_map_atlas_texture);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+#ifdef USE_SHADOW_SAMPLER
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_COMPARE_MODE, GL_COMPARE_REF_TO_TEXTURE);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_COMPARE_FUNC, GL_LEQUAL);
+#endif
+    // Use the same 32-bit float precision as the largest shared shadow map, since the
+    // largest tiles take the place of that shadow map.
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_DEPTH_COMPONENT32, size, size, 0,
+        GL_DEPTH_COMPONENT, GL_FLOAT, 0);
+    CHECK_GL_ERROR("Error after shadow map atlas texture initialization.\n");
+    glGenFramebuffers(1, &atlas_framebuffer);
+    glBindFramebuffer(GL_DRAW_FRAMEBUFFER, atlas_framebuffer);
+    glFramebufferTexture2D(GL_DRAW_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_TEXTURE_2D,
+        sre_internal_shadow_map_atlas_texture, 0);
+    glReadBuffer(GL_NONE);
+    if (glCheckFramebufferStatus(GL_DRAW_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
+        sreFatalError("Error -- shadow map atlas framebuffer not complete.");
+    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+    atlas_size = size;
+    sreResetShadowMapAtlas();
+}
+
+static bool AllocateNode(int node, int depth, int target_depth, int x, int y, int node_size,
+sreShadowMapAtlasTile& tile) {
+    if (node_state[node] == ATLAS_NODE_USED)
+        return false;
+    if (depth == target_depth) {
+        if (node_state[node] != ATLAS_NODE_FREE)
+            return false;
+        node_state[node] = ATLAS_NODE_USED;
+        used_area += node_size * node_size;
+        tile.x = x;
+        tile.y = y;
+        tile.size = node_size;
+        return true;
+    }
+    // The children of a free node are always free.
+    node_state[node] = ATLAS_NODE_SPLIT;
+    int child_size = node_size / 2;
+    for (int i = 0; i < 4; i++)
+        if (AllocateNode(node * 4 + 1 + i, depth + 1, target_depth, x + (i & 1) * child_size,
+        y + (i >> 1) * child_size, child_size, tile))
+            return true;
+    return false;
+}
+
+static void CheckAtlas() {
+    if (sre_internal_shadow_map_atlas_texture == 0 ||
+    atlas_size != sre_internal_shadow_map_atlas_size) {
+        sreDestroyShadowMapAtlas();
+        CreateAtlas(sre_internal_shadow_map_atlas_size);
+    }
+}
+
+// Allocate a tile of the given size (a power of two) in the shadow map atlas, creating
+// the atlas when required. Returns false when there is no free tile of that size.
+
+bool sreAllocateShadowMapAtlasTile(int size, sreShadowMapAtlasTile& tile) {
+    CheckAtlas();
+    int depth = 0;
+    while ((atlas_size >> depth) > size && depth < SRE_SHADOW_MAP_ATLAS_MAX_DEPTH)
+        depth++;
+    return AllocateNode(0, 0, depth, 0, 0, atlas_size, tile);
+}
+
+// Release all tiles.
+
+void sreResetShadowMapAtlas() {
+    memset(node_state, ATLAS_NODE_FREE, sizeof(node_state));
+    used_area = 0;
+}
+
+// Return whether no tile at all can be allocated. As long as part of the atlas is free,
+// a tile of the smallest size is available.
+
+bool sreShadowMapAtlasIsFull() {
+    return atlas_size > 0 && used_area == atlas_size * atlas_size;
+}
+
+// Release all tiles, and bind and clear the whole atlas, so that the shadow maps of
+// several lights can be rendered into it by only setting the viewport to each tile.
+
+void sreBeginShadowMapAtlas() {
+    CheckAtlas();
+    sreResetShadowMapAtlas();
+    glBindFramebuffer(GL_DRAW_FRAMEBUFFER, atlas_framebuffer);
+    glViewport(0, 0, atlas_size, atlas_size);
+    glClear(GL_DEPTH_BUFFER_BIT);
+}
+
+// Bind the atlas framebuffer and set the viewport to a tile, and clear the tile.
+
+void sreBindShadowMapAtlasTile(const sreShadowMapAtlasTile& tile) {
+    glBindFramebuffer(GL_DRAW_FRAMEBUFFER, atlas_framebuffer);
+    glViewport(tile.x, tile.y, tile.size, tile.size);
+    glEnable(GL_SCISSOR_TEST);
+    glScissor(tile.x, tile.y, tile.size, tile.size);
+    glClear(GL_DEPTH_BUFFER_BIT);
+    glDisable(GL_SCISSOR_TEST);
+}
+
+void sreDestroyShadowMapAtlas() {
+    if (sre_internal_shadow_map_atlas_texture == 0)
+        return;
+    glDeleteFramebuffers(1, &atlas_framebuffer);
+    glDeleteTextures(1, &sre_internal_shadow_map_atlas_texture);
+    atlas_framebuffer = 0;
+    sre_internal_shadow_map_atlas_texture = 0;
+    atlas_size = 0;
+}
+
+#else
+
+bool sreAllocateShadowMapAtlasTile(int size, sreShadowMapAtlasTile& tile) {
+    return false;
+}
+
+void sreResetShadowMapAtlas() {
+}
+
+bool sreShadowMapAtlasIsFull() {
+    return true;
+}
+
+void sreBeginShadowMapAtlas() {
+}
+
+void sreBindShadowMapAtlasTile(const sreShadowMapAtlasTile& tile) {
+}
+
+void sreDestroyShadowMapAtlas() {
+}
+
+#endif
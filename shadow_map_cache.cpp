@@ -0,0 +1,218 @@
+/*
+
+Copyright (c) 2014 Harm Hanemaaijer <fgenfb@yahoo.com>
+
+Permission to use, copy, modify, and/or distribute this software for any
+purpose with or without fee is hereby granted, provided that the above
+copyright notice and this permission notice appear in all copies.
+
+THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+
+*/
+
+// Persistent shadow maps.
+//
+// When enabled, the shadow maps of spot, beam and point source lights are rendered into
+// a small set of slots that are each assigned to a light, instead of into the shared
+// shadow map textures that are overwritten by every light. The shadow map code in
+// shadowmap.cpp records the state of the light and its shadow casters in the slot, so
+// that the shadow map can be reused in later frames while nothing changes. The least
+// recently used slot is reassigned when all slots are in use.
+//
+// Optionally each slot has a second depth texture, the static layer, that holds only the
+// static shadow casters. When only dynamic objects changed, the static layer is copied
+// into the shadow map and just the dynamic shadow casters are drawn on top of it.
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+#ifdef OPENGL_ES2
+#include <GLES2/gl2.h>
+#endif
+#ifdef OPENGL
+#include <GL/glew.h>
+#include <GL/gl.h>
+#endif
+
+#include "sre.h"
+#include "sre_internal.h"
+
+#if !defined(NO_SHADOW_MAP) && !defined(OPENGL_ES2)
+
+static sreShadowMapCacheSlot slot[SRE_SHADOW_MAP_CACHE_SLOTS];
+
+static const GLenum cube_map_target[6] = {
+    GL_TEXTURE_CUBE_MAP_POSITIVE_X,
+    GL_TEXTURE_CUBE_MAP_NEGATIVE_X,
+    GL_TEXTURE_CUBE_MAP_POSITIVE_Y,
+    GL_TEXTURE_CUBE_MAP_NEGATIVE_Y,
+    GL_TEXTURE_CUBE_MAP_POSITIVE_Z,
+    GL_TEXTURE_CUBE_MAP_NEGATIVE_Z
+};
+
+// Create a depth texture with the same format as the shared shadow map (or cube shadow
+// map) texture of the given size level, and attach it to one framebuffer (six for a
+// cube map).
+
+static void CreateSlotTexture(int type, int level, GLuint& texture, GLuint *framebuffer) {
+    glGenTextures(1, &texture);
+    GLenum target;
+    int size;
+    if (type == SRE_SHADOW_MAP_CACHE_SLOT_CUBE) {
+        target = GL_TEXTURE_CUBE_MAP;
+        size = sre_internal_max_cube_shadow_map_size >> level;
+    }
+    else {
+        target = GL_TEXTURE_2D;
+        size = sre_internal_max_shadow_map_size >> level;
+    }
+    glBindTexture(target, texture);
+    glTexParameteri(target, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    glTexParameteri(target, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+    glTexParameteri(target, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTexParameteri(target, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    if (type == SRE_SHADOW_MAP_CACHE_SLOT_CUBE)
+        glTexParameteri(target, GL_TEXTURE_WRAP_R, GL_CLAMP_TO_EDGE);
+#ifdef USE_SHADOW_SAMPLER
+    glTexParameteri(target, GL_TEXTURE_COMPARE_MODE, GL_COMPARE_REF_TO_TEXTURE);
+    glTexParameteri(target, GL_TEXTURE_COMPARE_FUNC, GL_LEQUAL);
+#endif
+    if (type == SRE_SHADOW_MAP_CACHE_SLOT_CUBE) {
+        for (int i = 0; i < 6; i++)
+            glTexImage2D(cube_map_target[i], 0, GL_DEPTH_COMPONENT, size, size, 0,
+                GL_DEPTH_COMPONENT, GL_UNSIGNED_SHORT, 0);
+    }
+    else if (level == 0)
+        glTexImage2D(GL_TEXTURE_2D, 0, GL_DEPTH_COMPONENT32, size, size, 0,
+            GL_DEPTH_COMPONENT, GL_FLOAT, 0);
+    else
+        glTexImage2D(GL_TEXTURE_2D, 0, GL_DEPTH_COMPONENT16, size, size, 0,
+            GL_DEPTH_COMPONENT, GL_UNSIGNED_SHORT, 0);
+    CHECK_GL_ERROR("Error after shadow map cache texture initialization.\n");
+    int nu_framebuffers = (type == SRE_SHADOW_MAP_CACHE_SLOT_CUBE) ? 6 : 1;
+    for (int i = 0; i < nu_framebuffers; i++) {
+        glGenFramebuffers(1, &framebuffer[i]);
+        glBindFramebuffer(GL_DRAW_FRAMEBUFFER, framebuffer[i]);
+        glFramebufferTexture2D(GL_DRAW_FRAMEBUFFER, GL_DEPTH_ATTACHMENT,
+            type == SRE_SHADOW_MAP_CACHE_SLOT_CUBE ? cube_map_target[i] : GL_TEXTURE_2D,
+            texture, 0);
+        glReadBuffer(GL_NONE);
+        if (glCheckFramebufferStatus(GL_DRAW_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
+            sreFatalError("Error -- shadow map cache framebuffer not complete.");
+    }
+    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+}
+
+static void DestroySlotTextures(sreShadowMapCacheSlot& s) {
+    int nu_framebuffers = (s.type == SRE_SHADOW_MAP_CACHE_SLOT_CUBE) ? 6 : 1;
+    if (s.texture != 0) {
+        glDeleteFramebuffers(nu_framebuffers, &s.framebuffer[0]);
+        glDeleteTextures(1, &s.texture);
+        s.texture = 0;
+    }
+    if (s.static_texture != 0) {
+        glDeleteFramebuffers(nu_framebuffers, &s.static_framebuffer[0]);
+        glDeleteTextures(1, &s.static_texture);
+        s.static_texture = 0;
+    }
+    s.scene = NULL;
+    s.valid = false;
+    s.static_layer_valid = false;
+}
+
+// Return the slot for a light, assigning one when the light does not have a slot yet.
+// The size level of a slot is fixed when its textures are created; the caller must use
+// the slot's level rather than the requested one. The textures are only recreated (and
+// the slot contents marked invalid) when the type changes or a larger shadow map (lower
+// level) is requested, so that camera movement does not cause repeated reallocation.
+
+sreShadowMapCacheSlot *sreGetShadowMapCacheSlot(const sreScene *scene, const sreLight& light,
+int type, int level) {
+    int index = - 1;
+    for (int i = 0; i < SRE_SHADOW_MAP_CACHE_SLOTS; i++)
+        if (slot[i].scene == scene && slot[i].light_id == light.id) {
+            index = i;
+            break;
+        }
+    if (index < 0) {
+        // Reassign the least recently used slot.
+        index = 0;
+        for (int i = 1; i < SRE_SHADOW_MAP_CACHE_SLOTS; i++)
+            if (slot[i].most_recent_use < slot[index].most_recent_use)
+                index = i;
+        slot[index].scene = scene;
+        slot[index].light_id = light.id;
+        slot[index].valid = false;
+        slot[index].static_layer_valid = false;
+    }
+    sreShadowMapCacheSlot& s = slot[index];
+    s.most_recent_use = sre_internal_current_frame;
+    bool static_layer = (sre_internal_shadow_map_cache_mode == SRE_SHADOW_MAP_CACHE_STATIC_LAYER);
+    if (s.texture != 0 && (s.type != type || level < s.level ||
+    (s.static_texture != 0) != static_layer)) {
+        DestroySlotTextures(s);
+        s.scene = scene;
+        s.light_id = light.id;
+    }
+    if (s.texture == 0) {
+        s.type = type;
+        s.level = level;
+        CreateSlotTexture(type, level, s.texture, &s.framebuffer[0]);
+        if (static_layer)
+            CreateSlotTexture(type, level, s.static_texture, &s.static_framebuffer[0]);
+        s.valid = false;
+        s.static_layer_valid = false;
+    }
+    return &s;
+}
+
+// Copy the static layer of a slot into its shadow map. The framebuffer binding is
+// left undefined.
+
+void sreCopyShadowMapCacheStaticLayer(sreShadowMapCacheSlot *s) {
+    int size;
+    if (s->type == SRE_SHADOW_MAP_CACHE_SLOT_CUBE)
+        size = sre_internal_max_cube_shadow_map_size >> s->level;
+    else
+        size = sre_internal_max_shadow_map_size >> s->level;
+    int nu_framebuffers = (s->type == SRE_SHADOW_MAP_CACHE_SLOT_CUBE) ? 6 : 1;
+    for (int i = 0; i < nu_framebuffers; i++) {
+        glBindFramebuffer(GL_READ_FRAMEBUFFER, s->static_framebuffer[i]);
+        glBindFramebuffer(GL_DRAW_FRAMEBUFFER, s->framebuffer[i]);
+        glBlitFramebuffer(0, 0, size, size, 0, 0, size, size, GL_DEPTH_BUFFER_BIT, GL_NEAREST);
+    }
+    glBindFramebuffer(GL_READ_FRAMEBUFFER, 0);
+    CHECK_GL_ERROR("Error after copying shadow map static layer.\n");
+}
+
+// Release all slots, for example when the cache is disabled.
+
+void sreClearShadowMapCache() {
+    for (int i = 0; i < SRE_SHADOW_MAP_CACHE_SLOTS; i++) {
+        DestroySlotTextures(slot[i]);
+        slot[i].light_id = - 1;
+        slot[i].most_recent_use = 0;
+    }
+}
+
+#else
+
+sreShadowMapCacheSlot *sreGetShadowMapCacheSlot(const sreScene *scene, const sreLight& light,
+int type, int level) {
+    return NULL;
+}
+
+void sreCopyShadowMapCacheStaticLayer(sreShadowMapCacheSlot *s) {
+}
+
+void sreClearShadowMapCache() {
+}
+
+#endif
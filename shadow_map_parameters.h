@@ -3,7 +3,12 @@
 #define NU_SHADOW_MAP_PARAMETERS_DIRECTIONAL_BEAM_LIGHT 4
 #define NU_SHADOW_MAP_PARAMETERS_SPOT_LIGHT 2
 #define NU_SHADOW_MAP_PARAMETERS_POINT_LIGHT 4
-#define NU_SHADOW_MAP_PARAMETERS_MAX 4
+#define NU_SHADOW_MAP_PARAMETERS_MAX 7
+// Directional light shadow map with cascades (number of cascades plus
+// six transformation values per cascade).
+#define NU_SHADOW_MAP_PARAMETERS_CASCADES 29
+// Spot or beam light shadow map with shadow map atlas tile parameters.
+#define NU_SHADOW_MAP_PARAMETERS_ATLAS 7
 
 // Size of shadow map in pixels
 #define SHADOW_MAP_SIZE 0
@@ -24,3 +29,14 @@
 // map shader when configured in distance storing mode.
 #define SHADOW_MAP_SEGMENT_DISTANCE_SCALING 2
 
+// Number of cascades of a directional light shadow map.
+#define SHADOW_MAP_NU_CASCADES 4
+// Start of the per-cascade scale (x, y, z) and offset (x, y, z) that convert
+// shadow map coordinates of the first cascade to those of each cascade.
+#define SHADOW_MAP_CASCADE_TRANSFORM 5
+
+// Scale and offset (x, y) of the shadow map atlas tile of a spot or beam light
+// relative to the atlas (a scale of 1.0 when the atlas is not used).
+#define SHADOW_MAP_ATLAS_TILE_SCALE 4
+#define SHADOW_MAP_ATLAS_TILE_OFFSET_X 5
+#define SHADOW_MAP_ATLAS_TILE_OFFSET_Y 6
@@ -53,6 +53,12 @@ OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
 // shadow caster AABB fall within the shadow map.
 //
 // The shadow map is then generated using the predetermined list of shadow casters. 
+//
+// Directional light shadow maps can optionally be split into cascades, each covering a
+// depth range of the view frustum and stored in its own tile of the largest shadow map.
+// The cascades that each shadow caster falls into are determined during the octree
+// traversal, and cascades of which the shadow casters and extents did not change since
+// they were last rendered are not rerendered.
 
 #ifndef NO_SHADOW_MAP
 
@@ -60,6 +66,12 @@ OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
 
 // static int object_count;
 
+#ifndef OPENGL_ES2
+// When non-zero, point light shadow casters are rendered with the layered shadow cube-map
+// shaders into the cube map faces selected by this mask.
+static int layered_cube_segment_mask = 0;
+#endif
+
 static void RenderShadowMapObject(sreObject *so, const sreLight& light) {
     // Apply the global object flags mask. Note render_flags will (unnecessarily)
     // be set again in the lighting pass, but the overhead is of course minimal.
@@ -88,8 +100,14 @@ static void RenderShadowMapObject(sreObject *so, const sreLight& light) {
 
     CHECK_GL_ERROR("RenderShadowMapObject: Error before shadow map shader initialization.\n");
     bool non_closed_add_bias = false;
-    if (light.type & SRE_LIGHT_POINT_SOURCE)
-        GL3InitializeCubeShadowMapShader(*so);
+    if (light.type & SRE_LIGHT_POINT_SOURCE) {
+#ifndef OPENGL_ES2
+        if (layered_cube_segment_mask != 0)
+            GL3InitializeLayeredCubeShadowMapShader(*so, layered_cube_segment_mask);
+        else
+#endif
+            GL3InitializeCubeShadowMapShader(*so);
+    }
     else if (light.type & SRE_LIGHT_SPOT)
         GL3InitializeSpotlightShadowMapShader(*so);
     else {
@@ -157,6 +175,7 @@ static void RenderShadowMapObject(sreObject *so, const sreLight& light) {
             glDrawElements(GL_TRIANGLES, nu_vertices, GL_UNSIGNED_SHORT, (void *)(vertex_offset * 2));
         else
             glDrawElements(GL_TRIANGLES, nu_vertices, GL_UNSIGNED_INT, (void *)(vertex_offset * 4));
+        sreProfilerCountDraw(nu_vertices / 3);
     }
     glDisableVertexAttribArray(0);
     if (non_closed_add_bias)
@@ -169,12 +188,45 @@ static void RenderShadowMapObject(sreObject *so, const sreLight& light) {
 //    object_count++;
 }
 
+// The shadow casters of the light for which the shadow map is rendered. The array is
+// either the scene's shadow caster array or the caster array of a shadow caster set that
+// was determined in advance (see sreDetermineShadowCastersForActiveLights()).
+
+static dstIntArray *current_shadow_caster_array;
+
+// When a persistent shadow map with a static layer is rendered, the static and dynamic
+// shadow casters are drawn in separate passes.
+
+enum { RENDER_ALL_SHADOW_CASTERS, RENDER_STATIC_SHADOW_CASTERS, RENDER_DYNAMIC_SHADOW_CASTERS };
+
+static int rendered_shadow_casters = RENDER_ALL_SHADOW_CASTERS;
+
+static inline bool ShadowCasterIsRendered(const sreObject *so) {
+    if (rendered_shadow_casters == RENDER_ALL_SHADOW_CASTERS)
+        return true;
+    bool dynamic = (so->flags & SRE_OBJECT_DYNAMIC_POSITION) != 0;
+    return dynamic == (rendered_shadow_casters == RENDER_DYNAMIC_SHADOW_CASTERS);
+}
+
 static void RenderShadowMapFromCasterArray(sreScene *scene, const sreLight& light) {
 //    sreMessage(SRE_MESSAGE_INFO, "Rendering %d objects into shadow map for light %d.",
-//        scene->shadow_caster_array.Size(), light.id);
-    for (int i = 0; i < scene->shadow_caster_array.Size(); i++)
-        RenderShadowMapObject(scene->object[
-            scene->shadow_caster_array.Get(i)], light);
+//        current_shadow_caster_array->Size(), light.id);
+    for (int i = 0; i < current_shadow_caster_array->Size(); i++) {
+        sreObject *so = scene->object[current_shadow_caster_array->Get(i)];
+        if (ShadowCasterIsRendered(so))
+            RenderShadowMapObject(so, light);
+    }
+}
+
+static void RenderCascadeShadowMapFromCasterArray(sreScene *scene, const sreLight& light,
+int cascade) {
+    // For cascaded directional light shadow maps, the cascades that the object falls into
+    // are stored in bits 26 to 29 of each entry in the shadow caster object array.
+    unsigned int cascade_bit = (unsigned int)1 << (26 + cascade);
+    for (int i = 0; i < current_shadow_caster_array->Size(); i++)
+        if (current_shadow_caster_array->Get(i) & cascade_bit)
+            RenderShadowMapObject(scene->object[
+                current_shadow_caster_array->Get(i) & 0x03FFFFFF], light);
 }
 
 static void RenderCubeShadowMapFromCasterArray(sreScene *scene, const sreLight& light, int segment) {
@@ -182,20 +234,46 @@ static void RenderCubeShadowMapFromCasterArray(sreScene *scene, const sreLight&
     // 26 to 31 of each entry in the shadow caster object array.
 //    object_count = 0;
     unsigned int segment_bit = (unsigned int)1 << (26 + segment);
-    for (int i = 0; i < scene->shadow_caster_array.Size(); i++)
-        if (scene->shadow_caster_array.Get(i) & segment_bit)
-            RenderShadowMapObject(scene->object[
-                scene->shadow_caster_array.Get(i) & 0x03FFFFFF], light);
+    for (int i = 0; i < current_shadow_caster_array->Size(); i++)
+        if (current_shadow_caster_array->Get(i) & segment_bit) {
+            sreObject *so = scene->object[current_shadow_caster_array->Get(i) & 0x03FFFFFF];
+            if (ShadowCasterIsRendered(so))
+                RenderShadowMapObject(so, light);
+        }
 //    sreMessage(SRE_MESSAGE_INFO, "Light %d shadow cube map generation: segment mask = 0x%08X, "
 //          "%d objects rendered.", light.id, segment_bit, object_count);
 }
 
+#ifndef OPENGL_ES2
+
+// Layered version that submits each shadow caster only once; the geometry shader routes
+// the triangles to the faces in face_mask that the object falls into.
+
+static void RenderLayeredCubeShadowMapFromCasterArray(sreScene *scene, const sreLight& light,
+int face_mask) {
+    for (int i = 0; i < current_shadow_caster_array->Size(); i++) {
+        int mask = (current_shadow_caster_array->Get(i) >> 26) & face_mask;
+        if (mask == 0)
+            continue;
+        sreObject *so = scene->object[current_shadow_caster_array->Get(i) & 0x03FFFFFF];
+        if (ShadowCasterIsRendered(so)) {
+            layered_cube_segment_mask = mask;
+            RenderShadowMapObject(so, light);
+        }
+    }
+    layered_cube_segment_mask = 0;
+}
+
+#endif
+
 // The calculated shadow AABBs are stored in a global variable.
 static sreBoundingVolumeAABB AABB_shadow_receiver;
 static sreBoundingVolumeAABB AABB_shadow_caster;
 // For point lights, calculate the minimum depth of any object over all shadow cube map segments.
 // This is similar to the distance between the light and the closest bounding volume of an object.
 static float min_segment_depth;
+// Keep track whether each segment of a point light cube map remains empty.
+static unsigned int segment_non_empty_mask;
 
 // During shadow AABB determination, SIMD registers/code may be used.
 #ifdef USE_SIMD
@@ -238,6 +316,37 @@ public :
     }
 };
 
+// The result of the shadow caster determination for a light: the list of shadow casters
+// (with the cube segment or cascade mask in bits 26 to 31 of each entry), the caster and
+// receiver AABBs and, for point lights, the cube segment information. The shadow caster
+// volume and cube segment hulls used during the determination are also stored, so that
+// the sets of different lights can be determined concurrently.
+
+class sreShadowCasterSet {
+public :
+    dstIntArray *caster_array;
+    sreBoundingVolumeConvexHull shadow_caster_volume;
+    sreBoundingVolumeConvexHull cube_segment_ch[6];
+    Vector4D cube_segment_ch_plane[6][4];
+    // Whether the cascade mask of each caster is determined (directional light cascades).
+    bool cascaded;
+    sreBoundingVolumeAABB AABB_shadow_caster;
+    sreBoundingVolumeAABB AABB_shadow_receiver;
+    unsigned int segment_non_empty_mask;
+    float min_segment_depth;
+    // The light and frame for which the set was determined in advance (- 1 when not
+    // determined in advance).
+    int light_index;
+    int frame;
+
+    sreShadowCasterSet() {
+        shadow_caster_volume.AllocateStorage(12);
+        caster_array = NULL;
+        light_index = - 1;
+        frame = - 1;
+    }
+};
+
 // Update an AABB with the union of the AABB and the bounding volume of an object.
 
 static void UpdateAABBWithObject(SHADOW_AABB_TYPE &AABB, sreObject *so) {
@@ -319,24 +428,19 @@ static const Vector3D cube_map_plane_normal[6][4] = {
     }
 };
 
-static sreBoundingVolumeConvexHull cube_segment_ch[6];
-static Vector4D cube_segment_ch_plane[6][4];
-
-static void CalculateCubeSegmentHulls(const sreLight& light) {
-    sreBoundingVolumeConvexHull ch;
-    unsigned int mask = 0;
+static void CalculateCubeSegmentHulls(sreShadowCasterSet& set, const sreLight& light) {
     for (int i = 0; i < 6; i++) {
-        cube_segment_ch[i].nu_planes = 4;
-        cube_segment_ch[i].plane = &cube_segment_ch_plane[i][0];
+        set.cube_segment_ch[i].nu_planes = 4;
+        set.cube_segment_ch[i].plane = &set.cube_segment_ch_plane[i][0];
         // Take the plane orientation from the table and make it go through
         // the light position.
         for (int j = 0; j < 4; j++)
-            cube_segment_ch[i].plane[j] = Vector4D(cube_map_plane_normal[i][j],
+            set.cube_segment_ch[i].plane[j] = Vector4D(cube_map_plane_normal[i][j],
                 - Dot(cube_map_plane_normal[i][j], light.sphere.center));
     }
 }
 
-static unsigned int GetSegmentMask(const sreLight& light, const sreObject& so) {
+static unsigned int GetSegmentMask(const sreShadowCasterSet& set, const sreObject& so) {
     // Check whether object is inside each convex hull representing the six
     // cube segments of the light volume.
     // This could be optimized because each plane test is identical to one of the plane
@@ -344,7 +448,7 @@ static unsigned int GetSegmentMask(const sreLight& light, const sreObject& so) {
     unsigned int mask = 0;
     for (int i = 5; i >= 0; i--) {
         mask <<= 1;
-        if (Intersects(so, cube_segment_ch[i]))
+        if (Intersects(so, set.cube_segment_ch[i]))
             mask |= 1;
     }
     return mask;
@@ -373,15 +477,16 @@ static void CalculateObjectAABB(const sreObject& so, sreBoundingVolumeAABB& obje
          }
 }
 
-static void UpdateMinSegmentDepth(const sreLight& light, const sreObject& so) {
-    if (min_segment_depth == 0.0f)
+static void UpdateMinSegmentDepth(sreShadowCasterSet& set, const sreLight& light,
+const sreObject& so) {
+    if (set.min_segment_depth == 0.0f)
         return;
     sreBoundingVolumeAABB object_AABB;
     CalculateObjectAABB(so, object_AABB);
     // Check whether the bounding volume intersects the light position; if so, there is no
     // bound on the minimum segment depth.
     if (Intersects(light.sphere.center, object_AABB)) {
-        min_segment_depth = 0.0f;
+        set.min_segment_depth = 0.0f;
         return;
     }
     // Calculate the distance from the light to the AABB.
@@ -404,7 +509,190 @@ static void UpdateMinSegmentDepth(const sreLight& light, const sreObject& so) {
     // Z-negative segment.
     if (object_AABB.dim_max.z <= light.sphere.center.z)
         max_dist = maxf(max_dist, light.sphere.center.z - object_AABB.dim_max.z);
-    min_segment_depth = minf(min_segment_depth, max_dist);
+    set.min_segment_depth = minf(set.min_segment_depth, max_dist);
+}
+
+// Directional light shadow map cascades. The extents of each cascade are defined in a
+// light coordinate system with the x axis cascade_x_dir, the y axis - cascade_y_dir (negated
+// as in the shadow map matrix) and the z axis the light vector (pointing towards the light).
+
+class sreShadowMapCascade {
+public :
+    float x_min, y_min;
+    // Width and height of the cascade.
+    float size;
+    // Range of z covered by the cascade. z_max is extended towards the light to include
+    // all shadow casters.
+    float z_min, z_max;
+    float caster_z_max;
+    int nu_casters;
+    unsigned int caster_hash;
+};
+
+// The number of cascades for the current directional light (1 when not split).
+static int nu_cascades;
+static sreShadowMapCascade cascade[SRE_MAX_SHADOW_MAP_CASCADES];
+static Vector3D cascade_x_dir, cascade_y_dir, cascade_light_vector;
+
+// The state of the cascades when they were last rendered into the shadow map.
+
+class sreShadowMapCascadeCacheEntry {
+public :
+    bool valid;
+    int light_id;
+    Vector3D light_direction;
+    int nu_cascades;
+    int shadow_map_size;
+    sreShadowMapCascade cascade;
+    int frame;
+};
+
+static sreShadowMapCascadeCacheEntry cascade_cache[SRE_MAX_SHADOW_MAP_CASCADES];
+
+// Called whenever the largest shadow map is overwritten with something other than the
+// cascades.
+
+static void InvalidateShadowMapCascadeCache() {
+    for (int i = 0; i < SRE_MAX_SHADOW_MAP_CASCADES; i++)
+        cascade_cache[i].valid = false;
+}
+
+static void ResetShadowMapCascadeParameters() {
+    sre_internal_shadow_map_cascade_parameters[0] = 1.0f;
+    for (int i = 0; i < 3; i++) {
+        sre_internal_shadow_map_cascade_parameters[1 + i] = 1.0f;
+        sre_internal_shadow_map_cascade_parameters[4 + i] = 0.0f;
+    }
+}
+
+// Divide the view frustum (up to the far end of the shadow map region) into depth ranges
+// and fit a cascade around the bounding sphere of each sub-frustum. The cascade
+// extents are snapped to shadow map texels so that they remain constant as long as the
+// camera does not move.
+
+static void CalculateShadowMapCascades(const sreLight& light, const sreFrustum& frustum) {
+    Vector3D light_vector = light.vector.GetVector3D();
+    cascade_light_vector = light_vector;
+    // Use the coordinate axis that is least aligned with the light direction.
+    Vector3D up;
+    if (fabsf(light_vector.x) <= fabsf(light_vector.y) &&
+    fabsf(light_vector.x) <= fabsf(light_vector.z))
+        up = Vector3D(1.0f, 0, 0);
+    else if (fabsf(light_vector.y) <= fabsf(light_vector.z))
+        up = Vector3D(0, 1.0f, 0);
+    else
+        up = Vector3D(0, 0, 1.0f);
+    cascade_x_dir = Cross(light_vector, up);
+    cascade_x_dir.Normalize();
+    cascade_y_dir = Cross(cascade_x_dir, light_vector);
+
+    float near_distance = frustum.nearD;
+    float far_distance = minf(frustum.farD, - sre_internal_shadow_map_AABB.dim_min.z);
+    if (far_distance <= near_distance)
+        far_distance = frustum.farD;
+    int tile_size = sre_internal_max_shadow_map_size / 2;
+    float split_start = near_distance;
+    for (int i = 0; i < nu_cascades; i++) {
+        // Blend logarithmic and uniform split distances.
+        float f = (float)(i + 1) / nu_cascades;
+        float split_end = 0.75f * near_distance * powf(far_distance / near_distance, f) +
+            0.25f * (near_distance + (far_distance - near_distance) * f);
+        if (i == nu_cascades - 1)
+            split_end = far_distance;
+        // Calculate the corners of the sub-frustum by interpolating along the frustum edges.
+        Point3D corner[8];
+        for (int j = 0; j < 4; j++) {
+            const Point3D& V_near = frustum.frustum_world.hull.vertex[j];
+            Vector3D edge = frustum.frustum_world.hull.vertex[j + 4] - V_near;
+            corner[j] = V_near + edge * ((split_start - frustum.nearD) /
+                (frustum.farD - frustum.nearD));
+            corner[j + 4] = V_near + edge * ((split_end - frustum.nearD) /
+                (frustum.farD - frustum.nearD));
+        }
+        Vector3D sum = Vector3D(0, 0, 0);
+        for (int j = 0; j < 8; j++)
+            sum += corner[j] - Point3D(0, 0, 0);
+        Point3D center = Point3D(0, 0, 0) + sum * 0.125f;
+        float radius = 0;
+        for (int j = 0; j < 8; j++)
+            radius = maxf(radius, Magnitude(corner[j] - center));
+        // Quantize the radius so that the size of the cascade is stable.
+        radius = ceilf(radius * 16.0f) / 16.0f;
+        float texel_size = 2.0f * radius / tile_size;
+        float cx = floorf(Dot(center, cascade_x_dir) / texel_size) * texel_size;
+        float cy = floorf(- Dot(center, cascade_y_dir) / texel_size) * texel_size;
+        float cz = floorf(Dot(center, light_vector) / texel_size) * texel_size;
+        cascade[i].x_min = cx - radius;
+        cascade[i].y_min = cy - radius;
+        cascade[i].size = 2.0f * radius;
+        cascade[i].z_min = cz - radius;
+        cascade[i].z_max = cz + radius;
+        cascade[i].caster_z_max = - FLT_MAX;
+        cascade[i].nu_casters = 0;
+        cascade[i].caster_hash = 2166136261u;
+        split_start = split_end;
+    }
+}
+
+// Determine the cascades into which an object can cast shadows, and update the
+// caster statistics of those cascades.
+
+static unsigned int GetCascadeMask(const sreObject& so) {
+    sreBoundingVolumeAABB object_AABB;
+    CalculateObjectAABB(so, object_AABB);
+    Point3D center = Point3D(0, 0, 0) + 0.5f * (object_AABB.dim_min + object_AABB.dim_max);
+    Vector3D extents = 0.5f * (object_AABB.dim_max - object_AABB.dim_min);
+    const Vector3D& light_vector = cascade_light_vector;
+    // Project the AABB onto the axes of the light coordinate system.
+    float x = Dot(center, cascade_x_dir);
+    float ex = fabsf(cascade_x_dir.x) * extents.x + fabsf(cascade_x_dir.y) * extents.y +
+        fabsf(cascade_x_dir.z) * extents.z;
+    float y = - Dot(center, cascade_y_dir);
+    float ey = fabsf(cascade_y_dir.x) * extents.x + fabsf(cascade_y_dir.y) * extents.y +
+        fabsf(cascade_y_dir.z) * extents.z;
+    float z = Dot(center, light_vector);
+    float ez = fabsf(light_vector.x) * extents.x + fabsf(light_vector.y) * extents.y +
+        fabsf(light_vector.z) * extents.z;
+    unsigned int mask = 0;
+    for (int i = 0; i < nu_cascades; i++) {
+        if (x + ex < cascade[i].x_min || x - ex > cascade[i].x_min + cascade[i].size ||
+        y + ey < cascade[i].y_min || y - ey > cascade[i].y_min + cascade[i].size ||
+        z + ez < cascade[i].z_min)
+            continue;
+        mask |= 1 << i;
+        cascade[i].caster_z_max = maxf(cascade[i].caster_z_max, z + ez);
+        cascade[i].nu_casters++;
+        cascade[i].caster_hash = (cascade[i].caster_hash ^ so.id) * 16777619u;
+    }
+    return mask;
+}
+
+// Process a single object for a directional light, updating the caster and receiver
+// AABBs. octree_bounds_check_result indicates whether the containing node is known to
+// be completely inside the shadow caster volume.
+
+static void FindAABBDirectionalLightObject(sreShadowAABBGenerationInfo& AABB_generation_info,
+sreScene *scene, sreShadowCasterSet& set, sreObject *so,
+BoundsCheckResult octree_bounds_check_result) {
+    if (!so->exists)
+        return;
+    // Note: for a root node-only octree where no bounds are defined,
+    // the intersection test of the object with the shadow caster volume
+    // is always performed.
+    if (octree_bounds_check_result != SRE_COMPLETELY_INSIDE)
+        if (!Intersects(*so, set.shadow_caster_volume))
+            return;
+    if (so->flags & SRE_OBJECT_CAST_SHADOWS) {
+        UpdateAABBWithObject(AABB_generation_info.casters, so);
+        if (set.cascaded)
+            // Store the cascades that the object falls into in bits 26 to 29.
+            set.caster_array->Add(so->id | (GetCascadeMask(*so) << 26));
+        else
+            set.caster_array->Add(so->id);
+    }
+    // For all objects that receive light, update the shadow receiver AABB.
+    if (!(so->flags & SRE_OBJECT_EMISSION_ONLY)) 
+        UpdateAABBWithObject(AABB_generation_info.receivers, so);
 }
 
 // Find the AABB for a directional light. Bounds checks are performed starting from the
@@ -413,7 +701,7 @@ static void UpdateMinSegmentDepth(const sreLight& light, const sreObject& so) {
 
 static void FindAABBDirectionalLight(sreShadowAABBGenerationInfo& AABB_generation_info,
 const sreFastOctree& fast_oct, int array_index,
-sreScene *scene, const sreFrustum& frustum, BoundsCheckResult octree_bounds_check_result) {
+sreScene *scene, sreShadowCasterSet& set, BoundsCheckResult octree_bounds_check_result) {
     // For directional lights, the shadow caster volume defined for the frustum is equal
     // to the shadow receiver volume.
     // Check whether the octree is completely outside or completely inside that volume,
@@ -424,7 +712,7 @@ sreScene *scene, const sreFrustum& frustum, BoundsCheckResult octree_bounds_chec
     SRE_COMPLETELY_INSIDE)) {
         int node_index = fast_oct.array[array_index];
         octree_bounds_check_result = QueryIntersection(fast_oct.node_bounds[node_index],
-            frustum.shadow_caster_volume);
+            set.shadow_caster_volume);
         if (octree_bounds_check_result == SRE_COMPLETELY_OUTSIDE)
             return;
     }
@@ -438,40 +726,79 @@ sreScene *scene, const sreFrustum& frustum, BoundsCheckResult octree_bounds_chec
         fast_oct.GetEntity(array_index + i, type, index);
         if (type != SRE_ENTITY_OBJECT)
             continue;
-        sreObject *so = scene->object[index];
-        if (so->exists) {
-            // Note: for a root node-only octree where no bounds are defined,
-            // the intersection test of the object with the shadow caster volume
-            // is always performed.
-            if (octree_bounds_check_result != SRE_COMPLETELY_INSIDE)
-                if (!Intersects(*so, frustum.shadow_caster_volume))
-                    continue;
-            if (so->flags & SRE_OBJECT_CAST_SHADOWS) {
-                UpdateAABBWithObject(AABB_generation_info.casters, so);
-                scene->shadow_caster_array.Add(so->id);
-            }
-            // For all objects that receive light, update the shadow receiver AABB.
-            if (!(so->flags & SRE_OBJECT_EMISSION_ONLY)) 
-                UpdateAABBWithObject(AABB_generation_info.receivers, so);
-        }
+        FindAABBDirectionalLightObject(AABB_generation_info, scene, set,
+            scene->object[index], octree_bounds_check_result);
     }
     // Check every non-empty subnode.
     array_index += nu_entities;
     for (int i = 0; i < nu_octants; i++)
         FindAABBDirectionalLight(AABB_generation_info,
             fast_oct, fast_oct.array[array_index + i], scene,
-            frustum, octree_bounds_check_result);
+            set, octree_bounds_check_result);
+}
+
+// Find the AABB for a directional light for the objects in the dynamic object BVH.
+
+static void FindAABBDirectionalLight(sreShadowAABBGenerationInfo& AABB_generation_info,
+const sreObjectBVH& bvh, int node_index, sreScene *scene, sreShadowCasterSet& set,
+BoundsCheckResult bounds_check_result) {
+    const sreObjectBVHNode& node = bvh.node[node_index];
+    if (bounds_check_result != SRE_COMPLETELY_INSIDE) {
+        bounds_check_result = QueryIntersection(node.bounds, set.shadow_caster_volume);
+        if (bounds_check_result == SRE_COMPLETELY_OUTSIDE)
+            return;
+    }
+    if (node.child[0] < 0) {
+        FindAABBDirectionalLightObject(AABB_generation_info, scene, set,
+            scene->object[node.object_index], bounds_check_result);
+        return;
+    }
+    FindAABBDirectionalLight(AABB_generation_info, bvh, node.child[0], scene, set,
+        bounds_check_result);
+    FindAABBDirectionalLight(AABB_generation_info, bvh, node.child[1], scene, set,
+        bounds_check_result);
 }
 
 // Find the AABB for all potential shadow casters within the range of a local light.
 // Also keep track of the shadow receivers AABB.
 
-// Keep track whether each segment of a point light cube map remains empty.
-static unsigned int segment_non_empty_mask;
+// Process a single object for a local light. octree_bounds_check_result indicates whether
+// the containing node is known to be completely inside the light volume.
+
+static void FindAABBLocalLightObject(sreShadowAABBGenerationInfo& AABB_generation_info,
+sreScene *scene, sreShadowCasterSet& set, const sreLight& light, sreObject *so,
+BoundsCheckResult octree_bounds_check_result) {
+    // Skip objects attached to the current light and infinite distance objects.
+    if (!so->exists || so->attached_light == light.id)
+        return;
+    // Both shadow casters and shadow receivers must intersect the light volume.
+    // Note: for a root-node only octree, the intersection test is always performed.
+    if (octree_bounds_check_result != SRE_COMPLETELY_INSIDE && !Intersects(*so, light))
+        return;
+    if (so->flags & SRE_OBJECT_CAST_SHADOWS) {
+        // For objects that cast shadows, update the caster AABB if the object falls within
+        // the shadow caster volume.
+        if (Intersects(*so, set.shadow_caster_volume)) {
+            UpdateAABBWithObject(AABB_generation_info.casters, so);
+            if (light.type & SRE_LIGHT_POINT_SOURCE) {
+                unsigned int segment_mask = GetSegmentMask(set, *so);
+                set.caster_array->Add(so->id | (segment_mask << 26));
+                set.segment_non_empty_mask |= segment_mask;
+                // Update the minimum segment depth.
+                UpdateMinSegmentDepth(set, light, *so);
+            }
+            else
+                set.caster_array->Add(so->id);
+        }
+    }
+    // For all objects that receive light, update the shadow receiver AABB.
+    if (!(so->flags & SRE_OBJECT_EMISSION_ONLY))
+        UpdateAABBWithObject(AABB_generation_info.receivers, so);
+}
 
 static void FindAABBLocalLight(sreShadowAABBGenerationInfo& AABB_generation_info,
 const sreFastOctree& fast_oct, int array_index, sreScene *scene,
-const sreFrustum& frustum, const sreLight& light, BoundsCheckResult octree_bounds_check_result) {
+sreShadowCasterSet& set, const sreLight& light, BoundsCheckResult octree_bounds_check_result) {
     int node_index = fast_oct.array[array_index];
     if (SRE_BOUNDS_NOT_EQUAL_AND_TEST_ALLOWED(octree_bounds_check_result, SRE_COMPLETELY_INSIDE)) {
         // If checks are allowed and the octree is not already completely inside the light volume,
@@ -491,42 +818,133 @@ const sreFrustum& frustum, const sreLight& light, BoundsCheckResult octree_bound
         fast_oct.GetEntity(array_index + i, type, index);
         if (type != SRE_ENTITY_OBJECT)
             continue;
-        sreObject *so = scene->object[index];
-        // Skip objects attached to the current light and infinite distance objects.
-        if (so->exists && so->attached_light != light.id) {
-            // Both shadow casters and shadow receivers must intersect the light volume.
-            // Note: for a root-node only octree, the intersection test is always performed.
-            if (octree_bounds_check_result == SRE_COMPLETELY_INSIDE || Intersects(*so, light)) {
-                if (so->flags & SRE_OBJECT_CAST_SHADOWS) {
-                    // For objects that cast shadows, update the caster AABB if the object falls within
-                    // the shadow caster volume.
-                    if (Intersects(*so, frustum.shadow_caster_volume)) {
-                        UpdateAABBWithObject(AABB_generation_info.casters, so);
-                        if (light.type & SRE_LIGHT_POINT_SOURCE) {
-                            unsigned int segment_mask = GetSegmentMask(light, *so);
-                            scene->shadow_caster_array.Add(so->id | (segment_mask << 26));
-                            segment_non_empty_mask |= segment_mask;
-                            // Update the minimum segment depth.
-                            UpdateMinSegmentDepth(light, *so);
-                        }
-                        else
-                            scene->shadow_caster_array.Add(so->id);
-                    }
-                }
-                // For all objects that receive light, update the shadow receiver AABB.
-                if (!(so->flags & SRE_OBJECT_EMISSION_ONLY))
-                    UpdateAABBWithObject(AABB_generation_info.receivers, so);
-            }
-        }
+        FindAABBLocalLightObject(AABB_generation_info, scene, set, light,
+            scene->object[index], octree_bounds_check_result);
     }
     // Check every non-empty subnode.
     array_index += nu_entities;
     for (int i = 0; i < nu_octants; i++)
         FindAABBLocalLight(AABB_generation_info,
-            fast_oct, fast_oct.array[array_index + i], scene, frustum, light,
+            fast_oct, fast_oct.array[array_index + i], scene, set, light,
             octree_bounds_check_result);
 }
 
+// Find the caster and receiver AABBs for a local light for the objects in the dynamic
+// object BVH.
+
+static void FindAABBLocalLight(sreShadowAABBGenerationInfo& AABB_generation_info,
+const sreObjectBVH& bvh, int node_index, sreScene *scene, sreShadowCasterSet& set,
+const sreLight& light, BoundsCheckResult bounds_check_result) {
+    const sreObjectBVHNode& node = bvh.node[node_index];
+    if (bounds_check_result != SRE_COMPLETELY_INSIDE) {
+        bounds_check_result = QueryIntersection(node.bounds, light);
+        if (bounds_check_result == SRE_COMPLETELY_OUTSIDE)
+            return;
+    }
+    if (node.child[0] < 0) {
+        FindAABBLocalLightObject(AABB_generation_info, scene, set, light,
+            scene->object[node.object_index], bounds_check_result);
+        return;
+    }
+    FindAABBLocalLight(AABB_generation_info, bvh, node.child[0], scene, set, light,
+        bounds_check_result);
+    FindAABBLocalLight(AABB_generation_info, bvh, node.child[1], scene, set, light,
+        bounds_check_result);
+}
+
+
+#ifndef OPENGL_ES2
+
+// Persistent shadow maps (see shadow_map_cache.cpp).
+
+enum { SHADOW_MAP_CACHE_HIT, SHADOW_MAP_CACHE_RENDER_DYNAMIC, SHADOW_MAP_CACHE_RENDER_ALL };
+
+static inline unsigned int HashShadowCaster(unsigned int hash, unsigned int entry) {
+    // FNV-1a, one 32-bit word at a time.
+    return (hash ^ entry) * 16777619u;
+}
+
+static inline bool VectorsAreEqual(const Vector4D& v1, const Vector4D& v2) {
+    return v1.x == v2.x && v1.y == v2.y && v1.z == v2.z && v1.w == v2.w;
+}
+
+// Compare the current light parameters and shadow casters with the state recorded in a
+// persistent shadow map slot, and record the new state. The return value indicates
+// whether the shadow map is still valid, whether only the dynamic shadow casters have to
+// be drawn on top of the static layer, or whether the shadow map has to be rendered
+// completely. The shadow caster array entries include the segment mask bits for point
+// lights, so a caster that moves into another cube segment is also detected.
+
+static int CheckShadowMapCacheSlot(sreScene *scene, const sreLight& light,
+sreShadowMapCacheSlot *slot, float near_plane_distance) {
+    int nu_static_casters = 0;
+    int nu_dynamic_casters = 0;
+    unsigned int static_caster_hash = 2166136261u;
+    unsigned int dynamic_caster_hash = 2166136261u;
+    bool static_casters_changed = false;
+    bool dynamic_casters_changed = false;
+    for (int i = 0; i < current_shadow_caster_array->Size(); i++) {
+        unsigned int entry = current_shadow_caster_array->Get(i);
+        sreObject *so = scene->object[entry & 0x03FFFFFF];
+        bool changed = (so->most_recent_position_change >= slot->frame ||
+            so->most_recent_transformation_change >= slot->frame);
+        if (so->flags & SRE_OBJECT_DYNAMIC_POSITION) {
+            nu_dynamic_casters++;
+            dynamic_caster_hash = HashShadowCaster(dynamic_caster_hash, entry);
+            dynamic_casters_changed |= changed;
+        }
+        else {
+            nu_static_casters++;
+            static_caster_hash = HashShadowCaster(static_caster_hash, entry);
+            static_casters_changed |= changed;
+        }
+    }
+    bool light_changed = !VectorsAreEqual(slot->light_vector, light.vector) ||
+        !VectorsAreEqual(slot->light_spotlight, light.spotlight) ||
+        slot->light_attenuation.x != light.attenuation.x ||
+        slot->light_attenuation.y != light.attenuation.y ||
+        slot->light_attenuation.z != light.attenuation.z;
+    bool static_layer_usable = !light_changed && !static_casters_changed &&
+        nu_static_casters == slot->nu_static_casters &&
+        static_caster_hash == slot->static_caster_hash;
+    int result;
+    if (slot->valid && static_layer_usable && !dynamic_casters_changed &&
+    nu_dynamic_casters == slot->nu_dynamic_casters &&
+    dynamic_caster_hash == slot->dynamic_caster_hash &&
+    near_plane_distance == slot->near_plane_distance)
+        result = SHADOW_MAP_CACHE_HIT;
+    else if (slot->static_layer_valid && static_layer_usable &&
+    near_plane_distance >= slot->near_plane_distance)
+        // The near plane of the static layer is still valid for the dynamic casters.
+        result = SHADOW_MAP_CACHE_RENDER_DYNAMIC;
+    else
+        result = SHADOW_MAP_CACHE_RENDER_ALL;
+    if (result != SHADOW_MAP_CACHE_HIT) {
+        slot->light_vector = light.vector;
+        slot->light_spotlight = light.spotlight;
+        slot->light_attenuation = light.attenuation;
+        slot->nu_static_casters = nu_static_casters;
+        slot->static_caster_hash = static_caster_hash;
+        slot->nu_dynamic_casters = nu_dynamic_casters;
+        slot->dynamic_caster_hash = dynamic_caster_hash;
+        if (result == SHADOW_MAP_CACHE_RENDER_ALL) {
+            slot->near_plane_distance = near_plane_distance;
+            slot->static_layer_valid = (slot->static_texture != 0);
+        }
+        slot->valid = true;
+        slot->frame = sre_internal_current_frame;
+    }
+    return result;
+}
+
+static void RenderCachedShadowMap(sreScene *scene, const sreLight& light,
+    sreShadowMapCacheSlot *slot, int cache_result, int segment_mask);
+
+// Set while the shadow maps of the active lights are rendered into the shadow map atlas
+// in advance (see sreRenderShadowMapAtlas()). The atlas is then already bound and cleared.
+static bool atlas_pass = false;
+
+#endif
 
 void RenderSpotOrBeamLightShadowMap(sreScene *scene, const sreLight& light, const sreFrustum &frustum) {
     // Create a local coordinate system.
@@ -566,6 +984,9 @@ void RenderSpotOrBeamLightShadowMap(sreScene *scene, const sreLight& light, cons
             inside = true;
     if (inside)
         threshold *= 0.75f;
+#ifndef OPENGL_ES2
+    float atlas_threshold = threshold;
+#endif
     for (int level = 0;; level++) {
         if (light.projected_size >= threshold ||
         level + 1 == sre_internal_nu_shadow_map_size_levels) {
@@ -574,16 +995,84 @@ void RenderSpotOrBeamLightShadowMap(sreScene *scene, const sreLight& light, cons
         }
         threshold *= 0.5f;
     }
+#ifndef OPENGL_ES2
+    sreShadowMapCacheSlot *cache_slot = NULL;
+    int cache_result;
+    bool use_atlas = false;
+    sre_internal_current_shadow_map_atlas_tile_size = 0;
+    sre_internal_shadow_map_atlas_tile_parameters[0] = 1.0f;
+    sre_internal_shadow_map_atlas_tile_parameters[1] = 0;
+    sre_internal_shadow_map_atlas_tile_parameters[2] = 0;
+    if (sre_internal_shadow_map_cache_mode != SRE_SHADOW_MAP_CACHE_DISABLED) {
+        // Use the persistent shadow map of the light.
+        cache_slot = sreGetShadowMapCacheSlot(scene, light, SRE_SHADOW_MAP_CACHE_SLOT_2D,
+            sre_internal_current_shadow_map_index);
+        sre_internal_current_shadow_map_index = cache_slot->level;
+        cache_result = CheckShadowMapCacheSlot(scene, light, cache_slot,
+            SRE_MIN_SPOT_LIGHT_SHADOW_MAP_NEAR_PLANE_DISTANCE);
+        sre_internal_current_shadow_map_texture = cache_slot->texture;
+    }
+    else if (sre_internal_shadow_map_atlas_size > 0) {
+        // Pick a tile size for the light using the same thresholds as the shadow map
+        // size levels, but with the full range of tile sizes.
+        int tile_size = sre_internal_max_shadow_map_size;
+        if (tile_size > sre_internal_shadow_map_atlas_size)
+            tile_size = sre_internal_shadow_map_atlas_size;
+        while (light.projected_size < atlas_threshold &&
+        tile_size > SRE_MIN_SHADOW_MAP_ATLAS_TILE_SIZE) {
+            tile_size /= 2;
+            atlas_threshold *= 0.5f;
+        }
+        sreShadowMapAtlasTile tile;
+        if (atlas_pass) {
+            // Use a smaller tile when the atlas is filling up. The caller has checked
+            // that the atlas is not full, so a tile of the smallest size is available.
+            while (!sreAllocateShadowMapAtlasTile(tile_size, tile))
+                tile_size /= 2;
+            glViewport(tile.x, tile.y, tile.size, tile.size);
+        }
+        else {
+            // When the atlas is full, the tiles rendered in advance have all been used
+            // by the lighting passes of earlier lights.
+            if (!sreAllocateShadowMapAtlasTile(tile_size, tile)) {
+                sreResetShadowMapAtlas();
+                sreAllocateShadowMapAtlasTile(tile_size, tile);
+            }
+            sreBindShadowMapAtlasTile(tile);
+        }
+        use_atlas = true;
+        sre_internal_current_shadow_map_texture = sre_internal_shadow_map_atlas_texture;
+        sre_internal_current_shadow_map_atlas_tile_size = tile.size;
+        float atlas_size = sre_internal_shadow_map_atlas_size;
+        sre_internal_shadow_map_atlas_tile_parameters[0] = tile.size / atlas_size;
+        sre_internal_shadow_map_atlas_tile_parameters[1] = tile.x / atlas_size;
+        sre_internal_shadow_map_atlas_tile_parameters[2] = tile.y / atlas_size;
+    }
+    else
+#endif
+    {
+        if (sre_internal_current_shadow_map_index == 0)
+            // The largest shadow map may hold directional light shadow map cascades.
+            InvalidateShadowMapCascadeCache();
+        sre_internal_current_shadow_map_texture = sre_internal_depth_texture[
+            sre_internal_current_shadow_map_index];
+    }
+
+#ifdef OPENGL_ES2
     glViewport(0, 0,
         sre_internal_max_shadow_map_size >> sre_internal_current_shadow_map_index,
         sre_internal_max_shadow_map_size >> sre_internal_current_shadow_map_index);
-
-#ifdef OPENGL_ES2
     glBindFramebuffer(GL_FRAMEBUFFER, sre_internal_shadow_map_framebuffer[
         sre_internal_current_shadow_map_index]);
 #else
-    glBindFramebuffer(GL_DRAW_FRAMEBUFFER, sre_internal_shadow_map_framebuffer[
-        sre_internal_current_shadow_map_index]);
+    // The atlas tile has been bound, cleared and set as viewport already.
+    if (!use_atlas)
+        glViewport(0, 0,
+            sre_internal_max_shadow_map_size >> sre_internal_current_shadow_map_index,
+            sre_internal_max_shadow_map_size >> sre_internal_current_shadow_map_index);
+    if (cache_slot == NULL && !use_atlas)
+        glBindFramebuffer(GL_DRAW_FRAMEBUFFER, sre_internal_shadow_map_framebuffer[
+            sre_internal_current_shadow_map_index]);
 #endif
     // Using front-face culling (only drawing back faces) reduces shadow map artifacts.
     glCullFace(GL_FRONT);
@@ -593,7 +1082,10 @@ void RenderSpotOrBeamLightShadowMap(sreScene *scene, const sreLight& light, cons
     if (sre_internal_use_depth_clamping)
         glDisable(GL_DEPTH_CLAMP);
 #endif
-    glClear(GL_DEPTH_BUFFER_BIT);
+#ifndef OPENGL_ES2
+    if (cache_slot == NULL && !use_atlas)
+#endif
+        glClear(GL_DEPTH_BUFFER_BIT);
     if (light.type & SRE_LIGHT_BEAM) {
     // Use an orthogonal transformation matrix for beam lights.
         Vector3D dim_min, dim_max;
@@ -620,13 +1112,24 @@ void RenderSpotOrBeamLightShadowMap(sreScene *scene, const sreLight& light, cons
         GL3InitializeSpotlightShadowMapShadersBeforeLight();
     }
 
-    RenderShadowMapFromCasterArray(scene, light);
-
-    if (sre_internal_HDR_enabled)
-        glBindFramebuffer(GL_FRAMEBUFFER, sre_internal_HDR_multisample_framebuffer);
+#ifndef OPENGL_ES2
+    if (cache_slot != NULL)
+        RenderCachedShadowMap(scene, light, cache_slot, cache_result, 1);
     else
-        glBindFramebuffer(GL_FRAMEBUFFER, 0);
-    glViewport(0, 0, sre_internal_window_width, sre_internal_window_height);
+#endif
+        RenderShadowMapFromCasterArray(scene, light);
+
+#ifndef OPENGL_ES2
+    // During the atlas pass, the atlas stays bound for the next light.
+    if (!atlas_pass)
+#endif
+    {
+        if (sre_internal_HDR_enabled)
+            glBindFramebuffer(GL_FRAMEBUFFER, sre_internal_HDR_multisample_framebuffer);
+        else
+            glBindFramebuffer(GL_FRAMEBUFFER, 0);
+        glViewport(0, 0, sre_internal_window_width, sre_internal_window_height);
+    }
     glCullFace(GL_BACK);
     glEnable(GL_CULL_FACE);
 #if !defined(NO_DEPTH_CLAMP)
@@ -670,6 +1173,10 @@ static Vector3D cube_map_t_vector[6] = {
     };
 #endif
 
+// The framebuffers of the faces of the most recently rendered cube shadow map, used
+// for visualization.
+static SRE_GLUINT *current_cube_map_framebuffer = NULL;
+
 static void BindAndClearCubeMap(int i) {
 #ifdef OPENGL_ES2
     glBindFramebuffer(GL_FRAMEBUFFER, sre_internal_cube_shadow_map_framebuffer[
@@ -684,6 +1191,89 @@ static void BindAndClearCubeMap(int i) {
     sre_internal_depth_cube_map_texture_is_clear[sre_internal_current_cube_shadow_map_index][i] = true;
 }
 
+#ifndef OPENGL_ES2
+
+// Render the shadow casters into a shadow map (or one cube map segment) with the current
+// shadow map matrix settings.
+
+static void RenderShadowMapSegment(sreScene *scene, const sreLight& light, int type, int i) {
+    if (type == SRE_SHADOW_MAP_CACHE_SLOT_CUBE) {
+        GL3CalculateCubeShadowMapMatrix(light.vector.GetVector3D(), cube_map_zdir[i],
+            cube_map_s_vector[i], cube_map_t_vector[i], min_segment_depth, light.attenuation.x);
+        RenderCubeShadowMapFromCasterArray(scene, light, i);
+    }
+    else
+        RenderShadowMapFromCasterArray(scene, light);
+}
+
+// Update a persistent shadow map according to the result of CheckShadowMapCacheSlot().
+// Only the segments in segment_mask (bit 0 for a regular shadow map) contain shadow
+// casters; the other segments are just cleared.
+
+static void RenderCachedShadowMap(sreScene *scene, const sreLight& light,
+sreShadowMapCacheSlot *slot, int cache_result, int segment_mask) {
+    if (cache_result == SHADOW_MAP_CACHE_HIT)
+        return;
+    int nu_segments = (slot->type == SRE_SHADOW_MAP_CACHE_SLOT_CUBE) ? 6 : 1;
+    if (slot->static_texture != 0) {
+        if (cache_result == SHADOW_MAP_CACHE_RENDER_ALL) {
+            rendered_shadow_casters = RENDER_STATIC_SHADOW_CASTERS;
+            for (int i = 0; i < nu_segments; i++) {
+                glBindFramebuffer(GL_DRAW_FRAMEBUFFER, slot->static_framebuffer[i]);
+                glClear(GL_DEPTH_BUFFER_BIT);
+                if (segment_mask & (1 << i))
+                    RenderShadowMapSegment(scene, light, slot->type, i);
+            }
+        }
+        // Draw the dynamic shadow casters on top of a copy of the static layer.
+        sreCopyShadowMapCacheStaticLayer(slot);
+        rendered_shadow_casters = RENDER_DYNAMIC_SHADOW_CASTERS;
+        for (int i = 0; i < nu_segments; i++)
+            if (segment_mask & (1 << i)) {
+                glBindFramebuffer(GL_DRAW_FRAMEBUFFER, slot->framebuffer[i]);
+                RenderShadowMapSegment(scene, light, slot->type, i);
+            }
+        rendered_shadow_casters = RENDER_ALL_SHADOW_CASTERS;
+    }
+    else
+        for (int i = 0; i < nu_segments; i++) {
+            glBindFramebuffer(GL_DRAW_FRAMEBUFFER, slot->framebuffer[i]);
+            glClear(GL_DEPTH_BUFFER_BIT);
+            if (segment_mask & (1 << i))
+                RenderShadowMapSegment(scene, light, slot->type, i);
+        }
+    CHECK_GL_ERROR("Error after RenderCachedShadowMap\n");
+}
+
+// Render all faces of the current shared cube shadow map in a single pass using the
+// layered framebuffer. Only the faces in face_mask contain relevant shadow casters.
+
+static void RenderLayeredCubeShadowMap(sreScene *scene, const sreLight& light, int face_mask) {
+    int index = sre_internal_current_cube_shadow_map_index;
+    glBindFramebuffer(GL_DRAW_FRAMEBUFFER, sre_internal_cube_shadow_map_layered_framebuffer[index]);
+    // Clearing the layered framebuffer clears all faces.
+    for (int i = 0; i < 6; i++)
+        if (!sre_internal_depth_cube_map_texture_is_clear[index][i]) {
+            glClear(GL_DEPTH_BUFFER_BIT);
+            break;
+        }
+    for (int i = 0; i < 6; i++)
+        sre_internal_depth_cube_map_texture_is_clear[index][i] = ((face_mask & (1 << i)) == 0);
+    if (face_mask == 0)
+        return;
+    Matrix4D face_matrix[6];
+    for (int i = 0; i < 6; i++) {
+        GL3CalculateCubeShadowMapMatrix(light.vector.GetVector3D(), cube_map_zdir[i],
+            cube_map_s_vector[i], cube_map_t_vector[i], min_segment_depth, light.attenuation.x);
+        face_matrix[i] = cube_shadow_map_matrix;
+    }
+    GL3InitializeLayeredCubeShadowMapShadersWithFaceMatrices(face_matrix);
+    RenderLayeredCubeShadowMapFromCasterArray(scene, light, face_mask);
+    CHECK_GL_ERROR("Error after RenderLayeredCubeShadowMap\n");
+}
+
+#endif
+
 void RenderPointLightShadowMap(sreScene *scene, const sreLight& light, const sreFrustum &frustum) {
 //    sreMessage(SRE_MESSAGE_LOG, "Rendering cube shadow map for point light %d.", light.id);
         // Using front-face culling (only drawing back faces) reduces shadow map artifacts.
@@ -750,6 +1340,24 @@ void RenderPointLightShadowMap(sreScene *scene, const sreLight& light, const sre
 //        sreMessage(SRE_MESSAGE_INFO, "min_segment_depth = %f", min_segment_depth);
         min_segment_depth = maxf(min_segment_depth, SRE_MIN_SHADOW_CUBE_MAP_NEAR_PLANE_DISTANCE);
 
+#ifndef OPENGL_ES2
+        sreShadowMapCacheSlot *cache_slot = NULL;
+        int cache_result;
+        if (sre_internal_shadow_map_cache_mode != SRE_SHADOW_MAP_CACHE_DISABLED) {
+            // Use the persistent cube shadow map of the light.
+            cache_slot = sreGetShadowMapCacheSlot(scene, light, SRE_SHADOW_MAP_CACHE_SLOT_CUBE,
+                sre_internal_current_cube_shadow_map_index);
+            if (cache_slot->level != sre_internal_current_cube_shadow_map_index) {
+                sre_internal_current_cube_shadow_map_index = cache_slot->level;
+                glViewport(0, 0,
+                    sre_internal_max_cube_shadow_map_size >> cache_slot->level,
+                    sre_internal_max_cube_shadow_map_size >> cache_slot->level);
+            }
+            cache_result = CheckShadowMapCacheSlot(scene, light, cache_slot, min_segment_depth);
+            // Keep using the near plane distance with which the shadow map was rendered.
+            min_segment_depth = cache_slot->near_plane_distance;
+        }
+#endif
         sreUpdateShadowMapNearPlaneDistance(min_segment_depth);
 #ifdef CUBE_MAP_STORES_DISTANCE
         // In the new shadow map method, the distance scaling is the same for all segments
@@ -759,6 +1367,29 @@ void RenderPointLightShadowMap(sreScene *scene, const sreLight& light, const sre
 #endif
         GL3InitializeCubeShadowMapShadersBeforeLight();
 
+#ifndef OPENGL_ES2
+    if (cache_slot != NULL) {
+        // The shadow map may be reused from a different viewpoint, so the segments
+        // are not skipped based on the shadow receivers.
+        RenderCachedShadowMap(scene, light, cache_slot, cache_result, segment_non_empty_mask);
+        sre_internal_current_depth_cube_map_texture = cache_slot->texture;
+        current_cube_map_framebuffer = &cache_slot->framebuffer[0];
+    }
+    else if (sre_internal_layered_cube_shadow_maps) {
+        // Determine the segments to render using the same criteria as the per-face path.
+        int face_mask = 0;
+        for (int i = 0; i < 6; i++)
+            if ((segment_non_empty_mask & (1 << i)) && !(zmax[i] <= 0 || zmax_casters[i] <= 0 ||
+            zmin_casters[i] > zmax[i]))
+                face_mask |= 1 << i;
+        RenderLayeredCubeShadowMap(scene, light, face_mask);
+        sre_internal_current_depth_cube_map_texture = sre_internal_depth_cube_map_texture[
+            sre_internal_current_cube_shadow_map_index];
+        current_cube_map_framebuffer = &sre_internal_cube_shadow_map_framebuffer[
+            sre_internal_current_cube_shadow_map_index][0];
+    }
+    else {
+#endif
         int cube_map_mask = 0;
         for (int i = 0; i < 6; i++) {
             // Bind the framebuffer with correct cube face and clear the cube map segment.
@@ -796,6 +1427,8 @@ void RenderPointLightShadowMap(sreScene *scene, const sreLight& light, const sre
 #if 1
     sre_internal_current_depth_cube_map_texture = sre_internal_depth_cube_map_texture[
         sre_internal_current_cube_shadow_map_index];
+    current_cube_map_framebuffer = &sre_internal_cube_shadow_map_framebuffer[
+        sre_internal_current_cube_shadow_map_index][0];
 #else
     // When all faces are used, just use the pre-initialized cubemap with all six faces.
     // Otherwise, only use the non-empty cube-map faces and use a small, light-weight
@@ -811,6 +1444,9 @@ void RenderPointLightShadowMap(sreScene *scene, const sreLight& light, const sre
             // To do.
     }
 #endif
+#ifndef OPENGL_ES2
+    }
+#endif
 
     // Restore framebuffer, viewport and other GL state parameters.
     if (sre_internal_HDR_enabled)
@@ -829,7 +1465,314 @@ void RenderPointLightShadowMap(sreScene *scene, const sreLight& light, const sre
     return;
 }
 
+// Check whether any of the shadow casters of a cascade has moved or changed its
+// transformation since the given frame.
+
+static bool CascadeCastersChanged(sreScene *scene, int i, int frame) {
+    unsigned int cascade_bit = (unsigned int)1 << (26 + i);
+    for (int j = 0; j < current_shadow_caster_array->Size(); j++) {
+        unsigned int entry = current_shadow_caster_array->Get(j);
+        if (!(entry & cascade_bit))
+            continue;
+        sreObject *so = scene->object[entry & 0x03FFFFFF];
+        if (so->most_recent_position_change >= frame ||
+        so->most_recent_transformation_change >= frame)
+            return true;
+    }
+    return false;
+}
+
+// Check whether the contents of the shadow map tile of a cascade are still valid.
+
+static bool CascadeIsCached(sreScene *scene, const sreLight& light, int i) {
+    const sreShadowMapCascadeCacheEntry& entry = cascade_cache[i];
+    if (!entry.valid || entry.light_id != light.id || entry.nu_cascades != nu_cascades ||
+    entry.shadow_map_size != sre_internal_max_shadow_map_size ||
+    entry.light_direction.x != cascade_light_vector.x ||
+    entry.light_direction.y != cascade_light_vector.y ||
+    entry.light_direction.z != cascade_light_vector.z)
+        return false;
+    const sreShadowMapCascade& c = entry.cascade;
+    if (c.x_min != cascade[i].x_min || c.y_min != cascade[i].y_min ||
+    c.size != cascade[i].size || c.z_min != cascade[i].z_min || c.z_max != cascade[i].z_max ||
+    c.nu_casters != cascade[i].nu_casters || c.caster_hash != cascade[i].caster_hash)
+        return false;
+    return !CascadeCastersChanged(scene, i, entry.frame);
+}
+
+static void CalculateCascadeShadowMapMatrix(int i) {
+    const sreShadowMapCascade& c = cascade[i];
+    // Place the shadow map camera at the top of the cascade in the light direction; since
+    // the x and y axes are perpendicular to the light vector, the cascade's x and y extents
+    // can be used directly.
+    GL3CalculateShadowMapMatrix(cascade_light_vector * c.z_max, - cascade_light_vector,
+        cascade_x_dir, cascade_y_dir, Vector3D(c.x_min, c.y_min, 0),
+        Vector3D(c.x_min + c.size, c.y_min + c.size, c.z_max - c.z_min));
+}
+
+// Render the cascades of a directional light into the tiles of the largest shadow map,
+// which must already be bound. Cascades 0 to 3 occupy the lower-left, lower-right,
+// upper-left and upper-right quadrants.
+
+static void RenderShadowMapCascades(sreScene *scene, const sreLight& light) {
+    int tile_size = sre_internal_max_shadow_map_size / 2;
+    for (int i = 0; i < nu_cascades; i++)
+        // Extend the cascade towards the light so that it includes all of its casters.
+        if (cascade[i].caster_z_max > cascade[i].z_max) {
+            float texel_size = cascade[i].size / tile_size;
+            cascade[i].z_max = ceilf(cascade[i].caster_z_max / texel_size) * texel_size;
+        }
+    glEnable(GL_SCISSOR_TEST);
+    for (int i = 0; i < nu_cascades; i++) {
+        if (CascadeIsCached(scene, light, i))
+            continue;
+        int x = (i & 1) * tile_size;
+        int y = (i >> 1) * tile_size;
+        glViewport(x, y, tile_size, tile_size);
+        glScissor(x, y, tile_size, tile_size);
+        glClear(GL_DEPTH_BUFFER_BIT);
+        CalculateCascadeShadowMapMatrix(i);
+        GL3InitializeShadowMapShadersBeforeLight(Vector4D(cascade[i].size, cascade[i].size,
+            cascade[i].z_max - cascade[i].z_min, tile_size));
+        RenderCascadeShadowMapFromCasterArray(scene, light, i);
+        sreShadowMapCascadeCacheEntry& entry = cascade_cache[i];
+        entry.valid = true;
+        entry.light_id = light.id;
+        entry.light_direction = cascade_light_vector;
+        entry.nu_cascades = nu_cascades;
+        entry.shadow_map_size = sre_internal_max_shadow_map_size;
+        entry.cascade = cascade[i];
+        entry.frame = sre_internal_current_frame;
+    }
+    glDisable(GL_SCISSOR_TEST);
+    CHECK_GL_ERROR("Error after rendering shadow map cascades.\n");
+
+    // The lighting pass shaders use the shadow map matrix of the first cascade, and
+    // derive the coordinates within the other cascades from it.
+    CalculateCascadeShadowMapMatrix(0);
+    float depth0 = cascade[0].z_max - cascade[0].z_min;
+    sre_internal_current_shadow_map_dimensions = Vector3D(cascade[0].size, cascade[0].size,
+        depth0);
+    sre_internal_shadow_map_cascade_parameters[0] = nu_cascades;
+    for (int i = 0; i < nu_cascades; i++) {
+        float *p = &sre_internal_shadow_map_cascade_parameters[1 + i * 6];
+        float depth = cascade[i].z_max - cascade[i].z_min;
+        p[0] = p[1] = cascade[0].size / cascade[i].size;
+        p[2] = depth0 / depth;
+        p[3] = (cascade[0].x_min - cascade[i].x_min) / cascade[i].size;
+        p[4] = (cascade[0].y_min - cascade[i].y_min) / cascade[i].size;
+        p[5] = (cascade[i].z_max - cascade[0].z_max) / depth;
+    }
+}
+
+static void RestoreStateAfterDirectionalLightShadowMap() {
+    // Switch back to default framebuffer.
+    if (sre_internal_HDR_enabled)
+        glBindFramebuffer(GL_FRAMEBUFFER, sre_internal_HDR_multisample_framebuffer);
+    else
+        glBindFramebuffer(GL_FRAMEBUFFER, 0);
+    glColorMask(GL_TRUE, GL_TRUE, GL_TRUE, GL_TRUE);
+    glViewport(0, 0, sre_internal_window_width, sre_internal_window_height);
+    glCullFace(GL_BACK);
+    glEnable(GL_CULL_FACE);
+#if !defined(NO_DEPTH_CLAMP)
+    // Restore the normal setting.
+    if (sre_internal_use_depth_clamping)
+        glEnable(GL_DEPTH_CLAMP);
+#endif
+}
+
+// Shadow caster determination.
+
+// Calculate the shadow caster volume for a light and store it in the shadow caster set.
+
+static void CalculateShadowCasterVolume(sreShadowCasterSet& set, sreFrustum& frustum,
+const sreLight& light) {
+    frustum.CalculateShadowCasterVolume(light.vector, 6);
+    set.shadow_caster_volume.nu_planes = frustum.shadow_caster_volume.nu_planes;
+    for (int i = 0; i < frustum.shadow_caster_volume.nu_planes; i++)
+        set.shadow_caster_volume.plane[i] = frustum.shadow_caster_volume.plane[i];
+}
+
+// Find all potential shadow casters for a light, and the AABBs of the shadow casters and
+// receivers. The shadow caster volume must already have been calculated. No OpenGL calls
+// are made and no global state is modified, so that this function can be run by worker
+// threads for different lights at the same time.
+
+static void DetermineShadowCasters(sreScene *scene, const sreLight& light,
+sreShadowCasterSet& set) {
+    set.caster_array->Truncate(0);
+    sreShadowAABBGenerationInfo AABB_generation_info;
+    AABB_generation_info.Initialize();
+    if (!(light.type & SRE_LIGHT_DIRECTIONAL)) {
+        // Point light, spot light or beam light.
+        // Find the AABB for all potential shadow casters and receivers within the range of the light.
+        CalculateCubeSegmentHulls(set, light);
+        set.min_segment_depth = FLT_MAX;
+        set.segment_non_empty_mask = 0;
+        // Note: infinite distance objects do not cast shadows, their octrees can be skipped.
+        FindAABBLocalLight(AABB_generation_info,
+            scene->fast_octree_static, 0, scene, set, light, SRE_BOUNDS_UNDEFINED);
+        // Since the dynamic object octree has no bounds, disable octree bounds checking.
+        FindAABBLocalLight(AABB_generation_info,
+            scene->fast_octree_dynamic, 0, scene, set, light, SRE_BOUNDS_DO_NOT_CHECK);
+        if (scene->dynamic_object_bvh != NULL && scene->dynamic_object_bvh->nu_nodes > 0)
+            FindAABBLocalLight(AABB_generation_info, *scene->dynamic_object_bvh, 0, scene,
+                set, light, SRE_BOUNDS_UNDEFINED);
+    }
+    else {
+        // Calculate AABB of the objects in the shadow casters and shadow receivers volumes.
+        // Note: infinite distance objects do not cast shadows, their octrees can be skipped.
+        FindAABBDirectionalLight(AABB_generation_info,
+            scene->fast_octree_static, 0, scene, set, SRE_BOUNDS_UNDEFINED);
+        FindAABBDirectionalLight(AABB_generation_info,
+            scene->fast_octree_dynamic, 0, scene, set, SRE_BOUNDS_DO_NOT_CHECK);
+        if (scene->dynamic_object_bvh != NULL && scene->dynamic_object_bvh->nu_nodes > 0)
+            FindAABBDirectionalLight(AABB_generation_info, *scene->dynamic_object_bvh, 0, scene,
+                set, SRE_BOUNDS_UNDEFINED);
+    }
+    AABB_generation_info.GetCasters(set.AABB_shadow_caster);
+    AABB_generation_info.GetReceivers(set.AABB_shadow_receiver);
+}
+
+// Set used when the shadow casters are determined just before the shadow map is rendered;
+// it uses the scene's shadow caster array.
+static sreShadowCasterSet scene_shadow_caster_set;
+
+// Sets determined in advance for the active lights of the current frame, each with its
+// own caster array.
+static sreShadowCasterSet *shadow_caster_set = NULL;
+static int nu_shadow_caster_sets = 0;
+static const sreFrustum *shadow_caster_set_frustum = NULL;
+
+static sreShadowCasterSet *FindShadowCasterSet(const sreLight& light, const sreFrustum& frustum) {
+    if (&frustum != shadow_caster_set_frustum)
+        return NULL;
+    for (int i = 0; i < nu_shadow_caster_sets; i++)
+        if (shadow_caster_set[i].light_index == light.id &&
+        shadow_caster_set[i].frame == sre_internal_current_frame)
+            return &shadow_caster_set[i];
+    return NULL;
+}
+
+static void DetermineShadowCastersJob(void *data, int job_index, int thread_index) {
+    sreScene *scene = (sreScene *)data;
+    sreShadowCasterSet& set = shadow_caster_set[job_index];
+    DetermineShadowCasters(scene, *scene->light[set.light_index], set);
+}
+
+// Determine the shadow casters of all active lights of the scene in advance using the
+// worker threads, so that the rendering thread only has to render the shadow maps. The
+// shadow caster volumes are calculated in the rendering thread because they are stored
+// in the frustum. Directional lights with shadow map cascades are skipped because the
+// cascade state is shared; they are handled when the shadow map is rendered.
+
+void sreDetermineShadowCastersForActiveLights(sreScene *scene, sreFrustum& frustum) {
+    nu_shadow_caster_sets = 0;
+    if (!(sre_internal_rendering_flags & SRE_RENDERING_FLAG_MULTI_THREADED_SHADOW_MAPS) ||
+    sre_internal_shadows != SRE_SHADOWS_SHADOW_MAPPING ||
+    scene->nu_active_lights < 2 || sreGetThreadPoolSize() < 2)
+        return;
+    if (shadow_caster_set == NULL)
+        shadow_caster_set = new sreShadowCasterSet[SRE_MAX_ACTIVE_LIGHTS];
+    int n = 0;
+    for (int i = 0; i < scene->nu_active_lights; i++) {
+        int light_index;
+        if (scene->nu_active_lights == scene->visible_light_array.Size())
+            light_index = scene->visible_light_array.Get(i);
+        else
+            light_index = scene->active_light[i];
+        const sreLight& light = *scene->light[light_index];
+        if (light.type & SRE_LIGHT_POINT_SOURCE) {
+            if (!(sre_internal_rendering_flags & SRE_RENDERING_FLAG_CUBE_SHADOW_MAP_SUPPORT))
+                continue;
+        }
+        else if (!(sre_internal_rendering_flags & SRE_RENDERING_FLAG_SHADOW_MAP_SUPPORT))
+            continue;
+        if ((light.type & SRE_LIGHT_DIRECTIONAL) && sre_internal_shadow_map_cascades > 1)
+            continue;
+        // Skip lights that will be skipped by the lighting pass.
+        if ((light.type & SRE_LIGHT_DYNAMIC_LIGHT_VOLUME) &&
+        sre_internal_current_frame > frustum.most_recent_frame_changed &&
+        !Intersects(light, frustum.frustum_world))
+            continue;
+        sreShadowCasterSet& set = shadow_caster_set[n];
+        if (set.caster_array == NULL)
+            set.caster_array = new dstIntArray;
+        set.light_index = light_index;
+        set.frame = sre_internal_current_frame;
+        set.cascaded = false;
+        CalculateShadowCasterVolume(set, frustum, light);
+        n++;
+    }
+    sreRunThreadPoolJobs(DetermineShadowCastersJob, scene, n);
+    nu_shadow_caster_sets = n;
+    shadow_caster_set_frustum = &frustum;
+}
+
+// Free the shadow caster sets determined in advance, including their caster arrays.
+
+void sreFreeShadowCasterSets() {
+    if (shadow_caster_set == NULL)
+        return;
+    for (int i = 0; i < SRE_MAX_ACTIVE_LIGHTS; i++)
+        delete shadow_caster_set[i].caster_array;
+    delete [] shadow_caster_set;
+    shadow_caster_set = NULL;
+    nu_shadow_caster_sets = 0;
+    shadow_caster_set_frustum = NULL;
+}
+
+#ifndef OPENGL_ES2
+
+// Spot and beam light shadow maps that were rendered into the shadow map atlas in advance,
+// indexed by light id, with the state that the lighting pass of the light requires.
+
+class sreAtlasShadowMap {
+public :
+    int frame;
+    bool result;
+    bool shadow_map_required;
+    int shadow_map_index;
+    int tile_size;
+    float tile_parameters[3];
+    Vector3D dimensions;
+    MatrixTransform lighting_pass_matrix;
+    Matrix4D projection_lighting_pass_matrix;
+};
+
+static sreAtlasShadowMap *atlas_shadow_map = NULL;
+static int max_atlas_shadow_maps = 0;
+
+static bool AtlasShadowMapRendered(const sreLight& light) {
+    return !atlas_pass && light.id < max_atlas_shadow_maps &&
+        atlas_shadow_map[light.id].frame == sre_internal_current_frame;
+}
+
+static bool RestoreAtlasShadowMap(sreLight& light) {
+    const sreAtlasShadowMap& a = atlas_shadow_map[light.id];
+    light.shadow_map_required = a.shadow_map_required;
+    if (a.shadow_map_required) {
+        sre_internal_current_shadow_map_texture = sre_internal_shadow_map_atlas_texture;
+        sre_internal_current_shadow_map_index = a.shadow_map_index;
+        sre_internal_current_shadow_map_atlas_tile_size = a.tile_size;
+        memcpy(sre_internal_shadow_map_atlas_tile_parameters, a.tile_parameters,
+            sizeof(sre_internal_shadow_map_atlas_tile_parameters));
+        sre_internal_current_shadow_map_dimensions = a.dimensions;
+        shadow_map_lighting_pass_matrix = a.lighting_pass_matrix;
+        projection_shadow_map_lighting_pass_matrix = a.projection_lighting_pass_matrix;
+    }
+    return a.result;
+}
+
+#endif
+
 bool GL3RenderShadowMapWithOctree(sreScene *scene, sreLight& light, sreFrustum &frustum) {
+#ifndef OPENGL_ES2
+    // Use the shadow map that was rendered into the atlas at the start of the lighting passes.
+    if (AtlasShadowMapRendered(light))
+        return RestoreAtlasShadowMap(light);
+#endif
     // Check whether the the required shadow map technique is available.
     if (((light.type & SRE_LIGHT_POINT_SOURCE) &&
     !(sre_internal_rendering_flags & SRE_RENDERING_FLAG_CUBE_SHADOW_MAP_SUPPORT)) ||
@@ -839,28 +1782,32 @@ bool GL3RenderShadowMapWithOctree(sreScene *scene, sreLight& light, sreFrustum &
         return true;
     }
 
-    // Calculate shadow caster volume.
-    frustum.CalculateShadowCasterVolume(light.vector, 6);
-    scene->shadow_caster_array.Truncate(0);
     // This flag will be set to false when a shadow map is actually not needed for the light.
     light.shadow_map_required = true;
 
+    if (light.type & SRE_LIGHT_DIRECTIONAL) {
+        // The cascade extents are needed to determine the cascades of each shadow caster.
+        nu_cascades = sre_internal_shadow_map_cascades;
+        if (nu_cascades > 1)
+            CalculateShadowMapCascades(light, frustum);
+    }
+    // Use the shadow casters determined in advance when available.
+    sreShadowCasterSet *set = FindShadowCasterSet(light, frustum);
+    if (set == NULL) {
+        set = &scene_shadow_caster_set;
+        set->caster_array = &scene->shadow_caster_array;
+        set->cascaded = (light.type & SRE_LIGHT_DIRECTIONAL) && nu_cascades > 1;
+        CalculateShadowCasterVolume(*set, frustum, light);
+        DetermineShadowCasters(scene, light, *set);
+    }
+    current_shadow_caster_array = set->caster_array;
+    AABB_shadow_caster = set->AABB_shadow_caster;
+    AABB_shadow_receiver = set->AABB_shadow_receiver;
+
     if (!(light.type & SRE_LIGHT_DIRECTIONAL)) {
         // Point light, spot light or beam light.
-        // Find the AABB for all potential shadow casters and receivers within the range of the light.
-        sreShadowAABBGenerationInfo AABB_generation_info;
-        AABB_generation_info.Initialize();
-        CalculateCubeSegmentHulls(light);
-        min_segment_depth = FLT_MAX;
-        segment_non_empty_mask = 0;
-        // Note: infinite distance objects do not cast shadows, their octrees can be skipped.
-        FindAABBLocalLight(AABB_generation_info,
-            scene->fast_octree_static, 0, scene, frustum, light, SRE_BOUNDS_UNDEFINED);
-        // Since the dynamic object octree has no bounds, disable octree bounds checking.
-        FindAABBLocalLight(AABB_generation_info,
-            scene->fast_octree_dynamic, 0, scene, frustum, light, SRE_BOUNDS_DO_NOT_CHECK);
-        AABB_generation_info.GetCasters(AABB_shadow_caster);
-        AABB_generation_info.GetReceivers(AABB_shadow_receiver);
+        min_segment_depth = set->min_segment_depth;
+        segment_non_empty_mask = set->segment_non_empty_mask;
         if (AABB_shadow_caster.dim_min.x == FLT_MAX ||
         AABB_shadow_receiver.dim_min.x == FLT_MAX ||
         !Intersects(AABB_shadow_receiver, frustum.frustum_world)) {
@@ -902,16 +1849,6 @@ bool GL3RenderShadowMapWithOctree(sreScene *scene, sreLight& light, sreFrustum &
     }
 
     // Directional light.
-    // Calculate AABB of the objects in the shadow casters and shadow receivers volumes.
-    sreShadowAABBGenerationInfo AABB_generation_info;
-    AABB_generation_info.Initialize();
-    // Note: infinite distance objects do not cast shadows, their octrees can be skipped.
-    FindAABBDirectionalLight(AABB_generation_info,
-        scene->fast_octree_static, 0, scene, frustum, SRE_BOUNDS_UNDEFINED);
-    FindAABBDirectionalLight(AABB_generation_info,
-        scene->fast_octree_dynamic, 0, scene, frustum, SRE_BOUNDS_DO_NOT_CHECK);
-    AABB_generation_info.GetCasters(AABB_shadow_caster);
-    AABB_generation_info.GetReceivers(AABB_shadow_receiver);
     if (AABB_shadow_caster.dim_min.x == FLT_MAX ||
     AABB_shadow_receiver.dim_min.x == FLT_MAX ||
     !Intersects(AABB_shadow_receiver, frustum.frustum_world)) {
@@ -928,6 +1865,7 @@ bool GL3RenderShadowMapWithOctree(sreScene *scene, sreLight& light, sreFrustum &
     // At this point, there will be a shadow map, so we can initialize the shadow map
     // in already. Always use the largest shadow map (level 0) for directional lights.
     sre_internal_current_shadow_map_index = 0;
+    sre_internal_current_shadow_map_texture = sre_internal_depth_texture[0];
     glViewport(0, 0,
         sre_internal_max_shadow_map_size >> sre_internal_current_shadow_map_index,
         sre_internal_max_shadow_map_size >> sre_internal_current_shadow_map_index);
@@ -952,6 +1890,14 @@ bool GL3RenderShadowMapWithOctree(sreScene *scene, sreLight& light, sreFrustum &
         glDisable(GL_DEPTH_CLAMP);
 #endif
     glColorMask(GL_FALSE, GL_FALSE, GL_FALSE, GL_FALSE);
+    if (nu_cascades > 1) {
+        RenderShadowMapCascades(scene, light);
+        RestoreStateAfterDirectionalLightShadowMap();
+        return true;
+    }
+    // The shadow map is overwritten, so that any cascades stored in it are lost.
+    InvalidateShadowMapCascadeCache();
+    ResetShadowMapCascadeParameters();
     glClear(GL_DEPTH_BUFFER_BIT);
 
     // Clip the shadow receivers AABB against the AABB of the view frustum (including far plane).
@@ -1176,21 +2122,84 @@ printf("AABB = (%f, %f, %f) - (%f, %f, %f)\n", AABB.dim_min.x, AABB.dim_min.y, A
     CHECK_GL_ERROR("Error after GL3InitializeShadowMapShadersBeforeLight.\n");
     RenderShadowMapFromCasterArray(scene, light);
 
-    // Switch back to default framebuffer.
+    RestoreStateAfterDirectionalLightShadowMap();
+    return true;
+}
+
+// Render the shadow maps of all active spot and beam lights into the shadow map atlas
+// before the lighting passes, so that the atlas is bound and cleared only once per frame.
+// GL3RenderShadowMapWithOctree() then only restores the state of the shadow map for the
+// lighting pass. When the atlas is full, the remaining lights are skipped here and their
+// shadow maps are rendered just before their lighting pass. Only used when the shadow map
+// atlas is enabled and the persistent shadow map cache is not.
+
+void sreRenderShadowMapAtlas(sreScene *scene, sreFrustum& frustum) {
+#ifndef OPENGL_ES2
+    if (sre_internal_shadow_map_atlas_size == 0 ||
+    sre_internal_shadow_map_cache_mode != SRE_SHADOW_MAP_CACHE_DISABLED ||
+    sre_internal_shadows != SRE_SHADOWS_SHADOW_MAPPING ||
+    !(sre_internal_rendering_flags & SRE_RENDERING_FLAG_SHADOW_MAP_SUPPORT))
+        return;
+    if (max_atlas_shadow_maps < scene->nu_lights) {
+        delete [] atlas_shadow_map;
+        max_atlas_shadow_maps = scene->nu_lights;
+        atlas_shadow_map = new sreAtlasShadowMap[max_atlas_shadow_maps];
+    }
+    for (int i = 0; i < max_atlas_shadow_maps; i++)
+        atlas_shadow_map[i].frame = - 1;
+    bool atlas_bound = false;
+    for (int i = 0; i < scene->nu_active_lights; i++) {
+        int light_index;
+        if (scene->nu_active_lights == scene->visible_light_array.Size())
+            light_index = scene->visible_light_array.Get(i);
+        else
+            light_index = scene->active_light[i];
+        sreLight& light = *scene->light[light_index];
+        if (!(light.type & (SRE_LIGHT_SPOT | SRE_LIGHT_BEAM)))
+            continue;
+        // Skip lights that will be skipped by the lighting pass.
+        if ((light.type & SRE_LIGHT_DYNAMIC_LIGHT_VOLUME) &&
+        sre_internal_current_frame > frustum.most_recent_frame_changed &&
+        !Intersects(light, frustum.frustum_world))
+            continue;
+        if (!atlas_bound) {
+            glDisable(GL_SCISSOR_TEST);
+#ifndef NO_DEPTH_BOUNDS
+            if (GLEW_EXT_depth_bounds_test)
+                glDepthBoundsEXT(0, 1.0f);
+#endif
+            glDisable(GL_BLEND);
+            glDepthMask(GL_TRUE);
+            sreBeginShadowMapAtlas();
+            atlas_bound = true;
+        }
+        else if (sreShadowMapAtlasIsFull())
+            break;
+        sreProfilerScope scope(SRE_PROFILE_SHADOW_MAP, light_index);
+        atlas_pass = true;
+        bool r = GL3RenderShadowMapWithOctree(scene, light, frustum);
+        atlas_pass = false;
+        sreAtlasShadowMap& a = atlas_shadow_map[light.id];
+        a.frame = sre_internal_current_frame;
+        a.result = r;
+        a.shadow_map_required = light.shadow_map_required;
+        a.shadow_map_index = sre_internal_current_shadow_map_index;
+        a.tile_size = sre_internal_current_shadow_map_atlas_tile_size;
+        memcpy(a.tile_parameters, sre_internal_shadow_map_atlas_tile_parameters,
+            sizeof(a.tile_parameters));
+        a.dimensions = sre_internal_current_shadow_map_dimensions;
+        a.lighting_pass_matrix = shadow_map_lighting_pass_matrix;
+        a.projection_lighting_pass_matrix = projection_shadow_map_lighting_pass_matrix;
+    }
+    if (!atlas_bound)
+        return;
     if (sre_internal_HDR_enabled)
         glBindFramebuffer(GL_FRAMEBUFFER, sre_internal_HDR_multisample_framebuffer);
     else
         glBindFramebuffer(GL_FRAMEBUFFER, 0);
-    glColorMask(GL_TRUE, GL_TRUE, GL_TRUE, GL_TRUE);
     glViewport(0, 0, sre_internal_window_width, sre_internal_window_height);
-    glCullFace(GL_BACK);
-    glEnable(GL_CULL_FACE);
-#if !defined(NO_DEPTH_CLAMP)
-    // Restore the normal setting.
-    if (sre_internal_use_depth_clamping)
-        glEnable(GL_DEPTH_CLAMP);
+    glDepthMask(GL_FALSE);
 #endif
-    return true;
 }
 
 
@@ -1275,7 +2284,7 @@ static Vector4D shadow_map_visualization_colors[2] = {
 void sreVisualizeDirectionalLightShadowMap(int light_index) {
     // Set the source to the shadow map texture.
     sreSetImageSource(SRE_IMAGE_SET_TEXTURE | SRE_IMAGE_SET_ONE_COMPONENT_SOURCE,
-        sre_internal_depth_texture[sre_internal_current_shadow_map_index], 0);
+        sre_internal_current_shadow_map_texture, 0);
     // Set the colors and the default texture coordinate transform (NULL).
     sreSetImageParameters(SRE_IMAGE_SET_COLORS | SRE_IMAGE_SET_TRANSFORM,
         shadow_map_visualization_colors, NULL);
@@ -1291,7 +2300,7 @@ static Vector4D spotlight_shadow_map_visualization_colors[2] = {
 void sreVisualizeBeamOrSpotLightShadowMap(int light_index) {
     // Set the source to the shadow map texture.
     sreSetImageSource(SRE_IMAGE_SET_TEXTURE | SRE_IMAGE_SET_ONE_COMPONENT_SOURCE,
-        sre_internal_depth_texture[sre_internal_current_shadow_map_index], 0);
+        sre_internal_current_shadow_map_texture, 0);
     // Set the colors and the default texture coordinate transform (NULL).
     sreSetImageParameters(SRE_IMAGE_SET_COLORS | SRE_IMAGE_SET_TRANSFORM,
         spotlight_shadow_map_visualization_colors, NULL);
@@ -1403,11 +2412,13 @@ void sreVisualizeCubeMap(int light_index) {
     // Set the colors and the default texture coordinate transform (NULL).
     sreSetImageParameters(SRE_IMAGE_SET_COLORS | SRE_IMAGE_SET_TRANSFORM,
         cube_visualization_colors, NULL);
+    SRE_GLUINT *cube_map_framebuffer = current_cube_map_framebuffer;
+    if (cube_map_framebuffer == NULL)
+        cube_map_framebuffer = &sre_internal_cube_shadow_map_framebuffer[
+            sre_internal_current_cube_shadow_map_index][0];
     for (int i = 0; i < 3; i++) {
         // Update the scratch texture.
-        glBindFramebuffer(GL_READ_FRAMEBUFFER,
-            sre_internal_cube_shadow_map_framebuffer[sre_internal_current_cube_shadow_map_index]
-                [order[i]]);
+        glBindFramebuffer(GL_READ_FRAMEBUFFER, cube_map_framebuffer[order[i]]);
         glActiveTexture(GL_TEXTURE0);
         glBindTexture(GL_TEXTURE_2D, scratch_texture);
         CHECK_GL_ERROR("Error before glCopyTexImage2D.\n");
@@ -1423,9 +2434,7 @@ void sreVisualizeCubeMap(int light_index) {
     }
     for (int i = 0; i < 3; i++) {
         // Update the scratch texture.
-        glBindFramebuffer(GL_READ_FRAMEBUFFER,
-            sre_internal_cube_shadow_map_framebuffer[sre_internal_current_cube_shadow_map_index]
-                [order[i + 3]]);
+        glBindFramebuffer(GL_READ_FRAMEBUFFER, cube_map_framebuffer[order[i + 3]]);
         glActiveTexture(GL_TEXTURE0);
         glBindTexture(GL_TEXTURE_2D, scratch_texture);
         glCopyTexImage2D(GL_TEXTURE_2D, 0, GL_DEPTH_COMPONENT16, 0, 0,
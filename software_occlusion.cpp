@@ -0,0 +1,432 @@
+/*
+
+Copyright (c) 2014 Harm Hanemaaijer <fgenfb@yahoo.com>
+
+Permission to use, copy, modify, and/or distribute this software for any
+purpose with or without fee is hereby granted, provided that the above
+copyright notice and this permission notice appear in all copies.
+
+THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+
+*/
+
+// Occlusion culling with a software depth buffer.
+//
+// The least detailed LOD model of each static object with the SRE_OBJECT_OCCLUDER flag
+// that is inside the view frustum is rasterized on the CPU into a low-resolution depth
+// buffer. The depth buffer stores 1 / w (which is linear in screen space and larger
+// for closer geometry), and is reduced into a hierarchical-Z buffer that holds the
+// farthest depth of every tile of pixels. During visible entity determination, the
+// bounding box of an octree node or object is projected, and the entity is occluded when
+// its closest point is farther than the farthest occluder depth in every tile covered
+// by the box's screen rectangle. No GL calls are involved, so that it also works on
+// OpenGL-ES 2.0 platforms without occlusion queries, and there is no latency.
+//
+// Because the occluder geometry is only sampled at pixel centers, the culling is not
+// strictly conservative; gaps between occluders smaller than a pixel of the software
+// depth buffer are ignored.
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+#include <float.h>
+
+#include "sre.h"
+#include "sre_internal.h"
+#include "sre_bounds.h"
+
+#ifdef USE_SIMD
+#include <dstVectorMathSIMD.h>
+#endif
+
+// The width must be a multiple of four (for SIMD) and of the tile size.
+#define SRE_SOFTWARE_DEPTH_BUFFER_WIDTH 256
+#define SRE_SOFTWARE_DEPTH_BUFFER_HEIGHT 128
+#define SRE_HIZ_TILE_SIZE 8
+#define SRE_HIZ_WIDTH (SRE_SOFTWARE_DEPTH_BUFFER_WIDTH / SRE_HIZ_TILE_SIZE)
+#define SRE_HIZ_HEIGHT (SRE_SOFTWARE_DEPTH_BUFFER_HEIGHT / SRE_HIZ_TILE_SIZE)
+// Occluders with a smaller projected size are not rasterized.
+#define SRE_OCCLUDER_MIN_PROJECTED_SIZE 0.05f
+// Maximum number of occluder triangles rasterized per frame.
+#define SRE_MAX_OCCLUDER_TRIANGLES_PER_FRAME 65536
+// Occluder polygons are clipped to a guard band of this size (in normalized device
+// coordinates) to keep the edge function calculations precise.
+#define SRE_OCCLUDER_GUARD_BAND 4.0f
+// Maximum number of vertices of a triangle clipped against the near plane and the
+// four guard band planes.
+#define SRE_MAX_CLIPPED_POLYGON_VERTICES 8
+
+static float depth_buffer[SRE_SOFTWARE_DEPTH_BUFFER_WIDTH * SRE_SOFTWARE_DEPTH_BUFFER_HEIGHT]
+    DST_ALIGNED(16);
+static float hiz_buffer[SRE_HIZ_WIDTH * SRE_HIZ_HEIGHT];
+// The view-projection matrix with which the depth buffer was rasterized.
+static Matrix4D depth_buffer_matrix;
+static float depth_buffer_near_plane_distance;
+static int nu_rasterized_occluders = 0;
+static int most_recent_frame_rasterized = - 1;
+// The occluder objects of the scene, determined when the number of objects changes.
+static sreScene *occluder_scene = NULL;
+static int occluder_scene_nu_objects = 0;
+static int *occluder_object = NULL;
+static int nu_occluder_objects = 0;
+static int max_occluder_objects = 0;
+// Clip space vertex positions of the occluder model being rasterized.
+static Vector4D *clip_vertex = NULL;
+static int max_clip_vertices = 0;
+
+static void UpdateOccluderList(sreScene *scene) {
+    if (scene == occluder_scene && scene->nu_objects == occluder_scene_nu_objects)
+        return;
+    occluder_scene = scene;
+    occluder_scene_nu_objects = scene->nu_objects;
+    nu_occluder_objects = 0;
+    for (int i = 0; i < scene->nu_objects; i++) {
+        sreObject *so = scene->object[i];
+        if (so == NULL || !so->exists)
+            continue;
+        // Only static objects that are drawn with solid geometry qualify.
+        if (!(so->flags & SRE_OBJECT_OCCLUDER) || (so->flags & (SRE_OBJECT_DYNAMIC_POSITION |
+        SRE_OBJECT_HIDDEN | SRE_OBJECT_INFINITE_DISTANCE | SRE_OBJECT_BILLBOARD |
+        SRE_OBJECT_LIGHT_HALO | SRE_OBJECT_PARTICLE_SYSTEM)))
+            continue;
+        if (nu_occluder_objects == max_occluder_objects) {
+            int new_max = max_occluder_objects == 0 ? 64 : max_occluder_objects * 2;
+            int *new_array = new int[new_max];
+            if (nu_occluder_objects > 0)
+                memcpy(new_array, occluder_object, sizeof(int) * nu_occluder_objects);
+            delete [] occluder_object;
+            occluder_object = new_array;
+            max_occluder_objects = new_max;
+        }
+        occluder_object[nu_occluder_objects] = i;
+        nu_occluder_objects++;
+    }
+}
+
+// Clip a polygon in clip space against the plane dot(plane, V) + offset >= 0. Returns
+// the new number of vertices.
+
+static int ClipPolygon(const Vector4D *V, int n, const Vector4D& plane, float offset,
+Vector4D *V_out) {
+    int n_out = 0;
+    float d_prev = Dot(plane, V[n - 1]) + offset;
+    for (int i = 0; i < n; i++) {
+        const Vector4D& V_prev = V[(i + n - 1) % n];
+        float d = Dot(plane, V[i]) + offset;
+        if ((d >= 0) != (d_prev >= 0)) {
+            // The edge crosses the plane; add the intersection point.
+            float t = d_prev / (d_prev - d);
+            V_out[n_out] = V_prev + t * (V[i] - V_prev);
+            n_out++;
+        }
+        if (d >= 0) {
+            V_out[n_out] = V[i];
+            n_out++;
+        }
+        d_prev = d;
+    }
+    return n_out;
+}
+
+// Rasterize a triangle with screen space vertices (x, y) and depth z = 1 / w. The
+// triangle must be counter-clockwise (positive area).
+
+static void RasterizeTriangle(const float *x, const float *y, const float *z, float area) {
+    float min_xf = fminf(fminf(x[0], x[1]), x[2]);
+    float max_xf = fmaxf(fmaxf(x[0], x[1]), x[2]);
+    float min_yf = fminf(fminf(y[0], y[1]), y[2]);
+    float max_yf = fmaxf(fmaxf(y[0], y[1]), y[2]);
+    int min_x = maxi(0, (int)floorf(min_xf));
+    int max_x = mini(SRE_SOFTWARE_DEPTH_BUFFER_WIDTH - 1, (int)ceilf(max_xf));
+    int min_y = maxi(0, (int)floorf(min_yf));
+    int max_y = mini(SRE_SOFTWARE_DEPTH_BUFFER_HEIGHT - 1, (int)ceilf(max_yf));
+    if (min_x > max_x || min_y > max_y)
+        return;
+    // Edge functions E(px, py) = A * px + B * py + C, which are non-negative on the
+    // inside of each edge.
+    float A[3], B[3], C[3];
+    for (int i = 0; i < 3; i++) {
+        int j = (i + 1) % 3;
+        A[i] = y[i] - y[j];
+        B[i] = x[j] - x[i];
+        C[i] = - (A[i] * x[i] + B[i] * y[i]);
+    }
+    // Depth plane equation.
+    float zA = ((z[1] - z[0]) * (y[2] - y[0]) - (z[2] - z[0]) * (y[1] - y[0])) / area;
+    float zB = ((x[1] - x[0]) * (z[2] - z[0]) - (x[2] - x[0]) * (z[1] - z[0])) / area;
+    float zC = z[0] - zA * x[0] - zB * y[0];
+    // Start at a multiple of four pixels. Pixels outside the bounding box fail the
+    // edge function tests.
+    int start_x = min_x & (~3);
+#ifdef USE_SIMD
+    __simd128_float m_zero = simd128_set_zero_float();
+    __simd128_float m_px_start = simd128_set_float((float)start_x + 0.5f, (float)start_x + 1.5f,
+        (float)start_x + 2.5f, (float)start_x + 3.5f);
+    __simd128_float m_A0 = simd128_set_same_float(A[0]);
+    __simd128_float m_A1 = simd128_set_same_float(A[1]);
+    __simd128_float m_A2 = simd128_set_same_float(A[2]);
+    __simd128_float m_zA = simd128_set_same_float(zA);
+    __simd128_float m_A0_step = simd128_set_same_float(A[0] * 4.0f);
+    __simd128_float m_A1_step = simd128_set_same_float(A[1] * 4.0f);
+    __simd128_float m_A2_step = simd128_set_same_float(A[2] * 4.0f);
+    __simd128_float m_zA_step = simd128_set_same_float(zA * 4.0f);
+    // The edge function and depth values at the start of the row, excluding the y term.
+    __simd128_float m_e0_start = simd128_add_float(simd128_mul_float(m_A0, m_px_start),
+        simd128_set_same_float(C[0]));
+    __simd128_float m_e1_start = simd128_add_float(simd128_mul_float(m_A1, m_px_start),
+        simd128_set_same_float(C[1]));
+    __simd128_float m_e2_start = simd128_add_float(simd128_mul_float(m_A2, m_px_start),
+        simd128_set_same_float(C[2]));
+    __simd128_float m_z_start = simd128_add_float(simd128_mul_float(m_zA, m_px_start),
+        simd128_set_same_float(zC));
+    for (int py = min_y; py <= max_y; py++) {
+        float center_y = (float)py + 0.5f;
+        __simd128_float m_e0 = simd128_add_float(m_e0_start, simd128_set_same_float(B[0] * center_y));
+        __simd128_float m_e1 = simd128_add_float(m_e1_start, simd128_set_same_float(B[1] * center_y));
+        __simd128_float m_e2 = simd128_add_float(m_e2_start, simd128_set_same_float(B[2] * center_y));
+        __simd128_float m_z = simd128_add_float(m_z_start, simd128_set_same_float(zB * center_y));
+        float *row = &depth_buffer[py * SRE_SOFTWARE_DEPTH_BUFFER_WIDTH];
+        for (int px = start_x; px <= max_x; px += 4) {
+            __simd128_int m_inside = simd128_and_int(
+                simd128_and_int(simd128_cmpge_float(m_e0, m_zero), simd128_cmpge_float(m_e1, m_zero)),
+                simd128_cmpge_float(m_e2, m_zero));
+            int mask = simd128_convert_masks_int32_int1(m_inside);
+            if (mask == 0xF) {
+                // All four pixels are covered.
+                simd128_store_float(&row[px], simd128_max_float(simd128_load_float(&row[px]), m_z));
+            }
+            else if (mask != 0) {
+                float z_pixel[4] DST_ALIGNED(16);
+                simd128_store_float(z_pixel, m_z);
+                for (int i = 0; i < 4; i++)
+                    if ((mask & (1 << i)) && z_pixel[i] > row[px + i])
+                        row[px + i] = z_pixel[i];
+            }
+            m_e0 = simd128_add_float(m_e0, m_A0_step);
+            m_e1 = simd128_add_float(m_e1, m_A1_step);
+            m_e2 = simd128_add_float(m_e2, m_A2_step);
+            m_z = simd128_add_float(m_z, m_zA_step);
+        }
+    }
+#else
+    for (int py = min_y; py <= max_y; py++) {
+        float center_y = (float)py + 0.5f;
+        float *row = &depth_buffer[py * SRE_SOFTWARE_DEPTH_BUFFER_WIDTH];
+        for (int px = start_x; px <= max_x; px++) {
+            float center_x = (float)px + 0.5f;
+            if (A[0] * center_x + B[0] * center_y + C[0] < 0 ||
+            A[1] * center_x + B[1] * center_y + C[1] < 0 ||
+            A[2] * center_x + B[2] * center_y + C[2] < 0)
+                continue;
+            float z_pixel = zA * center_x + zB * center_y + zC;
+            if (z_pixel > row[px])
+                row[px] = z_pixel;
+        }
+    }
+#endif
+}
+
+// Rasterize a convex polygon in clip space (a triangle that may have been clipped).
+
+static void RasterizePolygon(const Vector4D *V, int n, bool backface_culling) {
+    float x[SRE_MAX_CLIPPED_POLYGON_VERTICES];
+    float y[SRE_MAX_CLIPPED_POLYGON_VERTICES];
+    float z[SRE_MAX_CLIPPED_POLYGON_VERTICES];
+    for (int i = 0; i < n; i++) {
+        z[i] = 1.0f / V[i].w;
+        x[i] = (V[i].x * z[i] * 0.5f + 0.5f) * (float)SRE_SOFTWARE_DEPTH_BUFFER_WIDTH;
+        y[i] = (V[i].y * z[i] * 0.5f + 0.5f) * (float)SRE_SOFTWARE_DEPTH_BUFFER_HEIGHT;
+    }
+    // Draw the polygon as a triangle fan.
+    for (int i = 1; i + 1 < n; i++) {
+        float tx[3] = { x[0], x[i], x[i + 1] };
+        float ty[3] = { y[0], y[i], y[i + 1] };
+        float tz[3] = { z[0], z[i], z[i + 1] };
+        float area = (tx[1] - tx[0]) * (ty[2] - ty[0]) - (tx[2] - tx[0]) * (ty[1] - ty[0]);
+        if (area == 0)
+            continue;
+        if (area < 0) {
+            if (backface_culling)
+                continue;
+            // Reverse the winding order.
+            float temp = tx[1]; tx[1] = tx[2]; tx[2] = temp;
+            temp = ty[1]; ty[1] = ty[2]; ty[2] = temp;
+            temp = tz[1]; tz[1] = tz[2]; tz[2] = temp;
+            area = - area;
+        }
+        RasterizeTriangle(tx, ty, tz, area);
+    }
+}
+
+static void RasterizeOccluder(const sreObject& so, int& nu_triangles_left) {
+    const sreLODModel *m = so.model->lod_model[so.max_lod_level];
+    if (m->nu_triangles > nu_triangles_left)
+        return;
+    nu_triangles_left -= m->nu_triangles;
+    if (m->nu_vertices > max_clip_vertices) {
+        delete [] clip_vertex;
+        max_clip_vertices = m->nu_vertices;
+        clip_vertex = new Vector4D[max_clip_vertices];
+    }
+    Matrix4D MVP = depth_buffer_matrix * so.model_matrix;
+    for (int i = 0; i < m->nu_vertices; i++)
+        clip_vertex[i] = MVP * m->position[i];
+    const float near_w = depth_buffer_near_plane_distance;
+    const float guard_band = SRE_OCCLUDER_GUARD_BAND;
+    bool backface_culling = !(so.flags & SRE_OBJECT_NO_BACKFACE_CULLING);
+    for (int i = 0; i < m->nu_triangles; i++) {
+        Vector4D V[SRE_MAX_CLIPPED_POLYGON_VERTICES];
+        int n = 3;
+        bool inside = true;
+        for (int j = 0; j < 3; j++) {
+            V[j] = clip_vertex[m->triangle[i].vertex_index[j]];
+            if (V[j].w < near_w || fabsf(V[j].x) > guard_band * V[j].w ||
+            fabsf(V[j].y) > guard_band * V[j].w)
+                inside = false;
+        }
+        if (!inside) {
+            // Clip against the near plane (w >= near_w) and the guard band planes.
+            const Vector4D plane[5] = {
+                Vector4D(0, 0, 0, 1.0f),
+                Vector4D(- 1.0f, 0, 0, guard_band),
+                Vector4D(1.0f, 0, 0, guard_band),
+                Vector4D(0, - 1.0f, 0, guard_band),
+                Vector4D(0, 1.0f, 0, guard_band)
+            };
+            const float plane_offset[5] = { - near_w, 0, 0, 0, 0 };
+            Vector4D V_temp[SRE_MAX_CLIPPED_POLYGON_VERTICES];
+            for (int k = 0; k < 5 && n >= 3; k++) {
+                n = ClipPolygon(V, n, plane[k], plane_offset[k], V_temp);
+                memcpy(V, V_temp, sizeof(Vector4D) * n);
+            }
+            if (n < 3)
+                continue;
+        }
+        RasterizePolygon(V, n, backface_culling);
+    }
+    nu_rasterized_occluders++;
+}
+
+// Build the hierarchical-Z buffer, which holds the farthest depth (the minimum of 1 / w)
+// of every tile.
+
+static void BuildHiZBuffer() {
+    for (int ty = 0; ty < SRE_HIZ_HEIGHT; ty++)
+        for (int tx = 0; tx < SRE_HIZ_WIDTH; tx++) {
+            const float *tile = &depth_buffer[ty * SRE_HIZ_TILE_SIZE * SRE_SOFTWARE_DEPTH_BUFFER_WIDTH
+                + tx * SRE_HIZ_TILE_SIZE];
+#ifdef USE_SIMD
+            __simd128_float m_min = simd128_load_float(&tile[0]);
+            for (int y = 0; y < SRE_HIZ_TILE_SIZE; y++)
+                for (int x = 0; x < SRE_HIZ_TILE_SIZE; x += 4)
+                    m_min = simd128_min_float(m_min, simd128_load_float(
+                        &tile[y * SRE_SOFTWARE_DEPTH_BUFFER_WIDTH + x]));
+            float lane_min[4] DST_ALIGNED(16);
+            simd128_store_float(lane_min, m_min);
+            float min_z = fminf(fminf(lane_min[0], lane_min[1]), fminf(lane_min[2], lane_min[3]));
+#else
+            float min_z = FLT_MAX;
+            for (int y = 0; y < SRE_HIZ_TILE_SIZE; y++)
+                for (int x = 0; x < SRE_HIZ_TILE_SIZE; x++)
+                    min_z = fminf(min_z, tile[y * SRE_SOFTWARE_DEPTH_BUFFER_WIDTH + x]);
+#endif
+            hiz_buffer[ty * SRE_HIZ_WIDTH + tx] = min_z;
+        }
+}
+
+// Rasterize the occluders of the scene that are inside the view frustum into the
+// software depth buffer. Must be called after the view-projection matrix has been set
+// up for the frame. The depth buffer is only updated when the view frustum has changed,
+// since the occluders are static.
+
+void sreRasterizeOccluders(sreScene *scene, const sreFrustum& frustum) {
+    bool scene_changed = (scene != occluder_scene || scene->nu_objects != occluder_scene_nu_objects);
+    if (!scene_changed && most_recent_frame_rasterized >= 0 &&
+    frustum.most_recent_frame_changed <= most_recent_frame_rasterized)
+        return;
+    UpdateOccluderList(scene);
+    most_recent_frame_rasterized = sre_internal_current_frame;
+    depth_buffer_matrix = sre_internal_view_projection_matrix;
+    depth_buffer_near_plane_distance = sre_internal_near_plane_distance;
+    nu_rasterized_occluders = 0;
+    // A value of zero corresponds to infinite distance.
+    memset(depth_buffer, 0, sizeof(depth_buffer));
+    int nu_triangles_left = SRE_MAX_OCCLUDER_TRIANGLES_PER_FRAME;
+    for (int i = 0; i < nu_occluder_objects; i++) {
+        sreObject *so = scene->object[occluder_object[i]];
+        if (so == NULL || !so->exists)
+            continue;
+        if (!Intersects(*so, frustum.frustum_world))
+            continue;
+        // Skip occluders that are small on the screen, unless the viewpoint is inside
+        // the bounding sphere.
+        float w = Dot(depth_buffer_matrix.GetRow(3), so->sphere.center);
+        if (w > so->sphere.radius && so->sphere.radius * 2.0f / w < SRE_OCCLUDER_MIN_PROJECTED_SIZE)
+            continue;
+        RasterizeOccluder(*so, nu_triangles_left);
+    }
+    if (nu_rasterized_occluders > 0)
+        BuildHiZBuffer();
+}
+
+// Returns whether the axis-aligned bounding box is hidden behind the rasterized occluders.
+// Only reads the depth buffer, so it can be called from multiple threads.
+
+bool sreIsOccludedBySoftwareDepthBuffer(const sreBoundingVolumeAABB& AABB) {
+    if (nu_rasterized_occluders == 0)
+        return false;
+    float min_x = FLT_MAX, max_x = - FLT_MAX;
+    float min_y = FLT_MAX, max_y = - FLT_MAX;
+    float max_z = 0;
+    for (int i = 0; i < 8; i++) {
+        Vector4D P(
+            (i & 1) ? AABB.dim_max.x : AABB.dim_min.x,
+            (i & 2) ? AABB.dim_max.y : AABB.dim_min.y,
+            (i & 4) ? AABB.dim_max.z : AABB.dim_min.z, 1.0f);
+        Vector4D Pclip = depth_buffer_matrix * P;
+        // A box that extends to in front of the near plane is treated as visible.
+        if (Pclip.w < depth_buffer_near_plane_distance)
+            return false;
+        float z = 1.0f / Pclip.w;
+        float x = (Pclip.x * z * 0.5f + 0.5f) * (float)SRE_SOFTWARE_DEPTH_BUFFER_WIDTH;
+        float y = (Pclip.y * z * 0.5f + 0.5f) * (float)SRE_SOFTWARE_DEPTH_BUFFER_HEIGHT;
+        min_x = fminf(min_x, x);
+        max_x = fmaxf(max_x, x);
+        min_y = fminf(min_y, y);
+        max_y = fmaxf(max_y, y);
+        max_z = fmaxf(max_z, z);
+    }
+    // Boxes that are not on the screen are left to the frustum checks.
+    if (max_x < 0 || min_x >= (float)SRE_SOFTWARE_DEPTH_BUFFER_WIDTH ||
+    max_y < 0 || min_y >= (float)SRE_SOFTWARE_DEPTH_BUFFER_HEIGHT)
+        return false;
+    int min_tx = maxi(0, (int)min_x) / SRE_HIZ_TILE_SIZE;
+    int max_tx = mini(SRE_SOFTWARE_DEPTH_BUFFER_WIDTH - 1, (int)max_x) / SRE_HIZ_TILE_SIZE;
+    int min_ty = maxi(0, (int)min_y) / SRE_HIZ_TILE_SIZE;
+    int max_ty = mini(SRE_SOFTWARE_DEPTH_BUFFER_HEIGHT - 1, (int)max_y) / SRE_HIZ_TILE_SIZE;
+    for (int ty = min_ty; ty <= max_ty; ty++)
+        for (int tx = min_tx; tx <= max_tx; tx++)
+            if (hiz_buffer[ty * SRE_HIZ_WIDTH + tx] <= max_z)
+                return false;
+    return true;
+}
+
+bool sreIsOccludedBySoftwareDepthBuffer(const sreObject& so) {
+    sreBoundingVolumeAABB AABB;
+    if (so.flags & SRE_OBJECT_DYNAMIC_POSITION) {
+        // The static AABB is not updated for moving objects.
+        Vector3D extent = Vector3D(so.sphere.radius, so.sphere.radius, so.sphere.radius);
+        AABB.dim_min = so.sphere.center - extent;
+        AABB.dim_max = so.sphere.center + extent;
+    }
+    else
+        AABB = so.AABB;
+    return sreIsOccludedBySoftwareDepthBuffer(AABB);
+}
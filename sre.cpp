@@ -69,6 +69,9 @@ SRE_GLUINT sre_internal_cube_shadow_map_framebuffer[SRE_MAX_CUBE_SHADOW_MAP_LEVE
 float sre_internal_depth_cube_map_texture_precision[SRE_MAX_CUBE_SHADOW_MAP_LEVELS_OPENGL];
 SRE_GLUINT sre_internal_current_depth_cube_map_texture;
 bool sre_internal_depth_cube_map_texture_is_clear[SRE_MAX_CUBE_SHADOW_MAP_LEVELS_OPENGL][6];
+SRE_GLUINT sre_internal_cube_shadow_map_layered_framebuffer[SRE_MAX_CUBE_SHADOW_MAP_LEVELS_OPENGL];
+bool sre_internal_layered_cube_shadow_maps = false;
+bool sre_internal_uniform_buffers = false;
 SRE_GLUINT sre_internal_HDR_multisample_color_renderbuffer = 0;
 SRE_GLUINT sre_internal_HDR_multisample_depth_renderbuffer = 0;
 SRE_GLUINT sre_internal_HDR_color_texture = 0;
@@ -131,6 +134,9 @@ int sre_internal_shader_loading_mask = SRE_SHADER_MASK_ALL;
 #endif
 const char *sre_internal_shader_path = SHADER_PATH;
 bool sre_internal_demand_load_shaders = false;
+const char *sre_internal_shader_cache_path = NULL;
+bool sre_internal_async_shader_loading = false;
+bool sre_internal_profiling = false;
 int sre_internal_interleaved_vertex_buffers_mode = SRE_INTERLEAVED_BUFFERS_DISABLED;
 int sre_internal_object_flags_mask = SRE_OBJECT_FLAGS_MASK_FULL;
 int sre_internal_visualized_shadow_map = - 1;
@@ -147,6 +153,21 @@ int sre_internal_max_cube_shadow_map_size;
 int sre_internal_current_cube_shadow_map_index;
 int sre_internal_nu_cube_shadow_map_size_levels;
 Vector3D sre_internal_current_shadow_map_dimensions;
+int sre_internal_shadow_map_cascades = 1;
+int sre_internal_shadow_map_cache_mode = SRE_SHADOW_MAP_CACHE_DISABLED;
+SRE_GLUINT sre_internal_current_shadow_map_texture;
+float sre_internal_shadow_map_cascade_parameters[1 + SRE_MAX_SHADOW_MAP_CASCADES * 6] = {
+    1.0f, 1.0f, 1.0f, 1.0f, 0.0f, 0.0f, 0.0f
+};
+int sre_internal_shadow_map_atlas_size = 0;
+SRE_GLUINT sre_internal_shadow_map_atlas_texture = 0;
+int sre_internal_current_shadow_map_atlas_tile_size = 0;
+float sre_internal_shadow_map_atlas_tile_parameters[3] = { 1.0f, 0.0f, 0.0f };
+// Number of worker threads for the thread pool; - 1 means determine automatically.
+int sre_internal_nu_worker_threads = - 1;
+int sre_internal_shadow_volume_cache_budget = SRE_DEFAULT_SHADOW_VOLUME_CACHE_BUDGET;
+sreLightingPassBatchingInfo sre_internal_lighting_pass_stats;
+sreLightingPassBatchingInfo sre_internal_lighting_pass_stats_last_frame;
 
 void sreSetShadowsMethod(int method) {
     if (method == SRE_SHADOWS_SHADOW_VOLUMES &&
@@ -274,6 +295,241 @@ void sreSetGeometryScissorsCache(bool enabled) {
    }
 }
 
+void sreSetWorkerThreads(int n) {
+    sre_internal_nu_worker_threads = n;
+    // The pool will be recreated with the new number of threads when it is next used.
+    sreDestroyThreadPool();
+}
+
+void sreSetMultiThreadedVisibility(bool enabled) {
+   if (enabled)
+       sre_internal_rendering_flags |= SRE_RENDERING_FLAG_MULTI_THREADED_VISIBILITY;
+   else
+       sre_internal_rendering_flags &= ~SRE_RENDERING_FLAG_MULTI_THREADED_VISIBILITY;
+}
+
+void sreSetMultiThreadedShadowVolumes(bool enabled) {
+   if (enabled)
+       sre_internal_rendering_flags |= SRE_RENDERING_FLAG_MULTI_THREADED_SHADOW_VOLUMES;
+   else
+       sre_internal_rendering_flags &= ~SRE_RENDERING_FLAG_MULTI_THREADED_SHADOW_VOLUMES;
+}
+
+void sreSetMultiThreadedShadowMaps(bool enabled) {
+   if (enabled)
+       sre_internal_rendering_flags |= SRE_RENDERING_FLAG_MULTI_THREADED_SHADOW_MAPS;
+   else
+       sre_internal_rendering_flags &= ~SRE_RENDERING_FLAG_MULTI_THREADED_SHADOW_MAPS;
+}
+
+void sreSetLightingPassBatching(bool enabled) {
+   if (enabled)
+       sre_internal_rendering_flags |= SRE_RENDERING_FLAG_LIGHTING_PASS_BATCHING;
+   else
+       sre_internal_rendering_flags &= ~SRE_RENDERING_FLAG_LIGHTING_PASS_BATCHING;
+}
+
+void sreSetInstancing(bool enabled) {
+   if (enabled && (sre_internal_rendering_flags & SRE_RENDERING_FLAG_INSTANCING_SUPPORT))
+       sre_internal_rendering_flags |= SRE_RENDERING_FLAG_INSTANCING;
+   else
+       sre_internal_rendering_flags &= ~SRE_RENDERING_FLAG_INSTANCING;
+}
+
+void sreSetVertexArrayObjects(bool enabled) {
+   if (enabled && (sre_internal_rendering_flags & SRE_RENDERING_FLAG_VERTEX_ARRAY_OBJECT_SUPPORT))
+       sre_internal_rendering_flags |= SRE_RENDERING_FLAG_USE_VERTEX_ARRAY_OBJECTS;
+   else
+       sre_internal_rendering_flags &= ~SRE_RENDERING_FLAG_USE_VERTEX_ARRAY_OBJECTS;
+}
+
+void sreSetOcclusionCulling(bool enabled) {
+   if (enabled && (sre_internal_rendering_flags & SRE_RENDERING_FLAG_OCCLUSION_QUERY_SUPPORT)) {
+       // The bounding boxes are drawn with the shadow volume shader.
+       sreValidateShadowVolumeShaders();
+       sre_internal_rendering_flags |= SRE_RENDERING_FLAG_OCCLUSION_CULLING;
+   }
+   else
+       sre_internal_rendering_flags &= ~SRE_RENDERING_FLAG_OCCLUSION_CULLING;
+}
+
+void sreSetSoftwareOcclusionCulling(bool enabled) {
+   if (enabled)
+       sre_internal_rendering_flags |= SRE_RENDERING_FLAG_SOFTWARE_OCCLUSION_CULLING;
+   else
+       sre_internal_rendering_flags &= ~SRE_RENDERING_FLAG_SOFTWARE_OCCLUSION_CULLING;
+}
+
+void sreSetClusteredLighting(bool enabled) {
+   if (enabled && (sre_internal_rendering_flags & SRE_RENDERING_FLAG_CLUSTERED_LIGHTING_SUPPORT))
+       sre_internal_rendering_flags |= SRE_RENDERING_FLAG_CLUSTERED_LIGHTING;
+   else
+       sre_internal_rendering_flags &= ~SRE_RENDERING_FLAG_CLUSTERED_LIGHTING;
+   // The clustered lighting shader replaces the regular single-pass shaders.
+   sre_internal_reselect_shaders = true;
+}
+
+// Enabling has no effect when the G-buffer could not be created.
+
+void sreSetDeferredShading(bool enabled) {
+   if (enabled && sre_internal_gbuffer_framebuffer != 0)
+       sre_internal_rendering_flags |= SRE_RENDERING_FLAG_DEFERRED_SHADING;
+   else
+       sre_internal_rendering_flags &= ~SRE_RENDERING_FLAG_DEFERRED_SHADING;
+   // The G-buffer geometry shader replaces the regular single-pass shaders.
+   sre_internal_reselect_shaders = true;
+}
+
+// Enabling has no effect when the streaming buffer is not supported.
+
+void sreSetStreamingBuffer(bool enabled) {
+   if (enabled && sre_internal_streaming_buffer != 0)
+       sre_internal_rendering_flags |= SRE_RENDERING_FLAG_USE_STREAMING_BUFFER;
+   else
+       sre_internal_rendering_flags &= ~SRE_RENDERING_FLAG_USE_STREAMING_BUFFER;
+}
+
+void sreSetShadowMapCascades(int n) {
+#ifndef OPENGL_ES2
+    if (n < 1)
+        n = 1;
+    if (n > SRE_MAX_SHADOW_MAP_CASCADES)
+        n = SRE_MAX_SHADOW_MAP_CASCADES;
+    sre_internal_shadow_map_cascades = n;
+#endif
+}
+
+void sreSetShadowMapCache(int mode) {
+#ifndef OPENGL_ES2
+    if (mode == sre_internal_shadow_map_cache_mode)
+        return;
+    // Release the persistent shadow maps; they are recreated as needed.
+    sreClearShadowMapCache();
+    sre_internal_shadow_map_cache_mode = mode;
+#endif
+}
+
+#ifndef NO_SHADOW_MAP
+
+// Create the shared shadow map texture and framebuffer of a size level.
+
+static void CreateShadowMapTexture(int level) {
+    int size = sre_internal_max_shadow_map_size >> level;
+    glGenTextures(1, &sre_internal_depth_texture[level]);
+#ifdef OPENGL_ES2
+    glBindTexture(GL_TEXTURE_2D, sre_internal_depth_texture[level]);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    // Use 16-bit half-float precision. 32-bit float precision might be an option
+    // on fast hardware.
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_DEPTH_COMPONENT, size, size, 0,
+        GL_DEPTH_COMPONENT, GL_UNSIGNED_SHORT, 0);
+    sre_internal_depth_texture_precision[level] = 1.0f / powf(2.0f, 16.0f);
+#else
+    glBindTexture(GL_TEXTURE_2D, sre_internal_depth_texture[level]);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+#ifdef USE_SHADOW_SAMPLER
+    // Required when using sampler2DShadow in shader.
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_COMPARE_MODE, GL_COMPARE_REF_TO_TEXTURE);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_COMPARE_FUNC, GL_LEQUAL);
+#endif
+    // Use 32-bit float precision for largest shadow maps (used for directional
+    // lights).
+    GLenum gl_depth;
+    GLenum gl_type;
+    if (level == 0) {
+        gl_depth = GL_DEPTH_COMPONENT32;
+        gl_type = GL_FLOAT;
+        sre_internal_depth_texture_precision[level] = 1.0f / powf(2.0f, 23.0f);
+    }
+    else {
+        gl_depth = GL_DEPTH_COMPONENT16;
+        gl_type = GL_UNSIGNED_SHORT;
+        sre_internal_depth_texture_precision[level] = 1.0f / powf(2.0f, 16.0f);
+    }
+    glTexImage2D(GL_TEXTURE_2D, 0, gl_depth, size, size, 0,
+        GL_DEPTH_COMPONENT, gl_type, 0);
+#endif
+	CHECK_GL_ERROR("Error after shadow map initialization.\n");
+
+    glGenFramebuffers(1, &sre_internal_shadow_map_framebuffer[level]);
+#ifdef OPENGL_ES2
+    glBindFramebuffer(GL_FRAMEBUFFER, sre_internal_shadow_map_framebuffer[level]);
+#else
+    glBindFramebuffer(GL_DRAW_FRAMEBUFFER, sre_internal_shadow_map_framebuffer[level]);
+#endif
+    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_TEXTURE_2D,
+        sre_internal_depth_texture[level], 0);
+#ifdef OPENGL_ES2
+    if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE) {
+#else
+    glReadBuffer(GL_NONE);
+    if (glCheckFramebufferStatus(GL_DRAW_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE) {
+#endif
+        sreFatalError("Error -- shadow map (level %d) framebuffer not complete.", level);
+    }
+    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+}
+
+#ifndef OPENGL_ES2
+
+static void DestroyShadowMapTexture(int level) {
+    if (sre_internal_depth_texture[level] == 0)
+        return;
+    glDeleteFramebuffers(1, &sre_internal_shadow_map_framebuffer[level]);
+    glDeleteTextures(1, &sre_internal_depth_texture[level]);
+    sre_internal_depth_texture[level] = 0;
+    sre_internal_shadow_map_framebuffer[level] = 0;
+}
+
+#endif
+
+#endif
+
+void sreSetShadowMapAtlasSize(int size) {
+#ifndef OPENGL_ES2
+    if (size < 0)
+        size = 0;
+    // Round down to a power of two.
+    int atlas_size = 0;
+    if (size > 0)
+        for (atlas_size = 1; atlas_size * 2 <= size; atlas_size *= 2);
+    if (atlas_size == sre_internal_shadow_map_atlas_size)
+        return;
+    // The atlas texture is recreated with the new size when it is next used.
+    sreDestroyShadowMapAtlas();
+#ifndef NO_SHADOW_MAP
+    // Spot and beam lights do not use the smaller shared shadow maps when the atlas is
+    // enabled, so they only exist while it is disabled. The largest one is also used by
+    // directional lights.
+    if (sre_internal_rendering_flags & SRE_RENDERING_FLAG_SHADOW_MAP_SUPPORT)
+        for (int level = 1; level < sre_internal_nu_shadow_map_size_levels; level++) {
+            if (atlas_size > 0)
+                DestroyShadowMapTexture(level);
+            else if (sre_internal_depth_texture[level] == 0)
+                CreateShadowMapTexture(level);
+        }
+#endif
+    sre_internal_shadow_map_atlas_size = atlas_size;
+#endif
+}
+
+void sreSetLayeredCubeShadowMaps(bool enabled) {
+#ifndef OPENGL_ES2
+    sre_internal_layered_cube_shadow_maps = enabled;
+#ifndef NO_SHADOW_MAP
+    if (sre_internal_shadows == SRE_SHADOWS_SHADOW_MAPPING &&
+    (sre_internal_rendering_flags & SRE_RENDERING_FLAG_CUBE_SHADOW_MAP_SUPPORT))
+        sreValidateCubeShadowMapShaders();
+#endif
+#endif
+}
+
 void sreSetShadowMapRegion(Point3D dim_min, Point3D dim_max) {
     sre_internal_shadow_map_AABB.dim_min = dim_min;
     sre_internal_shadow_map_AABB.dim_max = dim_max;
@@ -412,6 +668,12 @@ sreShadowRenderingInfo *sreGetShadowRenderingInfo() {
      return info;
 }
 
+sreLightingPassBatchingInfo *sreGetLightingPassBatchingInfo() {
+     sreLightingPassBatchingInfo *info = new sreLightingPassBatchingInfo;
+     *info = sre_internal_lighting_pass_stats_last_frame;
+     return info;
+}
+
 void sreSetShaderPath(const char *path) {
     sre_internal_shader_path = path;
 }
@@ -420,6 +682,16 @@ void sreSetDemandLoadShaders(bool flag) {
     sre_internal_demand_load_shaders = flag;
 }
 
+void sreSetShaderCachePath(const char *path) {
+    sre_internal_shader_cache_path = path;
+}
+
+void sreSetAsynchronousShaderLoading(bool flag) {
+    sre_internal_async_shader_loading = flag;
+    if (flag)
+        sre_internal_demand_load_shaders = true;
+}
+
 // Set max shadow map size (power of two).
 void sreSetMaxShadowMapSize(int size) {
     sre_internal_max_shadow_map_size = size;
@@ -463,6 +735,17 @@ void sreSetShadowVolumeCache(bool enabled) {
    }
 }
 
+void sreSetShadowVolumeCacheSize(int object_cache_entries, int model_cache_entries) {
+    sreResizeShadowCache(object_cache_entries, model_cache_entries);
+}
+
+void sreSetShadowVolumeCacheBudget(int max_bytes) {
+    sre_internal_shadow_volume_cache_budget = max_bytes;
+    // Entries are only evicted when new ones are added, so clear the cache to enforce
+    // a lower budget.
+    sreClearShadowCache();
+}
+
 void sreSetForceDepthFailRendering(bool enabled) {
    if (enabled)
        sre_internal_rendering_flags |= SRE_RENDERING_FLAG_FORCE_DEPTH_FAIL;
@@ -619,6 +902,9 @@ void sreInitialize(int window_width, int window_height, sreSwapBuffersFunc swap_
 
     if (sre_internal_demand_load_shaders)
         sreMessage(SRE_MESSAGE_INFO, "Demand loading of shaders enabled.\n");
+    // The program binary cache must be set up before the first shader is loaded.
+    sreInitializeShaderCache();
+    sreInitializeAsyncShaderLoading();
 
     // First load the text shader, but respect the shader loading mask.
     // When demand-loading is enabled, and the splash screen is off,
@@ -684,66 +970,13 @@ void sreInitialize(int window_width, int window_height, sreSwapBuffersFunc swap_
     sre_internal_nu_shadow_map_size_levels = SRE_MAX_SHADOW_MAP_LEVELS_OPENGL;
 #endif
     for (int level = 0; level < sre_internal_nu_shadow_map_size_levels; level++) {
-        int size = sre_internal_max_shadow_map_size >> level;
-        glGenTextures(1, &sre_internal_depth_texture[level]);
-#ifdef OPENGL_ES2
-        glBindTexture(GL_TEXTURE_2D, sre_internal_depth_texture[level]);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
-        // Use 16-bit half-float precision. 32-bit float precision might be an option
-        // on fast hardware.
-        glTexImage2D(GL_TEXTURE_2D, 0, GL_DEPTH_COMPONENT, size, size, 0,
-            GL_DEPTH_COMPONENT, GL_UNSIGNED_SHORT, 0);
-        sre_internal_depth_texture_precision[level] = 1.0f / powf(2.0f, 16.0f);
-#else
-        glBindTexture(GL_TEXTURE_2D, sre_internal_depth_texture[level]);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
-#ifdef USE_SHADOW_SAMPLER
-        // Required when using sampler2DShadow in shader.
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_COMPARE_MODE, GL_COMPARE_REF_TO_TEXTURE);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_COMPARE_FUNC, GL_LEQUAL);
-#endif
-        // Use 32-bit float precision for largest shadow maps (used for directional
-        // lights).
-        GLenum gl_depth;
-        GLenum gl_type;
-        if (level == 0) {
-            gl_depth = GL_DEPTH_COMPONENT32;
-            gl_type = GL_FLOAT;
-            sre_internal_depth_texture_precision[level] = 1.0f / powf(2.0f, 23.0f);
-        }
-        else {
-            gl_depth = GL_DEPTH_COMPONENT16;
-            gl_type = GL_UNSIGNED_SHORT;
-            sre_internal_depth_texture_precision[level] = 1.0f / powf(2.0f, 16.0f);
-        }
-        glTexImage2D(GL_TEXTURE_2D, 0, gl_depth, size, size, 0,
-            GL_DEPTH_COMPONENT, gl_type, 0);
-#endif
-	CHECK_GL_ERROR("Error after shadow map initialization.\n");
-
-        glGenFramebuffers(1, &sre_internal_shadow_map_framebuffer[level]);
-#ifdef OPENGL_ES2
-        glBindFramebuffer(GL_FRAMEBUFFER, sre_internal_shadow_map_framebuffer[level]);
-#else
-        glBindFramebuffer(GL_DRAW_FRAMEBUFFER, sre_internal_shadow_map_framebuffer[level]);
-#endif
-        glFramebufferTexture2D(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_TEXTURE_2D,
-            sre_internal_depth_texture[level], 0);
-#ifdef OPENGL_ES2
-        if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE) {
-#else
-        glReadBuffer(GL_NONE);
-        if (glCheckFramebufferStatus(GL_DRAW_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE) {
+#ifndef OPENGL_ES2
+        // With the shadow map atlas, only the largest shadow map (used for directional
+        // lights) is needed.
+        if (level > 0 && sre_internal_shadow_map_atlas_size > 0)
+            continue;
 #endif
-            sreFatalError("Error -- shadow map (level %d) framebuffer not complete.", level);
-        }
-        glBindFramebuffer(GL_FRAMEBUFFER, 0);
+        CreateShadowMapTexture(level);
     }
     sreMessage(SRE_MESSAGE_INFO, "Created %d shadow maps of sizes %dx%d to %dx%d.",
         sre_internal_nu_shadow_map_size_levels,
@@ -845,6 +1078,19 @@ skip_shadow_map:
             }
             glBindFramebuffer(GL_FRAMEBUFFER, 0);
         }
+#ifndef OPENGL_ES2
+        // Layered framebuffer for single-pass rendering of all faces with a geometry shader.
+        glGenFramebuffers(1, &sre_internal_cube_shadow_map_layered_framebuffer[level]);
+        glBindFramebuffer(GL_DRAW_FRAMEBUFFER, sre_internal_cube_shadow_map_layered_framebuffer[level]);
+        glFramebufferTexture(GL_DRAW_FRAMEBUFFER, GL_DEPTH_ATTACHMENT,
+            sre_internal_depth_cube_map_texture[level], 0);
+        glReadBuffer(GL_NONE);
+        CHECK_GL_ERROR("Error after glFramebufferTexture\n");
+        if (glCheckFramebufferStatus(GL_DRAW_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE) {
+            sreFatalError("Error -- layered cube shadow map framebuffer not complete.");
+        }
+        glBindFramebuffer(GL_FRAMEBUFFER, 0);
+#endif
     }
     sreMessage(SRE_MESSAGE_INFO, "Created %d shadow cube maps of sizes %dx%d to %dx%d.",
         sre_internal_nu_cube_shadow_map_size_levels,
@@ -956,9 +1202,33 @@ skip_cube_shadow_map:
     // Switch back to window-system-provided framebuffer.
     glBindFramebuffer(GL_FRAMEBUFFER, 0);
 
+#ifndef OPENGL_ES2
+    // Hardware instancing of repeated objects in multi-pass rendering requires instanced
+    // vertex attributes (OpenGL 3.3). The instanced shader variants are initialized
+    // together with the lighting shaders.
+    if (GLEW_VERSION_3_3) {
+        sre_internal_rendering_flags |= SRE_RENDERING_FLAG_INSTANCING_SUPPORT |
+            SRE_RENDERING_FLAG_INSTANCING;
+        sreMessage(SRE_MESSAGE_INFO, "Hardware instancing enabled.");
+    }
+#endif
+
+    // Check whether the frame and light parameters of the lighting shaders can be stored
+    // in uniform buffers. This must be done before the lighting shaders are initialized.
+    sreInitializeUniformBuffers();
+
+    // Check whether texture buffer objects are available for clustered lighting. This
+    // must be done before the single-pass lighting shaders are initialized.
+    sreInitializeClusteredLighting();
+    // Create the G-buffer for deferred shading. This must also be done before the
+    // single-pass lighting shaders (which include the G-buffer geometry shader) are
+    // initialized.
+    sreInitializeDeferredShading();
+
     // Initialize lighting shaders.
     sreInitializeShaders(sre_internal_shader_loading_mask & (SRE_SHADER_MASK_LIGHTING_SINGLE_PASS |
-        SRE_SHADER_MASK_LIGHTING_MULTI_PASS));
+        SRE_SHADER_MASK_LIGHTING_MULTI_PASS | SRE_SHADER_MASK_DEFERRED_SHADING));
+    sreReportShaderLoadingStats();
 
     // Depth clamping is mainly useful for shadow volumes, but we still try to enable it for
     // all cases.
@@ -1009,6 +1279,17 @@ skip_stencil_shadow_volumes :
 
     // Enable geometry scissors cache by default.
     sre_internal_rendering_flags |= SRE_RENDERING_FLAG_GEOMETRY_SCISSORS_CACHE_ENABLED;
+    // Enable lighting pass batching by default.
+    sre_internal_rendering_flags |= SRE_RENDERING_FLAG_LIGHTING_PASS_BATCHING;
+
+    // Set up the streaming buffer for dynamic geometry when supported.
+    sreInitializeStreamingBuffer();
+    // Cache vertex attribute state in vertex array objects when supported.
+    sreInitializeVertexArrayObjects();
+    // Check whether occlusion queries are available for occlusion culling.
+    sreInitializeOcclusionQueries();
+    // Check whether GPU timer queries are available for the frame profiler.
+    sreInitializeProfiler();
 
     const char *texture_detail_str;
 #ifdef OPENGL_ES2
@@ -1067,6 +1348,8 @@ void sreResize(sreView *view, int window_width, int window_height) {
 //    glDeleteFramebuffers(1, &sre_internal_HDR_tone_map_framebuffer);
     SetupHDRFramebuffer();
 #endif
+    // Reallocate the G-buffer textures for the new window size.
+    sreResizeDeferredShading();
 }
 
 void sreCheckGLError(const char *format, ...) {
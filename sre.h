@@ -92,6 +92,8 @@ typedef Matrix4x3RM MatrixTransform;
 // needed.
 #define SRE_DEFAULT_MAX_SHADOW_VOLUME_VERTICES 8192
 #define SRE_DEFAULT_MAX_SILHOUETTE_EDGES 2048
+// Default GPU memory budget in bytes for the shadow volume caches.
+#define SRE_DEFAULT_SHADOW_VOLUME_CACHE_BUDGET (32 * 1024 * 1024)
 // Maximum number of levels-of-detail per object.
 #define SRE_MAX_LOD_LEVELS 4
 // The distance of the near plane.
@@ -119,6 +121,8 @@ typedef Matrix4x3RM MatrixTransform;
 // The size of the shadow map in pixels (n x n) for directional lights, spot lights and beam lights.
 #define SRE_MAX_SHADOW_MAP_SIZE_OPENGL 2048
 #define SRE_MAX_SHADOW_MAP_SIZE_GLES2 1024
+// The maximum number of cascades of the shadow map of a directional light.
+#define SRE_MAX_SHADOW_MAP_CASCADES 4
 // The projected size above which the largest shadow map is triggered for spot and beam lights;
 // the threshold is halved for each subsequent level with a shadow map half the size.
 #define SRE_MAX_SHADOW_MAP_SIZE_THRESHOLD_OPENGL 5.12f
@@ -489,6 +493,24 @@ enum {
     SRE_LOD_MODEL_VERTEX_BUFFER_DYNAMIC = 0x4000000,
 };
 
+// The maximum number of different object attribute configurations for which vertex array
+// objects are cached per LOD model. Further configurations set up the vertex attributes
+// for every draw.
+#define SRE_MAX_VERTEX_ARRAY_OBJECTS 8
+
+// Return values of sreLODModel::BindVertexArrayObject().
+enum {
+    // No vertex array object is bound; the vertex attributes must be set up and
+    // disabled after drawing.
+    SRE_VERTEX_ARRAY_OBJECT_NONE = 0,
+    // A newly created vertex array object is bound; the vertex attributes and element
+    // buffer must be set up and will be recorded in it.
+    SRE_VERTEX_ARRAY_OBJECT_CREATED,
+    // A vertex array object with the vertex attributes and element buffer already set
+    // up is bound.
+    SRE_VERTEX_ARRAY_OBJECT_BOUND
+};
+
 // An extension of sreBaseModel for models that can be uploaded to the GPU.
 // Used for Level-Of-Detail sub-models.
 
@@ -509,6 +531,11 @@ public :
     // Vertex attribute information (for non-interleaved buffers, and up to
     // three interleaved buffers).
     sreAttributeInfo attribute_info;
+    // Vertex array objects, created when the model is first drawn with a particular object
+    // attribute configuration (identified by sreObjectAttributeInfo::attribute_masks).
+    int nu_vertex_array_objects;
+    unsigned int vertex_array_object_attribute_masks[SRE_MAX_VERTEX_ARRAY_OBJECTS];
+    SRE_GLUINT vertex_array_object[SRE_MAX_VERTEX_ARRAY_OBJECTS];
 
     // Constructors and allocation.
     sreLODModel();
@@ -523,6 +550,10 @@ public :
     // info passed is object-specific, and may be a subset of the model's attributes).
     void SetupAttributesNonInterleaved(sreObjectAttributeInfo *info) const;
     void SetupAttributesInterleaved(sreObjectAttributeInfo *info) const;
+    // Bind the cached vertex array object for the attribute configuration, creating it
+    // when required. Returns one of the SRE_VERTEX_ARRAY_OBJECT_* values.
+    int BindVertexArrayObject(const sreObjectAttributeInfo *info);
+    void DeleteVertexArrayObjects();
 };
 
 // LOD model with support for shadow volumes (which can have with extruded vertices
@@ -536,6 +567,11 @@ public :
     // Edge information for shadow volumes.
     int nu_edges;
     ModelEdge *edge;
+    // Triangle plane equations (normal and w component) in structure-of-arrays format,
+    // used to determine light-facing triangles. The four arrays share one allocation
+    // and are padded with zeroes to a multiple of 32 triangles. Calculated together
+    // with the edges.
+    float *triangle_plane_x, *triangle_plane_y, *triangle_plane_z, *triangle_plane_w;
 
     sreLODModelShadowVolume();
     ~sreLODModelShadowVolume();
@@ -543,6 +579,7 @@ public :
     void CalculateEdges();
     void RemoveUnnecessaryEdges();
     void DestroyEdges();
+    void CalculateTrianglePlanes();
 };
 
 // Fluid data used for fluid models.
@@ -973,7 +1010,14 @@ enum {
     // The open side of an object with a non-closed model is always hidden from lights.
     SRE_OBJECT_OPEN_SIDE_HIDDEN_FROM_LIGHT = 0x4000000,
     // The open side of an object with a non-closed model is always hidden from view.
-    SRE_OBJECT_OPEN_SIDE_HIDDEN_FROM_VIEW = 0x8000000
+    SRE_OBJECT_OPEN_SIDE_HIDDEN_FROM_VIEW = 0x8000000,
+    // Pin the object's shadow volumes in the shadow volume cache so that they are not
+    // evicted. Use for frequently visible shadow casters in large scenes.
+    SRE_OBJECT_PIN_SHADOW_VOLUME_CACHE = 0x10000000,
+    // Rasterize the object's least detailed LOD model into the software depth buffer
+    // used for software occlusion culling. Only applies to static objects; the LOD
+    // model should not extend beyond the visible geometry of the object.
+    SRE_OBJECT_OCCLUDER = 0x20000000
 };
 
 class sreScissorsCacheEntry : public sreScissors {
@@ -981,6 +1025,28 @@ public :
     int light_id;
 };
 
+// Occlusion query state of an object or static octree node, used for occlusion culling.
+
+class SRE_API sreOcclusionQueryState {
+public :
+    // The query object (0 when not yet allocated).
+    SRE_GLUINT query;
+    // Whether a query has been issued of which the result has not yet been retrieved.
+    bool query_pending;
+    // The result of the most recently retrieved query.
+    bool occluded;
+    // The most recent frame in which the entity was inside the view frustum and
+    // was checked for occlusion.
+    int most_recent_frame_candidate;
+
+    sreOcclusionQueryState() {
+        query = 0;
+        query_pending = false;
+        occluded = false;
+        most_recent_frame_candidate = - 1;
+    }
+};
+
 // The main object class (an object in the scene); refers to the model used,
 // and contains all other non-model specific information.
 
@@ -1078,9 +1144,15 @@ public:
     // Time stamp to determine whether the first object-affecting light of a new frame
     // has been reached.
     int geometry_scissors_cache_timestamp;
+    // Record of the object in the object uniform buffer used by the multi-pass shaders;
+    // the slot is valid when the generation matches that of the buffer.
+    int object_uniform_buffer_slot;
+    int object_uniform_buffer_generation;
     float projected_size;
     // The frame number when the object was last determined to be visible.
     int most_recent_frame_visible;
+    // Occlusion culling state.
+    sreOcclusionQueryState occlusion;
 
     sreObject();
     ~sreObject();
@@ -1101,6 +1173,7 @@ public:
         const sreLight& light, Point3D& center, float& length, Vector3D& cylinder_axis,
         float& cylinder_radius) const;
     void AddShadowVolume(sreShadowVolume *sv);
+    void FreeShadowVolumes();
     sreShadowVolume *LookupShadowVolume(int light_index) const;
     void CalculateTemporaryShadowVolume(const sreLight& light, sreShadowVolume **sv) const;
     bool IsChangingPositionEveryFrame(int current_frame) const {
@@ -1179,12 +1252,26 @@ public :
     sreBoundingVolumeSphere sphere;
 };
 
+// Bounding volume hierarchy for dynamic objects (internal).
+
+class sreObjectBVH;
+
 // Optimized octree.
 
 class SRE_API sreFastOctree {
 public :
     sreOctreeNodeBounds *node_bounds;
+    int nu_nodes;
     unsigned int *array;
+    // Optional packed (structure-of-arrays) copy of the bounding spheres of the entities
+    // in the octree, indexed in the same way as array[] (only entity offsets are defined).
+    // Used for SIMD frustum culling of the entities in a node. Lights and other entities
+    // that should never be culled with this test have a radius of FLT_MAX. NULL when
+    // not created.
+    float *entity_sphere_x;
+    float *entity_sphere_y;
+    float *entity_sphere_z;
+    float *entity_sphere_radius;
 
     int GetNumberOfOctants(int offset) const {
 	return array[offset];
@@ -1397,6 +1484,9 @@ public:
     sreFastOctree fast_octree_static_infinite_distance;
     sreFastOctree fast_octree_dynamic;
     sreFastOctree fast_octree_dynamic_infinite_distance;
+    // Bounding volume hierarchy for dynamic (non-infinite distance) objects. When not NULL,
+    // these objects are not stored in fast_octree_dynamic.
+    sreObjectBVH *dynamic_object_bvh;
     int nu_root_node_objects;
     // Array of (non-final pass) visible objects, updated each frame.
     int *visible_object;
@@ -1420,6 +1510,13 @@ public:
     int active_light[SRE_MAX_ACTIVE_LIGHTS];
     // List of deleted scene objects.
     sreObjectList *deleted_ids;
+    // The number of lights and objects covered by the static light object lists, which
+    // are updated incrementally by CalculateStaticLightObjectLists().
+    int static_light_object_lists_nu_lights;
+    int static_light_object_lists_nu_objects;
+    // Set when an object covered by the static light object lists is deleted, which
+    // causes the lists of all lights to be recalculated.
+    bool static_light_object_lists_objects_deleted;
     // State variables used during scene construction.
     Color current_diffuse_reflection_color;
     int current_flags;
@@ -1593,6 +1690,10 @@ public:
     void MarkAllModelsReferenced() const;
     void UploadModels() const;
     void PrepareForRendering(unsigned int prepare_flags);
+    // Start loading the shaders that the scene's objects need with the current rendering
+    // settings and lights, based on the object flags. With asynchronous shader loading
+    // they are compiled in the background; otherwise they are loaded immediately.
+    void WarmUpShaders() const;
     // Octree creation and static light volume objects calculation.
     void CreateOctrees();
     void ClearOctrees();
@@ -1633,6 +1734,8 @@ public:
         BoundsCheckResult bounds_check_result);
     void DetermineVisibleEntitiesInFastStrictOptimizedOctreeRootNode(const sreFastOctree& fast_oct,
         int array_index, const sreFrustum& frustum, BoundsCheckResult bounds_check_result);
+    void DetermineVisibleEntitiesInObjectBVH(const sreObjectBVH& bvh, int node_index,
+        const sreFrustum& frustum, BoundsCheckResult bounds_check_result);
     void DetermineVisibleEntities(const sreFrustum& f);
     void RenderVisibleObjectsSinglePass(const sreFrustum&) const;
     void RenderFinalPassObjectsSinglePass(const sreFrustum&) const;
@@ -1644,6 +1747,8 @@ public:
     // array in sreScene for each light.
     void RenderLightingPasses(sreFrustum *f, sreView *view);
     void RenderLightingPassesNoShadow(sreFrustum *f, sreView *view);
+    // Render the visible objects with deferred shading (defined in deferred_shading.cpp).
+    void RenderDeferredShading(sreFrustum *f, sreView *view);
     void ApplyGlobalTextureParameters(int flags, int filter, float anisotropy);
     void sreVisualizeShadowMap(int light_index, sreFrustum *frustum);
     void InvalidateGeometryScissorsCache() const;
@@ -1663,6 +1768,9 @@ enum {
     // Whether there is support for shadow volumes. Disabling increase performance
     // somewhat.
     SRE_RENDERING_FLAG_SHADOW_VOLUME_SUPPORT = 0x1,
+    // Determine the shadow casters of all active lights in advance using worker threads
+    // when shadow mapping is enabled.
+    SRE_RENDERING_FLAG_MULTI_THREADED_SHADOW_MAPS = 0x2,
     // Use shadow volume cache for models and objects in GPU memory.
     SRE_RENDERING_FLAG_SHADOW_CACHE_ENABLED = 0x100,
     // Use triangle strips for point/spot shadow volume sides.
@@ -1684,6 +1792,44 @@ enum {
     SRE_RENDERING_FLAG_SHADOW_MAP_SUPPORT = 0x8000,
     // Whether cube shadow maps (point lights) are supported.
     SRE_RENDERING_FLAG_CUBE_SHADOW_MAP_SUPPORT = 0x10000,
+    // Use worker threads to traverse the static octree during visible entity
+    // determination.
+    SRE_RENDERING_FLAG_MULTI_THREADED_VISIBILITY = 0x20000,
+    // Use worker threads to calculate shadow volume silhouettes.
+    SRE_RENDERING_FLAG_MULTI_THREADED_SHADOW_VOLUMES = 0x40000,
+    // Sub-allocate dynamic geometry (shadow volumes that are not cached, billboards and
+    // particle systems) from a shared streaming buffer. Only available with OpenGL 3.2
+    // or GL_ARB_sync.
+    SRE_RENDERING_FLAG_USE_STREAMING_BUFFER = 0x80000,
+    // Sort the objects drawn in each lighting pass of multi-pass rendering by shader,
+    // textures and model, and skip redundant shader and texture changes.
+    SRE_RENDERING_FLAG_LIGHTING_PASS_BATCHING = 0x100000,
+    // Whether hardware instancing is supported (OpenGL 3.3).
+    SRE_RENDERING_FLAG_INSTANCING_SUPPORT = 0x200000,
+    // Draw visible objects that share a model, shader and material in the ambient and
+    // lighting passes of multi-pass rendering with one instanced draw call.
+    SRE_RENDERING_FLAG_INSTANCING = 0x400000,
+    // Whether vertex array objects are supported (OpenGL 3.0 or GL_OES_vertex_array_object).
+    SRE_RENDERING_FLAG_VERTEX_ARRAY_OBJECT_SUPPORT = 0x800000,
+    // Cache the vertex attribute setup of each LOD model in vertex array objects, one for
+    // every object attribute configuration it is drawn with.
+    SRE_RENDERING_FLAG_USE_VERTEX_ARRAY_OBJECTS = 0x1000000,
+    // Whether hardware occlusion queries are supported.
+    SRE_RENDERING_FLAG_OCCLUSION_QUERY_SUPPORT = 0x2000000,
+    // Skip static octree nodes and large objects that were found to be hidden by
+    // asynchronous occlusion queries in previous frames.
+    SRE_RENDERING_FLAG_OCCLUSION_CULLING = 0x4000000,
+    // Skip static octree nodes and objects that are hidden behind the occluder objects
+    // (SRE_OBJECT_OCCLUDER) in a depth buffer rasterized on the CPU.
+    SRE_RENDERING_FLAG_SOFTWARE_OCCLUSION_CULLING = 0x8000000,
+    // Whether clustered forward lighting is supported (texture buffer objects).
+    SRE_RENDERING_FLAG_CLUSTERED_LIGHTING_SUPPORT = 0x10000000,
+    // In single-pass rendering, apply all visible lights in one pass using per-cluster
+    // light lists instead of only the most prominent light.
+    SRE_RENDERING_FLAG_CLUSTERED_LIGHTING = 0x20000000,
+    // In single-pass rendering, render the visible objects into a G-buffer and apply
+    // each visible light in a screen-space pass.
+    SRE_RENDERING_FLAG_DEFERRED_SHADING = 0x40000000,
 };
 
 class SRE_API sreEngineSettingsInfo {
@@ -1705,6 +1851,12 @@ public :
     const char *shader_path;
 };
 
+class SRE_API sreShadowCacheStats {
+public :
+    int hits;
+    int misses;
+};
+
 class SRE_API sreShadowRenderingInfo {
 public :
     int shadow_volume_count;
@@ -1723,12 +1875,115 @@ public :
     int model_cache_misses;
     int model_cache_entries_depthfail;
     int model_cache_hits_depthfail;
+    // GPU memory used by both caches and the budget, in bytes.
+    int cache_total_size;
+    int cache_budget;
+    int cache_entries_pinned;
+    // Cache statistics for the last frame indexed by light index and scene object id.
+    int nu_light_stats;
+    sreShadowCacheStats *light_stats;
+    int nu_object_stats;
+    sreShadowCacheStats *object_stats;
+
+    sreShadowRenderingInfo() {
+        light_stats = NULL;
+        object_stats = NULL;
+    }
+    ~sreShadowRenderingInfo() {
+        delete [] light_stats;
+        delete [] object_stats;
+    }
+private :
+    // The statistics arrays are owned; copying is not allowed.
+    sreShadowRenderingInfo(const sreShadowRenderingInfo&);
+    sreShadowRenderingInfo& operator=(const sreShadowRenderingInfo&);
+};
+
+// Lighting pass batching statistics for the last frame (multi-pass rendering only).
+
+class SRE_API sreLightingPassBatchingInfo {
+public :
+    int objects_drawn;
+    // The number of times the render queue was sorted and submitted.
+    int batches;
+    // Shader program and texture changes performed, and redundant changes that were
+    // skipped.
+    int shader_changes;
+    int shader_changes_saved;
+    int texture_changes;
+    int texture_changes_saved;
+    // Instanced draw calls in the ambient and lighting passes, and the number of objects
+    // drawn with them.
+    int instanced_draws;
+    int instanced_objects;
+};
+
+// Frame profiling. The stages of rendering a frame are recorded as (possibly nested)
+// events with their CPU time and, when GPU timer queries are available, GPU time.
+
+enum {
+    SRE_PROFILE_FRAME = 0,
+    SRE_PROFILE_VISIBILITY,
+    SRE_PROFILE_AMBIENT_PASS,
+    SRE_PROFILE_SINGLE_PASS,
+    SRE_PROFILE_DEFERRED_SHADING,
+    SRE_PROFILE_SHADOW_MAP,
+    SRE_PROFILE_SHADOW_VOLUMES,
+    SRE_PROFILE_LIGHTING_PASS,
+    SRE_PROFILE_FINAL_PASS,
+    SRE_PROFILE_HDR,
+    SRE_NU_PROFILE_STAGES
+};
+
+class SRE_API sreProfileEvent {
+public :
+    int stage;
+    // The light index for shadow and lighting passes, - 1 otherwise.
+    int light_index;
+    // Nesting depth (0 for the frame event).
+    int depth;
+    // Times in microseconds relative to the start of the frame on the CPU. The GPU
+    // times are - 1 when GPU timer queries are not available.
+    double cpu_start;
+    double cpu_duration;
+    double gpu_start;
+    double gpu_duration;
+};
+
+class SRE_API sreFrameProfileInfo {
+public :
+    int frame;
+    bool gpu_timing;
+    int nu_events;
+    sreProfileEvent *event;
+    // Total time of the events of each stage in microseconds.
+    double cpu_time[SRE_NU_PROFILE_STAGES];
+    double gpu_time[SRE_NU_PROFILE_STAGES];
+    // Draw calls issued for objects and shadow volumes, and the triangles drawn by them
+    // (counting every instance).
+    int draw_calls;
+    int triangles;
+
+    sreFrameProfileInfo() {
+        event = NULL;
+    }
+    ~sreFrameProfileInfo() {
+        delete [] event;
+    }
 };
 
 typedef void (*sreSwapBuffersFunc)();
 
 // The following functions must be called before sreInitialize().
 SRE_API void sreSetDemandLoadShaders(bool enabled);
+// Cache linked shader programs as driver-specific binaries in the given directory (the
+// path must end with a directory separator), so that later runs can skip compilation.
+// The default (NULL) disables the cache.
+SRE_API void sreSetShaderCachePath(const char *path);
+// Compile demand-loaded lighting shaders without blocking rendering; objects whose shader
+// is still being compiled are temporarily drawn with a generic lighting shader. Implies
+// demand loading of shaders.
+SRE_API void sreSetAsynchronousShaderLoading(bool enabled);
 SRE_API void sreSetMaxShadowMapSize(int size);
 // SRE library initialization function.
 SRE_API void sreInitialize(int window_width, int window_height, sreSwapBuffersFunc swap_buffers_func);
@@ -1787,14 +2042,90 @@ SRE_API void sreSetSplashScreen(int type, void (*SplashScreenFunction)());
 SRE_API void sreSwapBuffers();
 SRE_API sreEngineSettingsInfo *sreGetEngineSettingsInfo();
 SRE_API sreShadowRenderingInfo *sreGetShadowRenderingInfo();
+SRE_API sreLightingPassBatchingInfo *sreGetLightingPassBatchingInfo();
+SRE_API void sreSetProfiling(bool enabled);
+// Return the profile of the most recent frame of which the results are complete (GPU
+// results lag a few frames behind), or NULL when no frame has been profiled.
+SRE_API sreFrameProfileInfo *sreGetFrameProfileInfo();
+SRE_API const char *sreGetProfileStageName(int stage);
+// Collect the profiles of all frames until sreEndProfileTrace(), which writes them
+// to a Chrome trace (JSON) file. Profiling must be enabled.
+SRE_API void sreBeginProfileTrace();
+SRE_API bool sreEndProfileTrace(const char *filename);
 SRE_API void sreSetVisualizedShadowMap(int light_index);
 SRE_API void sreSetDrawTextOverlayFunc(void (*func)());
 SRE_API void sreSetTriangleStripUseForShadowVolumes(bool enabled);
 SRE_API void sreSetTriangleFanUseForShadowVolumes(bool enabled);
 SRE_API void sreSetShadowVolumeCache(bool enabled);
+// Set the number of entries of the shadow volume object cache (point and spot lights)
+// and model cache (directional and beam lights). The caches are cleared.
+SRE_API void sreSetShadowVolumeCacheSize(int object_cache_entries, int model_cache_entries);
+// Set the maximum GPU memory in bytes used by the shadow volume caches. Least recently
+// used entries are evicted when it is exceeded.
+SRE_API void sreSetShadowVolumeCacheBudget(int max_bytes);
 SRE_API void sreSetForceDepthFailRendering(bool enabled);
 SRE_API void sreSetShadowVolumeSupport(bool enabled);
 SRE_API void sreSetGeometryScissorsCache(bool enabled);
+// Set the number of worker threads used for multi-threaded tasks (not counting the
+// rendering thread). The default value of - 1 selects the number of processors minus
+// one; 0 disables worker threads.
+SRE_API void sreSetWorkerThreads(int n);
+SRE_API void sreSetMultiThreadedVisibility(bool enabled);
+SRE_API void sreSetMultiThreadedShadowVolumes(bool enabled);
+SRE_API void sreSetMultiThreadedShadowMaps(bool enabled);
+SRE_API void sreSetStreamingBuffer(bool enabled);
+SRE_API void sreSetLightingPassBatching(bool enabled);
+// Enabling has no effect when hardware instancing is not supported.
+SRE_API void sreSetInstancing(bool enabled);
+// Enabling has no effect when vertex array objects are not supported.
+SRE_API void sreSetVertexArrayObjects(bool enabled);
+// Enable occlusion culling with hardware occlusion queries. The query results of the
+// previous frames are used, so that newly disoccluded geometry may appear one or two
+// frames late. Enabling has no effect when occlusion queries are not supported.
+SRE_API void sreSetOcclusionCulling(bool enabled);
+// Enable occlusion culling against a low-resolution depth buffer that is rasterized on
+// the CPU from the objects with the SRE_OBJECT_OCCLUDER flag. Does not require any GL
+// features.
+SRE_API void sreSetSoftwareOcclusionCulling(bool enabled);
+// Enable clustered forward lighting for single-pass rendering. The visible lights are
+// assigned to a grid of view frustum clusters and every object is lit by all lights in
+// one pass. Shadows are not applied in this mode. Enabling has no effect when texture
+// buffer objects are not supported.
+SRE_API void sreSetClusteredLighting(bool enabled);
+// Enable deferred shading for single-pass rendering. The visible objects are rendered
+// once into a G-buffer, after which every visible light is applied with a full-screen
+// pass restricted to the light's screen-space scissors region. Shadow mapping is
+// supported; stencil shadow volumes are not applied in this mode. Enabling has no
+// effect when the G-buffer could not be created.
+SRE_API void sreSetDeferredShading(bool enabled);
+// Set the number of cascades (1 to SRE_MAX_SHADOW_MAP_CASCADES) for directional light
+// shadow maps. The view frustum is split in depth and each split gets its own tile of
+// the shadow map; cascades of which the shadow casters did not change are not
+// rerendered. Has no effect with OpenGL ES 2.0.
+SRE_API void sreSetShadowMapCascades(int n);
+// Keep the shadow maps of spot, beam and point source lights in persistent per-light
+// storage, and only rerender them when the light or one of its shadow casters changes.
+// With SRE_SHADOW_MAP_CACHE_STATIC_LAYER, the static shadow casters are additionally
+// kept in a separate layer so that changes in dynamic objects only require the dynamic
+// shadow casters to be rendered. Has no effect with OpenGL ES 2.0.
+enum {
+    SRE_SHADOW_MAP_CACHE_DISABLED = 0,
+    SRE_SHADOW_MAP_CACHE_ENABLED,
+    SRE_SHADOW_MAP_CACHE_STATIC_LAYER
+};
+SRE_API void sreSetShadowMapCache(int mode);
+// Render spot and beam light shadow maps into tiles of a shadow map atlas with the given
+// size in pixels (rounded down to a power of two), with the tile size of each light
+// chosen according to its projected size on the screen. A size of zero (the default)
+// disables the atlas. The smaller shared shadow map textures are released while the atlas
+// is enabled. The shadow map cache, when enabled, takes precedence. Has no effect with
+// OpenGL ES 2.0.
+SRE_API void sreSetShadowMapAtlasSize(int size);
+// Render point light shadow cube maps in a single pass, using a layered framebuffer and
+// a geometry shader that routes each shadow caster to the cube map faces it intersects,
+// instead of submitting each caster once per face. Point lights using the shadow map
+// cache still use the per-face path. Has no effect with OpenGL ES 2.0.
+SRE_API void sreSetLayeredCubeShadowMaps(bool enabled);
 // Global texture detail settings.
 enum {
     // Use original texture size.
@@ -1914,7 +2245,8 @@ SRE_API void sreDrawTextCentered(const char *text, float x, float y, float w);
 #define SRE_SHADER_MASK_IMAGE                128
 #define SRE_SHADER_MASK_LIGHTING             6
 #define SRE_SHADER_MASK_CUBE_SHADOW_MAP      0x100
-#define SRE_SHADER_MASK_ALL                  0x1FF
+#define SRE_SHADER_MASK_DEFERRED_SHADING     0x200
+#define SRE_SHADER_MASK_ALL                  0x3FF
 SRE_API void sreSetShaderLoadingMask(int mask);
 
 // Model loading/creation.
@@ -61,6 +61,8 @@ enum {
     SRE_BACKEND_GLES2_ALLWINNER_MALI_FB = 0x101,
     SRE_BACKEND_GLES2_RPI_FB = 0x102,
     SRE_BACKEND_GLES2_RPI_FB_WITH_X11 = 0x103,
+    // Offscreen EGL rendering without a window (OpenGL or OpenGL-ES 2.0).
+    SRE_BACKEND_HEADLESS = 0x200,
     SRE_BACKEND_DEFAULT = 0x1000
 };
 
@@ -100,6 +102,8 @@ enum {
 class sreApplication {
 public :
     unsigned int flags;
+    // Name used in benchmark results (may be NULL).
+    const char *name;
     int window_width, window_height;
     Vector2D mouse_sensitivity;
     sreScene *scene;
@@ -43,12 +43,27 @@ sreBackend *sreCreateBackendGLES2RPIFB();
 #ifdef INCLUDE_BACKEND_GLES2_RPI_FB_WITH_X11
 sreBackend *sreCreateBackendGLES2RPIFBWITHX11();
 #endif
+#ifdef INCLUDE_BACKEND_HEADLESS
+sreBackend *sreCreateBackendHeadless();
+#endif
 
 sreBackend *sre_internal_backend = NULL;
 sreApplication *sre_internal_application;
 
 // Command-line options.
 static bool benchmark_mode = false;
+static int benchmark_frames = 0;
+static const char *benchmark_output_filename = NULL;
+static bool headless = false;
+static bool vertex_array_objects = true;
+static bool occlusion_culling = false;
+static bool software_occlusion_culling = false;
+static bool clustered_lighting = false;
+static bool deferred_shading = false;
+static int shadow_map_cascades = 1;
+static int shadow_map_cache = SRE_SHADOW_MAP_CACHE_DISABLED;
+static int shadow_map_atlas_size = 0;
+static bool layered_cube_shadow_maps = false;
 static bool multiple_lights = false;
 static bool multipass_rendering = false;
 static bool fullscreen_mode = false;
@@ -56,6 +71,9 @@ static int shadows = SRE_SHADOWS_NONE;
 static bool preprocess = false;
 static int debug_level = 0;
 static bool demand_load_shaders = false;
+static bool async_shader_loading = false;
+static const char *shader_cache_path = NULL;
+static const char *profile_trace_filename = NULL;
 static bool large_shadow_maps = false;
 #ifdef NO_MULTI_SAMPLE
 static bool multi_sample = false;
@@ -112,6 +130,11 @@ void sreSelectBackend(int backend) {
     case SRE_BACKEND_GLES2_RPI_FB_WITH_X11 :
         sre_internal_backend = sreCreateBackendGLES2RPIFBWITHX11();
         break;
+#endif
+#ifdef INCLUDE_BACKEND_HEADLESS
+    case SRE_BACKEND_HEADLESS :
+        sre_internal_backend = sreCreateBackendHeadless();
+        break;
 #endif
     default :
         sreFatalError("sreSelectBackend: Invalid back-end or back-end not supported.");
@@ -122,7 +145,19 @@ void sreSelectBackend(int backend) {
         gl_platform_str, sre_internal_backend->name);
 }
 
+// In benchmark mode, the time spent in sreScene::Render() excluding the buffer swap
+// (which may block waiting for the GPU) is accumulated, giving an estimate of the CPU
+// cost of issuing the rendering commands.
+static double benchmark_render_time = 0;
+static double benchmark_swap_time = 0;
+
 void sreBackendGLSwapBuffers() {
+    if (benchmark_mode) {
+        double time = sre_internal_backend->GetCurrentTime();
+        sre_internal_backend->GLSwapBuffers();
+        benchmark_swap_time += sre_internal_backend->GetCurrentTime() - time;
+        return;
+    }
     sre_internal_backend->GLSwapBuffers();
 }
 
@@ -151,6 +186,24 @@ static void sreBackendProcessOptions(int *argcp, char ***argvp) {
         if (strcmp(argv[argi], "--benchmark") == 0) {
             benchmark_mode = true;
         }
+        else if (argc >= argi + 2 && strcmp(argv[argi], "--benchmark-frames") == 0) {
+            benchmark_mode = true;
+            benchmark_frames = atoi(argv[argi + 1]);
+            // Remove the extra argument.
+            if (argc - argi - 2 > 0)
+                memmove(&argv[argi + 1], &argv[argi + 2], (argc - argi - 2) * sizeof(char *));
+            argc--;
+        }
+        else if (argc >= argi + 2 && strcmp(argv[argi], "--benchmark-output") == 0) {
+            benchmark_output_filename = argv[argi + 1];
+            // Remove the extra argument.
+            if (argc - argi - 2 > 0)
+                memmove(&argv[argi + 1], &argv[argi + 2], (argc - argi - 2) * sizeof(char *));
+            argc--;
+        }
+        else if (strcmp(argv[argi], "--headless") == 0) {
+            headless = true;
+        }
         else if (strcmp(argv[argi], "--multiple-lights") == 0) {
             multiple_lights = true;
             multipass_rendering = true;
@@ -193,6 +246,23 @@ static void sreBackendProcessOptions(int *argcp, char ***argvp) {
         else if (argc >= argi + 1 && strcmp(argv[argi], "--demand-load-shaders") == 0) {
             demand_load_shaders = true;
         }
+        else if (argc >= argi + 1 && strcmp(argv[argi], "--async-shaders") == 0) {
+            async_shader_loading = true;
+        }
+        else if (argc >= argi + 2 && strcmp(argv[argi], "--shader-cache") == 0) {
+            shader_cache_path = argv[argi + 1];
+            // Remove the extra argument.
+            if (argc - argi - 2 > 0)
+                memmove(&argv[argi + 1], &argv[argi + 2], (argc - argi - 2) * sizeof(char *));
+            argc--;
+        }
+        else if (argc >= argi + 2 && strcmp(argv[argi], "--profile-trace") == 0) {
+            profile_trace_filename = argv[argi + 1];
+            // Remove the extra argument.
+            if (argc - argi - 2 > 0)
+                memmove(&argv[argi + 1], &argv[argi + 2], (argc - argi - 2) * sizeof(char *));
+            argc--;
+        }
         else if (argc >= argi + 1 && strcmp(argv[argi], "--large-shadow-maps") == 0) {
             large_shadow_maps = true;
         }
@@ -208,6 +278,45 @@ static void sreBackendProcessOptions(int *argcp, char ***argvp) {
         else if (argc >= argi + 1 && strcmp(argv[argi], "--no-stencil-buffer") == 0) {
             stencil_buffer = false;
         }
+        else if (argc >= argi + 1 && strcmp(argv[argi], "--no-vertex-array-objects") == 0) {
+            vertex_array_objects = false;
+        }
+        else if (argc >= argi + 1 && strcmp(argv[argi], "--occlusion-culling") == 0) {
+            occlusion_culling = true;
+        }
+        else if (argc >= argi + 1 && strcmp(argv[argi], "--software-occlusion-culling") == 0) {
+            software_occlusion_culling = true;
+        }
+        else if (argc >= argi + 1 && strcmp(argv[argi], "--clustered-lighting") == 0) {
+            // Clustered lighting replaces multi-pass rendering.
+            clustered_lighting = true;
+            multipass_rendering = false;
+        }
+        else if (argc >= argi + 1 && strcmp(argv[argi], "--deferred-shading") == 0) {
+            // Deferred shading replaces multi-pass rendering.
+            deferred_shading = true;
+            multipass_rendering = false;
+        }
+        else if (argc >= argi + 2 && strcmp(argv[argi], "--shadow-map-cascades") == 0) {
+            shadow_map_cascades = atoi(argv[argi + 1]);
+            // Remove the extra argument.
+            if (argc - argi - 2 > 0)
+                memmove(&argv[argi + 1], &argv[argi + 2], (argc - argi - 2) * sizeof(char *));
+            argc--;
+        }
+        else if (argc >= argi + 2 && strcmp(argv[argi], "--shadow-map-atlas") == 0) {
+            shadow_map_atlas_size = atoi(argv[argi + 1]);
+            // Remove the extra argument.
+            if (argc - argi - 2 > 0)
+                memmove(&argv[argi + 1], &argv[argi + 2], (argc - argi - 2) * sizeof(char *));
+            argc--;
+        }
+        else if (argc >= argi + 1 && strcmp(argv[argi], "--shadow-map-cache") == 0)
+            shadow_map_cache = SRE_SHADOW_MAP_CACHE_ENABLED;
+        else if (argc >= argi + 1 && strcmp(argv[argi], "--shadow-map-cache-static-layer") == 0)
+            shadow_map_cache = SRE_SHADOW_MAP_CACHE_STATIC_LAYER;
+        else if (argc >= argi + 1 && strcmp(argv[argi], "--layered-cube-shadow-maps") == 0)
+            layered_cube_shadow_maps = true;
         else {
             // Unrecognized option; preserve for processing by the application.
             argi++;
@@ -251,6 +360,10 @@ static void sreBackendInitialize(sreApplication *app, int *argc, char ***argv) {
     sreSetDebugMessageLevel(debug_level);
     if (demand_load_shaders)
         sreSetDemandLoadShaders(true);
+    if (async_shader_loading)
+        sreSetAsynchronousShaderLoading(true);
+    if (shader_cache_path != NULL)
+        sreSetShaderCachePath(shader_cache_path);
     if (large_shadow_maps)
 #ifdef OPENGL_ES2
         sreSetMaxShadowMapSize(SRE_MAX_SHADOW_MAP_SIZE_GLES2 * 4);
@@ -273,7 +386,12 @@ static void sreBackendInitialize(sreApplication *app, int *argc, char ***argv) {
 	actual_width, actual_height, backend_init_flags);
     app->window_width = actual_width;
     app->window_height = actual_height;
+    // Report the start-up time so that runs with a cold and warm shader cache can be
+    // compared.
+    double init_start_time = sre_internal_backend->GetCurrentTime();
     sreInitialize(actual_width, actual_height, sreBackendGLSwapBuffers);
+    sreMessage(SRE_MESSAGE_INFO, "Library initialization took %.3lf s.",
+        sre_internal_backend->GetCurrentTime() - init_start_time);
 
     sreSetDrawTextOverlayFunc(sreBackendStandardTextOverlay);
     sreSetShadowsMethod(shadows);
@@ -284,6 +402,27 @@ static void sreBackendInitialize(sreApplication *app, int *argc, char ***argv) {
     sreSetLightScissors(SRE_SCISSORS_GEOMETRY);
     if (multipass_rendering && !multiple_lights)
         sreSetMultiPassMaxActiveLights(1);
+    if (!vertex_array_objects)
+        sreSetVertexArrayObjects(false);
+    if (occlusion_culling)
+        sreSetOcclusionCulling(true);
+    if (software_occlusion_culling)
+        sreSetSoftwareOcclusionCulling(true);
+    if (clustered_lighting)
+        sreSetClusteredLighting(true);
+    if (deferred_shading)
+        sreSetDeferredShading(true);
+    if (shadow_map_cascades > 1)
+        sreSetShadowMapCascades(shadow_map_cascades);
+    if (shadow_map_cache != SRE_SHADOW_MAP_CACHE_DISABLED)
+        sreSetShadowMapCache(shadow_map_cache);
+    if (shadow_map_atlas_size > 0)
+        sreSetShadowMapAtlasSize(shadow_map_atlas_size);
+    if (layered_cube_shadow_maps)
+        sreSetLayeredCubeShadowMaps(true);
+    // The benchmark reports per-pass times and draw statistics from the profiler.
+    if (profile_trace_filename != NULL || benchmark_frames > 0)
+        sreSetProfiling(true);
 
     // Enable mouse panning by default for framebuffer back-ends.
     if (sre_internal_backend->flags &
@@ -307,17 +446,23 @@ static void PrintConfigurationInfo() {
         multipass_rendering == true ? "Multi-pass" : "Single-pass");
     if (debug_level > 0)
         sreMessage(SRE_MESSAGE_INFO, "SRE library debug message level = %d.", debug_level);
-    if (benchmark_mode)
+    if (benchmark_frames > 0)
+        sreMessage(SRE_MESSAGE_INFO, "Benchmark mode enabled (%d frames).", benchmark_frames);
+    else if (benchmark_mode)
         sreMessage(SRE_MESSAGE_INFO, "Benchmark mode enabled.");
 }
 
 void sreInitializeApplication(sreApplication *app, int *argc, char ***argv) {
     sreMessage(SRE_MESSAGE_INFO, "Initializing back-end.");
     sre_internal_application = app;
-    if (sre_internal_backend == NULL)
-        sreSelectBackend(SRE_BACKEND_DEFAULT);
     sreBackendSetOptionDefaults();
     sreBackendProcessOptions(argc, argv);
+    if (sre_internal_backend == NULL) {
+        if (headless)
+            sreSelectBackend(SRE_BACKEND_HEADLESS);
+        else
+            sreSelectBackend(SRE_BACKEND_DEFAULT);
+    }
     if (preprocess)
         app->SetFlags(app->GetFlags() | SRE_APPLICATION_FLAG_PREPROCESS);
     sreBackendInitialize(app, argc, argv);
@@ -338,6 +483,7 @@ void sreInitializeApplication(sreApplication *app, int *argc, char ***argv) {
 
 sreApplication::sreApplication() {
     flags = SRE_APPLICATION_FLAG_DISPLAY_FPS | SRE_APPLICATION_FLAG_JUMP_ALLOWED;
+    name = NULL;
     input_acceleration = 0;
     horizontal_acceleration = 100.0f;
     max_horizontal_velocity = 100.0f;
@@ -377,7 +523,13 @@ void sreMainLoop(sreApplication *app) {
             break;
         }
         app->StepBeforeRender(end_time - app->start_time);
-        app->scene->Render(app->view);
+        if (benchmark_mode) {
+            double render_start_time = sre_internal_backend->GetCurrentTime();
+            app->scene->Render(app->view);
+            benchmark_render_time += sre_internal_backend->GetCurrentTime() - render_start_time;
+        }
+        else
+            app->scene->Render(app->view);
 
         app->StepBeforePhysics(end_time - app->start_time);
         time_physics_current = sre_internal_backend->GetCurrentTime();
@@ -411,6 +563,162 @@ void sreMainLoop(sreApplication *app) {
     }    
 }
 
+// Fixed-length benchmark (--benchmark-frames). The demo is advanced at a fixed rate of
+// demo time per frame regardless of the actual frame rate, and when the view is not a
+// scripted look-at view the camera circles the followed object once during the measured
+// frames, so that every run renders the same frames. The first frames are not measured
+// because they include shader loading and cache warm-up.
+
+#define SRE_BENCHMARK_TIME_STEP (1.0 / 60.0)
+#define SRE_BENCHMARK_WARM_UP_FRAMES 30
+
+class sreBenchmarkResults {
+public :
+    int nu_frames;
+    // Frame times in milliseconds, sorted after the run.
+    double *frame_time;
+    // Profiler totals over the frames of which the profile was retrieved.
+    int nu_profiled_frames;
+    bool gpu_timing;
+    double draw_calls;
+    double triangles;
+    double cpu_time[SRE_NU_PROFILE_STAGES];
+    double gpu_time[SRE_NU_PROFILE_STAGES];
+};
+
+static int CompareFrameTimes(const void *e1, const void *e2) {
+    double t1 = *(const double *)e1;
+    double t2 = *(const double *)e2;
+    if (t1 < t2)
+        return - 1;
+    if (t1 > t2)
+        return 1;
+    return 0;
+}
+
+// Nearest-rank percentile of the sorted frame times.
+
+static double FrameTimePercentile(const sreBenchmarkResults& r, double p) {
+    int i = (int)ceil(p * 0.01 * r.nu_frames) - 1;
+    if (i < 0)
+        i = 0;
+    return r.frame_time[i];
+}
+
+static void BenchmarkMainLoop(sreApplication *app) {
+    sreMessage(SRE_MESSAGE_INFO, "Starting benchmark (%d frames).", benchmark_frames);
+    sreBenchmarkResults r;
+    r.nu_frames = 0;
+    r.frame_time = new double[benchmark_frames];
+    r.nu_profiled_frames = 0;
+    r.gpu_timing = false;
+    r.draw_calls = 0;
+    r.triangles = 0;
+    for (int i = 0; i < SRE_NU_PROFILE_STAGES; i++) {
+        r.cpu_time[i] = 0;
+        r.gpu_time[i] = 0;
+    }
+    bool circle_camera = (app->view->GetViewMode() != SRE_VIEW_MODE_LOOK_AT);
+    Vector3D initial_angles;
+    app->view->GetViewAngles(initial_angles);
+    int first_measured_frame = - 1;
+    int last_profiled_frame = - 1;
+    app->start_time = sre_internal_backend->GetCurrentTime();
+    double previous_time = app->start_time;
+    app->stop_signal = 0;
+    for (int i = 0; i < SRE_BENCHMARK_WARM_UP_FRAMES + benchmark_frames; i++) {
+        if (app->stop_signal != 0)
+            break;
+        double demo_time = i * SRE_BENCHMARK_TIME_STEP;
+        int measured_index = i - SRE_BENCHMARK_WARM_UP_FRAMES;
+        if (measured_index == 0)
+            first_measured_frame = sreGetCurrentFrame();
+        if (circle_camera && measured_index >= 0)
+            app->view->SetViewAngles(Vector3D(initial_angles.x, 0, fmodf(initial_angles.z +
+                360.0f * measured_index / benchmark_frames, 360.0f)));
+        app->StepBeforeRender(demo_time);
+        app->scene->Render(app->view);
+        app->StepBeforePhysics(demo_time);
+        if (!(app->flags & SRE_APPLICATION_FLAG_NO_PHYSICS))
+           app->DoPhysics(demo_time, demo_time + SRE_BENCHMARK_TIME_STEP);
+        sre_internal_backend->ProcessGUIEvents();
+        app->ApplyControlObjectInputs(SRE_BENCHMARK_TIME_STEP);
+        double current_time = sre_internal_backend->GetCurrentTime();
+        if (measured_index >= 0) {
+            r.frame_time[r.nu_frames] = (current_time - previous_time) * 1000.0;
+            r.nu_frames++;
+            // The profile lags a few frames behind when GPU timing is used.
+            sreFrameProfileInfo *info = sreGetFrameProfileInfo();
+            if (info != NULL && info->frame >= first_measured_frame &&
+            info->frame != last_profiled_frame) {
+                last_profiled_frame = info->frame;
+                r.nu_profiled_frames++;
+                r.gpu_timing = info->gpu_timing;
+                r.draw_calls += info->draw_calls;
+                r.triangles += info->triangles;
+                for (int j = 0; j < SRE_NU_PROFILE_STAGES; j++) {
+                    r.cpu_time[j] += info->cpu_time[j] * 0.001;
+                    r.gpu_time[j] += info->gpu_time[j] * 0.001;
+                }
+            }
+            delete info;
+        }
+        previous_time = current_time;
+    }
+    if (r.nu_frames == 0) {
+        delete [] r.frame_time;
+        return;
+    }
+
+    double total_time = 0;
+    for (int i = 0; i < r.nu_frames; i++)
+        total_time += r.frame_time[i];
+    qsort(r.frame_time, r.nu_frames, sizeof(double), CompareFrameTimes);
+    double mean = total_time / r.nu_frames;
+    int n = r.nu_profiled_frames > 0 ? r.nu_profiled_frames : 1;
+    const char *name = app->name != NULL ? app->name : "unnamed";
+    sreMessage(SRE_MESSAGE_INFO, "Benchmark %s: %d frames, mean %.3lf ms (%.2lf fps), "
+        "median %.3lf ms, 90th percentile %.3lf ms, 99th percentile %.3lf ms, max %.3lf ms",
+        name, r.nu_frames, mean, 1000.0 / mean, FrameTimePercentile(r, 50),
+        FrameTimePercentile(r, 90), FrameTimePercentile(r, 99), r.frame_time[r.nu_frames - 1]);
+    sreMessage(SRE_MESSAGE_INFO, "Average per frame: %.1lf draw calls, %.0lf triangles",
+        r.draw_calls / n, r.triangles / n);
+    for (int i = 0; i < SRE_NU_PROFILE_STAGES; i++)
+        if (r.cpu_time[i] > 0)
+            sreMessage(SRE_MESSAGE_INFO, "    %-16s CPU %.3lf ms, GPU %.3lf ms",
+                sreGetProfileStageName(i), r.cpu_time[i] / n, r.gpu_time[i] / n);
+
+    // Append the results as a single line of JSON, so that the results of several runs
+    // can be collected in the same file.
+    if (benchmark_output_filename != NULL) {
+        FILE *fp = fopen(benchmark_output_filename, "a");
+        if (fp == NULL)
+            sreMessage(SRE_MESSAGE_WARNING, "Could not open benchmark output file %s.",
+                benchmark_output_filename);
+        else {
+            sreEngineSettingsInfo *info = sreGetEngineSettingsInfo();
+            fprintf(fp, "{\"demo\":\"%s\",\"backend\":\"%s\",\"width\":%d,\"height\":%d,"
+                "\"multi_pass\":%s,\"shadows\":\"%s\",\"frames\":%d,"
+                "\"frame_time_ms\":{\"mean\":%.4lf,\"min\":%.4lf,\"p50\":%.4lf,\"p90\":%.4lf,"
+                "\"p95\":%.4lf,\"p99\":%.4lf,\"max\":%.4lf},"
+                "\"draw_calls\":%.1lf,\"triangles\":%.0lf,\"gpu_timing\":%s,\"stages_ms\":{",
+                name, sre_internal_backend->name, info->window_width, info->window_height,
+                info->multi_pass_rendering ? "true" : "false", info->shadows_description,
+                r.nu_frames, mean, r.frame_time[0], FrameTimePercentile(r, 50),
+                FrameTimePercentile(r, 90), FrameTimePercentile(r, 95), FrameTimePercentile(r, 99),
+                r.frame_time[r.nu_frames - 1], r.draw_calls / n, r.triangles / n,
+                r.gpu_timing ? "true" : "false");
+            for (int i = 0; i < SRE_NU_PROFILE_STAGES; i++)
+                fprintf(fp, "%s\"%s\":{\"cpu\":%.4lf,\"gpu\":%.4lf}", i == 0 ? "" : ",",
+                    sreGetProfileStageName(i), r.cpu_time[i] / n, r.gpu_time[i] / n);
+            fprintf(fp, "}}\n");
+            fclose(fp);
+            delete info;
+        }
+    }
+    delete [] r.frame_time;
+}
+
 void sreRunApplication(sreApplication *app) {
     unsigned int prepare_flags = 0;
     if (app->flags & SRE_APPLICATION_FLAG_PREPROCESS)
@@ -422,13 +730,28 @@ void sreRunApplication(sreApplication *app) {
     if (app->flags & SRE_APPLICATION_FLAG_REUSE_OCTREES)
         prepare_flags |= SRE_PREPARE_REUSE_OCTREES;
     app->scene->PrepareForRendering(prepare_flags);
+    // Start compiling the shaders the scene needs in the background.
+    if (async_shader_loading)
+        app->scene->WarmUpShaders();
     if (!(app->flags & SRE_APPLICATION_FLAG_NO_PHYSICS))
         app->InitializePhysics();
-    sreMainLoop(app);
-    if (benchmark_mode) {
+    if (profile_trace_filename != NULL)
+        sreBeginProfileTrace();
+    if (benchmark_frames > 0)
+        BenchmarkMainLoop(app);
+    else
+        sreMainLoop(app);
+    if (profile_trace_filename != NULL)
+        sreEndProfileTrace(profile_trace_filename);
+    if (benchmark_mode && benchmark_frames == 0) {
        double fps = (double)sreGetCurrentFrame() /
            (sre_internal_backend->GetCurrentTime() - app->start_time);
        sreMessage(SRE_MESSAGE_INFO, "Benchmark result: %.3lf fps", fps);
+       // Compare with --no-vertex-array-objects etc. to measure the effect of
+       // draw call overhead reductions.
+       sreMessage(SRE_MESSAGE_INFO, "Average rendering CPU time per frame "
+           "(excluding buffer swap): %.3lf ms",
+           (benchmark_render_time - benchmark_swap_time) * 1000.0 / sreGetCurrentFrame());
     }
     if (!(app->flags & SRE_APPLICATION_FLAG_NO_PHYSICS))
         app->DestroyPhysics();
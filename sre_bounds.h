@@ -218,6 +218,11 @@ BoundsCheckResult QueryIntersection(const sreBoundingVolumeSphere& sphere,
 // Intersection of a sphere and a convex hull. This test may miss some cases of non-intersection.
 bool Intersects(const sreBoundingVolumeSphere& sphere, const sreBoundingVolumeConvexHull& ch);
 
+// Test up to 32 spheres stored in structure-of-arrays format against a convex hull, returning
+// a bit mask of the spheres that are completely outside.
+unsigned int QuerySpheresOutsideConvexHull(const float *center_x, const float *center_y,
+    const float *center_z, const float *radius, int n, const sreBoundingVolumeConvexHull& ch);
+
 bool Intersects(const sreBoundingVolumeCylinder& cyl, const sreBoundingVolumeConvexHull &ch);
 
 bool Intersects(const sreBoundingVolumeHalfCylinder& hc, const sreBoundingVolumeConvexHull &ch);
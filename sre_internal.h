@@ -63,6 +63,11 @@ extern SRE_GLUINT sre_internal_depth_cube_map_texture[SRE_MAX_CUBE_SHADOW_MAP_LE
 extern SRE_GLUINT sre_internal_cube_shadow_map_framebuffer[SRE_MAX_CUBE_SHADOW_MAP_LEVELS_OPENGL][6];
 extern float sre_internal_depth_cube_map_texture_precision[SRE_MAX_CUBE_SHADOW_MAP_LEVELS_OPENGL];
 extern bool sre_internal_depth_cube_map_texture_is_clear[SRE_MAX_CUBE_SHADOW_MAP_LEVELS_OPENGL][6];
+// Framebuffers with the whole cube map attached as a layered depth attachment.
+extern SRE_GLUINT sre_internal_cube_shadow_map_layered_framebuffer[SRE_MAX_CUBE_SHADOW_MAP_LEVELS_OPENGL];
+extern bool sre_internal_layered_cube_shadow_maps;
+// Whether the lighting shaders use uniform buffer objects for frame and light parameters.
+extern bool sre_internal_uniform_buffers;
 extern SRE_GLUINT sre_internal_HDR_color_texture;
 extern SRE_GLUINT sre_internal_HDR_multisample_framebuffer;
 extern SRE_GLUINT sre_internal_HDR_framebuffer;
@@ -97,6 +102,9 @@ extern int sre_internal_debug_message_level;
 extern int sre_internal_shader_loading_mask;
 extern const char *sre_internal_shader_path;
 extern bool sre_internal_demand_load_shaders;
+extern const char *sre_internal_shader_cache_path;
+extern bool sre_internal_async_shader_loading;
+extern bool sre_internal_profiling;
 extern bool sre_internal_invalidate_geometry_scissors_cache;
 extern bool sre_internal_stencil_buffer_is_clear;
 extern sreScissors sre_internal_last_stencil_scissors_region;
@@ -119,6 +127,26 @@ extern int sre_internal_current_cube_shadow_map_index;
 extern int sre_internal_nu_cube_shadow_map_size_levels;
 extern SRE_GLUINT sre_internal_current_depth_cube_map_texture;
 extern Vector3D sre_internal_current_shadow_map_dimensions;
+extern int sre_internal_shadow_map_cascades;
+extern int sre_internal_shadow_map_cache_mode;
+// The texture of the current (non-cube) shadow map.
+extern SRE_GLUINT sre_internal_current_shadow_map_texture;
+// Number of directional light shadow map cascades, followed by the scale (x, y, z) and
+// offset (x, y, z) that convert shadow map coordinates of the first cascade to those of
+// each cascade.
+extern float sre_internal_shadow_map_cascade_parameters[1 + SRE_MAX_SHADOW_MAP_CASCADES * 6];
+// Size of the shadow map atlas (zero when disabled), and the atlas tile used by the current
+// spot or beam light shadow map: its size in pixels (zero when the light does not use the
+// atlas) and its scale and offset (x, y) relative to the atlas.
+extern int sre_internal_shadow_map_atlas_size;
+extern SRE_GLUINT sre_internal_shadow_map_atlas_texture;
+extern int sre_internal_current_shadow_map_atlas_tile_size;
+extern float sre_internal_shadow_map_atlas_tile_parameters[3];
+extern int sre_internal_nu_worker_threads;
+extern int sre_internal_shadow_volume_cache_budget;
+// Lighting pass batching statistics for the current frame and the last frame.
+extern sreLightingPassBatchingInfo sre_internal_lighting_pass_stats;
+extern sreLightingPassBatchingInfo sre_internal_lighting_pass_stats_last_frame;
 
 extern Matrix3D *sre_internal_standard_UV_transformation_matrix;
 
@@ -142,6 +170,9 @@ SRE_LOCAL void GL3SetBillboard(sreObject *so);
 SRE_LOCAL void GL3SetBillboardBounds(sreObject *so);
 SRE_LOCAL void GL3SetParticleSystem(sreObject *so);
 SRE_LOCAL void GL3SetParticleSystemBounds(sreObject *so);
+SRE_LOCAL void GL3EnableBillboardAttribute(const sreLODModel *m, int attribute);
+SRE_LOCAL void sreInitializeVertexArrayObjects();
+SRE_LOCAL void sreUnbindVertexArrayObject();
 
 // draw_object.cpp
 
@@ -150,10 +181,13 @@ SRE_LOCAL void sreDrawObjectSinglePass(sreObject *so);
 SRE_LOCAL void sreDrawObjectFinalPass(sreObject *so);
 SRE_LOCAL void sreDrawObjectAmbientPass(sreObject *so);
 SRE_LOCAL void sreDrawObjectMultiPassLightingPass(sreObject *so, bool shadow_map_required);
+SRE_LOCAL bool sreDrawObjectsInstanced(sreObject **so, int nu_objects, bool ambient_pass,
+    bool shadow_map_required);
 
 // shader_uniform.cpp
 
 SRE_LOCAL void GL3InitializeShadersBeforeFrame();
+SRE_LOCAL void sreWarmUpObjectShaders(sreObject& so, sreLight *light);
 SRE_LOCAL void GL3InitializeShadersBeforeLight();
 SRE_LOCAL void GL3InitializeCubeShadowMapShadersBeforeLight();
 SRE_LOCAL void GL3InitializeShadowMapShadersBeforeLight(const Vector4D& dim);
@@ -168,7 +202,16 @@ SRE_LOCAL void GL3InitializeCubeShadowMapShader(const sreObject& so);
 SRE_LOCAL void sreUpdateShadowMapSegmentDistanceScaling(float segment_distance_scaling);
 SRE_LOCAL void sreUpdateShadowMapNearPlaneDistance(float n);
 SRE_LOCAL void GL3InitializeCubeShadowMapShadersWithSegmentDistanceScaling();
+SRE_LOCAL void GL3InitializeLayeredCubeShadowMapShadersWithFaceMatrices(const Matrix4D *face_matrix);
+SRE_LOCAL void GL3InitializeLayeredCubeShadowMapShader(const sreObject& so, int segment_mask);
 SRE_LOCAL void sreBindShadowMapTexture(sreLight *light);
+// Binding points of the uniform buffers shared by the lighting shaders.
+#define SRE_FRAME_UNIFORM_BUFFER_BINDING 0
+#define SRE_LIGHT_UNIFORM_BUFFER_BINDING 1
+#define SRE_OBJECT_UNIFORM_BUFFER_BINDING 2
+SRE_LOCAL void sreInitializeUniformBuffers();
+SRE_LOCAL void sreBeginLightingPassStateFiltering();
+SRE_LOCAL void sreEndLightingPassStateFiltering();
 SRE_LOCAL void GL3InitializeHDRLogLuminanceShader();
 SRE_LOCAL void GL3InitializeHDRAverageLuminanceShader();
 SRE_LOCAL void GL3InitializeHDRAverageLuminanceShaderWithLogLuminanceTexture();
@@ -176,6 +219,9 @@ SRE_LOCAL void GL3InitializeHDRAverageLuminanceShaderWithAverageLuminanceTexture
 SRE_LOCAL void GL3InitializeHDRLuminanceHistoryStorageShader();
 SRE_LOCAL void GL3InitializeHDRLuminanceHistoryComparisonShader(int slot);
 SRE_LOCAL void GL3InitializeHDRToneMapShader();
+SRE_LOCAL void GL3InitializeDeferredShadingCompositeShader();
+SRE_LOCAL void GL3InitializeDeferredShadingLightShader(int shader_index,
+    const Matrix4D& inverse_view_projection_matrix);
 SRE_LOCAL void GL3InitializeOldTextShader(Color *colorp);
 
 enum {
@@ -248,9 +294,13 @@ SRE_LOCAL void sreReportShadowCacheStats();
 SRE_LOCAL void sreResetShadowCacheStats();
 SRE_LOCAL void sreSetShadowCacheStatsInfo(sreShadowRenderingInfo *info);
 SRE_LOCAL void sreClearShadowCache();
+SRE_LOCAL void sreResizeShadowCache(int object_cache_entries, int model_cache_entries);
 
 // Defined in shadowmap.cpp:
 SRE_LOCAL bool GL3RenderShadowMapWithOctree(sreScene *scene, sreLight& light, sreFrustum &frustum);
+SRE_LOCAL void sreDetermineShadowCastersForActiveLights(sreScene *scene, sreFrustum& frustum);
+SRE_LOCAL void sreFreeShadowCasterSets();
+SRE_LOCAL void sreRenderShadowMapAtlas(sreScene *scene, sreFrustum& frustum);
 SRE_LOCAL void sreVisualizeDirectionalLightShadowMap(int light_index);
 SRE_LOCAL void sreVisualizeCubeMap(int light_index);
 SRE_LOCAL void sreVisualizeBeamOrSpotLightShadowMap(int light_index);
@@ -258,6 +308,225 @@ SRE_LOCAL void sreVisualizeBeamOrSpotLightShadowMap(int light_index);
 // Defined is lights.cpp:
 SRE_LOCAL void sreInitializeInternalShadowVolume();
 
+// Defined in thread_pool.cpp:
+// Job function called for each job; thread_index identifies the thread that runs the
+// job (0 is the rendering thread) and can be used to select per-thread scratch memory.
+typedef void (*sreThreadPoolJobFunc)(void *data, int job_index, int thread_index);
+SRE_LOCAL int sreGetThreadPoolSize();
+SRE_LOCAL void sreRunThreadPoolJobs(sreThreadPoolJobFunc func, void *data, int nu_jobs);
+SRE_LOCAL void sreDestroyThreadPool();
+
+// Defined in stream_buffer.cpp:
+// Ring buffer from which dynamic per-frame vertex and element data is sub-allocated.
+#define SRE_STREAMING_BUFFER_FAILED 0xFFFFFFFF
+extern SRE_GLUINT sre_internal_streaming_buffer;
+SRE_LOCAL void sreInitializeStreamingBuffer();
+SRE_LOCAL void sreStreamingBufferNextFrame();
+SRE_LOCAL void *sreMapStreamingBuffer(int size, unsigned int& offset);
+SRE_LOCAL void sreUnmapStreamingBuffer();
+SRE_LOCAL unsigned int sreUploadToStreamingBuffer(const void *data, int size);
+
+// Defined in occlusion.cpp:
+// Objects with fewer triangles (in the most detailed LOD model) than this are not
+// checked with occlusion queries.
+#define SRE_OCCLUSION_QUERY_MIN_TRIANGLES 256
+// The occlusion state of the nodes of the static octree (indexed by node index), and the
+// octree it applies to.
+extern const sreFastOctree *sre_internal_occlusion_octree;
+extern sreOcclusionQueryState *sre_internal_octree_node_occlusion_state;
+SRE_LOCAL void sreInitializeOcclusionQueries();
+SRE_LOCAL void sreUpdateOcclusionQueryResults(sreScene *scene);
+SRE_LOCAL void sreIssueOcclusionQueries(sreScene *scene);
+SRE_LOCAL void sreDestroyOcclusionQuery(sreOcclusionQueryState& state);
+
+// Called during visible entity determination for an entity that is inside the view
+// frustum. Returns whether the entity was found to be occluded by the most recent query.
+// An entity that was not a candidate in the previous frame (because it was outside the
+// frustum or inside an occluded octree node) is assumed to be visible until it has
+// been queried again. Only the state itself is updated, so this function can be called
+// from multiple threads for different entities.
+
+static inline bool sreCheckOccluded(sreOcclusionQueryState& state) {
+    if (state.most_recent_frame_candidate != sre_internal_current_frame - 1)
+        state.occluded = false;
+    state.most_recent_frame_candidate = sre_internal_current_frame;
+    return state.occluded;
+}
+
+// Defined in software_occlusion.cpp:
+SRE_LOCAL void sreRasterizeOccluders(sreScene *scene, const sreFrustum& frustum);
+SRE_LOCAL bool sreIsOccludedBySoftwareDepthBuffer(const sreBoundingVolumeAABB& AABB);
+SRE_LOCAL bool sreIsOccludedBySoftwareDepthBuffer(const sreObject& so);
+
+// Defined in clustered_lighting.cpp:
+// Dimensions of the cluster grid used for clustered forward lighting (screen tiles in x
+// and y, exponentially distributed depth slices in z).
+#define SRE_CLUSTER_GRID_X 16
+#define SRE_CLUSTER_GRID_Y 8
+#define SRE_CLUSTER_GRID_Z 24
+#define SRE_NU_CLUSTERS (SRE_CLUSTER_GRID_X * SRE_CLUSTER_GRID_Y * SRE_CLUSTER_GRID_Z)
+// Maximum number of lights that are applied in clustered lighting.
+#define SRE_MAX_CLUSTERED_LIGHTS 1024
+// Texture units of the light data and light list texture buffers.
+#define SRE_CLUSTER_LIGHT_DATA_TEXTURE_UNIT 5
+#define SRE_CLUSTER_LIGHT_LIST_TEXTURE_UNIT 6
+SRE_LOCAL void sreInitializeClusteredLighting();
+SRE_LOCAL void sreAssignLightsToClusters(sreScene *scene);
+SRE_LOCAL void GL3InitializeShaderWithClusterParameters(int loc);
+
+// Defined in deferred_shading.cpp:
+// G-buffer textures, bound to consecutive texture units starting at
+// SRE_GBUFFER_TEXTURE_UNIT during the deferred light and composite passes.
+enum {
+    SRE_GBUFFER_DIFFUSE = 0,
+    SRE_GBUFFER_SPECULAR,
+    SRE_GBUFFER_NORMAL,
+    SRE_GBUFFER_BASE_COLOR,
+    SRE_GBUFFER_DEPTH,
+    SRE_NU_GBUFFER_TEXTURES
+};
+#define SRE_GBUFFER_TEXTURE_UNIT 5
+// Zero when deferred shading is not supported.
+extern SRE_GLUINT sre_internal_gbuffer_framebuffer;
+SRE_LOCAL void sreInitializeDeferredShading();
+SRE_LOCAL void sreResizeDeferredShading();
+
+// Defined in profiler.cpp:
+SRE_LOCAL void sreInitializeProfiler();
+SRE_LOCAL void sreProfilerBeginFrame();
+SRE_LOCAL void sreProfilerEndFrame();
+SRE_LOCAL int sreProfilerBeginEvent(int stage, int light_index);
+SRE_LOCAL void sreProfilerEndEvent(int event);
+
+// Draw calls and triangles of the current frame, counted only when profiling is enabled.
+extern int sre_internal_profile_draw_calls;
+extern int sre_internal_profile_triangles;
+
+static inline void sreProfilerCountDraw(int nu_triangles) {
+    if (sre_internal_profiling) {
+        sre_internal_profile_draw_calls++;
+        sre_internal_profile_triangles += nu_triangles;
+    }
+}
+
+// Records a profile event for the lifetime of the object (when profiling is enabled).
+
+class sreProfilerScope {
+    int event;
+public :
+    sreProfilerScope(int stage, int light_index = - 1) {
+        if (sre_internal_profiling)
+            event = sreProfilerBeginEvent(stage, light_index);
+        else
+            event = - 1;
+    }
+    ~sreProfilerScope() {
+        if (event >= 0)
+            sreProfilerEndEvent(event);
+    }
+};
+
+// Defined in shadow_map_cache.cpp:
+// Persistent per-light shadow maps for spot, beam and point source lights.
+#define SRE_SHADOW_MAP_CACHE_SLOTS 8
+enum { SRE_SHADOW_MAP_CACHE_SLOT_2D, SRE_SHADOW_MAP_CACHE_SLOT_CUBE };
+
+class sreShadowMapCacheSlot {
+public :
+    const sreScene *scene;
+    int light_id;
+    int type;
+    // Shadow map size level of the textures (only decreases while they exist).
+    int level;
+    SRE_GLUINT texture;
+    SRE_GLUINT framebuffer[6];
+    // Static layer with only the static shadow casters (zero when not used).
+    SRE_GLUINT static_texture;
+    SRE_GLUINT static_framebuffer[6];
+    // The light parameters and shadow casters when the shadow map was rendered. The
+    // static layer is valid for the same light parameters and static shadow casters.
+    Vector4D light_vector;
+    Vector4D light_spotlight;
+    Vector3D light_attenuation;
+    int nu_static_casters;
+    unsigned int static_caster_hash;
+    int nu_dynamic_casters;
+    unsigned int dynamic_caster_hash;
+    float near_plane_distance;
+    bool valid;
+    bool static_layer_valid;
+    // The frame in which the shadow map was rendered.
+    int frame;
+    int most_recent_use;
+};
+
+SRE_LOCAL sreShadowMapCacheSlot *sreGetShadowMapCacheSlot(const sreScene *scene,
+    const sreLight& light, int type, int level);
+SRE_LOCAL void sreCopyShadowMapCacheStaticLayer(sreShadowMapCacheSlot *slot);
+SRE_LOCAL void sreClearShadowMapCache();
+
+// Defined in shadow_map_atlas.cpp:
+
+// Smallest atlas tile relative to the atlas size (1 / 2^depth).
+#define SRE_SHADOW_MAP_ATLAS_MAX_DEPTH 6
+#define SRE_MIN_SHADOW_MAP_ATLAS_TILE_SIZE 64
+
+class sreShadowMapAtlasTile {
+public :
+    int x, y;
+    int size;
+};
+
+SRE_LOCAL bool sreAllocateShadowMapAtlasTile(int size, sreShadowMapAtlasTile& tile);
+SRE_LOCAL void sreResetShadowMapAtlas();
+SRE_LOCAL bool sreShadowMapAtlasIsFull();
+SRE_LOCAL void sreBeginShadowMapAtlas();
+SRE_LOCAL void sreBindShadowMapAtlasTile(const sreShadowMapAtlasTile& tile);
+SRE_LOCAL void sreDestroyShadowMapAtlas();
+
+// Defined in bvh.cpp:
+// Bounding volume hierarchy (binary tree of AABBs) for dynamic objects. Leaf nodes hold
+// a single object with bounds that are enlarged by a margin so that small movements do
+// not require an update. When an object moves outside its leaf bounds, the leaf and its
+// ancestors are refitted; when the tree quality has degraded too much due to refitting,
+// it is rebuilt. Nodes are stored in depth-first order with the root at index 0.
+
+// The minimum number of dynamic objects for which a BVH is created.
+#define SRE_MIN_DYNAMIC_OBJECT_BVH_OBJECTS 16
+
+class sreObjectBVHNode {
+public :
+    // AABB and bounding sphere, compatible with octree node intersection tests.
+    sreOctreeNodeBounds bounds;
+    int parent;
+    // Child node indices, or - 1 for a leaf node.
+    int child[2];
+    // Scene object index for a leaf node.
+    int object_index;
+    bool changed;
+};
+
+class sreObjectBVH {
+public :
+    sreObjectBVHNode *node;
+    int nu_nodes;
+    // Leaf node index for every scene object index, - 1 when the object is not in the BVH.
+    int *leaf_node;
+    int max_object_index;
+    // Leaf nodes of objects that have changed since the last update.
+    int *changed_leaf;
+    int nu_changed_leafs;
+    // Sum of the surface areas of the node AABBs directly after creation and currently.
+    float build_cost;
+    float cost;
+
+    sreObjectBVH();
+    ~sreObjectBVH();
+    void Build(const sreScene& scene, int nu_objects, const int *object_index);
+    void MarkObjectChanged(int object_index);
+    void Update(const sreScene& scene);
+};
+
 // Image data structure for mipmaps.
 
 class sreMipmapImage {
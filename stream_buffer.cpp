@@ -0,0 +1,210 @@
+/*
+
+Copyright (c) 2014 Harm Hanemaaijer <fgenfb@yahoo.com>
+
+Permission to use, copy, modify, and/or distribute this software for any
+purpose with or without fee is hereby granted, provided that the above
+copyright notice and this permission notice appear in all copies.
+
+THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+
+*/
+
+// Streaming buffer for dynamic per-frame geometry (shadow volume element indices,
+// billboard and particle system vertices).
+//
+// Instead of re-specifying the data store of a buffer object with glBufferData for every
+// draw, which may stall the driver, the data is sub-allocated from one large buffer object
+// that is divided into SRE_STREAMING_BUFFER_SEGMENTS segments used in round-robin fashion,
+// one segment per frame. A fence is inserted after the commands of a frame, and before a
+// segment is reused the CPU waits for the fence of the frame that last used it, which will
+// normally already have been signaled.
+//
+// When GL_ARB_buffer_storage (OpenGL 4.4) is available, the buffer is persistently and
+// coherently mapped, so that writing data is just a memory copy. Otherwise, each
+// allocation is mapped with glMapBufferRange using GL_MAP_UNSYNCHRONIZED_BIT, which is
+// safe because of the fences.
+//
+// When the current segment is full, or the streaming buffer is not available (OpenGL-ES
+// 2.0, or OpenGL without GL_ARB_sync), allocation fails and the caller falls back to
+// uploading into its own buffer object.
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#ifdef OPENGL_ES2
+#include <GLES2/gl2.h>
+#endif
+#ifdef OPENGL
+#include <GL/glew.h>
+#include <GL/gl.h>
+#endif
+
+#include "sre.h"
+#include "sre_internal.h"
+
+#define SRE_STREAMING_BUFFER_SEGMENTS 3
+#define SRE_STREAMING_BUFFER_SEGMENT_SIZE (4 * 1024 * 1024)
+// Allocations are aligned so that any vertex attribute or index type can be used.
+#define SRE_STREAMING_BUFFER_ALIGNMENT 16
+// Maximum time to wait for a fence, in nanoseconds.
+#define SRE_STREAMING_BUFFER_FENCE_TIMEOUT 1000000000
+
+// The buffer object name, 0 when the streaming buffer is not available.
+SRE_GLUINT sre_internal_streaming_buffer = 0;
+
+#ifndef OPENGL_ES2
+
+static bool persistent_mapping;
+static unsigned char *persistent_pointer;
+static GLsync segment_fence[SRE_STREAMING_BUFFER_SEGMENTS];
+static int current_segment;
+// Offset of the first free byte in the current segment.
+static unsigned int segment_offset;
+// The number of allocations that failed because the current segment was full, and
+// the number of times the CPU had to wait for the GPU before reusing a segment.
+static int nu_overflows;
+static int nu_stalls;
+
+#endif
+
+void sreInitializeStreamingBuffer() {
+#ifdef OPENGL_ES2
+    sreMessage(SRE_MESSAGE_INFO, "Streaming buffer not supported with OpenGL-ES 2.0.");
+#else
+    if (!GLEW_VERSION_3_2 && !(GLEW_ARB_sync && GLEW_ARB_map_buffer_range &&
+    GLEW_ARB_copy_buffer)) {
+        sreMessage(SRE_MESSAGE_INFO, "Streaming buffer not available (requires GL_ARB_sync).");
+        return;
+    }
+    persistent_mapping = GLEW_VERSION_4_4 || GLEW_ARB_buffer_storage;
+    int total_size = SRE_STREAMING_BUFFER_SEGMENTS * SRE_STREAMING_BUFFER_SEGMENT_SIZE;
+    glGenBuffers(1, &sre_internal_streaming_buffer);
+    // Use the copy write target so that the array and element buffer bindings are
+    // not disturbed.
+    glBindBuffer(GL_COPY_WRITE_BUFFER, sre_internal_streaming_buffer);
+    if (persistent_mapping) {
+        GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+        glBufferStorage(GL_COPY_WRITE_BUFFER, total_size, NULL, flags);
+        persistent_pointer = (unsigned char *)glMapBufferRange(GL_COPY_WRITE_BUFFER, 0,
+            total_size, flags);
+        if (persistent_pointer == NULL) {
+            sreMessage(SRE_MESSAGE_WARNING, "Persistent mapping of streaming buffer failed.");
+            glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+            glDeleteBuffers(1, &sre_internal_streaming_buffer);
+            sre_internal_streaming_buffer = 0;
+            return;
+        }
+    }
+    else
+        glBufferData(GL_COPY_WRITE_BUFFER, total_size, NULL, GL_STREAM_DRAW);
+    glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+    CHECK_GL_ERROR("Error after creating streaming buffer.\n");
+    for (int i = 0; i < SRE_STREAMING_BUFFER_SEGMENTS; i++)
+        segment_fence[i] = 0;
+    current_segment = 0;
+    segment_offset = 0;
+    nu_overflows = 0;
+    nu_stalls = 0;
+    sre_internal_rendering_flags |= SRE_RENDERING_FLAG_USE_STREAMING_BUFFER;
+    sreMessage(SRE_MESSAGE_INFO, "Streaming buffer of %d x %d KB enabled (%s).",
+        SRE_STREAMING_BUFFER_SEGMENTS, SRE_STREAMING_BUFFER_SEGMENT_SIZE / 1024,
+        persistent_mapping ? "persistent mapping" : "unsynchronized mapping");
+#endif
+}
+
+// Called at the start of every frame. Fences the commands of the previous frame and
+// switches to the next segment.
+
+void sreStreamingBufferNextFrame() {
+#ifndef OPENGL_ES2
+    if (sre_internal_streaming_buffer == 0 || segment_offset == 0)
+        // Nothing was allocated during the previous frame; keep using the same segment.
+        return;
+    segment_fence[current_segment] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+    current_segment++;
+    if (current_segment == SRE_STREAMING_BUFFER_SEGMENTS)
+        current_segment = 0;
+    segment_offset = 0;
+    GLsync fence = segment_fence[current_segment];
+    if (fence == 0)
+        return;
+    GLenum status = glClientWaitSync(fence, 0, 0);
+    if (status == GL_TIMEOUT_EXPIRED) {
+        // The GPU is more than SRE_STREAMING_BUFFER_SEGMENTS - 1 frames behind.
+        nu_stalls++;
+        status = glClientWaitSync(fence, GL_SYNC_FLUSH_COMMANDS_BIT,
+            SRE_STREAMING_BUFFER_FENCE_TIMEOUT);
+        if (status == GL_TIMEOUT_EXPIRED || status == GL_WAIT_FAILED)
+            sreMessage(SRE_MESSAGE_WARNING, "Waiting for streaming buffer fence failed.");
+    }
+    glDeleteSync(fence);
+    segment_fence[current_segment] = 0;
+    if (sre_internal_current_frame % 1000 == 0 && (nu_overflows > 0 || nu_stalls > 0)) {
+        sreMessage(SRE_MESSAGE_LOG, "Streaming buffer: %d overflows, %d stalls in the last "
+            "1000 frames.", nu_overflows, nu_stalls);
+        nu_overflows = 0;
+        nu_stalls = 0;
+    }
+#endif
+}
+
+// Allocate size bytes from the current segment and return a pointer to write the data to,
+// with the offset of the data in the buffer object in offset. Returns NULL when the data
+// does not fit or the streaming buffer is not in use. When a pointer is returned,
+// sreUnmapStreamingBuffer() must be called after writing the data and before drawing.
+
+void *sreMapStreamingBuffer(int size, unsigned int& offset) {
+#ifdef OPENGL_ES2
+    return NULL;
+#else
+    if (sre_internal_streaming_buffer == 0 ||
+    !(sre_internal_rendering_flags & SRE_RENDERING_FLAG_USE_STREAMING_BUFFER))
+        return NULL;
+    if (segment_offset + size > SRE_STREAMING_BUFFER_SEGMENT_SIZE) {
+        nu_overflows++;
+        return NULL;
+    }
+    offset = current_segment * SRE_STREAMING_BUFFER_SEGMENT_SIZE + segment_offset;
+    segment_offset += (size + SRE_STREAMING_BUFFER_ALIGNMENT - 1) &
+        ~(SRE_STREAMING_BUFFER_ALIGNMENT - 1);
+    if (persistent_mapping)
+        return persistent_pointer + offset;
+    glBindBuffer(GL_COPY_WRITE_BUFFER, sre_internal_streaming_buffer);
+    // The range cannot be in use by the GPU because of the segment fences.
+    void *pointer = glMapBufferRange(GL_COPY_WRITE_BUFFER, offset, size,
+        GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_RANGE_BIT | GL_MAP_UNSYNCHRONIZED_BIT);
+    if (pointer == NULL)
+        glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+    return pointer;
+#endif
+}
+
+void sreUnmapStreamingBuffer() {
+#ifndef OPENGL_ES2
+    if (persistent_mapping)
+        // The mapping is coherent, so the data is visible to the GPU.
+        return;
+    glUnmapBuffer(GL_COPY_WRITE_BUFFER);
+    glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+#endif
+}
+
+// Copy data into the streaming buffer. Returns the offset in the buffer object, or
+// SRE_STREAMING_BUFFER_FAILED when the data could not be allocated.
+
+unsigned int sreUploadToStreamingBuffer(const void *data, int size) {
+    unsigned int offset;
+    void *pointer = sreMapStreamingBuffer(size, offset);
+    if (pointer == NULL)
+        return SRE_STREAMING_BUFFER_FAILED;
+    memcpy(pointer, data, size);
+    sreUnmapStreamingBuffer();
+    return offset;
+}
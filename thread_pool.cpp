@@ -0,0 +1,165 @@
+/*
+
+Copyright (c) 2014 Harm Hanemaaijer <fgenfb@yahoo.com>
+
+Permission to use, copy, modify, and/or distribute this software for any
+purpose with or without fee is hereby granted, provided that the above
+copyright notice and this permission notice appear in all copies.
+
+THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+
+*/
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <pthread.h>
+#include <unistd.h>
+
+#include "sre.h"
+#include "sre_internal.h"
+
+// This file implements a simple pool of worker threads that is used to spread
+// CPU-bound engine tasks (such as visible entity determination) over multiple cores.
+// A task is split into a number of independent jobs; the rendering thread queues
+// the jobs, takes part in processing them and returns when all jobs have finished.
+// Jobs must not make OpenGL calls, since the GL context is only current in the
+// rendering thread.
+
+#define SRE_MAX_WORKER_THREADS 16
+
+// The number of worker threads in the pool (not counting the rendering thread).
+// A value of - 1 means that the pool has not been created yet.
+static int nu_worker_threads = - 1;
+static pthread_t worker_thread[SRE_MAX_WORKER_THREADS];
+static pthread_mutex_t pool_mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t work_available_cond = PTHREAD_COND_INITIALIZER;
+static pthread_cond_t work_finished_cond = PTHREAD_COND_INITIALIZER;
+// State of the current set of jobs, protected by pool_mutex.
+static sreThreadPoolJobFunc job_func;
+static void *job_data;
+static int nu_jobs;
+static int next_job;
+static int nu_jobs_finished;
+// Incremented each time a new set of jobs is queued so that waiting threads can
+// detect new work.
+static unsigned int job_generation = 0;
+static bool pool_quit = false;
+
+// Take jobs from the current set and run them until none are left. Called with
+// the mutex locked; returns with the mutex locked.
+
+static void ProcessJobs(int thread_index) {
+    while (next_job < nu_jobs) {
+        int job_index = next_job;
+        next_job++;
+        sreThreadPoolJobFunc func = job_func;
+        void *data = job_data;
+        pthread_mutex_unlock(&pool_mutex);
+        func(data, job_index, thread_index);
+        pthread_mutex_lock(&pool_mutex);
+        nu_jobs_finished++;
+        if (nu_jobs_finished == nu_jobs)
+            pthread_cond_signal(&work_finished_cond);
+    }
+}
+
+static void *WorkerThreadMain(void *arg) {
+    // The rendering thread uses thread index 0.
+    int thread_index = (int)(long)arg + 1;
+    unsigned int generation = 0;
+    pthread_mutex_lock(&pool_mutex);
+    for (;;) {
+        while (job_generation == generation && !pool_quit)
+            pthread_cond_wait(&work_available_cond, &pool_mutex);
+        if (pool_quit)
+            break;
+        generation = job_generation;
+        ProcessJobs(thread_index);
+    }
+    pthread_mutex_unlock(&pool_mutex);
+    return NULL;
+}
+
+static int DetermineDefaultNumberOfWorkerThreads() {
+#ifdef _SC_NPROCESSORS_ONLN
+    long nu_processors = sysconf(_SC_NPROCESSORS_ONLN);
+    if (nu_processors > 1)
+        return (int)nu_processors - 1;
+#endif
+    return 0;
+}
+
+static void CreateThreadPool() {
+    int n = sre_internal_nu_worker_threads;
+    if (n < 0)
+        n = DetermineDefaultNumberOfWorkerThreads();
+    if (n > SRE_MAX_WORKER_THREADS)
+        n = SRE_MAX_WORKER_THREADS;
+    pool_quit = false;
+    nu_worker_threads = 0;
+    for (int i = 0; i < n; i++) {
+        if (pthread_create(&worker_thread[i], NULL, WorkerThreadMain, (void *)(long)i) != 0) {
+            sreMessage(SRE_MESSAGE_WARNING, "Could not create worker thread %d.", i);
+            break;
+        }
+        nu_worker_threads++;
+    }
+    sreMessage(SRE_MESSAGE_INFO, "Created thread pool with %d worker threads.", nu_worker_threads);
+}
+
+void sreDestroyThreadPool() {
+    if (nu_worker_threads < 0)
+        return;
+    pthread_mutex_lock(&pool_mutex);
+    pool_quit = true;
+    pthread_cond_broadcast(&work_available_cond);
+    pthread_mutex_unlock(&pool_mutex);
+    for (int i = 0; i < nu_worker_threads; i++)
+        pthread_join(worker_thread[i], NULL);
+    nu_worker_threads = - 1;
+}
+
+// Return the number of threads that may concurrently run jobs, including the
+// rendering thread. Thread indices passed to job functions are in the range
+// [0, sreGetThreadPoolSize() - 1]. The pool is created if required.
+
+int sreGetThreadPoolSize() {
+    if (nu_worker_threads < 0)
+        CreateThreadPool();
+    return nu_worker_threads + 1;
+}
+
+// Run n jobs using the thread pool. func is called for every job index from 0 to n - 1
+// with the supplied data pointer; the order in which jobs are started is the same as
+// the job index order, but jobs may finish in any order. Returns when all jobs have
+// finished. Must only be called from the rendering thread.
+
+void sreRunThreadPoolJobs(sreThreadPoolJobFunc func, void *data, int n) {
+    if (n <= 0)
+        return;
+    if (sreGetThreadPoolSize() == 1 || n == 1) {
+        // Just run the jobs in the rendering thread.
+        for (int i = 0; i < n; i++)
+            func(data, i, 0);
+        return;
+    }
+    pthread_mutex_lock(&pool_mutex);
+    job_func = func;
+    job_data = data;
+    nu_jobs = n;
+    next_job = 0;
+    nu_jobs_finished = 0;
+    job_generation++;
+    pthread_cond_broadcast(&work_available_cond);
+    // The rendering thread also processes jobs.
+    ProcessJobs(0);
+    while (nu_jobs_finished < nu_jobs)
+        pthread_cond_wait(&work_finished_cond, &pool_mutex);
+    pthread_mutex_unlock(&pool_mutex);
+}
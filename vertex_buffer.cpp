@@ -27,6 +27,8 @@ OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
 #include <float.h>
 #ifdef OPENGL_ES2
 #include <GLES2/gl2.h>
+#include <GLES2/gl2ext.h>
+#include <EGL/egl.h>
 #endif
 #ifdef OPENGL
 #include <GL/glew.h>
@@ -267,6 +269,8 @@ void sreLODModel::UploadToGPU(int attribute_mask, int dynamic_flags) {
     // This is not the best place to initialize this table (which is used when drawing objects).
     if (!attribute_list_table_initialized)
         sreGenerateAttributeListTable();
+    // Any cached vertex array objects may refer to buffers that are being replaced.
+    DeleteVertexArrayObjects();
 
     bool shadow =
         (sre_internal_rendering_flags & SRE_RENDERING_FLAG_SHADOW_VOLUME_SUPPORT)
@@ -478,11 +482,132 @@ void sreLODModel::DeleteFromGPU() {
          mask >>= 8;
     }
     glDeleteBuffers(1, &GL_element_buffer);
+    DeleteVertexArrayObjects();
+}
+
+// Vertex array objects. The vertex attribute pointers and element buffer binding of a
+// LOD model are recorded in a vertex array object the first time the model is drawn with
+// a particular object attribute configuration, so that subsequent draws only have to bind
+// it. The vertex array object is always unbound after drawing, so that code that sets up
+// vertex attributes directly (shadow volumes, billboards, text and HDR rendering) uses the
+// default vertex array object and cannot modify a cached one.
+
+#ifdef OPENGL_ES2
+// With OpenGL-ES 2.0, the functions of the GL_OES_vertex_array_object extension are
+// obtained at run-time.
+static PFNGLGENVERTEXARRAYSOESPROC glGenVertexArraysOES_function = NULL;
+static PFNGLBINDVERTEXARRAYOESPROC glBindVertexArrayOES_function = NULL;
+static PFNGLDELETEVERTEXARRAYSOESPROC glDeleteVertexArraysOES_function = NULL;
+#define glGenVertexArrays glGenVertexArraysOES_function
+#define glBindVertexArray glBindVertexArrayOES_function
+#define glDeleteVertexArrays glDeleteVertexArraysOES_function
+#endif
+
+void sreInitializeVertexArrayObjects() {
+#ifdef OPENGL_ES2
+    const char *extensions_str = (const char *)glGetString(GL_EXTENSIONS);
+    if (strstr(extensions_str, "GL_OES_vertex_array_object") != NULL) {
+        glGenVertexArraysOES_function = (PFNGLGENVERTEXARRAYSOESPROC)
+            eglGetProcAddress("glGenVertexArraysOES");
+        glBindVertexArrayOES_function = (PFNGLBINDVERTEXARRAYOESPROC)
+            eglGetProcAddress("glBindVertexArrayOES");
+        glDeleteVertexArraysOES_function = (PFNGLDELETEVERTEXARRAYSOESPROC)
+            eglGetProcAddress("glDeleteVertexArraysOES");
+    }
+    if (glGenVertexArraysOES_function == NULL || glBindVertexArrayOES_function == NULL ||
+    glDeleteVertexArraysOES_function == NULL) {
+        sreMessage(SRE_MESSAGE_INFO,
+            "Vertex array objects not available (requires GL_OES_vertex_array_object).");
+        return;
+    }
+#else
+    if (!GLEW_VERSION_3_0 && !GLEW_ARB_vertex_array_object) {
+        sreMessage(SRE_MESSAGE_INFO,
+            "Vertex array objects not available (requires GL_ARB_vertex_array_object).");
+        return;
+    }
+#endif
+    sre_internal_rendering_flags |= SRE_RENDERING_FLAG_VERTEX_ARRAY_OBJECT_SUPPORT |
+        SRE_RENDERING_FLAG_USE_VERTEX_ARRAY_OBJECTS;
+    sreMessage(SRE_MESSAGE_INFO, "Vertex array objects enabled.");
+}
+
+int sreLODModel::BindVertexArrayObject(const sreObjectAttributeInfo *info) {
+    if (!(sre_internal_rendering_flags & SRE_RENDERING_FLAG_USE_VERTEX_ARRAY_OBJECTS))
+        return SRE_VERTEX_ARRAY_OBJECT_NONE;
+    // The number of attribute configurations per model is small (ambient pass, lighting
+    // pass, shadow map lighting pass and single pass), so a linear search suffices.
+    for (int i = 0; i < nu_vertex_array_objects; i++)
+        if (vertex_array_object_attribute_masks[i] == info->attribute_masks) {
+            glBindVertexArray(vertex_array_object[i]);
+            return SRE_VERTEX_ARRAY_OBJECT_BOUND;
+        }
+    if (nu_vertex_array_objects == SRE_MAX_VERTEX_ARRAY_OBJECTS)
+        return SRE_VERTEX_ARRAY_OBJECT_NONE;
+    int i = nu_vertex_array_objects;
+    glGenVertexArrays(1, &vertex_array_object[i]);
+    vertex_array_object_attribute_masks[i] = info->attribute_masks;
+    nu_vertex_array_objects++;
+    glBindVertexArray(vertex_array_object[i]);
+    return SRE_VERTEX_ARRAY_OBJECT_CREATED;
+}
+
+void sreLODModel::DeleteVertexArrayObjects() {
+    if (nu_vertex_array_objects == 0)
+        return;
+    glDeleteVertexArrays(nu_vertex_array_objects, &vertex_array_object[0]);
+    nu_vertex_array_objects = 0;
+}
+
+void sreUnbindVertexArrayObject() {
+    glBindVertexArray(0);
 }
 
 // Billboarding (dynamic vertex buffers). Note that the vertex attribute for the
 // billboard related shaders only has three components (not homogeneous with an
 // added w = 1.0f), because shadow volumes do not apply.
+//
+// The vertex data is uploaded to the streaming buffer when possible; otherwise the
+// data store of the model's own attribute buffer is re-specified.
+
+// The model whose billboard vertex data was most recently set up, and the offsets of its
+// attributes in the streaming buffer (SRE_STREAMING_BUFFER_FAILED when the model's own
+// attribute buffer was used).
+static const sreLODModel *streamed_billboard_model = NULL;
+static unsigned int streamed_billboard_offset[SRE_NU_VERTEX_ATTRIBUTES];
+
+static void UploadBillboardAttribute(sreLODModel *m, int attribute, const void *data,
+int size) {
+    unsigned int offset = sreUploadToStreamingBuffer(data, size);
+    streamed_billboard_offset[attribute] = offset;
+    if (offset != SRE_STREAMING_BUFFER_FAILED)
+        return;
+    glBindBuffer(GL_ARRAY_BUFFER, m->GL_attribute_buffer[attribute]);
+    glBufferData(GL_ARRAY_BUFFER, size, data, GL_DYNAMIC_DRAW);
+}
+
+// Enable a vertex attribute (position or normal) of a billboard or particle system
+// for drawing, using the location of the most recently uploaded data.
+
+void GL3EnableBillboardAttribute(const sreLODModel *m, int attribute) {
+    unsigned int offset = 0;
+    glEnableVertexAttribArray(attribute);
+    if (m == streamed_billboard_model &&
+    streamed_billboard_offset[attribute] != SRE_STREAMING_BUFFER_FAILED) {
+        glBindBuffer(GL_ARRAY_BUFFER, sre_internal_streaming_buffer);
+        offset = streamed_billboard_offset[attribute];
+    }
+    else
+        glBindBuffer(GL_ARRAY_BUFFER, m->GL_attribute_buffer[attribute]);
+    glVertexAttribPointer(
+        attribute,
+        sre_internal_attribute_size[attribute] >> 2, // Number of floats per vertex.
+        GL_FLOAT,
+        GL_FALSE,
+        0,
+        (void *)(uintptr_t)offset
+        );
+}
 
 void GL3SetBillboard(sreObject *so) {
     Point3D P = so->sphere.center;
@@ -499,12 +624,11 @@ void GL3SetBillboard(sreObject *so) {
     if (so->flags & SRE_OBJECT_LIGHT_HALO)
         for (int i = 0; i < 4; i++)
             m->vertex_normal[i] = P;
-    glBindBuffer(GL_ARRAY_BUFFER, m->GL_attribute_buffer[SRE_ATTRIBUTE_POSITION]);
-    glBufferData(GL_ARRAY_BUFFER, 4 * sizeof(float) * 4, m->vertex, GL_DYNAMIC_DRAW);
-    if (so->flags & SRE_OBJECT_LIGHT_HALO) {
-        glBindBuffer(GL_ARRAY_BUFFER, m->GL_attribute_buffer[SRE_ATTRIBUTE_NORMAL]);
-        glBufferData(GL_ARRAY_BUFFER, 4 * sizeof(float) * 3, m->vertex_normal, GL_DYNAMIC_DRAW);
-    }
+    streamed_billboard_model = m;
+    UploadBillboardAttribute(m, SRE_ATTRIBUTE_POSITION, m->vertex, 4 * sizeof(float) * 4);
+    if (so->flags & SRE_OBJECT_LIGHT_HALO)
+        UploadBillboardAttribute(m, SRE_ATTRIBUTE_NORMAL, m->vertex_normal,
+            4 * sizeof(float) * 3);
 }
 
 void GL3SetParticleSystem(sreObject *so) {
@@ -529,13 +653,10 @@ void GL3SetParticleSystem(sreObject *so) {
     m->nu_vertices = so->nu_particles * 4;
     m->nu_triangles = so->nu_particles * 2;
     // Upload vertex attribute data.
-    glBindBuffer(GL_ARRAY_BUFFER, m->GL_attribute_buffer[SRE_ATTRIBUTE_POSITION]);
-    glBufferData(GL_ARRAY_BUFFER, so->nu_particles * 4 * sizeof(float) * 4,
-        m->position, GL_DYNAMIC_DRAW);
-    
-    if (so->flags & SRE_OBJECT_LIGHT_HALO) {
-        glBindBuffer(GL_ARRAY_BUFFER, m->GL_attribute_buffer[SRE_ATTRIBUTE_NORMAL]);
-        glBufferData(GL_ARRAY_BUFFER, so->nu_particles * 4 * sizeof(float) * 3,
-            m->vertex_normal, GL_DYNAMIC_DRAW);
-    }
+    streamed_billboard_model = m;
+    UploadBillboardAttribute(m, SRE_ATTRIBUTE_POSITION, m->position,
+        so->nu_particles * 4 * sizeof(float) * 4);
+    if (so->flags & SRE_OBJECT_LIGHT_HALO)
+        UploadBillboardAttribute(m, SRE_ATTRIBUTE_NORMAL, m->vertex_normal,
+            so->nu_particles * 4 * sizeof(float) * 3);
 }